@@ -23,6 +23,23 @@
 //!
 //! The animation module is responsible for making the world move.
 //! See header file for documentation
+//!
+//! Animated objects are kept in parallel arrays rather than a struct per object.  Each frame, MoveWorld
+//! works out how far through its animation every entry is, then takes each property in turn,
+//! interpolating it for all entries in one loop over contiguous rows, before writing the results back
+//! to the objects.  Positions and rotations are written straight into the world's ObjectTransformStore,
+//! through the slot each object had when its animation started; the slot's generation tells us if the
+//! object has since been deleted.  Rotations are slerped, which gives the same path as the old
+//! axis-angle interpolation from the end rotation, with the sines precomputed per animation.
+//! Finished animations get a last frame at their end values, and are dropped in the same pass that
+//! drops animations of deleted objects.  The rows start empty and double when a new animation doesnt fit,
+//! and a map from iReference to entry keeps finding an object's animation quick however many there are.
+//!
+//! Tracks are few, and have up to OBJECTTRACKMESSAGE::MAX_KEYS keys each, so PlayTracks just takes them one
+//! at a time: it finds the pair of keys the track is between, eases the fraction between them, and lerps or
+//! slerps each property.  Track rotations are slerped the short way round, so a looping track can turn an
+//! object all the way round with three or more keys.  Tracks use the same slot and generation check as
+//! moves, and are timed from the tick count they started at, so they need no messages while they play.
 
 #ifndef TIXML_USE_STL
 #define TIXML_USE_STL
@@ -51,225 +68,642 @@ using namespace std;
 #include "TickCount.h"
 
 #include "Prim.h"
+#include "XmlHelper.h"
+
+// Stores a vector, rotation, or color as column i of component rows
+static inline void StoreColumn( vector<float> Rows[], const int i, const Vector3 &V )
+{
+    Rows[0][i] = V.x;
+    Rows[1][i] = V.y;
+    Rows[2][i] = V.z;
+}
+
+static inline void StoreColumn( vector<float> Rows[], const int i, const Rot &R )
+{
+    Rows[0][i] = R.x;
+    Rows[1][i] = R.y;
+    Rows[2][i] = R.z;
+    Rows[3][i] = R.s;
+}
+
+static inline void StoreColumn( vector<float> Rows[], const int i, const Color &C )
+{
+    Rows[0][i] = C.r;
+    Rows[1][i] = C.g;
+    Rows[2][i] = C.b;
+}
+
+// Input: Results, Starts, Ends: iNumRows rows of at least iCount values each, iCount > 0
+//        Fractions: how far to go from each start to its end
+//
+// Returns: None
+//
+// Description: Linear interpolation of whole rows; kept free of branches so the compiler can vectorise it
+static void LerpRows( vector<float> Results[], const vector<float> Starts[], const vector<float> Ends[],
+                      const vector<float> &Fractions, const int iNumRows, const int iCount )
+{
+    const float *Fraction = &Fractions[0];
+    for( int iRow = 0; iRow < iNumRows; iRow++ )
+    {
+        float *Result = &Results[ iRow ][0];
+        const float *Start = &Starts[ iRow ][0];
+        const float *End = &Ends[ iRow ][0];
+        for( int i = 0; i < iCount; i++ )
+        {
+            Result[i] = Start[i] + Fraction[i] * ( End[i] - Start[i] );
+        }
+    }
+}
+
+void Animation::GrowMovingObjects()
+{
+    const int iNewCapacity = GetMovingObjectsCapacity() > 0 ? GetMovingObjectsCapacity() * 2 : 64;
+    DEBUG(  "Animation room for " << iNewCapacity << " moving objects" ); // DEBUG
+    References.resize( iNewCapacity );
+    Slots.resize( iNewCapacity );
+    SlotGenerations.resize( iNewCapacity );
+    Changes.resize( iNewCapacity );
+    StartTickCounts.resize( iNewCapacity );
+    EndTickCounts.resize( iNewCapacity );
+    RotAngles.resize( iNewCapacity );
+    RotInverseSines.resize( iNewCapacity );
+    ColorFaces.resize( iNewCapacity );
+    Fractions.resize( iNewCapacity );
+    for( int iRow = 0; iRow < 3; iRow++ )
+    {
+        StartPos[ iRow ].resize( iNewCapacity );
+        EndPos[ iRow ].resize( iNewCapacity );
+        StartScale[ iRow ].resize( iNewCapacity );
+        EndScale[ iRow ].resize( iNewCapacity );
+        StartColor[ iRow ].resize( iNewCapacity );
+        EndColor[ iRow ].resize( iNewCapacity );
+    }
+    for( int iRow = 0; iRow < 4; iRow++ )
+    {
+        StartRot[ iRow ].resize( iNewCapacity );
+        EndRot[ iRow ].resize( iNewCapacity );
+        Results[ iRow ].resize( iNewCapacity );
+    }
+    for( int iRow = 0; iRow < 2; iRow++ )
+    {
+        RotWeights[ iRow ].resize( iNewCapacity );
+    }
+}
+
+void Animation::CopyMovingObject( const int iToArrayNum, const int iFromArrayNum )
+{
+    const int i = iToArrayNum;
+    const int j = iFromArrayNum;
+    References[i] = References[j];
+    MovingObjectArrayNums[ References[i] ] = i;
+    Slots[i] = Slots[j];
+    SlotGenerations[i] = SlotGenerations[j];
+    Changes[i] = Changes[j];
+    StartTickCounts[i] = StartTickCounts[j];
+    EndTickCounts[i] = EndTickCounts[j];
+    RotAngles[i] = RotAngles[j];
+    RotInverseSines[i] = RotInverseSines[j];
+    ColorFaces[i] = ColorFaces[j];
+    for( int iRow = 0; iRow < 3; iRow++ )
+    {
+        StartPos[ iRow ][i] = StartPos[ iRow ][j];
+        EndPos[ iRow ][i] = EndPos[ iRow ][j];
+        StartScale[ iRow ][i] = StartScale[ iRow ][j];
+        EndScale[ iRow ][i] = EndScale[ iRow ][j];
+        StartColor[ iRow ][i] = StartColor[ iRow ][j];
+        EndColor[ iRow ][i] = EndColor[ iRow ][j];
+    }
+    for( int iRow = 0; iRow < 4; iRow++ )
+    {
+        StartRot[ iRow ][i] = StartRot[ iRow ][j];
+        EndRot[ iRow ][i] = EndRot[ iRow ][j];
+    }
+}
+
+bool Animation::IsObjectStillThere( const ObjectTransformStore &Transforms, const int iMoveArrayNum ) const
+{
+    const int iSlot = Slots[ iMoveArrayNum ];
+    return Transforms.Owner( iSlot ) != NULL && Transforms.Generation( iSlot ) == SlotGenerations[ iMoveArrayNum ];
+}
 
 void Animation::RemoveMovingObject( const int iMoveArrayNum )
 {
     DEBUG(  "RemoveMovingObject imovearraynum=" << iMoveArrayNum << " inummovingobjects=" << iNumMovingObjects ); // DEBUG
-    MovingObjects[ iMoveArrayNum ] = MovingObjects[ iNumMovingObjects - 1 ];
+    MovingObjectArrayNums.erase( References[ iMoveArrayNum ] );
+    if( iMoveArrayNum != iNumMovingObjects - 1 )
+    {
+        CopyMovingObject( iMoveArrayNum, iNumMovingObjects - 1 );
+    }
     iNumMovingObjects--;
 }
 
 void Animation::RemoveFromMovingObjects( const int iReference )
 {
-    int iMovingObjectNum = 0;
-    for( iMovingObjectNum = 0; iMovingObjectNum < iNumMovingObjects; iMovingObjectNum++ )
+    int iMovingObjectNum = ReferenceToMovingObjectArrayNum( iReference );
+    if( iMovingObjectNum != -1 )
     {
-        if( MovingObjects[ iMovingObjectNum ].iReference == iReference )
-        {
-            //          DEBUG( "Removing moving object num" << iMovingObjectNum  ); // DEBUG
-            RemoveMovingObject( iMovingObjectNum );
-            return;
-        }
+        //          DEBUG( "Removing moving object num" << iMovingObjectNum  ); // DEBUG
+        RemoveMovingObject( iMovingObjectNum );
     }
+    RemoveTrack( iReference );
+    RemoteObjects.RemoveObject( iReference );
 }
 
 const int Animation::ReferenceToMovingObjectArrayNum( const int iReference )
 {
-    int iMovingObjectNum = 0;
-    for( iMovingObjectNum = 0; iMovingObjectNum < iNumMovingObjects; iMovingObjectNum++ )
+    map<int,int>::const_iterator it = MovingObjectArrayNums.find( iReference );
+    if( it == MovingObjectArrayNums.end() )
     {
-        if( MovingObjects[ iMovingObjectNum ].iReference == iReference )
-        {
-            return iMovingObjectNum;
-        }
+        return -1;
     }
-    return -1;
+    return it->second;
 }
 
-void Animation::UpdateMovingObjectFromXML( const int iReference, const int iObjectArrayPos, const TiXmlElement *pElement )
+void Animation::UpdateMovingObject( const int iObjectArrayPos, const OBJECTMOVEMESSAGE &Move )
 {
-    TiXmlHandle docHandle((TiXmlElement *)pElement );
-    if( !docHandle.FirstChild("dynamics").FirstChild("duration").Element() )
+    if( Move.iDurationMilliseconds < 0 )
     {
         return;
     }
 
-    if( !docHandle.FirstChild("geometry").Element() )
+    RemoveTrack( Move.iReference );   // the move takes over from any track the object was playing
+    RemoteObjects.RemoveObject( Move.iReference );   // and from any snapshots
+
+    Object *pObject = World.GetObject( iObjectArrayPos );
+    bool bIsPrim = ( pObject->TypeTag == OBJECTTYPE_PRIM );
+    if( !Move.bPos && !Move.bRot && !( bIsPrim && ( Move.bScale || Move.bColor ) ) )
     {
         return;
     }
 
+    ObjectTransformStore &Transforms = World.GetTransforms();
+    const ObjectTransformSlot &TransformSlot = pObject->GetTransformSlot();
+    if( TransformSlot.GetStore() != &Transforms )
+    {
+        DEBUG(  "object " << Move.iReference << " has no transform slot, moving it straight to the end" ); // DEBUG
+        RemoveFromMovingObjects( Move.iReference );
+        if( Move.bPos )
+        {
+            pObject->pos = Move.Pos;
+        }
+        if( Move.bRot )
+        {
+            pObject->rot = Move.Rotation;
+        }
+        if( Move.bScale && bIsPrim )
+        {
+            static_cast<Prim *>(pObject)->scale = Move.Scale;
+        }
+        if( Move.bColor && bIsPrim )
+        {
+            static_cast<Prim *>(pObject)->SetColor( Move.iFaceNumber, Move.FaceColor );
+        }
+        return;
+    }
+
     // DEBUG(  "inummovingobjects=" << iNumMovingObjects ); // DEBUG
-    MovingObject *pMovingObject;
-    int iMovingObjectArrayNum = ReferenceToMovingObjectArrayNum( iReference );
-    //  if( !Selector.IsSelected( iReference ) )
-    //  {
-    if( iMovingObjectArrayNum == -1 )
+    int i = ReferenceToMovingObjectArrayNum( Move.iReference );
+    if( i == -1 )
     {
         DEBUG(  "Adding new moving object..." ); // DEBUG
-        iMovingObjectArrayNum = iNumMovingObjects;
-        pMovingObject = &(MovingObjects[ iMovingObjectArrayNum ]);
-        pMovingObject->iReference = iReference;
-        // pMovingObject->iObjectArrayNum = iObjectArrayPos;
+        if( iNumMovingObjects == GetMovingObjectsCapacity() )
+        {
+            GrowMovingObjects();
+        }
+        i = iNumMovingObjects;
+        References[i] = Move.iReference;
+        MovingObjectArrayNums[ Move.iReference ] = i;
 
         iNumMovingObjects++;
     }
     DEBUG(  "Populating moving object..." ); // DEBUG
-    pMovingObject = &(MovingObjects[ iMovingObjectArrayNum ]);
 
-    pMovingObject->bPosChange = false;
-    pMovingObject->bRotChange = false;
-    pMovingObject->bScaleChange = false;
-    pMovingObject->bColorChange = false;
+    Slots[i] = TransformSlot.GetSlot();
+    SlotGenerations[i] = Transforms.Generation( Slots[i] );
+    Changes[i] = 0;
 
-    const TiXmlElement *pDynamics = pElement->FirstChildElement("dynamics");
-    pMovingObject->iStartTickCount = MVGetTickCount();
-    //   DEBUG(  "Getting end tick count..." ); // DEBUG
-    pMovingObject->iEndTickCount = MVGetTickCount() + atoi( pDynamics->FirstChildElement("duration")->Attribute("milliseconds") );
+    int iTickCount = MVGetTickCount();
+    StartTickCounts[i] = iTickCount;
+    EndTickCounts[i] = iTickCount + Move.iDurationMilliseconds;
 
-    //  DEBUG(  "Doing pos..." ); // DEBUG
-    Object *pObject = World.GetObject( iObjectArrayPos );
+    if( Move.bPos )
+    {
+        Changes[i] |= MOVE_POS;
+        StoreColumn( StartPos, i, pObject->pos );
+        StoreColumn( EndPos, i, Move.Pos );
+    }
 
-    const TiXmlElement *pGeometry = pElement->FirstChildElement("geometry");
-    //DEBUG(  "inummovingobjects=" << iNumMovingObjects ); // DEBUG
-    if( pGeometry != NULL )
+    RotAngles[i] = 0;
+    RotInverseSines[i] = 0;
+    if( Move.bRot )
     {
-        if( pGeometry->FirstChildElement("pos") != NULL )
+        Changes[i] |= MOVE_ROT;
+        StoreColumn( StartRot, i, pObject->rot );
+        StoreColumn( EndRot, i, Move.Rotation );
+
+        float fCosAngle = pObject->rot.x * Move.Rotation.x + pObject->rot.y * Move.Rotation.y
+                          + pObject->rot.z * Move.Rotation.z + pObject->rot.s * Move.Rotation.s;
+        if( fCosAngle > 1 )
         {
-            //   DEBUG(  "pos change" ); // DEBUG
-            pMovingObject->bPosChange = true;
-            pMovingObject->StartPos = pObject->pos;
-            pMovingObject->EndPos = Vector3( pElement->FirstChildElement("geometry")->FirstChildElement("pos") );
+            fCosAngle = 1;
         }
-        //   DEBUG(  "Doing rot..." ); // DEBUG
-        //DEBUG(  "inummovingobjects=" << iNumMovingObjects ); // DEBUG
-        if( pGeometry->FirstChildElement("rot") != NULL )
+        else if( fCosAngle < -1 )
         {
-            //   DEBUG(  "rot change" ); // DEBUG
-            pMovingObject->bRotChange = true;
-            pMovingObject->StartRot = pObject->rot;
-            pMovingObject->EndRot = Rot( pElement->FirstChildElement("geometry")->FirstChildElement("rot") );
-
-            Rot InverseEndRot;
-            InverseRot( InverseEndRot, pMovingObject->EndRot );
-            Rot RotFromEndToStart;
-            RotMultiply( RotFromEndToStart, pMovingObject->StartRot, InverseEndRot );
-
-            Rot2AxisAngle( pMovingObject->Axis, pMovingObject->fAngleFromEndToStart, RotFromEndToStart );
-
+            fCosAngle = -1;
         }
-        //  DEBUG(  "Doing scale..." ); // DEBUG
-        // DEBUG(  "inummovingobjects=" << iNumMovingObjects ); // DEBUG
-        if( pGeometry->FirstChildElement("scale") != NULL )
+        RotAngles[i] = acos( fCosAngle );
+        float fSinAngle = sin( RotAngles[i] );
+        if( fabs( fSinAngle ) > 0.0005 )
         {
-            //    DEBUG(  "scale change" ); // DEBUG
-            if( strcmp( pObject->ObjectType, "PRIM" ) == 0 )
-            {
-                pMovingObject->bScaleChange = true;
-                pMovingObject->StartScale = dynamic_cast<Prim *>(pObject)->scale;
-                pMovingObject->EndScale = Vector3( pElement->FirstChildElement("geometry")->FirstChildElement("scale") );
-            }
+            RotInverseSines[i] = 1 / fSinAngle;
         }
     }
-    //  DEBUG(  "Doing color..." ); // DEBUG
-    // DEBUG(  "inummovingobjects=" << iNumMovingObjects ); // DEBUG
-    if( docHandle.FirstChild("faces").FirstChild("face").FirstChild("color").Element() )
+    if( Move.bScale && bIsPrim )
     {
-        if( strcmp( pObject->ObjectType, "PRIM" ) == 0 )
-        {
-            pMovingObject->StartColor = dynamic_cast<Prim *>(pObject)->GetColor(0);
-            pMovingObject->bColorChange = true;
-            pMovingObject->EndColor = Color( pElement->FirstChildElement("faces")->FirstChildElement("face")->FirstChildElement("color") );
-        }
+        Changes[i] |= MOVE_SCALE;
+        StoreColumn( StartScale, i, static_cast<Prim *>(pObject)->scale );
+        StoreColumn( EndScale, i, Move.Scale );
+    }
+    if( Move.bColor && bIsPrim )
+    {
+        Changes[i] |= MOVE_COLOR;
+        ColorFaces[i] = Move.iFaceNumber;
+        StoreColumn( StartColor, i, static_cast<Prim *>(pObject)->GetColor( Move.iFaceNumber ) );
+        StoreColumn( EndColor, i, Move.FaceColor );
     }
-    //     DEBUG(  "moving object updated" ); // DEBUG
     DEBUG(  "inummovingobjects=" << iNumMovingObjects ); // DEBUG
-    //}
 }
 
 void Animation::MoveObjectFromXMLString( const char *XMLString )
 {
-    TiXmlDocument IPC;
-    IPC.Parse( XMLString );
-    MoveObject( IPC.RootElement() );
+    OBJECTMOVEMESSAGE Move;
+    if( ParseObjectMove( XMLString, Move ) )
+    {
+        MoveObject( Move );
+    }
 }
 
-void Animation::MoveObject( const TiXmlElement *pElement )
+void Animation::MoveObject( const OBJECTMOVEMESSAGE &Move )
 {
-    int iReference = atoi( pElement->Attribute("ireference" ) );
-    int iObjectArrayPos = World.GetArrayNumForObjectReference( iReference );
-    if( iObjectArrayPos != -1 )
+    int iObjectArrayPos = World.GetArrayNumForObjectReference( Move.iReference );
+    if( iObjectArrayPos == -1 )
     {
-        UpdateMovingObjectFromXML( iReference, iObjectArrayPos, pElement );
-        //World.p_Objects[ iObjectArrayPos ]->pos = Vector3::Vector3FromXMLElement( pIPC->RootElement()->FirstChildElement("geometry")->FirstChildElement("pos") );
+        return;
     }
+
+    // timestamped moves of just position and rotation are snapshots; anything else, or no room, is a plain move
+    const ObjectTransformSlot &TransformSlot = World.GetObject( iObjectArrayPos )->GetTransformSlot();
+    if( Move.iTimestampMilliseconds >= 0 && Move.bPos && !Move.bScale && !Move.bColor
+            && TransformSlot.GetStore() == &World.GetTransforms() )
+    {
+        if( RemoteObjects.AddSnapshot( World.GetTransforms(), Move.iReference, TransformSlot.GetSlot(), Move.iTimestampMilliseconds,
+                                       Move.Pos, Move.bRot ? &Move.Rotation : NULL, Move.bVelocity ? &Move.Velocity : NULL,
+                                       MVGetTickCount() ) )
+        {
+            RemoveTrack( Move.iReference );
+            int iMovingObjectNum = ReferenceToMovingObjectArrayNum( Move.iReference );
+            if( iMovingObjectNum != -1 )
+            {
+                RemoveMovingObject( iMovingObjectNum );
+            }
+            return;
+        }
+    }
+    UpdateMovingObject( iObjectArrayPos, Move );
 }
 
 void Animation::MoveWorld()
 {
-    float fCurrentTickCount = (float)MVGetTickCount();
-    int iMoveArrayNum;
-    MovingObject *pMovingObject;
+    const int iTickCount = MVGetTickCount();
+    const int iCount = iNumMovingObjects;
+    ObjectTransformStore &Transforms = World.GetTransforms();
+    int i;
 
     // DEBUG(  "MoveWorld() start inummovingobjects=" << iNumMovingObjects ); // DEBUG
-    for( iMoveArrayNum = 0; iMoveArrayNum < iNumMovingObjects; iMoveArrayNum++ )
+    int AllChanges = 0;
+    for( i = 0; i < iCount; i++ )
+    {
+        int iDuration = EndTickCounts[i] - StartTickCounts[i];
+        float fFraction = iDuration > 0 ? (float)( iTickCount - StartTickCounts[i] ) / (float)iDuration : 1.0f;
+        Fractions[i] = fFraction < 0 ? 0 : ( fFraction > 1 ? 1 : fFraction );
+        AllChanges |= Changes[i];
+    }
+
+    if( AllChanges & MOVE_POS )
     {
-        //DEBUG(  "Moving object " << iNumMovingObjects ); // DEBUG
-        pMovingObject = &MovingObjects[ iMoveArrayNum ];
-        if( pMovingObject->iEndTickCount < (int)fCurrentTickCount )
+        LerpRows( Results, StartPos, EndPos, Fractions, 3, iCount );
+        for( i = 0; i < iCount; i++ )
         {
-            DEBUG(  "Descheduling moving object " << iMoveArrayNum ); // DEBUG
-            RemoveMovingObject( iMoveArrayNum );
-            iMoveArrayNum--;
-            //        DEBUG(  "Deschedule done " << iMoveArrayNum ); // DEBUG
+            if( ( Changes[i] & MOVE_POS ) && IsObjectStillThere( Transforms, i ) )
+            {
+                Vector3 &rPos = Transforms.Pos( Slots[i] );
+                rPos.x = Results[0][i];
+                rPos.y = Results[1][i];
+                rPos.z = Results[2][i];
+            }
         }
-        else
+    }
+
+    if( AllChanges & MOVE_ROT )
+    {
+        for( i = 0; i < iCount; i++ )
+        {
+            if( RotInverseSines[i] != 0 )
+            {
+                RotWeights[0][i] = sin( ( 1 - Fractions[i] ) * RotAngles[i] ) * RotInverseSines[i];
+                RotWeights[1][i] = sin( Fractions[i] * RotAngles[i] ) * RotInverseSines[i];
+            }
+            else
+            {
+                RotWeights[0][i] = 1 - Fractions[i];
+                RotWeights[1][i] = Fractions[i];
+            }
+        }
+        for( int iRow = 0; iRow < 4; iRow++ )
+        {
+            for( i = 0; i < iCount; i++ )
+            {
+                Results[ iRow ][i] = RotWeights[0][i] * StartRot[ iRow ][i] + RotWeights[1][i] * EndRot[ iRow ][i];
+            }
+        }
+        for( i = 0; i < iCount; i++ )
+        {
+            if( ( Changes[i] & MOVE_ROT ) && IsObjectStillThere( Transforms, i ) )
+            {
+                Rot &rRot = Transforms.Rotation( Slots[i] );
+                rRot.x = Results[0][i];
+                rRot.y = Results[1][i];
+                rRot.z = Results[2][i];
+                rRot.s = Results[3][i];
+            }
+        }
+    }
+
+    if( AllChanges & MOVE_SCALE )
+    {
+        LerpRows( Results, StartScale, EndScale, Fractions, 3, iCount );
+        for( i = 0; i < iCount; i++ )
+        {
+            if( ( Changes[i] & MOVE_SCALE ) && IsObjectStillThere( Transforms, i ) )
+            {
+                Vector3 &rScale = static_cast<Prim *>( Transforms.Owner( Slots[i] ) )->scale;
+                rScale.x = Results[0][i];
+                rScale.y = Results[1][i];
+                rScale.z = Results[2][i];
+            }
+        }
+    }
+
+    if( AllChanges & MOVE_COLOR )
+    {
+        LerpRows( Results, StartColor, EndColor, Fractions, 3, iCount );
+        for( i = 0; i < iCount; i++ )
+        {
+            if( ( Changes[i] & MOVE_COLOR ) && IsObjectStillThere( Transforms, i ) )
+            {
+                Color NewColor;
+                NewColor.r = Results[0][i];
+                NewColor.g = Results[1][i];
+                NewColor.b = Results[2][i];
+                static_cast<Prim *>( Transforms.Owner( Slots[i] ) )->SetColor( ColorFaces[i], NewColor );
+            }
+        }
+    }
+
+    // drop finished animations, and those whose object has gone, keeping the rest in order
+    int iNumKept = 0;
+    for( i = 0; i < iCount; i++ )
+    {
+        if( EndTickCounts[i] >= iTickCount && IsObjectStillThere( Transforms, i ) )
         {
-            int iObjectArrayNum = World.GetArrayNumForObjectReference( pMovingObject->iReference );
-            if( iObjectArrayNum != -1 )
+            if( iNumKept != i )
             {
-                Object *pObject = World.GetObject( iObjectArrayNum );
-
-                float fMultiplier = (fCurrentTickCount - (float)(pMovingObject->iStartTickCount)) / (float)(pMovingObject->iEndTickCount - pMovingObject->iStartTickCount);
-                //  DEBUG(  "fMultiplier = " << fMultiplier ); // DEBUG
-                if( pMovingObject->bPosChange )
-                {
-                    pObject->pos.x = ( 1 - fMultiplier ) * pMovingObject->StartPos.x + fMultiplier * pMovingObject->EndPos.x;
-                    pObject->pos.y = ( 1 - fMultiplier ) * pMovingObject->StartPos.y + fMultiplier * pMovingObject->EndPos.y;
-                    pObject->pos.z = ( 1 - fMultiplier ) * pMovingObject->StartPos.z + fMultiplier * pMovingObject->EndPos.z;
-                }
-                if( pMovingObject->bScaleChange )
-                {
-                    dynamic_cast<Prim *>(pObject)->scale.x = ( 1 - fMultiplier ) * pMovingObject->StartScale.x + fMultiplier * pMovingObject->EndScale.x;
-                    dynamic_cast<Prim *>(pObject)->scale.y = ( 1 - fMultiplier ) * pMovingObject->StartScale.y + fMultiplier * pMovingObject->EndScale.y;
-                    dynamic_cast<Prim *>(pObject)->scale.z = ( 1 - fMultiplier ) * pMovingObject->StartScale.z + fMultiplier * pMovingObject->EndScale.z;
-                }
-                if( pMovingObject->bRotChange )
-                {
-                    //  DEBUG(  "rot update\n" ); // DEBUG
-                    Rot RotFromEndToCurrent;
-                    AxisAngle2Rot( RotFromEndToCurrent,  pMovingObject->Axis, pMovingObject->fAngleFromEndToStart * ( 1 - fMultiplier ) );
-                    RotMultiply( pObject->rot, RotFromEndToCurrent, pMovingObject->EndRot );
-                    //  DEBUG(  "rot update done\n" ); // DEBUG
-                }
-                if( pMovingObject->bColorChange )
-                {
-                    if( strcmp( pObject->ObjectType, "PRIM" ) == 0 )
-                    {
-                        Color newcolor;
-                        newcolor.r = ( 1 - fMultiplier ) * pMovingObject->StartColor.r + fMultiplier * pMovingObject->EndColor.r;
-                        newcolor.g = ( 1 - fMultiplier ) * pMovingObject->StartColor.g + fMultiplier * pMovingObject->EndColor.g;
-                        newcolor.b = ( 1 - fMultiplier ) * pMovingObject->StartColor.b + fMultiplier * pMovingObject->EndColor.b;
-
-                        dynamic_cast<Prim *>(pObject)->SetColor( 0, newcolor );
-                    }
-                }
+                CopyMovingObject( iNumKept, i );
             }
+            iNumKept++;
+        }
+        else
+        {
+            DEBUG(  "Descheduling moving object " << References[i] ); // DEBUG
+            MovingObjectArrayNums.erase( References[i] );
         }
     }
+    iNumMovingObjects = iNumKept;
     // DEBUG(  "MoveWorld()done" ); // DEBUG
 }
 
+// Input: Easing: curve to use
+//        fFraction: how far between two keys, 0 to 1
+//
+// Returns: the eased fraction, also 0 to 1
+//
+// Description: Quadratic ease in and out, and smoothstep for both
+static float EaseFraction( const TrackEasing Easing, const float fFraction )
+{
+    switch( Easing )
+    {
+    case EASE_IN:
+        return fFraction * fFraction;
+    case EASE_OUT:
+        return fFraction * ( 2 - fFraction );
+    case EASE_INOUT:
+        return fFraction * fFraction * ( 3 - 2 * fFraction );
+    default:
+        return fFraction;
+    }
+}
+
+//! length of one loop of Track; never before its last key
+static int GetTrackPeriod( const OBJECTTRACKMESSAGE &Track )
+{
+    int iLastKeyTime = Track.Keys[ Track.iNumKeys - 1 ].iTimeMilliseconds;
+    return Track.iPeriodMilliseconds > iLastKeyTime ? Track.iPeriodMilliseconds : iLastKeyTime;
+}
+
+const int Animation::ReferenceToTrackArrayNum( const int iReference )
+{
+    for( int iTrackNum = 0; iTrackNum < iNumTracks; iTrackNum++ )
+    {
+        if( Tracks[ iTrackNum ].Track.iReference == iReference )
+        {
+            return iTrackNum;
+        }
+    }
+    return -1;
+}
+
+void Animation::RemoveTrack( const int iReference )
+{
+    int iTrackNum = ReferenceToTrackArrayNum( iReference );
+    if( iTrackNum != -1 )
+    {
+        DEBUG(  "Removing track for object " << iReference ); // DEBUG
+        Tracks[ iTrackNum ] = Tracks[ iNumTracks - 1 ];
+        iNumTracks--;
+    }
+}
+
+void Animation::SetTrackFromXMLString( const char *XMLString )
+{
+    OBJECTTRACKMESSAGE Track;
+    if( ParseObjectTrack( XMLString, Track ) )
+    {
+        SetTrack( Track );
+    }
+}
+
+void Animation::SetTrack( const OBJECTTRACKMESSAGE &Track )
+{
+    RemoveTrack( Track.iReference );
+    if( Track.iNumKeys == 0 )
+    {
+        return;
+    }
+
+    int iObjectArrayPos = World.GetArrayNumForObjectReference( Track.iReference );
+    if( iObjectArrayPos == -1 )
+    {
+        return;
+    }
+    Object *pObject = World.GetObject( iObjectArrayPos );
+    ObjectTransformStore &Transforms = World.GetTransforms();
+    const ObjectTransformSlot &TransformSlot = pObject->GetTransformSlot();
+    if( TransformSlot.GetStore() != &Transforms || iNumTracks == iMaxTracks )
+    {
+        DEBUG(  "object " << Track.iReference << " has no transform slot, or there are too many tracks; not playing its track" ); // DEBUG
+        return;
+    }
+
+    RemoveFromMovingObjects( Track.iReference );   // the track takes over from any move in progress
+
+    ANIMATIONTRACK &Playing = Tracks[ iNumTracks ];
+    iNumTracks++;
+    Playing.iSlot = TransformSlot.GetSlot();
+    Playing.SlotGeneration = Transforms.Generation( Playing.iSlot );
+    Playing.iStartTickCount = MVGetTickCount() - Track.iElapsedMilliseconds;
+    Playing.Track = Track;
+    if( pObject->TypeTag != OBJECTTYPE_PRIM )
+    {
+        Playing.Track.bScale = false;
+        Playing.Track.bColor = false;
+    }
+    DEBUG(  "playing track for object " << Track.iReference << " with " << Track.iNumKeys << " keys, inumtracks=" << iNumTracks ); // DEBUG
+}
+
+void Animation::WriteTrackToXMLWriter( const int iTrackNumber, XmlWriter &Writer )
+{
+    const ANIMATIONTRACK &Playing = Tracks[ iTrackNumber ];
+    OBJECTTRACKMESSAGE Track = Playing.Track;
+    Track.iElapsedMilliseconds = MVGetTickCount() - Playing.iStartTickCount;
+    int iPeriod = GetTrackPeriod( Track );
+    if( Track.bLoop && iPeriod > 0 )
+    {
+        Track.iElapsedMilliseconds %= iPeriod;
+    }
+    WriteObjectTrack( Track, Writer );
+}
+
+void Animation::PlayTracks()
+{
+    const int iTickCount = MVGetTickCount();
+    ObjectTransformStore &Transforms = World.GetTransforms();
+
+    int iNumKept = 0;
+    for( int i = 0; i < iNumTracks; i++ )
+    {
+        const ANIMATIONTRACK &Playing = Tracks[i];
+        const int iSlot = Playing.iSlot;
+        if( Transforms.Owner( iSlot ) == NULL || Transforms.Generation( iSlot ) != Playing.SlotGeneration )
+        {
+            DEBUG(  "Descheduling track of deleted object " << Playing.Track.iReference ); // DEBUG
+            continue;
+        }
+
+        const OBJECTTRACKMESSAGE &Track = Playing.Track;
+        const int iPeriod = GetTrackPeriod( Track );
+        int iTime = iTickCount - Playing.iStartTickCount;
+        if( iTime < 0 )
+        {
+            iTime = 0;
+        }
+        bool bFinished = false;
+        if( Track.bLoop && iPeriod > 0 )
+        {
+            iTime %= iPeriod;
+        }
+        else if( iTime >= iPeriod )
+        {
+            iTime = iPeriod;
+            bFinished = true;
+        }
+
+        // the track is between key iKey and the next, which is the first again after the last key of a loop
+        int iKey = 0;
+        while( iKey + 1 < Track.iNumKeys && Track.Keys[ iKey + 1 ].iTimeMilliseconds <= iTime )
+        {
+            iKey++;
+        }
+        const OBJECTTRACKKEY &From = Track.Keys[ iKey ];
+        const OBJECTTRACKKEY *pTo = &From;
+        int iToTime = From.iTimeMilliseconds;
+        if( iKey + 1 < Track.iNumKeys )
+        {
+            pTo = &Track.Keys[ iKey + 1 ];
+            iToTime = pTo->iTimeMilliseconds;
+        }
+        else if( Track.bLoop )
+        {
+            pTo = &Track.Keys[0];
+            iToTime = iPeriod;
+        }
+        const OBJECTTRACKKEY &To = *pTo;
+        float fFraction = 0;
+        if( iToTime > From.iTimeMilliseconds )
+        {
+            fFraction = EaseFraction( From.Easing, (float)( iTime - From.iTimeMilliseconds ) / (float)( iToTime - From.iTimeMilliseconds ) );
+        }
+
+        if( Track.bPos )
+        {
+            Vector3 &rPos = Transforms.Pos( iSlot );
+            rPos.x = From.Pos.x + fFraction * ( To.Pos.x - From.Pos.x );
+            rPos.y = From.Pos.y + fFraction * ( To.Pos.y - From.Pos.y );
+            rPos.z = From.Pos.z + fFraction * ( To.Pos.z - From.Pos.z );
+        }
+        if( Track.bRot )
+        {
+            RotSlerp( Transforms.Rotation( iSlot ), From.Rotation, To.Rotation, fFraction );
+        }
+        if( Track.bScale )
+        {
+            Vector3 &rScale = static_cast<Prim *>( Transforms.Owner( iSlot ) )->scale;
+            rScale.x = From.Scale.x + fFraction * ( To.Scale.x - From.Scale.x );
+            rScale.y = From.Scale.y + fFraction * ( To.Scale.y - From.Scale.y );
+            rScale.z = From.Scale.z + fFraction * ( To.Scale.z - From.Scale.z );
+        }
+        if( Track.bColor )
+        {
+            Color NewColor;
+            NewColor.r = From.FaceColor.r + fFraction * ( To.FaceColor.r - From.FaceColor.r );
+            NewColor.g = From.FaceColor.g + fFraction * ( To.FaceColor.g - From.FaceColor.g );
+            NewColor.b = From.FaceColor.b + fFraction * ( To.FaceColor.b - From.FaceColor.b );
+            static_cast<Prim *>( Transforms.Owner( iSlot ) )->SetColor( 0, NewColor );
+        }
+
+        if( bFinished )
+        {
+            DEBUG(  "Track finished for object " << Track.iReference ); // DEBUG
+            continue;
+        }
+        if( iNumKept != i )
+        {
+            Tracks[ iNumKept ] = Tracks[i];
+        }
+        iNumKept++;
+    }
+    iNumTracks = iNumKept;
+}
+
 void Animation::AnimateWorld()
 {
     ThisTimeInterval = MVGetTickCount() - iLastElapsedTime;
@@ -281,4 +715,6 @@ void Animation::AnimateWorld()
 
     // MovePlayer();
     MoveWorld();
+    PlayTracks();
+    RemoteObjects.Interpolate( World.GetTransforms(), MVGetTickCount() );
 }
@@ -24,6 +24,8 @@
 //! the animation module is responsible for making the world move:
 //!  - clientside retrospective interpolation of other avatar movements
 //!  - prospective smooth interpolation of object movements wrt size, position, rotation and even colour
+//!  - keyframe tracks, played once or looping
+//!  - snapshot interpolation of timestamped moves, see SnapshotInterpolation.cpp
 //!
 //! animator uses, and manipulates the World object
 //! some other objects (selection and keyandmouse) access objects in animator directlry, for now; probably should clean this up sometime
@@ -47,39 +49,33 @@
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
+#include <map>
+#include <vector>
 using namespace std;
 
 // #include "keyandmouse.h"
 #include "WorldStorage.h"
 #include "Math.h"
 #include "TickCount.h"
+#include "IPCMessages.h"
+#include "SnapshotInterpolation.h"
 
-//! a MovingObject struct holds the data for a single animated object (used by Animation)
-struct MovingObject
+//! Bits of Animation::Changes, saying which properties of an object are being animated
+enum AnimationChanges
 {
-    int iReference;  //!< Object's iReference number (unique within sim and database)
-    //  int iObjectArrayNum;
-
-    bool bPosChange;   //!< true if position is being animated
-    Vector3 StartPos;     //!< start position for animation
-    Vector3 EndPos;        //!< end position for animation
-
-    bool bRotChange;   //!< true if rotation is being animated
-    Rot StartRot;      //!< start rotation for rotation animation
-    Rot EndRot;        //!< end rotation for rotation animation
-    Vector3 Axis;       //!< axis of rotation for rotation animation
-    float fAngleFromEndToStart; //!< Total angular change for rotation animation
-
-    bool bScaleChange;  //!< true if scale is being animated
-    Vector3 StartScale;   //!< scale before animation started
-    Vector3 EndScale;     //!< scale once animation will have finished
-
-    bool bColorChange;  //!< true if color is being animated
-    Color StartColor;   //!< color before animation started
-    Color EndColor;     //!< color after animatino will have finished
+    MOVE_POS = 1,
+    MOVE_ROT = 2,
+    MOVE_SCALE = 4,
+    MOVE_COLOR = 8
+};
 
-    int iStartTickCount; //!< tick count at start of animation (tickcount is basically a measure of time of day)
-    int iEndTickCount;   //!< tick count when animation will have finished
+//! A keyframe track playing on an object; see Animation::SetTrack
+struct ANIMATIONTRACK
+{
+    int iSlot;   //!< the object's slot in the world's ObjectTransformStore
+    unsigned int SlotGeneration;   //!< generation of that slot when the track started; if it has changed, the object has gone
+    int iStartTickCount;   //!< tick count at time 0 of the track
+    OBJECTTRACKMESSAGE Track;
 };
 
 //! Animation handles interpolated non-physical movement
@@ -94,10 +90,10 @@ struct MovingObject
 //!
 //! How to use this class:
 //! - in constructor, pass in a reference to your mvWorldStorage object
-//! - call MoveObject for each animated object; passing in an XML element with structure:
+//! - call MoveObjectFromXMLString for each animated object; passing in an XML message with structure:
 //!
 //!   <pre>
-//!   <someelement>
+//!   <objectmove ireference="...">
 //!   <dynamics>
 //!   <duration milliseconds="..."/>
 //!   </dynamics>
@@ -107,13 +103,37 @@ struct MovingObject
 //!   <color r="..." g="..." b="..."/>  (optional)
 //!   <rot x="..." y="..." z="..." s="..."/>  (optional)
 //!   </geometry>
-//!   </someelement>
+//!   </objectmove>
+//!   </pre>
+//!
+//!   or call MoveObject with the message already parsed by ParseObjectMove.
+//!   Moves with a <timestamp milliseconds="..."/> in their dynamics, giving the sender's tick count, and optionally a
+//!   <velocity .../>, are snapshots of a remote object, eg an avatar, rather than moves to make over a duration;
+//!   they're buffered and played back a little behind the sender by SnapshotInterpolation
+//! - for movements that repeat, or have several steps, call SetTrackFromXMLString with an objecttrack message instead:
+//!
+//!   <pre>
+//!   <objecttrack ireference="..." loop="true" period="..." elapsed="...">
+//!   <key t="..." ease="linear|easein|easeout|easeinout">
+//!   <pos .../> <rot .../> <scale .../> <color .../>  (each optional)
+//!   </key>
+//!   ...
+//!   </objecttrack>
 //!   </pre>
 //!
+//!   t is the time of each key, in milliseconds from the start of the track; ease is the curve to the next key.
+//!   The track plays each frame from AnimateWorld, with no more messages needed, until it ends, or, if it loops,
+//!   until it's replaced by another objecttrack or objectmove for the object.  An objecttrack with no keys stops it.
+//!   WriteTrackToXMLWriter writes a playing track back out, with elapsed set, eg to send to a client that's just connected
 //! - each display/animation frame, call AnimateWorld to animate the world; animated objects will be removed
 //!   from MovingObjects list automatically once their animation has finished
-//! - you can call RemoveFromMovingObjects to stop animating an object, passing in the iReference of the object
+//! - you can call RemoveFromMovingObjects to stop animating an object, passing in the iReference of the object;
+//!   this stops its track too
 //! - you can call GetThisTimeInterval to obtain ThisTimeInterval
+//!
+//! Animated objects are held in parallel arrays, one entry per object, and MoveWorld works down each
+//! property of all entries at once; see Animation.cpp.  The arrays grow as needed, so any object with a slot
+//! in the world's ObjectTransformStore can be animated
 class Animation
 {
 public:
@@ -121,15 +141,21 @@ public:
             World( WorldStorage )
     {
         iNumMovingObjects = 0;
+        iNumTracks = 0;
         ThisTimeInterval = 0;
         iLastElapsedTime = MVGetTickCount();
         //World = WorldStorage;
     }
 
     void MoveObjectFromXMLString( const char *XMLString );         //!< call this to signal a new animated object, input is an XML objectmove command
-    void MoveObject( const TiXmlElement *pElement );         //!< call this to signal a new animated object, input is an XML objectmove command
+    void MoveObject( const OBJECTMOVEMESSAGE &Move );         //!< call this to signal a new animated object, input is a parsed objectmove command
+    void SetTrackFromXMLString( const char *XMLString );   //!< call this to start or stop an object's track, input is an XML objecttrack command
+    void SetTrack( const OBJECTTRACKMESSAGE &Track );      //!< call this to start or stop an object's track, input is a parsed objecttrack command
     void AnimateWorld();                                   //!< call this to animate world for one frame
 
+    void RemoveTrack( const int iReference );              //!< stops an object's track, given its iReference; the object stays where the track had got to
+    void WriteTrackToXMLWriter( const int iTrackNumber, XmlWriter &Writer );  //!< writes track number iTrackNumber as an objecttrack, with elapsed set to how far it has played
+
     void RemoveFromMovingObjects( const int iReference );  //!< removes an animated object given its iReference
     //! Obtain ThisTimeInterval
     int GetThisTimeInterval()
@@ -146,7 +172,13 @@ public:
     //! Obtain iReference for moving object number iMovingObjectNumber
     int GetMovingObjectiReference( int iMovingObjectNumber )
     {
-        return MovingObjects[ iMovingObjectNumber ].iReference;
+        return References[ iMovingObjectNumber ];
+    }
+
+    //! Obtain number of tracks playing
+    int GetNumTracks()
+    {
+        return iNumTracks;
     }
 
 protected:
@@ -156,12 +188,51 @@ protected:
     long iLastElapsedTime;  //!< Ticktime for last frame (measure of time of day)
 
     int iNumMovingObjects;   //!< Number of animated objects currently
-    MovingObject MovingObjects[200];  //!< Stores movement properties for all animated objects
-
+    map<int,int> MovingObjectArrayNums;   //!< entry of each animated object, by iReference
+
+    // One entry per animated object; every row has room for GetMovingObjectsCapacity() entries.
+    // Vectors, rotations and colors are stored a component per row,
+    // eg StartPos[1][i] is the y of entry i's start position, so each row is contiguous
+    vector<int> References;   //!< iReference of the object
+    vector<int> Slots;        //!< the object's slot in the world's ObjectTransformStore
+    vector<unsigned int> SlotGenerations;  //!< generation of that slot when the animation started; if it has changed, the object has gone
+    vector<int> Changes;      //!< AnimationChanges bits: which properties are animated
+    vector<int> StartTickCounts;  //!< tick count at start of animation (tickcount is basically a measure of time of day)
+    vector<int> EndTickCounts;    //!< tick count when animation will have finished
+    vector<float> StartPos[3];
+    vector<float> EndPos[3];
+    vector<float> StartRot[4];    //!< x, y, z, s
+    vector<float> EndRot[4];
+    vector<float> RotAngles;      //!< angle between StartRot and EndRot, as 4-vectors
+    vector<float> RotInverseSines;  //!< 1 / sin( RotAngles ), or 0 if the angle is too small to slerp
+    vector<float> StartScale[3];
+    vector<float> EndScale[3];
+    vector<int> ColorFaces;       //!< face whose color is animated
+    vector<float> StartColor[3];  //!< r, g, b
+    vector<float> EndColor[3];
+
+    // Scratch rows for MoveWorld
+    vector<float> Fractions;      //!< how far through its animation each entry is, 0 to 1
+    vector<float> RotWeights[2];  //!< slerp weights of StartRot and EndRot
+    vector<float> Results[4];     //!< interpolated values of the property being applied
+
+    static const int iMaxTracks = 256;  //!< tracks are for the few objects that keep moving; the rest use objectmoves
+
+    int iNumTracks;   //!< Number of tracks playing
+    ANIMATIONTRACK Tracks[ iMaxTracks ];
+
+    SnapshotInterpolation RemoteObjects;   //!< objects moved by timestamped moves
+
+    int GetMovingObjectsCapacity() const { return (int)References.size(); }  //!< entries the rows have room for
+    void GrowMovingObjects();   //!< Doubles the room in every row, keeping the entries
+    void CopyMovingObject( const int iToArrayNum, const int iFromArrayNum );  //!< Copies every row of one animated object's entry to another
+    bool IsObjectStillThere( const ObjectTransformStore &Transforms, const int iMoveArrayNum ) const;  //!< Checks the animated object still holds the slot it had at the start
     void RemoveMovingObject( const int iMoveArrayNum );  //!< Removes an animated object given its array number
     const int ReferenceToMovingObjectArrayNum( const int iReference ); //!< Obtains the animated object's array number, given the object's iReference number
-    void UpdateMovingObjectFromXML( const int iReference, const int iObjectArrayPos, const TiXmlElement *pElement );   //!< Updates the movement properties of an object from a passed-in XML message
+    void UpdateMovingObject( const int iObjectArrayPos, const OBJECTMOVEMESSAGE &Move );   //!< Updates the movement properties of an object from a passed-in objectmove message
     void MoveWorld();  //!< Runs one frame of animation; moving all objects to next position
+    void PlayTracks();  //!< Runs one frame of the tracks; moving their objects to where the tracks have got to
+    const int ReferenceToTrackArrayNum( const int iReference ); //!< Obtains the track's array number, given its object's iReference number
     void MovePlayer(); //!< Erm, that's strange; this function doesnt actually exist :-O
 
 };
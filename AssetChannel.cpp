@@ -0,0 +1,511 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief clientfileagent's persistent, multiplexed download connection to serverfileagent
+//!
+//! clientfileagent's persistent, multiplexed download connection to serverfileagent
+//! see AssetChannel.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sstream>
+using namespace std;
+
+#include "Diag.h"
+#include "AssetChannel.h"
+
+extern mvsocket MetaverseClientSocket;
+
+const int iMaxChannelAttempts = 3;   //!< connections a download is requested on before we give up on it
+const int iChannelReadChunkSize = 4096;   //!< most frame data read per Receive call
+const char *sChannelEncodings = "heightmap,lz";   //!< encodings we accept, most preferred first
+
+//! Path the partial file of a download of sFilePath in Encoding belongs to
+static string EncodedFilePath( const string &sFilePath, AssetEncoding Encoding )
+{
+	if( Encoding == ASSETENCODING_IDENTITY )
+	{
+		return sFilePath;
+	}
+	return sFilePath + "." + AssetEncodingName( Encoding );
+}
+
+AssetChannelClass::AssetChannelClass()
+{
+	iServerPort = 0;
+	iNextRequestId = 1;
+	iFrameRequestId = -1;
+	iFrameBytesRemaining = 0;
+	bDecodeThreadStarted = false;
+	pthread_mutex_init( &DecodeMutex, NULL );
+	pthread_cond_init( &DecodeCondition, NULL );
+}
+
+// Input: none
+//
+// Returns: True if the channel was opened
+//
+// Description: Connects to sServerIP:iServerPort and asks for a channel
+bool AssetChannelClass::Open()
+{
+	ChannelSocket.Init();
+	ChannelSocket.ConnectToServer( inet_addr( sServerIP.c_str() ), iServerPort );
+	if( !ChannelSocket.IsOpen() )
+	{
+		WARNING( "Couldn't open asset channel to " << sServerIP << ":" << iServerPort );
+		return false;
+	}
+	iFrameRequestId = -1;
+	iFrameBytesRemaining = 0;
+	ChannelSocket.Send( "<loaderchannel/>\n" );
+	DEBUG( "Asset channel open to " << sServerIP << ":" << iServerPort );
+	return true;
+}
+
+// Input: sServerIP, iServerPort: the serverfileagent to use
+//
+// Returns: True if the channel is open to that serverfileagent
+//
+// Description: Downloads still pending on a channel to a different server, eg after a
+//  hyperlink, are failed, since the new server may not have them
+bool AssetChannelClass::Connect( const char *sNewServerIP, int iNewServerPort )
+{
+	if( ChannelSocket.IsOpen() && sServerIP == sNewServerIP && iServerPort == iNewServerPort )
+	{
+		return true;
+	}
+	ChannelSocket.Close();
+	while( !Downloads.empty() )
+	{
+		Downloads.begin()->second.PartialFile.Close();
+		FinishDownload( Downloads.begin()->first, "FAIL" );
+	}
+	sServerIP = sNewServerIP;
+	iServerPort = iNewServerPort;
+	return Open();
+}
+
+// Input: rDownload: the download to ask for
+//
+// Returns: None
+//
+// Description: Asks the server for the download, from wherever its journal says we got to.
+//  A partial download can be in any encoding; the server is told which.
+void AssetChannelClass::SendRequest( CHANNELDOWNLOAD &rDownload )
+{
+	TiXmlDocument Request;
+	Request.Parse( rDownload.sRequest.c_str() );
+	TiXmlElement *pRequest = Request.RootElement();
+
+	rDownload.iAttempts++;
+	rDownload.bBegun = false;
+	rDownload.iBytesRemaining = 0;
+
+	long iOffset = 0;
+	AssetEncoding OffsetEncoding = ASSETENCODING_IDENTITY;
+	for( int i = 0; i < ASSETENCODING_COUNT && iOffset == 0; i++ )
+	{
+		OffsetEncoding = (AssetEncoding)i;
+		iOffset = FileTransGetResumeOffset( EncodedFilePath( rDownload.sFilePath, OffsetEncoding ).c_str(), rDownload.sChecksum.c_str() );
+	}
+	if( iOffset == 0 )
+	{
+		OffsetEncoding = ASSETENCODING_IDENTITY;
+	}
+
+	ostringstream messagestream;
+	messagestream << "<channelget id=\"" << rDownload.iRequestId << "\" type=\"" << pRequest->Attribute("type")
+	<< "\" serverfilename=\"" << pRequest->Attribute("serverfilename") << "\" checksum=\"" << rDownload.sChecksum
+	<< "\" offset=\"" << iOffset << "\" offsetencoding=\"" << AssetEncodingName( OffsetEncoding )
+	<< "\" encodings=\"" << sChannelEncodings << "\" priority=\"" << rDownload.iPriority << "\"/>" << endl;
+	DEBUG( "sending to server " << messagestream.str() );
+	ChannelSocket.Send( messagestream.str().c_str() );
+}
+
+// Input: pRequest: loadergetfile request from metaverseclient
+//        sFilePath: where the file should go
+//
+// Returns: None
+//
+// Description: metaverseclient is sent loaderfiledone when the download finishes or fails.
+//  An optional priority attribute on the request sets the download's priority, default 0
+void AssetChannelClass::RequestFile( TiXmlElement *pRequest, const string &sFilePath )
+{
+	int iRequestId = iNextRequestId++;
+	CHANNELDOWNLOAD &rDownload = Downloads[ iRequestId ];
+	ostringstream requeststream;
+	requeststream << *pRequest;
+	rDownload.iRequestId = iRequestId;
+	rDownload.sRequest = requeststream.str();
+	rDownload.sFilePath = sFilePath;
+	rDownload.sChecksum = pRequest->Attribute("checksum") != NULL ? pRequest->Attribute("checksum") : "";
+	rDownload.iPriority = pRequest->Attribute("priority") != NULL ? atoi( pRequest->Attribute("priority") ) : 0;
+	rDownload.iAttempts = 0;
+	rDownload.Encoding = ASSETENCODING_IDENTITY;
+	rDownload.bDecoding = false;
+	SendRequest( rDownload );
+}
+
+// Input: sChecksum: file whose downloads to reprioritise
+//        iPriority: new priority; higher is sent first
+//
+// Returns: None
+void AssetChannelClass::SetPriority( const char *sChecksum, int iPriority )
+{
+	for( map < int, CHANNELDOWNLOAD >::iterator it = Downloads.begin(); it != Downloads.end(); it++ )
+	{
+		if( it->second.sChecksum == sChecksum && it->second.iPriority != iPriority )
+		{
+			it->second.iPriority = iPriority;
+			ChannelSocket.Send( "<channelpriority id=\"%i\" priority=\"%i\"/>\n", it->first, iPriority );
+		}
+	}
+}
+
+// Input: sChecksum: file whose downloads to cancel
+//
+// Returns: None
+//
+// Description: What has arrived so far stays journaled, so a later request resumes it.
+//  metaverseclient gets a loaderfiledone with result CANCELLED
+void AssetChannelClass::CancelFile( const char *sChecksum )
+{
+	map < int, CHANNELDOWNLOAD >::iterator it = Downloads.begin();
+	while( it != Downloads.end() )
+	{
+		int iRequestId = it->first;
+		bool bCancel = it->second.sChecksum == sChecksum;
+		it++;
+		if( bCancel )
+		{
+			ChannelSocket.Send( "<channelcancel id=\"%i\"/>\n", iRequestId );
+			Downloads[ iRequestId ].PartialFile.Close();
+			FinishDownload( iRequestId, "CANCELLED" );
+		}
+	}
+}
+
+// Input: iRequestId: download that has finished
+//        sResult: SUCCESS, FAIL or CANCELLED
+//
+// Returns: None
+//
+// Description: Tells metaverseclient, and forgets the download
+void AssetChannelClass::FinishDownload( int iRequestId, const char *sResult )
+{
+	map < int, CHANNELDOWNLOAD >::iterator it = Downloads.find( iRequestId );
+	if( it == Downloads.end() )
+	{
+		return;
+	}
+	TiXmlDocument Reply;
+	Reply.Parse( it->second.sRequest.c_str() );
+	Downloads.erase( it );
+	if( Reply.RootElement() == NULL )
+	{
+		return;
+	}
+	Reply.RootElement()->SetValue( "loaderfiledone" );
+	Reply.RootElement()->SetAttribute( "result", sResult );
+	ostringstream messagetoclientstream;
+	messagetoclientstream << Reply << endl;
+	DEBUG( "sending toclient " << messagetoclientstream.str() );
+	MetaverseClientSocket.Send( messagetoclientstream.str().c_str() );
+}
+
+// Input: sHeader: a frame header from the server
+//
+// Returns: None
+void AssetChannelClass::HandleHeader( const char *sHeader )
+{
+	TiXmlDocument Header;
+	Header.Parse( sHeader );
+	TiXmlElement *pHeader = Header.RootElement();
+	if( pHeader == NULL || pHeader->Attribute("id") == NULL )
+	{
+		WARNING( "Unrecognised asset channel header [" << sHeader << "]" );
+		return;
+	}
+	int iRequestId = atoi( pHeader->Attribute("id") );
+	map < int, CHANNELDOWNLOAD >::iterator it = Downloads.find( iRequestId );
+
+	if( strcmp( pHeader->Value(), "channeldata" ) == 0 && pHeader->Attribute("length") != NULL )
+	{
+		// data for a download we've cancelled is read and thrown away
+		iFrameRequestId = iRequestId;
+		iFrameBytesRemaining = atol( pHeader->Attribute("length") );
+		if( it != Downloads.end() && ( !it->second.bBegun || iFrameBytesRemaining > it->second.iBytesRemaining ) )
+		{
+			WARNING( "Unexpected data for download " << iRequestId );
+			it->second.PartialFile.Close();
+			FinishDownload( iRequestId, "FAIL" );
+		}
+	}
+	else if( it == Downloads.end() )
+	{
+		return;
+	}
+	else if( strcmp( pHeader->Value(), "channelbegin" ) == 0 )
+	{
+		CHANNELDOWNLOAD &rDownload = it->second;
+		long iOffset = pHeader->Attribute("offset") != NULL ? atol( pHeader->Attribute("offset") ) : 0;
+		rDownload.iBytesRemaining = pHeader->Attribute("length") != NULL ? atol( pHeader->Attribute("length") ) : 0;
+		rDownload.Encoding = pHeader->Attribute("encoding") != NULL ? AssetEncodingFromName( pHeader->Attribute("encoding") ) : ASSETENCODING_IDENTITY;
+		if( rDownload.Encoding == ASSETENCODING_COUNT
+			|| !rDownload.PartialFile.Open( EncodedFilePath( rDownload.sFilePath, rDownload.Encoding ).c_str(), rDownload.sChecksum.c_str(), iOffset ) )
+		{
+			FinishDownload( iRequestId, "FAIL" );
+			return;
+		}
+		rDownload.bBegun = true;
+		if( rDownload.iBytesRemaining == 0 )
+		{
+			CompleteDownload( iRequestId );
+		}
+	}
+	else if( strcmp( pHeader->Value(), "channelerror" ) == 0 )
+	{
+		WARNING( "Server couldn't send download " << iRequestId );
+		FinishDownload( iRequestId, "FAIL" );
+	}
+}
+
+// Input: buffer, iBytes: frame data that has just arrived
+//
+// Returns: None
+void AssetChannelClass::HandleData( const char *buffer, int iBytes )
+{
+	iFrameBytesRemaining -= iBytes;
+	map < int, CHANNELDOWNLOAD >::iterator it = Downloads.find( iFrameRequestId );
+	if( it == Downloads.end() )
+	{
+		return;
+	}
+	CHANNELDOWNLOAD &rDownload = it->second;
+	rDownload.iBytesRemaining -= iBytes;
+	if( !rDownload.PartialFile.Write( buffer, iBytes ) )
+	{
+		rDownload.PartialFile.Close();
+		FinishDownload( iFrameRequestId, "FAIL" );
+	}
+	else if( rDownload.iBytesRemaining == 0 )
+	{
+		DEBUG( "Download " << iFrameRequestId << " complete, " << rDownload.PartialFile.GetBytesWritten() << " bytes "
+			<< AssetEncodingName( rDownload.Encoding ) );
+		CompleteDownload( iFrameRequestId );
+	}
+}
+
+// Input: iRequestId: download whose data has all arrived
+//
+// Returns: None
+//
+// Description: Unencoded downloads are verified and moved into place straight away;
+//  encoded ones are handed to the decode thread, and reported by ProcessDecoded
+void AssetChannelClass::CompleteDownload( int iRequestId )
+{
+	CHANNELDOWNLOAD &rDownload = Downloads[ iRequestId ];
+	rDownload.PartialFile.Close();
+	if( rDownload.Encoding == ASSETENCODING_IDENTITY )
+	{
+		FinishDownload( iRequestId, FileTransCompleteFile( rDownload.sFilePath.c_str(), rDownload.sChecksum.c_str() ) ? "SUCCESS" : "FAIL" );
+		return;
+	}
+
+	rDownload.bDecoding = true;
+	CHANNELDECODE Decode;
+	Decode.iRequestId = iRequestId;
+	Decode.sFilePath = rDownload.sFilePath;
+	Decode.sEncodedFilePath = EncodedFilePath( rDownload.sFilePath, rDownload.Encoding );
+	Decode.sChecksum = rDownload.sChecksum;
+	Decode.Encoding = rDownload.Encoding;
+	Decode.bResult = false;
+
+	pthread_mutex_lock( &DecodeMutex );
+	if( !bDecodeThreadStarted )
+	{
+		bDecodeThreadStarted = pthread_create( &DecodeThread, NULL, DecodeThreadFunction, this ) == 0;
+	}
+	DecodeQueue.push_back( Decode );
+	pthread_cond_signal( &DecodeCondition );
+	bool bThreadRunning = bDecodeThreadStarted;
+	pthread_mutex_unlock( &DecodeMutex );
+
+	if( !bThreadRunning )
+	{
+		WARNING( "Couldn't start decode thread; decoding download " << iRequestId << " in place" );
+		DecodeLoop();
+	}
+}
+
+void *AssetChannelClass::DecodeThreadFunction( void *pAssetChannel )
+{
+	( (AssetChannelClass *)pAssetChannel )->DecodeLoop();
+	return NULL;
+}
+
+// Input: None
+//
+// Returns: Never on the decode thread; when DecodeQueue is empty if the thread couldn't be started
+//
+// Description: Decodes and verifies queued downloads, one at a time
+void AssetChannelClass::DecodeLoop()
+{
+	pthread_mutex_lock( &DecodeMutex );
+	while( true )
+	{
+		while( DecodeQueue.empty() )
+		{
+			if( !bDecodeThreadStarted )
+			{
+				pthread_mutex_unlock( &DecodeMutex );
+				return;
+			}
+			pthread_cond_wait( &DecodeCondition, &DecodeMutex );
+		}
+		CHANNELDECODE Decode = DecodeQueue.front();
+		DecodeQueue.pop_front();
+		pthread_mutex_unlock( &DecodeMutex );
+
+		Decode.bResult = FileTransCompleteEncodedFile( Decode.sFilePath.c_str(), Decode.sEncodedFilePath.c_str(), Decode.Encoding, Decode.sChecksum.c_str() );
+
+		pthread_mutex_lock( &DecodeMutex );
+		DecodedQueue.push_back( Decode );
+	}
+}
+
+// Input: None
+//
+// Returns: None
+//
+// Description: Tells metaverseclient about downloads the decode thread has finished with
+void AssetChannelClass::ProcessDecoded()
+{
+	pthread_mutex_lock( &DecodeMutex );
+	deque < CHANNELDECODE > Decoded;
+	Decoded.swap( DecodedQueue );
+	pthread_mutex_unlock( &DecodeMutex );
+
+	for( deque < CHANNELDECODE >::iterator it = Decoded.begin(); it != Decoded.end(); it++ )
+	{
+		// a download cancelled while it was decoding has already been reported
+		map < int, CHANNELDOWNLOAD >::iterator download = Downloads.find( it->iRequestId );
+		if( download != Downloads.end() && download->second.bDecoding )
+		{
+			FinishDownload( it->iRequestId, it->bResult ? "SUCCESS" : "FAIL" );
+		}
+	}
+}
+
+bool AssetChannelClass::IsDecoding()
+{
+	for( map < int, CHANNELDOWNLOAD >::iterator it = Downloads.begin(); it != Downloads.end(); it++ )
+	{
+		if( it->second.bDecoding )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Input: None
+//
+// Returns: None
+//
+// Description: Journals what we have, reopens the channel and asks again for everything
+//  unfinished.  Downloads that have had iMaxChannelAttempts connections fail.
+void AssetChannelClass::HandleDisconnect()
+{
+	WARNING( "Asset channel to " << sServerIP << ":" << iServerPort << " lost" );
+	ChannelSocket.Close();
+	iFrameRequestId = -1;
+	iFrameBytesRemaining = 0;
+	bool bReopened = !Downloads.empty() && Open();
+	map < int, CHANNELDOWNLOAD >::iterator it = Downloads.begin();
+	while( it != Downloads.end() )
+	{
+		int iRequestId = it->first;
+		CHANNELDOWNLOAD &rDownload = it->second;
+		it++;
+		if( rDownload.bDecoding )
+		{
+			// nothing more needed from the server
+			continue;
+		}
+		rDownload.PartialFile.Close();
+		if( bReopened && rDownload.iAttempts < iMaxChannelAttempts )
+		{
+			SendRequest( rDownload );
+		}
+		else
+		{
+			FinishDownload( iRequestId, "FAIL" );
+		}
+	}
+}
+
+// Input: None
+//
+// Returns: None
+//
+// Description: Handles frame headers and data that have arrived, returning as soon as the
+//  socket has nothing more for us
+void AssetChannelClass::ProcessIncoming()
+{
+	ProcessDecoded();
+
+	char ReadBuffer[ iChannelReadChunkSize + 1 ];
+	while( ChannelSocket.IsOpen() && ( ChannelSocket.BufferedBytes() > 0 || ChannelSocket.DataAvailable() ) )
+	{
+		if( iFrameBytesRemaining > 0 )
+		{
+			// only ask for what's already buffered, or one recv's worth, so Receive can't block
+			size_t bytes = iFrameBytesRemaining < iChannelReadChunkSize ? iFrameBytesRemaining : iChannelReadChunkSize;
+			if( ChannelSocket.BufferedBytes() > 0 && ChannelSocket.BufferedBytes() < bytes )
+			{
+				bytes = ChannelSocket.BufferedBytes();
+			}
+			int iBytesRead = ChannelSocket.Receive( ReadBuffer, bytes );
+			if( iBytesRead <= 0 )
+			{
+				HandleDisconnect();
+				return;
+			}
+			HandleData( ReadBuffer, iBytesRead );
+		}
+		else
+		{
+			int ReadResult = ChannelSocket.ReceiveLineIfAvailable( ReadBuffer );
+			if( ReadResult == SOCKETS_READ_SOCKETGONE )
+			{
+				HandleDisconnect();
+				return;
+			}
+			else if( ReadResult != SOCKETS_READ_OK )
+			{
+				// only part of a header so far
+				return;
+			}
+			HandleHeader( ReadBuffer );
+		}
+	}
+}
@@ -0,0 +1,131 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief clientfileagent's persistent, multiplexed download connection to serverfileagent
+//!
+//! clientfileagent's persistent, multiplexed download connection to serverfileagent
+//! One connection carries all downloads for a server, with a request id on every frame,
+//! so there's one TCP handshake and slow-start ramp per session rather than per file.
+//! Downloads have priorities, which can be changed, and can be cancelled.
+//! Downloads can arrive encoded (see AssetCodec.h); they're decoded on a background thread,
+//! so a big terrain or texture doesn't hold up the frames for other downloads.
+//! See ServerFileAgent.cpp for the protocol.
+
+#ifndef _ASSETCHANNEL_H
+#define _ASSETCHANNEL_H
+
+#include <map>
+#include <deque>
+#include <string>
+using namespace std;
+
+#include "pthread.h"
+
+#include "tinyxml.h"
+
+#include "SocketsClass.h"
+#include "FileTrans.h"
+
+//! One download requested over the asset channel
+class CHANNELDOWNLOAD
+{
+public:
+	int iRequestId;   //!< our id for the download, carried by every frame
+	string sRequest;   //!< the loadergetfile request from metaverseclient, answered with loaderfiledone
+	string sFilePath;   //!< where the finished file goes
+	string sChecksum;   //!< md5 checksum the file must have
+	int iPriority;   //!< higher is sent first
+	int iAttempts;   //!< connections the download has been requested on
+	long iBytesRemaining;   //!< data still to come in the range the server is sending
+	bool bBegun;   //!< channelbegin received for the current attempt
+	AssetEncoding Encoding;   //!< encoding the server is sending the file in
+	bool bDecoding;   //!< all received, and queued for decoding
+	FileTransPartialFile PartialFile;   //!< journaled partial file the data goes into
+};
+
+//! A received encoded download, to be decoded on the decode thread
+class CHANNELDECODE
+{
+public:
+	int iRequestId;
+	string sFilePath;
+	string sEncodedFilePath;   //!< path the encoded data's partial file belongs to
+	string sChecksum;
+	AssetEncoding Encoding;
+	bool bResult;   //!< set by the decode thread
+};
+
+//! AssetChannelClass manages clientfileagent's persistent download connection to serverfileagent
+
+//! AssetChannelClass manages clientfileagent's persistent download connection to serverfileagent
+//! RequestFile queues a download; ProcessIncoming handles frames as they arrive and tells
+//! metaverseclient about each finished download.  If the connection drops, it is reopened and
+//! unfinished downloads resume from their journals.
+class AssetChannelClass
+{
+public:
+	AssetChannelClass();
+
+	bool Connect( const char *sServerIP, int iServerPort );   //!< Opens the channel, unless it's already open to that server
+	bool IsOpen()
+	{
+		return ChannelSocket.IsOpen();
+	}
+	const mvsocket &GetSocket()
+	{
+		return ChannelSocket;
+	}
+
+	void RequestFile( TiXmlElement *pRequest, const string &sFilePath );   //!< Queues the download asked for by a loadergetfile request
+	void SetPriority( const char *sChecksum, int iPriority );   //!< Reprioritises downloads of sChecksum
+	void CancelFile( const char *sChecksum );   //!< Cancels downloads of sChecksum, eg for objects gone out of view
+	void ProcessIncoming();   //!< Handles whatever the server has sent, and finished decodes, without blocking
+	bool IsDecoding();   //!< True while downloads are waiting on the decode thread
+
+protected:
+	mvsocket ChannelSocket;
+	string sServerIP;
+	int iServerPort;
+	map < int, CHANNELDOWNLOAD > Downloads;   //!< downloads in progress, by request id
+	int iNextRequestId;
+	int iFrameRequestId;   //!< download the data being received belongs to; may no longer exist
+	long iFrameBytesRemaining;   //!< data bytes of the current frame still to receive
+
+	bool bDecodeThreadStarted;
+	pthread_t DecodeThread;
+	pthread_mutex_t DecodeMutex;   //!< guards DecodeQueue and DecodedQueue
+	pthread_cond_t DecodeCondition;   //!< signalled when DecodeQueue gets a job
+	deque < CHANNELDECODE > DecodeQueue;   //!< downloads waiting to be decoded
+	deque < CHANNELDECODE > DecodedQueue;   //!< decoded, waiting for ProcessIncoming to report them
+	static void *DecodeThreadFunction( void *pAssetChannel );
+	void DecodeLoop();
+
+	bool Open();
+	void SendRequest( CHANNELDOWNLOAD &rDownload );
+	void HandleHeader( const char *sHeader );
+	void HandleData( const char *buffer, int iBytes );
+	void CompleteDownload( int iRequestId );
+	void ProcessDecoded();
+	void FinishDownload( int iRequestId, const char *sResult );
+	void HandleDisconnect();
+};
+
+#endif // _ASSETCHANNEL_H
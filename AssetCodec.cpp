@@ -0,0 +1,595 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Encodings that assets can be transferred in
+//!
+//! Encodings that assets can be transferred in
+//! see headerfile for documentation
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+using namespace std;
+
+#include "Diag.h"
+#include "AssetCodec.h"
+
+// Both encodings start with the decoded size, as a 4-byte little-endian integer.
+//
+// lz is a sequence of blocks: a token byte, whose high nibble is the number of literal
+// bytes and low nibble the match length less iLzMinMatch, then any further literal count,
+// the literals, a 2-byte little-endian match offset, and any further match length.
+// A nibble of 15 means the count continues in following bytes, each added on, until
+// one that isn't 255.  The last block has literals only.
+//
+// heightmap is a bit stream, most significant bit first.  Each row starts with a 3-bit
+// Rice parameter k; then each height's prediction error, zigzag-mapped to 0..255,
+// is sent as v >> k in unary, as one bits ended by a zero, then the low k bits of v.
+// Heights are predicted by the LOCO-I median predictor from the heights left, above
+// and above-left.
+
+static const size_t iLzMinMatch = 4;   //!< shortest match lz encodes
+static const size_t iLzMaxOffset = 65535;   //!< furthest back an lz match can be
+static const int iLzHashBits = 14;   //!< log2 of the lz match finder's hash table size
+static const int iHeightmapMaxRiceParameter = 7;
+
+static const char *AssetEncodingNames[ ASSETENCODING_COUNT ] =
+    {
+        "identity",
+        "lz",
+        "heightmap"
+    };
+
+const char *AssetEncodingName( AssetEncoding Encoding )
+{
+    if( Encoding < 0 || Encoding >= ASSETENCODING_COUNT )
+    {
+        return "";
+    }
+    return AssetEncodingNames[ Encoding ];
+}
+
+AssetEncoding AssetEncodingFromName( const char *sName )
+{
+    for( int i = 0; i < ASSETENCODING_COUNT; i++ )
+    {
+        if( sName != NULL && strcmp( sName, AssetEncodingNames[i] ) == 0 )
+        {
+            return (AssetEncoding)i;
+        }
+    }
+    return ASSETENCODING_COUNT;
+}
+
+//! Returns the width of a square heightmap of iSize bytes, or 0 if iSize isn't square
+static size_t HeightmapWidth( size_t iSize )
+{
+    size_t iWidth = (size_t)( sqrt( (double)iSize ) + 0.5 );
+    return iWidth > 0 && iWidth * iWidth == iSize ? iWidth : 0;
+}
+
+bool AssetEncodingApplies( AssetEncoding Encoding, const char *sFiletype, size_t iSize )
+{
+    switch( Encoding )
+    {
+    case ASSETENCODING_IDENTITY:
+        return true;
+    case ASSETENCODING_LZ:
+        return iSize > 0;
+    case ASSETENCODING_HEIGHTMAP:
+        return strcmp( sFiletype, "TERRAIN" ) == 0 && HeightmapWidth( iSize ) > 0;
+    default:
+        return false;
+    }
+}
+
+static void WriteSize( string &Out, size_t iSize )
+{
+    for( int i = 0; i < 4; i++ )
+    {
+        Out += (char)( ( iSize >> ( 8 * i ) ) & 0xff );
+    }
+}
+
+static bool ReadSize( const string &In, size_t &iSize )
+{
+    if( In.size() < 4 )
+    {
+        return false;
+    }
+    iSize = 0;
+    for( int i = 0; i < 4; i++ )
+    {
+        iSize |= (size_t)(unsigned char)In[i] << ( 8 * i );
+    }
+    return true;
+}
+
+static inline unsigned int Read32( const unsigned char *p )
+{
+    unsigned int value;
+    memcpy( &value, p, 4 );
+    return value;
+}
+
+//! Appends the part of a count beyond a token nibble of 15
+static void LzWriteCount( string &Out, size_t iCount )
+{
+    iCount -= 15;
+    while( iCount >= 255 )
+    {
+        Out += (char)255;
+        iCount -= 255;
+    }
+    Out += (char)iCount;
+}
+
+//! Adds on the part of a count beyond a token nibble of 15; returns false if In runs out
+static bool LzReadCount( const string &In, size_t &iPos, size_t &iCount )
+{
+    unsigned char byte;
+    do
+    {
+        if( iPos >= In.size() )
+        {
+            return false;
+        }
+        byte = (unsigned char)In[ iPos++ ];
+        iCount += byte;
+    }
+    while( byte == 255 );
+    return true;
+}
+
+//! Appends one lz block: the literals Raw[iLiteralStart, iLiteralEnd), then a match, if iMatchLength isn't 0
+static void LzWriteBlock( string &Out, const string &Raw, size_t iLiteralStart, size_t iLiteralEnd, size_t iMatchOffset, size_t iMatchLength )
+{
+    size_t iLiterals = iLiteralEnd - iLiteralStart;
+    size_t iMatchCode = iMatchLength > 0 ? iMatchLength - iLzMinMatch : 0;
+    Out += (char)( ( ( iLiterals < 15 ? iLiterals : 15 ) << 4 ) | ( iMatchCode < 15 ? iMatchCode : 15 ) );
+    if( iLiterals >= 15 )
+    {
+        LzWriteCount( Out, iLiterals );
+    }
+    Out.append( Raw, iLiteralStart, iLiterals );
+    if( iMatchLength > 0 )
+    {
+        Out += (char)( iMatchOffset & 0xff );
+        Out += (char)( iMatchOffset >> 8 );
+        if( iMatchCode >= 15 )
+        {
+            LzWriteCount( Out, iMatchCode );
+        }
+    }
+}
+
+static bool LzEncode( const string &Raw, string &Encoded )
+{
+    const unsigned char *p = (const unsigned char *)Raw.data();
+    size_t iSize = Raw.size();
+    vector<size_t> HashTable( 1 << iLzHashBits, (size_t)-1 );
+
+    Encoded.clear();
+    Encoded.reserve( iSize / 2 + 16 );
+    WriteSize( Encoded, iSize );
+
+    size_t iLiteralStart = 0;
+    size_t i = 0;
+    while( i + iLzMinMatch <= iSize )
+    {
+        unsigned int Sequence = Read32( p + i );
+        unsigned int iHash = ( Sequence * 2654435761U ) >> ( 32 - iLzHashBits );
+        size_t iCandidate = HashTable[ iHash ];
+        HashTable[ iHash ] = i;
+        if( iCandidate != (size_t)-1 && i - iCandidate <= iLzMaxOffset && Read32( p + iCandidate ) == Sequence )
+        {
+            size_t iMatchLength = iLzMinMatch;
+            while( i + iMatchLength < iSize && p[ iCandidate + iMatchLength ] == p[ i + iMatchLength ] )
+            {
+                iMatchLength++;
+            }
+            LzWriteBlock( Encoded, Raw, iLiteralStart, i, i - iCandidate, iMatchLength );
+            i += iMatchLength;
+            iLiteralStart = i;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    if( iLiteralStart < iSize )
+    {
+        LzWriteBlock( Encoded, Raw, iLiteralStart, iSize, 0, 0 );
+    }
+    return true;
+}
+
+static bool LzDecode( const string &Encoded, string &Raw )
+{
+    size_t iSize;
+    if( !ReadSize( Encoded, iSize ) )
+    {
+        return false;
+    }
+    Raw.clear();
+    Raw.reserve( iSize );
+    size_t iPos = 4;
+    while( Raw.size() < iSize )
+    {
+        if( iPos >= Encoded.size() )
+        {
+            return false;
+        }
+        unsigned char Token = (unsigned char)Encoded[ iPos++ ];
+        size_t iLiterals = Token >> 4;
+        if( iLiterals == 15 && !LzReadCount( Encoded, iPos, iLiterals ) )
+        {
+            return false;
+        }
+        if( iLiterals > Encoded.size() - iPos || iLiterals > iSize - Raw.size() )
+        {
+            return false;
+        }
+        Raw.append( Encoded, iPos, iLiterals );
+        iPos += iLiterals;
+        if( Raw.size() == iSize )
+        {
+            break;
+        }
+
+        if( iPos + 2 > Encoded.size() )
+        {
+            return false;
+        }
+        size_t iOffset = (unsigned char)Encoded[ iPos ] | ( (size_t)(unsigned char)Encoded[ iPos + 1 ] << 8 );
+        iPos += 2;
+        size_t iMatchLength = Token & 0x0f;
+        if( iMatchLength == 15 && !LzReadCount( Encoded, iPos, iMatchLength ) )
+        {
+            return false;
+        }
+        iMatchLength += iLzMinMatch;
+        if( iOffset == 0 || iOffset > Raw.size() || iMatchLength > iSize - Raw.size() )
+        {
+            return false;
+        }
+        // byte by byte, since a match can overlap the bytes it produces
+        size_t iFrom = Raw.size() - iOffset;
+        for( size_t i = 0; i < iMatchLength; i++ )
+        {
+            Raw += Raw[ iFrom + i ];
+        }
+    }
+    return iPos == Encoded.size();
+}
+
+//! Writes a stream of bits, most significant first
+class BITWRITER
+{
+public:
+    string &Out;
+    unsigned int iBits;
+    int iBitCount;
+
+    BITWRITER( string &rOut ) : Out( rOut )
+    {
+        iBits = 0;
+        iBitCount = 0;
+    }
+    void Write( unsigned int iValue, int iCount )
+    {
+        for( int i = iCount - 1; i >= 0; i-- )
+        {
+            iBits = ( iBits << 1 ) | ( ( iValue >> i ) & 1 );
+            if( ++iBitCount == 8 )
+            {
+                Out += (char)iBits;
+                iBits = 0;
+                iBitCount = 0;
+            }
+        }
+    }
+    void Flush()
+    {
+        if( iBitCount > 0 )
+        {
+            Write( 0, 8 - iBitCount );
+        }
+    }
+};
+
+//! Reads a stream of bits written by BITWRITER
+class BITREADER
+{
+public:
+    const string &In;
+    size_t iPos;
+    int iBitPos;
+
+    BITREADER( const string &rIn, size_t iStart ) : In( rIn )
+    {
+        iPos = iStart;
+        iBitPos = 0;
+    }
+    //! Reads one bit into iBit; returns false if the stream has run out
+    bool ReadBit( unsigned int &iBit )
+    {
+        if( iPos >= In.size() )
+        {
+            return false;
+        }
+        iBit = ( (unsigned char)In[ iPos ] >> ( 7 - iBitPos ) ) & 1;
+        if( ++iBitPos == 8 )
+        {
+            iBitPos = 0;
+            iPos++;
+        }
+        return true;
+    }
+    bool Read( unsigned int &iValue, int iCount )
+    {
+        iValue = 0;
+        for( int i = 0; i < iCount; i++ )
+        {
+            unsigned int iBit;
+            if( !ReadBit( iBit ) )
+            {
+                return false;
+            }
+            iValue = ( iValue << 1 ) | iBit;
+        }
+        return true;
+    }
+};
+
+//! LOCO-I median predictor of the height at x,y
+static inline int HeightmapPredict( const unsigned char *pHeights, size_t iWidth, size_t x, size_t y )
+{
+    if( y == 0 )
+    {
+        return x == 0 ? 0 : pHeights[ x - 1 ];
+    }
+    int Up = pHeights[ x + ( y - 1 ) * iWidth ];
+    if( x == 0 )
+    {
+        return Up;
+    }
+    int Left = pHeights[ x - 1 + y * iWidth ];
+    int UpLeft = pHeights[ x - 1 + ( y - 1 ) * iWidth ];
+    int Lower = Left < Up ? Left : Up;
+    int Higher = Left < Up ? Up : Left;
+    if( UpLeft >= Higher )
+    {
+        return Lower;
+    }
+    if( UpLeft <= Lower )
+    {
+        return Higher;
+    }
+    return Left + Up - UpLeft;
+}
+
+static bool HeightmapEncode( const string &Raw, string &Encoded )
+{
+    size_t iWidth = HeightmapWidth( Raw.size() );
+    if( iWidth == 0 )
+    {
+        return false;
+    }
+    const unsigned char *pHeights = (const unsigned char *)Raw.data();
+
+    Encoded.clear();
+    WriteSize( Encoded, Raw.size() );
+    BITWRITER Bits( Encoded );
+    vector<unsigned int> Errors( iWidth );
+    for( size_t y = 0; y < iWidth; y++ )
+    {
+        for( size_t x = 0; x < iWidth; x++ )
+        {
+            // the error wraps modulo 256, so it fits a signed char; zigzag it to 0..255
+            signed char Error = (signed char)( pHeights[ x + y * iWidth ] - HeightmapPredict( pHeights, iWidth, x, y ) );
+            Errors[ x ] = Error >= 0 ? 2 * Error : -2 * Error - 1;
+        }
+
+        int iBestParameter = 0;
+        size_t iBestBits = (size_t)-1;
+        for( int k = 0; k <= iHeightmapMaxRiceParameter; k++ )
+        {
+            size_t iBits = 0;
+            for( size_t x = 0; x < iWidth; x++ )
+            {
+                iBits += ( Errors[ x ] >> k ) + 1 + k;
+            }
+            if( iBits < iBestBits )
+            {
+                iBestBits = iBits;
+                iBestParameter = k;
+            }
+        }
+
+        Bits.Write( iBestParameter, 3 );
+        for( size_t x = 0; x < iWidth; x++ )
+        {
+            for( unsigned int q = Errors[ x ] >> iBestParameter; q > 0; q-- )
+            {
+                Bits.Write( 1, 1 );
+            }
+            Bits.Write( 0, 1 );
+            Bits.Write( Errors[ x ], iBestParameter );
+        }
+    }
+    Bits.Flush();
+    return true;
+}
+
+static bool HeightmapDecode( const string &Encoded, string &Raw )
+{
+    size_t iSize;
+    if( !ReadSize( Encoded, iSize ) )
+    {
+        return false;
+    }
+    size_t iWidth = HeightmapWidth( iSize );
+    if( iWidth == 0 )
+    {
+        return false;
+    }
+
+    Raw.assign( iSize, '\0' );
+    unsigned char *pHeights = (unsigned char *)&Raw[0];
+    BITREADER Bits( Encoded, 4 );
+    for( size_t y = 0; y < iWidth; y++ )
+    {
+        unsigned int k;
+        if( !Bits.Read( k, 3 ) )
+        {
+            return false;
+        }
+        for( size_t x = 0; x < iWidth; x++ )
+        {
+            unsigned int q = 0;
+            unsigned int iBit;
+            while( true )
+            {
+                if( !Bits.ReadBit( iBit ) )
+                {
+                    return false;
+                }
+                if( iBit == 0 )
+                {
+                    break;
+                }
+                if( ++q > ( 255U >> k ) )
+                {
+                    return false;
+                }
+            }
+            unsigned int iLowBits;
+            if( !Bits.Read( iLowBits, k ) )
+            {
+                return false;
+            }
+            unsigned int v = ( q << k ) | iLowBits;
+            if( v > 255 )
+            {
+                return false;
+            }
+            int Error = ( v & 1 ) ? -(int)( ( v + 1 ) / 2 ) : (int)( v / 2 );
+            pHeights[ x + y * iWidth ] = (unsigned char)( HeightmapPredict( pHeights, iWidth, x, y ) + Error );
+        }
+    }
+    return true;
+}
+
+bool AssetEncode( AssetEncoding Encoding, const string &Raw, string &Encoded )
+{
+    switch( Encoding )
+    {
+    case ASSETENCODING_IDENTITY:
+        Encoded = Raw;
+        return true;
+    case ASSETENCODING_LZ:
+        return LzEncode( Raw, Encoded );
+    case ASSETENCODING_HEIGHTMAP:
+        return HeightmapEncode( Raw, Encoded );
+    default:
+        return false;
+    }
+}
+
+bool AssetDecode( AssetEncoding Encoding, const string &Encoded, string &Raw )
+{
+    switch( Encoding )
+    {
+    case ASSETENCODING_IDENTITY:
+        Raw = Encoded;
+        return true;
+    case ASSETENCODING_LZ:
+        return LzDecode( Encoded, Raw );
+    case ASSETENCODING_HEIGHTMAP:
+        return HeightmapDecode( Encoded, Raw );
+    default:
+        return false;
+    }
+}
+
+//! Reads all of file sFilePath into Contents
+static bool ReadWholeFile( const char *sFilePath, string &Contents )
+{
+    FILE *pFile = fopen( sFilePath, "rb" );
+    if( pFile == NULL )
+    {
+        ERRORMSG( "Unable to open " << sFilePath );
+        return false;
+    }
+    Contents.clear();
+    char buffer[ 65536 ];
+    size_t iBytesRead;
+    while( ( iBytesRead = fread( buffer, 1, sizeof( buffer ), pFile ) ) > 0 )
+    {
+        Contents.append( buffer, iBytesRead );
+    }
+    bool bResult = !ferror( pFile );
+    fclose( pFile );
+    return bResult;
+}
+
+//! Writes Contents to file sFilePath
+static bool WriteWholeFile( const char *sFilePath, const string &Contents )
+{
+    FILE *pFile = fopen( sFilePath, "wb" );
+    if( pFile == NULL )
+    {
+        ERRORMSG( "Unable to open " << sFilePath << " for writing" );
+        return false;
+    }
+    bool bResult = fwrite( Contents.data(), 1, Contents.size(), pFile ) == Contents.size();
+    bResult = fclose( pFile ) == 0 && bResult;
+    if( !bResult )
+    {
+        ERRORMSG( "Unable to write " << sFilePath );
+    }
+    return bResult;
+}
+
+bool AssetEncodeFile( AssetEncoding Encoding, const char *sSourcePath, const char *sTargetPath )
+{
+    string Raw;
+    string Encoded;
+    return ReadWholeFile( sSourcePath, Raw ) && AssetEncode( Encoding, Raw, Encoded ) && WriteWholeFile( sTargetPath, Encoded );
+}
+
+bool AssetDecodeFile( AssetEncoding Encoding, const char *sSourcePath, const char *sTargetPath )
+{
+    string Encoded;
+    string Raw;
+    if( !ReadWholeFile( sSourcePath, Encoded ) )
+    {
+        return false;
+    }
+    if( !AssetDecode( Encoding, Encoded, Raw ) )
+    {
+        ERRORMSG( "Corrupt " << AssetEncodingName( Encoding ) << " data in " << sSourcePath );
+        return false;
+    }
+    return WriteWholeFile( sTargetPath, Raw );
+}
@@ -0,0 +1,66 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Encodings that assets can be transferred in
+//!
+//! Encodings that assets can be transferred in
+//! serverfileagent keeps encoded variants of assets next to the originals, and sends one when
+//! the client accepts that encoding and it's worthwhile; clientfileagent decodes it back
+//! to the original before checking the md5 checksum.
+//! - lz: a fast general-purpose LZ77 byte codec, for textures, meshes and scripts
+//! - heightmap: for square 8-bit terrain heightmaps; each height is predicted from its
+//!   neighbours, and the prediction errors Rice-coded row by row
+
+#ifndef _ASSETCODEC_H
+#define _ASSETCODEC_H
+
+#include <string>
+using namespace std;
+
+//! An encoding an asset can be transferred in
+enum AssetEncoding
+{
+    ASSETENCODING_IDENTITY,   //!< the original file
+    ASSETENCODING_LZ,   //!< general-purpose LZ77
+    ASSETENCODING_HEIGHTMAP,   //!< predictive coding of square 8-bit heightmaps
+
+    ASSETENCODING_COUNT
+};
+
+const char *AssetEncodingName( AssetEncoding Encoding );   //!< Name of Encoding on the wire, eg "lz"
+AssetEncoding AssetEncodingFromName( const char *sName );   //!< Encoding called sName, or ASSETENCODING_COUNT if unknown
+
+//! Returns true if Encoding can be used for an asset of type sFiletype and iSize bytes
+bool AssetEncodingApplies( AssetEncoding Encoding, const char *sFiletype, size_t iSize );
+
+//! Encodes Raw into Encoded; returns false if Encoding doesn't apply to the data
+bool AssetEncode( AssetEncoding Encoding, const string &Raw, string &Encoded );
+
+//! Decodes Encoded into Raw; returns false if Encoded is corrupt
+bool AssetDecode( AssetEncoding Encoding, const string &Encoded, string &Raw );
+
+//! Encodes file sSourcePath into file sTargetPath; returns true if it worked
+bool AssetEncodeFile( AssetEncoding Encoding, const char *sSourcePath, const char *sTargetPath );
+
+//! Decodes file sSourcePath into file sTargetPath; returns true if it worked
+bool AssetDecodeFile( AssetEncoding Encoding, const char *sSourcePath, const char *sTargetPath );
+
+#endif // _ASSETCODEC_H
@@ -0,0 +1,290 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Content-addressed store of the asset files served by serverfileagent
+// see headerfile AssetStore.h for documentation
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <map>
+#include <string>
+using namespace std;
+
+#include "Diag.h"
+#include "Checksum.h"
+#include "AssetStore.h"
+
+AssetStore::AssetStore( size_t iMaxHotBytes, int iMaxMappedAssets )
+{
+    this->iMaxHotBytes = iMaxHotBytes;
+    this->iMaxMappedAssets = iMaxMappedAssets;
+    iHotBytes = 0;
+    iMappedAssets = 0;
+    iRequestCounter = 0;
+    iMisses = 0;
+    for( int i = 0; i < ASSETSOURCE_COUNT; i++ )
+    {
+        iHits[i] = 0;
+        BytesServed[i] = 0;
+    }
+}
+
+AssetStore::~AssetStore()
+{
+    map < string, ASSETINFO, less<string> >::iterator iterator;
+    for( iterator = Assets.begin(); iterator != Assets.end(); iterator++ )
+    {
+        delete[] iterator->second.pMemoryCopy;
+        Unmap( iterator->second );
+    }
+}
+
+const char *AssetStore::Acquire( const string &sChecksum, const string &sFilePath, size_t &iSize, AssetSource &Source )
+{
+    map < string, ASSETINFO, less<string> >::iterator iterator = Assets.find( sChecksum );
+    if( iterator == Assets.end() )
+    {
+        if( sFilePath == "" )
+        {
+            return NULL;
+        }
+
+        // content-addressed: only index the file under the checksum it actually has
+        if( GenerateCheckString( sFilePath ) != sChecksum )
+        {
+            WARNING( "Asset file " << sFilePath << " doesnt match requested checksum " << sChecksum << "; not storing" );
+            return NULL;
+        }
+        ASSETINFO NewAsset;
+        NewAsset.sFilePath = sFilePath;
+        iterator = Assets.insert( make_pair( sChecksum, NewAsset ) ).first;
+    }
+
+    ASSETINFO &rAsset = iterator->second;
+    iRequestCounter++;
+    if( rAsset.pMemoryCopy != NULL )
+    {
+        iHits[ ASSETSOURCE_MEMORY ]++;
+    }
+    else if( rAsset.pMapping != NULL )
+    {
+        iHits[ ASSETSOURCE_MAPPED ]++;
+    }
+    else
+    {
+        iMisses++;
+        if( !Map( rAsset ) )
+        {
+            Assets.erase( iterator );
+            return NULL;
+        }
+    }
+
+    rAsset.iRequests++;
+    rAsset.iUsers++;
+    rAsset.iLastUsed = iRequestCounter;
+    if( rAsset.pMemoryCopy == NULL && rAsset.iRequests >= 2 && rAsset.iSize <= iMaxHotBytes / 4 )
+    {
+        Promote( rAsset );
+    }
+    Trim();
+
+    iSize = rAsset.iSize;
+    if( rAsset.pMemoryCopy != NULL )
+    {
+        Source = ASSETSOURCE_MEMORY;
+        return rAsset.pMemoryCopy;
+    }
+    Source = ASSETSOURCE_MAPPED;
+    return (const char *)rAsset.pMapping;
+}
+
+void AssetStore::Release( const string &sChecksum )
+{
+    map < string, ASSETINFO, less<string> >::iterator iterator = Assets.find( sChecksum );
+    if( iterator != Assets.end() && iterator->second.iUsers > 0 )
+    {
+        iterator->second.iUsers--;
+        Trim();
+    }
+}
+
+void AssetStore::AddBytesServed( AssetSource Source, size_t iBytes )
+{
+    BytesServed[ Source ] += iBytes;
+}
+
+void AssetStore::ReportStatistics()
+{
+    unsigned long iRequests = iHits[ ASSETSOURCE_MEMORY ] + iHits[ ASSETSOURCE_MAPPED ] + iMisses;
+    if( iRequests == 0 )
+    {
+        return;
+    }
+    INFO( "Asset store: " << iRequests << " requests, memory hit ratio " << ( 100.0 * iHits[ ASSETSOURCE_MEMORY ] / iRequests )
+          << "%, overall hit ratio " << ( 100.0 * ( iRequests - iMisses ) / iRequests ) << "%; "
+          << "memory " << iHits[ ASSETSOURCE_MEMORY ] << " hits " << BytesServed[ ASSETSOURCE_MEMORY ] << " bytes, "
+          << "mapped " << iHits[ ASSETSOURCE_MAPPED ] << " hits " << BytesServed[ ASSETSOURCE_MAPPED ] << " bytes, "
+          << iMisses << " loads from disk; " << iHotBytes << " bytes hot, " << iMappedAssets << " assets mapped" );
+}
+
+//! Maps rAsset's file into memory, setting rAsset.iSize
+bool AssetStore::Map( ASSETINFO &rAsset )
+{
+    struct stat FileInfo;
+    if( stat( rAsset.sFilePath.c_str(), &FileInfo ) != 0 )
+    {
+        ERRORMSG( "Unable to stat asset file " << rAsset.sFilePath );
+        return false;
+    }
+    rAsset.iSize = FileInfo.st_size;
+    if( rAsset.iSize == 0 )
+    {
+        // nothing to map; an empty hot copy serves it
+        rAsset.pMemoryCopy = new char[ 1 ];
+        return true;
+    }
+
+#ifndef _WIN32
+    int iFileDescriptor = open( rAsset.sFilePath.c_str(), O_RDONLY );
+    if( iFileDescriptor == -1 )
+    {
+        ERRORMSG( "Unable to open asset file " << rAsset.sFilePath );
+        return false;
+    }
+    void *pMapping = mmap( NULL, rAsset.iSize, PROT_READ, MAP_SHARED, iFileDescriptor, 0 );
+    close( iFileDescriptor );
+    if( pMapping == MAP_FAILED )
+    {
+        ERRORMSG( "Unable to map asset file " << rAsset.sFilePath );
+        return false;
+    }
+    rAsset.pMapping = pMapping;
+#else
+    // no mmap here; a private copy stands in for the mapped view
+    FILE *pFile = fopen( rAsset.sFilePath.c_str(), "rb" );
+    if( pFile == NULL )
+    {
+        ERRORMSG( "Unable to open asset file " << rAsset.sFilePath );
+        return false;
+    }
+    char *pCopy = new char[ rAsset.iSize ];
+    size_t iBytesRead = fread( pCopy, 1, rAsset.iSize, pFile );
+    fclose( pFile );
+    if( iBytesRead != rAsset.iSize )
+    {
+        ERRORMSG( "Unable to read asset file " << rAsset.sFilePath );
+        delete[] pCopy;
+        return false;
+    }
+    rAsset.pMapping = pCopy;
+#endif
+
+    iMappedAssets++;
+    return true;
+}
+
+void AssetStore::Unmap( ASSETINFO &rAsset )
+{
+    if( rAsset.pMapping == NULL )
+    {
+        return;
+    }
+#ifndef _WIN32
+    munmap( rAsset.pMapping, rAsset.iSize );
+#else
+    delete[] (char *)rAsset.pMapping;
+#endif
+    rAsset.pMapping = NULL;
+    iMappedAssets--;
+}
+
+//! Copies a mapped asset into the memory cache
+void AssetStore::Promote( ASSETINFO &rAsset )
+{
+    if( rAsset.pMapping == NULL )
+    {
+        return;
+    }
+    rAsset.pMemoryCopy = new char[ rAsset.iSize ];
+    memcpy( rAsset.pMemoryCopy, rAsset.pMapping, rAsset.iSize );
+    iHotBytes += rAsset.iSize;
+    DEBUG( "Asset " << rAsset.sFilePath << " promoted to memory cache, " << iHotBytes << " bytes hot" );
+}
+
+//! Drops least recently used hot copies and mappings until the store is within budget
+
+//! Drops least recently used hot copies and mappings until the store is within budget
+//! Assets with transfers in progress are never dropped, so the store can run over budget until they finish
+void AssetStore::Trim()
+{
+    map < string, ASSETINFO, less<string> >::iterator iterator;
+    while( iHotBytes > iMaxHotBytes )
+    {
+        ASSETINFO *pOldest = NULL;
+        for( iterator = Assets.begin(); iterator != Assets.end(); iterator++ )
+        {
+            ASSETINFO &rAsset = iterator->second;
+            if( rAsset.pMemoryCopy != NULL && rAsset.iUsers == 0 && rAsset.iSize > 0
+                && ( pOldest == NULL || rAsset.iLastUsed < pOldest->iLastUsed ) )
+            {
+                pOldest = &rAsset;
+            }
+        }
+        if( pOldest == NULL )
+        {
+            break;
+        }
+        delete[] pOldest->pMemoryCopy;
+        pOldest->pMemoryCopy = NULL;
+        iHotBytes -= pOldest->iSize;
+    }
+
+    while( iMappedAssets > iMaxMappedAssets )
+    {
+        ASSETINFO *pOldest = NULL;
+        for( iterator = Assets.begin(); iterator != Assets.end(); iterator++ )
+        {
+            ASSETINFO &rAsset = iterator->second;
+            if( rAsset.pMapping != NULL && rAsset.iUsers == 0
+                && ( pOldest == NULL || rAsset.iLastUsed < pOldest->iLastUsed ) )
+            {
+                pOldest = &rAsset;
+            }
+        }
+        if( pOldest == NULL )
+        {
+            break;
+        }
+        Unmap( *pOldest );
+    }
+}
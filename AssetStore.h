@@ -0,0 +1,108 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Content-addressed store of the asset files served by serverfileagent
+//!
+//! Content-addressed store of the asset files served by serverfileagent
+//! Assets are keyed by their md5 checksum, as used by the texture, terrain, mesh and script caches.
+//! Once an asset is known, requests for it need no filename validation, path generation or fopen.
+//! Frequently requested assets are copied into an LRU-bounded memory cache;
+//! the rest are served from a memory-mapped view of the file.
+
+#ifndef _ASSETSTORE_H
+#define _ASSETSTORE_H
+
+#include <map>
+#include <string>
+using namespace std;
+
+//! Where an asset's bytes are currently served from
+enum AssetSource
+{
+    ASSETSOURCE_MEMORY,   //!< hot copy held in the memory cache
+    ASSETSOURCE_MAPPED,   //!< memory-mapped view of the file on disk
+
+    ASSETSOURCE_COUNT
+};
+
+//! One asset in the store
+class ASSETINFO
+{
+public:
+    string sFilePath;   //!< file the asset was loaded from
+    size_t iSize;   //!< asset size in bytes
+    char *pMemoryCopy;   //!< hot copy, or NULL
+    void *pMapping;   //!< mapped view of sFilePath, or NULL
+    int iRequests;   //!< number of times the asset has been requested
+    int iUsers;   //!< number of transfers currently reading from the asset; it cant be dropped while non-zero
+    unsigned long iLastUsed;   //!< store-wide request counter value at last use, for LRU eviction
+
+    ASSETINFO()
+    {
+        iSize = 0;
+        pMemoryCopy = NULL;
+        pMapping = NULL;
+        iRequests = 0;
+        iUsers = 0;
+        iLastUsed = 0;
+    }
+};
+
+//! AssetStore holds the assets serverfileagent serves, keyed by md5 checksum
+
+//! AssetStore holds the assets serverfileagent serves, keyed by md5 checksum
+//! Acquire returns a pointer to the asset's bytes, which stays valid until the matching Release
+//! An asset is only added under a checksum once the file's md5 has been checked against it
+class AssetStore
+{
+public:
+    AssetStore( size_t iMaxHotBytes, int iMaxMappedAssets );
+    ~AssetStore();
+
+    //! Returns the bytes of asset sChecksum, loading it from sFilePath if it's not in the store yet
+
+    //! Returns the bytes of asset sChecksum, loading it from sFilePath if it's not in the store yet
+    //! sFilePath can be empty, in which case only assets already in the store are found
+    //! Returns NULL if the asset is unavailable or sFilePath doesnt match sChecksum
+    const char *Acquire( const string &sChecksum, const string &sFilePath, size_t &iSize, AssetSource &Source );
+    void Release( const string &sChecksum );   //!< Ends a transfer started by Acquire
+    void AddBytesServed( AssetSource Source, size_t iBytes );   //!< Records bytes actually sent from Source
+    void ReportStatistics();   //!< Logs hit ratio and bytes served per source
+
+protected:
+    map < string, ASSETINFO, less<string> > Assets;   //!< all known assets, by checksum
+    size_t iMaxHotBytes;   //!< memory cache budget
+    size_t iHotBytes;   //!< bytes currently in the memory cache
+    int iMaxMappedAssets;   //!< most assets to keep mapped
+    int iMappedAssets;   //!< assets currently mapped
+    unsigned long iRequestCounter;   //!< total Acquire calls, used as the LRU clock
+
+    unsigned long iHits[ ASSETSOURCE_COUNT ];   //!< requests served from each source
+    unsigned long iMisses;   //!< requests that had to load the asset from disk
+    double BytesServed[ ASSETSOURCE_COUNT ];   //!< bytes sent from each source
+
+    bool Map( ASSETINFO &rAsset );
+    void Unmap( ASSETINFO &rAsset );
+    void Promote( ASSETINFO &rAsset );
+    void Trim();
+};
+
+#endif // _ASSETSTORE_H
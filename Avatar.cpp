@@ -83,10 +83,16 @@ void Avatar::WriteToXMLDoc( TiXmlElement *pElement )
     Debug( "Avatar::WriteToXMLDocEx\n" );
     pElement->SetAttribute( "type", "AVATAR" );
     AddXmlChildIfNecessary( pElement, "meta" );
-    AddXmlChildIfNecessary( pElement, "avatar" );
+    AddXmlChildIfNecessary( pElement->FirstChildElement("meta"), "avatar" );
     pElement->FirstChildElement("meta")->FirstChildElement("avatar")->SetAttribute( "name", avatarname );
     ObjectGrouping::WriteToXMLDoc( pElement );
 }
+void Avatar::WriteXMLMeta( XmlWriter &Writer )
+{
+    Writer.StartElement( "avatar" );
+    Writer.Attribute( "name", avatarname );
+    Writer.EndElement();
+}
 void Avatar::UpdateFromXML( TiXmlElement *pElement )
 {
     ObjectGrouping::UpdateFromXML( pElement );
@@ -89,6 +89,7 @@ public:
    {
    	   sprintf( sObjectGroupingType, "AVATAR" );
    	   sprintf( sDeepObjectType, "AVATAR" );
+   	   DeepTypeTag = DEEPTYPE_AVATAR;
    	   sprintf( avatarname, "" );
    	   //scale.x = 0.5;
    	   //scale.y = 0.5;
@@ -99,6 +100,7 @@ public:
    virtual void PopulateFromDBRow();
    void LoadFromXML( TiXmlElement *pElement );
    virtual void WriteToXMLDoc( TiXmlElement *pElement );
+   virtual void WriteXMLMeta( XmlWriter &Writer );
    virtual void UpdateFromXML( TiXmlElement *pElement );
    const Avatar &Avatar::operator=( const Avatar &IncomingPrim );
    //virtual void CopyTo( Avatar *ptarget );
@@ -29,6 +29,7 @@
 
 #include "Diag.h"
 #include "BasicTypes.h"
+#include "XmlHelper.h"
 
 Color::Color( const TiXmlElement *p_Element )
 {
@@ -48,6 +49,13 @@ void Color::WriteToXMLElement( TiXmlElement *p_Element )
     p_Element->SetDoubleAttribute( "b", b );
 }
 
+void Color::WriteToXMLWriter( XmlWriter &Writer ) const
+{
+    Writer.Attribute( "r", r );
+    Writer.Attribute( "g", g );
+    Writer.Attribute( "b", b );
+}
+
 ostream& operator<< ( ostream& os, const Color &color )
 {
     os << "<color r=\"" << color.r << "\" g=\"" << color.g << "\" b=\"" << color.b << "\"/>" ;
@@ -44,6 +44,7 @@ using namespace std;
 
 typedef class Vector3 Vector3;
 typedef class Vector3 Vector3;
+class XmlWriter;
 
 //! Color contains a color, in r,g,b format; plus helper functions
 class Color
@@ -85,6 +86,9 @@ public:
   //! Writes values to passed-in xml element, <someelement r="..." g="..." b="..."/>
   void WriteToXMLElement( TiXmlElement *p_Element );
   
+  //! Appends r,g,b attributes to the element just opened in Writer
+  void WriteToXMLWriter( XmlWriter &Writer ) const;
+  
   //! Reads values from passed in XML element in format <someelement r="..." g="..." b="..."/>
    Color( const TiXmlElement *p_Element );
    
@@ -28,16 +28,47 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <map>
 
 
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+
+#include "pthread.h"
 
 #include "Diag.h"
 #include "Checksum.h"
 
+const size_t iChecksumWindowSize = 16 * 1024 * 1024;   //!< bytes of a file mapped at a time while hashing
+const int iMaxChecksumThreads = 16;   //!< most threads GenerateCheckStrings will start
+const int iChecksumRacyWindowSeconds = 2;   //!< files modified more recently than this aren't cached; they could change again within the same mtime tick
+
+//! A remembered checksum, valid while the file's size and modification time are unchanged
+class CHECKSUMCACHEENTRY
+{
+public:
+    off_t iSize;
+    time_t iModified;
+    string sChecksum;
+};
+
+static map < string, CHECKSUMCACHEENTRY > ChecksumCache;   //!< checksums by file path
+static FILE *pChecksumCacheFile = NULL;   //!< persistent cache, opened for appending, if ChecksumCacheOpen was called
+static pthread_mutex_t ChecksumCacheMutex = PTHREAD_MUTEX_INITIALIZER;   //!< guards ChecksumCache and pChecksumCacheFile
+
+extern int md5_file (const char *filepath, void *resblock);
+
 
 extern void md5_init_ctx (struct md5_ctx *ctx);
 
@@ -86,53 +117,442 @@ extern int md5_stream (FILE *stream, void *resblock);
 extern void *md5_buffer (const char *buffer, size_t len, void *resblock);
 
 
+// Input: sFilePath: file to read
+//        pProcess: called for each consecutive block of the file, with pContext
+//
+// Returns: True if the whole file was read
+//
+// Description: Files are memory-mapped a window at a time where mmap is available,
+//  so hashing doesn't copy the file through stdio buffers
+static bool ReadFileInWindows( const char *sFilePath, void (*pProcess)( const char *buffer, size_t len, void *pContext ), void *pContext )
+{
+#ifndef _WIN32
+    int iFileDescriptor = open( sFilePath, O_RDONLY );
+    if( iFileDescriptor == -1 )
+    {
+        return false;
+    }
+    struct stat FileInfo;
+    if( fstat( iFileDescriptor, &FileInfo ) != 0 )
+    {
+        close( iFileDescriptor );
+        return false;
+    }
+    off_t iFileSize = FileInfo.st_size;
+    for( off_t iOffset = 0; iOffset < iFileSize; iOffset += iChecksumWindowSize )
+    {
+        size_t iWindowSize = iFileSize - iOffset < (off_t)iChecksumWindowSize ? iFileSize - iOffset : iChecksumWindowSize;
+        void *pWindow = mmap( NULL, iWindowSize, PROT_READ, MAP_SHARED, iFileDescriptor, iOffset );
+        if( pWindow == MAP_FAILED )
+        {
+            close( iFileDescriptor );
+            return false;
+        }
+        madvise( pWindow, iWindowSize, MADV_SEQUENTIAL );
+        pProcess( (const char *)pWindow, iWindowSize, pContext );
+        munmap( pWindow, iWindowSize );
+    }
+    close( iFileDescriptor );
+    return true;
+#else
+    FILE *pFile = fopen( sFilePath, "rb" );
+    if( pFile == NULL )
+    {
+        return false;
+    }
+    char *buffer = new char[ 65536 ];
+    size_t iBytesRead;
+    while( ( iBytesRead = fread( buffer, 1, 65536, pFile ) ) > 0 )
+    {
+        pProcess( buffer, iBytesRead, pContext );
+    }
+    bool bResult = !ferror( pFile );
+    delete[] buffer;
+    fclose( pFile );
+    return bResult;
+#endif
+}
+
+//! Formats a binary digest as lower-case hex
+static string DigestToHex( const unsigned char *Digest, int iDigestBytes )
+{
+    char HexDigest[ 2 * 32 + 1 ];
+    for( int cnt = 0; cnt < iDigestBytes; ++cnt )
+    {
+        sprintf( &HexDigest[cnt*2], "%02x", (unsigned int)Digest[cnt] );
+    }
+    HexDigest[ 2 * iDigestBytes ] = '\0';
+    return HexDigest;
+}
+
+// The fast hash is xxHash64 (Yann Collet's algorithm, BSD licensed), seed 0.
+// Words are read in host byte order, so hashes are only comparable on the same machine.
+typedef unsigned long long fasthash_uint64;
+
+static const fasthash_uint64 FASTHASH_PRIME1 = 11400714785074694791ULL;
+static const fasthash_uint64 FASTHASH_PRIME2 = 14029467366897019727ULL;
+static const fasthash_uint64 FASTHASH_PRIME3 = 1609587929392839161ULL;
+static const fasthash_uint64 FASTHASH_PRIME4 = 9650029242287828579ULL;
+static const fasthash_uint64 FASTHASH_PRIME5 = 2870177450012600261ULL;
+
+//! Running state of a fast hash
+class FASTHASHSTATE
+{
+public:
+    fasthash_uint64 v1, v2, v3, v4;
+    fasthash_uint64 iTotalLength;
+    unsigned char Pending[32];   //!< bytes not yet making up a whole 32-byte stripe
+    size_t iPendingLength;
+
+    FASTHASHSTATE()
+    {
+        v1 = FASTHASH_PRIME1 + FASTHASH_PRIME2;
+        v2 = FASTHASH_PRIME2;
+        v3 = 0;
+        v4 = 0 - FASTHASH_PRIME1;
+        iTotalLength = 0;
+        iPendingLength = 0;
+    }
+};
+
+static inline fasthash_uint64 FastHashRotl( fasthash_uint64 x, int r )
+{
+    return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+static inline fasthash_uint64 FastHashRead64( const unsigned char *p )
+{
+    fasthash_uint64 value;
+    memcpy( &value, p, 8 );
+    return value;
+}
+
+static inline fasthash_uint64 FastHashRound( fasthash_uint64 acc, fasthash_uint64 input )
+{
+    acc += input * FASTHASH_PRIME2;
+    acc = FastHashRotl( acc, 31 );
+    return acc * FASTHASH_PRIME1;
+}
+
+static inline fasthash_uint64 FastHashMerge( fasthash_uint64 acc, fasthash_uint64 v )
+{
+    acc ^= FastHashRound( 0, v );
+    return acc * FASTHASH_PRIME1 + FASTHASH_PRIME4;
+}
+
+static void FastHashUpdate( const char *buffer, size_t len, void *pContext )
+{
+    FASTHASHSTATE &rState = *(FASTHASHSTATE *)pContext;
+    const unsigned char *p = (const unsigned char *)buffer;
+    const unsigned char *pEnd = p + len;
+    rState.iTotalLength += len;
+
+    if( rState.iPendingLength + len < 32 )
+    {
+        memcpy( rState.Pending + rState.iPendingLength, p, len );
+        rState.iPendingLength += len;
+        return;
+    }
+    if( rState.iPendingLength > 0 )
+    {
+        size_t iFill = 32 - rState.iPendingLength;
+        memcpy( rState.Pending + rState.iPendingLength, p, iFill );
+        rState.v1 = FastHashRound( rState.v1, FastHashRead64( rState.Pending ) );
+        rState.v2 = FastHashRound( rState.v2, FastHashRead64( rState.Pending + 8 ) );
+        rState.v3 = FastHashRound( rState.v3, FastHashRead64( rState.Pending + 16 ) );
+        rState.v4 = FastHashRound( rState.v4, FastHashRead64( rState.Pending + 24 ) );
+        p += iFill;
+        rState.iPendingLength = 0;
+    }
+    fasthash_uint64 v1 = rState.v1, v2 = rState.v2, v3 = rState.v3, v4 = rState.v4;
+    while( p + 32 <= pEnd )
+    {
+        v1 = FastHashRound( v1, FastHashRead64( p ) );
+        v2 = FastHashRound( v2, FastHashRead64( p + 8 ) );
+        v3 = FastHashRound( v3, FastHashRead64( p + 16 ) );
+        v4 = FastHashRound( v4, FastHashRead64( p + 24 ) );
+        p += 32;
+    }
+    rState.v1 = v1;
+    rState.v2 = v2;
+    rState.v3 = v3;
+    rState.v4 = v4;
+    memcpy( rState.Pending, p, pEnd - p );
+    rState.iPendingLength = pEnd - p;
+}
+
+static string FastHashDigest( const FASTHASHSTATE &rState )
+{
+    fasthash_uint64 h;
+    if( rState.iTotalLength >= 32 )
+    {
+        h = FastHashRotl( rState.v1, 1 ) + FastHashRotl( rState.v2, 7 ) + FastHashRotl( rState.v3, 12 ) + FastHashRotl( rState.v4, 18 );
+        h = FastHashMerge( h, rState.v1 );
+        h = FastHashMerge( h, rState.v2 );
+        h = FastHashMerge( h, rState.v3 );
+        h = FastHashMerge( h, rState.v4 );
+    }
+    else
+    {
+        h = FASTHASH_PRIME5;
+    }
+    h += rState.iTotalLength;
+
+    const unsigned char *p = rState.Pending;
+    const unsigned char *pEnd = p + rState.iPendingLength;
+    while( p + 8 <= pEnd )
+    {
+        h ^= FastHashRound( 0, FastHashRead64( p ) );
+        h = FastHashRotl( h, 27 ) * FASTHASH_PRIME1 + FASTHASH_PRIME4;
+        p += 8;
+    }
+    if( p + 4 <= pEnd )
+    {
+        unsigned int k;
+        memcpy( &k, p, 4 );
+        h ^= (fasthash_uint64)k * FASTHASH_PRIME1;
+        h = FastHashRotl( h, 23 ) * FASTHASH_PRIME2 + FASTHASH_PRIME3;
+        p += 4;
+    }
+    while( p < pEnd )
+    {
+        h ^= (*p) * FASTHASH_PRIME5;
+        h = FastHashRotl( h, 11 ) * FASTHASH_PRIME1;
+        p++;
+    }
+    h ^= h >> 33;
+    h *= FASTHASH_PRIME2;
+    h ^= h >> 29;
+    h *= FASTHASH_PRIME3;
+    h ^= h >> 32;
+
+    unsigned char Digest[8];
+    for( int i = 0; i < 8; i++ )
+    {
+        Digest[i] = (unsigned char)( h >> ( 56 - 8 * i ) );
+    }
+    return DigestToHex( Digest, 8 );
+}
+
+string GenerateFastCheckString( const char *buffer, size_t len )
+{
+    FASTHASHSTATE State;
+    FastHashUpdate( buffer, len, &State );
+    return FastHashDigest( State );
+}
+
+string GenerateFastCheckString( string TargetFilePath )
+{
+    FASTHASHSTATE State;
+    if( !ReadFileInWindows( TargetFilePath.c_str(), FastHashUpdate, &State ) )
+    {
+        return "";
+    }
+    return FastHashDigest( State );
+}
+
+// Input: sFilePath: file a checksum was generated for
+//        rEntry: the checksum, and the file's size and modification time
+//
+// Returns: None
+//
+// Description: Each line of the cache file holds a fast hash of the rest of the line,
+//  so a line torn by a crash is ignored when the file is next loaded.
+//  Call with ChecksumCacheMutex locked.
+static void ChecksumCacheWriteEntry( FILE *pFile, const string &sFilePath, const CHECKSUMCACHEENTRY &rEntry )
+{
+    ostringstream entrystream;
+    entrystream << rEntry.iSize << " " << rEntry.iModified << " " << rEntry.sChecksum << " " << sFilePath;
+    string sEntry = entrystream.str();
+    fprintf( pFile, "%s %s\n", GenerateFastCheckString( sEntry.c_str(), sEntry.size() ).c_str(), sEntry.c_str() );
+}
+
+void ChecksumCacheOpen( const char *sCacheFilePath )
+{
+    pthread_mutex_lock( &ChecksumCacheMutex );
+    if( pChecksumCacheFile != NULL )
+    {
+        fclose( pChecksumCacheFile );
+        pChecksumCacheFile = NULL;
+    }
+
+    int iLines = 0;
+    ifstream cachefile( sCacheFilePath );
+    string sLine;
+    while( getline( cachefile, sLine ) )
+    {
+        iLines++;
+        size_t iEntryStart = sLine.find( ' ' );
+        if( iEntryStart == string::npos
+            || GenerateFastCheckString( sLine.c_str() + iEntryStart + 1, sLine.size() - iEntryStart - 1 ) != sLine.substr( 0, iEntryStart ) )
+        {
+            continue;
+        }
+        istringstream entrystream( sLine.substr( iEntryStart + 1 ) );
+        CHECKSUMCACHEENTRY Entry;
+        string sFilePath;
+        if( entrystream >> Entry.iSize >> Entry.iModified >> Entry.sChecksum && entrystream.get() == ' ' && getline( entrystream, sFilePath ) )
+        {
+            // later lines supersede earlier ones for the same file
+            ChecksumCache[ sFilePath ] = Entry;
+        }
+    }
+    cachefile.close();
+
+    // drop superseded lines once they outnumber the live ones
+    if( iLines > 2 * (int)ChecksumCache.size() + 64 )
+    {
+        string sNewCacheFilePath = string( sCacheFilePath ) + ".new";
+        FILE *pNewFile = fopen( sNewCacheFilePath.c_str(), "wb" );
+        if( pNewFile != NULL )
+        {
+            for( map < string, CHECKSUMCACHEENTRY >::iterator it = ChecksumCache.begin(); it != ChecksumCache.end(); it++ )
+            {
+                ChecksumCacheWriteEntry( pNewFile, it->first, it->second );
+            }
+            fclose( pNewFile );
+#ifdef _WIN32
+            remove( sCacheFilePath );
+#endif
+            rename( sNewCacheFilePath.c_str(), sCacheFilePath );
+        }
+    }
+
+    pChecksumCacheFile = fopen( sCacheFilePath, "ab" );
+    if( pChecksumCacheFile == NULL )
+    {
+        WARNING( "Unable to open checksum cache " << sCacheFilePath << "; checksums won't be remembered between runs" );
+    }
+    INFO( "Checksum cache " << sCacheFilePath << " holds " << ChecksumCache.size() << " files" );
+    pthread_mutex_unlock( &ChecksumCacheMutex );
+}
+
+// Input: TargetFilePath: file to checksum
+//
+// Returns: md5 checksum as lower-case hex, or "" if the file can't be read
+//
+// Description: Returns the remembered checksum if the file's size and modification time
+//  are as they were when it was generated.  Thread-safe.
 string GenerateCheckString( string TargetFilePath )
 {
-    string checksum = "";
+    struct stat FileInfo;
+    if( stat( TargetFilePath.c_str(), &FileInfo ) != 0 )
+    {
+        return "";
+    }
+
+    pthread_mutex_lock( &ChecksumCacheMutex );
+    map < string, CHECKSUMCACHEENTRY >::iterator cached = ChecksumCache.find( TargetFilePath );
+    if( cached != ChecksumCache.end() && cached->second.iSize == FileInfo.st_size && cached->second.iModified == FileInfo.st_mtime )
+    {
+        string checksum = cached->second.sChecksum;
+        pthread_mutex_unlock( &ChecksumCacheMutex );
+        return checksum;
+    }
+    pthread_mutex_unlock( &ChecksumCacheMutex );
+
     unsigned char BinaryChecksum[16];
-    char HexChecksum[33];
-    int cnt;
-    unsigned int byte;
-    FILE *file = fopen(TargetFilePath.c_str(), "rb");
-    if(NULL != file)
-    {
-        md5_stream(file, BinaryChecksum);
-        fclose(file);
-        for (cnt = 0; cnt < 16; ++cnt)
+    if( md5_file( TargetFilePath.c_str(), BinaryChecksum ) != 0 )
+    {
+        return "";
+    }
+    string checksum = DigestToHex( BinaryChecksum, 16 );
+
+    // only remember it if the file didn't change while we hashed it, and isn't still being written
+    struct stat FileInfoAfter;
+    if( stat( TargetFilePath.c_str(), &FileInfoAfter ) == 0 && FileInfoAfter.st_size == FileInfo.st_size
+        && FileInfoAfter.st_mtime == FileInfo.st_mtime && time( NULL ) - FileInfo.st_mtime >= iChecksumRacyWindowSeconds )
+    {
+        CHECKSUMCACHEENTRY Entry;
+        Entry.iSize = FileInfo.st_size;
+        Entry.iModified = FileInfo.st_mtime;
+        Entry.sChecksum = checksum;
+        if( TargetFilePath.find_first_of( "\r\n" ) == string::npos )
         {
-            byte = BinaryChecksum[cnt];
-            sprintf(&HexChecksum[cnt*2], "%02x", byte);
+            pthread_mutex_lock( &ChecksumCacheMutex );
+            ChecksumCache[ TargetFilePath ] = Entry;
+            if( pChecksumCacheFile != NULL )
+            {
+                ChecksumCacheWriteEntry( pChecksumCacheFile, TargetFilePath, Entry );
+                fflush( pChecksumCacheFile );
+            }
+            pthread_mutex_unlock( &ChecksumCacheMutex );
         }
-        checksum = HexChecksum;
     }
+    return checksum;
+}
 
-#if 0
-    // Old method:
-    // uses fciv.exe (from Microsoft) to compute md5 checksum
-    // there must be a similar utility for Linux
-    // fciv is *fast*
-    string checksum = "";
-    ostringstream commandstream;
-    commandstream << "dochecksum \"" << TexturePath << "\"";
-    DEBUG(  commandstream.str() ); // DEBUG
-    // spawnlp( _P_WAIT, "dochecksum.bat", "dochecksum.bat", TexturePath.c_str() );
-    system(commandstream.str().c_str() );
+//! Files shared out between GenerateCheckStrings' threads
+class CHECKSUMBATCH
+{
+public:
+    const vector<string> *pFilePaths;
+    vector<string> *pChecksums;
+    size_t iNextFile;   //!< next file for a thread to take
+    pthread_mutex_t Mutex;   //!< guards iNextFile
+};
 
-    ifstream checksumfile;
-    string line;
-    checksumfile.rdbuf( )->open( "checksum.txt", ios::in );
-    for( int i = 0; i < 9; i++ )
+static void *ChecksumWorkerThread( void *pArgument )
+{
+    CHECKSUMBATCH &rBatch = *(CHECKSUMBATCH *)pArgument;
+    while( true )
     {
-        checksumfile >> line;
+        pthread_mutex_lock( &rBatch.Mutex );
+        size_t iFile = rBatch.iNextFile++;
+        pthread_mutex_unlock( &rBatch.Mutex );
+        if( iFile >= rBatch.pFilePaths->size() )
+        {
+            break;
+        }
+        ( *rBatch.pChecksums )[ iFile ] = GenerateCheckString( ( *rBatch.pFilePaths )[ iFile ] );
     }
+    return NULL;
+}
 
-    checksumfile >> checksum;
-    checksumfile.rdbuf( )->close( );
+void GenerateCheckStrings( const vector<string> &FilePaths, vector<string> &Checksums, int iNumThreads )
+{
+    Checksums.clear();
+    Checksums.resize( FilePaths.size() );
 
-    DEBUG(  checksum ); // DEBUG
+    if( iNumThreads <= 0 )
+    {
+#ifndef _WIN32
+        iNumThreads = (int)sysconf( _SC_NPROCESSORS_ONLN );
+#else
+        iNumThreads = 4;
 #endif
+    }
+    if( iNumThreads > iMaxChecksumThreads )
+    {
+        iNumThreads = iMaxChecksumThreads;
+    }
+    if( iNumThreads > (int)FilePaths.size() )
+    {
+        iNumThreads = (int)FilePaths.size();
+    }
 
-    return checksum;
+    CHECKSUMBATCH Batch;
+    Batch.pFilePaths = &FilePaths;
+    Batch.pChecksums = &Checksums;
+    Batch.iNextFile = 0;
+    pthread_mutex_init( &Batch.Mutex, NULL );
+
+    // this thread hashes too, so one thread's worth of work needs no pool at all
+    vector<pthread_t> Threads;
+    for( int i = 1; i < iNumThreads; i++ )
+    {
+        pthread_t Thread;
+        if( pthread_create( &Thread, NULL, ChecksumWorkerThread, &Batch ) == 0 )
+        {
+            Threads.push_back( Thread );
+        }
+    }
+    ChecksumWorkerThread( &Batch );
+    for( size_t i = 0; i < Threads.size(); i++ )
+    {
+        pthread_join( Threads[i], NULL );
+    }
+    pthread_mutex_destroy( &Batch.Mutex );
 }
 
 
@@ -610,3 +1030,25 @@ md5_process_block (const void *buffer, size_t len, struct md5_ctx *ctx)
     ctx->D = D;
 }
 
+/* End of the GNU coreutils code */
+
+/* Compute MD5 message digest for the file at FILEPATH, read through
+   ReadFileInWindows.  The resulting message digest number will be written
+   into the 16 bytes beginning at RESBLOCK.  Returns 0 on success.  */
+static void
+md5_process_window (const char *buffer, size_t len, void *ctx)
+{
+    md5_process_bytes (buffer, len, (struct md5_ctx *) ctx);
+}
+
+int
+md5_file (const char *filepath, void *resblock)
+{
+    struct md5_ctx ctx;
+
+    md5_init_ctx (&ctx);
+    if (!ReadFileInWindows (filepath, md5_process_window, &ctx))
+        return 1;
+    md5_finish_ctx (&ctx, resblock);
+    return 0;
+}
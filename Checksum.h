@@ -22,14 +22,40 @@
 //! \brief Generates MD5 checksums for a passed-in filepath
 //!
 //! Generates MD5 checksums for a passed-in filepath
+//! Files are read through memory mappings.  Checksums are remembered against the file's
+//! path, size and modification time, optionally in a persistent cache file, so an
+//! unchanged file is only ever hashed once.
 
 #ifndef _CHECKSUM_H
 #define _CHECKSUM_H
 
 #include <string>
+#include <vector>
 using namespace std;
 
 string GenerateCheckString( string TargetFilePath ); //!< Generates MD5 checksum string for file TargetFilePath
 
+//! Generates MD5 checksum strings for many files at once
+
+//! Generates MD5 checksum strings for many files at once
+//! Files are hashed by a pool of iNumThreads threads, or one per processor if iNumThreads is 0.
+//! Checksums[i] is the checksum of FilePaths[i], or "" if it couldn't be read
+void GenerateCheckStrings( const vector<string> &FilePaths, vector<string> &Checksums, int iNumThreads = 0 );
+
+//! Generates a fast 64-bit hash string of file TargetFilePath, for internal integrity checks
+
+//! Generates a fast 64-bit hash string of file TargetFilePath, for internal integrity checks
+//! Several times faster than md5; use it only for data that never leaves this machine,
+//! since asset checksums on the wire are md5
+string GenerateFastCheckString( string TargetFilePath );
+string GenerateFastCheckString( const char *buffer, size_t len ); //!< Generates a fast 64-bit hash string of a block of memory
+
+//! Makes the checksum cache persistent, in file sCacheFilePath
+
+//! Makes the checksum cache persistent, in file sCacheFilePath
+//! Loads the checksums already in the file, and appends new ones as they're generated.
+//! Only one process should use a given cache file.
+void ChecksumCacheOpen( const char *sCacheFilePath );
+
 #endif // _CHECKSUM_H
 
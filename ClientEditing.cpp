@@ -162,7 +162,7 @@ void ClientsideEditingClass::EditTexture( int iObjectReference )
     if( iArrayNum != -1 )
     {
         string sTextureReference;
-        if( strcmp( World.GetObject( iArrayNum )->ObjectType, "PRIM" ) == 0 )
+        if( World.GetObject( iArrayNum )->TypeTag == OBJECTTYPE_PRIM )
         {
             Prim *p_Prim = dynamic_cast< Prim * >( World.GetObject( iArrayNum ) );
             sTextureReference = p_Prim->GetTexture( 0 );
@@ -197,9 +197,9 @@ void ClientsideEditingClass::EditObject( int iObjectReference )
 
         string sTempDir = GenerateTempDir( mvConfig.TempDirectory );
 
-        if( strcmp( World.GetObject( iArrayNum )->ObjectType, "PRIM" ) == 0 )
+        if( World.GetObject( iArrayNum )->TypeTag == OBJECTTYPE_PRIM )
         {
-            if( strcmp( World.GetObject( iArrayNum )->sDeepObjectType, "TERRAIN" ) == 0 )
+            if( World.GetObject( iArrayNum )->DeepTypeTag == DEEPTYPE_TERRAIN )
             {
                 Terrain *p_Terrain = dynamic_cast< Terrain * >( World.GetObject( iArrayNum ) );
             }
@@ -27,11 +27,13 @@
 // Modified 20050409 Mark Wagner - uses wxBase for filename manipulation
 //  Made thread-safe for sending
 // Modified 20050410 - Began UTF-8 support
+// Downloads share one persistent, multiplexed connection per server; see AssetChannel.h
 
 #include <stdio.h>
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <vector>
 using namespace std;
 
 #include <wx/filename.h>
@@ -44,6 +46,7 @@ using namespace std;
 #include "File.h"
 #include "port_list.h"
 #include "Config.h"
+#include "AssetChannel.h"
 
 //#define BUFSIZE 2047
 //char SendBuffer[ BUFSIZE + 1 ];
@@ -51,11 +54,14 @@ using namespace std;
 
 mvsocket SocketServerFileAgent;
 mvsocket MetaverseClientSocket;
+AssetChannelClass AssetChannel;   //!< persistent download connection to the current server's serverfileagent
 
 //int iServerPort = 0;
 //int iMetaverseClientPort = 22169;
 
 ConfigClass mvConfig;
+
+const int iMaxDownloadAttempts = 3;  //!< connections tried per download; each one resumes where the last stopped
     
 //char sMetaverseServerIP[64];
 
@@ -69,10 +75,14 @@ void TellClientWereDone( const char *sType, const char *sFilename )
 	  printf( "file loaded\n" );
 }
 
-bool GetFileItselfFromServer( mvsocket *RecvSocket, const char *sType, const char *sLocalFilename, const char *sFilename, const char *sFullFilePath )
+// Input: sType: the file type (TEXTURE, TERRAIN, MESHFILE or SCRIPT)
+//        sLocalFilename: the file's name in the client cache
+//        sFullFilePath: an explicit path to download to, or NULL to use the client cache
+//        FilePath: set to the normalized path to download to
+//
+// Returns: True if a path could be worked out, false for an unknown file type
+bool GetLocalFilePath( const char *sType, const char *sLocalFilename, const char *sFullFilePath, wxFileName &FilePath )
 {
-	wxFileName FilePath;
-	
 	if( NULL == sFullFilePath )
 	{
 		FilePath = wxString(sLocalFilename, wxConvUTF8);
@@ -94,7 +104,7 @@ bool GetFileItselfFromServer( mvsocket *RecvSocket, const char *sType, const cha
 		}
 		else
 		{
-			WARNING("GetFileItselfFromServer(): Unknown file type " << sType);
+			WARNING("GetLocalFilePath(): Unknown file type " << sType);
 			return false;
 		}
 		
@@ -106,16 +116,7 @@ bool GetFileItselfFromServer( mvsocket *RecvSocket, const char *sType, const cha
 		FilePath = wxString(sFullFilePath, wxConvUTF8);
 	}
 	FilePath.Normalize( wxPATH_NORM_ALL, wxString( mvConfig.CacheDirectory.c_str()  ));
-	DEBUG(  "launching filetransgetfile..." ); // DEBUG
-	if( FileTransGetFile( RecvSocket, FilePath.GetFullPath().mb_str() ) )
-	{
-		return true;
-	}
-	else
-	{
-		return false;
-	}
-
+	return true;
 }
    
 bool SendFile( mvsocket *SendSocket, wxFileName *FileName, TiXmlElement *pElement)
@@ -144,7 +145,10 @@ bool SendFile( mvsocket *SendSocket, wxFileName *FileName, TiXmlElement *pElemen
 //
 // Description: Retrieves a file from the metaverse server, saving it
 //  in the specified file.  Sends a message to the metaverse client
-//  indicating success or failure.
+//  indicating success or failure.  The file is downloaded into a journaled
+//  partial file; if the connection drops, we reconnect and ask for the rest,
+//  up to iMaxDownloadAttempts times.  The file only appears under its real
+//  name once its md5 checksum has been verified.
 //
 // Thread safety: Unknown
 //
@@ -152,40 +156,46 @@ bool SendFile( mvsocket *SendSocket, wxFileName *FileName, TiXmlElement *pElemen
 void LoadFile( TiXmlDocument *pIPC )
 {
 	bool iResult = false;
-	int iServerPort;
-	mvsocket *RecvSocket = new mvsocket;
-	
-//	sprintf( sMetaverseServerIP, pIPC->RootElement()->Attribute("serverip") );
-//	iServerPort = atoi( pIPC->RootElement()->Attribute("serverport") );
-
-	RecvSocket->Init();
-	RecvSocket->ConnectToServer( inet_addr( pIPC->RootElement()->Attribute("serverip") ), atoi( pIPC->RootElement()->Attribute("serverport") ) );   
-
-	if( !RecvSocket->IsOpen() )
+	wxFileName FilePath;
+	const char *sChecksum = pIPC->RootElement()->Attribute("checksum");
+	if( NULL == sChecksum )
 	{
-		iResult = false;
-		DEBUG(  "failed to connect to server" ); // DEBUG
+		sChecksum = "";
 	}
-	else
+
+	if( GetLocalFilePath( pIPC->RootElement()->Attribute("type" ), pIPC->RootElement()->Attribute("sourcefilename"), 
+		pIPC->RootElement()->Attribute("ourlocalfilepath"), FilePath ) )
 	{
+		string sFilePath = (const char *)FilePath.GetFullPath().mb_str();
+		for( int iAttempt = 0; iAttempt < iMaxDownloadAttempts && !iResult; iAttempt++ )
+		{
+			mvsocket RecvSocket;
+			RecvSocket.Init();
+			RecvSocket.ConnectToServer( inet_addr( pIPC->RootElement()->Attribute("serverip") ), atoi( pIPC->RootElement()->Attribute("serverport") ) );   
 
-		DEBUG(  "connected to server" ); // DEBUG
+			if( !RecvSocket.IsOpen() )
+			{
+				DEBUG(  "failed to connect to server" ); // DEBUG
+				continue;
+			}
 
-		ostringstream messagestream;
-		messagestream << "<loadergetfile type=\"" << pIPC->RootElement()->Attribute("type" ) << "\" "
-		"sourcefilename=\"" << pIPC->RootElement()->Attribute("sourcefilename" ) << "\""
-		<< " checksum=\"" << pIPC->RootElement()->Attribute("checksum" ) << "\" serverfilename=\"" << pIPC->RootElement()->Attribute("serverfilename" )
-		<< "\"/>" << endl;
-		DEBUG(  "sending to server " << messagestream.str() ); // DEBUG
-		RecvSocket->Send( messagestream.str().c_str() );
+			DEBUG(  "connected to server" ); // DEBUG
 
-		if( pIPC->RootElement()->Attribute("ourlocalfilepath") == NULL )
-		{
-			iResult = GetFileItselfFromServer( RecvSocket, pIPC->RootElement()->Attribute("type" ), pIPC->RootElement()->Attribute("sourcefilename"), pIPC->RootElement()->Attribute("serverfilename" ), NULL );
-		}
-		else
-		{
-			iResult = GetFileItselfFromServer( RecvSocket, pIPC->RootElement()->Attribute("type" ), pIPC->RootElement()->Attribute("sourcefilename"), pIPC->RootElement()->Attribute("serverfilename" ), pIPC->RootElement()->Attribute("ourlocalfilepath") );
+			long iOffset = FileTransGetResumeOffset( sFilePath.c_str(), sChecksum );
+			ostringstream messagestream;
+			messagestream << "<loadergetfile type=\"" << pIPC->RootElement()->Attribute("type" ) << "\" "
+			"sourcefilename=\"" << pIPC->RootElement()->Attribute("sourcefilename" ) << "\""
+			<< " checksum=\"" << sChecksum << "\" serverfilename=\"" << pIPC->RootElement()->Attribute("serverfilename" )
+			<< "\" offset=\"" << iOffset << "\"/>" << endl;
+			DEBUG(  "sending to server " << messagestream.str() ); // DEBUG
+			RecvSocket.Send( messagestream.str().c_str() );
+
+			DEBUG(  "launching filetransgetfile..." ); // DEBUG
+			if( FileTransGetFile( &RecvSocket, sFilePath.c_str(), sChecksum, iOffset ) )
+			{
+				iResult = FileTransCompleteFile( sFilePath.c_str(), sChecksum );
+			}
+			RecvSocket.Close();
 		}
 	}
 	ostringstream messagetoclientstream;
@@ -203,9 +213,6 @@ void LoadFile( TiXmlDocument *pIPC )
 	messagetoclientstream << *pIPC << endl;
 	DEBUG(  "sending toclient " << messagetoclientstream.str() ); // DEBUG
 	MetaverseClientSocket.Send( messagetoclientstream.str().c_str() );
-	
-	RecvSocket->Close();
-	delete RecvSocket;
 }
 
 // Input: pIPC: A TinyXML document tree containing the IO request
@@ -277,37 +284,88 @@ bool ConnectAndSendFile( TiXmlDocument *pIPC )
 	return result;
 }
 
+// Input: pIPC: a loadergetfile request
+//
+// Returns: None
+//
+// Description: Queues the download on the asset channel to the request's server,
+//  falling back to a connection of its own if the channel can't be opened
+void RequestFile( TiXmlDocument *pIPC )
+{
+	TiXmlElement *pRequest = pIPC->RootElement();
+	wxFileName FilePath;
+	if( pRequest->Attribute("serverip") != NULL && pRequest->Attribute("serverport") != NULL
+		&& GetLocalFilePath( pRequest->Attribute("type" ), pRequest->Attribute("sourcefilename"), 
+		pRequest->Attribute("ourlocalfilepath"), FilePath ) 
+		&& AssetChannel.Connect( pRequest->Attribute("serverip"), atoi( pRequest->Attribute("serverport") ) ) )
+	{
+		AssetChannel.RequestFile( pRequest, (const char *)FilePath.GetFullPath().mb_str() );
+	}
+	else
+	{
+		LoadFile( pIPC );
+	}
+}
+
 // Input:
 //
 // Returns:
 //
-// Description:
+// Description: Waits on both metaverseclient and the asset channel, so downloads
+//  keep arriving while we take new requests
 //
 // History: 20050409 Mark Wagner: Added support for clean shutdown
 int main(int argc, char *argv[])
 {
-	char ReadBuffer[4096];
+	char ReadBuffer[4097];
 	mvConfig.ReadConfig();
 	mvsocket::InitSocketSystem();
 	MetaverseClientSocket.Init();
 	MetaverseClientSocket.ConnectToServer( inet_addr( "127.0.0.1" ), iPortFileTransfer );   
 
 	int ReadResult = 0;
+	bool bShutdown = false;
 
-	while( 1 )
+	while( !bShutdown )
 	{
-		DEBUG( "Waiting for request from metaverseclient ..." );
-		ReadResult = MetaverseClientSocket.ReceiveLineBlocking( ReadBuffer );
-		if( ReadResult == SOCKETS_READ_OK )
+		vector<const mvsocket *> ReadSockets;
+		vector<const mvsocket *> WriteSockets;
+		ReadSockets.push_back( &MetaverseClientSocket );
+		if( AssetChannel.IsOpen() )
+		{
+			ReadSockets.push_back( &AssetChannel.GetSocket() );
+		}
+		if( MetaverseClientSocket.BufferedBytes() == 0 )
+		{
+			// decoded downloads are picked up when we wake, so don't sleep long while there are any
+			SocketsReadWriteBlock( AssetChannel.IsDecoding() ? 50 : 1000, ReadSockets, WriteSockets );
+		}
+
+		AssetChannel.ProcessIncoming();
+
+		while( ( ReadResult = MetaverseClientSocket.ReceiveLineIfAvailable( ReadBuffer ) ) == SOCKETS_READ_OK )
 		{
 			if( ReadBuffer[0] =='<' )
 			{
 				Debug( "received xml from metaverseclient [%s]\n", ReadBuffer );
 				TiXmlDocument IPC;
 				IPC.Parse( ReadBuffer );
+				if( IPC.RootElement() == NULL )
+				{
+					continue;
+				}
 				if( strcmp( IPC.RootElement()->Value(), "loadergetfile" ) == 0 )
 				{
-					LoadFile( &IPC );
+					RequestFile( &IPC );
+				}
+				else if( strcmp( IPC.RootElement()->Value(), "loadercancelfile" ) == 0 && IPC.RootElement()->Attribute("checksum") != NULL )
+				{
+					AssetChannel.CancelFile( IPC.RootElement()->Attribute("checksum") );
+				}
+				else if( strcmp( IPC.RootElement()->Value(), "loaderfilepriority" ) == 0 && IPC.RootElement()->Attribute("checksum") != NULL
+					&& IPC.RootElement()->Attribute("priority") != NULL )
+				{
+					AssetChannel.SetPriority( IPC.RootElement()->Attribute("checksum"), atoi( IPC.RootElement()->Attribute("priority") ) );
 				}
 				else if( strcmp( IPC.RootElement()->Value(), "loadersendfile" ) == 0 )
 				{
@@ -317,6 +375,7 @@ int main(int argc, char *argv[])
 				{
 					// Need to shut down
 					DEBUG("Shutdown request received");
+					bShutdown = true;
 					break;
 				}
 			}
@@ -325,10 +384,10 @@ int main(int argc, char *argv[])
 				DEBUG( "received legacy IPC from metaverseclient [" << ReadBuffer << "]" );
 			}
 		}
-		else if( ReadResult == SOCKETS_READ_SOCKETGONE )
+		if( ReadResult == SOCKETS_READ_SOCKETGONE )
 		{
 			DEBUG( "Server socket gone.  Shutting down." );
-			break;
+			bShutdown = true;
 		}
 	}
 	// Shut down
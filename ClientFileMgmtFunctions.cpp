@@ -108,7 +108,7 @@ void ClientFileFunctionsClass::DownloadFile( FILEINFO &rFileInfo )
     ostringstream messagetoclientfileagentstream;
     messagetoclientfileagentstream << "<loadergetfile type=\"" << rFileInfo.sType << "\" checksum=\"" << rFileInfo.sChecksum
     << "\" sourcefilename=\"" << rFileInfo.sSourceFilename << "\" serverfilename=\"" << rFileInfo.sServerFilename
-    << "\"/>" << endl;
+    << "\" priority=\"" << GetDownloadPriority() << "\"/>" << endl;
     DEBUG(  "sending to clientfileagent " << messagetoclientfileagentstream.str() ); // DEBUG
     //endererMain::SendClientMessage( messagetoclientfileagentstream.str().c_str() );
     TiXmlDocument IPC;
@@ -77,6 +77,11 @@ public:
     {
         return "";
     } //!< returns subdirectory where these files are stored (eg meshes, textures etc)
+
+    virtual int GetDownloadPriority()
+    {
+        return 1000000;
+    } //!< priority of downloads of these files on the asset channel; above any texture's, as meshes and terrain are needed to draw anything
 };
 
 #endif // _CLIENTFILEMGMTFUNCTIONS_H
@@ -198,7 +198,7 @@ void ClientLinkingClass::UnlinkSelectedObject()
         if( iSelectedArrayNum != -1 )
         {
             Object *p_Object = World.GetObject( iSelectedArrayNum );
-            if( strcmp( p_Object->sDeepObjectType, "OBJECTGROUPING" ) == 0 )
+            if( p_Object->DeepTypeTag == DEEPTYPE_OBJECTGROUPING )
             {
                 DEBUG(  "deleting objectgrouping ref " << iSelectedReference ); // DEBUG
                 ostringstream messagestream;
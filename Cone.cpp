@@ -169,6 +169,11 @@ void Cone::WriteToXMLDoc( TiXmlElement *pElement )
     pElement->FirstChildElement("faces")->FirstChildElement("face")->FirstChildElement("texture")->SetAttribute("stexturereference", sTextureReference );
     Prim::WriteToXMLDoc( pElement );
 }
+void Cone::WriteXMLAttributes( XmlWriter &Writer )
+{
+    Writer.Attribute( "type", "CONE" );
+    Prim::WriteXMLAttributes( Writer );
+}
 //void Cone::CopyTo( Cone *ptargetcone )
 //{
 //ptargetcone->color0 = color0;
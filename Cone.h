@@ -88,6 +88,8 @@ public:
    	   DEBUG( "Cone::Cone" );
    	   sprintf( ObjectType, "PRIM" );
    	   sprintf( sDeepObjectType, "CONE" );
+   	   TypeTag = OBJECTTYPE_PRIM;
+   	   DeepTypeTag = DEEPTYPE_CONE;
    	   sprintf( PrimType, "CONE" );
    	   color0.r = 0.2;
    	   color0.g = 0.2;
@@ -103,6 +105,7 @@ public:
    virtual void UpdateFromXML( TiXmlElement *pElement );
    void LoadFromXML( TiXmlElement *pElement );
    virtual void WriteToXMLDoc( TiXmlElement *pElement );
+   virtual void WriteXMLAttributes( XmlWriter &Writer );
    //virtual void CopyTo( Cone *ptargetcube );
    const Cone &Cone::operator=( const Cone &IncomingPrim );
    virtual void Draw();
@@ -175,6 +175,11 @@ void Cube::WriteToXMLDoc( TiXmlElement *pElement )
     pElement->FirstChildElement("faces")->FirstChildElement("face")->FirstChildElement("texture")->SetAttribute("stexturereference", sTextureReference );
     Prim::WriteToXMLDoc( pElement );
 }
+void Cube::WriteXMLAttributes( XmlWriter &Writer )
+{
+    Writer.Attribute( "type", "CUBE" );
+    Prim::WriteXMLAttributes( Writer );
+}
 //void Cube::CopyTo( Cube *ptargetcube )
 //{
 //ptargetcube->color0 = color0;
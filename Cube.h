@@ -88,6 +88,8 @@ public:
    	   DEBUG( "Cube::Cube" );
    	   sprintf( ObjectType, "PRIM" );
    	   sprintf( sDeepObjectType, "CUBE" );
+   	   TypeTag = OBJECTTYPE_PRIM;
+   	   DeepTypeTag = DEEPTYPE_CUBE;
    	   sprintf( PrimType, "CUBE" );
    	   color0.r = 0.2;
    	   color0.g = 0.2;
@@ -103,6 +105,7 @@ public:
    virtual void UpdateFromXML( TiXmlElement *pElement );
    void LoadFromXML( TiXmlElement *pElement );
    virtual void WriteToXMLDoc( TiXmlElement *pElement );
+   virtual void WriteXMLAttributes( XmlWriter &Writer );
    const Cube &Cube::operator=( const Cube &IncomingPrim );
    //virtual void CopyTo( Cube *ptargetcube );
    virtual void Draw();
@@ -169,6 +169,11 @@ void Cylinder::WriteToXMLDoc( TiXmlElement *pElement )
     pElement->FirstChildElement("faces")->FirstChildElement("face")->FirstChildElement("texture")->SetAttribute("stexturereference", sTextureReference );
     Prim::WriteToXMLDoc( pElement );
 }
+void Cylinder::WriteXMLAttributes( XmlWriter &Writer )
+{
+    Writer.Attribute( "type", "CYLINDER" );
+    Prim::WriteXMLAttributes( Writer );
+}
 //void Cylinder::CopyTo( Cylinder *ptargetcylinder )
 //{
 //ptargetcylinder->color0 = color0;
@@ -88,6 +88,8 @@ public:
    	   DEBUG( "Cylinder::Cylinder" );
    	   sprintf( ObjectType, "PRIM" );
    	   sprintf( sDeepObjectType, "CYLINDER" );
+   	   TypeTag = OBJECTTYPE_PRIM;
+   	   DeepTypeTag = DEEPTYPE_CYLINDER;
    	   sprintf( PrimType, "CYLINDER" );
    	   color0.r = 0.2;
    	   color0.g = 0.2;
@@ -103,6 +105,7 @@ public:
    virtual void UpdateFromXML( TiXmlElement *pElement );
    void LoadFromXML( TiXmlElement *pElement );
    virtual void WriteToXMLDoc( TiXmlElement *pElement );
+   virtual void WriteXMLAttributes( XmlWriter &Writer );
    //virtual void CopyTo( Cylinder *ptargetcube );
    const Cylinder &Cylinder::operator=( const Cylinder &IncomingPrim );
    virtual void Draw();
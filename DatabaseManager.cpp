@@ -38,6 +38,7 @@ using namespace std;
 #include "MySQLDBInterface.h"
 #include "IDBInterface.h"
 #include "Parse.h"
+#include "IPCMessages.h"
 #include "Diag.h"
 #include "Config.h"
 #include "System.h"
@@ -64,6 +65,7 @@ int iMetaverseServerPort = 22170;
 
 #define BUFSIZE 2047
 char SendBuffer[BUFSIZE + 1];  //!< buffer for socket sends
+string ObjectMessageBuffer;   //!< reused for each object message written with Object::WriteToXMLWriter, so it keeps its memory
 char ReadBuffer[4097];  //!< buffer for socket reads
 
 char SQLCommands[10][512];  //!< buffer to parse a list of SQLCommands into
@@ -324,21 +326,13 @@ void RetrieveWorldStateForOneObjectType( Object *p_Object )
             p_Object->PopulateFromDBRow();
             DEBUG( "object populated from db row..." );
 
-            TiXmlDocument IPC;
-            IPC.Parse( "<objectrefreshdata>"
-                       "<meta><avatar /></meta>"
-                       "<geometry><pos /><rot /><scale /></geometry>"
-                       "<faces><face num=\"0\"><color/></faces>"
-                       "</objectrefreshdata>" );
-
-            p_Object->WriteToXMLDoc( IPC.RootElement() );
+            ObjectMessageBuffer.clear();
+            XmlWriter Writer( ObjectMessageBuffer );
+            p_Object->WriteToXMLWriter( Writer, "objectrefreshdata" );
+            ObjectMessageBuffer += '\n';
 
-            std::string IPCString;
-            IPCString << IPC;
-            sprintf( SendBuffer, "%s\n", IPCString.c_str() );
-
-            DEBUG( "Sending " << SendBuffer );
-            SocketMetaverseServer.Send( SendBuffer );
+            DEBUG( "Sending " << ObjectMessageBuffer );
+            SocketMetaverseServer.Send( ObjectMessageBuffer.c_str() );
             pdbinterface->NextRow();
         }
         pdbinterface->EndMultiRowQuery();
@@ -493,6 +487,15 @@ void SetInfoFromXML( TiXmlElement *pElement )
                                    " ( %i, '%s', '%s', '%s' );", iOwner, sStore.c_str(), sKey.c_str(), sData.c_str() );
 }
 
+//! Sets each of the values in the script database storage area given by the setinfo children of pElement
+void SetInfoBatchFromXML( TiXmlElement *pElement )
+{
+    for( TiXmlElement *pSetInfoElement = pElement->FirstChildElement("setinfo"); pSetInfoElement != NULL; pSetInfoElement = pSetInfoElement->NextSiblingElement("setinfo") )
+    {
+        SetInfoFromXML( pSetInfoElement );
+    }
+}
+
 //! Retrieves a value in the script database storage area, according to pElement, and sends it to the metaverseserver component
 void RequestInfoXML( TiXmlElement *pElement )
 {
@@ -721,61 +724,74 @@ void MainLoop()
             if( ReadBuffer[0] =='<' )
             {
                 DEBUG( "received xml from server " << ReadBuffer );
-                TiXmlDocument IPC;
-                IPC.Parse( ReadBuffer );
-                if( strcmp( IPC.RootElement()->Value(), "login" ) == 0 )
-                {
-                    Debug( "received authentication request from %s\n", IPC.RootElement()->Attribute("name") );
-                    Authenticate( atoi( IPC.RootElement()->Attribute("iconnectionref") ),
-                                  IPC.RootElement()->Attribute("name"),
-                                  IPC.RootElement()->Attribute("password")
-                                );
-                }
-                else if( strcmp( IPC.RootElement()->Value(), "objectcreate" ) == 0 )
-                {
-                    DEBUG( "received object create request" );
-                    CreateObjectFromXML( IPC.RootElement() );
-                }
-                else if( strcmp( IPC.RootElement()->Value(), "objectimport" ) == 0 )
-                {
-                    DEBUG( "received object create request" );
-                    CreateObjectFromXML( IPC.RootElement() );
-                }
-                else if( strcmp( IPC.RootElement()->Value(), "objectupdate" ) == 0 )
+                IPCMessageType MessageType = GetIPCMessageType( ReadBuffer );
+                LOGINMESSAGE Login;
+                if( MessageType == IPC_LOGIN && ParseLogin( ReadBuffer, Login ) )
                 {
-                    DEBUG(  "received object update request" << ReadBuffer ); // DEBUG
-                    UpdateObject( atoi( IPC.RootElement()->Attribute("ireference" ) ), IPC.RootElement() );
+                    Debug( "received authentication request from %s\n", Login.sName );
+                    Authenticate( Login.iConnectionRef, Login.sName, Login.sPassword );
                 }
-                else if( strcmp( IPC.RootElement()->Value(), "skyboxupdate" ) == 0 )
-                {
-                    DEBUG(  "received skybox update request" << ReadBuffer ); // DEBUG
-                    UpdateSkybox(  IPC.RootElement() );
-                }
-                else if( strcmp( IPC.RootElement()->Value(), "objectdelete" ) == 0 )
-                {
-                    DEBUG( "received object delete request" );
-                    DeleteObjectXML( IPC.RootElement() );
-                }
-                else if( strcmp( IPC.RootElement()->Value(), "setinfo" ) == 0 )
-                {
-                    DEBUG( "received setinfo request" );
-                    SetInfoFromXML( IPC.RootElement() );
-                }
-                else if( strcmp( IPC.RootElement()->Value(), "requestinfo" ) == 0 )
-                {
-                    DEBUG( "received requestinfo request" );
-                    RequestInfoXML( IPC.RootElement() );
-                }
-                else if( strcmp( IPC.RootElement()->Value(), "registerfile" ) == 0 )
-                {
-                    DEBUG( "received registerfile request" );
-                    RegisterFileXML( IPC.RootElement() );
-                }
-                else if( strcmp( IPC.RootElement()->Value(), "requestworldstate" ) == 0 )
+                else if( MessageType == IPC_REQUESTWORLDSTATE )
                 {
                     DEBUG( "Retrieve world command received" );
                     RetrieveWorldState();
                 }
+                else if( MessageType != IPC_UNKNOWN )
+                {
+                    TiXmlDocument IPC;
+                    IPC.Parse( ReadBuffer );
+                    if( IPC.RootElement() == NULL )
+                    {
+                        continue;
+                    }
+
+                    switch( MessageType )
+                    {
+                    case IPC_OBJECTCREATE:
+                    case IPC_OBJECTIMPORT:
+                        DEBUG( "received object create request" );
+                        CreateObjectFromXML( IPC.RootElement() );
+                        break;
+
+                    case IPC_OBJECTUPDATE:
+                        DEBUG(  "received object update request" << ReadBuffer ); // DEBUG
+                        UpdateObject( atoi( IPC.RootElement()->Attribute("ireference" ) ), IPC.RootElement() );
+                        break;
+
+                    case IPC_SKYBOXUPDATE:
+                        DEBUG(  "received skybox update request" << ReadBuffer ); // DEBUG
+                        UpdateSkybox(  IPC.RootElement() );
+                        break;
+
+                    case IPC_OBJECTDELETE:
+                        DEBUG( "received object delete request" );
+                        DeleteObjectXML( IPC.RootElement() );
+                        break;
+
+                    case IPC_SETINFO:
+                        DEBUG( "received setinfo request" );
+                        SetInfoFromXML( IPC.RootElement() );
+                        break;
+
+                    case IPC_SETINFOBATCH:
+                        DEBUG( "received setinfobatch request" );
+                        SetInfoBatchFromXML( IPC.RootElement() );
+                        break;
+
+                    case IPC_REQUESTINFO:
+                        DEBUG( "received requestinfo request" );
+                        RequestInfoXML( IPC.RootElement() );
+                        break;
+
+                    case IPC_REGISTERFILE:
+                        DEBUG( "received registerfile request" );
+                        RegisterFileXML( IPC.RootElement() );
+                        break;
+
+                    default:
+                        break;
+                    }
+                }
             }
             else
             {
@@ -293,7 +293,7 @@ void Editing3DClass::DrawEditBarsToOpenGL()
 
             Vector3 ScaleToUse;
 
-            if( strcmp( p_Object->ObjectType, "PRIM" ) == 0 )
+            if( p_Object->TypeTag == OBJECTTYPE_PRIM )
             {
                 Prim *p_Prim = dynamic_cast< Prim *>( p_Object );
                 ScaleToUse = p_Prim->scale;
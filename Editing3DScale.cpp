@@ -81,7 +81,7 @@ void Editing3DScaleClass::InteractiveHandleEdit( mvEditing3DAxisType Axis, int m
 
     if( p_Object != NULL )
     {
-        if( strcmp( p_Object->ObjectType, "PRIM" ) == 0 )
+        if( p_Object->TypeTag == OBJECTTYPE_PRIM )
         {
             float fDistanceFromUsToObject = VectorMag( p_Object->pos - OurPos );
 
@@ -241,7 +241,7 @@ void Editing3DScaleClass::InteractiveFreeEdit( int mousex, int mousey )
 
     if( p_Object != NULL )
     {
-        if( strcmp( p_Object->ObjectType, "PRIM" ) == 0 )
+        if( p_Object->TypeTag == OBJECTTYPE_PRIM )
         {
             float fDistanceFromUsToObject = VectorMag( p_Object->pos - OurPos );
 
@@ -338,7 +338,7 @@ void _InteractiveFreeScaleEdit_Old( bool bAltAxes, int x, int y )
     int iSelectedArrayNum = World.GetArrayNumForObjectReference( iSelectedReference );
 
     // DEBUG(  "interactive scale edit objectype=[" << World.GetObject( iSelectedArrayNum )->ObjectType << "]" ); // DEBUG
-    if( strcmp( World.GetObject( iSelectedArrayNum )->ObjectType, "PRIM" ) == 0 )
+    if( World.GetObject( iSelectedArrayNum )->TypeTag == OBJECTTYPE_PRIM )
     {
         float HalfWinWidth = RendererImpl::GetWindowWidth() / 2;
         float HalfWinHeight = RendererImpl::GetWindowHeight() / 2;
@@ -416,7 +416,7 @@ void Editing3DScaleClass::InitiateFreeEdit(int mousex, int mousey )
 
     if( p_Object != NULL )
     {
-        if( strcmp( p_Object->ObjectType, "PRIM" ) == 0 )
+        if( p_Object->TypeTag == OBJECTTYPE_PRIM )
         {
             Editing3D.iDragStartX = mousex;
             Editing3D.iDragStartY = mousey;
@@ -438,7 +438,7 @@ void Editing3DScaleClass::InitiateHandleEdit( int mousex, int mousey, mvEditing3
 
     if( p_Object != NULL )
     {
-        if( strcmp( p_Object->ObjectType, "PRIM" ) == 0 )
+        if( p_Object->TypeTag == OBJECTTYPE_PRIM )
         {
             Editing3D.iDragStartX = mousex;
             Editing3D.iDragStartY = mousey;
@@ -0,0 +1,150 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Keeps the list of files the server knows about, for sending to clients in bulk
+//!
+//! Rather than one message per file, clients asking for the world state get one <filemanifest>
+//! message per file type, listing the files in the same elements the per-file broadcasts use:
+//!
+//! <filemanifest type="texture" session="1120000000" epoch="42" since="0">
+//!   <texture checksum="..." serverfilename="..." sourcefilename="..."/>
+//!   ...
+//! </filemanifest>
+//!
+//! all on one line.  Long lists are split over several messages, so each fits the line buffers
+//! clients read with; only the last for a type has final="true".
+//!
+//! A client that kept its file caches can send the session and epoch of the last manifest it got
+//! in <requestworldstate manifestsession="..." manifestepoch="..."/>, and gets only the files
+//! added since.  If the server has restarted since, the session won't match, and it gets everything.
+
+#include <time.h>
+#include <string.h>
+#include <sstream>
+using namespace std;
+
+#include "SocketsClass.h"
+#include "XmlHelper.h"
+#include "FileManifest.h"
+
+//! longest whole message, final newline included; held to the send buffer, the smaller of our
+//! socket buffers, so anything reading or relaying a manifest line can take it whole
+static const size_t iMaxManifestMessageLength = SOCKETS_SEND_BUFFER_LENGTH - 1;
+
+static const char sFinalOpenTag[] = " final=\"true\">";
+static const char sCloseTag[] = "</filemanifest>\n";
+
+static const char *ManifestTypes[] = { "texture", "terrain", "meshfile", "script" };
+static const int iNumManifestTypes = sizeof( ManifestTypes ) / sizeof( ManifestTypes[0] );
+
+FileManifestClass::FileManifestClass()
+{
+    iSession = (int)time( NULL );
+}
+
+bool FileManifestClass::Add( const char *sType, const string &sChecksum, const string &sServerFilename, const string &sSourceFilename )
+{
+    string sKey = string( sType ) + " " + sChecksum;
+    if( Keys.find( sKey ) != Keys.end() )
+    {
+        return false;
+    }
+    Keys.insert( sKey );
+
+    FILEMANIFESTENTRY Entry;
+    Entry.sType = sType;
+    Entry.sChecksum = sChecksum;
+    Entry.sServerFilename = sServerFilename;
+    Entry.sSourceFilename = sSourceFilename;
+    Entries.push_back( Entry );
+    return true;
+}
+
+int FileManifestClass::GetSession() const
+{
+    return iSession;
+}
+
+int FileManifestClass::GetEpoch() const
+{
+    return (int)Entries.size();
+}
+
+// Input: iClientSession, iSinceEpoch: the session and epoch of the last manifest the client got, or 0
+//        bIncludeScripts: whether to list scripts, which only local clients get
+//        Messages: the messages are appended to this, each ending in a newline
+//
+// Returns: None
+//
+// Description: Builds one or more <filemanifest> messages per file type, even if there are
+//  no new files of that type, so the client always learns the current epoch.
+//  If iClientSession isn't ours, lists all files.
+//  Each message, wrapper and newline included, is at most iMaxManifestMessageLength long,
+//  unless a single entry is longer than that by itself.  Filenames are escaped, so they
+//  can hold anything
+void FileManifestClass::GetManifestMessages( int iClientSession, int iSinceEpoch, bool bIncludeScripts, vector< string > &Messages ) const
+{
+    if( iClientSession != iSession || iSinceEpoch < 0 || iSinceEpoch > GetEpoch() )
+    {
+        iSinceEpoch = 0;
+    }
+
+    for( int iType = 0; iType < iNumManifestTypes; iType++ )
+    {
+        string sType = ManifestTypes[ iType ];
+        if( sType == "script" && !bIncludeScripts )
+        {
+            continue;
+        }
+
+        ostringstream headerstream;
+        headerstream << "<filemanifest type=\"" << sType << "\" session=\"" << iSession
+        << "\" epoch=\"" << GetEpoch() << "\" since=\"" << iSinceEpoch << "\"";
+        string sHeader = headerstream.str();
+
+        string sEntries;
+        for( int i = iSinceEpoch; i < GetEpoch(); i++ )
+        {
+            const FILEMANIFESTENTRY &rEntry = Entries[i];
+            if( rEntry.sType != sType )
+            {
+                continue;
+            }
+            string sEntry;
+            XmlWriter Writer( sEntry );
+            Writer.StartElement( sType.c_str() );
+            Writer.Attribute( "checksum", rEntry.sChecksum.c_str() );
+            Writer.Attribute( "serverfilename", rEntry.sServerFilename.c_str() );
+            Writer.Attribute( "sourcefilename", rEntry.sSourceFilename.c_str() );
+            Writer.EndElement();
+
+            // measured as if this were the final message, which has the longer wrapper
+            if( !sEntries.empty() && sHeader.length() + strlen( sFinalOpenTag ) + sEntries.length() + sEntry.length()
+                    + strlen( sCloseTag ) > iMaxManifestMessageLength )
+            {
+                Messages.push_back( sHeader + ">" + sEntries + sCloseTag );
+                sEntries = "";
+            }
+            sEntries += sEntry;
+        }
+        Messages.push_back( sHeader + sFinalOpenTag + sEntries + sCloseTag );
+    }
+}
@@ -0,0 +1,65 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Keeps the list of files the server knows about, for sending to clients in bulk
+
+// see FileManifest.cpp for documentation
+
+#ifndef _FILEMANIFEST_H
+#define _FILEMANIFEST_H
+
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+//! One file in FileManifestClass
+class FILEMANIFESTENTRY
+{
+public:
+   string sType;   //!< root element name clients know the file type by: texture, terrain, meshfile or script
+   string sChecksum;
+   string sServerFilename;
+   string sSourceFilename;
+};
+
+//! FileManifestClass keeps the list of files the server knows about, for sending to clients in bulk
+
+//! FileManifestClass keeps the list of files the server knows about, for sending to clients in bulk
+//! Each file added moves the manifest on one epoch, so clients can ask for just the files added
+//! since an epoch they've seen.  This class only builds the messages; sending them is left to the server
+class FileManifestClass
+{
+public:
+   FileManifestClass();
+
+   bool Add( const char *sType, const string &sChecksum, const string &sServerFilename, const string &sSourceFilename );   //!< adds a file, returning false if it was already there
+   int GetSession() const;   //!< identifies this run of the server; epochs from other runs mean nothing
+   int GetEpoch() const;   //!< number of files added so far
+   void GetManifestMessages( int iClientSession, int iSinceEpoch, bool bIncludeScripts, vector< string > &Messages ) const;   //!< appends <filemanifest> messages listing files added after iSinceEpoch
+
+protected:
+   int iSession;
+   vector< FILEMANIFESTENTRY > Entries;   //!< in the order added; Entries[i] was added at epoch i + 1
+   set< string > Keys;   //!< type and checksum of each entry, to spot duplicates
+};
+
+#endif // _FILEMANIFEST_H
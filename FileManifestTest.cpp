@@ -0,0 +1,165 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief filemanifesttest: headless tests of the <filemanifest> messages FileManifestClass builds
+//!
+//! Fills a manifest with enough long filenames to need splitting, and checks every message,
+//! wrapper included, fits the socket send buffer, that only the last per type is final, that
+//! no file is lost or repeated, and that awkward filenames come out escaped.
+//! Prints each failed check, and exits non-zero if any failed.
+//!
+//! usage: filemanifesttest
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "SocketsClass.h"
+#include "FileManifest.h"
+#include "TestCheck.h"
+
+//! number of times sNeedle appears in sHaystack
+int CountOf( const string &sHaystack, const string &sNeedle )
+{
+    int iCount = 0;
+    for( size_t iPos = sHaystack.find( sNeedle ); iPos != string::npos; iPos = sHaystack.find( sNeedle, iPos + 1 ) )
+    {
+        iCount++;
+    }
+    return iCount;
+}
+
+//! the messages for sType, in order
+vector< string > MessagesOfType( const vector< string > &Messages, const char *sType )
+{
+    string sStart = string( "<filemanifest type=\"" ) + sType + "\"";
+    vector< string > Result;
+    for( int i = 0; i < (int)Messages.size(); i++ )
+    {
+        if( Messages[i].compare( 0, sStart.length(), sStart ) == 0 )
+        {
+            Result.push_back( Messages[i] );
+        }
+    }
+    return Result;
+}
+
+void TestSplitting()
+{
+    const int iNumTextures = 200;
+    FileManifestClass Manifest;
+    for( int i = 0; i < iNumTextures; i++ )
+    {
+        char Checksum[64];
+        sprintf( Checksum, "%032i", i );
+        string sLongName = string( "textures/a rather long directory name/" ) + Checksum + ".tga";
+        CHECK( Manifest.Add( "texture", Checksum, sLongName, string( "c:\\source\\" ) + sLongName ) );
+    }
+    CHECK( !Manifest.Add( "texture", "00000000000000000000000000000000", "other", "other" ) );
+    CHECK( Manifest.Add( "terrain", "terrainchecksum", "terrain.raw", "terrain.raw" ) );
+    CHECK( Manifest.GetEpoch() == iNumTextures + 1 );
+
+    vector< string > Messages;
+    Manifest.GetManifestMessages( 0, 0, false, Messages );
+    for( int i = 0; i < (int)Messages.size(); i++ )
+    {
+        CHECK( Messages[i].length() <= SOCKETS_SEND_BUFFER_LENGTH - 1 );
+        CHECK( Messages[i][ Messages[i].length() - 1 ] == '\n' );
+        CHECK( CountOf( Messages[i], "\n" ) == 1 );
+        CHECK( CountOf( Messages[i], "</filemanifest>" ) == 1 );
+        CHECK( CountOf( Messages[i], "type=\"script\"" ) == 0 );
+    }
+
+    vector< string > TextureMessages = MessagesOfType( Messages, "texture" );
+    CHECK( TextureMessages.size() > 1 );
+    int iNumListed = 0;
+    for( int i = 0; i < (int)TextureMessages.size(); i++ )
+    {
+        bool bLast = ( i == (int)TextureMessages.size() - 1 );
+        CHECK( CountOf( TextureMessages[i], "final=\"true\"" ) == ( bLast ? 1 : 0 ) );
+        iNumListed += CountOf( TextureMessages[i], "<texture " );
+    }
+    CHECK( iNumListed == iNumTextures );
+
+    vector< string > TerrainMessages = MessagesOfType( Messages, "terrain" );
+    CHECK( TerrainMessages.size() == 1 );
+    CHECK( CountOf( TerrainMessages[0], "<terrain " ) == 1 );
+
+    // the meshfile list is empty but still sent, so the client learns the epoch
+    vector< string > MeshMessages = MessagesOfType( Messages, "meshfile" );
+    CHECK( MeshMessages.size() == 1 );
+    CHECK( CountOf( MeshMessages[0], "final=\"true\"" ) == 1 );
+}
+
+void TestEscaping()
+{
+    FileManifestClass Manifest;
+    Manifest.Add( "script", "scriptchecksum", "scripts/100% \"done\" & <dusted>.lua", "it's.lua" );
+
+    vector< string > Messages;
+    Manifest.GetManifestMessages( 0, 0, true, Messages );
+    vector< string > ScriptMessages = MessagesOfType( Messages, "script" );
+    CHECK( ScriptMessages.size() == 1 );
+    if( ScriptMessages.size() == 1 )
+    {
+        CHECK( CountOf( ScriptMessages[0], "serverfilename='scripts/100% &quot;done&quot; &amp; &lt;dusted&gt;.lua'" ) == 1 );
+        CHECK( CountOf( ScriptMessages[0], "sourcefilename=\"it&apos;s.lua\"" ) == 1 );
+    }
+}
+
+void TestSinceEpoch()
+{
+    FileManifestClass Manifest;
+    Manifest.Add( "texture", "one", "one.tga", "one.tga" );
+    Manifest.Add( "texture", "two", "two.tga", "two.tga" );
+
+    vector< string > Messages;
+    Manifest.GetManifestMessages( Manifest.GetSession(), 1, false, Messages );
+    vector< string > TextureMessages = MessagesOfType( Messages, "texture" );
+    CHECK( TextureMessages.size() == 1 );
+    if( TextureMessages.size() == 1 )
+    {
+        CHECK( CountOf( TextureMessages[0], "since=\"1\"" ) == 1 );
+        CHECK( CountOf( TextureMessages[0], "one.tga" ) == 0 );
+        CHECK( CountOf( TextureMessages[0], "two.tga" ) == 2 );
+    }
+
+    // another session's epoch means nothing, so we get everything
+    Messages.clear();
+    Manifest.GetManifestMessages( Manifest.GetSession() + 1, 1, false, Messages );
+    TextureMessages = MessagesOfType( Messages, "texture" );
+    CHECK( TextureMessages.size() == 1 );
+    if( TextureMessages.size() == 1 )
+    {
+        CHECK( CountOf( TextureMessages[0], "since=\"0\"" ) == 1 );
+        CHECK( CountOf( TextureMessages[0], "one.tga" ) == 2 );
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    TestSplitting();
+    TestEscaping();
+    TestSinceEpoch();
+
+    return ReportChecks();
+}
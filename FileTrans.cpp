@@ -25,88 +25,317 @@
 // 20050409 Mark Wagner - Made thread-safe, modified so all error messages
 //  use the DEBUG framework, vastly improved the error-handling
 // 20050416 Hugh Perkins - renamed ERROR to ERRORMSG (naming conflict on Windows)
+// Downloads are ranged, journaled and checksum-verified so they can be resumed
 
 #include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <errno.h>
 #include <iostream>
+#include <string>
 using namespace std;
 
+#include "tinyxml.h"
+
 #include "FileTrans.h"
 #include "SocketsClass.h"
+#include "Checksum.h"
+
+// Partial downloads are kept in <path>.part, with a journal in <path>.journal
+// holding "<checksum> <bytes>": how much of the .part file is known to be on disk
+static const char *sPartialSuffix = ".part";
+static const char *sJournalSuffix = ".journal";
+static const long iJournalInterval = 262144;  // bytes received between journal updates
+
+void FileTransDiscardPartialFile( const char *sFilePath )
+{
+	remove( ( string( sFilePath ) + sPartialSuffix ).c_str() );
+	remove( ( string( sFilePath ) + sJournalSuffix ).c_str() );
+}
+
+FileTransPartialFile::FileTransPartialFile()
+{
+	pFile = NULL;
+	iBytesWritten = 0;
+	iBytesSinceJournal = 0;
+}
+
+// Input: sFilePath: the absolute path the finished file will have
+//        sChecksum: md5 checksum of the file, or ""; recorded in the journal
+//        iOffset: where the incoming data starts, from FileTransGetResumeOffset
+//
+// Returns: True if the partial file could be opened, false otherwise
+bool FileTransPartialFile::Open( const char *sFilePath, const char *sChecksum, long iOffset )
+{
+	this->sFilePath = sFilePath;
+	this->sChecksum = sChecksum;
+	iBytesWritten = iOffset;
+	iBytesSinceJournal = 0;
+	pFile = fopen( ( this->sFilePath + sPartialSuffix ).c_str(), iOffset == 0 ? "wb" : "r+b" );
+	if( NULL == pFile || fseek( pFile, iOffset, SEEK_SET ) != 0 )
+	{
+		ERRORMSG("Receive error: Unable to open partial file for " << sFilePath << " for writing");
+		if( NULL != pFile )
+		{
+			fclose( pFile );
+			pFile = NULL;
+		}
+		return false;
+	}
+	return true;
+}
+
+// Input: buffer, bytes: the next data of the file
+//
+// Returns: True if the data was written, false otherwise
+//
+// Description: Appends data to the partial file.  Every iJournalInterval bytes the
+//  file is flushed and the journal updated.
+bool FileTransPartialFile::Write( const char *buffer, size_t bytes )
+{
+	if( NULL == pFile || fwrite( buffer, sizeof( char ), bytes, pFile ) != bytes )
+	{
+		ERRORMSG( "Write error " << strerror(errno) << " writing partial file for " << sFilePath );
+		return false;
+	}
+	iBytesWritten += bytes;
+	iBytesSinceJournal += bytes;
+	if( iBytesSinceJournal >= iJournalInterval )
+	{
+		fflush( pFile );
+		WriteJournal();
+		iBytesSinceJournal = 0;
+	}
+	return true;
+}
+
+//! Flushes and closes the partial file and brings the journal up to date
+void FileTransPartialFile::Close()
+{
+	if( NULL == pFile )
+	{
+		return;
+	}
+	fflush( pFile );
+	fclose( pFile );
+	pFile = NULL;
+	WriteJournal();
+}
+
+void FileTransPartialFile::WriteJournal()
+{
+	string sJournalPath = sFilePath + sJournalSuffix;
+	FILE *fJournal = fopen( sJournalPath.c_str(), "wb" );
+	if( NULL == fJournal )
+	{
+		WARNING( "Unable to write download journal " << sJournalPath );
+		return;
+	}
+	fprintf( fJournal, "%s %ld\n", sChecksum.c_str(), iBytesWritten );
+	fclose( fJournal );
+}
+
+// Input: sFilePath: the absolute path the finished file will have
+//        sChecksum: md5 checksum of the file being downloaded
+//
+// Returns: The offset to resume the download of sFilePath from; 0 to start afresh
+//
+// Description: Checks the journal left by an interrupted FileTransGetFile.  A partial
+//  file is only resumed if it was for the same checksum, and is at least as long as
+//  the journal says.  Without a checksum we cant tell what a partial file contains,
+//  so those downloads always start afresh.
+long FileTransGetResumeOffset( const char *sFilePath, const char *sChecksum )
+{
+	if( NULL == sFilePath || NULL == sChecksum || strlen( sChecksum ) == 0 || strlen( sChecksum ) > 32 )
+	{
+		return 0;
+	}
+
+	char sJournalChecksum[ 33 ] = "";
+	long iJournalBytes = 0;
+	FILE *fJournal = fopen( ( string( sFilePath ) + sJournalSuffix ).c_str(), "rb" );
+	if( NULL == fJournal )
+	{
+		return 0;
+	}
+	int iFieldsRead = fscanf( fJournal, "%32s %ld", sJournalChecksum, &iJournalBytes );
+	fclose( fJournal );
+
+	struct stat PartialInfo;
+	if( iFieldsRead != 2 || strcmp( sJournalChecksum, sChecksum ) != 0 || iJournalBytes <= 0
+		|| stat( ( string( sFilePath ) + sPartialSuffix ).c_str(), &PartialInfo ) != 0
+		|| PartialInfo.st_size < iJournalBytes )
+	{
+		DEBUG( "Discarding unusable partial download of " << sFilePath );
+		FileTransDiscardPartialFile( sFilePath );
+		return 0;
+	}
+	DEBUG( "Resuming download of " << sFilePath << " from byte " << iJournalBytes );
+	return iJournalBytes;
+}
 
 // Input: sockettouse: a pointer to a socket to read data from
-//        sFilePath: the absolute path to the file to write data to
+//        sFilePath: the absolute path the finished file will have
+//        sChecksum: md5 checksum of the file, or "" if unknown; recorded in the journal
+//        iOffset: the offset the range was requested from, from FileTransGetResumeOffset
 //
-// Returns: True if the file was fully read, false otherwise
+// Returns: True if the whole rest of the file was received, false otherwise
 //
-// Description: Reads a file from the specified socket, and writes
-//  it to the file specified in "sFilePath", in chunks of 4096 bytes
-//  per pass.  The socket remains open if the file was read successfully;
-//  if an error occurred, the socket state is undefined; the file will
-//  contain a partial file.
+// Description: Reads the server's loaderfilerange header, then the data for that
+//  range, writing it into the partial file at the range offset.  Every
+//  iJournalInterval bytes, and when the transfer stops for any reason, the
+//  partial file is flushed and the journal updated, so an interrupted download
+//  can be resumed with FileTransGetResumeOffset.  Nothing is written to sFilePath
+//  itself; FileTransCompleteFile verifies the partial file and moves it there.
+//  The socket remains open.
 //
 // Thread safety: Function is thread-safe, assuming that mvsocket and the
 //  file-access calls are.
 //
 // History: 20050409 Mark Wagner - made thread-safe
-bool FileTransGetFile( mvsocket *sockettouse, const char *sFilePath )
+bool FileTransGetFile( mvsocket *sockettouse, const char *sFilePath, const char *sChecksum, long iOffset )
 {
 	char ReadBuffer[ 4097 ];
-	FILE *fIncomingFile = NULL;
-	bool bFileOpen = false;
-	bool result = false;
 	int BytesRecv;
-	
+
 	// Sanity-check input
-	if( NULL == sockettouse || NULL == sFilePath )
+	if( NULL == sockettouse || NULL == sFilePath || NULL == sChecksum )
 	{
 		ERRORMSG("Invalid parameter in FileTransGetFile");
 		return false;
 	}
 
-	fIncomingFile = fopen( sFilePath, "wb" );
-	if(NULL == fIncomingFile)
+	if( sockettouse->ReceiveLineBlocking( ReadBuffer ) != SOCKETS_READ_OK )
+	{
+		ERRORMSG( "Receive error: no reply from server for " << sFilePath );
+		return false;
+	}
+	TiXmlDocument RangeHeader;
+	RangeHeader.Parse( ReadBuffer );
+	TiXmlElement *pRange = RangeHeader.RootElement();
+	if( NULL == pRange || strcmp( pRange->Value(), "loaderfilerange" ) != 0
+		|| NULL == pRange->Attribute("offset") || NULL == pRange->Attribute("length") || NULL == pRange->Attribute("filesize") )
+	{
+		ERRORMSG( "Receive error: bad range header [" << ReadBuffer << "] for " << sFilePath );
+		return false;
+	}
+	long iRangeOffset = atol( pRange->Attribute("offset") );
+	long iBytesRemaining = atol( pRange->Attribute("length") );
+	long iFileSize = atol( pRange->Attribute("filesize") );
+	if( iRangeOffset != iOffset || iRangeOffset + iBytesRemaining != iFileSize )
+	{
+		// eg the partial file is longer than the server's copy; start again next time
+		WARNING( "Server sent range " << iRangeOffset << "+" << iBytesRemaining << " of " << iFileSize
+			<< ", asked for " << iOffset << " onwards; discarding partial download of " << sFilePath );
+		FileTransDiscardPartialFile( sFilePath );
+		return false;
+	}
+
+	FileTransPartialFile IncomingFile;
+	if( !IncomingFile.Open( sFilePath, sChecksum, iOffset ) )
 	{
-		ERRORMSG("Receive error: Unable to open file " << sFilePath << " for writing");
 		return false;
 	}
 	
-	bFileOpen = true;
-	DEBUG( "Beginning transfer of file " << sFilePath );
+	DEBUG( "Beginning transfer of file " << sFilePath << " from byte " << iOffset << ", " << iBytesRemaining << " bytes to go" );
 	
-	while( bFileOpen )
+	while( iBytesRemaining > 0 )
 	{
-		BytesRecv = sockettouse->Receive( ReadBuffer, 4096 );
+		BytesRecv = sockettouse->Receive( ReadBuffer, iBytesRemaining < 4096 ? iBytesRemaining : 4096 );
 
 		if( BytesRecv == SOCKET_ERROR )
 		{
 			// A transfer error occurred
 			ERRORMSG( "Transfer error " << strerror(errno) );
-			bFileOpen = false;
-			result = false;
+			break;
 		}
 		else if( BytesRecv > 0 )
 		{
 			// Got data
-			fwrite( ReadBuffer, sizeof( char ), BytesRecv, fIncomingFile );
+			if( !IncomingFile.Write( ReadBuffer, BytesRecv ) )
+			{
+				break;
+			}
+			iBytesRemaining -= BytesRecv;
 		}
 		else if( BytesRecv == 0 )
 		{
-			// Connection cleanly closed; assume a successful transfer
-			bFileOpen = false;
-			result = true;
+			// Connection closed before the range was complete
+			WARNING( "Connection closed with " << iBytesRemaining << " bytes of " << sFilePath << " still to come" );
+			break;
 		}
 		else
 		{
 			// Unknown error
 			ERRORMSG( "Unknown socket result " << BytesRecv << " errno " << strerror(errno) );
-			bFileOpen = false;
-			result = false;
+			break;
 		}
 	}
-	fclose( fIncomingFile );
-	DEBUG( "Transfer finished" ); // DEBUG
-	return result;
+	IncomingFile.Close();
+	DEBUG( "Transfer finished, " << IncomingFile.GetBytesWritten() << " of " << iFileSize << " bytes" ); // DEBUG
+	return iBytesRemaining == 0;
 }	
+
+// Input: sFilePath: the absolute path the finished file will have
+//        sChecksum: md5 checksum of the file, or "" if unknown
+//
+// Returns: True if the file was verified and is now at sFilePath, false otherwise
+//
+// Description: Checks the md5 checksum of a completely downloaded partial file
+//  and renames it to sFilePath, so a file only ever appears under its real name
+//  once it is whole.  A partial file that fails the check is thrown away.
+bool FileTransCompleteFile( const char *sFilePath, const char *sChecksum )
+{
+	string sPartialPath = string( sFilePath ) + sPartialSuffix;
+	if( NULL != sChecksum && strlen( sChecksum ) > 0 )
+	{
+		string sActualChecksum = GenerateCheckString( sPartialPath );
+		if( sActualChecksum != sChecksum )
+		{
+			ERRORMSG( "Checksum mismatch on download of " << sFilePath << ": expected " << sChecksum << " got " << sActualChecksum );
+			FileTransDiscardPartialFile( sFilePath );
+			return false;
+		}
+	}
+#ifdef _WIN32
+	// rename wont replace an existing file here
+	remove( sFilePath );
+#endif
+	if( rename( sPartialPath.c_str(), sFilePath ) != 0 )
+	{
+		ERRORMSG( "Unable to move downloaded file into place at " << sFilePath << ": " << strerror(errno) );
+		return false;
+	}
+	remove( ( string( sFilePath ) + sJournalSuffix ).c_str() );
+	return true;
+}
+
+// Input: sFilePath: the absolute path the finished file will have
+//        sEncodedFilePath: the path the encoded download's FileTransPartialFile was opened with
+//        Encoding: how the download was encoded
+//        sChecksum: md5 checksum of the decoded file, or "" if unknown
+//
+// Returns: True if the file was decoded, verified and is now at sFilePath, false otherwise
+//
+// Description: Decodes the encoded partial file into sFilePath's partial file, then
+//  finishes as FileTransCompleteFile.  The checksum is of the original file, so it
+//  also verifies the decoding.
+//
+// Thread safety: thread-safe, so it can run on a background thread
+bool FileTransCompleteEncodedFile( const char *sFilePath, const char *sEncodedFilePath, AssetEncoding Encoding, const char *sChecksum )
+{
+	string sEncodedPartialPath = string( sEncodedFilePath ) + sPartialSuffix;
+	string sPartialPath = string( sFilePath ) + sPartialSuffix;
+	bool bDecoded = AssetDecodeFile( Encoding, sEncodedPartialPath.c_str(), sPartialPath.c_str() );
+	FileTransDiscardPartialFile( sEncodedFilePath );
+	if( !bDecoded )
+	{
+		remove( sPartialPath.c_str() );
+		return false;
+	}
+	return FileTransCompleteFile( sFilePath, sChecksum );
+}
    
 // Input: sockettouse: a pointer to an mvsocket to send data on
 //        sFilePath: a string containing the path of the file to send
@@ -114,7 +343,8 @@ bool FileTransGetFile( mvsocket *sockettouse, const char *sFilePath )
 // Returns: True if the file was sent successfully, false otherwise
 //
 // Description: Sends the file "sFilePath" to whatever's on the other end
-//  of "sockettouse" at a rate of 1200 bytes per pass.  The socket remains
+//  of "sockettouse", up to 64KB per pass using SendFileChunk, which avoids
+//  copying the file through user space where the OS allows.  The socket remains
 //  open when the function returns, assuming no errors occurred.  In the
 //  event of a transfer error, the state of the socket is undefined.
 //
@@ -126,11 +356,11 @@ bool FileTransGetFile( mvsocket *sockettouse, const char *sFilePath )
 //          20050413 Mark Wagner - Modified to handle errors when sending the end of the file
 bool FileTransSendFile( mvsocket *sockettouse, const char *sFilePath )
 {
-	size_t bytes =  0;
+	const size_t iSendChunkSize = 65536;
 	ssize_t bytes_sent = 0;
 	bool result = false;
-	char ReadBuffer[ 4097 ];
 	FILE *fOutgoingFile;
+	struct stat FileInfo;
 
 	// Sanity-check input
 	if( NULL == sockettouse || NULL == sFilePath )
@@ -145,50 +375,33 @@ bool FileTransSendFile( mvsocket *sockettouse, const char *sFilePath )
 		DEBUG(  "couldnt open file " << sFilePath ); // DEBUG
 		return false;
 	}
-
-	bool bFileOpen = true;
+	if( fstat( fileno( fOutgoingFile ), &FileInfo ) != 0 )
+	{
+		ERRORMSG( "Read error " << strerror(errno) << " reading file " << sFilePath );
+		fclose( fOutgoingFile );
+		return false;
+	}
 
 	DEBUG("Beginning transfer for file " << sFilePath );
 
-	int BytesRead;
-	while( bFileOpen )
+	size_t FileSize = FileInfo.st_size;
+	off_t Offset = 0;
+	result = true;
+	while( result && (size_t)Offset < FileSize )
 	{
-		BytesRead = fread( ReadBuffer, sizeof( char), 1200, fOutgoingFile );
-
-		if( feof( fOutgoingFile ) != 0 )
+		size_t BytesToSend = FileSize - Offset;
+		if( BytesToSend > iSendChunkSize )
 		{
-			bFileOpen = false;
-			DEBUG( "File " << sFilePath << " completely read, sending remainder of data" );
-			bytes_sent = sockettouse->Send( ReadBuffer, BytesRead );
-			if(SOCKET_ERROR == bytes_sent)
-			{
-				result = false;
-			}
-			else
-			{
-				result = true;
-			}
+			BytesToSend = iSendChunkSize;
 		}
-		else if( ferror( fOutgoingFile ) != 0 )
+		// the socket is blocking, so this waits for buffer space rather than returning 0
+		bytes_sent = sockettouse->SendFileChunk( fileno( fOutgoingFile ), Offset, BytesToSend );
+		if( bytes_sent <= 0 )
 		{
-			ERRORMSG( "Read error " << strerror(errno) << " reading file " << sFilePath );
-//			sockettouse.Close();
+			ERRORMSG( "Socket transfer error " << strerror(errno) << " on file " << sFilePath );
 			result = false;
-			bFileOpen = false;
 		}
-		else
-		{
-			bytes_sent = sockettouse->Send( ReadBuffer, BytesRead );
-			if( SOCKET_ERROR == bytes_sent )
-			{
-				ERRORMSG( "Socket transfer error " << strerror(errno) << " on file " << sFilePath );
-				result = false;
-				bFileOpen = false;
-			}
-		}
-		bytes += bytes_sent;
-		DEBUG(bytes << " bytes sent" );
-
+		DEBUG(Offset << " bytes sent" );
 	}
 	fclose( fOutgoingFile );
 	if(result)
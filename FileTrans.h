@@ -25,15 +25,75 @@
 //! in theory it should probably be possible to reuse these functions in the serverfileagent, though
 //! it's less easy than it seems to decouple the serverfileagent functions like this
 
+#include <string>
+using namespace std;
+
 #include "SocketsClass.h"
+#include "AssetCodec.h"
+
+//! A download being written to a journaled partial file next to its final path
+
+//! A download being written to a journaled partial file next to its final path
+//! The journal records how many bytes of the partial file are safely on disk,
+//! so FileTransGetResumeOffset can pick the download up again after an interruption
+class FileTransPartialFile
+{
+public:
+	FileTransPartialFile();
+	bool Open( const char *sFilePath, const char *sChecksum, long iOffset );   //!< opens the partial file for sFilePath, positioned at iOffset
+	bool Write( const char *buffer, size_t bytes );   //!< appends data, journaling periodically
+	void Close();   //!< flushes, closes and journals
+	long GetBytesWritten()
+	{
+		return iBytesWritten;
+	}   //!< partial file length so far
+	bool IsOpen()
+	{
+		return pFile != NULL;
+	}
+
+protected:
+	FILE *pFile;
+	string sFilePath;
+	string sChecksum;
+	long iBytesWritten;
+	long iBytesSinceJournal;
+
+	void WriteJournal();
+};
+
+//! Deletes any partial file and journal for sFilePath
+void FileTransDiscardPartialFile( const char *sFilePath );
 
-//! Gets file sFilePath from connected peer on sockettouse
+//! Returns the offset an interrupted download of sFilePath can resume from, or 0
 
-//! Gets file from connected peer on sockettouse
-//! writes it to sFilePath
+//! Returns the offset an interrupted download of sFilePath can resume from, or 0
+//! Only partial downloads journaled for the same sChecksum are resumed
+long FileTransGetResumeOffset( const char *sFilePath, const char *sChecksum );
+
+//! Gets the rest of file sFilePath, from iOffset on, from connected peer on sockettouse
+
+//! Gets the rest of file sFilePath, from iOffset on, from connected peer on sockettouse
+//! the peer sends a loaderfilerange header first
+//! writes it to a journaled partial file next to sFilePath, not to sFilePath itself
 //! socket stays open after function call
-//! returns true if worked, false if failed
-bool FileTransGetFile( mvsocket *sockettouse, const char *sFilePath );
+//! returns true if the whole file arrived, false if failed; call FileTransCompleteFile after success
+bool FileTransGetFile( mvsocket *sockettouse, const char *sFilePath, const char *sChecksum, long iOffset );
+
+//! Verifies a downloaded partial file against sChecksum and moves it to sFilePath
+
+//! Verifies a downloaded partial file against sChecksum and moves it to sFilePath
+//! the move is a rename, so sFilePath never holds a partial file
+//! returns true if worked; a file that fails verification is deleted
+bool FileTransCompleteFile( const char *sFilePath, const char *sChecksum );
+
+//! Decodes a downloaded encoded partial file, then verifies it and moves it to sFilePath
+
+//! Decodes a downloaded encoded partial file, then verifies it and moves it to sFilePath
+//! sEncodedFilePath is the path the encoded download's partial file was opened with;
+//! the encoded partial file is deleted either way
+//! returns true if worked
+bool FileTransCompleteEncodedFile( const char *sFilePath, const char *sEncodedFilePath, AssetEncoding Encoding, const char *sChecksum );
    
 //! Sends file sFilePath to connected peer on sockettouse
 
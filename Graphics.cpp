@@ -431,107 +431,6 @@ void mvGraphicsClass::DoCylinder()
     glCallList(LISTCylinder);
 }
 
-// based on http://nehe.gamedev.net
-int Height( unsigned char *g_HeightMap, int iMapSize, const int X, const int Y)    // This Returns The Height From A Height Map Index
-{
-    int x = X % iMapSize;        // Error Check Our x Value
-    int y = Y % iMapSize;        // Error Check Our y Value
-
-    if(!g_HeightMap)
-        return 0;       // Make Sure Our Data Is Valid
-
-    return g_HeightMap[x + (y * iMapSize)];    // Index Into Our Height Array And Return The Height
-}
-
-// based on http://nehe.gamedev.net
-void mvGraphicsClass::RenderHeightMap(  unsigned char *g_HeightMap, int iMapSize )     // This Renders The Height Map As Quads
-{
-    int X = 0, Y = 0;
-    int x, y, z;
-
-    if( !g_HeightMap )
-    {
-        DEBUG(  "Error: no height map data available" ); // DEBUG
-        return;
-    }
-
-    glBegin( GL_QUADS );
-
-    // DEBUG(  "drawing quads..." ); // DEBUG
-    for ( X = 2; X < (iMapSize - 3); X += 1 )
-    {
-        // DEBUG(  "X " << X ); // DEBUG
-        for ( Y = 2; Y < (iMapSize - 3); Y += 1 )
-        {
-            Vector3 Normal; // = VectorNormals[ X + 128 * Y ];
-            Normal.z = 1;
-            Normal.x = ( Height( g_HeightMap, iMapSize, X + 10, Y ) - Height( g_HeightMap, iMapSize, X, Y ) ) / 10.0f;
-            Normal.y = ( Height( g_HeightMap, iMapSize, X, Y + 10 ) - Height( g_HeightMap, iMapSize, X, Y ) ) / 10.0f;
-
-            x = X;
-            y = Y;
-            z = Height( g_HeightMap, iMapSize, X, Y );
-            glNormal3f( Normal.x, Normal.y, Normal.z);
-            glTexCoord2f((float)X / (float)iMapSize, (float)Y / (float)iMapSize);
-            glVertex3i(x, y, z);
-
-            x = X + 1;
-            y = Y;
-            z = Height( g_HeightMap, iMapSize, X + 1, Y );
-            glNormal3f( Normal.x, Normal.y, Normal.z);
-            glTexCoord2f((float)(X + 1) / (float)iMapSize, (float)(Y ) / (float)iMapSize);
-            glVertex3i(x, y, z);
-
-            x = X + 1;
-            y = Y + 1 ;
-            z = Height( g_HeightMap, iMapSize, X + 1, Y + 1 );
-            glNormal3f( Normal.x, Normal.y, Normal.z);
-            glTexCoord2f((float)(X + 1) / (float)iMapSize, (float)(Y + 1 ) / (float)iMapSize);
-            glVertex3i(x, y, z);
-
-            x = X;
-            y = Y + 1 ;
-            z = Height( g_HeightMap, iMapSize, X, Y + 1 );
-            glNormal3f( Normal.x, Normal.y, Normal.z);
-            glTexCoord2f((float)(X) / (float)iMapSize, (float)(Y + 1 ) / (float)iMapSize);
-            glVertex3i(x, y, z);
-        }
-    }
-    //DEBUG(  "Quads done" << X ); // DEBUG
-    glEnd();
-}
-
-//int mvGraphicsClass::iNextTerrainListNumber = 1001;
-
-void mvGraphicsClass::RenderTerrain(  unsigned char *g_HeightMap, int iMapSize )
-{
-    // DEBUG(  "RenderTerrain() start..." ); // DEBUG
-    glPushMatrix();
-    glTranslatef( -0.5,-0.5,-0.5 );
-    glScalef( 1 / (float)iMapSize, 1 / (float)iMapSize, 1.0f / 256.0f );
-
-    //if( !bTerrainListInitialized )
-    // {
-    //  iOurTerrainListNumber = iNextTerrainListNumber;
-    // iNextTerrainListNumber++;
-
-    //   glNewList(iOurTerrainListNumber, GL_COMPILE);
-    // DEBUG(  "rendering height map..." ); // DEBUG
-
-    RenderHeightMap( g_HeightMap, iMapSize );
-    // DEBUG(  "rendering done" ); // DEBUG
-    //   glEndList();
-
-    //  bTerrainListInitialized = true;
-    //}
-
-    //glCallList(iOurTerrainListNumber);
-
-    glPopMatrix();
-
-    //  DEBUG(  "RenderTerrain() ... done" ); // DEBUG
-}
-
 void mvGraphicsClass::Translatef( float x, float y, float z )
 {
     ::glTranslatef( x, y, z );
@@ -577,3 +476,145 @@ void mvGraphicsClass::Rotatef( float fAngleDegrees, float fX, float fY, float fZ
     glRotatef( fAngleDegrees, fX, fY, fZ );
 }
 
+void mvGraphicsClass::GetViewFrustum( VIEWFRUSTUM &Frustum )
+{
+    GLfloat Projection[16];
+    GLfloat ModelView[16];
+    glGetFloatv( GL_PROJECTION_MATRIX, Projection );
+    glGetFloatv( GL_MODELVIEW_MATRIX, ModelView );
+
+    GLfloat Clip[16];
+    for( int iColumn = 0; iColumn < 4; iColumn++ )
+    {
+        for( int iRow = 0; iRow < 4; iRow++ )
+        {
+            Clip[ iColumn * 4 + iRow ] = 0;
+            for( int k = 0; k < 4; k++ )
+            {
+                Clip[ iColumn * 4 + iRow ] += Projection[ k * 4 + iRow ] * ModelView[ iColumn * 4 + k ];
+            }
+        }
+    }
+    FrustumFromClipMatrix( Frustum, Clip );
+}
+
+// The modelview matrix takes a point to eye coordinates, where the eye is at 0,0,0, so the eye is
+// wherever the matrix takes to 0,0,0: minus the inverse of its rotation and scale, times its translation
+void mvGraphicsClass::GetEyePosition( Vector3 &EyePos )
+{
+    GLfloat ModelView[16];
+    glGetFloatv( GL_MODELVIEW_MATRIX, ModelView );
+
+    // A[row][column], from the column-major OpenGL matrix
+    float A[3][3];
+    for( int iRow = 0; iRow < 3; iRow++ )
+    {
+        for( int iColumn = 0; iColumn < 3; iColumn++ )
+        {
+            A[iRow][iColumn] = ModelView[ iColumn * 4 + iRow ];
+        }
+    }
+    float Translation[3] = { ModelView[12], ModelView[13], ModelView[14] };
+
+    float Cofactors[3][3];
+    for( int iRow = 0; iRow < 3; iRow++ )
+    {
+        for( int iColumn = 0; iColumn < 3; iColumn++ )
+        {
+            int r0 = ( iRow + 1 ) % 3, r1 = ( iRow + 2 ) % 3;
+            int c0 = ( iColumn + 1 ) % 3, c1 = ( iColumn + 2 ) % 3;
+            Cofactors[iRow][iColumn] = A[r0][c0] * A[r1][c1] - A[r0][c1] * A[r1][c0];
+        }
+    }
+    float fDeterminant = A[0][0] * Cofactors[0][0] + A[0][1] * Cofactors[0][1] + A[0][2] * Cofactors[0][2];
+    if( fDeterminant == 0 )
+    {
+        EyePos = Vector3( 0, 0, 0 );
+        return;
+    }
+
+    // the inverse is the transpose of the cofactors, over the determinant
+    float Eye[3];
+    for( int iAxis = 0; iAxis < 3; iAxis++ )
+    {
+        Eye[iAxis] = 0;
+        for( int k = 0; k < 3; k++ )
+        {
+            Eye[iAxis] -= Cofactors[k][iAxis] * Translation[k] / fDeterminant;
+        }
+    }
+    EyePos = Vector3( Eye[0], Eye[1], Eye[2] );
+}
+
+// The vertices stay where the caller keeps them, so nothing is copied or compiled; GL_NORMALIZE is on while
+// drawing since the caller's transform usually scales the terrain a long way from the size of its normals
+void mvGraphicsClass::DrawIndexedTriangles( const BATCHVERTEX *pVertices, const unsigned short *pIndices, int iNumIndices )
+{
+    glEnable( GL_NORMALIZE );
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glEnableClientState( GL_NORMAL_ARRAY );
+    glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+    glVertexPointer( 3, GL_FLOAT, sizeof( BATCHVERTEX ), pVertices[0].Pos );
+    glNormalPointer( GL_FLOAT, sizeof( BATCHVERTEX ), pVertices[0].Normal );
+    glTexCoordPointer( 2, GL_FLOAT, sizeof( BATCHVERTEX ), pVertices[0].TexCoord );
+
+    glDrawElements( GL_TRIANGLES, iNumIndices, GL_UNSIGNED_SHORT, pIndices );
+
+    glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+    glDisableClientState( GL_NORMAL_ARRAY );
+    glDisableClientState( GL_VERTEX_ARRAY );
+    glDisable( GL_NORMALIZE );
+}
+
+// The vertices go into a display list, which keeps its own copy, normally in video memory, so the caller
+// can free them straight afterwards
+int mvGraphicsClass::CreateStaticBatch( const BATCHVERTEX *pVertices, int iNumVertices )
+{
+    // the prim lists above dont come from glGenLists, so take them, so it doesnt hand them out
+    GLuint iList = glGenLists( 1 );
+    while( iList != 0 && iList <= LISTCone )
+    {
+        iList = glGenLists( 1 );
+    }
+    if( iList == 0 )
+    {
+        return -1;
+    }
+
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glEnableClientState( GL_NORMAL_ARRAY );
+    glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+    glEnableClientState( GL_COLOR_ARRAY );
+    glVertexPointer( 3, GL_FLOAT, sizeof( BATCHVERTEX ), pVertices[0].Pos );
+    glNormalPointer( GL_FLOAT, sizeof( BATCHVERTEX ), pVertices[0].Normal );
+    glTexCoordPointer( 2, GL_FLOAT, sizeof( BATCHVERTEX ), pVertices[0].TexCoord );
+    glColorPointer( 3, GL_FLOAT, sizeof( BATCHVERTEX ), pVertices[0].Color );
+
+    glNewList( iList, GL_COMPILE );
+    glDrawArrays( GL_TRIANGLES, 0, iNumVertices );
+    glEndList();
+
+    glDisableClientState( GL_COLOR_ARRAY );
+    glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+    glDisableClientState( GL_NORMAL_ARRAY );
+    glDisableClientState( GL_VERTEX_ARRAY );
+
+    return (int)iList;
+}
+
+void mvGraphicsClass::DrawStaticBatch( int iBatchHandle, int iTextureID )
+{
+    // each vertex has its own color, which the lighting uses as the material
+    glColorMaterial( GL_FRONT, GL_AMBIENT_AND_DIFFUSE );
+    glEnable( GL_COLOR_MATERIAL );
+    glBindTexture( GL_TEXTURE_2D, iTextureID );
+    glCallList( iBatchHandle );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+    glDisable( GL_COLOR_MATERIAL );
+}
+
+void mvGraphicsClass::DeleteStaticBatch( int iBatchHandle )
+{
+    glDeleteLists( iBatchHandle, 1 );
+}
+
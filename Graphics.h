@@ -75,9 +75,6 @@ public:
 
    virtual void DoWireSphere();  //!< Draws a wire sphere
 
-	virtual void RenderHeightMap(  unsigned char *g_HeightMap, int iMapSize );  //!< renders the terrain in g_HeightMap; which is of size iMapSize x iMapSize (each height is one byte)
-   virtual void RenderTerrain(  unsigned char *g_HeightMap, int iMapSize );  //!< renders the terrain in g_HeightMap; which is of size iMapSize x iMapSize (each height is one byte)
-
   	virtual void DrawSquareXYPlane();                   //!< draws a 1x1 square in current x-y plane, centered on 0,0,0
   	virtual void DrawParallelSquares( int iNumSlices );   //!< draws parallel squares in current x-y plane, along the z-axis, from -0.5 to +0.5
 
@@ -90,6 +87,13 @@ public:
 	virtual void PushMatrix();  //!< wraps glPushMatrix
    virtual void SetMaterialColor(float *mcolor);
    virtual void RasterPos3f(float x, float y, float z );
+
+   virtual void GetViewFrustum( VIEWFRUSTUM &Frustum );   //!< gets the frustum of the current projection and modelview matrices
+   virtual void GetEyePosition( Vector3 &EyePos );   //!< gets where the eye is, in the coordinates of the current modelview matrix
+   virtual void DrawIndexedTriangles( const BATCHVERTEX *pVertices, const unsigned short *pIndices, int iNumIndices );   //!< draws triangles, three indices into pVertices each, in the current material and texture
+   virtual int CreateStaticBatch( const BATCHVERTEX *pVertices, int iNumVertices );   //!< compiles triangles, three vertices each, into a display list; returns its handle
+   virtual void DrawStaticBatch( int iBatchHandle, int iTextureID );   //!< draws a batch from CreateStaticBatch, with texture iTextureID
+   virtual void DeleteStaticBatch( int iBatchHandle );   //!< frees a batch from CreateStaticBatch
 };
 
 #endif // _MVGRAPHICS_H
@@ -27,6 +27,16 @@
 #include <string.h>
 
 #include "BasicTypes.h"
+#include "Math.h"
+
+//! One vertex of a static batch, already in world coordinates, or of a terrain chunk; see StaticBatches.cpp and TerrainMesh.cpp
+struct BATCHVERTEX
+{
+   float Pos[3];
+   float Normal[3];
+   float TexCoord[2];
+   float Color[3];   //!< ambient and diffuse material color
+};
 
 //! mvGraphicsInterface is a pure virtual interface class for mvGraphics
 
@@ -54,9 +64,6 @@ public:
 
 virtual void DoWireSphere() = 0;
 
-   virtual void RenderHeightMap(  unsigned char *g_HeightMap, int iMapSize ) = 0;
-   virtual void RenderTerrain(  unsigned char *g_HeightMap, int iMapSize ) = 0;
-
    virtual void DrawSquareXYPlane() = 0;
    virtual void DrawParallelSquares( int iNumSlices ) = 0;
 	virtual void Translatef( float x, float y, float z ) = 0;
@@ -67,6 +74,13 @@ virtual void DoWireSphere() = 0;
 	virtual void PushMatrix() = 0;
     virtual void SetMaterialColor(float *mcolor) = 0;
     virtual void RasterPos3f(float x, float y, float z ) = 0;
+
+   virtual void GetViewFrustum( VIEWFRUSTUM &Frustum ) = 0;
+   virtual void GetEyePosition( Vector3 &EyePos ) = 0;
+   virtual void DrawIndexedTriangles( const BATCHVERTEX *pVertices, const unsigned short *pIndices, int iNumIndices ) = 0;
+   virtual int CreateStaticBatch( const BATCHVERTEX *pVertices, int iNumVertices ) = 0;
+   virtual void DrawStaticBatch( int iBatchHandle, int iTextureID ) = 0;
+   virtual void DeleteStaticBatch( int iBatchHandle ) = 0;
 };
 
 #endif // _MVGRAPHICSINTERFACE_H
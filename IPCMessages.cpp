@@ -0,0 +1,808 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Pull parser and message schema for the XML IPC lines passed between the OSMP processes
+//!
+//! The OSMP processes talk to each other in XML, one message per line, eg:
+//!
+//! <objectmove ireference="123"><geometry><pos x="1" y="2" z="3"/></geometry><dynamics><duration milliseconds="200"/></dynamics></objectmove>
+//!
+//! Building a TiXmlDocument for each of these means allocating a node for every element and
+//! attribute, only to read a handful of numbers back out and throw the tree away.  For the
+//! messages that come in often, this module reads the line in place instead:
+//!
+//! - GetIPCMessageType reads just the root element name, so the mainloops can switch on an
+//!   IPCMessageType, rather than strcmp'ing their way down a list of names
+//! - IPCPullParser walks the tags of a message one at a time, with the attributes read straight
+//!   out of the line buffer
+//! - ParseObjectMove, ParseObjectTrack, ParseLogin and ParseLoginResult fill typed structs from their messages
+//!
+//! Messages whose handlers work on whole object descriptions (objectcreate, objectupdate and so on)
+//! still go through TinyXML; the parser isnt meant to replace it there.
+//!
+//! The list of message types is shared by all the processes; add new messages to both IPCMessageType
+//! and IPCMessageNames, keeping IPCMessageNames sorted.
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "IPCMessages.h"
+#include "XmlHelper.h"
+
+//! One entry of the message name table
+struct IPCMessageNameInfo
+{
+    const char *sName;
+    IPCMessageType MessageType;
+};
+
+//! Message name table, sorted by name so it can be binary searched
+static const IPCMessageNameInfo IPCMessageNames[] =
+{
+    { "capture", IPC_CAPTURE },
+    { "collisionend", IPC_COLLISIONEND },
+    { "collisionstart", IPC_COLLISIONSTART },
+    { "comm", IPC_COMM },
+    { "event", IPC_EVENT },
+    { "filemanifest", IPC_FILEMANIFEST },
+    { "hyperlinkagent", IPC_HYPERLINKAGENT },
+    { "inforesponse", IPC_INFORESPONSE },
+    { "keydown", IPC_KEYDOWN },
+    { "keyup", IPC_KEYUP },
+    { "login", IPC_LOGIN },
+    { "loginaccept", IPC_LOGINACCEPT },
+    { "loginreject", IPC_LOGINREJECT },
+    { "meshfile", IPC_MESHFILE },
+    { "multicastrpc", IPC_MULTICASTRPC },
+    { "newfileupload", IPC_NEWFILEUPLOAD },
+    { "objectcreate", IPC_OBJECTCREATE },
+    { "objectdelete", IPC_OBJECTDELETE },
+    { "objectimport", IPC_OBJECTIMPORT },
+    { "objectmove", IPC_OBJECTMOVE },
+    { "objectrefreshdata", IPC_OBJECTREFRESHDATA },
+    { "objecttrack", IPC_OBJECTTRACK },
+    { "objectupdate", IPC_OBJECTUPDATE },
+    { "registerfile", IPC_REGISTERFILE },
+    { "registerscriptingengine", IPC_REGISTERSCRIPTINGENGINE },
+    { "requestinfo", IPC_REQUESTINFO },
+    { "requestworldstate", IPC_REQUESTWORLDSTATE },
+    { "script", IPC_SCRIPT },
+    { "scriptingengines", IPC_SCRIPTINGENGINES },
+    { "scriptshardassign", IPC_SCRIPTSHARDASSIGN },
+    { "scriptshardrelease", IPC_SCRIPTSHARDRELEASE },
+    { "scriptshardstate", IPC_SCRIPTSHARDSTATE },
+    { "setinfo", IPC_SETINFO },
+    { "setinfobatch", IPC_SETINFOBATCH },
+    { "skyboxupdate", IPC_SKYBOXUPDATE },
+    { "terrain", IPC_TERRAIN },
+    { "texture", IPC_TEXTURE },
+    { "userdatachanged", IPC_USERDATACHANGED },
+    { "worldversion", IPC_WORLDVERSION }
+};
+
+static const int iNumIPCMessageNames = sizeof( IPCMessageNames ) / sizeof( IPCMessageNames[0] );
+
+//! compares the iLength characters at pName with the null-terminated sName, like strcmp
+static int CompareName( const char *pName, int iLength, const char *sName )
+{
+    int iCompare = strncmp( pName, sName, iLength );
+    if( iCompare != 0 )
+    {
+        return iCompare;
+    }
+    return sName[ iLength ] == '\0' ? 0 : -1;
+}
+
+IPCMessageType GetIPCMessageType( const char *sMessage )
+{
+    IPCPullParser Parser( sMessage );
+    if( !Parser.Next() || !Parser.IsStartTag() )
+    {
+        return IPC_UNKNOWN;
+    }
+
+    int iNameLength;
+    const char *pName = Parser.GetName( iNameLength );
+
+    int iLow = 0;
+    int iHigh = iNumIPCMessageNames - 1;
+    while( iLow <= iHigh )
+    {
+        int iMid = ( iLow + iHigh ) / 2;
+        int iCompare = CompareName( pName, iNameLength, IPCMessageNames[ iMid ].sName );
+        if( iCompare == 0 )
+        {
+            return IPCMessageNames[ iMid ].MessageType;
+        }
+        else if( iCompare < 0 )
+        {
+            iHigh = iMid - 1;
+        }
+        else
+        {
+            iLow = iMid + 1;
+        }
+    }
+    return IPC_UNKNOWN;
+}
+
+const char *GetIPCMessageName( IPCMessageType MessageType )
+{
+    for( int i = 0; i < iNumIPCMessageNames; i++ )
+    {
+        if( IPCMessageNames[ i ].MessageType == MessageType )
+        {
+            return IPCMessageNames[ i ].sName;
+        }
+    }
+    return "";
+}
+
+IPCPullParser::IPCPullParser( const char *sMessage )
+{
+    pNext = sMessage;
+    pName = NULL;
+    iNameLength = 0;
+    pAttributes = NULL;
+    pTagEnd = NULL;
+    bStartTag = false;
+    bEndTag = false;
+    iDepth = 0;
+}
+
+// Input: none
+// Returns: true if there was another tag; false at the end of the message, or if the rest of it is malformed
+// Description: Skips to the next tag, passing over any text, <?...?> declarations and <!-- --> comments.
+// Finds the closing > of the tag, skipping over > inside quoted attribute values.  Once it has
+// returned false, it keeps returning false.
+bool IPCPullParser::Next()
+{
+    if( bEndTag )
+    {
+        iDepth--;
+    }
+    bStartTag = false;
+    bEndTag = false;
+    if( pNext == NULL )
+    {
+        return false;
+    }
+
+    const char *p = strchr( pNext, '<' );
+    while( p != NULL && ( p[1] == '?' || strncmp( p, "<!--", 4 ) == 0 ) )
+    {
+        const char *pSkipTo = p[1] == '?' ? strstr( p, "?>" ) : strstr( p, "-->" );
+        p = pSkipTo == NULL ? NULL : strchr( pSkipTo, '<' );
+    }
+    if( p == NULL )
+    {
+        pNext = NULL;
+        return false;
+    }
+
+    p++;
+    bool bClosingTag = ( *p == '/' );
+    if( bClosingTag )
+    {
+        p++;
+    }
+    pName = p;
+    while( *p != '\0' && *p != '>' && *p != '/' && !isspace( (unsigned char)*p ) )
+    {
+        p++;
+    }
+    iNameLength = (int)( p - pName );
+    pAttributes = p;
+
+    char cQuote = 0;
+    while( *p != '\0' && ( cQuote != 0 || *p != '>' ) )
+    {
+        if( cQuote != 0 )
+        {
+            if( *p == cQuote )
+            {
+                cQuote = 0;
+            }
+        }
+        else if( *p == '"' || *p == '\'' )
+        {
+            cQuote = *p;
+        }
+        p++;
+    }
+    if( *p != '>' || iNameLength == 0 )
+    {
+        pNext = NULL;
+        return false;
+    }
+    pTagEnd = p;
+    pNext = p + 1;
+
+    if( bClosingTag )
+    {
+        bEndTag = true;
+    }
+    else
+    {
+        bStartTag = true;
+        iDepth++;
+        bEndTag = ( p[-1] == '/' );
+    }
+    return true;
+}
+
+bool IPCPullParser::IsStartTag() const
+{
+    return bStartTag;
+}
+
+bool IPCPullParser::IsEndTag() const
+{
+    return bEndTag;
+}
+
+int IPCPullParser::GetDepth() const
+{
+    return iDepth;
+}
+
+bool IPCPullParser::NameIs( const char *sName ) const
+{
+    return ( bStartTag || bEndTag ) && CompareName( pName, iNameLength, sName ) == 0;
+}
+
+const char *IPCPullParser::GetName( int &iLength ) const
+{
+    iLength = iNameLength;
+    return pName;
+}
+
+// Input: sName is the attribute name to look for
+// Returns: true if the current tag has attribute sName; sValue and iValueLength then give its value, inside the message buffer
+// Description: Scans the current tag's attributes.  Values are returned as they are in the message,
+// without unescaping entities; use CopyAttribute for strings that might contain them.
+bool IPCPullParser::GetAttribute( const char *sName, const char *&sValue, int &iValueLength ) const
+{
+    if( !bStartTag )
+    {
+        return false;
+    }
+
+    const char *p = pAttributes;
+    while( p < pTagEnd )
+    {
+        while( p < pTagEnd && ( isspace( (unsigned char)*p ) || *p == '/' ) )
+        {
+            p++;
+        }
+        const char *pAttributeName = p;
+        while( p < pTagEnd && *p != '=' && *p != '/' && !isspace( (unsigned char)*p ) )
+        {
+            p++;
+        }
+        int iAttributeNameLength = (int)( p - pAttributeName );
+        while( p < pTagEnd && isspace( (unsigned char)*p ) )
+        {
+            p++;
+        }
+        if( p >= pTagEnd || *p != '=' )
+        {
+            return false;
+        }
+        p++;
+        while( p < pTagEnd && isspace( (unsigned char)*p ) )
+        {
+            p++;
+        }
+        if( p >= pTagEnd || ( *p != '"' && *p != '\'' ) )
+        {
+            return false;
+        }
+        const char *pValue = p + 1;
+        const char *pValueEnd = (const char *)memchr( pValue, *p, pTagEnd - pValue );
+        if( pValueEnd == NULL )
+        {
+            return false;
+        }
+        if( iAttributeNameLength > 0 && CompareName( pAttributeName, iAttributeNameLength, sName ) == 0 )
+        {
+            sValue = pValue;
+            iValueLength = (int)( pValueEnd - pValue );
+            return true;
+        }
+        p = pValueEnd + 1;
+    }
+    return false;
+}
+
+bool IPCPullParser::HasAttribute( const char *sName ) const
+{
+    const char *sValue;
+    int iValueLength;
+    return GetAttribute( sName, sValue, iValueLength );
+}
+
+int IPCPullParser::GetIntAttribute( const char *sName, int iDefault ) const
+{
+    const char *sValue;
+    int iValueLength;
+    if( !GetAttribute( sName, sValue, iValueLength ) )
+    {
+        return iDefault;
+    }
+    return atoi( sValue );   // stops at the closing quote
+}
+
+float IPCPullParser::GetFloatAttribute( const char *sName, float fDefault ) const
+{
+    const char *sValue;
+    int iValueLength;
+    if( !GetAttribute( sName, sValue, iValueLength ) )
+    {
+        return fDefault;
+    }
+    return (float)atof( sValue );   // stops at the closing quote
+}
+
+//! entities we unescape in CopyAttribute; these are the ones TinyXML writes
+struct IPCEntityInfo
+{
+    const char *sEntity;
+    int iLength;
+    char cValue;
+};
+
+static const IPCEntityInfo IPCEntities[] =
+{
+    { "&amp;", 5, '&' },
+    { "&lt;", 4, '<' },
+    { "&gt;", 4, '>' },
+    { "&quot;", 6, '"' },
+    { "&apos;", 6, '\'' }
+};
+
+static const int iNumIPCEntities = sizeof( IPCEntities ) / sizeof( IPCEntities[0] );
+
+bool IPCPullParser::CopyAttribute( const char *sName, char *sBuffer, int iBufferSize ) const
+{
+    sBuffer[0] = '\0';
+    const char *sValue;
+    int iValueLength;
+    if( !GetAttribute( sName, sValue, iValueLength ) )
+    {
+        return false;
+    }
+
+    const char *pValueEnd = sValue + iValueLength;
+    int iCopied = 0;
+    const char *p = sValue;
+    while( p < pValueEnd && iCopied < iBufferSize - 1 )
+    {
+        char c = *p;
+        int iSkip = 1;
+        if( c == '&' )
+        {
+            for( int i = 0; i < iNumIPCEntities; i++ )
+            {
+                if( pValueEnd - p >= IPCEntities[ i ].iLength && strncmp( p, IPCEntities[ i ].sEntity, IPCEntities[ i ].iLength ) == 0 )
+                {
+                    c = IPCEntities[ i ].cValue;
+                    iSkip = IPCEntities[ i ].iLength;
+                    break;
+                }
+            }
+        }
+        sBuffer[ iCopied++ ] = c;
+        p += iSkip;
+    }
+    sBuffer[ iCopied ] = '\0';
+    return true;
+}
+
+//! reads a Vector3 from the x, y and z attributes of Parser's current tag
+static Vector3 Vector3FromTag( const IPCPullParser &Parser )
+{
+    return Vector3( Parser.GetFloatAttribute( "x", 0 ), Parser.GetFloatAttribute( "y", 0 ), Parser.GetFloatAttribute( "z", 0 ) );
+}
+
+// Input: sMessage is one XML IPC line
+// Returns: true if sMessage was an <objectmove> with an ireference
+// Description: Reads the geometry, first face color and its face number, duration, timestamp and velocity out of an objectmove; anything else in it is ignored.
+bool ParseObjectMove( const char *sMessage, OBJECTMOVEMESSAGE &Move )
+{
+    IPCPullParser Parser( sMessage );
+    if( !Parser.Next() || !Parser.NameIs( "objectmove" ) || !Parser.HasAttribute( "ireference" ) )
+    {
+        return false;
+    }
+
+    Move.iReference = Parser.GetIntAttribute( "ireference", 0 );
+    Move.bPos = false;
+    Move.bRot = false;
+    Move.bScale = false;
+    Move.bColor = false;
+    Move.iFaceNumber = 0;
+    Move.iDurationMilliseconds = -1;
+    Move.iTimestampMilliseconds = -1;
+    Move.bVelocity = false;
+
+    if( Parser.IsEndTag() )
+    {
+        return true;   // <objectmove .../>, nothing to move
+    }
+
+    bool bInGeometry = false;
+    bool bInFaces = false;
+    bool bInDynamics = false;
+    int iFaceNumber = 0;
+    while( Parser.Next() && Parser.GetDepth() > 1 )
+    {
+        if( !Parser.IsStartTag() )
+        {
+            continue;
+        }
+        if( Parser.GetDepth() == 2 )
+        {
+            bInGeometry = Parser.NameIs( "geometry" );
+            bInFaces = Parser.NameIs( "faces" );
+            bInDynamics = Parser.NameIs( "dynamics" );
+        }
+        else if( Parser.GetDepth() == 3 && bInGeometry )
+        {
+            if( Parser.NameIs( "pos" ) )
+            {
+                Move.bPos = true;
+                Move.Pos = Vector3FromTag( Parser );
+            }
+            else if( Parser.NameIs( "rot" ) )
+            {
+                Move.bRot = true;
+                Move.Rotation = Rot( Parser.GetFloatAttribute( "x", 0 ), Parser.GetFloatAttribute( "y", 0 ),
+                                     Parser.GetFloatAttribute( "z", 0 ), Parser.GetFloatAttribute( "s", 1 ) );
+            }
+            else if( Parser.NameIs( "scale" ) )
+            {
+                Move.bScale = true;
+                Move.Scale = Vector3FromTag( Parser );
+            }
+        }
+        else if( Parser.GetDepth() == 3 && bInDynamics )
+        {
+            if( Parser.NameIs( "duration" ) )
+            {
+                Move.iDurationMilliseconds = Parser.GetIntAttribute( "milliseconds", -1 );
+            }
+            else if( Parser.NameIs( "timestamp" ) )
+            {
+                Move.iTimestampMilliseconds = Parser.GetIntAttribute( "milliseconds", -1 );
+            }
+            else if( Parser.NameIs( "velocity" ) )
+            {
+                Move.bVelocity = true;
+                Move.Velocity = Vector3FromTag( Parser );
+            }
+        }
+        else if( Parser.GetDepth() == 3 && bInFaces && Parser.NameIs( "face" ) )
+        {
+            iFaceNumber = Parser.GetIntAttribute( "num", 0 );
+        }
+        else if( Parser.GetDepth() == 4 && bInFaces && !Move.bColor )
+        {
+            if( Parser.NameIs( "color" ) )
+            {
+                Move.bColor = true;
+                Move.iFaceNumber = iFaceNumber;
+                Move.FaceColor = Color( Parser.GetFloatAttribute( "r", 0 ), Parser.GetFloatAttribute( "g", 0 ), Parser.GetFloatAttribute( "b", 0 ) );
+            }
+        }
+    }
+    return true;
+}
+
+void WriteObjectMove( const OBJECTMOVEMESSAGE &Move, XmlWriter &Writer )
+{
+    Writer.StartElement( "objectmove" );
+    Writer.Attribute( "ireference", Move.iReference );
+    if( Move.bPos || Move.bRot || Move.bScale )
+    {
+        Writer.StartElement( "geometry" );
+        if( Move.bPos )
+        {
+            Writer.StartElement( "pos" );
+            Move.Pos.WriteToXMLWriter( Writer );
+            Writer.EndElement();
+        }
+        if( Move.bRot )
+        {
+            Writer.StartElement( "rot" );
+            Move.Rotation.WriteToXMLWriter( Writer );
+            Writer.EndElement();
+        }
+        if( Move.bScale )
+        {
+            Writer.StartElement( "scale" );
+            Move.Scale.WriteToXMLWriter( Writer );
+            Writer.EndElement();
+        }
+        Writer.EndElement();
+    }
+    if( Move.bColor )
+    {
+        Writer.StartElement( "faces" );
+        Writer.StartElement( "face" );
+        Writer.Attribute( "num", Move.iFaceNumber );
+        Writer.StartElement( "color" );
+        Move.FaceColor.WriteToXMLWriter( Writer );
+        Writer.EndElement();
+        Writer.EndElement();
+        Writer.EndElement();
+    }
+    if( Move.iDurationMilliseconds >= 0 || Move.iTimestampMilliseconds >= 0 || Move.bVelocity )
+    {
+        Writer.StartElement( "dynamics" );
+        if( Move.iDurationMilliseconds >= 0 )
+        {
+            Writer.StartElement( "duration" );
+            Writer.Attribute( "milliseconds", Move.iDurationMilliseconds );
+            Writer.EndElement();
+        }
+        if( Move.iTimestampMilliseconds >= 0 )
+        {
+            Writer.StartElement( "timestamp" );
+            Writer.Attribute( "milliseconds", Move.iTimestampMilliseconds );
+            Writer.EndElement();
+        }
+        if( Move.bVelocity )
+        {
+            Writer.StartElement( "velocity" );
+            Move.Velocity.WriteToXMLWriter( Writer );
+            Writer.EndElement();
+        }
+        Writer.EndElement();
+    }
+    Writer.EndElement();
+}
+
+//! names of the TrackEasing values, as used in the ease attribute of <key>
+static const char *TrackEasingNames[] = { "linear", "easein", "easeout", "easeinout" };
+
+static const int iNumTrackEasings = sizeof( TrackEasingNames ) / sizeof( TrackEasingNames[0] );
+
+TrackEasing GetTrackEasing( const char *sName )
+{
+    for( int i = 0; i < iNumTrackEasings; i++ )
+    {
+        if( strcmp( sName, TrackEasingNames[ i ] ) == 0 )
+        {
+            return (TrackEasing)i;
+        }
+    }
+    return EASE_LINEAR;
+}
+
+// Input: sMessage is one XML IPC line
+// Returns: true if sMessage was an <objecttrack> with an ireference
+// Description: Reads the keys of an objecttrack.  Keys come in time order; a key that goes back in time is
+//              moved up to the one before it.  Properties the first key doesnt have are ignored on later keys,
+//              and later keys missing a property repeat the value of the key before.
+bool ParseObjectTrack( const char *sMessage, OBJECTTRACKMESSAGE &Track )
+{
+    IPCPullParser Parser( sMessage );
+    if( !Parser.Next() || !Parser.NameIs( "objecttrack" ) || !Parser.HasAttribute( "ireference" ) )
+    {
+        return false;
+    }
+
+    Track.iReference = Parser.GetIntAttribute( "ireference", 0 );
+    char sLoop[8];
+    Parser.CopyAttribute( "loop", sLoop, sizeof( sLoop ) );
+    Track.bLoop = ( strcmp( sLoop, "true" ) == 0 );
+    Track.iPeriodMilliseconds = Parser.GetIntAttribute( "period", 0 );
+    Track.iElapsedMilliseconds = Parser.GetIntAttribute( "elapsed", 0 );
+    Track.bPos = false;
+    Track.bRot = false;
+    Track.bScale = false;
+    Track.bColor = false;
+    Track.iNumKeys = 0;
+
+    if( Parser.IsEndTag() )
+    {
+        return true;   // <objecttrack .../>, stops the track
+    }
+
+    OBJECTTRACKKEY *pKey = NULL;
+    while( Parser.Next() && Parser.GetDepth() > 1 )
+    {
+        if( !Parser.IsStartTag() )
+        {
+            continue;
+        }
+        if( Parser.GetDepth() == 2 )
+        {
+            pKey = NULL;
+            if( !Parser.NameIs( "key" ) || Track.iNumKeys == OBJECTTRACKMESSAGE::MAX_KEYS )
+            {
+                continue;
+            }
+            pKey = &Track.Keys[ Track.iNumKeys ];
+            if( Track.iNumKeys > 0 )
+            {
+                *pKey = Track.Keys[ Track.iNumKeys - 1 ];
+            }
+            else
+            {
+                pKey->iTimeMilliseconds = 0;
+            }
+            int iTime = Parser.GetIntAttribute( "t", 0 );
+            if( iTime > pKey->iTimeMilliseconds )
+            {
+                pKey->iTimeMilliseconds = iTime;
+            }
+
+            char sEase[16];
+            Parser.CopyAttribute( "ease", sEase, sizeof( sEase ) );
+            pKey->Easing = GetTrackEasing( sEase );
+            Track.iNumKeys++;
+        }
+        else if( Parser.GetDepth() == 3 && pKey != NULL )
+        {
+            bool bFirstKey = ( pKey == &Track.Keys[0] );
+            if( Parser.NameIs( "pos" ) && ( bFirstKey || Track.bPos ) )
+            {
+                Track.bPos = true;
+                pKey->Pos = Vector3FromTag( Parser );
+            }
+            else if( Parser.NameIs( "rot" ) && ( bFirstKey || Track.bRot ) )
+            {
+                Track.bRot = true;
+                pKey->Rotation = Rot( Parser.GetFloatAttribute( "x", 0 ), Parser.GetFloatAttribute( "y", 0 ),
+                                      Parser.GetFloatAttribute( "z", 0 ), Parser.GetFloatAttribute( "s", 1 ) );
+            }
+            else if( Parser.NameIs( "scale" ) && ( bFirstKey || Track.bScale ) )
+            {
+                Track.bScale = true;
+                pKey->Scale = Vector3FromTag( Parser );
+            }
+            else if( Parser.NameIs( "color" ) && ( bFirstKey || Track.bColor ) )
+            {
+                Track.bColor = true;
+                pKey->FaceColor = Color( Parser.GetFloatAttribute( "r", 0 ), Parser.GetFloatAttribute( "g", 0 ), Parser.GetFloatAttribute( "b", 0 ) );
+            }
+        }
+    }
+    return true;
+}
+
+// Input: Track: track about to be sent
+//        iMaxLineLength: size of the buffer the receiver reads a line into
+//
+// Returns: true if Track fitted as it was, false if keys were dropped
+//
+// Description: An objecttrack goes over the sockets as one line, and each process reads a line into a
+//  fixed buffer, so a track with many keys, or long numbers, could be cut off.  This drops keys off the
+//  end until Track, written with WriteObjectTrack plus a newline, is shorter than iMaxLineLength.  The
+//  server adds elapsed="..." when it passes a track on to clients that connect later, so the length is
+//  measured with the longest elapsed there could be.
+bool FitObjectTrack( OBJECTTRACKMESSAGE &Track, const int iMaxLineLength )
+{
+    OBJECTTRACKMESSAGE LongestTrack = Track;
+    LongestTrack.iElapsedMilliseconds = INT_MAX;
+    string Line;
+    for( ;; )
+    {
+        Line.clear();
+        XmlWriter Writer( Line );
+        WriteObjectTrack( LongestTrack, Writer );
+        if( (int)Line.size() + 1 < iMaxLineLength || LongestTrack.iNumKeys == 0 )
+        {
+            break;
+        }
+        LongestTrack.iNumKeys--;
+    }
+
+    if( LongestTrack.iNumKeys == Track.iNumKeys )
+    {
+        return true;
+    }
+    Track.iNumKeys = LongestTrack.iNumKeys;
+    return false;
+}
+
+void WriteObjectTrack( const OBJECTTRACKMESSAGE &Track, XmlWriter &Writer )
+{
+    Writer.StartElement( "objecttrack" );
+    Writer.Attribute( "ireference", Track.iReference );
+    if( Track.bLoop )
+    {
+        Writer.Attribute( "loop", "true" );
+        if( Track.iPeriodMilliseconds > 0 )
+        {
+            Writer.Attribute( "period", Track.iPeriodMilliseconds );
+        }
+    }
+    if( Track.iElapsedMilliseconds > 0 )
+    {
+        Writer.Attribute( "elapsed", Track.iElapsedMilliseconds );
+    }
+    for( int i = 0; i < Track.iNumKeys; i++ )
+    {
+        const OBJECTTRACKKEY &Key = Track.Keys[ i ];
+        Writer.StartElement( "key" );
+        Writer.Attribute( "t", Key.iTimeMilliseconds );
+        if( Key.Easing != EASE_LINEAR )
+        {
+            Writer.Attribute( "ease", TrackEasingNames[ Key.Easing ] );
+        }
+        if( Track.bPos )
+        {
+            Writer.StartElement( "pos" );
+            Key.Pos.WriteToXMLWriter( Writer );
+            Writer.EndElement();
+        }
+        if( Track.bRot )
+        {
+            Writer.StartElement( "rot" );
+            Key.Rotation.WriteToXMLWriter( Writer );
+            Writer.EndElement();
+        }
+        if( Track.bScale )
+        {
+            Writer.StartElement( "scale" );
+            Key.Scale.WriteToXMLWriter( Writer );
+            Writer.EndElement();
+        }
+        if( Track.bColor )
+        {
+            Writer.StartElement( "color" );
+            Key.FaceColor.WriteToXMLWriter( Writer );
+            Writer.EndElement();
+        }
+        Writer.EndElement();
+    }
+    Writer.EndElement();
+}
+
+bool ParseLogin( const char *sMessage, LOGINMESSAGE &Login )
+{
+    IPCPullParser Parser( sMessage );
+    if( !Parser.Next() || !Parser.NameIs( "login" ) )
+    {
+        return false;
+    }
+    Login.iConnectionRef = Parser.GetIntAttribute( "iconnectionref", 0 );
+    Parser.CopyAttribute( "name", Login.sName, sizeof( Login.sName ) );
+    Parser.CopyAttribute( "password", Login.sPassword, sizeof( Login.sPassword ) );
+    return true;
+}
+
+bool ParseLoginResult( const char *sMessage, LOGINRESULTMESSAGE &LoginResult )
+{
+    IPCPullParser Parser( sMessage );
+    if( !Parser.Next() || !( Parser.NameIs( "loginaccept" ) || Parser.NameIs( "loginreject" ) ) )
+    {
+        return false;
+    }
+    LoginResult.iConnectionRef = Parser.GetIntAttribute( "iconnectionref", 0 );
+    LoginResult.iReference = Parser.GetIntAttribute( "ireference", 0 );
+    Parser.CopyAttribute( "name", LoginResult.sName, sizeof( LoginResult.sName ) );
+    return true;
+}
@@ -0,0 +1,201 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Pull parser and message schema for the XML IPC lines passed between the OSMP processes
+
+// see IPCMessages.cpp for documentation
+
+#ifndef _IPCMESSAGES_H
+#define _IPCMESSAGES_H
+
+#include "BasicTypes.h"
+#include "Math.h"
+
+class XmlWriter;
+
+//! The XML IPC messages passed between the OSMP processes, by root element name
+enum IPCMessageType
+{
+   IPC_UNKNOWN = 0,
+   IPC_CAPTURE,
+   IPC_COLLISIONEND,
+   IPC_COLLISIONSTART,
+   IPC_COMM,
+   IPC_EVENT,
+   IPC_FILEMANIFEST,
+   IPC_HYPERLINKAGENT,
+   IPC_INFORESPONSE,
+   IPC_KEYDOWN,
+   IPC_KEYUP,
+   IPC_LOGIN,
+   IPC_LOGINACCEPT,
+   IPC_LOGINREJECT,
+   IPC_MESHFILE,
+   IPC_MULTICASTRPC,
+   IPC_NEWFILEUPLOAD,
+   IPC_OBJECTCREATE,
+   IPC_OBJECTDELETE,
+   IPC_OBJECTIMPORT,
+   IPC_OBJECTMOVE,
+   IPC_OBJECTREFRESHDATA,
+   IPC_OBJECTTRACK,
+   IPC_OBJECTUPDATE,
+   IPC_REGISTERFILE,
+   IPC_REGISTERSCRIPTINGENGINE,
+   IPC_REQUESTINFO,
+   IPC_REQUESTWORLDSTATE,
+   IPC_SCRIPT,
+   IPC_SCRIPTINGENGINES,
+   IPC_SCRIPTSHARDASSIGN,
+   IPC_SCRIPTSHARDRELEASE,
+   IPC_SCRIPTSHARDSTATE,
+   IPC_SETINFO,
+   IPC_SETINFOBATCH,
+   IPC_SKYBOXUPDATE,
+   IPC_TERRAIN,
+   IPC_TEXTURE,
+   IPC_USERDATACHANGED,
+   IPC_WORLDVERSION
+};
+
+IPCMessageType GetIPCMessageType( const char *sMessage );   //!< returns the type of the XML IPC message in sMessage, from its root element name
+const char *GetIPCMessageName( IPCMessageType MessageType );   //!< returns the root element name for MessageType, or "" for IPC_UNKNOWN
+
+//! IPCPullParser walks the tags of one XML IPC message in place
+
+//! IPCPullParser walks the tags of one XML IPC message in place
+//! It doesnt copy or allocate anything: names and attribute values are read straight out of the message
+//! buffer, which must stay valid, and unchanged, while the parser is used.
+//! Text between tags is skipped; OSMP IPC doesnt use it.
+class IPCPullParser
+{
+public:
+   IPCPullParser( const char *sMessage );
+
+   bool Next();   //!< moves to the next tag; returns false at the end of the message, or if the message is malformed
+   bool IsStartTag() const;   //!< true for <name ...> and <name .../>
+   bool IsEndTag() const;   //!< true for </name>, and also for <name .../>, which both opens and closes its element
+   int GetDepth() const;   //!< depth of the current element; the root element is at depth 1
+   bool NameIs( const char *sName ) const;   //!< true if the current tag has name sName
+   const char *GetName( int &iLength ) const;   //!< name of the current tag; points into the message, and is iLength long
+
+   bool GetAttribute( const char *sName, const char *&sValue, int &iValueLength ) const;   //!< finds attribute sName on the current tag; sValue points into the message, and is not unescaped
+   bool HasAttribute( const char *sName ) const;
+   int GetIntAttribute( const char *sName, int iDefault ) const;   //!< returns attribute sName as an int, or iDefault if it's missing
+   float GetFloatAttribute( const char *sName, float fDefault ) const;   //!< returns attribute sName as a float, or fDefault if it's missing
+   bool CopyAttribute( const char *sName, char *sBuffer, int iBufferSize ) const;   //!< copies attribute sName into sBuffer, unescaping entities and truncating to fit; "" and false if it's missing
+
+protected:
+   const char *pNext;   //!< where to look for the next tag
+   const char *pName;   //!< name of the current tag
+   int iNameLength;
+   const char *pAttributes;   //!< start of the current tag's attributes
+   const char *pTagEnd;   //!< the closing > of the current tag
+   bool bStartTag;
+   bool bEndTag;
+   int iDepth;
+};
+
+//! <objectmove>: moves, rotates, scales and/or recolors an object smoothly over iDurationMilliseconds
+struct OBJECTMOVEMESSAGE
+{
+   int iReference;   //!< object being moved
+   bool bPos;   //!< true if Pos is set
+   Vector3 Pos;   //!< <geometry><pos .../>
+   bool bRot;   //!< true if Rotation is set
+   Rot Rotation;   //!< <geometry><rot .../>
+   bool bScale;   //!< true if Scale is set
+   Vector3 Scale;   //!< <geometry><scale .../>
+   bool bColor;   //!< true if FaceColor is set
+   int iFaceNumber;   //!< <faces><face num="...">: face FaceColor is for; moves only animate one face, the first listed
+   Color FaceColor;   //!< <faces><face><color .../>
+   int iDurationMilliseconds;   //!< <dynamics><duration milliseconds="..."/>, or -1 if missing
+   int iTimestampMilliseconds;   //!< <dynamics><timestamp milliseconds="..."/>: sender's tick count when it sent the move, or -1 if missing
+   bool bVelocity;   //!< true if Velocity is set
+   Vector3 Velocity;   //!< <dynamics><velocity .../>: object's velocity when the move was sent, per second
+};
+
+//! Easing curve from one key of an <objecttrack> to the next
+enum TrackEasing
+{
+   EASE_LINEAR = 0,
+   EASE_IN,   //!< starts slow
+   EASE_OUT,   //!< ends slow
+   EASE_INOUT   //!< starts and ends slow
+};
+
+//! One key of an <objecttrack>: <key t="..." ease="..."><pos .../><rot .../><scale .../><color .../></key>
+struct OBJECTTRACKKEY
+{
+   int iTimeMilliseconds;   //!< time of the key from the start of the track
+   TrackEasing Easing;   //!< curve from this key to the next
+   Vector3 Pos;
+   Rot Rotation;
+   Vector3 Scale;
+   Color FaceColor;   //!< tracks only animate face 0, like moves
+};
+
+//! <objecttrack>: plays a list of keys on an object, once or looping, until the next objecttrack or objectmove for it
+
+//! <objecttrack>: plays a list of keys on an object, once or looping, until the next objecttrack or objectmove for it
+//! A property is animated if the first key has it; later keys that leave it out keep the value of the key before.
+//! An objecttrack with no keys stops the object's track.
+struct OBJECTTRACKMESSAGE
+{
+   enum { MAX_KEYS = 12 };   //!< keys after this are ignored; FitObjectTrack keeps a track within one IPC line
+
+   int iReference;   //!< object being animated
+   bool bLoop;   //!< loop="true"
+   int iPeriodMilliseconds;   //!< period="...": length of one loop; if it's after the last key, the track goes back to the first key in between. Defaults to the time of the last key
+   int iElapsedMilliseconds;   //!< elapsed="...": how far into the track it was when the message was sent; 0 if missing
+   bool bPos;   //!< true if the keys have positions
+   bool bRot;
+   bool bScale;
+   bool bColor;
+   int iNumKeys;
+   OBJECTTRACKKEY Keys[ MAX_KEYS ];   //!< in time order
+};
+
+//! <login> from a client, and as passed on to the dbinterface
+struct LOGINMESSAGE
+{
+   int iConnectionRef;   //!< server's connection reference; 0 coming from the client
+   char sName[65];
+   char sPassword[129];
+};
+
+//! <loginaccept> and <loginreject>, from the dbinterface, and from the server to the client
+struct LOGINRESULTMESSAGE
+{
+   int iConnectionRef;   //!< server's connection reference; 0 coming from the server
+   int iReference;   //!< avatar's object reference; 0 for loginreject
+   char sName[65];
+};
+
+bool ParseObjectMove( const char *sMessage, OBJECTMOVEMESSAGE &Move );   //!< fills Move from an <objectmove> message; returns false if it isnt one, or has no ireference
+void WriteObjectMove( const OBJECTMOVEMESSAGE &Move, XmlWriter &Writer );   //!< writes Move as an <objectmove> element
+TrackEasing GetTrackEasing( const char *sName );   //!< returns the easing named sName, as in the ease attribute of <key>; EASE_LINEAR if it's not one
+bool ParseObjectTrack( const char *sMessage, OBJECTTRACKMESSAGE &Track );   //!< fills Track from an <objecttrack> message; returns false if it isnt one, or has no ireference
+void WriteObjectTrack( const OBJECTTRACKMESSAGE &Track, XmlWriter &Writer );   //!< writes Track as an <objecttrack> element
+bool FitObjectTrack( OBJECTTRACKMESSAGE &Track, const int iMaxLineLength );   //!< drops keys off the end of Track until it fits in a line shorter than iMaxLineLength; returns false if it had to
+bool ParseLogin( const char *sMessage, LOGINMESSAGE &Login );   //!< fills Login from a <login> message; returns false if it isnt one
+bool ParseLoginResult( const char *sMessage, LOGINRESULTMESSAGE &LoginResult );   //!< fills LoginResult from a <loginaccept> or <loginreject> message; returns false if it's neither
+
+#endif // _IPCMESSAGES_H
@@ -0,0 +1,176 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief ipcmessagestest: headless tests of the objecttrack messages IPCMessages writes and parses
+//!
+//! Builds a track with every key and every property, with long numbers, and checks it's too long
+//! for one socket line as it is; that FitObjectTrack cuts it to the most keys that fit, with room for
+//! the elapsed="..." the server adds; that the cut track parses back the same; and that it gets across
+//! a loopback socket, sent as a blob and read as a line, whole.  Also checks a short track is left alone.
+//! Prints each failed check, and exits non-zero if any failed.
+//!
+//! usage: ipcmessagestest
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+using namespace std;
+
+#include "SocketsClass.h"
+#include "IPCMessages.h"
+#include "XmlHelper.h"
+#include "TestCheck.h"
+
+const int iTestPort = 22191;   //!< loopback port for TestTrackOverSocket; mvsocketdriver uses 22190
+
+//! fills Track with iNumKeys keys having every property; the big values write out long, and as floats are whole numbers, so they read back exactly
+void MakeTrack( OBJECTTRACKMESSAGE &Track, const int iNumKeys )
+{
+    Track.iReference = 123456;
+    Track.bLoop = true;
+    Track.iPeriodMilliseconds = 120000;
+    Track.iElapsedMilliseconds = 0;
+    Track.bPos = true;
+    Track.bRot = true;
+    Track.bScale = true;
+    Track.bColor = true;
+    Track.iNumKeys = iNumKeys;
+    for( int i = 0; i < iNumKeys; i++ )
+    {
+        OBJECTTRACKKEY &Key = Track.Keys[i];
+        Key.iTimeMilliseconds = 10000 * i;
+        Key.Easing = EASE_INOUT;
+        Key.Pos = Vector3( -1.0e20f * ( i + 1 ), 2.0e20f, -3.0e20f );
+        Key.Rotation = Rot( 0.5f, -0.5f, 0.5f, -0.5f );
+        Key.Scale = Vector3( 1.0e20f * ( i + 1 ), 2.0e20f, 3.0e20f );
+        Key.FaceColor.r = 0.25f;
+        Key.FaceColor.g = 0.5f;
+        Key.FaceColor.b = 0.75f;
+    }
+}
+
+//! returns Track written as an objecttrack line, newline included
+string WriteTrackLine( const OBJECTTRACKMESSAGE &Track )
+{
+    string Line;
+    XmlWriter Writer( Line );
+    WriteObjectTrack( Track, Writer );
+    Line += '\n';
+    return Line;
+}
+
+//! checks Parsed has the same keys as Track
+void CheckSameKeys( const OBJECTTRACKMESSAGE &Parsed, const OBJECTTRACKMESSAGE &Track )
+{
+    CHECK( Parsed.iReference == Track.iReference );
+    CHECK( Parsed.iNumKeys == Track.iNumKeys );
+    for( int i = 0; i < Parsed.iNumKeys && i < Track.iNumKeys; i++ )
+    {
+        CHECK( Parsed.Keys[i].iTimeMilliseconds == Track.Keys[i].iTimeMilliseconds );
+        CHECK( Parsed.Keys[i].Easing == Track.Keys[i].Easing );
+        CHECK( Parsed.Keys[i].Pos.x == Track.Keys[i].Pos.x && Parsed.Keys[i].Pos.y == Track.Keys[i].Pos.y && Parsed.Keys[i].Pos.z == Track.Keys[i].Pos.z );
+        CHECK( Parsed.Keys[i].Rotation.s == Track.Keys[i].Rotation.s );
+        CHECK( Parsed.Keys[i].Scale.x == Track.Keys[i].Scale.x );
+        CHECK( Parsed.Keys[i].FaceColor.b == Track.Keys[i].FaceColor.b );
+    }
+}
+
+void TestLongTrack()
+{
+    OBJECTTRACKMESSAGE Track;
+    MakeTrack( Track, OBJECTTRACKMESSAGE::MAX_KEYS );
+    string FullLine = WriteTrackLine( Track );
+    CHECK( FullLine.size() > (size_t)SOCKETS_SEND_BUFFER_LENGTH );   // the printf Send would cut it off
+    CHECK( FullLine.size() >= (size_t)SOCKETS_READ_BUFFER_LENGTH );   // and it wouldnt be read as one line
+
+    OBJECTTRACKMESSAGE Fitted = Track;
+    CHECK( !FitObjectTrack( Fitted, SOCKETS_READ_BUFFER_LENGTH ) );
+    CHECK( Fitted.iNumKeys > 0 && Fitted.iNumKeys < OBJECTTRACKMESSAGE::MAX_KEYS );
+
+    // fits with the longest elapsed the server could add, and one more key wouldnt
+    OBJECTTRACKMESSAGE Longest = Fitted;
+    Longest.iElapsedMilliseconds = INT_MAX;
+    CHECK( WriteTrackLine( Longest ).size() < (size_t)SOCKETS_READ_BUFFER_LENGTH );
+    Longest.iNumKeys++;
+    CHECK( WriteTrackLine( Longest ).size() >= (size_t)SOCKETS_READ_BUFFER_LENGTH );
+
+    OBJECTTRACKMESSAGE Parsed;
+    CHECK( ParseObjectTrack( WriteTrackLine( Fitted ).c_str(), Parsed ) );
+    CheckSameKeys( Parsed, Fitted );
+}
+
+void TestShortTrack()
+{
+    OBJECTTRACKMESSAGE Track;
+    MakeTrack( Track, 3 );
+    OBJECTTRACKMESSAGE Fitted = Track;
+    CHECK( FitObjectTrack( Fitted, SOCKETS_READ_BUFFER_LENGTH ) );
+    CHECK( Fitted.iNumKeys == 3 );
+    CHECK( WriteTrackLine( Fitted ) == WriteTrackLine( Track ) );
+}
+
+void TestTrackOverSocket()
+{
+    OBJECTTRACKMESSAGE Track;
+    MakeTrack( Track, OBJECTTRACKMESSAGE::MAX_KEYS );
+    FitObjectTrack( Track, SOCKETS_READ_BUFFER_LENGTH );
+    string Line = WriteTrackLine( Track );
+
+    mvsocket Listener;
+    Listener.Init();
+    CHECK( Listener.Listen( inet_addr( "127.0.0.1" ), iTestPort ) );
+    mvsocket Receiver;
+    Receiver.Init();
+    bool bConnected = Receiver.ConnectToServer( inet_addr( "127.0.0.1" ), iTestPort );
+    CHECK( bConnected );
+    if( bConnected )
+    {
+        mvsocket Sender = Listener.AcceptNewConnection();
+        // as the scripting engine and server send it
+        CHECK( Sender.Send( Line.c_str(), Line.size() ) != SOCKET_ERROR );
+
+        char ReadBuffer[ SOCKETS_READ_BUFFER_LENGTH + 2 ];   // as the server's
+        CHECK( Receiver.ReceiveLineBlocking( ReadBuffer ) == SOCKETS_READ_OK );
+        CHECK( Line == ReadBuffer );
+
+        OBJECTTRACKMESSAGE Parsed;
+        CHECK( ParseObjectTrack( ReadBuffer, Parsed ) );
+        CheckSameKeys( Parsed, Track );
+
+        // receiving end closes first, so the listening port isnt left in TIME_WAIT for the next run
+        Receiver.Close();
+        Sender.Close();
+    }
+    Listener.Close();
+}
+
+int main( int argc, char *argv[] )
+{
+    mvsocket::InitSocketSystem();
+
+    TestLongTrack();
+    TestShortTrack();
+    TestTrackOverSocket();
+
+    mvsocket::EndSocketSystem();
+
+    return ReportChecks();
+}
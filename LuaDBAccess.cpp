@@ -26,6 +26,9 @@
 // Programming Standards:
 // You MUST lock the mutex EngineMutex at the start of each function and unlock it when you exit
 
+// Values are read and written through LuaUserDataCache: writes are batched, and reads of cached values
+// queue the UserData event straight away, without asking the server
+
 
 #include <sstream>
 #include <string>
@@ -46,6 +49,9 @@ extern "C"
 
 #include "LuaScriptingAPIHelper.h"
 #include "LuaDBAccess.h"
+#include "LuaUserDataCache.h"
+#include "LuaEventClass.h"
+#include "scriptingenginelua.h"
 
 extern lua_State *luaVM;
 extern mvWorldStorage World;
@@ -59,6 +65,35 @@ extern pthread_mutex_t EngineMutex;
 
 namespace LuaDBAccess
 {
+    //! Gets a user data value for object iReference; from the cache if we have it, otherwise from the server
+    //! Either way, the script receives the value as a UserData event
+    static void RequestDBValue( int iReference, int iOwner, const string &sStore, const string &sValuename, const string &sClientsidereference )
+    {
+        string sValue;
+        if( LuaUserDataCache::Lookup( iOwner, sStore, sValuename, sValue ) )
+        {
+            EventInfoUserData *pEvent = new EventInfoUserData;
+
+            pEvent->iVMNum = iReference;
+            pEvent->sClientSideReference = sClientsidereference;
+            pEvent->iOwner = iOwner;
+            pEvent->sStore = sStore;
+            pEvent->sKey = sValuename;
+            pEvent->sData = sValue;
+
+            QueueEvent( pEvent );
+            return;
+        }
+
+        LuaUserDataCache::NoteFetch( iOwner, sStore, sValuename );
+
+        ostringstream messagestream;
+        messagestream << "<requestinfo type=\"DBUSERDATA\" ireplytoreference=\"" << iMyReference << "\" ireference=\"" << iReference << "\" idataowner=\"" << iOwner <<
+        "\" store=\"" << sStore << "\" valuename=\"" << sValuename << "\" clientsidereference=\"" << sClientsidereference << "\" />" << endl;
+        DEBUG(  "Sending to server " << messagestream.str() );
+        SocketMetaverseServer.Send( messagestream.str().c_str() );
+    }
+
     static int WriteDBPrivateValue( lua_State *L )
     {
         pthread_mutex_lock( &EngineMutex );
@@ -73,12 +108,7 @@ namespace LuaDBAccess
             Object *p_Object = World.GetObjectByReference( iReference );
             if( p_Object != NULL )
             {
-                int iOwner = p_Object->iownerreference;
-                ostringstream messagestream;
-                messagestream << "<setinfo type=\"DBUSERDATA\" ireference=\"" << iReference << "\" iowner=\"" << iOwner <<
-                "\" store=\"private\" valuename=\"" << sValuename << "\" value=\"" << sValue << "\">" << endl;
-                DEBUG(  "Sending to server " << messagestream.str() );
-                SocketMetaverseServer.Send( messagestream.str().c_str() );
+                LuaUserDataCache::Write( iReference, p_Object->iownerreference, "private", sValuename, sValue );
             }
         }
 
@@ -100,13 +130,7 @@ namespace LuaDBAccess
             Object *p_Object = World.GetObjectByReference( iReference );
             if( p_Object != NULL )
             {
-                int iOwner = p_Object->iownerreference;
-
-                ostringstream messagestream;
-                messagestream << "<setinfo type=\"DBUSERDATA\" ireference=\"" << iReference << "\" iowner=\"" << iOwner <<
-                "\" store=\"public\" valuename=\"" << sValuename << "\" value=\"" << sValue << "\" />" << endl;
-                DEBUG(  "Sending to server " << messagestream.str() );
-                SocketMetaverseServer.Send( messagestream.str().c_str() );
+                LuaUserDataCache::Write( iReference, p_Object->iownerreference, "public", sValuename, sValue );
             }
         }
 
@@ -128,13 +152,7 @@ namespace LuaDBAccess
             Object *p_Object = World.GetObjectByReference( iReference );
             if( p_Object != NULL )
             {
-                int iOwner = p_Object->iownerreference;
-
-                ostringstream messagestream;
-                messagestream << "<requestinfo type=\"DBUSERDATA\" ireplytoreference=\"" << iMyReference << "\" ireference=\"" << iReference << "\" idataowner=\"" << iOwner <<
-                "\" store=\"private\" valuename=\"" << sValuename << "\" clientsidereference=\"" << sClientsidereference << "\" />" << endl;
-                DEBUG(  "Sending to server " << messagestream.str() );
-                SocketMetaverseServer.Send( messagestream.str().c_str() );
+                RequestDBValue( iReference, p_Object->iownerreference, "private", sValuename, sClientsidereference );
             }
         }
 
@@ -157,11 +175,7 @@ namespace LuaDBAccess
             Object *p_Object = World.GetObjectByReference( iReference );
             if( p_Object != NULL )
             {
-                ostringstream messagestream;
-                messagestream << "<requestinfo type=\"DBUSERDATA\" ireplytoreference=\"" << iMyReference << "\" ireference=\"" << iReference << "\" idataowner=\"" << iOwnerReference <<
-                "\" store=\"public\" valuename=\"" << sValuename << "\" clientsidereference=\"" << sClientsidereference << "\" />" << endl;
-                DEBUG(  "Sending to server " << messagestream.str() );
-                SocketMetaverseServer.Send( messagestream.str().c_str() );
+                RequestDBValue( iReference, iOwnerReference, "public", sValuename, sClientsidereference );
             }
         }
 
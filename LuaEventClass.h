@@ -27,15 +27,49 @@
 #include <string>
 using namespace std;
 
-//! Base class for all Lua engine events; holds VM reference, eventname, and eventclass name
+//! Integer tag identifying the class of an event, used to dispatch events without string compares
+
+//! Integer tag identifying the class of an event, used to dispatch events without string compares
+//! Each tag has one entry in the event handler table in ScriptingEngineLua.cpp, which gives the Lua
+//! function name and how to push the event's arguments.
+//! EVENTTYPE_NAMEDFUNCTION is for events whose Lua function name is only known at runtime, such as custom timers
+enum EventType
+{
+    EVENTTYPE_INIT,
+    EVENTTYPE_TIMER,
+    EVENTTYPE_CLICK,
+    EVENTTYPE_KEYUP,
+    EVENTTYPE_KEYDOWN,
+    EVENTTYPE_COLLISIONSTART,
+    EVENTTYPE_COLLISIONEND,
+    EVENTTYPE_USERDATA,
+    EVENTTYPE_ASYNCRPC,
+    EVENTTYPE_NAMEDFUNCTION,
+    NUMEVENTTYPES
+};
+
+//! Base class for all Lua engine events; holds VM reference, event type, eventname, and eventclass name
 class EventInfo
 {
 public:
     int iVMNum;   //!< reference number of targeted VM
+    EventType iEventType;  //!< type tag of event, used for dispatch
     string sEventName;  //!< Name of event
     //string sData;
     string sEventClass;   //!< Class of event
 
+    EventInfo( EventType iEventType = EVENTTYPE_NAMEDFUNCTION, const char *sEventName = "", const char *sEventClass = "EventInfo" )
+    {
+        this->iVMNum = 0;
+        this->iEventType = iEventType;
+        this->sEventName = sEventName;
+        this->sEventClass = sEventClass;
+    }
+
+    virtual ~EventInfo()
+    {
+    }
+
     virtual int DummyFunction()
     {
         return 0;
@@ -46,7 +80,7 @@ public:
 class EventInfoData : public EventInfo
 {
 public:
-
+    EventInfoData( EventType iEventType, const char *sEventName, const char *sEventClass ) : EventInfo( iEventType, sEventName, sEventClass ) {}
 };
 
 //! EventCollisionStart is for collision start events; used by Lua scripting engine
@@ -54,6 +88,7 @@ class EventCollisionStart : public EventInfo
 {
 public:
     int iReference; //!< iReference of colliding object
+    EventCollisionStart() : EventInfo( EVENTTYPE_COLLISIONSTART, "CollisionStart", "EventCollisionStart" ) {}
 };
 
 //! EventCollisionEnd is for collision end events; used by Lua scripting engine
@@ -61,6 +96,7 @@ class EventCollisionEnd : public EventInfo
 {
 public:
     int iReference; //!< iReference of colliding object
+    EventCollisionEnd() : EventInfo( EVENTTYPE_COLLISIONEND, "CollisionEnd", "EventCollisionEnd" ) {}
 };
 
 //! EventKeyUp is for key up events; used by Lua scripting engine
@@ -69,6 +105,7 @@ class EventKeyUp : public EventInfo
 public:
     string sValue;  //!< key code(?)
     int iReference;    //!< iReference of avatar typing (?)
+    EventKeyUp() : EventInfo( EVENTTYPE_KEYUP, "KeyUp", "EventKeyUp" ) {}
 };
 
 //! Key down events; used by Lua scripting engine
@@ -77,20 +114,23 @@ class EventKeyDown : public EventInfo
 public:
     string sValue;   //!< key code(?)
     int iReference;    //!< iReference of avatar typing (?)
+    EventKeyDown() : EventInfo( EVENTTYPE_KEYDOWN, "KeyDown", "EventKeyDown" ) {}
 };
 
 //! Time events; used by lua scripting engine
+//! The standard timer calls "Timer"; custom timers pass in the name of the function to call
 class EventTimer : public EventInfo
 {
 public:
-
+    EventTimer() : EventInfo( EVENTTYPE_TIMER, "Timer", "EventTimer" ) {}
+    EventTimer( const string &sFunctionName ) : EventInfo( EVENTTYPE_NAMEDFUNCTION, sFunctionName.c_str(), "EventTimer" ) {}
 };
 
 //! initialization event (at script startup); used by lua scripting engine
 class EventInit : public EventInfo
 {
 public:
-
+    EventInit() : EventInfo( EVENTTYPE_INIT, "Init", "EventInit" ) {}
 };
 
 //! mouseclick event; used by lua scripting engine
@@ -98,6 +138,7 @@ class EventClick : public EventInfo
 {
 public:
     int iClickerReference;  //!< iReference of avatar who clicked
+    EventClick() : EventInfo( EVENTTYPE_CLICK, "Click", "EventClick" ) {}
 };
 
 //! userdata event; used to return userdata from db; used by lua scripting engine
@@ -109,13 +150,44 @@ public:
     string sKey;    //!< key to identify the data
     string sData;    //!< returned data
     string sClientSideReference;  //!< arbitrary query reference sent by client
+    EventInfoUserData() : EventInfoData( EVENTTYPE_USERDATA, "UserData", "EventInfoUserData" ) {}
 };
 
 //! script RPC event; used by lua scripting engine
 class EventInfoRPC : public EventInfo
 {
 public:
+    EventInfoRPC( EventType iEventType, const char *sEventName, const char *sEventClass ) : EventInfo( iEventType, sEventName, sEventClass ) {}
+};
+
+//! Message text shared by all the events of one multicast RPC
+
+//! Message text shared by all the events of one multicast RPC, so that sending to a large group
+//! copies the message once rather than once per member.
+//! Reference counts are only changed with EngineMutex held, like everything else in the scripting engine
+class SharedRPCMessage
+{
+public:
+    string sMessage;   //!< message
+    int iRefCount;    //!< number of holders; deleted when this drops to zero
 
+    SharedRPCMessage( const string &sMessage )
+    {
+        this->sMessage = sMessage;
+        iRefCount = 1;
+    }
+    void AddRef()
+    {
+        iRefCount++;
+    }
+    void Release()
+    {
+        iRefCount--;
+        if( iRefCount == 0 )
+        {
+            delete this;
+        }
+    }
 };
 
 //! script multicast rpc event; used by lua scripting engine
@@ -124,7 +196,17 @@ class EventInfoMulticastRPC : public EventInfoRPC
 public:
     int iSenderReference;  //!< iReference of sending object
     //string sRPCType;
-    string sMessage;   //!< message
+    SharedRPCMessage *pMessage;   //!< message, shared with the other members of the multicast group
+
+    EventInfoMulticastRPC( SharedRPCMessage *pMessage ) : EventInfoRPC( EVENTTYPE_ASYNCRPC, "AsyncRPC", "EventInfoMulticastRPC" )
+    {
+        this->pMessage = pMessage;
+        pMessage->AddRef();
+    }
+    ~EventInfoMulticastRPC()
+    {
+        pMessage->Release();
+    }
 };
 
 #endif // _LUAEVENTCLASS_H
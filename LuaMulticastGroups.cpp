@@ -0,0 +1,161 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Multicast groups of the scripts running in this Lua scripting engine
+//!
+//! Each engine keeps the groups of the scripts it runs, and hands a script's memberships over with
+//! its state when it migrates to another engine.  Scripts join groups with RegisterForMulticastGroup,
+//! and send to them with SendMulticastRPC; see LuaScriptingStandardRPC.cpp.
+//!
+//! Delivering an RPC to a group makes one SharedRPCMessage holding the message, and queues a small
+//! EventInfoMulticastRPC pointing at it for each member, so a large group costs one copy of the
+//! message rather than one per member.  multicastdriver measures this against a copy per member.
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "tinyxml.h"
+
+#include "scriptingenginelua.h"
+#include "LuaEventClass.h"
+#include "LuaMulticastGroups.h"
+
+//! a multicast group; used by Lua scripting engine for RPC multicast calls
+//! members are kept sorted by iReference, which is also the order of ObjectVMs, so that
+//! fan-out walks the VMs in order
+class MULTICASTGROUP
+{
+public:
+    string sGroupName;
+    vector < int > iMemberReferences;
+
+    void AddMember( int iReference )
+    {
+        vector < int >::iterator position = lower_bound( iMemberReferences.begin(), iMemberReferences.end(), iReference );
+        if( position == iMemberReferences.end() || *position != iReference )
+        {
+            iMemberReferences.insert( position, iReference );
+        }
+    }
+};
+
+map < string, MULTICASTGROUP > MulticastGroups;  //!< All registered multicast groups
+
+extern map < int, ObjectVMInfoClass > ObjectVMs;
+
+// Input: iReference: object whose script registered for the group, or migrated to this engine
+//                    having been a member on its old engine
+//        sGroupname: the multicast group
+//
+// Description: Adds iReference to the group, creating the group if need be.
+//  Caller must hold EngineMutex.
+void JoinMulticastGroup( int iReference, const string &sGroupname )
+{
+    if( MulticastGroups.find( sGroupname ) == MulticastGroups.end() )
+    {
+        MULTICASTGROUP Multicastgroup;
+        Multicastgroup.sGroupName = sGroupname;
+        MulticastGroups.insert( pair < string, MULTICASTGROUP >( sGroupname, Multicastgroup ) );
+    }
+    MulticastGroups.find( sGroupname )->second.AddMember( iReference );
+}
+
+// Input: pElement: a multicastrpc message, relayed by the server from the engine of the sender
+//
+// Description: Queues the RPC for each member of the group whose script runs in this engine.
+//  Caller must hold EngineMutex.
+void DeliverMulticastRPC( TiXmlElement *pElement )
+{
+    const char *sGroupname = pElement->Attribute( "group" );
+    const char *sMessage = pElement->Attribute( "message" );
+    if( sGroupname == NULL || sMessage == NULL || pElement->Attribute( "isender" ) == NULL )
+    {
+        return;
+    }
+    DeliverMulticastRPC( sGroupname, atoi( pElement->Attribute( "isender" ) ), sMessage );
+}
+
+// Input: sGroupname: multicast group to deliver to
+//        iSenderReference: object whose script sent the RPC, in this engine or another
+//        sMessage: the RPC's message
+//
+// Description: Queues the RPC for each member of the group whose script runs in this engine.
+//  Members whose VM has gone are compacted out of the group in the same pass.
+//  Caller must hold EngineMutex.
+void DeliverMulticastRPC( const char *sGroupname, int iSenderReference, const char *sMessage )
+{
+    map < string, MULTICASTGROUP >::iterator groupiterator = MulticastGroups.find( sGroupname );
+    if( groupiterator == MulticastGroups.end() )
+    {
+        return;
+    }
+    vector < int > &rMembers = groupiterator->second.iMemberReferences;
+
+    // one copy of the message, shared by the events of all members
+    SharedRPCMessage *pMessage = new SharedRPCMessage( sMessage );
+
+    int iNumLiveMembers = 0;
+    for( int i = 0; i < (int)rMembers.size(); i++ )
+    {
+        ObjectVMIterator vmiterator = ObjectVMs.find( rMembers[i] );
+        if( vmiterator == ObjectVMs.end() )
+        {
+            continue;
+        }
+        rMembers[ iNumLiveMembers ] = rMembers[i];
+        iNumLiveMembers++;
+
+        if( vmiterator->second.pVM != NULL )
+        {
+            EventInfoMulticastRPC *pEvent = new EventInfoMulticastRPC( pMessage );
+
+            pEvent->iVMNum = rMembers[i];
+            pEvent->iSenderReference = iSenderReference;
+
+            QueueEventForVM( vmiterator->second, pEvent );
+        }
+    }
+    rMembers.resize( iNumLiveMembers );
+
+    pMessage->Release();
+}
+
+// Input: iReference: object whose script is migrating to another engine
+// Output: Groups: the names of the multicast groups iReference was a member of are appended
+//
+// Description: Takes iReference out of all its multicast groups, so they can be re-joined
+//  by the engine the script migrates to.  Caller must hold EngineMutex.
+void TakeMulticastGroupsForObject( int iReference, vector < string > &Groups )
+{
+    for( map < string, MULTICASTGROUP >::iterator groupiterator = MulticastGroups.begin(); groupiterator != MulticastGroups.end(); groupiterator++ )
+    {
+        vector < int > &rMembers = groupiterator->second.iMemberReferences;
+        vector < int >::iterator position = lower_bound( rMembers.begin(), rMembers.end(), iReference );
+        if( position != rMembers.end() && *position == iReference )
+        {
+            rMembers.erase( position );
+            Groups.push_back( groupiterator->first );
+        }
+    }
+}
@@ -0,0 +1,39 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Multicast groups of the scripts running in this Lua scripting engine
+// see LuaMulticastGroups.cpp for documentation
+
+#ifndef _LUAMULTICASTGROUPS_H
+#define _LUAMULTICASTGROUPS_H
+
+#include <string>
+#include <vector>
+using namespace std;
+
+class TiXmlElement;
+
+void JoinMulticastGroup( int iReference, const string &sGroupname );   //!< adds iReference to group sGroupname, for a script that registered for it or that was a member on the engine it migrated from
+void DeliverMulticastRPC( TiXmlElement *pElement );   //!< queues a multicastrpc relayed by the server for the local members of its group
+void DeliverMulticastRPC( const char *sGroupname, int iSenderReference, const char *sMessage );   //!< queues a multicast RPC for the local members of group sGroupname
+void TakeMulticastGroupsForObject( int iReference, vector < string > &Groups );   //!< removes iReference from its groups, appending their names to Groups, when its script migrates away
+
+#endif // _LUAMULTICASTGROUPS_H
@@ -48,6 +48,8 @@ extern "C"
 #include "WorldStorage.h"
 #include "SocketsClass.h"
 #include "Math.h"
+#include "IPCMessages.h"
+#include "XmlHelper.h"
 
 #include "LuaScriptingAPIHelper.h"
 #include "LuaScriptingAPI.h"
@@ -180,6 +182,154 @@ static int DoSmoothMove( lua_State *L )
     return 0;
 }
 
+// reads one key of a SetAnimationTrack keys table, at the top of the stack, into the next key of Track
+static void TableToTrackKey( lua_State *L, OBJECTTRACKMESSAGE &Track )
+{
+    OBJECTTRACKKEY &Key = Track.Keys[ Track.iNumKeys ];
+    bool bFirstKey = ( Track.iNumKeys == 0 );
+    if( bFirstKey )
+    {
+        Key.iTimeMilliseconds = 0;
+    }
+    else
+    {
+        Key = Track.Keys[ Track.iNumKeys - 1 ];
+    }
+    Key.Easing = EASE_LINEAR;
+
+    lua_pushnil(L);  /* first key */
+    while (lua_next(L, -2) != 0)
+    {
+        if( lua_type( L, -2 ) != LUA_TSTRING )
+        {
+            lua_pop(L, 1);
+            continue;
+        }
+        string keyname = lua_tostring( L, -2 );
+        string valuetype = lua_typename(L, lua_type(L, -1));
+        if( keyname == "time" && valuetype == "number" )
+        {
+            int iTime = (int)lua_tonumber( L, -1 );
+            if( bFirstKey || iTime > Key.iTimeMilliseconds )
+            {
+                Key.iTimeMilliseconds = iTime;
+            }
+        }
+        else if( keyname == "ease" && valuetype == "string" )
+        {
+            Key.Easing = GetTrackEasing( lua_tostring( L, -1 ) );
+        }
+        else if( keyname == "pos" && valuetype == "table" && ( bFirstKey || Track.bPos ) )
+        {
+            Track.bPos = true;
+            TableToPos( L, Key.Pos );
+        }
+        else if( keyname == "rot" && valuetype == "table" && ( bFirstKey || Track.bRot ) )
+        {
+            Track.bRot = true;
+            TableToRot( L, Key.Rotation );
+        }
+        else if( keyname == "scale" && valuetype == "table" && ( bFirstKey || Track.bScale ) )
+        {
+            Track.bScale = true;
+            TableToScale( L, Key.Scale );
+        }
+        else if( keyname == "color" && valuetype == "table" && ( bFirstKey || Track.bColor ) )
+        {
+            Track.bColor = true;
+            TableToColor( L, Key.FaceColor );
+        }
+        lua_pop(L, 1);  /* removes `value'; keeps `key' for next iteration */
+    }
+    Track.iNumKeys++;
+}
+
+// SetAnimationTrack{ loop = true, period = ..., keys = { { time = 0, ease = "easeinout", pos = {...}, rot = {...} }, ... } }
+// sends the whole track once; the server and clients play it from there
+static int SetAnimationTrack( lua_State *L )
+{
+    pthread_mutex_lock( &EngineMutex );
+
+    int iReference = GetReferenceFromVMRegistry( L );
+
+    OBJECTTRACKMESSAGE Track;
+    Track.iReference = iReference;
+    Track.bLoop = false;
+    Track.iPeriodMilliseconds = 0;
+    Track.iElapsedMilliseconds = 0;
+    Track.bPos = false;
+    Track.bRot = false;
+    Track.bScale = false;
+    Track.bColor = false;
+    Track.iNumKeys = 0;
+
+    if( strcmp( lua_typename( L, lua_type( L, 1 ) ), "table" ) == 0 )
+    {
+        lua_pushnil(L);  /* first key */
+        while (lua_next(L, 1) != 0)
+        {
+            string keyname = lua_tostring( L, -2 );
+            string valuetype = lua_typename(L, lua_type(L, -1));
+            if( keyname == "loop" && valuetype == "boolean" )
+            {
+                Track.bLoop = lua_toboolean( L, -1 );
+            }
+            else if( keyname == "period" && valuetype == "number" )
+            {
+                Track.iPeriodMilliseconds = (int)lua_tonumber( L, -1 );
+            }
+            else if( keyname == "keys" && valuetype == "table" )
+            {
+                // keys is a list, so go through it by index; lua_tostring on a number key would upset lua_next
+                int iNumKeys = luaL_getn( L, -1 );
+                for( int i = 1; i <= iNumKeys && Track.iNumKeys < OBJECTTRACKMESSAGE::MAX_KEYS; i++ )
+                {
+                    lua_rawgeti( L, -1, i );
+                    if( lua_type( L, -1 ) == LUA_TTABLE )
+                    {
+                        TableToTrackKey( L, Track );
+                    }
+                    lua_pop( L, 1 );
+                }
+            }
+            lua_pop(L, 1);  /* removes `value'; keeps `key' for next iteration */
+        }
+
+        if( Track.iNumKeys > 0 && iReference > 0 )
+        {
+            // a whole track is longer than the printf Send can format, so it goes as a blob, cut to what the server can read as one line
+            if( !FitObjectTrack( Track, SOCKETS_READ_BUFFER_LENGTH ) )
+            {
+                DEBUG(  "track for " << iReference << " too long for one line, sending its first " << Track.iNumKeys << " keys" ); // DEBUG
+            }
+            string TrackMessage;
+            XmlWriter Writer( TrackMessage );
+            WriteObjectTrack( Track, Writer );
+            TrackMessage += '\n';
+            DEBUG(  "Sending to server " << TrackMessage ); // DEBUG
+            SocketMetaverseServer.Send( TrackMessage.c_str(), TrackMessage.size() );
+        }
+    }
+
+    pthread_mutex_unlock( &EngineMutex );
+    return 0;
+}
+
+// stops the track started by SetAnimationTrack; the object stays where the track had got to
+static int StopAnimationTrack( lua_State *L )
+{
+    pthread_mutex_lock( &EngineMutex );
+
+    int iReference = GetReferenceFromVMRegistry( L );
+    sprintf( SendBuffer, "<objecttrack ireference=\"%i\"/>\n",
+             iReference
+           );
+    SocketMetaverseServer.Send( SendBuffer );
+
+    pthread_mutex_unlock( &EngineMutex );
+    return 0;
+}
+
 static int CreateObject(lua_State *L)
 {
     pthread_mutex_lock( &EngineMutex );
@@ -316,6 +466,8 @@ void RegisterMiscellaneousFunctions( lua_State *pluaVM )
     LUAREGISTER(Say);
 
     LUAREGISTER(DoSmoothMove);
+    LUAREGISTER(SetAnimationTrack);
+    LUAREGISTER(StopAnimationTrack);
 
     LUAREGISTER(HyperlinkAgent);
 }
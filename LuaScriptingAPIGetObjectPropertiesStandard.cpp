@@ -392,7 +392,7 @@ static int GetScale( lua_State *L )
 
     lua_newtable( L );
 
-    if( strcmp( p_Object->ObjectType, "PRIM" ) == 0 )
+    if( p_Object->TypeTag == OBJECTTYPE_PRIM )
     {
         Prim *p_Prim = dynamic_cast< Prim *>( p_Object );
         lua_pushstring( L, "x" );
@@ -438,7 +438,7 @@ static int GetScaleByReference( lua_State *L )
         Object *p_Object = World.GetObjectByReference( iReference );
         if( p_Object != NULL )
         {
-            if( strcmp( p_Object->ObjectType, "PRIM" ) == 0 )
+            if( p_Object->TypeTag == OBJECTTYPE_PRIM )
             {
                 Prim *p_Prim = dynamic_cast< Prim *>( p_Object );
 
@@ -492,7 +492,7 @@ static int GetColor( lua_State *L )
 
     lua_newtable( L );
 
-    if( strcmp( p_Object->ObjectType, "PRIM" ) == 0 )
+    if( p_Object->TypeTag == OBJECTTYPE_PRIM )
     {
         Prim *p_Prim = dynamic_cast< Prim *>( p_Object );
 
@@ -542,7 +542,7 @@ static int GetColorByReference( lua_State *L )
 
         if( p_Object != NULL )
         {
-            if( strcmp( p_Object->ObjectType, "PRIM" ) == 0 )
+            if( p_Object->TypeTag == OBJECTTYPE_PRIM )
             {
                 Prim *p_Prim = dynamic_cast< Prim *>( p_Object );
 
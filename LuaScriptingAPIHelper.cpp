@@ -40,6 +40,7 @@ extern "C"
 #include "scriptingenginelua.h"
 #include "LuaScriptingAPI.h"
 #include "LuaScriptingAPIHelper.h"
+#include "LuaVMPool.h"
 
 extern map < int, ObjectVMInfoClass > ObjectVMs;
 
@@ -47,12 +48,11 @@ extern void SendClientMessage( const char *message );
 
 lua_State *GetVMForReference( int iReference )
 {
-    for( ObjectVMIterator iterator = ObjectVMs.begin(); iterator != ObjectVMs.end(); iterator++ )
+    // ObjectVMs is keyed on the object reference
+    ObjectVMIterator iterator = ObjectVMs.find( iReference );
+    if( iterator != ObjectVMs.end() )
     {
-        if( iterator->second.iObjectReference == iReference )
-        {
-            return iterator->second.pVM;
-        }
+        return iterator->second.pVM;
     }
     return NULL;
 }
@@ -213,20 +213,18 @@ int GetReferenceFromVMRegistry( lua_State *L )
 
     iReference = 0;
 
-    //cout << "reading registry..." << lua_typename(L, lua_type(L, LUA_REGISTRYINDEX )) << endl;
-    lua_pushnil( L );
-    while (lua_next(L, LUA_REGISTRYINDEX ) != 0)
+    LuaVMPool::PushScriptTable( L );
+    if( lua_type( L, -1 ) == LUA_TTABLE )
     {
-        string keyname = lua_tostring( L, -2 );
-        string valuetype = lua_typename(L, lua_type(L, -1));
-        DEBUG("[" << keyname << "] [" << valuetype << "]" << endl);
-        if( keyname == "iReference" && valuetype == "number" )
+        lua_pushstring( L, "iReference" );
+        lua_rawget( L, -2 );
+        if( lua_type( L, -1 ) == LUA_TNUMBER )
         {
             iReference = (int)lua_tonumber( L, -1 );
-            DEBUG("Got iReference: " << iReference << endl);
         }
-        lua_pop(L, 1);  /* removes `value'; keeps `key' for next iteration */
+        lua_pop( L, 1 );
     }
+    lua_pop( L, 1 );
 
     return iReference;
 }
@@ -467,13 +465,15 @@ namespace LuaScriptingAPIHelper  // Add new functions to this namespace
     void AddObjectReferenceToVMRegistry( int iObjectReference, lua_State *pluaVM )
     {
         DEBUG("AddObjectReferenceToVMRegistry()" << endl);
-        DumpVMRegistry( pluaVM );
-
-        lua_pushstring( pluaVM, "iReference" );
-        lua_pushnumber( pluaVM, iObjectReference );
-        lua_settable( pluaVM, LUA_REGISTRYINDEX );
 
-        DumpVMRegistry( pluaVM );
+        LuaVMPool::PushScriptTable( pluaVM );
+        if( lua_type( pluaVM, -1 ) == LUA_TTABLE )
+        {
+            lua_pushstring( pluaVM, "iReference" );
+            lua_pushnumber( pluaVM, iObjectReference );
+            lua_rawset( pluaVM, -3 );
+        }
+        lua_pop( pluaVM, 1 );
     }
 
     void PushRotAsTable( lua_State *L, const Rot &rot )
@@ -520,7 +520,8 @@ namespace LuaScriptingAPIHelper  // Add new functions to this namespace
         lua_pushnil( pluaVM );
         while (lua_next(pluaVM, LUA_REGISTRYINDEX ) != 0)
         {
-            string keyname = lua_tostring( pluaVM, -2 );
+            // lua_tostring on a number key would turn it into a string in place, and upset lua_next
+            string keyname = lua_type( pluaVM, -2 ) == LUA_TSTRING ? lua_tostring( pluaVM, -2 ) : lua_typename( pluaVM, lua_type( pluaVM, -2 ) );
             string valuetype = lua_typename(pluaVM, lua_type(pluaVM, -1));
             DEBUG("[" << keyname << "] [" << valuetype << "]" << endl);
             lua_pop(pluaVM, 1);  /* removes `value'; keeps `key' for next iteration */
@@ -47,7 +47,7 @@ void TableToScale( lua_State *L, Vector3 &NewScale );   //!< converts passed in
 void TableToColor( lua_State *L, Color &NewColor );   //!< converts passed in table with "r","g","b" keys into a Color
 void TableToRot( lua_State *L, Rot &NewRot );           //!< converts passed in table with "x","y","z","s" keys into a Rot
 void TableToVector( lua_State *L, Vector3 &NewVector );   //!< converts passed in table with "x","y","z" keys into a Vector3
-int GetReferenceFromVMRegistry( lua_State *L );   //!< Retrieves iReference of object, which we previously stored in VM's local registry
+int GetReferenceFromVMRegistry( lua_State *L );   //!< Retrieves iReference of object, which we previously stored in the VM's record in the registry
 lua_State *GetVMForReference( int iReference );     //!< Retrieves a pointer to the VM correspondign to object iReference
 
 //! \brief Functions available to the functions to Lua script-callable functions
@@ -56,8 +56,8 @@ namespace LuaScriptingAPIHelper  // Note: Add new functions to this namespace
     string GetTypename( lua_State *L, int iStackPos );                         //!< returns the typename of the value at stack position stackpos
     int SwapParams(lua_State *L, lua_State *pluaVM);  // swaps stacks for two VM's
     void SayFromObject( int iObjectReference, string sMessage );               //!< sends a Say in the sim from the object iObjectReference
-    void AddObjectReferenceToVMRegistry( int iObjectReference, lua_State *pluaVM );        //!<  stores the value iObjectReference in the VM registry of the passed in VM, for later retrieval by GetReferenceFromVMRegistry within each Lua-called function call
-    void DumpVMRegistry( lua_State *pluaVM );      //!< diagnostic tool: dumps the contents of the VM registry of the passed-in VM
+    void AddObjectReferenceToVMRegistry( int iObjectReference, lua_State *pluaVM );        //!<  stores the value iObjectReference in the registry record of the passed in VM, for later retrieval by GetReferenceFromVMRegistry within each Lua-called function call
+    void DumpVMRegistry( lua_State *pluaVM );      //!< diagnostic tool: dumps the contents of the registry, shared by all VMs, of the passed-in VM
     bool DoPCall(lua_State *L, int nargs, int nresults, int errfunc); //!< error handled pcall
 
     void PushRotAsTable( lua_State *L, const Rot &rot );  //!< Pushes a rot onto the stack of VM L, as a table
@@ -25,12 +25,19 @@
 
 // For documentation on each function, see the document LuaScriptEngine.html in the cvs module "documentation"
 
+// Multicast RPCs are delivered straight to the members whose scripts run in this engine.  If the
+// server has told us there are other scripting engines, they also go to the server, which passes
+// them to every other engine, so members whose scripts run there get them too.  The groups
+// themselves are kept in LuaMulticastGroups.cpp.
+//
+// SendSynchroRPC only reaches objects whose scripts run in this engine; it can't wait for a
+// call to another engine to return, so it reports an error to the caller instead.
+
 // Programming standards:
 // - *Only* functions called directly by Lua scripts should be in this module
 //   (helper functions go in the module LuaScriptingApiHelper.cpp/.h)
 // - You MUST lock the mutex EngineMutex at the start of each function, and unlock it at the end
 
-#include <set>
 #include <map>
 #include <sstream>
 #include <string>
@@ -49,9 +56,12 @@ extern "C"
 #include "Math.h"
 #include "ThreadWrapper.h"
 
+#include "XmlHelper.h"
+
 #include "scriptingenginelua.h"
 #include "LuaScriptingAPIHelper.h"
 #include "LuaScriptingStandardRPC.h"
+#include "LuaMulticastGroups.h"
 #include "LuaEventClass.h"
 
 extern lua_State *luaVM;
@@ -59,17 +69,7 @@ extern mvWorldStorage World;
 extern mvsocket SocketMetaverseServer;
 extern char SendBuffer[ 2048 ];
 extern char ReadBuffer[ 4097 ];
-
-//! a multicast group; used by Lua scripting engine for RPC multicast calls
-class MULTICASTGROUP
-{
-public:
-    string sGroupName;
-    set < int >
-    iMemberReferences;
-};
-
-map < string, MULTICASTGROUP > MulticastGroups;  //!< All registered multicast groups
+extern int iNumScriptingEngines;
 
 extern map < int, ObjectVMInfoClass > ObjectVMs;
 
@@ -85,13 +85,7 @@ static int RegisterForMulticastGroup( lua_State *L )
     {
         string sGroup = lua_tostring( L, 1 );
         DEBUG(  "ref " << iReference << " trying to register for multicast gorup " << sGroup ); // DEBUG
-        if( MulticastGroups.find( sGroup ) == MulticastGroups.end() )
-        {
-            MULTICASTGROUP Multicastgroup;
-            Multicastgroup.sGroupName = sGroup;
-            MulticastGroups.insert( pair < string, MULTICASTGROUP >( sGroup, Multicastgroup ) );
-        }
-        MulticastGroups.find( sGroup )->second.iMemberReferences.insert( iReference );
+        JoinMulticastGroup( iReference, sGroup );
     }
 
     pthread_mutex_unlock( &EngineMutex );
@@ -108,32 +102,45 @@ static int SendSynchroRPC( lua_State *L )
     {
         int iTargetReference = lua_tonumber( L, 1 );
         lua_remove( L, 1 );
-        ObjectVMInfoClass &ObjectVMInfo = ObjectVMs.find( iTargetReference )->second;
 
         //struct timespec delay;
         //delay.tv_sec = 0;
         //delay.tv_nsec = 1000 * 1000 * 1000;
 
+        // the target can be released, eg migrated to another engine, while we wait, so look it up each time
         DEBUG(  "synchroRPC() Checking for target vm running or not..." );
-        while( ObjectVMInfo.bVMIsRunning == true )
+        ObjectVMIterator vmiterator = ObjectVMs.find( iTargetReference );
+        while( vmiterator != ObjectVMs.end() && vmiterator->second.bVMIsRunning == true )
         {
+            // EngineMutex is recursive, and the engine holds it around the script calling us too; the
+            // target's event thread needs both let go
+            pthread_mutex_unlock( &EngineMutex );
             pthread_mutex_unlock( &EngineMutex );
             PauseThreadMilliseconds( 1000 );
             //pthread_delay_np( &delay );
             pthread_mutex_lock( &EngineMutex );
+            pthread_mutex_lock( &EngineMutex );
+            vmiterator = ObjectVMs.find( iTargetReference );
+        }
+        if( vmiterator == ObjectVMs.end() || vmiterator->second.pVM == NULL )
+        {
+            ostringstream errorstream;
+            errorstream << "sendSynchroRPC target " << iTargetReference << " has no script in this scripting engine";
+            LuaScriptingAPIHelper::SayFromObject( iReference, errorstream.str() );
+            pthread_mutex_unlock( &EngineMutex );
+            return 0;
         }
         DEBUG(  "synchroRPC() target vm not running, we have mutex, send rpc..." );
         args = 0;
-        lua_State *pluaVM = ObjectVMInfo.pVM;
+        lua_State *pluaVM = vmiterator->second.pVM;
         lua_settop(pluaVM, 0);
         lua_getglobal( pluaVM, "SynchroRPC" );
         lua_pushnumber( pluaVM, (float)iReference );
 
         args = LuaScriptingAPIHelper::SwapParams(L, pluaVM);
         args++;
-        pthread_mutex_unlock( &EngineMutex );
+        // all VMs share one Lua state, so we keep EngineMutex while the target runs
         LuaScriptingAPIHelper::DoPCall(pluaVM, args, LUA_MULTRET, 0);
-        pthread_mutex_lock( &EngineMutex );
         args = LuaScriptingAPIHelper::SwapParams(pluaVM, L);
     }
     else
@@ -153,29 +160,28 @@ static int SendMulticastRPC( lua_State *L )
     int iReference = GetReferenceFromVMRegistry( L );
     if( strcmp( lua_typename( L, lua_type( L, 1 ) ), "string" ) == 0 && strcmp( lua_typename( L, lua_type( L, 2 ) ), "string" ) == 0 )
     {
-        string sGroupname = lua_tostring( L, 1 );
-        string sMessage = lua_tostring( L, 2 );
+        DeliverMulticastRPC( lua_tostring( L, 1 ), iReference, lua_tostring( L, 2 ) );
 
-        if( MulticastGroups.find(  sGroupname ) != MulticastGroups.end() )
+        // the server passes this to every engine but us, and each delivers it to its own members.
+        // Until the server tells us how many engines there are, we assume there may be others
+        if( iNumScriptingEngines != 1 )
         {
-            MULTICASTGROUP &rMulticastgroup = MulticastGroups.find(  sGroupname )->second;
-
-            for( set < int >::iterator iterator = rMulticastgroup.iMemberReferences.begin(); iterator != rMulticastgroup.iMemberReferences.end(); iterator++ )
+            string Message;
+            XmlWriter Writer( Message );
+            Writer.StartElement( "multicastrpc" );
+            Writer.Attribute( "group", lua_tostring( L, 1 ) );
+            Writer.Attribute( "isender", iReference );
+            Writer.Attribute( "message", lua_tostring( L, 2 ) );
+            Writer.EndElement();
+            Message += '\n';
+
+            if( (int)Message.size() < SOCKETS_READ_BUFFER_LENGTH )
+            {
+                SocketMetaverseServer.Send( Message.c_str(), Message.size() );
+            }
+            else
             {
-                lua_State *pluaVM = GetVMForReference( *iterator );
-                if( pluaVM != NULL )
-                {
-                    EventInfoMulticastRPC *pEvent = new EventInfoMulticastRPC;
-
-                    pEvent->sEventName = "AsyncRPC";
-                    pEvent->sEventClass = "EventInfoMulticastRPC";
-                    pEvent->iVMNum = *iterator;
-                    pEvent->iSenderReference = iReference;
-                    pEvent->sMessage = sMessage;
-
-                    // QueueFunction( *iterator, "AsyncRPC", sMessage );
-                    QueueEvent( pEvent );
-                }
+                LuaScriptingAPIHelper::SayFromObject( iReference, "sendMulticastRPC message too long to send to other scripting engines" );
             }
         }
     }
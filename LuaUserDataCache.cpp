@@ -0,0 +1,225 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Engine-side cache of script database user data, in front of the setinfo/requestinfo round trips
+//!
+//! Reading a user data value used to mean a requestinfo to the metaverseserver, forwarded to
+//! dbinterface, with the answer coming back the same way as a UserData event; every write was a
+//! setinfo message of its own.  This cache keeps the values this engine has read or written:
+//! - reads of a cached value queue the UserData event locally, with no IPC at all
+//! - writes go into the cache straight away (write-through) and are queued; FlushWrites sends
+//!   the queue once per frame as <setinfobatch> messages, keeping only the last write to each value
+//! - the server sends <userdatachanged> to the other engines when a value is written, and those
+//!   drop it from their cache
+//!
+//! A fetch answered after the value was written or invalidated carries an old value: it is still
+//! passed to the script that asked, but not cached.
+
+#ifndef TIXML_USE_STL
+#define TIXML_USE_STL
+#endif
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+using namespace std;
+
+#include "tinyxml.h"
+
+#include "SocketsClass.h"
+#include "Diag.h"
+#include "LuaUserDataCache.h"
+
+extern mvsocket SocketMetaverseServer;
+
+namespace LuaUserDataCache
+{
+    const int iMaxCachedValues = 4096;   //!< the cache is emptied when it grows past this
+    const char sBatchStart[] = "<setinfobatch type=\"DBUSERDATA\">";
+    const char sBatchEnd[] = "</setinfobatch>\n";
+    const int iMaxBatchLength = SOCKETS_SEND_BUFFER_LENGTH - 1;   //!< longest setinfobatch message, wrapper included, so one always fits a socket send buffer
+    const int iMaxBatchEntriesLength = iMaxBatchLength - ( sizeof( sBatchStart ) - 1 ) - ( sizeof( sBatchEnd ) - 1 );
+
+    //! identifies one user data value
+    class USERDATAKEY
+    {
+    public:
+        int iOwner;
+        string sStore;
+        string sValueName;
+
+        USERDATAKEY( int iOwner, const string &sStore, const string &sValueName )
+        {
+            this->iOwner = iOwner;
+            this->sStore = sStore;
+            this->sValueName = sValueName;
+        }
+        bool operator<( const USERDATAKEY &other ) const
+        {
+            if( iOwner != other.iOwner )
+            {
+                return iOwner < other.iOwner;
+            }
+            if( sStore != other.sStore )
+            {
+                return sStore < other.sStore;
+            }
+            return sValueName < other.sValueName;
+        }
+    };
+
+    //! a write not yet sent to the server
+    class PENDINGWRITE
+    {
+    public:
+        int iReference;   //!< object that wrote the value
+        string sValue;
+    };
+
+    static map< USERDATAKEY, string > CachedValues;
+    static map< USERDATAKEY, PENDINGWRITE > PendingWrites;
+    static map< USERDATAKEY, int > PendingFetches;   //!< number of requestinfos in flight, per value
+    static set< USERDATAKEY > StaleFetches;   //!< values whose in-flight fetches must not be cached
+
+    //! a value in flight is now out of date
+    static void MarkFetchesStale( const USERDATAKEY &Key )
+    {
+        if( PendingFetches.find( Key ) != PendingFetches.end() )
+        {
+            StaleFetches.insert( Key );
+        }
+    }
+
+    static void StoreValue( const USERDATAKEY &Key, const string &sValue )
+    {
+        if( (int)CachedValues.size() >= iMaxCachedValues && CachedValues.find( Key ) == CachedValues.end() )
+        {
+            DEBUG( "user data cache full, emptying" );
+            CachedValues.clear();
+        }
+        CachedValues[ Key ] = sValue;
+    }
+
+    bool Lookup( int iOwner, const string &sStore, const string &sValueName, string &sValue )
+    {
+        map< USERDATAKEY, string >::iterator iterator = CachedValues.find( USERDATAKEY( iOwner, sStore, sValueName ) );
+        if( iterator == CachedValues.end() )
+        {
+            return false;
+        }
+        sValue = iterator->second;
+        return true;
+    }
+
+    void NoteFetch( int iOwner, const string &sStore, const string &sValueName )
+    {
+        PendingFetches[ USERDATAKEY( iOwner, sStore, sValueName ) ]++;
+    }
+
+    void StoreFetchResult( int iOwner, const string &sStore, const string &sValueName, const string &sValue )
+    {
+        USERDATAKEY Key( iOwner, sStore, sValueName );
+        bool bStale = StaleFetches.find( Key ) != StaleFetches.end();
+
+        map< USERDATAKEY, int >::iterator fetchiterator = PendingFetches.find( Key );
+        if( fetchiterator != PendingFetches.end() )
+        {
+            fetchiterator->second--;
+            if( fetchiterator->second <= 0 )
+            {
+                PendingFetches.erase( fetchiterator );
+                StaleFetches.erase( Key );
+            }
+        }
+
+        if( !bStale )
+        {
+            StoreValue( Key, sValue );
+        }
+    }
+
+    void Write( int iReference, int iOwner, const string &sStore, const string &sValueName, const string &sValue )
+    {
+        USERDATAKEY Key( iOwner, sStore, sValueName );
+        StoreValue( Key, sValue );
+        MarkFetchesStale( Key );
+
+        PENDINGWRITE &rWrite = PendingWrites[ Key ];
+        rWrite.iReference = iReference;
+        rWrite.sValue = sValue;
+    }
+
+    void Invalidate( int iOwner, const string &sStore, const string &sValueName )
+    {
+        USERDATAKEY Key( iOwner, sStore, sValueName );
+        CachedValues.erase( Key );
+        MarkFetchesStale( Key );
+    }
+
+    static void SendBatch( const string &sEntries )
+    {
+        string sMessage = sBatchStart + sEntries + sBatchEnd;
+        DEBUG(  "Sending to server " << sMessage );
+        SocketMetaverseServer.Send( sMessage.c_str(), sMessage.size() );
+    }
+
+    void FlushWrites()
+    {
+        if( PendingWrites.empty() )
+        {
+            return;
+        }
+
+        string sEntries = "";
+        for( map< USERDATAKEY, PENDINGWRITE >::iterator iterator = PendingWrites.begin(); iterator != PendingWrites.end(); iterator++ )
+        {
+            TiXmlElement Entry( "setinfo" );
+            Entry.SetAttribute( "type", "DBUSERDATA" );
+            Entry.SetAttribute( "ireference", iterator->second.iReference );
+            Entry.SetAttribute( "iowner", iterator->first.iOwner );
+            Entry.SetAttribute( "store", iterator->first.sStore.c_str() );
+            Entry.SetAttribute( "valuename", iterator->first.sValueName.c_str() );
+            Entry.SetAttribute( "value", iterator->second.sValue.c_str() );
+
+            ostringstream entrystream;
+            entrystream << Entry;
+            if( (int)entrystream.str().size() > iMaxBatchEntriesLength )
+            {
+                WARNING( "user data value " << iterator->first.sValueName << " of object " << iterator->second.iReference
+                         << " too long to store (" << entrystream.str().size() << " bytes), dropped" );
+                continue;
+            }
+            if( sEntries != "" && (int)( sEntries.size() + entrystream.str().size() ) > iMaxBatchEntriesLength )
+            {
+                SendBatch( sEntries );
+                sEntries = "";
+            }
+            sEntries += entrystream.str();
+        }
+        if( sEntries != "" )
+        {
+            SendBatch( sEntries );
+        }
+
+        PendingWrites.clear();
+    }
+}
@@ -0,0 +1,47 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Engine-side cache of script database user data, in front of the setinfo/requestinfo round trips
+
+// see LuaUserDataCache.cpp for documentation
+
+#ifndef _LUAUSERDATACACHE_H
+#define _LUAUSERDATACACHE_H
+
+#include <string>
+using namespace std;
+
+//! \brief Engine-side cache of script database user data, in front of the setinfo/requestinfo round trips
+//!
+//! Programming standards:
+//! - None of these functions should be directly callable by Lua scripts
+//! - None of these functions should lock or unlock mutexes; callers hold EngineMutex
+namespace LuaUserDataCache
+{
+    bool Lookup( int iOwner, const string &sStore, const string &sValueName, string &sValue );   //!< returns true and sets sValue if the value is cached
+    void NoteFetch( int iOwner, const string &sStore, const string &sValueName );   //!< call when sending a requestinfo for a value that wasnt cached
+    void StoreFetchResult( int iOwner, const string &sStore, const string &sValueName, const string &sValue );   //!< call with each DBUSERDATA inforesponse
+    void Write( int iReference, int iOwner, const string &sStore, const string &sValueName, const string &sValue );   //!< caches a write from object iReference, and queues it for the next FlushWrites
+    void Invalidate( int iOwner, const string &sStore, const string &sValueName );   //!< drops a cached value that was changed elsewhere
+    void FlushWrites();   //!< sends all queued writes to the server, batched; call once per frame
+}
+
+#endif // _LUAUSERDATACACHE_H
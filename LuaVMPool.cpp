@@ -0,0 +1,533 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Pool of Lua script threads, all sharing one state that holds the OSMP API
+//!
+//! The scripting engine used to lua_open a brand new VM, and register every OSMP API function
+//! into it one by one, each time an object got a script, and lua_close it (or leak it) when the
+//! script changed or the object was deleted.  Now there is one Lua state, made the first time
+//! a VM is asked for, that has the base libraries and RegisterLuaStandardFunctions loaded into it
+//! once.  Each script's "VM" is a lua_newthread of that state: a stack of its own, sharing the
+//! API, the registry and the garbage collector with every other script.  This module keeps a free
+//! list of those threads that already have their globals set up.
+//!
+//! Layout:
+//! - the globals table of the shared state, which the libraries and RegisterLuaStandardFunctions
+//!   filled in, is the API table.  It is stored in the registry and never visible to scripts directly
+//! - each script thread gets its own, initially empty, globals table whose metatable has
+//!   __index = the script's handlers table, which in turn falls back on the API table.
+//!   The metatable is protected with __metatable, so scripts can read the API but cannot reach
+//!   or replace it
+//! - tables in the API, such as math and coroutine, are read-only: each script's handlers table
+//!   holds an empty proxy for each, whose metatable, shared by all scripts, has __index = the
+//!   real table, a __newindex that raises an error, and __metatable.  A rawset on a proxy only
+//!   changes that script's proxy, which goes at the next recycle.  The API has no tables nested
+//!   deeper than that, so proxies are only made one level down
+//! - globals named in SetHandlerNames, the event handlers, never go into the globals table
+//!   itself.  Its __newindex puts them in the handlers table, under both their name and their
+//!   number, so every assignment to one, at load time or later, is seen, and PushHandler finds
+//!   the current function by number without a lookup by name
+//! - the registry table osmp.scripts holds a record for each script thread, keyed by the lua_State
+//!   as a light userdata: the thread itself, so it isnt collected while pooled or in use, the
+//!   handlers table, and iReference, the object the script belongs to.  The globals metatable
+//!   points at the record too, so coroutines a script makes, which share its globals, find it
+//! - Lua 5.0 has no separate environment for C functions: LUA_GLOBALSINDEX in a C function is the
+//!   globals table of the thread calling it, which is the script's table.  API functions that look
+//!   up globals therefore see the script's own globals first, and reach the API through __index
+//!
+//! Recycling a VM therefore just gives the thread fresh globals and handlers tables and clears its
+//! stack and iReference; what the script left behind is collected incrementally, as normal.
+//!
+//! lua_getgccount counts the whole shared state, so per-VM memory is what the state holds beyond
+//! the API, divided by the number of VMs.  ReportCreationCost, run from scriptingenginelua -vmreport,
+//! compares what a VM costs made the old way, with lua_open and every Register* call per object,
+//! against one handed out by the pool.
+//!
+//! Threads of one state mustnt run at the same time, since this Lua isnt built with lua_lock;
+//! the scripting engine runs them all under EngineMutex, see ChildThreadFunction.
+//!
+//! The pool doesnt know whether a VM is running an event.  The scripting engine mustnt release a VM
+//! whose event thread is still inside lua_pcall; it leaves it to that thread, see ChildThreadFunction.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <set>
+#include <vector>
+using namespace std;
+
+extern "C"
+{
+#include <lua.h>
+   #include "lauxlib.h"
+   #include "lualib.h"
+}
+
+#include "Diag.h"
+#include "TickCount.h"
+#include "LuaScriptingAPI.h"
+#include "LuaScriptingAPIHelper.h"
+#include "LuaVMPool.h"
+
+namespace LuaVMPool
+{
+    const int iMaxFreeVMs = 256;   //!< VMs beyond this many in the free list are dropped instead of pooled
+
+    const char *sAPITableKey = "osmp.api";   //!< registry key of the shared API table
+    const char *sHandlersMetatableKey = "osmp.handlersmeta";   //!< registry key of the metatable given to each handlers table
+    const char *sHandlerNumbersKey = "osmp.handlernumbers";   //!< registry key of the table of handler names to handler numbers
+    const char *sSetGlobalKey = "osmp.setglobal";   //!< registry key of SetGlobal, shared by every globals metatable
+    const char *sReadOnlyMetatablesKey = "osmp.readonlymetas";   //!< registry key of the table of API table names to their proxies' metatable
+    const char *sScriptsKey = "osmp.scripts";   //!< registry key of the table of script thread records
+    const char *sScriptKey = "osmp.script";   //!< key of the script thread record in its globals metatable
+
+    vector < const char * > HandlerNames;   //!< globals kept in the handlers table; see SetHandlerNames
+
+    lua_State *pSharedState = NULL;   //!< holds the API, and every script thread
+    int iSharedStateKBytes = 0;   //!< lua_getgccount of the shared state once the API was loaded
+
+    vector < lua_State * > FreeVMs;   //!< initialized script threads not currently assigned to an object
+    set < lua_State * > VMsInUse;   //!< script threads currently assigned to an object
+
+    int iNumVMsCreated = 0;   //!< total lua_newthread calls, for diagnostics
+    int iNumVMsReused = 0;    //!< total acquisitions served from the free list, for diagnostics
+
+    //! __newindex of script globals tables: t, k, v.  Event handlers go in the handlers table, everything else in t
+    static int SetGlobal( lua_State *pluaVM )
+    {
+        if( lua_type( pluaVM, 2 ) == LUA_TSTRING )
+        {
+            lua_pushstring( pluaVM, sHandlerNumbersKey );
+            lua_rawget( pluaVM, LUA_REGISTRYINDEX );
+            lua_pushvalue( pluaVM, 2 );
+            lua_rawget( pluaVM, -2 );
+            if( lua_type( pluaVM, -1 ) == LUA_TNUMBER && lua_getmetatable( pluaVM, 1 ) )
+            {
+                int iHandler = (int)lua_tonumber( pluaVM, -2 );
+                lua_pushliteral( pluaVM, "__index" );
+                lua_rawget( pluaVM, -2 );
+                lua_pushvalue( pluaVM, 2 );
+                lua_pushvalue( pluaVM, 3 );
+                lua_rawset( pluaVM, -3 );
+                lua_pushvalue( pluaVM, 3 );
+                lua_rawseti( pluaVM, -2, iHandler );
+                return 0;
+            }
+            lua_settop( pluaVM, 3 );
+        }
+        lua_rawset( pluaVM, 1 );
+        return 0;
+    }
+
+    //! __newindex of the read-only API table proxies
+    static int ReadOnlyAPI( lua_State *pluaVM )
+    {
+        lua_pushliteral( pluaVM, "OSMP API tables are read-only" );
+        lua_error( pluaVM );
+        return 0;
+    }
+
+    //! opens the shared state, loads libraries and OSMP API into it, and makes the registry entries scripts need
+    static void CreateSharedState()
+    {
+        pSharedState = lua_open();
+
+        if( NULL == pSharedState )
+        {
+            printf("Error Initializing lua\n" );
+            exit(1);
+        }
+        lua_State *pluaVM = pSharedState;
+        luaopen_math( pluaVM );
+        luaopen_base( pluaVM);
+
+        RegisterLuaStandardFunctions( pluaVM );
+        lua_settop( pluaVM, 0 );
+
+        lua_pushstring( pluaVM, sAPITableKey );
+        lua_pushvalue( pluaVM, LUA_GLOBALSINDEX );
+        lua_rawset( pluaVM, LUA_REGISTRYINDEX );
+
+        lua_pushstring( pluaVM, sHandlersMetatableKey );
+        lua_newtable( pluaVM );
+        lua_pushliteral( pluaVM, "__index" );
+        lua_pushvalue( pluaVM, LUA_GLOBALSINDEX );
+        lua_rawset( pluaVM, -3 );
+        lua_rawset( pluaVM, LUA_REGISTRYINDEX );
+
+        lua_pushstring( pluaVM, sHandlerNumbersKey );
+        lua_newtable( pluaVM );
+        for( int i = 0; i < (int)HandlerNames.size(); i++ )
+        {
+            if( HandlerNames[i] != NULL )
+            {
+                lua_pushstring( pluaVM, HandlerNames[i] );
+                lua_pushnumber( pluaVM, i );
+                lua_rawset( pluaVM, -3 );
+            }
+        }
+        lua_rawset( pluaVM, LUA_REGISTRYINDEX );
+
+        lua_pushstring( pluaVM, sSetGlobalKey );
+        lua_pushcfunction( pluaVM, SetGlobal );
+        lua_rawset( pluaVM, LUA_REGISTRYINDEX );
+
+        lua_pushstring( pluaVM, sScriptsKey );
+        lua_newtable( pluaVM );
+        lua_rawset( pluaVM, LUA_REGISTRYINDEX );
+
+        // one proxy metatable for each table in the API, other than _G
+        lua_pushvalue( pluaVM, LUA_GLOBALSINDEX );
+        int iAPITable = lua_gettop( pluaVM );
+        lua_pushstring( pluaVM, sReadOnlyMetatablesKey );
+        lua_newtable( pluaVM );
+        int iReadOnlyMetatables = lua_gettop( pluaVM );
+        lua_pushnil( pluaVM );
+        while( lua_next( pluaVM, iAPITable ) != 0 )
+        {
+            if( lua_type( pluaVM, -2 ) == LUA_TSTRING && lua_type( pluaVM, -1 ) == LUA_TTABLE
+                && !lua_rawequal( pluaVM, -1, iAPITable ) )
+            {
+                lua_pushvalue( pluaVM, -2 );
+                lua_newtable( pluaVM );
+                lua_pushliteral( pluaVM, "__index" );
+                lua_pushvalue( pluaVM, -4 );
+                lua_rawset( pluaVM, -3 );
+                lua_pushliteral( pluaVM, "__newindex" );
+                lua_pushcfunction( pluaVM, ReadOnlyAPI );
+                lua_rawset( pluaVM, -3 );
+                lua_pushliteral( pluaVM, "__metatable" );
+                lua_pushboolean( pluaVM, 0 );
+                lua_rawset( pluaVM, -3 );
+                lua_rawset( pluaVM, iReadOnlyMetatables );
+            }
+            lua_pop( pluaVM, 1 );
+        }
+        lua_rawset( pluaVM, LUA_REGISTRYINDEX );
+        lua_settop( pluaVM, 0 );
+
+        iSharedStateKBytes = lua_getgccount( pluaVM );
+    }
+
+    //! replaces the globals table of script thread pluaVM with a new empty table, and its handlers table
+    //! with another, falling back on the API table and holding fresh proxies of the API's tables
+    static void InstallFreshGlobals( lua_State *pluaVM )
+    {
+        PushScriptTable( pluaVM );
+        int iScript = lua_gettop( pluaVM );
+
+        lua_newtable( pluaVM );
+        int iHandlers = lua_gettop( pluaVM );
+        lua_pushstring( pluaVM, sHandlersMetatableKey );
+        lua_rawget( pluaVM, LUA_REGISTRYINDEX );
+        lua_setmetatable( pluaVM, iHandlers );
+
+        lua_pushstring( pluaVM, sReadOnlyMetatablesKey );
+        lua_rawget( pluaVM, LUA_REGISTRYINDEX );
+        int iReadOnlyMetatables = lua_gettop( pluaVM );
+        lua_pushnil( pluaVM );
+        while( lua_next( pluaVM, iReadOnlyMetatables ) != 0 )
+        {
+            lua_pushvalue( pluaVM, -2 );
+            lua_newtable( pluaVM );
+            lua_pushvalue( pluaVM, -3 );
+            lua_setmetatable( pluaVM, -2 );
+            lua_rawset( pluaVM, iHandlers );
+            lua_pop( pluaVM, 1 );
+        }
+        lua_pop( pluaVM, 1 );
+
+        lua_pushliteral( pluaVM, "handlers" );
+        lua_pushvalue( pluaVM, iHandlers );
+        lua_rawset( pluaVM, iScript );
+
+        lua_newtable( pluaVM );
+        int iGlobalsMetatable = lua_gettop( pluaVM );
+        lua_pushliteral( pluaVM, "__index" );
+        lua_pushvalue( pluaVM, iHandlers );
+        lua_rawset( pluaVM, iGlobalsMetatable );
+        lua_pushliteral( pluaVM, "__newindex" );
+        lua_pushstring( pluaVM, sSetGlobalKey );
+        lua_rawget( pluaVM, LUA_REGISTRYINDEX );
+        lua_rawset( pluaVM, iGlobalsMetatable );
+        lua_pushliteral( pluaVM, "__metatable" );
+        lua_pushboolean( pluaVM, 0 );
+        lua_rawset( pluaVM, iGlobalsMetatable );
+        lua_pushstring( pluaVM, sScriptKey );
+        lua_pushvalue( pluaVM, iScript );
+        lua_rawset( pluaVM, iGlobalsMetatable );
+
+        lua_newtable( pluaVM );
+        lua_pushvalue( pluaVM, iGlobalsMetatable );
+        lua_setmetatable( pluaVM, -2 );
+
+        lua_pushliteral( pluaVM, "_G" );
+        lua_pushvalue( pluaVM, -2 );
+        lua_rawset( pluaVM, -3 );
+
+        lua_replace( pluaVM, LUA_GLOBALSINDEX );
+        lua_settop( pluaVM, iScript - 1 );
+    }
+
+    //! makes a new script thread of the shared state, with its record and fresh globals
+    static lua_State *CreateVM()
+    {
+        if( pSharedState == NULL )
+        {
+            CreateSharedState();
+        }
+
+        lua_State *pluaVM = lua_newthread( pSharedState );
+
+        lua_pushstring( pSharedState, sScriptsKey );
+        lua_rawget( pSharedState, LUA_REGISTRYINDEX );
+        lua_pushlightuserdata( pSharedState, pluaVM );
+        lua_newtable( pSharedState );
+        lua_pushliteral( pSharedState, "thread" );
+        lua_pushvalue( pSharedState, -5 );
+        lua_rawset( pSharedState, -3 );
+        lua_rawset( pSharedState, -3 );
+        lua_pop( pSharedState, 2 );
+
+        InstallFreshGlobals( pluaVM );
+
+        iNumVMsCreated++;
+        return pluaVM;
+    }
+
+    //! drops the record of script thread pluaVM, so the thread and everything its script left are collected
+    static void CloseVM( lua_State *pluaVM )
+    {
+        lua_settop( pluaVM, 0 );
+
+        lua_pushstring( pSharedState, sScriptsKey );
+        lua_rawget( pSharedState, LUA_REGISTRYINDEX );
+        lua_pushlightuserdata( pSharedState, pluaVM );
+        lua_pushnil( pSharedState );
+        lua_rawset( pSharedState, -3 );
+        lua_pop( pSharedState, 1 );
+    }
+
+    //! clears everything a script left behind in pluaVM: stack, globals, handlers and iReference
+    static void WipeScriptState( lua_State *pluaVM )
+    {
+        lua_settop( pluaVM, 0 );
+
+        PushScriptTable( pluaVM );
+        lua_pushliteral( pluaVM, "iReference" );
+        lua_pushnil( pluaVM );
+        lua_rawset( pluaVM, -3 );
+        lua_pop( pluaVM, 1 );
+
+        InstallFreshGlobals( pluaVM );
+    }
+
+    void SetHandlerNames( const char * const *psNames, int iNumNames )
+    {
+        HandlerNames.assign( psNames, psNames + iNumNames );
+    }
+
+    void PushScriptTable( lua_State *pluaVM )
+    {
+        lua_pushstring( pluaVM, sScriptsKey );
+        lua_rawget( pluaVM, LUA_REGISTRYINDEX );
+        if( lua_type( pluaVM, -1 ) == LUA_TTABLE )
+        {
+            lua_pushlightuserdata( pluaVM, pluaVM );
+            lua_rawget( pluaVM, -2 );
+            lua_remove( pluaVM, -2 );
+            if( lua_type( pluaVM, -1 ) == LUA_TTABLE )
+            {
+                return;
+            }
+        }
+        lua_pop( pluaVM, 1 );
+
+        // not a script thread itself; maybe a coroutine of one, sharing its globals
+        if( lua_getmetatable( pluaVM, LUA_GLOBALSINDEX ) )
+        {
+            lua_pushstring( pluaVM, sScriptKey );
+            lua_rawget( pluaVM, -2 );
+            lua_remove( pluaVM, -2 );
+            if( lua_type( pluaVM, -1 ) == LUA_TTABLE )
+            {
+                return;
+            }
+            lua_pop( pluaVM, 1 );
+        }
+        lua_pushnil( pluaVM );
+    }
+
+    void PushHandler( lua_State *pluaVM, int iHandler )
+    {
+        PushScriptTable( pluaVM );
+        if( lua_type( pluaVM, -1 ) != LUA_TTABLE )
+        {
+            return;
+        }
+        lua_pushliteral( pluaVM, "handlers" );
+        lua_rawget( pluaVM, -2 );
+        lua_rawgeti( pluaVM, -1, iHandler );
+        lua_replace( pluaVM, -3 );
+        lua_pop( pluaVM, 1 );
+    }
+
+    void Prewarm( int iNumVMs )
+    {
+        DEBUG( "LuaVMPool::Prewarm() creating " << iNumVMs << " VMs" ); // DEBUG
+        for( int i = 0; i < iNumVMs && (int)FreeVMs.size() < iMaxFreeVMs; i++ )
+        {
+            FreeVMs.push_back( CreateVM() );
+        }
+    }
+
+    lua_State *AcquireVM( int iObjectReference )
+    {
+        lua_State *pluaVM = NULL;
+        if( FreeVMs.size() > 0 )
+        {
+            pluaVM = FreeVMs.back();
+            FreeVMs.pop_back();
+            iNumVMsReused++;
+        }
+        else
+        {
+            pluaVM = CreateVM();
+        }
+        VMsInUse.insert( pluaVM );
+
+        LuaScriptingAPIHelper::AddObjectReferenceToVMRegistry( iObjectReference, pluaVM );
+        return pluaVM;
+    }
+
+    void RecycleVM( lua_State *pluaVM, int iObjectReference )
+    {
+        DEBUG( "LuaVMPool::RecycleVM() for object " << iObjectReference ); // DEBUG
+        WipeScriptState( pluaVM );
+        LuaScriptingAPIHelper::AddObjectReferenceToVMRegistry( iObjectReference, pluaVM );
+        iNumVMsReused++;
+    }
+
+    void ReleaseVM( lua_State *pluaVM )
+    {
+        if( pluaVM == NULL || VMsInUse.find( pluaVM ) == VMsInUse.end() )
+        {
+            return;
+        }
+        VMsInUse.erase( pluaVM );
+
+        if( (int)FreeVMs.size() < iMaxFreeVMs )
+        {
+            WipeScriptState( pluaVM );
+            FreeVMs.push_back( pluaVM );
+        }
+        else
+        {
+            CloseVM( pluaVM );
+        }
+    }
+
+    void ReportMemoryUsage()
+    {
+        long lScriptKBytes = 0;
+        if( pSharedState != NULL )
+        {
+            lScriptKBytes = lua_getgccount( pSharedState ) - iSharedStateKBytes;
+        }
+
+        long lBytesPerVM = 0;
+        int iNumVMs = (int)( VMsInUse.size() + FreeVMs.size() );
+        if( iNumVMs > 0 )
+        {
+            lBytesPerVM = lScriptKBytes * 1024 / iNumVMs;
+        }
+
+        INFO( "LuaVMPool: " << VMsInUse.size() << " VMs in use, " << FreeVMs.size() << " VMs free; API "
+              << iSharedStateKBytes << " KB once, scripts " << lScriptKBytes << " KB, " << lBytesPerVM
+              << " bytes per VM, including garbage not yet collected; "
+              << iNumVMsCreated << " created, " << iNumVMsReused << " reused" );
+    }
+
+    // Description: makes iNumVMs VMs as the engine did before the pool, then has iNumVMs objects take a
+    //              VM from the pool, and prints the memory and time per VM of each.  The pooled VMs
+    //              are handed back and taken again, as happens when scripts are reassigned, so both
+    //              a first acquisition and a reuse are timed.  Memory of the pooled VMs is the growth
+    //              of the shared state between two full collections, so it excludes the API, which
+    //              is printed separately.  Run it before Prewarm, so that every VM is a new one
+    void ReportCreationCost( int iNumVMs )
+    {
+        vector < lua_State * > OldStyleVMs;
+        int iStartTickCount = MVGetTickCount();
+        for( int i = 0; i < iNumVMs; i++ )
+        {
+            lua_State *pluaVM = lua_open();
+            luaopen_math( pluaVM );
+            luaopen_base( pluaVM);
+            RegisterLuaStandardFunctions( pluaVM );
+            lua_settop( pluaVM, 0 );
+            OldStyleVMs.push_back( pluaVM );
+        }
+        int iOldStyleMilliseconds = MVGetTickCount() - iStartTickCount;
+        long lOldStyleKBytes = 0;
+        for( int i = 0; i < iNumVMs; i++ )
+        {
+            lOldStyleKBytes += lua_getgccount( OldStyleVMs[i] );
+            lua_close( OldStyleVMs[i] );
+        }
+
+        if( pSharedState == NULL )
+        {
+            CreateSharedState();
+        }
+        lua_setgcthreshold( pSharedState, 0 );
+        long lBaselineKBytes = lua_getgccount( pSharedState );
+
+        vector < lua_State * > PooledVMs;
+        iStartTickCount = MVGetTickCount();
+        for( int i = 0; i < iNumVMs; i++ )
+        {
+            PooledVMs.push_back( AcquireVM( i + 1 ) );
+        }
+        int iAcquireMilliseconds = MVGetTickCount() - iStartTickCount;
+        lua_setgcthreshold( pSharedState, 0 );
+        long lPooledKBytes = lua_getgccount( pSharedState ) - lBaselineKBytes;
+
+        iStartTickCount = MVGetTickCount();
+        for( int i = 0; i < iNumVMs; i++ )
+        {
+            RecycleVM( PooledVMs[i], i + 1 );
+        }
+        int iRecycleMilliseconds = MVGetTickCount() - iStartTickCount;
+
+        for( int i = 0; i < iNumVMs; i++ )
+        {
+            ReleaseVM( PooledVMs[i] );
+        }
+
+        if( iNumVMs > 0 )
+        {
+            printf( "%i VMs, lua_open and Register* per VM: %li bytes per VM, %.3f ms per VM\n", iNumVMs,
+                    lOldStyleKBytes * 1024 / iNumVMs, (float)iOldStyleMilliseconds / (float)iNumVMs );
+            printf( "%i VMs, from LuaVMPool: %li bytes per VM plus %li bytes of API once, %.3f ms per VM first time, %.3f ms per VM reused\n", iNumVMs,
+                    lPooledKBytes * 1024 / iNumVMs, (long)iSharedStateKBytes * 1024,
+                    (float)iAcquireMilliseconds / (float)iNumVMs, (float)iRecycleMilliseconds / (float)iNumVMs );
+        }
+    }
+}
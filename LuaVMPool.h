@@ -0,0 +1,58 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Pool of Lua script threads, all sharing one state that holds the OSMP API
+
+// see LuaVMPool.cpp for documentation
+
+#ifndef _LUAVMPOOL_H
+#define _LUAVMPOOL_H
+
+extern "C"
+{
+#include <lua.h>
+}
+
+//! \brief Pool of Lua script threads, all sharing one state that holds the OSMP API
+//!
+//! The base libraries and the whole OSMP scripting API are loaded once, into one shared Lua state,
+//! and hidden behind each script's globals table via an __index metatable; the API's own tables are
+//! read-only to scripts.  Each script's VM is a lua_newthread of that state, so handing a VM to a new
+//! script only needs a fresh, empty globals table, and scripts no longer pay for lua_open plus every
+//! Register* call, nor hold a copy of the API each.
+//!
+//! Programming standards:
+//! - None of these functions should be directly callable by Lua scripts
+//! - None of these functions should lock or unlock mutexes; callers hold EngineMutex
+namespace LuaVMPool
+{
+    void SetHandlerNames( const char * const *psNames, int iNumNames );   //!< globals with these names, NULLs skipped, are handlers that PushHandler can fetch by position; call before any VM is made
+    void PushScriptTable( lua_State *pluaVM );   //!< pushes the record of the script running in thread pluaVM, which holds iReference, or nil
+    void PushHandler( lua_State *pluaVM, int iHandler );   //!< pushes the value the running script last gave global HandlerNames[iHandler], or nil
+    void Prewarm( int iNumVMs );   //!< creates iNumVMs initialized VMs and places them in the free list
+    lua_State *AcquireVM( int iObjectReference );   //!< returns a VM with empty globals, registered to object iObjectReference
+    void RecycleVM( lua_State *pluaVM, int iObjectReference );   //!< wipes script state from an in-use VM, so it can run a new script for iObjectReference
+    void ReleaseVM( lua_State *pluaVM );   //!< returns an in-use VM to the pool, or drops it for collection if the pool is full
+    void ReportMemoryUsage();   //!< writes VM counts, the shared API's memory usage and per-VM memory usage to the INFO log
+    void ReportCreationCost( int iNumVMs );   //!< prints memory and time per VM for iNumVMs VMs made without and with the pool
+}
+
+#endif // _LUAVMPOOL_H
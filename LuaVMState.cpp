@@ -0,0 +1,210 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Saves and restores the data held in a script's globals, for moving a script between VMs
+//!
+//! Used when the metaverseserver moves an object's script from one scripting engine process
+//! to another.  The state is written as a Lua chunk returning a table of the script's globals,
+//! eg: return {["count"]=3,["name"]="door",["open"]=true,["pos"]={["x"]=1.5}}
+//!
+//! Only data is saved: numbers, strings, booleans, and tables of those, up to iMaxTableDepth deep.
+//! Functions are not saved; the new VM gets them by running the script itself.
+//! The output uses printable ASCII only, with no line breaks, so it can travel in an XML IPC attribute.
+//!
+//! Scripts see only their own globals table; the API lives behind its __index, see LuaVMPool.cpp,
+//! so walking the globals table doesnt pick up API functions.
+
+#include <stdio.h>
+#include <sstream>
+using namespace std;
+
+extern "C"
+{
+#include <lua.h>
+   #include "lauxlib.h"
+}
+
+#include "LuaVMState.h"
+
+namespace LuaVMState
+{
+    const int iMaxTableDepth = 8;   //!< nested tables deeper than this are not saved
+
+    static void WriteQuotedString( ostringstream &out, const char *sValue, size_t iLength )
+    {
+        out << '"';
+        for( size_t i = 0; i < iLength; i++ )
+        {
+            unsigned char c = (unsigned char)sValue[i];
+            if( c == '"' || c == '\\' )
+            {
+                out << '\\' << c;
+            }
+            else if( c < 32 || c >= 127 )
+            {
+                char sEscape[8];
+                sprintf( sEscape, "\\%03i", c );
+                out << sEscape;
+            }
+            else
+            {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    //! writes the number, string or boolean at iIndex to out; returns false if it isnt one of those
+    static bool WriteSimpleValue( lua_State *pluaVM, int iIndex, ostringstream &out )
+    {
+        switch( lua_type( pluaVM, iIndex ) )
+        {
+        case LUA_TNUMBER:
+            {
+                lua_Number Value = lua_tonumber( pluaVM, iIndex );
+                if( Value != Value || Value - Value != 0 )
+                {
+                    // nan or infinity, which have no literal
+                    return false;
+                }
+                char sNumber[32];
+                sprintf( sNumber, "%.17g", (double)Value );
+                out << sNumber;
+                return true;
+            }
+        case LUA_TSTRING:
+            WriteQuotedString( out, lua_tostring( pluaVM, iIndex ), lua_strlen( pluaVM, iIndex ) );
+            return true;
+        case LUA_TBOOLEAN:
+            out << ( lua_toboolean( pluaVM, iIndex ) ? "true" : "false" );
+            return true;
+        }
+        return false;
+    }
+
+    static bool WriteValue( lua_State *pluaVM, int iIndex, ostringstream &out, int iDepth );
+
+    //! writes the entries of the table at iIndex (a positive index) to out, as a table constructor
+    static void WriteTable( lua_State *pluaVM, int iIndex, ostringstream &out, int iDepth )
+    {
+        out << '{';
+        bool bFirst = true;
+        lua_pushnil( pluaVM );
+        while( lua_next( pluaVM, iIndex ) != 0 )
+        {
+            // key at -2, value at -1
+            ostringstream entry;
+            entry << '[';
+            if( WriteSimpleValue( pluaVM, -2, entry ) )
+            {
+                entry << "]=";
+                if( WriteValue( pluaVM, lua_gettop( pluaVM ), entry, iDepth ) )
+                {
+                    if( !bFirst )
+                    {
+                        out << ',';
+                    }
+                    out << entry.str();
+                    bFirst = false;
+                }
+            }
+            lua_pop( pluaVM, 1 );
+        }
+        out << '}';
+    }
+
+    //! writes the value at iIndex (a positive index) to out; returns false if it cant be saved
+    static bool WriteValue( lua_State *pluaVM, int iIndex, ostringstream &out, int iDepth )
+    {
+        if( lua_type( pluaVM, iIndex ) == LUA_TTABLE )
+        {
+            if( iDepth >= iMaxTableDepth )
+            {
+                return false;
+            }
+            WriteTable( pluaVM, iIndex, out, iDepth + 1 );
+            return true;
+        }
+        return WriteSimpleValue( pluaVM, iIndex, out );
+    }
+
+    void SaveState( lua_State *pluaVM, string &sState )
+    {
+        ostringstream out;
+        out << "return {";
+        bool bFirst = true;
+
+        lua_pushnil( pluaVM );
+        while( lua_next( pluaVM, LUA_GLOBALSINDEX ) != 0 )
+        {
+            // _G, and anything else pointing back at the globals table, is recreated with the VM
+            lua_pushvalue( pluaVM, LUA_GLOBALSINDEX );
+            bool bIsGlobalsTable = lua_rawequal( pluaVM, -1, -2 ) != 0;
+            lua_pop( pluaVM, 1 );
+
+            if( !bIsGlobalsTable )
+            {
+                ostringstream entry;
+                entry << '[';
+                if( WriteSimpleValue( pluaVM, -2, entry ) )
+                {
+                    entry << "]=";
+                    if( WriteValue( pluaVM, lua_gettop( pluaVM ), entry, 0 ) )
+                    {
+                        if( !bFirst )
+                        {
+                            out << ',';
+                        }
+                        out << entry.str();
+                        bFirst = false;
+                    }
+                }
+            }
+            lua_pop( pluaVM, 1 );
+        }
+
+        out << '}';
+        sState = out.str();
+    }
+
+    bool RestoreState( lua_State *pluaVM, const string &sState )
+    {
+        int iTop = lua_gettop( pluaVM );
+        if( luaL_loadbuffer( pluaVM, sState.c_str(), sState.size(), "=migratedstate" ) != 0
+                || lua_pcall( pluaVM, 0, 1, 0 ) != 0
+                || lua_type( pluaVM, -1 ) != LUA_TTABLE )
+        {
+            lua_settop( pluaVM, iTop );
+            return false;
+        }
+
+        int iStateTable = lua_gettop( pluaVM );
+        lua_pushnil( pluaVM );
+        while( lua_next( pluaVM, iStateTable ) != 0 )
+        {
+            lua_pushvalue( pluaVM, -2 );
+            lua_insert( pluaVM, -2 );
+            lua_rawset( pluaVM, LUA_GLOBALSINDEX );
+        }
+        lua_settop( pluaVM, iTop );
+        return true;
+    }
+}
@@ -0,0 +1,48 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Saves and restores the data held in a script's globals, for moving a script between VMs
+
+// see LuaVMState.cpp for documentation
+
+#ifndef _LUAVMSTATE_H
+#define _LUAVMSTATE_H
+
+#include <string>
+using namespace std;
+
+extern "C"
+{
+#include <lua.h>
+}
+
+//! \brief Saves and restores the data held in a script's globals, for moving a script between VMs
+//!
+//! Programming standards:
+//! - None of these functions should be directly callable by Lua scripts
+//! - None of these functions should lock or unlock mutexes; callers hold EngineMutex
+namespace LuaVMState
+{
+    void SaveState( lua_State *pluaVM, string &sState );   //!< writes the data globals of the script in pluaVM to sState
+    bool RestoreState( lua_State *pluaVM, const string &sState );   //!< sets the globals saved in sState into the script in pluaVM; returns false on a malformed state
+}
+
+#endif // _LUAVMSTATE_H
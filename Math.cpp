@@ -28,6 +28,7 @@
 using namespace std;
 
 #include "Math.h"
+#include "XmlHelper.h"
 
 #include "Diag.h"
 
@@ -42,6 +43,85 @@ void RotMultiply( Rot &Qr, const Rot &Q1, const Rot &Q2 )
     //DEBUG(  "RotMULITPLY in=" << Q1 << " " << Q2 << " out=" << Qr <<endl;
 }
 
+// Input: From, To: rotations to slerp between
+//        fFraction: how far from From to To
+//
+// Returns: rResult, the interpolated rotation
+//
+// Description: Slerps the short way round: if From and To are more than half a turn apart as 4-vectors,
+//              To is negated, which is the same rotation
+void RotSlerp( Rot &rResult, const Rot &From, const Rot &To, const float fFraction )
+{
+    float fCosAngle = From.x * To.x + From.y * To.y + From.z * To.z + From.s * To.s;
+    float fToSign = 1;
+    if( fCosAngle < 0 )
+    {
+        fCosAngle = -fCosAngle;
+        fToSign = -1;
+    }
+    float fFromWeight = 1 - fFraction;
+    float fToWeight = fFraction;
+    if( fCosAngle < 0.9995 )
+    {
+        float fAngle = acos( fCosAngle );
+        float fInverseSine = 1 / sin( fAngle );
+        fFromWeight = sin( ( 1 - fFraction ) * fAngle ) * fInverseSine;
+        fToWeight = sin( fFraction * fAngle ) * fInverseSine;
+    }
+    fToWeight *= fToSign;
+    rResult.x = fFromWeight * From.x + fToWeight * To.x;
+    rResult.y = fFromWeight * From.y + fToWeight * To.y;
+    rResult.z = fFromWeight * From.z + fToWeight * To.z;
+    rResult.s = fFromWeight * From.s + fToWeight * To.s;
+}
+
+// Input: ClipMatrix: projection matrix times modelview matrix, column-major as glGetFloatv returns them
+//
+// Returns: Frustum, in world coordinates if the modelview is just the camera
+//
+// Description: Each plane is the fourth row of the matrix plus or minus one of the others (Gribb and Hartmann);
+//              planes are normalized so Distances are in world units
+void FrustumFromClipMatrix( VIEWFRUSTUM &Frustum, const float *ClipMatrix )
+{
+    for( int iPlane = 0; iPlane < 6; iPlane++ )
+    {
+        int iRow = iPlane / 2;
+        float fSign = ( iPlane % 2 == 0 ) ? 1.0f : -1.0f;
+        Vector3 Normal( ClipMatrix[3] + fSign * ClipMatrix[iRow], ClipMatrix[7] + fSign * ClipMatrix[4 + iRow],
+                        ClipMatrix[11] + fSign * ClipMatrix[8 + iRow] );
+        float fDistance = ClipMatrix[15] + fSign * ClipMatrix[12 + iRow];
+        float fMagnitude = VectorMag( Normal );
+        if( fMagnitude > 0 )
+        {
+            Normal = Normal / fMagnitude;
+            fDistance /= fMagnitude;
+        }
+        Frustum.Normals[iPlane] = Normal;
+        Frustum.Distances[iPlane] = fDistance;
+    }
+}
+
+// Input: Frustum: planes to test against
+//        Min, Max: opposite corners of an axis-aligned box
+//
+// Returns: false if the box is wholly outside any one plane, otherwise true
+//
+// Description: Tests only the corner furthest along each plane's normal, so it can say true for some boxes
+//              just outside the frustum's corners; that's fine for culling
+bool BoxInFrustum( const VIEWFRUSTUM &Frustum, const Vector3 &Min, const Vector3 &Max )
+{
+    for( int iPlane = 0; iPlane < 6; iPlane++ )
+    {
+        const Vector3 &Normal = Frustum.Normals[iPlane];
+        Vector3 FurthestCorner( Normal.x >= 0 ? Max.x : Min.x, Normal.y >= 0 ? Max.y : Min.y, Normal.z >= 0 ? Max.z : Min.z );
+        if( VectorDot( Normal, FurthestCorner ) + Frustum.Distances[iPlane] < 0 )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 void VectorCross( Vector3 &vR, const Vector3 &v1, const Vector3 &v2 )
 {
     vR.x = v1.y * v2.z - v1.z * v2.y;
@@ -217,6 +297,13 @@ void Vector3::WriteToXMLElement( TiXmlElement *p_Element )
     DEBUG(  "Vector3::WriteToXMLElement p_Element.Attribute(x) = " << p_Element->Attribute("x") );
 }
 
+void Vector3::WriteToXMLWriter( XmlWriter &Writer ) const
+{
+    Writer.Attribute( "x", x );
+    Writer.Attribute( "y", y );
+    Writer.Attribute( "z", z );
+}
+
 Rot::Rot( const TiXmlElement *p_Element )
 {
     x = atof( p_Element->Attribute( "x" ) );
@@ -237,6 +324,14 @@ void Rot::WriteToXMLElement( TiXmlElement *p_Element )
     p_Element->SetDoubleAttribute( "s", s );
 }
 
+void Rot::WriteToXMLWriter( XmlWriter &Writer ) const
+{
+    Writer.Attribute( "x", x );
+    Writer.Attribute( "y", y );
+    Writer.Attribute( "z", z );
+    Writer.Attribute( "s", s );
+}
+
 ostream& operator<< (ostream& os, const Rot& rot)
 {
     //   DEBUG(  rot.x << " " << rot.y << " " << rot.z ); // DEBUG
@@ -40,6 +40,8 @@ using namespace std;
 
 #include "tinyxml.h"
 
+class XmlWriter;
+
 //! Rot contains a rotation, in x,y,z,s quaternion format; plus helper functions
 class Rot
 {
@@ -89,6 +91,9 @@ public:
    //! writes out to passed-in xml element in format <someelement x="..." y="..." z="..." s="..."/>
   void WriteToXMLElement( TiXmlElement *p_Element );
   
+   //! appends x,y,z,s attributes to the element just opened in Writer
+  void WriteToXMLWriter( XmlWriter &Writer ) const;
+  
   // writes out to ostream 
    friend ostream& operator<< ( ostream& os, const Rot& rot );
 };
@@ -136,6 +141,7 @@ public:
   //}
   
   void WriteToXMLElement( TiXmlElement *p_Element );  //!< writes out to passed-in xml element
+  void WriteToXMLWriter( XmlWriter &Writer ) const;  //!< appends x,y,z attributes to the element just opened in Writer
 };
 
 inline Vector3 Vector3::operator- ( const Vector3 &V2 ) const
@@ -193,6 +199,13 @@ const float PI = 3.1415926535f;
 const float TwoPI = 2.0*3.1415926535f;
 #endif
 
+//! View frustum, as six planes facing inwards, for culling; a point p is inside plane i if Normals[i] . p + Distances[i] >= 0
+struct VIEWFRUSTUM
+{
+   Vector3 Normals[6];
+   float Distances[6];
+};
+
 void RotMultiply( class Rot &Qr, const class Rot &Q1, const class Rot &Q2 );             //!< multiplies two rots
 float VectorMag( const Vector3 &V ); //!< returns magnitude of vector V
 void VectorCross( Vector3 &vR, const Vector3 &v1, const Vector3 &v2 );  //!< vR is crossproduct of v1 and v2
@@ -203,6 +216,9 @@ void AxisAngle2Rot( class Rot &Qr, const Vector3 &V, const float Theta );     //
 void Rot2AxisAngle(Vector3 &Vr, float &Thetar, const class Rot &R );      //!< converst from quaternion rotation to axis/angle rotation
 void AxisAngles2Rot(Rot &Qr, const Vector3 &V);
 void InverseRot( class Rot &RInverted, const class Rot &R );                   //!< inverts a quaternion rotatoin
+void RotSlerp( class Rot &rResult, const class Rot &From, const class Rot &To, const float fFraction );  //!< spherical interpolation from From to To, the short way round
+void FrustumFromClipMatrix( VIEWFRUSTUM &Frustum, const float *ClipMatrix );  //!< gets the frustum planes from a column-major (OpenGL order) projection * modelview matrix
+bool BoxInFrustum( const VIEWFRUSTUM &Frustum, const Vector3 &Min, const Vector3 &Max );  //!< returns false if the box from Min to Max is wholly outside the frustum
 //void MultiplyVectorByRot( Vector3 &vResult, const class Rot &Rot, const Vector3 &vector  ); //!< Multiplies Vector by Rot, returning in VectorResult
 //void MultiplyPosByRot( Vector3 &PosResult, const class Rot &Rot, const Vector3 &Pos  );  //!< Multiplies Pos by Rot, returning in PosResult
 //void MultiplyScaleByRot( Vector3 &ScaleResult, const class Rot &Rot, const Vector3 &Scale );  //!< Multiplies Scale by Rot, and returns in ScaleResult
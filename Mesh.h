@@ -42,6 +42,7 @@ public:
    	   DEBUG( "MESH::MESH" );
    	   sprintf( ObjectType, "PRIM" );
    	   sprintf( sDeepObjectType, "MESH" );
+   	   TypeTag = OBJECTTYPE_PRIM;
    	   sprintf( PrimType, "mvMd2Mesh" );
    	   color0.r = 0.8;
    	   color0.g = 0.2;
@@ -127,12 +127,14 @@ using namespace std;
 #include "ClientMeshFileMgmt.h"
 #include "MeshInfoCache.h"
 #include "Graphics.h"
+#include "StaticBatches.h"
 #include "Camera.h"
 #include "Collision.h"
 
 #include "Object.h"
 #include "ObjectGrouping.h"
 #include "Avatar.h"
+#include "Checksum.h"
 
 #include "MetaverseClient.h"
 
@@ -159,6 +161,7 @@ namespace MetaverseClient
     bool bSendKeepAlives = true;   //!< send avatar position as and when it changes?  can set to false for debugging (theres a commandline option for this)
 
     long LastAvPosUpdate;         //!< last tickcount(milliseconds) that av position update was sent
+    bool bAvatarMovedLastUpdate = false;   //!< true if the av was moving when the last position update was sent; we send one more when it stops
 
 #ifndef _NOVector3KEEPALIVE
 
@@ -184,6 +187,7 @@ namespace MetaverseClient
     MeshInfoCacheClass MeshInfoCache;  //!< stores information about available meshes
     ClientMeshFileMgmtClass MeshFileMgmt;  //!< manages upload/download of meshes
     mvGraphicsClass mvGraphics;  //!< wraps OpengL specific functions; also contains utility graphics functions
+    StaticBatchesClass StaticBatches( mvGraphics );  //!< draws prims that havent moved for a while in batches
     mvCameraClass Camera;   //!< manages camera movement, eg, orbit, pan etc
 
     Editing3DClass Editing3D;
@@ -317,13 +321,24 @@ namespace MetaverseClient
         RotMultiply( rAvatar, rTwist, rPitch );
 
 
+        // timestamp and velocity let other clients play us back smoothly between keepalives; see SnapshotInterpolation.cpp
+        Vector3 vVelocity( 0, 0, 0 );
+        Object *p_Avatar = World.GetObjectByReference( iMyReference );
+        if( p_Avatar != NULL && PlayerMovement.bAvatarMoved )
+        {
+            vVelocity = p_Avatar->vVelocity;
+        }
+
         ostringstream MessageStream;
         MessageStream << "<objectmove ireference=\"" << iMyReference << "\"><geometry>"
         << "<pos x=\"" << PlayerMovement.avatarxpos << "\" y=\"" << PlayerMovement.avatarypos << "\" z=\"0.0\" />"
         //<< AvRot
         << rAvatar
         << "</geometry>"
-        << "<dynamics><duration milliseconds=\"" << iSendMovesEvery << "\"/></dynamics></objectmove>\n";
+        << "<dynamics><duration milliseconds=\"" << iSendMovesEvery << "\"/>"
+        << "<timestamp milliseconds=\"" << MVGetTickCount() << "\"/>"
+        << "<velocity x=\"" << vVelocity.x << "\" y=\"" << vVelocity.y << "\" z=\"" << vVelocity.z << "\"/>"
+        << "</dynamics></objectmove>\n";
         string Message = MessageStream.str();
         DEBUG(  "avatar keepalive: " << Message.c_str() ); // DEBUG
         SendToServer( Message.c_str() );
@@ -346,7 +361,7 @@ namespace MetaverseClient
             ostringstream MessageStream;
             if( iArrayNum != -1 )
             {
-                if( strcmp( World.GetObject( iArrayNum )->ObjectType, "PRIM" ) == 0 )
+                if( World.GetObject( iArrayNum )->TypeTag == OBJECTTYPE_PRIM )
                 {
                     MessageStream << "<objectmove ireference=\"" << iReference << "\">"
                     << "<geometry>"
@@ -413,8 +428,9 @@ namespace MetaverseClient
         {
             if( MVGetTickCount() - LastAvPosUpdate > iSendMovesEvery )
             {
-                if( PlayerMovement.bAvatarMoved )
+                if( PlayerMovement.bAvatarMoved || bAvatarMovedLastUpdate )
                 {
+                    bAvatarMovedLastUpdate = PlayerMovement.bAvatarMoved;
                     SendAvatarKeepAlive();
                 }
 
@@ -472,6 +488,11 @@ namespace MetaverseClient
                     if( strcmp( pElement->Value(), "loaderfiledone" ) == 0 )
                     {
                         DEBUG(  "loaderfiledone command received from fileagent " ); // DEBUG
+                        if( pElement->Attribute("type") != NULL && strcmp( pElement->Attribute("type"), "TEXTURE" ) == 0
+                                && pElement->Attribute("checksum") != NULL )
+                        {
+                            RendererTexturing.DownloadFinished( pElement->Attribute("checksum") );
+                        }
                         if( strcmp( pElement->Attribute("result"), "SUCCESS" ) == 0 )
                         {
                             if( pElement->Attribute("oureditreference" ) == NULL )
@@ -600,6 +621,7 @@ namespace MetaverseClient
 
         HandleFileAgentInput();
         ProcessWorld();
+        RendererTexturing.UploadDecodedTextures();
     }
 
 } // namespace MetaverseClient
@@ -665,6 +687,10 @@ void InitMetaverseClient( CallbackToPythonClass &callbackobject )
 
     mvsocket::InitSocketSystem();
 
+    // so cached files aren't rehashed every time we start
+    string sChecksumCacheDirectory = mvConfig.CacheDirectory == "" ? "" : mvConfig.CacheDirectory + "/";
+    ChecksumCacheOpen( ( sChecksumCacheDirectory + "clientdata/cache/checksumcache.txt" ).c_str() );
+
     //if( mvConfig.CollisionAndPhysicsEngine != "" )
     //{
     //  DEBUG(  "loading collision and physics engine " << mvConfig.CollisionAndPhysicsEngine << " ..." ); // DEBUG
@@ -73,6 +73,7 @@ using namespace std;
 #include "Object.h"
 #include "ObjectGrouping.h"
 #include "Avatar.h"
+#include "Prim.h"
 
 #include "WorldStorage.h"
 #include "SocketsClass.h"
@@ -94,6 +95,11 @@ using namespace std;
 #include "SpawnWrap.h"
 #include "Collision.h"
 #include "Terrain.h"
+#include "ScriptingEngineShards.h"
+#include "FileManifest.h"
+#include "WorldChangeLog.h"
+#include "IPCMessages.h"
+#include "MoveSendScheduler.h"
 
 #define BUFSIZE 2047
 
@@ -104,6 +110,7 @@ float fSayDistance = 10.0;            //!< How far Says travel
 
 char ReadBuffer[4098];  //!< data buffer for socket reads
 char SendBuffer[BUFSIZE + 1];  //!< data buffer for socket writes
+string ObjectMessageBuffer;   //!< reused for each object message written with Object::WriteToXMLWriter, so it keeps its memory
 
 mvsocket SocketDBInterfaceListener;  //!< socket for dbinterface component to connect on
 mvsocket SocketDBInterface;   //!< socket for comms with dbinterface component
@@ -125,6 +132,16 @@ TerrainCacheClass TerrainCache;   //!< stores information about available textur
 Animation animator( World );   //!< Used to animate the world (non-physics movement)
 ConfigClass mvConfig;   //!< Load configuration from config.xml, and exposes it as properties
 MeshInfoCacheClass MeshInfoCache;   //!< stores information about available meshfiles
+ScriptingEngineShardsClass ScriptingEngineShards;   //!< which scripting engine runs the script of each object
+FileManifestClass FileManifest;   //!< every texture, terrain, meshfile and script in the caches above, in the order added
+WorldChangeLogClass WorldChangeLog( 20000 );   //!< version of each object, for sending reconnecting clients only what changed
+float fMoveSendPosThreshold = 0.05f;   //!< change in an object's position or scale worth sending a client straight away, in world units
+float fMoveSendRotThreshold = 0.02f;   //!< change in an object's rotation worth sending a client straight away, in radians
+int iMoveSendMaxDelayMilliseconds = 500;   //!< longest a client waits for smaller changes to an object, if its budget allows
+int iMoveSendBytesPerSecond = 32768;   //!< budget for object moves, per client
+int iMoveSendBurstBytes = 8192;   //!< most of its budget a client can save up
+MoveSendSchedulerClass MoveSendScheduler( fMoveSendPosThreshold, fMoveSendRotThreshold, iMoveSendMaxDelayMilliseconds,
+        iMoveSendBytesPerSecond, iMoveSendBurstBytes );   //!< which object moves to send to each client, and when
 
 COLLISION Collisions[2048]; //!< Active collisions; this is used to pass collision information from the physics engine to the scripting engines
 COLLISION Colliding[2048]; //!< collision data from last frame; this is used to pass collision information from the physics engine to the scripting engines
@@ -138,6 +155,13 @@ SET_INT DirtyCache;            //!< set of all objects which have been changed b
 int iDirtyCacheWriteDelaySeconds = 10;   //!< Interval between writing objects that have moved to db
 int iLastDirtyCacheWriteTickCount = 0;   //!< Last dirty cache write tickcount (careful, tickcount is in milliseconds)
 
+int iWorldVersionBroadcastIntervalSeconds = 2;   //!< Interval between telling clients the world version, if it's changed
+int iLastWorldVersionBroadcastTickCount = 0;
+map< int, int > LastWorldVersionsBroadcast;   //!< world version each client was last told, by connection reference
+
+int iMoveCompressionReportIntervalSeconds = 60;   //!< Interval between logging how many object moves the send scheduler saved
+int iLastMoveCompressionReportTickCount = 0;
+
 //! Returns true or false according to whether rConnection is a local client or not. Used for privilege assignment to local scripting engines
 bool IsLocalClient( const CONNECTION &rConnection )
 {
@@ -195,15 +219,13 @@ void ManageDirtyCache()   // could maybe use a separate thread for this???
             {
                 if( iArrayNum != -1 )
                 {
-                    TiXmlDocument IPC;
-                    IPC.Parse( "<objectupdate><meta><avatar/></meta><geometry><pos/><rot/><scale/></geometry><faces><face num=\"0\"><color/></face></faces></objectcreate>" );
-                    World.GetObject( iArrayNum )->WriteToXMLDoc( IPC.RootElement() );
+                    ObjectMessageBuffer.clear();
+                    XmlWriter Writer( ObjectMessageBuffer );
+                    World.GetObject( iArrayNum )->WriteToXMLWriter( Writer, "objectupdate" );
+                    ObjectMessageBuffer += '\n';
 
-                    ostringstream messagestream;
-                    messagestream << IPC << endl;
-                    string IPCText = messagestream.str();
-                    DEBUG( "Updating dirty object to db [" << IPCText << "]" );
-                    SocketDBInterface.Send( IPCText.c_str() );
+                    DEBUG( "Updating dirty object to db [" << ObjectMessageBuffer << "]" );
+                    SocketDBInterface.Send( ObjectMessageBuffer.c_str() );
                 }
             }
         }
@@ -218,6 +240,90 @@ void BroadcastToAllClients( const char *Message )
     MetaverseServerConnectionManager.Broadcast( Message );
 }
 
+//! Tells each client every iWorldVersionBroadcastIntervalSeconds the world version it's been sent everything up to,
+//! if it's changed, so that if they reconnect they can ask for just the changes since
+//! Moves MoveSendScheduler is still holding back from a client hold back its version too; otherwise a client
+//! that reconnected would be told those moves were already sent, and never get them
+void BroadcastWorldVersion()
+{
+    if( MVGetTickCount() - iLastWorldVersionBroadcastTickCount > 1000 * iWorldVersionBroadcastIntervalSeconds )
+    {
+        map< int, int > VersionsBroadcast;
+        ConnectionsIteratorTypedef iterator;
+        for( iterator = MetaverseServerConnectionManager.Connections.begin(); iterator != MetaverseServerConnectionManager.Connections.end(); iterator++ )
+        {
+            int iVersion = MoveSendScheduler.GetVersionSent( iterator->first, WorldChangeLog.GetVersion() );
+            if( !iterator->second.bConnected || iVersion == -1 )
+            {
+                continue;
+            }
+            map< int, int >::const_iterator lastiterator = LastWorldVersionsBroadcast.find( iterator->first );
+            if( lastiterator == LastWorldVersionsBroadcast.end() || lastiterator->second != iVersion )
+            {
+                char sMessage[256];
+                sprintf( sMessage, "<worldversion session=\"%i\" version=\"%i\"/>\n", WorldChangeLog.GetSession(), iVersion );
+                MetaverseServerConnectionManager.SendThruConnection( iterator->second, sMessage );
+            }
+            VersionsBroadcast.insert( pair< int, int >( iterator->first, iVersion ) );
+        }
+        LastWorldVersionsBroadcast.swap( VersionsBroadcast );
+        iLastWorldVersionBroadcastTickCount = MVGetTickCount();
+    }
+}
+
+//! Sends each client the object moves MoveSendScheduler picks for it this frame
+//!
+//! Sends each client the object moves MoveSendScheduler picks for it this frame
+//! Moves near the client's avatar go first, so they're the last to wait when the client's budget runs out
+void SendScheduledMoves()
+{
+    int iTickCount = MVGetTickCount();
+    set< int > ConnectionRefs;
+    vector< const string * > Messages;
+
+    ConnectionsIteratorTypedef iterator;
+    for( iterator = MetaverseServerConnectionManager.Connections.begin(); iterator != MetaverseServerConnectionManager.Connections.end(); iterator++ )
+    {
+        if( !iterator->second.bConnected )
+        {
+            continue;
+        }
+        ConnectionRefs.insert( iterator->first );
+
+        const Vector3 *pAvatarPos = NULL;
+        Object *pAvatar = World.GetObjectByReference( iterator->second.iForeignReference );
+        if( pAvatar != NULL )
+        {
+            pAvatarPos = &pAvatar->pos;
+        }
+
+        Messages.clear();
+        MoveSendScheduler.GetMovesToSend( iterator->first, pAvatarPos, iTickCount, Messages );
+        for( int i = 0; i < (int)Messages.size(); i++ )
+        {
+            MetaverseServerConnectionManager.SendThruConnection( iterator->second, Messages[i]->c_str() );
+        }
+    }
+    MoveSendScheduler.ForgetOldMoves( ConnectionRefs, iTickCount );
+}
+
+//! Logs, every iMoveCompressionReportIntervalSeconds, how many object moves forwarding each move to each client
+//! would have sent, against how many MoveSendScheduler sent
+void ReportMoveCompression()
+{
+    if( MVGetTickCount() - iLastMoveCompressionReportTickCount > 1000 * iMoveCompressionReportIntervalSeconds )
+    {
+        if( MoveSendScheduler.GetNumMovesSent() > 0 )
+        {
+            INFO( "object moves: " << MoveSendScheduler.GetNumMovesReceived() << " received, "
+                << MoveSendScheduler.GetNumNaiveSends() << " to send forwarding each, "
+                << MoveSendScheduler.GetNumMovesSent() << " sent; compression "
+                << (float)MoveSendScheduler.GetNumNaiveSends() / (float)MoveSendScheduler.GetNumMovesSent() << ":1" );
+        }
+        iLastMoveCompressionReportTickCount = MVGetTickCount();
+    }
+}
+
 //! Sends message to all local connected clients; this will be primarily scripting engines
 
 //! Sends message to all local connected clients; this will be primarily scripting engines
@@ -253,38 +359,206 @@ void BroadcastToInternetClients( const char *Message )
     }
 }
 
+//! Sends Message to the scripting engine connected as iConnectionRef
+void SendToScriptingEngine( int iConnectionRef, const char *Message )
+{
+    ConnectionsIteratorTypedef iterator = MetaverseServerConnectionManager.Connections.find( iConnectionRef );
+    if( iterator != MetaverseServerConnectionManager.Connections.end() )
+    {
+        DEBUG(  "sending to scripting engine " << iConnectionRef << " " << Message ); // DEBUG
+        MetaverseServerConnectionManager.SendThruConnection( iterator->second, Message );
+    }
+}
+
+//! Sends Message to the scripting engine running the script of object iReference
+
+//! Sends Message to the scripting engine running the script of object iReference
+//! If no scripting engine has registered for sharding, Message goes to all local clients, as before sharding
+void SendToScriptOwner( int iReference, const char *Message )
+{
+    if( ScriptingEngineShards.GetNumEngines() == 0 )
+    {
+        BroadcastToLocalClients( Message );
+        return;
+    }
+
+    int iOwner = ScriptingEngineShards.GetOwner( iReference );
+    if( iOwner != -1 )
+    {
+        SendToScriptingEngine( iOwner, Message );
+    }
+}
+
+//! Sends a key event from avatar iAvatarReference to the scripting engines running objects that capture its keyboard
+void SendKeyboardEventToScripts( int iAvatarReference, const char *Message )
+{
+    if( ScriptingEngineShards.GetNumEngines() == 0 )
+    {
+        BroadcastToLocalClients( Message );
+        return;
+    }
+
+    set< int > Engines;
+    ScriptingEngineShards.GetEnginesCapturingKeyboard( iAvatarReference, Engines );
+    for( set< int >::iterator iterator = Engines.begin(); iterator != Engines.end(); iterator++ )
+    {
+        SendToScriptingEngine( *iterator, Message );
+    }
+}
+
+//! Gives the script of p_Object to a scripting engine, if it has a script and no engine runs it yet
+void AssignScriptIfNecessary( Object *p_Object )
+{
+    if( p_Object == NULL || strcmp( p_Object->sScriptReference, "" ) == 0 )
+    {
+        return;
+    }
+    if( ScriptingEngineShards.GetOwner( p_Object->iReference ) == -1 )
+    {
+        int iOwner = ScriptingEngineShards.AssignObject( p_Object->iReference );
+        if( iOwner != -1 )
+        {
+            ostringstream messagestream;
+            messagestream << "<scriptshardassign ireference=\"" << p_Object->iReference << "\"/>" << endl;
+            SendToScriptingEngine( iOwner, messagestream.str().c_str() );
+        }
+    }
+}
+
+//! Asks the current owners of the objects in Migrations to hand over their scripts
+void StartScriptMigrations( const vector< SCRIPTMIGRATION > &Migrations )
+{
+    for( int i = 0; i < (int)Migrations.size(); i++ )
+    {
+        INFO( "migrating script of object " << Migrations[i].iReference << " from scripting engine "
+              << Migrations[i].iSourceConnectionRef << " to " << Migrations[i].iTargetConnectionRef );
+        ostringstream messagestream;
+        messagestream << "<scriptshardrelease ireference=\"" << Migrations[i].iReference << "\"/>" << endl;
+        SendToScriptingEngine( Migrations[i].iSourceConnectionRef, messagestream.str().c_str() );
+    }
+}
+
+//! Tells every scripting engine how many there are, so that an engine running alone keeps its multicast RPCs to itself
+void BroadcastNumScriptingEngines()
+{
+    vector< int > Engines;
+    ScriptingEngineShards.GetEngines( Engines );
+    ostringstream messagestream;
+    messagestream << "<scriptingengines count=\"" << Engines.size() << "\" />" << endl;
+    for( int i = 0; i < (int)Engines.size(); i++ )
+    {
+        SendToScriptingEngine( Engines[i], messagestream.str().c_str() );
+    }
+}
+
+//! Registers connection iConnectionRef as a scripting engine, and moves some scripts to it
+void RegisterScriptingEngine( int iConnectionRef, CONNECTION &rConnection )
+{
+    if( !IsLocalClient( rConnection ) )
+    {
+        WARNING( "ignoring scripting engine registration from remote connection " << iConnectionRef );
+        return;
+    }
+
+    INFO( "scripting engine registered on connection " << iConnectionRef );
+    ScriptingEngineShards.AddEngine( iConnectionRef );
+    BroadcastNumScriptingEngines();
+
+    for( int i = 0; i < World.iNumObjects; i++ )
+    {
+        AssignScriptIfNecessary( World.GetObject( i ) );
+    }
+
+    vector< SCRIPTMIGRATION > Migrations;
+    ScriptingEngineShards.PlanRebalance( Migrations );
+    StartScriptMigrations( Migrations );
+}
+
+//! Forwards the script state released by the old owner of an object to its new owner
+void CompleteScriptMigration( int iConnectionRef, TiXmlElement *pElement )
+{
+    int iReference = atoi( pElement->Attribute("ireference") );
+    if( ScriptingEngineShards.GetOwner( iReference ) != iConnectionRef )
+    {
+        WARNING( "ignoring script state for object " << iReference << " from non-owner " << iConnectionRef );
+        return;
+    }
+
+    int iNewOwner = ScriptingEngineShards.CompleteMigration( iReference );
+    if( iNewOwner != -1 )
+    {
+        pElement->SetValue( "scriptshardassign" );
+        ostringstream messagestream;
+        messagestream << *pElement << endl;
+        SendToScriptingEngine( iNewOwner, messagestream.str().c_str() );
+    }
+}
+
+//! Passes a multicast RPC from one scripting engine to all the others, each of which delivers it to the
+//! members of the group whose scripts it runs; the sending engine has delivered it to its own already.
+//! Message is relayed as received
+void RelayMulticastRPC( int iConnectionRef, const char *Message )
+{
+    if( !ScriptingEngineShards.IsEngine( iConnectionRef ) )
+    {
+        WARNING( "ignoring multicast rpc from connection " << iConnectionRef << ", which isnt a scripting engine" );
+        return;
+    }
+
+    vector< int > Engines;
+    ScriptingEngineShards.GetEngines( Engines );
+    for( int i = 0; i < (int)Engines.size(); i++ )
+    {
+        if( Engines[i] != iConnectionRef )
+        {
+            SendToScriptingEngine( Engines[i], Message );
+        }
+    }
+}
+
+//! Gives the scripts of any disconnected scripting engine to the remaining engines; call before purging connections
+void CheckForLostScriptingEngines()
+{
+    vector< int > Engines;
+    ScriptingEngineShards.GetEngines( Engines );
+    for( int i = 0; i < (int)Engines.size(); i++ )
+    {
+        ConnectionsIteratorTypedef iterator = MetaverseServerConnectionManager.Connections.find( Engines[i] );
+        if( iterator == MetaverseServerConnectionManager.Connections.end() || !iterator->second.bConnected )
+        {
+            INFO( "scripting engine on connection " << Engines[i] << " lost" );
+            vector< int > OrphanedObjects;
+            ScriptingEngineShards.RemoveEngine( Engines[i], OrphanedObjects );
+            for( int j = 0; j < (int)OrphanedObjects.size(); j++ )
+            {
+                AssignScriptIfNecessary( World.GetObjectByReference( OrphanedObjects[j] ) );
+            }
+            BroadcastNumScriptingEngines();
+        }
+    }
+}
+
 //! Broadcasts the existing object specified by iObjectIndex to all connected clients
 void BroadcastExistingObject( int iObjectIndex )
 {
     if( World.GetObject( iObjectIndex ) != NULL )
     {
         printf( "sending object %i reference %i\n", iObjectIndex, World.GetObject( iObjectIndex )->iReference );
-        TiXmlDocument IPC;
-        IPC.Parse( "<objectrefreshdata>"
-                   "<meta><avatar /></meta>"
-                   "<geometry><pos /><rot /><scale /></geometry>"
-                   "<faces><face num=\"0\"/></faces>"
-                   "</objectrefreshdata>" );
-        DEBUG( "about to write to xml doc object type " << World.GetObject(iObjectIndex)->ObjectType );
-        World.GetObject(iObjectIndex)->WriteToXMLDoc( IPC.RootElement() );
-        DEBUG( "xml doc done" );
-
-        std::string IPCText;
-        IPCText << IPC;
-        sprintf( SendBuffer, "%.2046s\n", IPCText.c_str() );
-        DEBUG( "Broadcasting to clients " << SendBuffer  );
+        DEBUG( "about to write object type " << World.GetObject(iObjectIndex)->ObjectType );
+        ObjectMessageBuffer.clear();
+        XmlWriter Writer( ObjectMessageBuffer );
+        World.GetObject(iObjectIndex)->WriteToXMLWriter( Writer, "objectrefreshdata" );
+        ObjectMessageBuffer += '\n';
+        DEBUG( "Broadcasting to clients " << ObjectMessageBuffer  );
 
-        BroadcastToLocalClients( SendBuffer );
+        BroadcastToLocalClients( ObjectMessageBuffer.c_str() );
 
-        string InternetIPC;
-        if( IPC.RootElement()->FirstChildElement("scripts") != NULL )
-        {
-            IPC.RootElement()->RemoveChild( IPC.RootElement()->FirstChildElement( "scripts" ) );
-        }
-        InternetIPC << IPC;
-        sprintf( SendBuffer, "%.2046s\n", InternetIPC.c_str() );
+        // internet clients dont get told about scripts
+        ObjectMessageBuffer.clear();
+        World.GetObject(iObjectIndex)->WriteToXMLWriter( Writer, "objectrefreshdata", false );
+        ObjectMessageBuffer += '\n';
 
-        BroadcastToInternetClients( SendBuffer );
+        BroadcastToInternetClients( ObjectMessageBuffer.c_str() );
     }
 }
 
@@ -295,31 +569,18 @@ void SendExistingObjectToOneConnection( CONNECTION &rConnection, int iObjectInde
     if( p_Object != NULL )
     {
         printf( "sending object %i reference %i\n", iObjectIndex, p_Object->iReference );
-        TiXmlDocument IPC;
-        IPC.Parse( "<objectrefreshdata>"
-                   "<meta><avatar /></meta>"
-                   "<geometry><pos /><rot /><scale /></geometry>"
-                   "<faces><face num=\"0\"><color/></face></faces>"
-                   "</objectrefreshdata>" );
-        DEBUG( "about to write to xml doc object type " << p_Object->ObjectType );
-        p_Object->WriteToXMLDoc( IPC.RootElement() );
-        DEBUG( "xml doc done" );
-
-        if( strcmp( p_Object->sScriptReference, "" ) != 0 )
-        {
-            if( strcmp( inet_ntoa( rConnection.connectionsocket.GetPeer() ), "0.0.0.0" ) != 0 )
-            {
-                IPC.RootElement()->RemoveChild( IPC.RootElement()->FirstChildElement( "scripts" ) );
-            }
-        }
+        DEBUG( "about to write object type " << p_Object->ObjectType );
+
+        // only local clients get told about scripts
+        bool bIncludeScripts = ( strcmp( inet_ntoa( rConnection.connectionsocket.GetPeer() ), "0.0.0.0" ) == 0 );
 
-        std::string IPCText;
-        IPCText << IPC;
-        char Message[2047];
-        sprintf( Message, "%.2046s\n", IPCText.c_str() );
-        DEBUG(  "Sending[" << Message << "] to client ireference " << rConnection.iForeignReference ); // DEBUG
+        ObjectMessageBuffer.clear();
+        XmlWriter Writer( ObjectMessageBuffer );
+        p_Object->WriteToXMLWriter( Writer, "objectrefreshdata", bIncludeScripts );
+        ObjectMessageBuffer += '\n';
+        DEBUG(  "Sending[" << ObjectMessageBuffer << "] to client ireference " << rConnection.iForeignReference ); // DEBUG
 
-        MetaverseServerConnectionManager.SendThruConnection( rConnection, Message );
+        MetaverseServerConnectionManager.SendThruConnection( rConnection, ObjectMessageBuffer.c_str() );
     }
 }
 
@@ -345,8 +606,7 @@ void RecursiveDelete( Object *p_Object )
                 iNumSubObjects;
                 i++ )
         {
-            if( strcmp( dynamic_cast< ObjectGrouping * >(p_Object)->SubObjectReferences[ i ]->
-                        sDeepObjectType, "OBJECTGROUPING" ) == 0 )
+            if( dynamic_cast< ObjectGrouping * >(p_Object)->SubObjectReferences[ i ]->DeepTypeTag == DEEPTYPE_OBJECTGROUPING )
             {
                 RecursiveDelete( dynamic_cast< ObjectGrouping * >(p_Object)->SubObjectReferences[ i ] );
             }
@@ -368,7 +628,7 @@ void DeleteObjectFromDB( int iownerreference, TiXmlElement *pElement )
     Object *p_Object = World.GetObjectByReference( iReference );
     if( p_Object != NULL )
     {
-        if( strcmp( p_Object->sDeepObjectType, "AVATAR" ) == 0 )
+        if( p_Object->DeepTypeTag == DEEPTYPE_AVATAR )
         {
             DEBUG(  "Attempt to delete avatar object, ignoring" ); // DEBUG
             return;
@@ -388,7 +648,7 @@ void DeleteObjectFromDB( int iownerreference, TiXmlElement *pElement )
             }
         }
 
-        if( strcmp( p_Object->ObjectType, "OBJECTGROUPING" ) == 0 )
+        if( p_Object->TypeTag == OBJECTTYPE_OBJECTGROUPING )
         {
             DEBUG( "received demand to delete object ref %i,sending to db..." << iReference );
 
@@ -434,7 +694,13 @@ void StoreObjectInDB( int iownerreference, TiXmlElement *pElement )
 }
 
 //! Sends entire world state to the client specified by rConnection
-void SendCurrentDataToConnection( CONNECTION rConnection )
+//!
+//! Sends entire world state to the client specified by rConnection
+//! If pRequest gives the worldsession and worldversion the client last heard of, and WorldChangeLog
+//! still goes back that far, only objects changed since are sent; see WorldChangeLog.cpp
+//! Files are sent as <filemanifest> lists; if pRequest gives the manifestsession and manifestepoch
+//! of the last manifest the client got, only files added since are listed
+void SendCurrentDataToConnection( CONNECTION rConnection, TiXmlElement *pRequest )
 {
     DEBUG( "Sending world state to client ref" << rConnection.iForeignReference );
 
@@ -442,58 +708,71 @@ void SendCurrentDataToConnection( CONNECTION rConnection )
     clientmessagestream << "<skyboxupdate stexturereference=\"" << World.GetSkyboxChecksum() << "\" />" << endl;
     MetaverseServerConnectionManager.SendThruConnection( rConnection, clientmessagestream.str().c_str() );
 
+    set< int > ChangedObjects;
+    bool bDelta = pRequest->Attribute("worldsession") != NULL && pRequest->Attribute("worldversion") != NULL &&
+                  WorldChangeLog.GetChangesSince( atoi( pRequest->Attribute("worldsession") ), atoi( pRequest->Attribute("worldversion") ), ChangedObjects );
 
+    ostringstream versionmessagestream;
+    versionmessagestream << "<worldversion session=\"" << WorldChangeLog.GetSession() << "\" version=\"" << WorldChangeLog.GetVersion()
+    << "\" full=\"" << ( bDelta ? "false" : "true" ) << "\"/>" << endl;
+    MetaverseServerConnectionManager.SendThruConnection( rConnection, versionmessagestream.str().c_str() );
 
-    int i;
-    for( i = 0; i < World.iNumObjects; i++ )
+    if( bDelta )
     {
-        SendExistingObjectToOneConnection( rConnection, i );
+        DEBUG(  "sending " << ChangedObjects.size() << " changed objects since version " << pRequest->Attribute("worldversion") ); // DEBUG
+        for( set< int >::iterator iterator = ChangedObjects.begin(); iterator != ChangedObjects.end(); iterator++ )
+        {
+            int iArrayNum = World.GetArrayNumForObjectReference( *iterator );
+            if( iArrayNum != -1 )
+            {
+                SendExistingObjectToOneConnection( rConnection, iArrayNum );
+            }
+            else
+            {
+                char sMessage[256];
+                sprintf( sMessage, "<objectdelete ireference=\"%i\"/>\n", *iterator );
+                MetaverseServerConnectionManager.SendThruConnection( rConnection, sMessage );
+            }
+        }
     }
-
-
-    TextureIteratorTypedef iterator;
-    for( iterator = textureinfocache.Textures.begin(); iterator != textureinfocache.Textures.end(); iterator++ )
+    else
     {
-        DEBUG(  "sending texture " << iterator->second.sSourceFilename ); // DEBUG
-        TEXTUREINFO &rTextureInfo = iterator->second;
-        ostringstream clientmessagestream;
-        clientmessagestream << "<texture checksum=\"" << rTextureInfo.sChecksum << "\" serverfilename=\"" << rTextureInfo.sServerFilename << "\" sourcefilename=\"" << rTextureInfo.sSourceFilename << "\"/>" << endl;
-        MetaverseServerConnectionManager.SendThruConnection( rConnection, clientmessagestream.str().c_str() );
+        int i;
+        for( i = 0; i < World.iNumObjects; i++ )
+        {
+            SendExistingObjectToOneConnection( rConnection, i );
+        }
     }
 
-    TerrainIteratorTypedef terrainiterator;
-    for( terrainiterator = TerrainCache.Terrains.begin(); terrainiterator != TerrainCache.Terrains.end(); terrainiterator++ )
+    // tracks go to every client, changed objects or not, since they only get sent when they start
+    DEBUG(  "sending " << animator.GetNumTracks() << " tracks" ); // DEBUG
+    for( int iTrackNum = 0; iTrackNum < animator.GetNumTracks(); iTrackNum++ )
     {
-        DEBUG(  "sending terrain " << terrainiterator->second.sSourceFilename ); // DEBUG
-        TerrainINFO &rTerrainInfo = terrainiterator->second;
-        ostringstream clientmessagestream;
-        clientmessagestream << "<terrain checksum=\"" << rTerrainInfo.sChecksum << "\" serverfilename=\""
-        << rTerrainInfo.sServerFilename << "\" sourcefilename=\"" << rTerrainInfo.sSourceFilename << "\"/>" << endl;
-        MetaverseServerConnectionManager.SendThruConnection( rConnection, clientmessagestream.str().c_str() );
+        ObjectMessageBuffer.clear();
+        XmlWriter Writer( ObjectMessageBuffer );
+        animator.WriteTrackToXMLWriter( iTrackNum, Writer );
+        ObjectMessageBuffer += '\n';
+        MetaverseServerConnectionManager.SendThruConnection( rConnection, ObjectMessageBuffer.c_str() );
     }
 
-    FileInfoIteratorTypedef meshiterator;
-    for( meshiterator = MeshInfoCache.Files.begin(); meshiterator != MeshInfoCache.Files.end(); meshiterator++ )
+
+    int iManifestSession = 0;
+    int iManifestEpoch = 0;
+    if( pRequest->Attribute("manifestsession") != NULL && pRequest->Attribute("manifestepoch") != NULL )
     {
-        DEBUG(  "sending mesh " << meshiterator->second.sSourceFilename ); // DEBUG
-        FILEINFO &rMeshInfo = meshiterator->second;
-        ostringstream clientmessagestream;
-        clientmessagestream << "<meshfile checksum=\"" << rMeshInfo.sChecksum << "\" serverfilename=\""
-        << rMeshInfo.sServerFilename << "\" sourcefilename=\"" << rMeshInfo.sSourceFilename << "\"/>" << endl;
-        MetaverseServerConnectionManager.SendThruConnection( rConnection, clientmessagestream.str().c_str() );
+        iManifestSession = atoi( pRequest->Attribute("manifestsession") );
+        iManifestEpoch = atoi( pRequest->Attribute("manifestepoch") );
     }
 
-    if( strcmp( inet_ntoa( rConnection.connectionsocket.GetPeer() ), "0.0.0.0" ) == 0 )
+    // only local clients get scripts
+    bool bIncludeScripts = ( strcmp( inet_ntoa( rConnection.connectionsocket.GetPeer() ), "0.0.0.0" ) == 0 );
+
+    vector< string > ManifestMessages;
+    FileManifest.GetManifestMessages( iManifestSession, iManifestEpoch, bIncludeScripts, ManifestMessages );
+    DEBUG(  "sending " << ManifestMessages.size() << " file manifest messages, up to epoch " << FileManifest.GetEpoch() ); // DEBUG
+    for( vector< string >::iterator iterator = ManifestMessages.begin(); iterator != ManifestMessages.end(); iterator++ )
     {
-        ScriptIteratorTypedef scriptiterator;
-        for( scriptiterator = ScriptInfoCache.Scripts.begin(); scriptiterator != ScriptInfoCache.Scripts.end(); scriptiterator++ )
-        {
-            DEBUG(  "sending script " << scriptiterator->second.sSourceFilename ); // DEBUG
-            SCRIPTINFO &rScriptInfo = scriptiterator->second;
-            ostringstream clientmessagestream;
-            clientmessagestream << "<script checksum=\"" << rScriptInfo.sChecksum << "\" serverfilename=\"" << rScriptInfo.sServerFilename << "\" sourcefilename=\"" << rScriptInfo.sSourceFilename << "\"/>" << endl;
-            MetaverseServerConnectionManager.SendThruConnection( rConnection, clientmessagestream.str().c_str() );
-        }
+        MetaverseServerConnectionManager.SendThruConnection( rConnection, iterator->c_str() );
     }
     DEBUG("Done SendCurrentDataToConnection");
 }
@@ -505,11 +784,14 @@ void SendCurrentDataToConnection( CONNECTION rConnection )
 void CacheAndBroadcastObjectDeleteFromDB( TiXmlElement *pElement )
 {
     World.DeleteObjectXML( pElement );
+    WorldChangeLog.ObjectChanged( atoi( pElement->Attribute("ireference") ) );
+    MoveSendScheduler.ObjectRemoved( atoi( pElement->Attribute("ireference") ) );
 
     char sMessage[256];
     sprintf( sMessage, "<objectdelete ireference=\"%i\"/>\n", atoi( pElement->Attribute("ireference") ) );
     BroadcastToAllClients( sMessage );
     CollisionAndPhysicsEngine.ObjectDestroy( atoi( pElement->Attribute("ireference" ) ) );
+    ScriptingEngineShards.RemoveObject( atoi( pElement->Attribute("ireference" ) ) );
 }
 
 //! Adds the object specified by pElement to internal world, and broadcasts create/update to all clients
@@ -520,6 +802,7 @@ void CacheAndBroadcastObjectFromDB( TiXmlElement *pElement )
 {
     Object *p_Object = World.StoreObjectXML( pElement );
     CollisionAndPhysicsEngine.ObjectModify( p_Object );
+    WorldChangeLog.ObjectChanged( p_Object->iReference );
 
     std::string IPCText;
     IPCText << *pElement;
@@ -536,6 +819,8 @@ void CacheAndBroadcastObjectFromDB( TiXmlElement *pElement )
     sprintf( SendBuffer, "%.2046s\n", InternetIPC.c_str() );
 
     BroadcastToInternetClients( SendBuffer );
+
+    AssignScriptIfNecessary( p_Object );
 }
 
 //! Adds the skybox specified by pElement to internal world, and broadcasts to all clients
@@ -568,7 +853,8 @@ void CacheAndBroadcastSkyboxFromDB( TiXmlElement *pElement )
 //! database has already been updated by this time
 void CacheAndBroadcastTextureFromDB( TiXmlElement *p_Element )
 {
-    textureinfocache.AddTextureInfoFromXML( p_Element );
+    TEXTUREINFO &rTextureInfo = textureinfocache.AddTextureInfoFromXML( p_Element );
+    FileManifest.Add( "texture", rTextureInfo.sChecksum, rTextureInfo.sServerFilename, rTextureInfo.sSourceFilename );
     ostringstream clientmessagestream;
     clientmessagestream << "<texture checksum=\"" << p_Element->Attribute("checksum") << "\" serverfilename=\"" << p_Element->Attribute("sourcefilename") << "\" sourcefilename=\"" << p_Element->Attribute("sourcefilename") << "\"/>" << endl;
     BroadcastToAllClients( clientmessagestream.str().c_str() );
@@ -580,7 +866,8 @@ void CacheAndBroadcastTextureFromDB( TiXmlElement *p_Element )
 //! database has already been updated by this time
 void CacheAndBroadcastTerrainFromDB( TiXmlElement *p_Element )
 {
-    TerrainCache.AddTerrainInfoFromXML( p_Element );
+    TerrainINFO &rTerrainInfo = TerrainCache.AddTerrainInfoFromXML( p_Element );
+    FileManifest.Add( "terrain", rTerrainInfo.sChecksum, rTerrainInfo.sServerFilename, rTerrainInfo.sSourceFilename );
     ostringstream clientmessagestream;
     clientmessagestream << "<terrain checksum=\"" << p_Element->Attribute("checksum") << "\" serverfilename=\"" << p_Element->Attribute("sourcefilename") << "\" sourcefilename=\"" << p_Element->Attribute("sourcefilename") << "\"/>" << endl;
     BroadcastToAllClients( clientmessagestream.str().c_str() );
@@ -592,7 +879,8 @@ void CacheAndBroadcastTerrainFromDB( TiXmlElement *p_Element )
 //! database has already been updated by this time
 void CacheAndBroadcastMeshfileFromDB( TiXmlElement *p_Element )
 {
-    MeshInfoCache.AddFileInfoFromXML( p_Element );
+    FILEINFO &rMeshInfo = MeshInfoCache.AddFileInfoFromXML( p_Element );
+    FileManifest.Add( "meshfile", rMeshInfo.sChecksum, rMeshInfo.sServerFilename, rMeshInfo.sSourceFilename );
     ostringstream clientmessagestream;
     clientmessagestream << "<meshfile checksum=\"" << p_Element->Attribute("checksum") << "\" serverfilename=\"" << p_Element->Attribute("sourcefilename") << "\" sourcefilename=\"" << p_Element->Attribute("sourcefilename") << "\"/>" << endl;
     BroadcastToAllClients( clientmessagestream.str().c_str() );
@@ -605,7 +893,8 @@ void CacheAndBroadcastMeshfileFromDB( TiXmlElement *p_Element )
 void CacheAndBroadcastScriptFromDB( TiXmlElement *p_Element )
 {
     DEBUG(  "CacheAndBroadcastScriptFromDB..." ); // DEBUG
-    ScriptInfoCache.AddInfoFromXML( p_Element );
+    SCRIPTINFO &rScriptInfo = ScriptInfoCache.AddInfoFromXML( p_Element );
+    FileManifest.Add( "script", rScriptInfo.sChecksum, rScriptInfo.sServerFilename, rScriptInfo.sSourceFilename );
     ostringstream clientmessagestream;
     clientmessagestream << "<script checksum=\"" << p_Element->Attribute("checksum") << "\" serverfilename=\"" << p_Element->Attribute("sourcefilename") << "\" sourcefilename=\"" << p_Element->Attribute("sourcefilename") << "\"/>" << endl;
     BroadcastToLocalClients( clientmessagestream.str().c_str() );
@@ -623,8 +912,8 @@ void HandleEvent( int iOwnerReference, TiXmlElement *pElement )
         pElement->SetAttribute("iowner", iOwnerReference );
 
         messagestream << *pElement << endl;
-        DEBUG(  "broadcasting to local clients: " << messagestream.str() ); // DEBUG
-        BroadcastToLocalClients( messagestream.str().c_str() );
+        DEBUG(  "sending to script owner: " << messagestream.str() ); // DEBUG
+        SendToScriptOwner( atoi( pElement->Attribute("ireference") ), messagestream.str().c_str() );
     }
 }
 
@@ -642,7 +931,7 @@ void UpdateObjectCachetoDBAndBroadcast( int iOwnerReference, TiXmlElement *pElem
 
     if( p_Object != NULL )
     {
-        if( strcmp( p_Object->ObjectType, "OBJECTGROUPING" ) != 0 )
+        if( p_Object->TypeTag != OBJECTTYPE_OBJECTGROUPING )
         {
             World.UpdateObjectXML( pElement );
         }
@@ -663,6 +952,7 @@ void UpdateObjectCachetoDBAndBroadcast( int iOwnerReference, TiXmlElement *pElem
             {
                 int iMemberReference = *iterator;
                 Object *p_ChildObject = World.GetObjectByReference( iMemberReference );
+                WorldChangeLog.ObjectChanged( iMemberReference );
                 ostringstream DBUpdateStream;
                 DBUpdateStream << "<objectupdate ireference=\"" << p_ChildObject->iReference << "\" type=\"" << p_ChildObject->sDeepObjectType << "\">"
                 << "<geometry>"
@@ -677,6 +967,7 @@ void UpdateObjectCachetoDBAndBroadcast( int iOwnerReference, TiXmlElement *pElem
             for( int i = 0; i < pGroup->iNumSubObjects; i++ )
             {
                 Object *p_ChildObject = pGroup->SubObjectReferences[ i ];
+                WorldChangeLog.ObjectChanged( p_ChildObject->iReference );
                 ostringstream DBUpdateStream;
                 DBUpdateStream << "<objectupdate ireference=\"" << p_ChildObject->iReference << "\" type=\"" << p_ChildObject->sDeepObjectType << "\">"
                 << "<geometry>"
@@ -689,6 +980,7 @@ void UpdateObjectCachetoDBAndBroadcast( int iOwnerReference, TiXmlElement *pElem
             }
         }
 
+        WorldChangeLog.ObjectChanged( iReference );
         pElement->SetAttribute( "type", p_Object->sDeepObjectType );
 
         std::string IPCString;
@@ -708,6 +1000,8 @@ void UpdateObjectCachetoDBAndBroadcast( int iOwnerReference, TiXmlElement *pElem
         sprintf( SendBuffer, "%.2046s\n", InternetIPC.c_str() );
 
         BroadcastToInternetClients( SendBuffer );
+
+        AssignScriptIfNecessary( p_Object );
     }
 }
 
@@ -734,25 +1028,82 @@ void UpdateSkyboxCachetoDBAndBroadcast( int iOwnerReference, TiXmlElement *pElem
     BroadcastToInternetClients( SendBuffer );
 }
 
-//! moves an object specified by pElement (contains the ireference and the move instructions); and broadcasts change to all connected clients
-void MoveObjectAndBroadcast( TiXmlElement *pElement )
+//! moves an object to where Move says it's going; and hands Move to MoveSendScheduler, to send on to connected clients
+//!
+//! moves an object to where Move says it's going; and hands Move to MoveSendScheduler, to send on to connected clients
+//! The server doesnt animate; the object goes straight to its end position, and the clients animate the move.
+//! Clients are sent the move by SendScheduledMoves, merged with any later ones, once it's changed enough to matter
+void MoveObjectAndBroadcast( const OBJECTMOVEMESSAGE &Move )
 {
-    int iReference = atoi( pElement->Attribute("ireference" ) );
+    int iReference = Move.iReference;
     int iArrayNum = World.GetArrayNumForObjectReference( iReference );
     if( iArrayNum != -1 )
     {
+        Object *pObject = World.GetObject( iArrayNum );
+        if( Move.bPos )
+        {
+            pObject->pos = Move.Pos;
+        }
+        if( Move.bRot )
+        {
+            pObject->rot = Move.Rotation;
+        }
+        if( pObject->TypeTag == OBJECTTYPE_PRIM )
+        {
+            if( Move.bScale )
+            {
+                dynamic_cast< Prim * >( pObject )->scale = Move.Scale;
+            }
+            if( Move.bColor )
+            {
+                dynamic_cast< Prim * >( pObject )->SetColor( Move.iFaceNumber, Move.FaceColor );
+            }
+        }
+        animator.RemoveTrack( iReference );
+        CollisionAndPhysicsEngine.ObjectModify( pObject );
+
+        DirtyCache.insert( iReference );
+        int iVersion = WorldChangeLog.ObjectChanged( iReference );
+
+        MoveSendScheduler.ObjectMoved( Move, iVersion, (int)MetaverseServerConnectionManager.Connections.size(), MVGetTickCount() );
+    }
+}
 
-        World.GetObject( iArrayNum )->UpdateFromXML( pElement );
-        CollisionAndPhysicsEngine.ObjectModify( World.GetObject( iArrayNum ) );
+//! starts or stops an object's track, from Track; and broadcasts sMessage, the objecttrack Track was parsed from, to all connected clients
+//!
+//! starts or stops an object's track, from Track; and broadcasts sMessage, the objecttrack Track was parsed from, to all connected clients
+//! The server plays the track too, so the object is where the clients see it for collisions and the db,
+//! and so SendCurrentDataToConnection can pass it on to clients that connect later.
+//! If the track wouldnt fit in a line once elapsed="..." is added for those clients, the keys that do fit
+//! are played and broadcast instead, so every client plays the same track
+void SetTrackAndBroadcast( const OBJECTTRACKMESSAGE &Track, const char *sMessage )
+{
+    int iReference = Track.iReference;
+    if( World.GetArrayNumForObjectReference( iReference ) != -1 )
+    {
+        OBJECTTRACKMESSAGE FittedTrack = Track;
+        bool bFitted = FitObjectTrack( FittedTrack, SOCKETS_READ_BUFFER_LENGTH );
+        animator.SetTrack( FittedTrack );
 
         DirtyCache.insert( iReference );
+        WorldChangeLog.ObjectChanged( iReference );
 
-        std::string IPCString;
-        IPCString << *pElement;
-        sprintf( SendBuffer, "%s\n", IPCString.c_str() );
+        // sent as a blob, like the other object messages; a track with all its keys is longer than the printf Send can format
+        if( bFitted )
+        {
+            ObjectMessageBuffer = sMessage;
+        }
+        else
+        {
+            DEBUG(  "track for " << iReference << " too long for one line, keeping its first " << FittedTrack.iNumKeys << " keys" ); // DEBUG
+            ObjectMessageBuffer.clear();
+            XmlWriter Writer( ObjectMessageBuffer );
+            WriteObjectTrack( FittedTrack, Writer );
+        }
+        ObjectMessageBuffer += '\n';
 
-        printf( "Broadcasting [%s]\n", SendBuffer );
-        BroadcastToAllClients( SendBuffer );
+        DEBUG( "Broadcasting [" << ObjectMessageBuffer << "]" );
+        BroadcastToAllClients( ObjectMessageBuffer.c_str() );
     }
 }
 
@@ -793,7 +1144,7 @@ void ProcessComm( CONNECTION &rConnection, TiXmlElement *pElement )
         }
 
         char ObjectName[65];
-        if( strcmp( World.GetObject( iArrayNum )->sDeepObjectType, "AVATAR" ) == 0 )
+        if( World.GetObject( iArrayNum )->DeepTypeTag == DEEPTYPE_AVATAR )
         {
             sprintf( ObjectName, dynamic_cast< Avatar *>(World.GetObject( iArrayNum ))->avatarname );
         }
@@ -941,6 +1292,43 @@ void HyperlinkAgentFromXML( CONNECTION &rConnection, TiXmlElement *pElement )
     }
 }
 
+//! Only local clients (scripting engines) may write the user data of other owners; fixes up iowner of
+//! the DBUSERDATA setinfo pElement, sent by rConnection, accordingly
+void CheckUserDataOwner( CONNECTION &rConnection, TiXmlElement *pElement )
+{
+    if( pElement->Attribute("iowner") == NULL || !IsLocalClient( rConnection ) )
+    {
+        pElement->SetAttribute("iowner", rConnection.iForeignReference );
+    }
+}
+
+//! Tells the scripting engines, other than the one on rWriterConnection, to drop the user data values
+//! written by the setinfo elements in Changes from their caches
+void NotifyUserDataChanged( CONNECTION &rWriterConnection, const vector< TiXmlElement * > &Changes )
+{
+    TiXmlElement NotificationElement( "userdatachanged" );
+    for( int i = 0; i < (int)Changes.size(); i++ )
+    {
+        TiXmlElement ValueElement( "userdata" );
+        ValueElement.SetAttribute( "iowner", Changes[i]->Attribute("iowner") );
+        ValueElement.SetAttribute( "store", Changes[i]->Attribute("store") );
+        ValueElement.SetAttribute( "valuename", Changes[i]->Attribute("valuename") );
+        NotificationElement.InsertEndChild( ValueElement );
+    }
+    ostringstream messagestream;
+    messagestream << NotificationElement << endl;
+
+    ConnectionsIteratorTypedef iterator;
+    for( iterator = MetaverseServerConnectionManager.Connections.begin(); iterator != MetaverseServerConnectionManager.Connections.end(); iterator++ )
+    {
+        bool bIsScriptingEngine = ScriptingEngineShards.GetNumEngines() > 0 ? ScriptingEngineShards.IsEngine( iterator->first ) : IsLocalClient( iterator->second );
+        if( bIsScriptingEngine && iterator->second.iForeignReference != rWriterConnection.iForeignReference )
+        {
+            MetaverseServerConnectionManager.SendThruConnection( iterator->second, messagestream.str().c_str() );
+        }
+    }
+}
+
 //! Processes a database script data setinfo request specified by pElement, and sent by the client specified in rConnection
 void SetInfoFromXML( CONNECTION &rConnection, TiXmlElement *pElement )
 {
@@ -948,15 +1336,40 @@ void SetInfoFromXML( CONNECTION &rConnection, TiXmlElement *pElement )
 
     if( sType == "DBUSERDATA" )
     {
-        if( pElement->Attribute("iowner") == NULL || !IsLocalClient( rConnection ) )
+        CheckUserDataOwner( rConnection, pElement );
+
+        ostringstream DBStream;
+        DBStream << *pElement << endl;
+        DEBUG(  "sending to db: " << DBStream.str() ); // DEBUG
+        SocketDBInterface.Send( DBStream.str().c_str(), DBStream.str().size() );
+
+        vector< TiXmlElement * > Changes;
+        Changes.push_back( pElement );
+        NotifyUserDataChanged( rConnection, Changes );
+    }
+}
+
+//! Processes a batch of database script data setinfo requests, as sent by the scripting engine's user data cache
+//! The batch goes to dbinterface as one message
+void SetInfoBatchFromXML( CONNECTION &rConnection, TiXmlElement *pElement )
+{
+    string sType = pElement->Attribute("type" );
+
+    if( sType == "DBUSERDATA" )
+    {
+        vector< TiXmlElement * > Changes;
+        for( TiXmlElement *pSetInfoElement = pElement->FirstChildElement("setinfo"); pSetInfoElement != NULL; pSetInfoElement = pSetInfoElement->NextSiblingElement("setinfo") )
         {
-            pElement->SetAttribute("iowner", rConnection.iForeignReference );
+            CheckUserDataOwner( rConnection, pSetInfoElement );
+            Changes.push_back( pSetInfoElement );
         }
 
         ostringstream DBStream;
         DBStream << *pElement << endl;
         DEBUG(  "sending to db: " << DBStream.str() ); // DEBUG
-        SocketDBInterface.Send( DBStream.str().c_str() );
+        SocketDBInterface.Send( DBStream.str().c_str(), DBStream.str().size() );
+
+        NotifyUserDataChanged( rConnection, Changes );
     }
 }
 
@@ -976,106 +1389,111 @@ void ProcessDBInterfaceMessages()
         if( ReadBuffer[0] == '<' )
         {
             DEBUG( "received xml from dbinterface, socket " << SocketDBInterface.GetSocket() << " " << ReadBuffer );
-            TiXmlDocument IPC;
-            IPC.Parse( ReadBuffer );
-            if( strcmp( IPC.RootElement()->Value(), "loginaccept" ) == 0 )
+            IPCMessageType MessageType = GetIPCMessageType( ReadBuffer );
+            LOGINRESULTMESSAGE LoginResult;
+            if( MessageType == IPC_LOGINACCEPT && ParseLoginResult( ReadBuffer, LoginResult ) )
             {
                 ConnectionsIteratorTypedef iterator;
-                iterator = MetaverseServerConnectionManager.Connections.find( atoi( IPC.RootElement()->Attribute("iconnectionref") ) );
+                iterator = MetaverseServerConnectionManager.Connections.find( LoginResult.iConnectionRef );
                 if( iterator != MetaverseServerConnectionManager.Connections.end() )
                 {
                     CONNECTION &rConnection = iterator->second;
 
-                    if( MetaverseServerConnectionManager.NumClientConnectionsWithName( IPC.RootElement()->Attribute("name") ) == 0 )
+                    if( MetaverseServerConnectionManager.NumClientConnectionsWithName( LoginResult.sName ) == 0 )
                     {
-                        rConnection.name = IPC.RootElement()->Attribute("name");
+                        rConnection.name = LoginResult.sName;
                         rConnection.bAuthenticated = true;
-                        rConnection.iForeignReference = atoi( IPC.RootElement()->Attribute("ireference" ) );
-                        sprintf( SendBuffer, "<loginaccept name=\"%s\" ireference=\"%i\"/>\n", IPC.RootElement()->Attribute("name"), rConnection.iForeignReference );
+                        rConnection.iForeignReference = LoginResult.iReference;
+                        sprintf( SendBuffer, "<loginaccept name=\"%s\" ireference=\"%i\"/>\n", LoginResult.sName, rConnection.iForeignReference );
                         DEBUG(  "sending to client " << SendBuffer ); // DEBUG
                         MetaverseServerConnectionManager.SendThruConnection( rConnection, SendBuffer );
                     }
                     else
                     {
-                        sprintf( SendBuffer, "<loginreject name=\"%s\" reason=\"alreadyconnected\"/>\n", IPC.RootElement()->Attribute("name") );
+                        sprintf( SendBuffer, "<loginreject name=\"%s\" reason=\"alreadyconnected\"/>\n", LoginResult.sName );
                         printf( "sending to client [%s]\n", SendBuffer );
                         MetaverseServerConnectionManager.SendThruConnection( rConnection, SendBuffer );
 
-                        DEBUG(  "Kicking client " << IPC.RootElement()->Attribute("name") << " : avatar already connected" ); // DEBUG
+                        DEBUG(  "Kicking client " << LoginResult.sName << " : avatar already connected" ); // DEBUG
                         MetaverseServerConnectionManager.CloseConnectionNow( rConnection );
                     }
                 }
             }
-            else if( strcmp( IPC.RootElement()->Value(), "loginreject" ) == 0 )
+            else if( MessageType == IPC_LOGINREJECT && ParseLoginResult( ReadBuffer, LoginResult ) )
             {
                 ConnectionsIteratorTypedef iterator;
-                iterator = MetaverseServerConnectionManager.Connections.find( atoi( IPC.RootElement()->Attribute("iconnectionref") ) );
+                iterator = MetaverseServerConnectionManager.Connections.find( LoginResult.iConnectionRef );
                 if( iterator != MetaverseServerConnectionManager.Connections.end() )
                 {
                     CONNECTION &rConnection = iterator->second;
 
-                    sprintf( SendBuffer, "<loginreject name=\"%s\" reason=\"failedauth\"/>\n", IPC.RootElement()->Attribute("name") );
+                    sprintf( SendBuffer, "<loginreject name=\"%s\" reason=\"failedauth\"/>\n", LoginResult.sName );
                     DEBUG(  "sending to client " << SendBuffer ); // DEBUG
                     MetaverseServerConnectionManager.SendThruConnection( rConnection, SendBuffer );
 
-                    DEBUG(  "Kicking client " << IPC.RootElement()->Attribute("name") << " for failed auth" ); // DEBUG
+                    DEBUG(  "Kicking client " << LoginResult.sName << " for failed auth" ); // DEBUG
                     MetaverseServerConnectionManager.CloseConnectionNow( rConnection );
                 }
             }
-            else if( strcmp( IPC.RootElement()->Value(), "objectcreate" ) == 0 )
+            else if( MessageType != IPC_UNKNOWN )
             {
-                DEBUG( "received object create from db" );
+                TiXmlDocument IPC;
+                IPC.Parse( ReadBuffer );
+                if( IPC.RootElement() == NULL )
+                {
+                    return;
+                }
 
-                CacheAndBroadcastObjectFromDB( IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "skyboxupdate" ) == 0 )
-            {
-                DEBUG( "received skybox update from db");
-                CacheAndBroadcastSkyboxFromDB( IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "objectdelete" ) == 0 )
-            {
-                DEBUG( "received object delete from db" );
+                switch( MessageType )
+                {
+                case IPC_OBJECTCREATE:
+                    DEBUG( "received object create from db" );
+                    CacheAndBroadcastObjectFromDB( IPC.RootElement() );
+                    break;
 
-                CacheAndBroadcastObjectDeleteFromDB( IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "texture" ) == 0 )
-            {
-                DEBUG( "received texture info from db" );
+                case IPC_SKYBOXUPDATE:
+                    DEBUG( "received skybox update from db");
+                    CacheAndBroadcastSkyboxFromDB( IPC.RootElement() );
+                    break;
 
-                CacheAndBroadcastTextureFromDB( IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "meshfile" ) == 0 )
-            {
-                DEBUG( "received meshfile info from db" );
+                case IPC_OBJECTDELETE:
+                    DEBUG( "received object delete from db" );
+                    CacheAndBroadcastObjectDeleteFromDB( IPC.RootElement() );
+                    break;
 
-                CacheAndBroadcastMeshfileFromDB( IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "terrain" ) == 0 )
-            {
-                DEBUG( "received terrain info from db" );
+                case IPC_TEXTURE:
+                    DEBUG( "received texture info from db" );
+                    CacheAndBroadcastTextureFromDB( IPC.RootElement() );
+                    break;
 
-                CacheAndBroadcastTerrainFromDB( IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "script" ) == 0 )
-            {
-                DEBUG( "received script info from db" );
+                case IPC_MESHFILE:
+                    DEBUG( "received meshfile info from db" );
+                    CacheAndBroadcastMeshfileFromDB( IPC.RootElement() );
+                    break;
 
-                CacheAndBroadcastScriptFromDB( IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "inforesponse" ) == 0 )
-            {
-                DEBUG( "received inforesponse from db" );
+                case IPC_TERRAIN:
+                    DEBUG( "received terrain info from db" );
+                    CacheAndBroadcastTerrainFromDB( IPC.RootElement() );
+                    break;
 
-                ProcessInfoResponseFromDB( IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "objectrefreshdata" ) == 0 )
-            {
-                DEBUG( "received object refresh from db" );
-                char Type[17];
-                sprintf( Type, "%.16s", IPC.RootElement()->Attribute( "type") );
+                case IPC_SCRIPT:
+                    DEBUG( "received script info from db" );
+                    CacheAndBroadcastScriptFromDB( IPC.RootElement() );
+                    break;
+
+                case IPC_INFORESPONSE:
+                    DEBUG( "received inforesponse from db" );
+                    ProcessInfoResponseFromDB( IPC.RootElement() );
+                    break;
+
+                case IPC_OBJECTREFRESHDATA:
+                    DEBUG( "received object refresh from db" );
+                    CacheAndBroadcastObjectFromDB( IPC.RootElement() );
+                    break;
 
-                CacheAndBroadcastObjectFromDB( IPC.RootElement() );
+                default:
+                    break;
+                }
             }
         }
         else
@@ -1102,17 +1520,17 @@ void HandleClientInput( int iConnectionRef, CONNECTION &rConnection, char *Messa
     {
         string a = inet_ntoa(rConnection.connectionsocket.GetPeer());
         DEBUG(  "received xml from client ref " << rConnection.iForeignReference << " socket " << rConnection.connectionsocket.GetSocket() << " ip " << a << " [" << Message << "]" ); // DEBUG
-        TiXmlDocument IPC;
-        IPC.Parse( Message );
+        IPCMessageType MessageType = GetIPCMessageType( Message );
         DEBUG(  "bauthenticated for this client = " << rConnection.bAuthenticated ); // DEBUG
         if( !rConnection.bAuthenticated )
         {
-            if( strcmp( IPC.RootElement()->Value(), "login" ) == 0 )
+            LOGINMESSAGE Login;
+            if( MessageType == IPC_LOGIN && ParseLogin( Message, Login ) )
             {
                 sprintf( SendBuffer, "<login iconnectionref=\"%i\" name=\"%s\" password=\"%s\"/>\n",
                          iConnectionRef,
-                         IPC.RootElement()->Attribute("name"),
-                         IPC.RootElement()->Attribute("password") );
+                         Login.sName,
+                         Login.sPassword );
                 DEBUG( "Sending to db " << SendBuffer );
                 SocketDBInterface.Send( SendBuffer );
 
@@ -1128,61 +1546,94 @@ void HandleClientInput( int iConnectionRef, CONNECTION &rConnection, char *Messa
                 //}
             }
         }
-        else
+        else if( MessageType == IPC_OBJECTMOVE )
         {
-            if( strcmp( IPC.RootElement()->Value(), "requestworldstate" ) == 0 )
+            // moves are most of what clients send; they dont need the whole document built
+            OBJECTMOVEMESSAGE Move;
+            if( ParseObjectMove( Message, Move ) )
             {
-                SendCurrentDataToConnection( rConnection );
+                MoveObjectAndBroadcast( Move );
             }
-            else if( strcmp( IPC.RootElement()->Value(), "objectcreate" ) == 0 )
+        }
+        else if( MessageType == IPC_OBJECTTRACK )
+        {
+            OBJECTTRACKMESSAGE Track;
+            if( ParseObjectTrack( Message, Track ) )
             {
-                StoreObjectInDB( rConnection.iForeignReference, IPC.RootElement() );
+                SetTrackAndBroadcast( Track, Message );
             }
-            else if( strcmp( IPC.RootElement()->Value(), "objectimport" ) == 0 )
+        }
+        else
+        {
+            TiXmlDocument IPC;
+            IPC.Parse( Message );
+            if( IPC.RootElement() == NULL )
             {
-                StoreObjectInDB( rConnection.iForeignReference, IPC.RootElement() );
+                return;
             }
-            else if( strcmp( IPC.RootElement()->Value(), "objectupdate" ) == 0 )
+
+            switch( MessageType )
             {
+            case IPC_REQUESTWORLDSTATE:
+                SendCurrentDataToConnection( rConnection, IPC.RootElement() );
+                MoveSendScheduler.ConnectionSynced( iConnectionRef, WorldChangeLog.GetVersion(), MVGetTickCount() );
+                break;
+
+            case IPC_OBJECTCREATE:
+            case IPC_OBJECTIMPORT:
+                StoreObjectInDB( rConnection.iForeignReference, IPC.RootElement() );
+                break;
+
+            case IPC_OBJECTUPDATE:
                 UpdateObjectCachetoDBAndBroadcast( rConnection.iForeignReference, IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "skyboxupdate" ) == 0 )
-            {
+                break;
+
+            case IPC_SKYBOXUPDATE:
                 UpdateSkyboxCachetoDBAndBroadcast( rConnection.iForeignReference, IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "requestinfo" ) == 0 )
-            {
+                break;
+
+            case IPC_REQUESTINFO:
                 SendInfoResponse( rConnection, IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "setinfo" ) == 0 )
-            {
+                break;
+
+            case IPC_SETINFO:
                 SetInfoFromXML( rConnection, IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "event" ) == 0 )
-            {
+                break;
+
+            case IPC_SETINFOBATCH:
+                SetInfoBatchFromXML( rConnection, IPC.RootElement() );
+                break;
+
+            case IPC_EVENT:
                 HandleEvent( rConnection.iForeignReference, IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "hyperlinkagent" ) == 0 )
-            {
+                break;
+
+            case IPC_HYPERLINKAGENT:
                 HyperlinkAgentFromXML( rConnection, IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "objectdelete" ) == 0 )
-            {
+                break;
+
+            case IPC_OBJECTDELETE:
                 DeleteObjectFromDB( rConnection.iForeignReference, IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "objectmove" ) == 0 )
-            {
-                MoveObjectAndBroadcast( IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "comm" ) == 0 )
-            {
+                break;
+
+            case IPC_COMM:
                 DEBUG("Handle Input, Process Comm");
                 ProcessComm( rConnection, IPC.RootElement() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "capture" ) == 0 )
-            {
+                break;
+
+            case IPC_CAPTURE:
                 if (IsLocalClient(rConnection))
                 {
+                    const char *sWhat = IPC.RootElement()->Attribute("what");
+                    if( sWhat != NULL && strcmp( sWhat, "wholekeyboard" ) == 0 )
+                    {
+                        ScriptingEngineShards.AddKeyboardCapture( atoi( IPC.RootElement()->Attribute("iowner") ), atoi( IPC.RootElement()->Attribute("ireference") ) );
+                    }
+                    else if( sWhat != NULL && strcmp( sWhat, "wholekeyboardoff" ) == 0 )
+                    {
+                        ScriptingEngineShards.RemoveKeyboardCaptures( atoi( IPC.RootElement()->Attribute("ireference") ) );
+                    }
+
                     int iReference = atoi(IPC.RootElement()->Attribute("iowner"));
                     DEBUG("Sending capture to client: " << iReference);
                     ostringstream clientmessagestream;
@@ -1192,26 +1643,35 @@ void HandleClientInput( int iConnectionRef, CONNECTION &rConnection, char *Messa
                     MetaverseServerConnectionManager.SendThruConnection( rConnection2 , clientmessagestream.str().c_str());
 
                 }
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "keyup" ) == 0 )
-            {
-                ostringstream messagestream;
+                break;
 
-                IPC.RootElement()->SetAttribute("iowner", rConnection.iForeignReference );
+            case IPC_KEYUP:
+            case IPC_KEYDOWN:
+                {
+                    ostringstream messagestream;
 
-                messagestream << *IPC.RootElement() << endl;
-                DEBUG("broadcasting to local clients: " << messagestream.str() ); // DEBUG
-                BroadcastToLocalClients( messagestream.str().c_str() );
-            }
-            else if( strcmp( IPC.RootElement()->Value(), "keydown" ) == 0 )
-            {
-                ostringstream messagestream;
+                    IPC.RootElement()->SetAttribute("iowner", rConnection.iForeignReference );
+
+                    messagestream << *IPC.RootElement() << endl;
+                    DEBUG("sending to keyboard capturers: " << messagestream.str() ); // DEBUG
+                    SendKeyboardEventToScripts( rConnection.iForeignReference, messagestream.str().c_str() );
+                }
+                break;
+
+            case IPC_REGISTERSCRIPTINGENGINE:
+                RegisterScriptingEngine( iConnectionRef, rConnection );
+                break;
+
+            case IPC_SCRIPTSHARDSTATE:
+                CompleteScriptMigration( iConnectionRef, IPC.RootElement() );
+                break;
 
-                IPC.RootElement()->SetAttribute("iowner", rConnection.iForeignReference );
+            case IPC_MULTICASTRPC:
+                RelayMulticastRPC( iConnectionRef, Message );
+                break;
 
-                messagestream << *IPC.RootElement() << endl;
-                DEBUG("broadcasting to local clients: " << messagestream.str() ); // DEBUG
-                BroadcastToLocalClients( messagestream.str().c_str() );
+            default:
+                break;
             }
         }
     }
@@ -1259,7 +1719,8 @@ void RegisterNewFileWithDB( TiXmlElement *p_Element )
     if( type == "TEXTURE" )
     {
         DEBUG(  "received texture" ); // DEBUG
-        textureinfocache.AddTextureInfoFromXML( p_Element );
+        TEXTUREINFO &rTextureInfo = textureinfocache.AddTextureInfoFromXML( p_Element );
+        FileManifest.Add( "texture", rTextureInfo.sChecksum, rTextureInfo.sServerFilename, rTextureInfo.sSourceFilename );
         ostringstream clientmessagestream;
         //    clientmessagestream << "<texture checksum=\"" << p_Element->Attribute("checksum") << "\" sourcefilename=\"" << p_Element->Attribute("sourcefilename") << "\"/>" ); // DEBUG
         clientmessagestream << "<texture checksum=\"" << p_Element->Attribute("checksum") << "\" serverfilename=\"" << p_Element->Attribute("sourcefilename") << "\" sourcefilename=\"" << p_Element->Attribute("sourcefilename") << "\"/>" << endl;
@@ -1268,7 +1729,8 @@ void RegisterNewFileWithDB( TiXmlElement *p_Element )
     else if( type == "TERRAIN" )
     {
         DEBUG(  "received terrain" ); // DEBUG
-        TerrainCache.AddTerrainInfoFromXML( p_Element );
+        TerrainINFO &rTerrainInfo = TerrainCache.AddTerrainInfoFromXML( p_Element );
+        FileManifest.Add( "terrain", rTerrainInfo.sChecksum, rTerrainInfo.sServerFilename, rTerrainInfo.sSourceFilename );
         ostringstream clientmessagestream;
         //    clientmessagestream << "<texture checksum=\"" << p_Element->Attribute("checksum") << "\" sourcefilename=\"" << p_Element->Attribute("sourcefilename") << "\"/>" ); // DEBUG
         clientmessagestream << "<terrain checksum=\"" << p_Element->Attribute("checksum") << "\" serverfilename=\"" << p_Element->Attribute("sourcefilename") << "\" sourcefilename=\"" << p_Element->Attribute("sourcefilename") << "\"/>" << endl;
@@ -1277,7 +1739,8 @@ void RegisterNewFileWithDB( TiXmlElement *p_Element )
     else if( type == "MESHFILE" )
     {
         DEBUG(  "received md2mesh" ); // DEBUG
-        MeshInfoCache.AddFileInfoFromXML( p_Element );
+        FILEINFO &rMeshInfo = MeshInfoCache.AddFileInfoFromXML( p_Element );
+        FileManifest.Add( "meshfile", rMeshInfo.sChecksum, rMeshInfo.sServerFilename, rMeshInfo.sSourceFilename );
         ostringstream clientmessagestream;
         clientmessagestream << "<meshfile checksum=\"" << p_Element->Attribute("checksum") << "\" serverfilename=\"" << p_Element->Attribute("sourcefilename") << "\" sourcefilename=\"" << p_Element->Attribute("sourcefilename") << "\"/>" << endl;
         DEBUG(  "sending to clients " << clientmessagestream.str() ); // DEBUG
@@ -1286,7 +1749,8 @@ void RegisterNewFileWithDB( TiXmlElement *p_Element )
     else if( type == "SCRIPT" )
     {
         DEBUG(  "received script" ); // DEBUG
-        ScriptInfoCache.AddInfoFromXML( p_Element );
+        SCRIPTINFO &rScriptInfo = ScriptInfoCache.AddInfoFromXML( p_Element );
+        FileManifest.Add( "script", rScriptInfo.sChecksum, rScriptInfo.sServerFilename, rScriptInfo.sSourceFilename );
         ostringstream clientmessagestream;
         clientmessagestream << "<script checksum=\"" << p_Element->Attribute("checksum") << "\" serverfilename=\"" << p_Element->Attribute("sourcefilename") << "\" sourcefilename=\"" << p_Element->Attribute("sourcefilename") << "\"/>" << endl;
         BroadcastToLocalClients( clientmessagestream.str().c_str() );
@@ -1429,7 +1893,7 @@ bool ConnectToAuthServer()
     return bResult;
 }
 
-//! Sends information about objects collisions to the scripting engines (ie, to locally connected clients)
+//! Sends information about objects collisions to the scripting engines that run the scripts of the collision targets
 void SendCollisionsToScripts()
 {
     // new entries in Collisions get collisionstart
@@ -1465,7 +1929,7 @@ void SendCollisionsToScripts()
             started.push_back(Collisions[i].iTarget);
             ostringstream clientmessagestream;
             clientmessagestream << "<collisionstart itarget=\"" << Collisions[i].iTarget << "\" ireference=\"" << Collisions[i].iCollidingObjectReference << "\"/>" << endl;
-            BroadcastToLocalClients( clientmessagestream.str().c_str() );
+            SendToScriptOwner( Collisions[i].iTarget, clientmessagestream.str().c_str() );
         }
     }
 
@@ -1492,8 +1956,8 @@ void SendCollisionsToScripts()
             if (f == -1)
             {
                 ostringstream clientmessagestream;
-                clientmessagestream << "<collisionend itarget=\"" << Collisions[i].iTarget << "\" ireference=\"" << Collisions[i].iCollidingObjectReference << "\"/>" << endl;
-                BroadcastToLocalClients( clientmessagestream.str().c_str() );
+                clientmessagestream << "<collisionend itarget=\"" << Colliding[i].iTarget << "\" ireference=\"" << Colliding[i].iCollidingObjectReference << "\"/>" << endl;
+                SendToScriptOwner( Colliding[i].iTarget, clientmessagestream.str().c_str() );
             }
         }
     }
@@ -1531,8 +1995,12 @@ void MainLoop()
         //DEBUG(" call scripts ");
         SendCollisionsToScripts();
 
+        SendScheduledMoves();
+        ReportMoveCompression();
         ManageDirtyCache();    // objects that have moved and not been written to db
+        BroadcastWorldVersion();
 
+        CheckForLostScriptingEngines();
         ServerConsoleConnectionManager.PurgeDisconnectedConnections();
         MetaverseServerConnectionManager.PurgeDisconnectedConnections();
     }
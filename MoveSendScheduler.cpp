@@ -0,0 +1,369 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Decides which object moves to send to each client, and when, within a bandwidth budget
+//!
+//! Rather than forwarding every objectmove to every client as it arrives, the server hands moves to
+//! ObjectMoved, which merges them into the latest state of each object.  Once a frame, GetMovesToSend is
+//! called for each connection, and works out, for each object that has moved, how far what the connection
+//! was last sent is from the latest state, in multiples of the thresholds: position (and scale) in world
+//! units, rotation as the angle between the two rotations.  Objects more than one threshold out are sent,
+//! and so are objects that have been out by any amount for longer than iMaxDelayMilliseconds, so small
+//! moves still arrive eventually.  Objects the connection has never been sent, or whose color changed,
+//! are always sent.
+//!
+//! Each connection has a budget of iBytesPerSecond, topped up each frame and saved up to iBurstBytes.
+//! Moves are sent in priority order, error plus age divided by one plus the distance from the object to the
+//! connection's avatar, while the budget lasts.  Moves that dont fit wait for the next frame, by which
+//! time they may have been overtaken by newer ones, and are then sent only once.
+//!
+//! Each move carries the world version WorldChangeLog gave it, so GetVersionSent can tell the server which
+//! version a connection has really been sent everything up to.  Announcing the latest world version instead
+//! would let a client that reconnects ask only for changes since, and never get the moves still waiting for it.
+//!
+//! GetNumNaiveSends counts the moves we'd have sent just forwarding every move to every connection, so
+//! GetNumNaiveSends() / GetNumMovesSent() is the compression this gets us.
+
+#include "MoveSendScheduler.h"
+
+#include <math.h>
+#include <algorithm>
+
+#include "XmlHelper.h"
+
+//! one move a connection could be sent, with its priority, for sorting
+struct MOVECANDIDATE
+{
+    float fPriority;
+    map< int, PENDINGMOVE >::const_iterator Pending;
+};
+
+static bool HigherPriority( const MOVECANDIDATE &Candidate1, const MOVECANDIDATE &Candidate2 )
+{
+    return Candidate1.fPriority > Candidate2.fPriority;
+}
+
+MoveSendSchedulerClass::MoveSendSchedulerClass( float fNewPosThreshold, float fNewRotThreshold, int iNewMaxDelayMilliseconds, int iNewBytesPerSecond, int iNewBurstBytes )
+{
+    fPosThreshold = fNewPosThreshold;
+    fRotThreshold = fNewRotThreshold;
+    iMaxDelayMilliseconds = iNewMaxDelayMilliseconds;
+    iBytesPerSecond = iNewBytesPerSecond;
+    iBurstBytes = iNewBurstBytes;
+
+    iNumMovesReceived = 0;
+    iNumNaiveSends = 0;
+    iNumMovesSent = 0;
+}
+
+void MoveSendSchedulerClass::ObjectMoved( const OBJECTMOVEMESSAGE &Move, int iVersion, int iNumReceivers, int iTickCount )
+{
+    iNumMovesReceived++;
+    iNumNaiveSends += iNumReceivers;
+
+    map< int, PENDINGMOVE >::iterator pendingiterator = PendingMoves.find( Move.iReference );
+    if( pendingiterator == PendingMoves.end() )
+    {
+        PENDINGMOVE NewPending;
+        NewPending.Move = Move;
+        NewPending.iSequence = 0;
+        pendingiterator = PendingMoves.insert( pair< int, PENDINGMOVE >( Move.iReference, NewPending ) ).first;
+    }
+    else
+    {
+        // fields this move doesnt set keep their value from earlier moves; the rest are the newest
+        OBJECTMOVEMESSAGE &Merged = pendingiterator->second.Move;
+        if( Move.bPos )
+        {
+            Merged.bPos = true;
+            Merged.Pos = Move.Pos;
+        }
+        if( Move.bRot )
+        {
+            Merged.bRot = true;
+            Merged.Rotation = Move.Rotation;
+        }
+        if( Move.bScale )
+        {
+            Merged.bScale = true;
+            Merged.Scale = Move.Scale;
+        }
+        if( Move.bColor )
+        {
+            Merged.bColor = true;
+            Merged.iFaceNumber = Move.iFaceNumber;
+            Merged.FaceColor = Move.FaceColor;
+        }
+        Merged.iDurationMilliseconds = Move.iDurationMilliseconds;
+        Merged.iTimestampMilliseconds = Move.iTimestampMilliseconds;
+        Merged.bVelocity = Move.bVelocity;
+        Merged.Velocity = Move.Velocity;
+        pendingiterator->second.iSequence++;
+    }
+
+    PENDINGMOVE &Pending = pendingiterator->second;
+    Pending.iVersion = iVersion;
+    Pending.iTickCount = iTickCount;
+    Pending.Message.clear();
+    XmlWriter Writer( Pending.Message );
+    WriteObjectMove( Pending.Move, Writer );
+    Pending.Message += '\n';
+}
+
+void MoveSendSchedulerClass::ObjectRemoved( int iReference )
+{
+    PendingMoves.erase( iReference );
+    map< int, MOVERECEIVER >::iterator receiveriterator;
+    for( receiveriterator = Receivers.begin(); receiveriterator != Receivers.end(); receiveriterator++ )
+    {
+        receiveriterator->second.SentMoves.erase( iReference );
+    }
+}
+
+void MoveSendSchedulerClass::ConnectionSynced( int iConnectionRef, int iVersion, int iTickCount )
+{
+    MOVERECEIVER &Receiver = Receivers[ iConnectionRef ];
+    Receiver.SentMoves.clear();
+    Receiver.fBudgetBytes = (float)iBurstBytes;
+    Receiver.iLastTickCount = iTickCount;
+    Receiver.iSyncedVersion = iVersion;
+
+    map< int, PENDINGMOVE >::const_iterator pendingiterator;
+    for( pendingiterator = PendingMoves.begin(); pendingiterator != PendingMoves.end(); pendingiterator++ )
+    {
+        SENTMOVE Sent;
+        Sent.Move = pendingiterator->second.Move;
+        Sent.iSequence = pendingiterator->second.iSequence;
+        Sent.iVersion = pendingiterator->second.iVersion;
+        Sent.iTickCount = iTickCount;
+        Receiver.SentMoves.insert( pair< int, SENTMOVE >( pendingiterator->first, Sent ) );
+    }
+}
+
+// Input: Latest: latest state of an object; Sent: what a connection was last sent for it
+// Returns: how far Sent is from Latest, in multiples of the thresholds; bMustSend is set if Sent is missing something Latest has
+// Description: rotation error is the angle between the two rotations; scale is measured against the position threshold
+float MoveSendSchedulerClass::GetError( const OBJECTMOVEMESSAGE &Latest, const OBJECTMOVEMESSAGE &Sent, bool &bMustSend ) const
+{
+    bMustSend = false;
+    float fError = 0;
+    if( Latest.bPos )
+    {
+        if( !Sent.bPos )
+        {
+            bMustSend = true;
+        }
+        else
+        {
+            fError = VectorMag( Latest.Pos - Sent.Pos ) / fPosThreshold;
+        }
+    }
+    if( Latest.bRot )
+    {
+        if( !Sent.bRot )
+        {
+            bMustSend = true;
+        }
+        else
+        {
+            float fDot = fabs( Latest.Rotation.x * Sent.Rotation.x + Latest.Rotation.y * Sent.Rotation.y
+                + Latest.Rotation.z * Sent.Rotation.z + Latest.Rotation.s * Sent.Rotation.s );
+            if( fDot > 1.0 )
+            {
+                fDot = 1.0;
+            }
+            float fRotError = 2 * (float)acos( fDot ) / fRotThreshold;
+            if( fRotError > fError )
+            {
+                fError = fRotError;
+            }
+        }
+    }
+    if( Latest.bScale )
+    {
+        if( !Sent.bScale )
+        {
+            bMustSend = true;
+        }
+        else
+        {
+            float fScaleError = VectorMag( Latest.Scale - Sent.Scale ) / fPosThreshold;
+            if( fScaleError > fError )
+            {
+                fError = fScaleError;
+            }
+        }
+    }
+    if( Latest.bColor )
+    {
+        if( !Sent.bColor || Latest.iFaceNumber != Sent.iFaceNumber || Latest.FaceColor.r != Sent.FaceColor.r || Latest.FaceColor.g != Sent.FaceColor.g
+            || Latest.FaceColor.b != Sent.FaceColor.b )
+        {
+            bMustSend = true;
+        }
+    }
+    return fError;
+}
+
+void MoveSendSchedulerClass::GetMovesToSend( int iConnectionRef, const Vector3 *pReceiverPos, int iTickCount, vector< const string * > &Messages )
+{
+    map< int, MOVERECEIVER >::iterator receiveriterator = Receivers.find( iConnectionRef );
+    if( receiveriterator == Receivers.end() )
+    {
+        // not synced yet; it'll get the latest of everything when it is
+        return;
+    }
+    MOVERECEIVER &Receiver = receiveriterator->second;
+
+    Receiver.fBudgetBytes += (float)iBytesPerSecond * (float)( iTickCount - Receiver.iLastTickCount ) / 1000.0f;
+    if( Receiver.fBudgetBytes > (float)iBurstBytes )
+    {
+        Receiver.fBudgetBytes = (float)iBurstBytes;
+    }
+    Receiver.iLastTickCount = iTickCount;
+
+    vector< MOVECANDIDATE > Candidates;
+    map< int, PENDINGMOVE >::const_iterator pendingiterator;
+    for( pendingiterator = PendingMoves.begin(); pendingiterator != PendingMoves.end(); pendingiterator++ )
+    {
+        const PENDINGMOVE &Pending = pendingiterator->second;
+        float fError = 0;
+        float fAgeFraction = 0;
+        bool bMustSend = true;
+        map< int, SENTMOVE >::const_iterator sentiterator = Receiver.SentMoves.find( pendingiterator->first );
+        if( sentiterator != Receiver.SentMoves.end() )
+        {
+            if( sentiterator->second.iSequence == Pending.iSequence )
+            {
+                continue;
+            }
+            fError = GetError( Pending.Move, sentiterator->second.Move, bMustSend );
+            fAgeFraction = (float)( iTickCount - sentiterator->second.iTickCount ) / (float)iMaxDelayMilliseconds;
+            if( !bMustSend && fError <= 1.0f && fAgeFraction <= 1.0f )
+            {
+                continue;
+            }
+        }
+
+        MOVECANDIDATE Candidate;
+        Candidate.fPriority = fError + fAgeFraction + ( bMustSend ? 10.0f : 0.0f );
+        if( pReceiverPos != NULL && Pending.Move.bPos )
+        {
+            Candidate.fPriority /= 1.0f + VectorMag( Pending.Move.Pos - *pReceiverPos );
+        }
+        Candidate.Pending = pendingiterator;
+        Candidates.push_back( Candidate );
+    }
+
+    sort( Candidates.begin(), Candidates.end(), HigherPriority );
+
+    for( int i = 0; i < (int)Candidates.size() && Receiver.fBudgetBytes > 0; i++ )
+    {
+        const PENDINGMOVE &Pending = Candidates[i].Pending->second;
+        Messages.push_back( &Pending.Message );
+        Receiver.fBudgetBytes -= (float)Pending.Message.size();
+        iNumMovesSent++;
+
+        SENTMOVE &Sent = Receiver.SentMoves[ Candidates[i].Pending->first ];
+        Sent.Move = Pending.Move;
+        Sent.iSequence = Pending.iSequence;
+        Sent.iVersion = Pending.iVersion;
+        Sent.iTickCount = iTickCount;
+    }
+}
+
+// Input: iConnectionRef: the connection; iWorldVersion: WorldChangeLog's version now
+// Returns: the world version the connection has been sent every move up to, or -1 if it's not synced
+// Description: an object the connection is behind on has changed since the version it was last sent, or since
+// the connection synced if it's been sent nothing since, so everything up to the earliest of those has gone
+int MoveSendSchedulerClass::GetVersionSent( int iConnectionRef, int iWorldVersion ) const
+{
+    map< int, MOVERECEIVER >::const_iterator receiveriterator = Receivers.find( iConnectionRef );
+    if( receiveriterator == Receivers.end() )
+    {
+        return -1;
+    }
+    const MOVERECEIVER &Receiver = receiveriterator->second;
+
+    int iVersionSent = iWorldVersion;
+    map< int, PENDINGMOVE >::const_iterator pendingiterator;
+    for( pendingiterator = PendingMoves.begin(); pendingiterator != PendingMoves.end(); pendingiterator++ )
+    {
+        int iBehindSince = Receiver.iSyncedVersion;
+        map< int, SENTMOVE >::const_iterator sentiterator = Receiver.SentMoves.find( pendingiterator->first );
+        if( sentiterator != Receiver.SentMoves.end() )
+        {
+            if( sentiterator->second.iSequence == pendingiterator->second.iSequence )
+            {
+                continue;
+            }
+            iBehindSince = sentiterator->second.iVersion;
+        }
+        if( iBehindSince < iVersionSent )
+        {
+            iVersionSent = iBehindSince;
+        }
+    }
+    return iVersionSent;
+}
+
+void MoveSendSchedulerClass::ForgetOldMoves( const set< int > &ConnectionRefs, int iTickCount )
+{
+    map< int, MOVERECEIVER >::iterator receiveriterator = Receivers.begin();
+    while( receiveriterator != Receivers.end() )
+    {
+        if( ConnectionRefs.find( receiveriterator->first ) == ConnectionRefs.end() )
+        {
+            Receivers.erase( receiveriterator++ );
+        }
+        else
+        {
+            receiveriterator++;
+        }
+    }
+
+    // an object can go once it's been still a while and everyone has its latest state; a connection that
+    // syncs later gets it from the world anyway
+    map< int, PENDINGMOVE >::iterator pendingiterator = PendingMoves.begin();
+    while( pendingiterator != PendingMoves.end() )
+    {
+        bool bCanForget = iTickCount - pendingiterator->second.iTickCount > 10 * iMaxDelayMilliseconds;
+        for( receiveriterator = Receivers.begin(); bCanForget && receiveriterator != Receivers.end(); receiveriterator++ )
+        {
+            map< int, SENTMOVE >::const_iterator sentiterator = receiveriterator->second.SentMoves.find( pendingiterator->first );
+            if( sentiterator == receiveriterator->second.SentMoves.end() || sentiterator->second.iSequence != pendingiterator->second.iSequence )
+            {
+                bCanForget = false;
+            }
+        }
+        if( bCanForget )
+        {
+            for( receiveriterator = Receivers.begin(); receiveriterator != Receivers.end(); receiveriterator++ )
+            {
+                receiveriterator->second.SentMoves.erase( pendingiterator->first );
+            }
+            PendingMoves.erase( pendingiterator++ );
+        }
+        else
+        {
+            pendingiterator++;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Decides which object moves to send to each client, and when, within a bandwidth budget
+
+// see MoveSendScheduler.cpp for documentation
+
+#ifndef _MOVESENDSCHEDULER_H
+#define _MOVESENDSCHEDULER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Math.h"
+#include "IPCMessages.h"
+
+//! The latest state of one object, merged from the moves received for it
+struct PENDINGMOVE
+{
+   OBJECTMOVEMESSAGE Move;
+   int iSequence;    //!< goes up by one for each move received for the object
+   int iVersion;     //!< world version of the last move received
+   int iTickCount;   //!< when the last move was received
+   string Message;   //!< Move, written out as an objectmove line
+};
+
+//! What one connection was last sent about one object
+struct SENTMOVE
+{
+   OBJECTMOVEMESSAGE Move;
+   int iSequence;    //!< iSequence of the PENDINGMOVE it was
+   int iVersion;     //!< iVersion of the PENDINGMOVE it was
+   int iTickCount;   //!< when it was sent
+};
+
+//! One connection's moves sent, and its budget
+struct MOVERECEIVER
+{
+   map< int, SENTMOVE > SentMoves;   //!< by object reference
+   float fBudgetBytes;   //!< bytes the connection can be sent now
+   int iLastTickCount;   //!< when the budget was last topped up
+   int iSyncedVersion;   //!< world version when it was sent the whole world
+};
+
+//! MoveSendSchedulerClass decides which object moves to send to each client, and when, within a bandwidth budget
+
+//! MoveSendSchedulerClass decides which object moves to send to each client, and when, within a bandwidth budget
+//! Moves received are merged into the latest state of each object.  Each frame, GetMovesToSend picks the objects
+//! whose latest state is far enough from what a connection was last sent, nearest first, until its budget runs out.
+//! This class is only bookkeeping; sending the moves is left to the server
+class MoveSendSchedulerClass
+{
+public:
+   MoveSendSchedulerClass( float fPosThreshold, float fRotThreshold, int iMaxDelayMilliseconds, int iBytesPerSecond, int iBurstBytes );
+
+   void ObjectMoved( const OBJECTMOVEMESSAGE &Move, int iVersion, int iNumReceivers, int iTickCount );   //!< merges Move, world version iVersion, into the object's latest state; iNumReceivers is how many connections would have been sent it straight away
+   void ObjectRemoved( int iReference );   //!< forgets an object, eg when it's deleted
+   void ConnectionSynced( int iConnectionRef, int iVersion, int iTickCount );   //!< records that a connection has just been sent the whole world, as of world version iVersion, so is up to date with every object
+   void GetMovesToSend( int iConnectionRef, const Vector3 *pReceiverPos, int iTickCount, vector< const string * > &Messages );   //!< adds the moves to send through a connection now to Messages, and records them as sent; pReceiverPos is the connection's avatar position, or NULL
+   int GetVersionSent( int iConnectionRef, int iWorldVersion ) const;   //!< returns the world version a connection has been sent every move up to: iWorldVersion, or earlier if moves are waiting for it; -1 if it's not synced
+   void ForgetOldMoves( const set< int > &ConnectionRefs, int iTickCount );   //!< drops connections not in ConnectionRefs, and objects every connection is up to date with that havent moved for a while
+
+   int GetNumMovesReceived() const { return iNumMovesReceived; }
+   int GetNumNaiveSends() const { return iNumNaiveSends; }   //!< moves we'd have sent forwarding each move to each connection
+   int GetNumMovesSent() const { return iNumMovesSent; }
+
+protected:
+   float fPosThreshold;   //!< position and scale change worth sending, in world units
+   float fRotThreshold;   //!< rotation change worth sending, in radians
+   int iMaxDelayMilliseconds;   //!< longest a connection goes without a change, however small, if it has the budget
+   int iBytesPerSecond;   //!< budget for moves, per connection
+   int iBurstBytes;   //!< most budget a connection can save up
+
+   map< int, PENDINGMOVE > PendingMoves;   //!< by object reference
+   map< int, MOVERECEIVER > Receivers;   //!< by connection reference
+
+   int iNumMovesReceived;
+   int iNumNaiveSends;
+   int iNumMovesSent;
+
+   float GetError( const OBJECTMOVEMESSAGE &Latest, const OBJECTMOVEMESSAGE &Sent, bool &bMustSend ) const;   //!< how far Sent is from Latest, in thresholds
+};
+
+#endif // _MOVESENDSCHEDULER_H
@@ -0,0 +1,190 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief movesendschedulertest: headless tests that MoveSendScheduler delivers the moves it holds back
+//!
+//! Checks that a move too small to send straight away is sent once it's waited iMaxDelayMilliseconds;
+//! that moves a connection has no budget for are sent on later frames, each once, at their latest state;
+//! that an object a connection has never been sent goes at once; and that GetVersionSent only reaches the
+//! world version once every move up to it has been sent, so a reconnecting client is never told it has
+//! a move it was never sent.
+//! Prints each failed check, and exits non-zero if any failed.
+//!
+//! usage: movesendschedulertest
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "MoveSendScheduler.h"
+#include "IPCMessages.h"
+#include "TestCheck.h"
+
+const float fPosThreshold = 0.05f;
+const float fRotThreshold = 0.02f;
+const int iMaxDelayMilliseconds = 500;
+const int iBytesPerSecond = 32768;
+const int iBurstBytes = 8192;
+const int iFrameMilliseconds = 50;
+const int iConnectionRef = 3;
+
+//! returns a move of object iReference to Pos
+OBJECTMOVEMESSAGE MakeMove( const int iReference, const Vector3 &Pos )
+{
+    OBJECTMOVEMESSAGE Move;
+    Move.iReference = iReference;
+    Move.bPos = true;
+    Move.Pos = Pos;
+    Move.bRot = false;
+    Move.bScale = false;
+    Move.bColor = false;
+    Move.iFaceNumber = 0;
+    Move.iDurationMilliseconds = -1;
+    Move.iTimestampMilliseconds = -1;
+    Move.bVelocity = false;
+    return Move;
+}
+
+//! gets one frame's moves for the connection, parsed, into Moves by object reference; returns how many there were
+int GetFrame( MoveSendSchedulerClass &Scheduler, const int iTickCount, map< int, OBJECTMOVEMESSAGE > &Moves )
+{
+    vector< const string * > Messages;
+    Scheduler.GetMovesToSend( iConnectionRef, NULL, iTickCount, Messages );
+    for( int i = 0; i < (int)Messages.size(); i++ )
+    {
+        OBJECTMOVEMESSAGE Move;
+        CHECK( ParseObjectMove( Messages[i]->c_str(), Move ) );
+        CHECK( Moves.find( Move.iReference ) == Moves.end() );
+        Moves[ Move.iReference ] = Move;
+    }
+    return (int)Messages.size();
+}
+
+void TestSmallMoveSentAfterMaxDelay()
+{
+    MoveSendSchedulerClass Scheduler( fPosThreshold, fRotThreshold, iMaxDelayMilliseconds, iBytesPerSecond, iBurstBytes );
+    Scheduler.ObjectMoved( MakeMove( 7, Vector3( 0, 0, 0 ) ), 1, 1, 0 );
+    Scheduler.ConnectionSynced( iConnectionRef, 1, 0 );
+
+    map< int, OBJECTMOVEMESSAGE > Moves;
+    CHECK( GetFrame( Scheduler, iFrameMilliseconds, Moves ) == 0 );
+    CHECK( Scheduler.GetVersionSent( iConnectionRef, 1 ) == 1 );
+
+    Scheduler.ObjectMoved( MakeMove( 7, Vector3( fPosThreshold / 4, 0, 0 ) ), 2, 1, 2 * iFrameMilliseconds );
+    CHECK( Scheduler.GetVersionSent( iConnectionRef, 2 ) == 1 );
+
+    int iTickCount = 2 * iFrameMilliseconds;
+    int iSentTickCount = -1;
+    for( ; iTickCount <= 4 * iMaxDelayMilliseconds && iSentTickCount == -1; iTickCount += iFrameMilliseconds )
+    {
+        if( GetFrame( Scheduler, iTickCount, Moves ) > 0 )
+        {
+            iSentTickCount = iTickCount;
+        }
+        else
+        {
+            CHECK( Scheduler.GetVersionSent( iConnectionRef, 2 ) == 1 );
+        }
+    }
+    CHECK( iSentTickCount > iMaxDelayMilliseconds );
+    CHECK( iSentTickCount <= iMaxDelayMilliseconds + iFrameMilliseconds );
+    CHECK( Moves.size() == 1 && Moves[7].Pos.x == fPosThreshold / 4 );
+    CHECK( Scheduler.GetVersionSent( iConnectionRef, 2 ) == 2 );
+
+    Moves.clear();
+    CHECK( GetFrame( Scheduler, iTickCount + iMaxDelayMilliseconds, Moves ) == 0 );
+}
+
+void TestMovesOverBudgetSentLater()
+{
+    const int iNumObjects = 400;
+    MoveSendSchedulerClass Scheduler( fPosThreshold, fRotThreshold, iMaxDelayMilliseconds, iBytesPerSecond, iBurstBytes );
+    Scheduler.ConnectionSynced( iConnectionRef, 0, 0 );
+
+    int iVersion = 0;
+    for( int iReference = 1; iReference <= iNumObjects; iReference++ )
+    {
+        Scheduler.ObjectMoved( MakeMove( iReference, Vector3( (float)iReference, 0, 0 ) ), ++iVersion, 1, 0 );
+    }
+
+    map< int, OBJECTMOVEMESSAGE > Moves;
+    int iFirstFrameSends = GetFrame( Scheduler, 0, Moves );
+    CHECK( iFirstFrameSends > 0 );
+    CHECK( iFirstFrameSends < iNumObjects );
+    CHECK( Scheduler.GetVersionSent( iConnectionRef, iVersion ) < iVersion );
+
+    // the ones still waiting move again, and should be sent only at their latest position
+    for( int iReference = 1; iReference <= iNumObjects; iReference++ )
+    {
+        if( Moves.find( iReference ) == Moves.end() )
+        {
+            Scheduler.ObjectMoved( MakeMove( iReference, Vector3( (float)iReference, 1, 0 ) ), ++iVersion, 1, iFrameMilliseconds / 2 );
+        }
+    }
+    map< int, OBJECTMOVEMESSAGE > FirstMoves = Moves;
+
+    int iTickCount = iFrameMilliseconds;
+    for( ; iTickCount <= 10000 && Moves.size() < (size_t)iNumObjects; iTickCount += iFrameMilliseconds )
+    {
+        GetFrame( Scheduler, iTickCount, Moves );
+    }
+    CHECK( Moves.size() == (size_t)iNumObjects );
+    for( int iReference = 1; iReference <= iNumObjects; iReference++ )
+    {
+        float fY = FirstMoves.find( iReference ) != FirstMoves.end() ? 0.0f : 1.0f;
+        CHECK( Moves[ iReference ].Pos.x == (float)iReference && Moves[ iReference ].Pos.y == fY );
+    }
+    CHECK( Scheduler.GetVersionSent( iConnectionRef, iVersion ) == iVersion );
+    CHECK( Scheduler.GetNumMovesSent() == iNumObjects );
+}
+
+void TestNewObjectSentAtOnce()
+{
+    MoveSendSchedulerClass Scheduler( fPosThreshold, fRotThreshold, iMaxDelayMilliseconds, iBytesPerSecond, iBurstBytes );
+    Scheduler.ConnectionSynced( iConnectionRef, 5, 0 );
+    Scheduler.ObjectMoved( MakeMove( 9, Vector3( 0, 0, 0 ) ), 6, 1, 0 );
+    CHECK( Scheduler.GetVersionSent( iConnectionRef, 6 ) == 5 );
+
+    map< int, OBJECTMOVEMESSAGE > Moves;
+    CHECK( GetFrame( Scheduler, 0, Moves ) == 1 );
+    CHECK( Scheduler.GetVersionSent( iConnectionRef, 6 ) == 6 );
+}
+
+void TestUnsyncedConnection()
+{
+    MoveSendSchedulerClass Scheduler( fPosThreshold, fRotThreshold, iMaxDelayMilliseconds, iBytesPerSecond, iBurstBytes );
+    Scheduler.ObjectMoved( MakeMove( 9, Vector3( 0, 0, 0 ) ), 1, 1, 0 );
+
+    map< int, OBJECTMOVEMESSAGE > Moves;
+    CHECK( GetFrame( Scheduler, 0, Moves ) == 0 );
+    CHECK( Scheduler.GetVersionSent( iConnectionRef, 1 ) == -1 );
+}
+
+int main( int argc, char *argv[] )
+{
+    TestSmallMoveSentAfterMaxDelay();
+    TestMovesOverBudgetSentLater();
+    TestNewObjectSentAtOnce();
+    TestUnsyncedConnection();
+
+    return ReportChecks();
+}
@@ -64,46 +64,88 @@ mvGraphicsInterface *Object::pmvGraphics = 0;
 TextureInfoCache *Object::ptextureinfocache = 0;
 TerrainCacheClass *Object::pTerrainCache = 0;
 MeshInfoCacheClass *Object::pMeshInfoCache = 0;
+ObjectTransformStore *Object::pTransformStore = 0;
 
-const char *Object::DeepTypeToObjectType( const char *DeepObjectType )
+// Creates an object of class T, for the object type table
+template< class T > static Object *NewObject()
 {
-    if( strcmp( DeepObjectType, "CUBE" ) == 0 )
-    {
-        return "PRIM";
-    }
-    else if( strcmp( DeepObjectType, "SPHERE" ) == 0 )
-    {
-        return "PRIM";
-    }
-    else if( strcmp( DeepObjectType, "CYLINDER" ) == 0 )
-    {
-        return( "PRIM" );
-    }
-    else if( strcmp( DeepObjectType, "CONE" ) == 0 )
-    {
-        return( "PRIM" );
-    }
-    else if( strcmp( DeepObjectType, "TERRAIN" ) == 0 )
+    return new T;
+}
+
+// The object type table, indexed by DeepObjectTypeTag
+static const OBJECTTYPEINFO ObjectTypes[ DEEPTYPE_COUNT ] =
+{
+    { DEEPTYPE_UNKNOWN, "", OBJECTTYPE_UNKNOWN, "", NULL, NULL, NULL, NULL },
+    { DEEPTYPE_CUBE, "CUBE", OBJECTTYPE_PRIM, "PRIM", &NewObject< Cube >,
+      &Cube::GetCreateSQLFromXMLEx, &Cube::GetUpdateSQLFromXMLEx, NULL },
+    { DEEPTYPE_SPHERE, "SPHERE", OBJECTTYPE_PRIM, "PRIM", &NewObject< Sphere >,
+      &Sphere::GetCreateSQLFromXMLEx, &Sphere::GetUpdateSQLFromXMLEx, NULL },
+    { DEEPTYPE_CYLINDER, "CYLINDER", OBJECTTYPE_PRIM, "PRIM", &NewObject< Cylinder >,
+      &Cylinder::GetCreateSQLFromXMLEx, &Cylinder::GetUpdateSQLFromXMLEx, NULL },
+    { DEEPTYPE_CONE, "CONE", OBJECTTYPE_PRIM, "PRIM", &NewObject< Cone >,
+      &Cone::GetCreateSQLFromXMLEx, &Cone::GetUpdateSQLFromXMLEx, NULL },
+    { DEEPTYPE_TERRAIN, "TERRAIN", OBJECTTYPE_PRIM, "PRIM", &NewObject< Terrain >,
+      &Terrain::GetCreateSQLFromXMLEx, &Terrain::GetUpdateSQLFromXMLEx, NULL },
+    { DEEPTYPE_MD2MESH, "mvMd2Mesh", OBJECTTYPE_PRIM, "PRIM", &NewObject< mvMd2Mesh >,
+      &mvMd2Mesh::GetCreateSQLFromXMLEx, &mvMd2Mesh::GetUpdateSQLFromXMLEx, NULL },
+    { DEEPTYPE_AVATAR, "AVATAR", OBJECTTYPE_OBJECTGROUPING, "OBJECTGROUPING", &NewObject< Avatar >,
+      &Avatar::GetCreateSQLFromXMLEx, &Avatar::GetUpdateSQLFromXMLEx, NULL },
+    { DEEPTYPE_OBJECTGROUPING, "OBJECTGROUPING", OBJECTTYPE_OBJECTGROUPING, "OBJECTGROUPING", &NewObject< ObjectGrouping >,
+      &ObjectGrouping::GetCreateSQLFromXMLEx, &ObjectGrouping::GetUpdateSQLFromXMLEx, &ObjectGrouping::GetDeleteSQLFromXMLEx }
+};
+
+// Other names clients use for some types
+static const struct
+{
+    const char *sName;
+    DeepObjectTypeTag DeepType;
+}
+ObjectTypeAliases[] =
+{
+    { "MD2MESH", DEEPTYPE_MD2MESH }
+};
+
+const OBJECTTYPEINFO *Object::GetTypeInfo( DeepObjectTypeTag DeepType )
+{
+    if( DeepType <= DEEPTYPE_UNKNOWN || DeepType >= DEEPTYPE_COUNT )
     {
-        return( "PRIM" );
+        return NULL;
     }
-    else if( strcmp( DeepObjectType, "mvMd2Mesh" ) == 0 )
+    return &ObjectTypes[ DeepType ];
+}
+
+const OBJECTTYPEINFO *Object::GetTypeInfo( const char *sDeepObjectType )
+{
+    if( sDeepObjectType == NULL )
     {
-        return( "PRIM" );
+        return NULL;
     }
-    else if( strcmp( DeepObjectType, "AVATAR" ) == 0 )
+    for( int i = DEEPTYPE_UNKNOWN + 1; i < DEEPTYPE_COUNT; i++ )
     {
-        return( "OBJECTGROUPING" );
+        if( strcmp( sDeepObjectType, ObjectTypes[i].sDeepObjectType ) == 0 )
+        {
+            return &ObjectTypes[i];
+        }
     }
-    else if( strcmp( DeepObjectType, "OBJECTGROUPING" ) == 0 )
+    for( int i = 0; i < (int)( sizeof( ObjectTypeAliases ) / sizeof( ObjectTypeAliases[0] ) ); i++ )
     {
-        return( "OBJECTGROUPING" );
+        if( strcmp( sDeepObjectType, ObjectTypeAliases[i].sName ) == 0 )
+        {
+            return &ObjectTypes[ ObjectTypeAliases[i].DeepType ];
+        }
     }
-    else
+    return NULL;
+}
+
+const char *Object::DeepTypeToObjectType( const char *DeepObjectType )
+{
+    const OBJECTTYPEINFO *pTypeInfo = GetTypeInfo( DeepObjectType );
+    if( pTypeInfo == NULL )
     {
         Debug( "DeepTypeToObjectType() WARNING: unknown deep object type type [%s]\n", DeepObjectType );
         return "";
     }
+    return pTypeInfo->sObjectType;
 }
 
 void Object::PopulateFromDBRow()
@@ -211,6 +253,32 @@ void Object::PopulateFromDBRow()
         }
     }
 }
+Object::Object( const Object &IncomingObject )
+    : TransformSlot( pTransformStore, this ), pos( TransformSlot.Pos() ), rot( TransformSlot.Rotation() ),
+    vVelocity( TransformSlot.Velocity() ), vAngularVelocity( TransformSlot.AngularVelocity() )
+{
+    iReference = IncomingObject.iReference;
+    iParentReference = IncomingObject.iParentReference;
+    strcpy( ObjectType, IncomingObject.ObjectType );
+    strcpy( sDeepObjectType, IncomingObject.sDeepObjectType );
+    TypeTag = IncomingObject.TypeTag;
+    DeepTypeTag = IncomingObject.DeepTypeTag;
+    iownerreference = IncomingObject.iownerreference;
+    pos = IncomingObject.pos;
+    rot = IncomingObject.rot;
+    strcpy( sScriptReference, IncomingObject.sScriptReference );
+    strcpy( sObjectName, IncomingObject.sObjectName );
+
+    bPhysicsEnabled = IncomingObject.bPhysicsEnabled;
+    bPhantomEnabled = IncomingObject.bPhantomEnabled;
+    bGravityEnabled = IncomingObject.bGravityEnabled;
+    bTerrainEnabled = IncomingObject.bTerrainEnabled;
+    vVelocity = IncomingObject.vVelocity;
+    vAngularVelocity = IncomingObject.vAngularVelocity;
+    vLocalForce = IncomingObject.vLocalForce;
+    vLocalTorque = IncomingObject.vLocalTorque;
+}
+
 const Object &Object::operator=( const Object &IncomingObject )
 {
     this->iReference = IncomingObject.iReference;
@@ -736,6 +804,119 @@ void Object::WriteToXMLDoc( TiXmlElement *pElement )
     rot.WriteToXMLElement( pElement->FirstChildElement("geometry")->FirstChildElement("rot") );
     //  Debug( "Object::WriteToXMLDoc done\n" );
 }
+
+// Input: Writer to append to, sMessageName for the root element (eg "objectrefreshdata"), bIncludeScripts false to leave out <scripts>
+// Description: Writes, byte for byte, what the message used to be built as: the template
+//   <sMessageName><meta><avatar /></meta><geometry><pos /><rot /><scale /></geometry><faces><face num="0"><color /></face></faces></sMessageName>
+// filled in by WriteToXMLDoc, and printed by TinyXML; template elements the object doesnt fill in are
+// still written, empty.  The subclasses add their parts through WriteXMLAttributes, WriteXMLMeta,
+// WriteXMLGeometry and WriteXMLFaces.
+void Object::WriteToXMLWriter( XmlWriter &Writer, const char *sMessageName, bool bIncludeScripts )
+{
+    Writer.StartElement( sMessageName );
+    WriteXMLAttributes( Writer );
+
+    Writer.StartElement( "meta" );
+    WriteXMLMeta( Writer );
+    Writer.EndElement();
+
+    Writer.StartElement( "geometry" );
+    WriteXMLGeometry( Writer );
+    Writer.EndElement();
+
+    WriteXMLFaces( Writer );
+
+    if( bIncludeScripts && strcmp( sScriptReference, "" ) != 0 )
+    {
+        Writer.StartElement( "scripts" );
+        Writer.StartElement( "script" );
+        Writer.Attribute( "sscriptreference", sScriptReference );
+        Writer.EndElement();
+        Writer.EndElement();
+    }
+
+    if( bPhysicsEnabled )
+    {
+        Writer.StartElement( "physics" );
+        Writer.Attribute( "state", "on" );
+        if( bGravityEnabled )
+        {
+            Writer.Attribute( "gravity", "on" );
+        }
+        Writer.EndElement();
+    }
+
+    if( bPhantomEnabled )
+    {
+        Writer.StartElement( "phantom" );
+        Writer.Attribute( "state", "on" );
+        Writer.EndElement();
+    }
+
+    if( bTerrainEnabled )
+    {
+        Writer.StartElement( "terrain" );
+        Writer.Attribute( "state", "on" );
+        Writer.EndElement();
+    }
+
+    // WriteToXMLDoc adds physics for gravity last, if it isnt there already
+    if( bGravityEnabled && !bPhysicsEnabled )
+    {
+        Writer.StartElement( "physics" );
+        Writer.Attribute( "gravity", "on" );
+        Writer.EndElement();
+    }
+
+    Writer.EndElement();
+}
+
+void Object::WriteXMLAttributes( XmlWriter &Writer )
+{
+    Writer.Attribute( "ireference", iReference );
+    Writer.Attribute( "iparentreference", iParentReference );
+    Writer.Attribute( "owner", iownerreference );
+
+    if( strcmp( sObjectName, "" ) != 0 )
+    {
+        Writer.Attribute( "objectname", sObjectName );
+    }
+}
+
+void Object::WriteXMLMeta( XmlWriter &Writer )
+{
+    Writer.StartElement( "avatar" );
+    Writer.EndElement();
+}
+
+void Object::WriteXMLPosAndRot( XmlWriter &Writer )
+{
+    Writer.StartElement( "pos" );
+    pos.WriteToXMLWriter( Writer );
+    Writer.EndElement();
+
+    Writer.StartElement( "rot" );
+    rot.WriteToXMLWriter( Writer );
+    Writer.EndElement();
+}
+
+void Object::WriteXMLGeometry( XmlWriter &Writer )
+{
+    WriteXMLPosAndRot( Writer );
+    Writer.StartElement( "scale" );
+    Writer.EndElement();
+}
+
+void Object::WriteXMLFaces( XmlWriter &Writer )
+{
+    Writer.StartElement( "faces" );
+    Writer.StartElement( "face" );
+    Writer.Attribute( "num", 0 );
+    Writer.StartElement( "color" );
+    Writer.EndElement();
+    Writer.EndElement();
+    Writer.EndElement();
+}
 void Object::Draw()
 {
     //     Debug( "Object::DrawEx\n" );
@@ -747,15 +928,11 @@ void Object::DrawSelected()
 
 ostream& operator<< ( ostream& os, Object &object )
 {
-    TiXmlDocument IPC;
-    IPC.Parse( "<objectcreate>"
-               "<meta><avatar /></meta>"
-               "<geometry><pos /><rot /><scale /></geometry>"
-               "<faces><face num=\"0\"><color/></face></faces>"
-               "</objectcreate>" );
-    object.WriteToXMLDoc( IPC.RootElement() );
+    string IPCText;
+    XmlWriter Writer( IPCText );
+    object.WriteToXMLWriter( Writer, "objectcreate" );
 
-    if( strcmp( object.ObjectType, "OBJECTGROUPING" ) == 0 )
+    if( object.TypeTag == OBJECTTYPE_OBJECTGROUPING )
     {
         // DEBUG(  "objectgoruping detected" ); // DEBUG
         for( int i= 0; i < dynamic_cast< ObjectGrouping &>(object).iNumSubObjects;i++ )
@@ -765,7 +942,7 @@ ostream& operator<< ( ostream& os, Object &object )
         }
     }
 
-    os << IPC << endl;
+    os << IPCText << endl;
 
     return os;
 }
@@ -773,99 +950,43 @@ ostream& operator<< ( ostream& os, Object &object )
 void Object::GetCreateSQLFromXML( TiXmlElement *pElement, char *SQL )
 {
     Debug( "Object::GetCreateSQLFromXML\n" );
-    const char *sDeepObjectType = pElement->Attribute( "type" );
+    const OBJECTTYPEINFO *pTypeInfo = GetTypeInfo( pElement->Attribute( "type" ) );
 
-    if( strcmp( sDeepObjectType, "CUBE" ) == 0 )
-    {
-        Cube::GetCreateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "SPHERE" ) == 0 )
-    {
-        Sphere::GetCreateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "CYLINDER" ) == 0 )
-    {
-        Cylinder::GetCreateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "CONE" ) == 0 )
-    {
-        Cone::GetCreateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "TERRAIN" ) == 0 )
-    {
-        Terrain::GetCreateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "mvMd2Mesh" ) == 0 )
-    {
-        mvMd2Mesh::GetCreateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "AVATAR" ) == 0 )
+    if( pTypeInfo != NULL && pTypeInfo->pfGetCreateSQLFromXMLEx != NULL )
     {
-        Avatar::GetCreateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "OBJECTGROUPING" ) == 0 )
-    {
-        ObjectGrouping::GetCreateSQLFromXMLEx( pElement, SQL );
+        pTypeInfo->pfGetCreateSQLFromXMLEx( pElement, SQL );
     }
 }
 
 void Object::GetDeleteSQLFromXML( TiXmlElement *pElement, char *SQL )
 {
     Debug( "Object::GetDeleteSQLFromXML\n" );
-    const char *sDeepObjectType = pElement->Attribute( "type" );
+    const OBJECTTYPEINFO *pTypeInfo = GetTypeInfo( pElement->Attribute( "type" ) );
 
-    if( strcmp( sDeepObjectType, "OBJECTGROUPING" ) == 0 )
+    if( pTypeInfo != NULL && pTypeInfo->pfGetDeleteSQLFromXMLEx != NULL )
     {
-        ObjectGrouping::GetDeleteSQLFromXMLEx( pElement, SQL );
+        pTypeInfo->pfGetDeleteSQLFromXMLEx( pElement, SQL );
     }
 }
 
 void Object::GetUpdateSQLFromXML( TiXmlElement *pElement, char *SQL )
 {
     Debug( "Object::GetUpdateSQLFromXML\n" );
-    const char *sDeepObjectType = pElement->Attribute( "type" );
+    const OBJECTTYPEINFO *pTypeInfo = GetTypeInfo( pElement->Attribute( "type" ) );
 
-    if( strcmp( sDeepObjectType, "CUBE" ) == 0 )
-    {
-        Cube::GetUpdateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "SPHERE" ) == 0 )
-    {
-        Sphere::GetUpdateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "CYLINDER" ) == 0 )
-    {
-        Cylinder::GetUpdateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "CONE" ) == 0 )
-    {
-        Cone::GetUpdateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "TERRAIN" ) == 0 )
-    {
-        Terrain::GetUpdateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "MD2MESH" ) == 0 )
-    {
-        mvMd2Mesh::GetUpdateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "AVATAR" ) == 0 )
-    {
-        Avatar::GetUpdateSQLFromXMLEx( pElement, SQL );
-    }
-    else if( strcmp( sDeepObjectType, "OBJECTGROUPING" ) == 0 )
+    if( pTypeInfo != NULL && pTypeInfo->pfGetUpdateSQLFromXMLEx != NULL )
     {
-        ObjectGrouping::GetUpdateSQLFromXMLEx( pElement, SQL );
+        pTypeInfo->pfGetUpdateSQLFromXMLEx( pElement, SQL );
     }
 }
 
 void Object::GetDeepObjectType_From_ObjectTypeAndPrimType()
 {
-    if( strcmp( ObjectType, "PRIM" ) == 0 )
+    if( TypeTag == OBJECTTYPE_PRIM )
     {
         sprintf( sDeepObjectType, dynamic_cast<Prim *>(this)->PrimType );
     }
-    else if( strcmp( ObjectType, "OBJECTGROUPING" ) == 0 )
+    else if( TypeTag == OBJECTTYPE_OBJECTGROUPING )
     {
         sprintf( sDeepObjectType, dynamic_cast<ObjectGrouping *>(this)->sObjectGroupingType );
     }
@@ -875,39 +996,11 @@ Object *Object::CreateNewObjectFromXML( TiXmlElement *pElement )
 {
     Object *pNewObject = NULL;
     Debug( "Object::CreateNewObjectFromXML\n" );
-    const char *sDeepObjectType = pElement->Attribute( "type" );
+    const OBJECTTYPEINFO *pTypeInfo = GetTypeInfo( pElement->Attribute( "type" ) );
 
-    if( strcmp( sDeepObjectType, "CUBE" ) == 0 )
-    {
-        pNewObject = new Cube;
-    }
-    else if( strcmp( sDeepObjectType, "SPHERE" ) == 0 )
-    {
-        pNewObject = new Sphere;
-    }
-    else if( strcmp( sDeepObjectType, "CYLINDER" ) == 0 )
-    {
-        pNewObject = new Cylinder;
-    }
-    else if( strcmp( sDeepObjectType, "CONE" ) == 0 )
-    {
-        pNewObject = new Cone;
-    }
-    else if( strcmp( sDeepObjectType, "TERRAIN" ) == 0 )
-    {
-        pNewObject = new Terrain;
-    }
-    else if( strcmp( sDeepObjectType, "MD2MESH" ) == 0 )
-    {
-        pNewObject = new mvMd2Mesh;
-    }
-    else if( strcmp( sDeepObjectType, "AVATAR" ) == 0 )
-    {
-        pNewObject = new Avatar;
-    }
-    else if( strcmp( sDeepObjectType, "OBJECTGROUPING" ) == 0 )
+    if( pTypeInfo != NULL )
     {
-        pNewObject = new ObjectGrouping;
+        pNewObject = pTypeInfo->pfCreate();
     }
 
     if( pNewObject != NULL )
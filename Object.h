@@ -69,6 +69,8 @@
 #include "TextureInfoCache.h"
 #include "TerrainInfoCache.h"
 #include "MeshInfoCache.h"
+#include "XmlHelper.h"
+#include "ObjectTransformStore.h"
 //#include "modelloader.h"
 //#include "ModelFactoryInterface.h"
 
@@ -76,11 +78,49 @@ class Cube;
 class Avatar;
 class Prim;
 class ObjectGrouping;
+class Object;
+
+//! Tag for Object::ObjectType, the broad kind of object
+enum ObjectTypeTag
+{
+   OBJECTTYPE_UNKNOWN = 0,
+   OBJECTTYPE_PRIM,
+   OBJECTTYPE_OBJECTGROUPING
+};
+
+//! Tag for Object::sDeepObjectType, the class of the object.  Indexes the object type table in Object.cpp, so keep the two in step
+enum DeepObjectTypeTag
+{
+   DEEPTYPE_UNKNOWN = 0,
+   DEEPTYPE_CUBE,
+   DEEPTYPE_SPHERE,
+   DEEPTYPE_CYLINDER,
+   DEEPTYPE_CONE,
+   DEEPTYPE_TERRAIN,
+   DEEPTYPE_MD2MESH,
+   DEEPTYPE_AVATAR,
+   DEEPTYPE_OBJECTGROUPING,
+   DEEPTYPE_COUNT
+};
+
+//! Entry in the object type table: names and handlers for one class of object
+struct OBJECTTYPEINFO
+{
+   DeepObjectTypeTag DeepType;
+   const char *sDeepObjectType;   //!< type name in XML and the database, eg "CUBE"
+   ObjectTypeTag Type;
+   const char *sObjectType;       //!< "PRIM" or "OBJECTGROUPING"
+   Object *(*pfCreate)();         //!< creates a new, empty, object of this class
+   void (*pfGetCreateSQLFromXMLEx)( TiXmlElement *pElement, char *SQL );
+   void (*pfGetUpdateSQLFromXMLEx)( TiXmlElement *pElement, char *SQL );
+   void (*pfGetDeleteSQLFromXMLEx)( TiXmlElement *pElement, char *SQL );   //!< NULL if the class has nothing extra to delete
+};
 
 //! Base class for all prims and objects in the world.  Virtual: cant be instantiated itself
 class Object
 {
 protected:
+   ObjectTransformSlot TransformSlot;  //!< holds pos, rot, vVelocity and vAngularVelocity; declared first so it is constructed before them
 
 public:
    static void (*pfCallbackAddName)( int );
@@ -92,14 +132,17 @@ public:
    static TextureInfoCache *ptextureinfocache;   //!< putting this here to reduce dependencies
    static TerrainCacheClass *pTerrainCache;       //!< putting this here to reduce dependencies
    static MeshInfoCacheClass *pMeshInfoCache;   //!< putting this here to reduce dependencies
+   static ObjectTransformStore *pTransformStore;  //!< store new objects take their transform slot from; NULL gives each object its own
 
    int iReference;            //!< fundamental unique identifier for the object.  Created by dbinterface.  Unique.  (LIke a guiid)
    int iParentReference;      //!< reference for object's parent, or 0 if object is a toplevel object
    char ObjectType[17];       //!< "PRIM" or "OBJECTGROUPING" are only two options here currently
    char sDeepObjectType[17];  //!< The actual class of the object, eg Cube, Avatar etc
+   ObjectTypeTag TypeTag;            //!< ObjectType as a tag, set by the constructor.  Test this, not the string
+   DeepObjectTypeTag DeepTypeTag;    //!< sDeepObjectType as a tag, set by the constructor.  Test this, not the string
    int iownerreference;       //!< iReference of owner/creator of object
-   Vector3 pos;                   //!< position of object in sim/world
-   Rot rot;                   //!< rotation of object
+   Vector3 &pos;                  //!< position of object in sim/world (in TransformSlot)
+   Rot &rot;                  //!< rotation of object (in TransformSlot)
    char sScriptReference[33]; //!< md5 checksum of assigned script
 
    char sObjectName[ 65 ];   //!< Object's name
@@ -108,14 +151,15 @@ public:
    bool bPhantomEnabled;  //!< Phantom enabled
    bool bGravityEnabled;  //!< Gravity enabled
    bool bTerrainEnabled;  //!< Terrain enabled (no, I dont remember what this means :-O)
-   Vector3 vVelocity;      //!< Current linear velocity
-   Vector3 vAngularVelocity;      //!< Current angular velocity
+   Vector3 &vVelocity;      //!< Current linear velocity (in TransformSlot)
+   Vector3 &vAngularVelocity;      //!< Current angular velocity (in TransformSlot)
    Vector3 vLocalForce;      //!< Current local linear force spontaneously acting on object
    Vector3 vLocalTorque;      //!< Current local rotational torque spontaneously acting on object
 
   const char *GetObjectType() const{ return ObjectType; }
   const char *GetDeepObjectType() const{ return sDeepObjectType; }
   const char *GetObjectName() const{ return sObjectName; }
+  const ObjectTransformSlot &GetTransformSlot() const{ return TransformSlot; }
 
    static void SetAddNameCallback( void (*pfCallbackAddName)( int ) )
    {
@@ -147,11 +191,20 @@ public:
    	  Object::pTerrainCache = &rTerrainCache;
    }
 
+   static void SetTransformStore( ObjectTransformStore *pNewTransformStore )
+   {
+   	  Object::pTransformStore = pNewTransformStore;
+   }
+
    Object()   //!< Constructor.  Initializes object with default values when object is created.  If you add any new properties to object,
               //!< dont forget to add them in here
+      : TransformSlot( pTransformStore, this ), pos( TransformSlot.Pos() ), rot( TransformSlot.Rotation() ),
+        vVelocity( TransformSlot.Velocity() ), vAngularVelocity( TransformSlot.AngularVelocity() )
    {
    	   iReference = 0;
    	   iParentReference = 0;
+   	   TypeTag = OBJECTTYPE_UNKNOWN;
+   	   DeepTypeTag = DEEPTYPE_UNKNOWN;
    	   iownerreference = 0;
    	   pos.x = 0;
    	   pos.y = 0;
@@ -184,6 +237,8 @@ public:
    	   vLocalTorque.y = 0;
    	   vLocalTorque.z = 0;
    }
+   Object( const Object &IncomingObject );   //!< Copy constructor.  The copy gets its own transform slot.  If you add any new properties to object, add them in here too
+   virtual ~Object(){}
    static void GetCreateSQLFromXML( TiXmlElement *pElement, char *SQL );    //!< Calls the appropriate GetCreateSQLFromXMlEx function, depending on pElement->Attribute("type")
    static void GetCreateSQLFromXMLEx( TiXmlElement *pElement, char *SQL );  //!< fills string SQL with SQL commands to create the object specified by pElement XML in the database
    static void GetUpdateSQLFromXML( TiXmlElement *pElement, char *SQL );    //!< Calls the appropriate GetUpdateSQLFromXMlEx function, depending on pElement->Attribute("type")
@@ -191,6 +246,8 @@ public:
    static void GetDeleteSQLFromXML( TiXmlElement *pElement, char *SQL );    //!< Calls the appropriate GetDeleteSQLFromXMlEx function, depending on pElement->Attribute("type")
    static void GetDeleteSQLFromXMLEx( TiXmlElement *pElement, char *SQL );   //!< fills string SQL with SQL commands to delete specified by pElement XML from the databse
    static Object *CreateNewObjectFromXML( TiXmlElement *pElement );          //!< Creates a new object/cube/avatar etc from the XMl in pElement
+   static const OBJECTTYPEINFO *GetTypeInfo( DeepObjectTypeTag DeepType );   //!< object type table entry for DeepType, or NULL for DEEPTYPE_UNKNOWN
+   static const OBJECTTYPEINFO *GetTypeInfo( const char *sDeepObjectType );  //!< object type table entry for a type name from XML or the database, or NULL if unknown
    virtual char *GetWorldStateRetrieveSQL() = 0;                             //!< Gets SQL statement to retrieve objects of type of instantiated object (eg call it on a cube object -> returns SQL to retrieve cubes)
    void GetDeepObjectType_From_ObjectTypeAndPrimType();              //!< populates sDeepObjectType field (same as pElement->Attribute("type") value, or name of object class )
    static const char *DeepTypeToObjectType( const char *DeepObjectType );
@@ -200,6 +257,12 @@ public:
    virtual void UpdateFromXML( TiXmlElement *pElement );                   //!< updates this object from the XML pElement
    virtual void LoadFromXML( TiXmlElement *pElement );                     //!< loads this object values from the XML pElement
    virtual void WriteToXMLDoc( TiXmlElement *pElement );                   //!< writes the current object to the XML pElement
+   void WriteToXMLWriter( XmlWriter &Writer, const char *sMessageName, bool bIncludeScripts = true );  //!< writes the current object as a whole <sMessageName> element, without building a TiXmlDocument
+   virtual void WriteXMLAttributes( XmlWriter &Writer );                   //!< writes the object's attributes onto the element WriteToXMLWriter opened
+   virtual void WriteXMLMeta( XmlWriter &Writer );                         //!< writes the children of the <meta> element; an empty <avatar/> unless this is an avatar
+   void WriteXMLPosAndRot( XmlWriter &Writer );                            //!< writes the <pos> and <rot> elements; used by WriteXMLGeometry
+   virtual void WriteXMLGeometry( XmlWriter &Writer );                     //!< writes the children of the <geometry> element; an empty <scale/> unless this is a prim
+   virtual void WriteXMLFaces( XmlWriter &Writer );                        //!< writes the <faces> element; an empty <color/> for face 0 unless this is a prim
    virtual void Draw();                                                     //!< Draws this object to OpenGL/GLUT, including applying textures, rotating, and translating (leaves OpenGL Matrices how they were prior to function call)
    virtual void DrawSelected();                                             //!< Draws this object's highlighting to OpenGL/GLUT, so that object appears "Selected" (leaves OpenGL Matrices how they were prior to function call)
    virtual void WriteToDeepXML( TiXmlElement *pElement ) = 0;               //!< Writes object to single recursive XMl structure, removing iReference and iParentReference, which are implicit in the recursion
@@ -201,6 +201,11 @@ void ObjectGrouping::WriteToXMLDoc( TiXmlElement *pElement )
     pElement->SetAttribute( "type", sDeepObjectType );
     Object::WriteToXMLDoc( pElement );
 }
+void ObjectGrouping::WriteXMLAttributes( XmlWriter &Writer )
+{
+    Writer.Attribute( "type", sDeepObjectType );
+    Object::WriteXMLAttributes( Writer );
+}
 //void ObjectGrouping::CopyTo( ObjectGrouping *ptarget )
 //{
 // PLACEHOLDER. TO DO!
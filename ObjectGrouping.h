@@ -85,7 +85,10 @@ public:
    ObjectGrouping()
    {
    	   iNumSubObjects = 0;
+   	   sprintf( ObjectType, "OBJECTGROUPING" );
    	   sprintf( sDeepObjectType, "OBJECTGROUPING" );
+   	   TypeTag = OBJECTTYPE_OBJECTGROUPING;
+   	   DeepTypeTag = DEEPTYPE_OBJECTGROUPING;
    	   sprintf( sObjectGroupingType, "OBJECTGROUPING" );
    }
    virtual void WriteToDeepXML( TiXmlElement *pElement );
@@ -98,6 +101,7 @@ public:
    void LoadFromXML( TiXmlElement *pElement );
    void AddSubObject( Object *pSubObject );
    virtual void WriteToXMLDoc( TiXmlElement *pElement );
+   virtual void WriteXMLAttributes( XmlWriter &Writer );
    const ObjectGrouping &ObjectGrouping::operator=( const ObjectGrouping &IncomingObject );
    //void CopyTo( ObjectGrouping *ptarget );
    virtual void Draw();
@@ -0,0 +1,158 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Keeps the per-frame transform and dynamics state of objects in contiguous arrays
+//!
+//! The position, rotation, velocity and angular velocity of every object are read and written
+//! every frame, by physics, animation, and movement broadcasts.  Kept inside the objects they were
+//! spread through the heap, between names, script references and type strings, so a pass over the
+//! world brought in a cache line or more per object for 52 bytes of data.
+//!
+//! ObjectTransformStore keeps them in one array per field instead.  mvWorldStorage owns a store and
+//! registers it with Object::SetTransformStore; every Object constructed afterwards takes a slot in it, and
+//! its pos, rot, vVelocity and vAngularVelocity members are references to that slot, so existing code using
+//! them is unchanged.  A slot stays put for the life of the object, even when mvWorldStorage moves the
+//! object to another iArrayNum, so the references never need fixing up.
+//!
+//! Freed slots are reused before new ones, so the slots in use stay packed towards the start of the arrays.
+//!
+//! The arrays are allocated a block of OBJECTTRANSFORMBLOCK::iNumSlots at a time, when the blocks so far are full,
+//! rather than reallocated bigger, since objects hold references into them.  Each block is contiguous, so a pass
+//! over the world is a few long loops, one per block.  Only when iMaxSlots are in use, or a block cant be allocated,
+//! does AllocateSlot fail, and then the object keeps its own OBJECTTRANSFORM.
+
+#include <stdio.h>
+#include <new>
+
+#include "Diag.h"
+#include "ObjectTransformStore.h"
+
+ObjectTransformStore::ObjectTransformStore()
+{
+    iNumSlotsUsed = 0;
+}
+
+ObjectTransformStore::~ObjectTransformStore()
+{
+    for( int i = 0; i < (int)Blocks.size(); i++ )
+    {
+        delete Blocks[i];
+    }
+}
+
+int ObjectTransformStore::GetNumSlotsUsedInBlock( int iBlockNum ) const
+{
+    int iNumSlots = iNumSlotsUsed - iBlockNum * iSlotsPerBlock;
+    return iNumSlots < iSlotsPerBlock ? iNumSlots : iSlotsPerBlock;
+}
+
+int ObjectTransformStore::AllocateSlot( Object *pOwner )
+{
+    int iSlot;
+    if( !FreeSlots.empty() )
+    {
+        iSlot = FreeSlots.back();
+        FreeSlots.pop_back();
+    }
+    else if( iNumSlotsUsed < iMaxSlots )
+    {
+        if( iNumSlotsUsed == (int)Blocks.size() * iSlotsPerBlock )
+        {
+            OBJECTTRANSFORMBLOCK *pNewBlock = new( nothrow ) OBJECTTRANSFORMBLOCK;
+            if( pNewBlock == NULL )
+            {
+                DEBUG(  "ObjectTransformStore::AllocateSlot couldnt allocate another block of slots" ); // DEBUG
+                return -1;
+            }
+            for( int i = 0; i < iSlotsPerBlock; i++ )
+            {
+                pNewBlock->Owners[i] = NULL;
+                pNewBlock->Generations[i] = 0;
+            }
+            Blocks.push_back( pNewBlock );
+        }
+        iSlot = iNumSlotsUsed;
+        iNumSlotsUsed++;
+    }
+    else
+    {
+        DEBUG(  "ObjectTransformStore::AllocateSlot all " << iMaxSlots << " slots in use" ); // DEBUG
+        return -1;
+    }
+
+    OBJECTTRANSFORMBLOCK &SlotBlock = Block( iSlot );
+    const int i = iSlot % iSlotsPerBlock;
+    SlotBlock.Pos[i] = Vector3();
+    SlotBlock.Rotation[i] = Rot();
+    SlotBlock.Velocity[i] = Vector3();
+    SlotBlock.AngularVelocity[i] = Vector3();
+    SlotBlock.Owners[i] = pOwner;
+    SlotBlock.Generations[i]++;
+    return iSlot;
+}
+
+void ObjectTransformStore::FreeSlot( int iSlot )
+{
+    if( iSlot < 0 || iSlot >= iNumSlotsUsed || Owner( iSlot ) == NULL )
+    {
+        DEBUG(  "ObjectTransformStore::FreeSlot warning: invalid slot " << iSlot ); // DEBUG
+        return;
+    }
+
+    Block( iSlot ).Owners[ iSlot % iSlotsPerBlock ] = NULL;
+    if( iSlot == iNumSlotsUsed - 1 )
+    {
+        iNumSlotsUsed--;
+    }
+    else
+    {
+        FreeSlots.push_back( iSlot );
+    }
+}
+
+ObjectTransformSlot::ObjectTransformSlot( ObjectTransformStore *pNewStore, Object *pOwner )
+{
+    pStore = pNewStore;
+    iSlot = -1;
+    pOwnTransform = NULL;
+
+    if( pStore != NULL )
+    {
+        iSlot = pStore->AllocateSlot( pOwner );
+        if( iSlot == -1 )
+        {
+            DEBUG(  "ObjectTransformStore full, object will keep its own transform" ); // DEBUG
+            pStore = NULL;
+        }
+    }
+    if( pStore == NULL )
+    {
+        pOwnTransform = new OBJECTTRANSFORM;
+    }
+}
+
+ObjectTransformSlot::~ObjectTransformSlot()
+{
+    if( pStore != NULL )
+    {
+        pStore->FreeSlot( iSlot );
+    }
+    delete pOwnTransform;
+}
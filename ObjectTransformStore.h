@@ -0,0 +1,129 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Keeps the per-frame transform and dynamics state of objects in contiguous arrays
+
+// see ObjectTransformStore.cpp for documentation
+
+#ifndef _OBJECTTRANSFORMSTORE_H
+#define _OBJECTTRANSFORMSTORE_H
+
+#include <vector>
+using namespace std;
+
+#include "Math.h"
+
+class Object;
+
+//! One object's transform and dynamics, for an object that couldnt get a slot in a store
+struct OBJECTTRANSFORM
+{
+   Vector3 Pos;              //!< position
+   Rot Rotation;             //!< rotation
+   Vector3 Velocity;         //!< linear velocity
+   Vector3 AngularVelocity;  //!< angular velocity
+};
+
+//! A block of slots in an ObjectTransformStore, one array per field; once allocated, a block never moves
+struct OBJECTTRANSFORMBLOCK
+{
+   static const int iNumSlots = 1024;  //!< slots per block
+
+   Vector3 Pos[ iNumSlots ];              //!< positions
+   Rot Rotation[ iNumSlots ];             //!< rotations
+   Vector3 Velocity[ iNumSlots ];         //!< linear velocities
+   Vector3 AngularVelocity[ iNumSlots ];  //!< angular velocities
+   Object *Owners[ iNumSlots ];           //!< object using each slot, or NULL if the slot is free
+   unsigned int Generations[ iNumSlots ]; //!< counts allocations of each slot, so anything holding a slot number can tell when it has been reused
+};
+
+//! ObjectTransformStore keeps the position, rotation and velocities of objects in parallel arrays, by slot
+
+//! ObjectTransformStore keeps the position, rotation and velocities of objects in parallel arrays, by slot
+//! An object takes a slot when it is constructed and keeps it until it is destroyed.
+//! The arrays are in blocks of OBJECTTRANSFORMBLOCK::iNumSlots, added as the store fills, so slots never move.
+//! Per-frame passes can walk the blocks from 0 to GetNumBlocks(), and the slots in each from 0 to
+//! GetNumSlotsUsedInBlock(), skipping slots whose Owners entry is NULL; or go by slot number with Pos(), Owner() etc
+class ObjectTransformStore
+{
+public:
+   static const int iSlotsPerBlock = OBJECTTRANSFORMBLOCK::iNumSlots;
+   static const int iMaxSlots = 1024 * iSlotsPerBlock;  //!< objects in the world, plus those created outside it, eg prototypes and imports
+
+   ObjectTransformStore();
+   ~ObjectTransformStore();
+
+   int AllocateSlot( Object *pOwner );   //!< returns a free slot, reset to zero position, velocity and rotation, or -1 if the store is full
+   void FreeSlot( int iSlot );           //!< gives back a slot from AllocateSlot
+   int GetNumSlotsUsed() const { return iNumSlotsUsed; }   //!< all slots in use are below this
+
+   Vector3 &Pos( int iSlot ){ return Block( iSlot ).Pos[ iSlot % iSlotsPerBlock ]; }
+   Rot &Rotation( int iSlot ){ return Block( iSlot ).Rotation[ iSlot % iSlotsPerBlock ]; }
+   Vector3 &Velocity( int iSlot ){ return Block( iSlot ).Velocity[ iSlot % iSlotsPerBlock ]; }
+   Vector3 &AngularVelocity( int iSlot ){ return Block( iSlot ).AngularVelocity[ iSlot % iSlotsPerBlock ]; }
+   Object *Owner( int iSlot ) const { return Blocks[ iSlot / iSlotsPerBlock ]->Owners[ iSlot % iSlotsPerBlock ]; }
+   unsigned int Generation( int iSlot ) const { return Blocks[ iSlot / iSlotsPerBlock ]->Generations[ iSlot % iSlotsPerBlock ]; }
+
+   int GetNumBlocks() const { return ( iNumSlotsUsed + iSlotsPerBlock - 1 ) / iSlotsPerBlock; }  //!< blocks holding slots in use
+   OBJECTTRANSFORMBLOCK &GetBlock( int iBlockNum ){ return *Blocks[ iBlockNum ]; }          //!< block iBlockNum, holding slots from iBlockNum * iSlotsPerBlock
+   int GetNumSlotsUsedInBlock( int iBlockNum ) const;   //!< slots in use in block iBlockNum are below this
+
+protected:
+   vector<OBJECTTRANSFORMBLOCK *> Blocks;  //!< allocated as needed, freed with the store
+   vector<int> FreeSlots;  //!< free slots below iNumSlotsUsed
+   int iNumSlotsUsed;
+
+   OBJECTTRANSFORMBLOCK &Block( int iSlot ){ return *Blocks[ iSlot / iSlotsPerBlock ]; }
+
+private:
+   ObjectTransformStore( const ObjectTransformStore & );              //!< not copyable: objects hold references into the blocks
+   ObjectTransformStore &operator=( const ObjectTransformStore & );
+};
+
+//! An object's slot in an ObjectTransformStore
+
+//! An object's slot in an ObjectTransformStore
+//! Allocated on construction and freed on destruction.  If there's no store, or it's full,
+//! the slot holds its own OBJECTTRANSFORM instead, so the object still works, just not in the arrays
+class ObjectTransformSlot
+{
+public:
+   ObjectTransformSlot( ObjectTransformStore *pStore, Object *pOwner );
+   ~ObjectTransformSlot();
+
+   Vector3 &Pos(){ return pStore != NULL ? pStore->Pos( iSlot ) : pOwnTransform->Pos; }
+   Rot &Rotation(){ return pStore != NULL ? pStore->Rotation( iSlot ) : pOwnTransform->Rotation; }
+   Vector3 &Velocity(){ return pStore != NULL ? pStore->Velocity( iSlot ) : pOwnTransform->Velocity; }
+   Vector3 &AngularVelocity(){ return pStore != NULL ? pStore->AngularVelocity( iSlot ) : pOwnTransform->AngularVelocity; }
+
+   ObjectTransformStore *GetStore() const { return pStore; }   //!< store holding this slot, or NULL if it has its own OBJECTTRANSFORM
+   int GetSlot() const { return iSlot; }                       //!< index into the store's arrays, or -1
+
+protected:
+   ObjectTransformStore *pStore;
+   int iSlot;
+   OBJECTTRANSFORM *pOwnTransform;
+
+private:
+   ObjectTransformSlot( const ObjectTransformSlot & );              //!< not copyable: a copied object gets its own slot
+   ObjectTransformSlot &operator=( const ObjectTransformSlot & );
+};
+
+#endif // _OBJECTTRANSFORMSTORE_H
@@ -0,0 +1,180 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief objectwritertest: golden-output tests of Object::WriteToXMLWriter
+//!
+//! Object messages used to be built by parsing a template document, filling it in with
+//! WriteToXMLDoc, and printing it with TinyXML.  For each type of object, this builds the message
+//! both that way and with WriteToXMLWriter, and checks they're byte for byte the same; and checks a
+//! cube's message against a fixed string, so the format cant drift on both sides at once.
+//! Prints each failed check, and exits non-zero if any failed.
+//!
+//! usage: objectwritertest
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+using namespace std;
+
+#include "tinyxml.h"
+
+#include "XmlHelper.h"
+#include "Object.h"
+#include "Cube.h"
+#include "Sphere.h"
+#include "Terrain.h"
+#include "mvMd2Mesh.h"
+#include "ObjectGrouping.h"
+#include "Avatar.h"
+#include "TestCheck.h"
+
+//! builds rObject's message the old way: fills in the template document with WriteToXMLDoc, and prints it
+string WriteWithTemplate( Object &rObject, const char *sMessageName, bool bIncludeScripts )
+{
+    string sTemplate = string( "<" ) + sMessageName + ">"
+                       "<meta><avatar /></meta>"
+                       "<geometry><pos /><rot /><scale /></geometry>"
+                       "<faces><face num=\"0\"><color/></face></faces>"
+                       "</" + sMessageName + ">";
+    TiXmlDocument IPC;
+    IPC.Parse( sTemplate.c_str() );
+    rObject.WriteToXMLDoc( IPC.RootElement() );
+    if( !bIncludeScripts && IPC.RootElement()->FirstChildElement( "scripts" ) != NULL )
+    {
+        IPC.RootElement()->RemoveChild( IPC.RootElement()->FirstChildElement( "scripts" ) );
+    }
+
+    string sMessage;
+    sMessage << IPC;
+    return sMessage;
+}
+
+//! builds rObject's message with WriteToXMLWriter
+string WriteWithWriter( Object &rObject, const char *sMessageName, bool bIncludeScripts )
+{
+    string sMessage;
+    XmlWriter Writer( sMessage );
+    rObject.WriteToXMLWriter( Writer, sMessageName, bIncludeScripts );
+    return sMessage;
+}
+
+//! checks both ways of writing rObject give the same bytes, with and without scripts
+void CheckSameBothWays( Object &rObject, const char *sMessageName )
+{
+    string sOld = WriteWithTemplate( rObject, sMessageName, true );
+    string sNew = WriteWithWriter( rObject, sMessageName, true );
+    CHECK( sNew == sOld );
+    if( sNew != sOld )
+    {
+        printf( "  template: %s\n  writer:   %s\n", sOld.c_str(), sNew.c_str() );
+    }
+
+    sOld = WriteWithTemplate( rObject, sMessageName, false );
+    sNew = WriteWithWriter( rObject, sMessageName, false );
+    CHECK( sNew == sOld );
+    if( sNew != sOld )
+    {
+        printf( "  template: %s\n  writer:   %s\n", sOld.c_str(), sNew.c_str() );
+    }
+}
+
+//! sets the Object properties every test object gets
+void SetUpObject( Object &rObject, int iReference )
+{
+    rObject.iReference = iReference;
+    rObject.iParentReference = 0;
+    rObject.iownerreference = 7;
+    rObject.pos = Vector3( 1.5, -2.25, 100 );
+    rObject.rot = Rot( 0, 0, 0.5, 0.75 );
+}
+
+void TestCube()
+{
+    Cube TestCube;
+    SetUpObject( TestCube, 12 );
+    TestCube.scale = Vector3( 1, 2, 3 );
+    TestCube.SetColor( 0, Color( 0.5, 0.25, 1 ) );
+    TestCube.SetTexture( 0, "0123456789abcdef0123456789abcdef" );
+    sprintf( TestCube.sScriptReference, "fedcba9876543210fedcba9876543210" );
+    TestCube.bPhysicsEnabled = true;
+    TestCube.bGravityEnabled = true;
+    CheckSameBothWays( TestCube, "objectrefreshdata" );
+
+    CHECK( WriteWithWriter( TestCube, "objectrefreshdata", true ) ==
+           "<objectrefreshdata type=\"CUBE\" ireference=\"12\" iparentreference=\"0\" owner=\"7\">"
+           "<meta><avatar /></meta>"
+           "<geometry><pos x=\"1.500000\" y=\"-2.250000\" z=\"100.000000\" /><rot x=\"0.000000\" y=\"0.000000\" z=\"0.500000\" s=\"0.750000\" />"
+           "<scale x=\"1.000000\" y=\"2.000000\" z=\"3.000000\" /></geometry>"
+           "<faces><face num=\"0\"><color r=\"0.500000\" g=\"0.250000\" b=\"1.000000\" />"
+           "<texture stexturereference=\"0123456789abcdef0123456789abcdef\" /></face></faces>"
+           "<scripts><script sscriptreference=\"fedcba9876543210fedcba9876543210\" /></scripts>"
+           "<physics state=\"on\" gravity=\"on\" />"
+           "</objectrefreshdata>" );
+
+    // names can hold anything; gravity without physics comes after the other flags
+    sprintf( TestCube.sObjectName, "Bob's \"cube\" & <more>" );
+    TestCube.bPhysicsEnabled = false;
+    TestCube.bPhantomEnabled = true;
+    TestCube.bTerrainEnabled = true;
+    CheckSameBothWays( TestCube, "objectupdate" );
+}
+
+void TestOtherPrims()
+{
+    Sphere TestSphere;
+    SetUpObject( TestSphere, 13 );
+    TestSphere.bGravityEnabled = false;
+    CheckSameBothWays( TestSphere, "objectcreate" );
+
+    Terrain TestTerrain;
+    SetUpObject( TestTerrain, 14 );
+    sprintf( TestTerrain.sTerrainReference, "terrainchecksum" );
+    sprintf( TestTerrain.sSkyboxReference, "skyboxchecksum" );
+    TestTerrain.SetTexture( 0, "terraintexture" );
+    CheckSameBothWays( TestTerrain, "objectrefreshdata" );
+
+    mvMd2Mesh TestMesh;
+    SetUpObject( TestMesh, 15 );
+    sprintf( TestMesh.sMeshReference, "meshchecksum" );
+    CheckSameBothWays( TestMesh, "objectrefreshdata" );
+}
+
+void TestGroupings()
+{
+    ObjectGrouping TestGrouping;
+    SetUpObject( TestGrouping, 16 );
+    sprintf( TestGrouping.sObjectName, "a group" );
+    CheckSameBothWays( TestGrouping, "objectrefreshdata" );
+
+    Avatar TestAvatar;
+    SetUpObject( TestAvatar, 17 );
+    sprintf( TestAvatar.avatarname, "Someone" );
+    TestAvatar.bPhysicsEnabled = true;
+    CheckSameBothWays( TestAvatar, "objectrefreshdata" );
+}
+
+int main( int argc, char *argv[] )
+{
+    TestCube();
+    TestOtherPrims();
+    TestGroupings();
+
+    return ReportChecks();
+}
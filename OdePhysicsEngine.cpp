@@ -166,7 +166,7 @@ void CollisionAndPhysicsEngineClass::nearCallback (void *data, dGeomID o1, dGeom
 
     if( pObject1 != NULL )
     {
-        if( strcmp( pObject1->sDeepObjectType, "TERRAIN" ) == 0 )
+        if( pObject1->DeepTypeTag == DEEPTYPE_TERRAIN )
         {
             bInteractionWithTerrain = true;
             iNumberOfTerrain = 1;
@@ -183,7 +183,7 @@ void CollisionAndPhysicsEngineClass::nearCallback (void *data, dGeomID o1, dGeom
 
     if( pObject2 != NULL )
     {
-        if( strcmp( pObject2->sDeepObjectType, "TERRAIN" ) == 0 )
+        if( pObject2->DeepTypeTag == DEEPTYPE_TERRAIN )
         {
             if( iNumberOfTerrain == 0 )
             {
@@ -419,11 +419,11 @@ void CollisionAndPhysicsEngineClass::CreateGeom( dSpaceID targetspace, const Obj
 {
     //DEBUG(  "CreateGeom " << p_Object->ObjectType << " r: " << p_Object->iReference << " n: " << p_Object->sObjectName << "..." ); // DEBUG
     bool bObjectCreated = false;
-    if( strcmp( p_Object->ObjectType, "PRIM" ) == 0 )
+    if( p_Object->TypeTag == OBJECTTYPE_PRIM )
     {
         // DEBUG(  "its a prim" ); // DEBUG
         const Prim *p_Prim = dynamic_cast< const Prim *>( p_Object );
-        if( strcmp( p_Object->sDeepObjectType, "SPHERE" ) == 0 )
+        if( p_Object->DeepTypeTag == DEEPTYPE_SPHERE )
         {
             OdeObject NewOdeObject;
 
@@ -446,7 +446,7 @@ void CollisionAndPhysicsEngineClass::CreateGeom( dSpaceID targetspace, const Obj
 
             bObjectCreated = true;
         }
-        else if( strcmp( p_Object->sDeepObjectType, "CUBE" ) == 0 )
+        else if( p_Object->DeepTypeTag == DEEPTYPE_CUBE )
         {
             OdeObject NewOdeObject;
 
@@ -458,7 +458,7 @@ void CollisionAndPhysicsEngineClass::CreateGeom( dSpaceID targetspace, const Obj
 
             bObjectCreated = true;
         }
-        else if( strcmp( p_Object->sDeepObjectType, "CONE" ) == 0 )
+        else if( p_Object->DeepTypeTag == DEEPTYPE_CONE )
         {
             OdeObject NewOdeObject;
 
@@ -471,7 +471,7 @@ void CollisionAndPhysicsEngineClass::CreateGeom( dSpaceID targetspace, const Obj
 
             bObjectCreated = true;
         }
-        else if( strcmp( p_Object->sDeepObjectType, "mvMd2Mesh" ) == 0 )
+        else if( p_Object->DeepTypeTag == DEEPTYPE_MD2MESH )
         {
             OdeObject NewOdeObject;
 
@@ -483,7 +483,7 @@ void CollisionAndPhysicsEngineClass::CreateGeom( dSpaceID targetspace, const Obj
 
             bObjectCreated = true;
         }
-        else if( strcmp( p_Object->sDeepObjectType, "CYLINDER" ) == 0 )
+        else if( p_Object->DeepTypeTag == DEEPTYPE_CYLINDER )
         {
             OdeObject NewOdeObject;
 
@@ -495,7 +495,7 @@ void CollisionAndPhysicsEngineClass::CreateGeom( dSpaceID targetspace, const Obj
 
             bObjectCreated = true;
         }
-        else if( strcmp( p_Object->sDeepObjectType, "TERRAIN" ) == 0 )
+        else if( p_Object->DeepTypeTag == DEEPTYPE_TERRAIN )
         {
             OdeObject NewOdeObject;
 
@@ -509,7 +509,7 @@ void CollisionAndPhysicsEngineClass::CreateGeom( dSpaceID targetspace, const Obj
             bObjectCreated = true;
         }
     }
-    else if( strcmp( p_Object->sDeepObjectType, "OBJECTGROUPING" ) == 0 )
+    else if( p_Object->DeepTypeTag == DEEPTYPE_OBJECTGROUPING )
     {
         const ObjectGrouping *p_Group = dynamic_cast< const ObjectGrouping *>( p_Object );
         for( int i = 0; i < p_Group->iNumSubObjects; i++ )
@@ -574,10 +574,10 @@ void CollisionAndPhysicsEngineClass::DeleteGeom( int iReference )
 
 void CollisionAndPhysicsEngineClass::CreatePhysicalGeom( OdeObject &rOdeObject, const Object *p_Object )
 {
-    if( strcmp( p_Object->ObjectType, "PRIM" ) == 0 )
+    if( p_Object->TypeTag == OBJECTTYPE_PRIM )
     {
         const Prim *p_Prim = dynamic_cast< const Prim *>( p_Object );
-        if( strcmp( p_Object->sDeepObjectType, "SPHERE" ) == 0 )
+        if( p_Object->DeepTypeTag == DEEPTYPE_SPHERE )
         {
             //rOdeObject.geom = dCreateSphere( permaspace, ( p_Prim->scale.x + p_Prim->scale.y + p_Prim->scale.z ) / 3 );
             //dMassSetSphere( &( rOdeObject.fMass ), DENSITY, ( p_Prim->scale.x + p_Prim->scale.y + p_Prim->scale.z ) / 3 );
@@ -587,34 +587,34 @@ void CollisionAndPhysicsEngineClass::CreatePhysicalGeom( OdeObject &rOdeObject,
             dMassSetBox( &( rOdeObject.fMass ), DENSITY, p_Prim->scale.x, p_Prim->scale.y, p_Prim->scale.z );
             rOdeObject.bEnabled = true;
         }
-        else if( strcmp( p_Object->sDeepObjectType, "CUBE" ) == 0 )
+        else if( p_Object->DeepTypeTag == DEEPTYPE_CUBE )
         {
             rOdeObject.geom = dCreateBox( permaspace, p_Prim->scale.x, p_Prim->scale.y, p_Prim->scale.z );
             dMassSetBox( &( rOdeObject.fMass ), DENSITY, p_Prim->scale.x, p_Prim->scale.y, p_Prim->scale.z );
             rOdeObject.bEnabled = true;
         }
-        else if( strcmp( p_Object->sDeepObjectType, "CONE" ) == 0 )
+        else if( p_Object->DeepTypeTag == DEEPTYPE_CONE )
         {
             // map cone to box
             rOdeObject.geom = dCreateBox( permaspace, p_Prim->scale.x, p_Prim->scale.y, p_Prim->scale.z );
             dMassSetBox( &( rOdeObject.fMass ), DENSITY, p_Prim->scale.x, p_Prim->scale.y, p_Prim->scale.z );
             rOdeObject.bEnabled = true;
         }
-        else if( strcmp( p_Object->sDeepObjectType, "mvMd2Mesh" ) == 0 )
+        else if( p_Object->DeepTypeTag == DEEPTYPE_MD2MESH )
         {
             // map md2mesh to box
             rOdeObject.geom = dCreateBox( permaspace, p_Prim->scale.x, p_Prim->scale.y, p_Prim->scale.z );
             dMassSetBox( &( rOdeObject.fMass ), DENSITY, p_Prim->scale.x, p_Prim->scale.y, p_Prim->scale.z );
             rOdeObject.bEnabled = true;
         }
-        else if( strcmp( p_Object->sDeepObjectType, "CYLINDER" ) == 0 )
+        else if( p_Object->DeepTypeTag == DEEPTYPE_CYLINDER )
         {
             rOdeObject.geom = dCreateCCylinder( permaspace, p_Prim->scale.x, ( p_Prim->scale.y + p_Prim->scale.z ) / 2 );
             dMassSetCylinder( &( rOdeObject.fMass ), DENSITY, 3, p_Prim->scale.x, ( p_Prim->scale.y + p_Prim->scale.z ) / 2 );
             rOdeObject.bEnabled = true;
         }
     }
-    else if( strcmp( p_Object->ObjectType, "OBJECTGROUPING" ) == 0 )
+    else if( p_Object->TypeTag == OBJECTTYPE_OBJECTGROUPING )
     {
         //cout<< " physical objectgrouping "  ); // DEBUG
         const ObjectGrouping *p_Group = dynamic_cast< const ObjectGrouping *>( p_Object );
@@ -682,7 +682,7 @@ void CollisionAndPhysicsEngineClass::HandleCollisionsAndPhysics( int iElapsedTim
                 dBodySetPosition( NewOdeObject.body, p_Object->pos.x, p_Object->pos.y, p_Object->pos.z );
 
 
-                if( strcmp( p_Object->sDeepObjectType, "AVATAR" ) != 0 )
+                if( p_Object->DeepTypeTag != DEEPTYPE_AVATAR )
                 {
                     bArePhysicalObjects = true;
                     //DEBUG(  "physical body: pos: " << p_Object->pos << " vel: " << p_Object->vVelocity << " rot: " << p_Object->rot << " grav: " << p_Object->bGravityEnabled ); // DEBUG
@@ -790,7 +790,7 @@ void CollisionAndPhysicsEngineClass::HandleCollisionsAndPhysics( int iElapsedTim
         p_Object->vVelocity.y = pNewVel[1];
         p_Object->vVelocity.z = pNewVel[2];
 
-        if( strcmp( p_Object->sDeepObjectType, "AVATAR" ) != 0 )
+        if( p_Object->DeepTypeTag != DEEPTYPE_AVATAR )
         {
 
             const dReal *pNewRot;
@@ -135,6 +135,31 @@ void Prim::WriteToXMLDoc( TiXmlElement *pElement )
     //  Debug( "Prim::WriteToXMLDoc done\n" );
     Object::WriteToXMLDoc( pElement );
 }
+void Prim::WriteXMLGeometry( XmlWriter &Writer )
+{
+    WriteXMLPosAndRot( Writer );
+    Writer.StartElement( "scale" );
+    scale.WriteToXMLWriter( Writer );
+    Writer.EndElement();
+}
+void Prim::WriteXMLFaces( XmlWriter &Writer )
+{
+    Writer.StartElement( "faces" );
+    Writer.StartElement( "face" );
+    Writer.Attribute( "num", 0 );
+    WriteXMLFace( Writer );
+    Writer.EndElement();
+    Writer.EndElement();
+}
+void Prim::WriteXMLFace( XmlWriter &Writer )
+{
+    Writer.StartElement( "color" );
+    GetColor( 0 ).WriteToXMLWriter( Writer );
+    Writer.EndElement();
+    Writer.StartElement( "texture" );
+    Writer.Attribute( "stexturereference", GetTexture( 0 ) );
+    Writer.EndElement();
+}
 //void Prim::CopyTo( Prim *ptargetprim )
 //{
 //sprintf( ptargetprim->PrimType, PrimType );
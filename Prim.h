@@ -95,6 +95,9 @@ public:
    virtual void UpdateFromXML( TiXmlElement *pElement );
    void LoadFromXML( TiXmlElement *pElement );
    virtual void WriteToXMLDoc( TiXmlElement *pElement );
+   virtual void WriteXMLGeometry( XmlWriter &Writer );
+   virtual void WriteXMLFaces( XmlWriter &Writer );
+   virtual void WriteXMLFace( XmlWriter &Writer );   //!< writes the children of <face num="0">; used by WriteXMLFaces
    const Prim &Prim::operator=( const Prim &IncomingPrim );
    //virtual void CopyTo( Prim *ptargetprim );
    virtual void Draw();
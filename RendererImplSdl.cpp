@@ -50,6 +50,7 @@ using namespace std;
 #include "Animation.h"
 #include "PlayerMovement.h"
 #include "Graphics.h"
+#include "StaticBatches.h"
 //#include "keyandmouse.h"
 #include "Camera.h"
 #include "Editing3D.h"
@@ -80,6 +81,7 @@ namespace MetaverseClient
     extern char SkyboxReference[33];
 
     extern mvGraphicsClass mvGraphics;
+    extern StaticBatchesClass StaticBatches;
     extern mvCameraClass Camera;
 
     extern Editing3DClass Editing3D;
@@ -380,11 +382,28 @@ namespace RendererImpl
             };
         glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, mcolor);
 
+        // when selecting, every object is drawn by itself, so it gets its own name to be picked by
+        GLint iRenderMode;
+        glGetIntegerv( GL_RENDER_MODE, &iRenderMode );
+        bool bUseBatches = ( iRenderMode == GL_RENDER );
+        if( bUseBatches )
+        {
+            StaticBatches.Update( World, MVGetTickCount() );
+            VIEWFRUSTUM Frustum;
+            mvGraphics.GetViewFrustum( Frustum );
+            StaticBatches.Draw( Frustum );
+            GetRendererTexturing().SetViewFrustum( Frustum );
+        }
+
         for( int i = 0; i < World.iNumObjects; i++ )
         {
             // dont draw submembers directly, dont draw default objects
             if( World.GetObject(i)->iParentReference == 0 && World.GetObject(i)->iReference != 0 )
             {
+                if( bUseBatches && StaticBatches.IsBatched( World.GetObject(i)->iReference ) )
+                {
+                    continue;
+                }
                 // dont draw own avatar in mouselook mode
                 if( World.GetObject(i)->iReference != MetaverseClient::iMyReference )
                 {
@@ -454,7 +473,9 @@ namespace RendererImpl
         iLastCount = MVGetTickCount();
         //  DEBUG(  "world drawn" ); // DEBUG
 
-        TIMING( "DrawWorld timings: " << iDrawObjectsTime << " " << iSelectedObjectsTime << " " << iEditBarsTime );
+        TIMING( "DrawWorld timings: " << iDrawObjectsTime << " " << iSelectedObjectsTime << " " << iEditBarsTime
+                << " static batches drawn " << StaticBatches.GetNumBatchesDrawn() << "/" << StaticBatches.GetNumBatches()
+                << " holding " << StaticBatches.GetNumBatchedPrims() << " prims, rebuilt " << StaticBatches.GetNumRebuilds() );
     }
 
     //! called to draw what we see in window, once a frame.
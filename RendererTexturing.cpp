@@ -29,6 +29,13 @@
 // 20050423 Hugh Perkins - Migrated into Tartan library
 // 20050520 Hugh Perkins - migrated to be a class
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <math.h>
+#include <limits.h>
+#include <map>
 #include <string>
 #include <iostream>
 #include <sstream>
@@ -37,6 +44,8 @@ using namespace std;
 #include <wx/filename.h>
 #include <wx/strconv.h>
 
+#include <GL/gl.h>
+
 #include "tinyxml.h"
 
 #include "TextureLoader.h"
@@ -49,6 +58,7 @@ using namespace std;
 #include "Checksum.h"
 #include "Config.h"
 #include "Terrain.h"
+#include "TickCount.h"
 #include "MetaverseClient.h"
 
 namespace MetaverseClient
@@ -58,9 +68,39 @@ namespace MetaverseClient
     extern mvSelection Selector;            // but at least the namespaces are encapsulated so it's not *really* bad
     extern mvWorldStorage World;
     extern ConfigClass mvConfig;
+    extern int iMyReference;
 }
 using namespace MetaverseClient;
 
+static const int iTextureDecodeThreads = 2;
+static const size_t iTextureUploadBytesPerFrame = 1024 * 1024;   //!< at least one texture is uploaded each frame, even if bigger than this
+static const int iTexturePriorityIntervalMs = 500;
+static const float fTexelsPerPriority = 512;   //!< roughly how many pixels across the screen a prim as big as its distance covers
+static const int iMinWantedTextureSize = 16;
+static const float fOutOfViewPriorityScale = 0.25f;   //!< textures only on prims out of view are decoded and downloaded after those in view
+static const float fDownloadPriorityScale = 1000;   //!< download priorities are ints; this keeps the resolution of GetTexturePriorities
+static const int iMaxTextureDownloadPriority = 999999;   //!< below ClientFileFunctionsClass::GetDownloadPriority, so meshes and terrain go first
+static const int iCancelOutOfViewMs = 5000;   //!< downloads out of view this long are cancelled; looking round briefly doesnt cancel them
+
+RendererTexturingClass::RendererTexturingClass() : TextureDecoder( iTextureDecodeThreads )
+{
+    iLastPriorityUpdate = 0;
+    bHaveViewFrustum = false;
+}
+
+string RendererTexturingClass::GetTextureCachePath( const string &sFilename )
+{
+    wxFileName FilePath;
+
+    FilePath = wxString(sFilename.c_str(), wxConvUTF8);
+    FilePath.PrependDir(L"textures");
+    FilePath.PrependDir(L"cache");
+    FilePath.PrependDir(L"clientdata");
+    FilePath.Normalize( wxPATH_NORM_ALL, wxString( mvConfig.CacheDirectory.c_str()  ));
+
+    return string( FilePath.GetFullPath().mb_str() );
+}
+
 // Input: rTextureInfo: A reference to a TEXTUREINFO struct
 //
 // Returns: True on success.
@@ -149,13 +189,29 @@ bool RendererTexturingClass::LoadTexture( TEXTUREINFO &rTextureInfo )
     }
 }
 
+// Input: rTextureInfo: the texture to download
+//
+// Returns: None
+//
+// Description: Asks ClientFileAgent for the texture, with the priority of the prims that use it;
+//  UpdateDownloadPriorities keeps that up to date until the download finishes
 void RendererTexturingClass::DownloadTexture( TEXTUREINFO &rTextureInfo )
 {
+    map < string, float > Priorities;
+    GetTexturePriorities( Priorities );
+    map < string, float >::iterator priority = Priorities.find( rTextureInfo.sChecksum );
+
+    TEXTUREDOWNLOAD &rDownload = Downloads[ rTextureInfo.sChecksum ];
+    rDownload.iPriority = GetDownloadPriority( priority != Priorities.end() ? priority->second : 0 );
+    rDownload.bForPrim = priority != Priorities.end();
+    rDownload.iLastInViewTickCount = MVGetTickCount();
+    CancelledDownloads.erase( rTextureInfo.sChecksum );
+
     DEBUG(" ** SENDING LOADER GET FILE XML");
     ostringstream messagetoclientfileagentstream;
     messagetoclientfileagentstream << "<loadergetfile type=\"TEXTURE\" checksum=\"" << rTextureInfo.sChecksum
     << "\" sourcefilename=\"" << rTextureInfo.sSourceFilename << "\" serverfilename=\"" << rTextureInfo.sServerFilename
-    << "\"/>" << endl;
+    << "\" priority=\"" << rDownload.iPriority << "\"/>" << endl;
     //DEBUG(  "sending to server " << messagetoclientfileagentstream.str() ); // DEBUG
     TiXmlDocument IPC;
     IPC.Parse( messagetoclientfileagentstream.str().c_str() );
@@ -208,7 +264,8 @@ bool RendererTexturingClass::TextureIsInCache( TEXTUREINFO &rTextureInfo )
 //          False if the texture was requested
 //
 // Description: Checks to see if the requested texture is in cache. If
-//  it is, loads it.  If loading fails, loads a "Missing Image" proxy.
+//  it is, loads a "Missing Image" proxy and queues the texture for decoding;
+//  UploadDecodedTextures replaces the proxy once it's decoded.
 //  If the file isn't in cache, sends a load request to the metaverse
 //  client.
 //
@@ -225,11 +282,339 @@ void RendererTexturingClass::LoadOrRequestTexture( TEXTUREINFO &rTextureInfo )
     }
     else
     {
-        if(!LoadTexture( rTextureInfo ) )
+        // 0 is never an OpenGL texture name, so means nothing is loaded yet
+        if( rTextureInfo.iTextureID <= 0 )
         {
-            //   WARNING("Loading proxy texture for " << rTextureInfo.sServerFilename.c_str());
             LoadMissingTexture( rTextureInfo );
         }
+        map < string, float > Priorities;
+        GetTexturePriorities( Priorities );
+        QueueTextureDecode( rTextureInfo, Priorities[ rTextureInfo.sChecksum ] );
+    }
+}
+
+// Input: fPriority: from GetTexturePriorities
+//
+// Returns: The width or height, whichever is larger, of the biggest mip level worth uploading
+//
+// Description: Textures with priority 0 aren't on any prim we know of, but may be on the skybox or
+//  terrain, so get full size
+int RendererTexturingClass::GetWantedTextureSize( float fPriority )
+{
+    if( fPriority <= 0 )
+    {
+        return INT_MAX;
+    }
+    int iSize = iMinWantedTextureSize;
+    while( iSize < fPriority * fTexelsPerPriority && iSize < INT_MAX / 2 )
+    {
+        iSize *= 2;
+    }
+    return iSize;
+}
+
+//! Queues rTextureInfo for decoding, at the mip level fPriority needs; mip chains are cached as <checksum>.mips next to the textures
+void RendererTexturingClass::QueueTextureDecode( TEXTUREINFO &rTextureInfo, float fPriority )
+{
+    TextureDecoder.Queue( rTextureInfo.sChecksum, GetTextureCachePath( rTextureInfo.sServerFilename ),
+                          GetTextureCachePath( rTextureInfo.sChecksum + ".mips" ), fPriority, GetWantedTextureSize( fPriority ) );
+}
+
+// Input: Priorities: receives the priority of each texture used in the world, by checksum
+//        pInView: if not NULL, receives the checksums of textures used by prims in view
+//
+// Returns: None
+//
+// Description: A texture's priority is the largest, over the prims using it, of the prim's
+//  biggest dimension over its distance from our avatar, roughly its size on screen, scaled
+//  down by fOutOfViewPriorityScale for prims outside the view frustum.
+//  Textures nothing uses aren't in Priorities, so have priority 0.
+void RendererTexturingClass::GetTexturePriorities( map < string, float > &Priorities, set < string > *pInView )
+{
+    Vector3 ViewerPos;
+    Object *pAvatar = World.GetObjectByReference( iMyReference );
+    if( pAvatar != NULL )
+    {
+        ViewerPos = pAvatar->pos;
+    }
+
+    for( int i = 0; i < World.iNumObjects; i++ )
+    {
+        Object *pObject = World.GetObject( i );
+        if( pObject->TypeTag != OBJECTTYPE_PRIM )
+        {
+            continue;
+        }
+        Prim *pPrim = dynamic_cast< Prim *>( pObject );
+        const char *sChecksum = pPrim->GetTexture( 0 );
+        if( sChecksum == NULL || sChecksum[0] == '\0' )
+        {
+            continue;
+        }
+
+        float fSize = pPrim->scale.x;
+        if( pPrim->scale.y > fSize )
+        {
+            fSize = pPrim->scale.y;
+        }
+        if( pPrim->scale.z > fSize )
+        {
+            fSize = pPrim->scale.z;
+        }
+        float dx = pObject->pos.x - ViewerPos.x;
+        float dy = pObject->pos.y - ViewerPos.y;
+        float dz = pObject->pos.z - ViewerPos.z;
+        float fDistance = (float)sqrt( dx * dx + dy * dy + dz * dz );
+        if( fDistance < 1.0 )
+        {
+            fDistance = 1.0;
+        }
+
+        float fPriority = fSize / fDistance;
+        Vector3 Extent( fSize, fSize, fSize );
+        if( !bHaveViewFrustum || BoxInFrustum( ViewFrustum, pObject->pos - Extent, pObject->pos + Extent ) )
+        {
+            if( pInView != NULL )
+            {
+                pInView->insert( sChecksum );
+            }
+        }
+        else
+        {
+            fPriority *= fOutOfViewPriorityScale;
+        }
+
+        float &rPriority = Priorities[ sChecksum ];
+        if( fPriority > rPriority )
+        {
+            rPriority = fPriority;
+        }
+    }
+}
+
+int RendererTexturingClass::GetDownloadPriority( float fPriority )
+{
+    if( fPriority * fDownloadPriorityScale >= iMaxTextureDownloadPriority )
+    {
+        return iMaxTextureDownloadPriority;
+    }
+    return (int)( fPriority * fDownloadPriorityScale );
+}
+
+void RendererTexturingClass::SendDownloadMessage( const char *sMessage, const string &sChecksum, int iPriority )
+{
+    ostringstream messagetoclientfileagentstream;
+    messagetoclientfileagentstream << "<" << sMessage << " type=\"TEXTURE\" checksum=\"" << sChecksum
+    << "\" priority=\"" << iPriority << "\"/>" << endl;
+    TiXmlDocument IPC;
+    IPC.Parse( messagetoclientfileagentstream.str().c_str() );
+    SendXMLDocToFileAgent( IPC );
+}
+
+// Input: Priorities, InView: from GetTexturePriorities
+//
+// Returns: None
+//
+// Description: Sends ClientFileAgent the new priority of each download whose priority has changed.
+//  Downloads of textures no prim in view has used for iCancelOutOfViewMs are cancelled; what
+//  has arrived stays journaled by ClientFileAgent, so asking again, when a prim using the texture
+//  comes back into view, resumes the download.
+//
+// Thread safety: Render thread only
+void RendererTexturingClass::UpdateDownloadPriorities( const map < string, float > &Priorities, const set < string > &InView )
+{
+    int iTickCount = MVGetTickCount();
+    map < string, TEXTUREDOWNLOAD >::iterator it = Downloads.begin();
+    while( it != Downloads.end() )
+    {
+        map < string, TEXTUREDOWNLOAD >::iterator download = it;
+        it++;
+
+        if( InView.find( download->first ) != InView.end() )
+        {
+            download->second.iLastInViewTickCount = iTickCount;
+        }
+        if( download->second.bForPrim && iTickCount - download->second.iLastInViewTickCount >= iCancelOutOfViewMs )
+        {
+            DEBUG( "cancelling download of texture " << download->first << ", out of view" );
+            SendDownloadMessage( "loadercancelfile", download->first, download->second.iPriority );
+            CancelledDownloads.insert( download->first );
+            Downloads.erase( download );
+            continue;
+        }
+
+        map < string, float >::const_iterator priority = Priorities.find( download->first );
+        int iPriority = GetDownloadPriority( priority != Priorities.end() ? priority->second : 0 );
+        if( iPriority != download->second.iPriority )
+        {
+            download->second.iPriority = iPriority;
+            SendDownloadMessage( "loaderfilepriority", download->first, iPriority );
+        }
+    }
+
+    for( set < string >::const_iterator inview = InView.begin(); inview != InView.end(); inview++ )
+    {
+        if( CancelledDownloads.find( *inview ) != CancelledDownloads.end() )
+        {
+            map < string, TEXTUREINFO >::iterator texture = textureinfocache.Textures.find( *inview );
+            if( texture != textureinfocache.Textures.end() )
+            {
+                DownloadTexture( texture->second );
+            }
+            CancelledDownloads.erase( *inview );
+        }
+    }
+}
+
+void RendererTexturingClass::SetViewFrustum( const VIEWFRUSTUM &Frustum )
+{
+    ViewFrustum = Frustum;
+    bHaveViewFrustum = true;
+}
+
+void RendererTexturingClass::DownloadFinished( const char *sChecksum )
+{
+    Downloads.erase( sChecksum );
+}
+
+// Input: rTextureInfo: the texture to upload
+//        rJob: its decoded mip levels
+//
+// Returns: True on success
+//
+// Description: Uploads the mip levels into a new OpenGL texture, and points rTextureInfo at it,
+//  deleting the texture it replaces unless that was the placeholder.  Levels no bigger than
+//  those already uploaded are ignored.
+//
+// Thread safety: Render thread only
+bool RendererTexturingClass::UploadDecodedTexture( TEXTUREINFO &rTextureInfo, const TEXTUREDECODEJOB &rJob )
+{
+    const DECODEDTEXTURE &rTop = rJob.MipLevels[0];
+    int iSize = rTop.iWidth > rTop.iHeight ? rTop.iWidth : rTop.iHeight;
+    rTextureInfo.iFullSize = rJob.iFullSize;
+    if( iSize <= rTextureInfo.iUploadedSize )
+    {
+        return true;
+    }
+
+    GLenum Format = GL_RGB;
+    if( rTop.iChannels == 1 )
+    {
+        Format = GL_LUMINANCE;
+    }
+    else if( rTop.iChannels == 4 )
+    {
+        Format = GL_RGBA;
+    }
+
+    GLuint iTextureID;
+    glGenTextures( 1, &iTextureID );
+    glBindTexture( GL_TEXTURE_2D, iTextureID );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    for( size_t i = 0; i < rJob.MipLevels.size(); i++ )
+    {
+        const DECODEDTEXTURE &rLevel = rJob.MipLevels[i];
+        glTexImage2D( GL_TEXTURE_2D, (GLint)i, rLevel.iChannels, rLevel.iWidth, rLevel.iHeight, 0,
+                      Format, GL_UNSIGNED_BYTE, &rLevel.Pixels[0] );
+    }
+    if( glGetError() != GL_NO_ERROR )
+    {
+        glDeleteTextures( 1, &iTextureID );
+        return false;
+    }
+
+    if( rTextureInfo.iUploadedSize > 0 )
+    {
+        GLuint iOldTextureID = rTextureInfo.iTextureID;
+        glDeleteTextures( 1, &iOldTextureID );
+    }
+    rTextureInfo.iTextureID = iTextureID;
+    rTextureInfo.iUploadedSize = iSize;
+    return true;
+}
+
+// Input: None
+//
+// Returns: None
+//
+// Description: Updates the decode priorities of textures waiting to be decoded or uploaded,
+//  and queues larger mip levels of uploaded textures that have got bigger on screen.
+//  Then updates the downloads, with UpdateDownloadPriorities.
+//
+// Thread safety: Render thread only
+void RendererTexturingClass::UpdateTexturePriorities()
+{
+    map < string, float > Priorities;
+    set < string > InView;
+    GetTexturePriorities( Priorities, &InView );
+
+    vector<string> Pending;
+    TextureDecoder.GetPendingChecksums( Pending );
+    for( vector<string>::iterator it = Pending.begin(); it != Pending.end(); it++ )
+    {
+        map < string, float >::iterator priority = Priorities.find( *it );
+        TextureDecoder.SetPriority( *it, priority != Priorities.end() ? priority->second : 0 );
+    }
+
+    for( map < string, float >::iterator it = Priorities.begin(); it != Priorities.end(); it++ )
+    {
+        map < string, TEXTUREINFO >::iterator texture = textureinfocache.Textures.find( it->first );
+        if( texture != textureinfocache.Textures.end() &&
+                texture->second.iUploadedSize > 0 &&
+                texture->second.iUploadedSize < texture->second.iFullSize &&
+                texture->second.iUploadedSize < GetWantedTextureSize( it->second ) )
+        {
+            QueueTextureDecode( texture->second, it->second );
+        }
+    }
+
+    UpdateDownloadPriorities( Priorities, InView );
+}
+
+// Input: None
+//
+// Returns: None
+//
+// Description: Every iTexturePriorityIntervalMs, runs UpdateTexturePriorities.
+//  Then uploads decoded textures, highest priority first, until iTextureUploadBytesPerFrame
+//  have been uploaded this frame.  Textures that we couldn't decode are loaded the old way,
+//  which may manage formats the decoder doesn't.
+//
+// Thread safety: Render thread only
+void RendererTexturingClass::UploadDecodedTextures()
+{
+    if( MVGetTickCount() - iLastPriorityUpdate >= iTexturePriorityIntervalMs )
+    {
+        iLastPriorityUpdate = MVGetTickCount();
+        UpdateTexturePriorities();
+    }
+
+    if( TextureDecoder.IsIdle() )
+    {
+        return;
+    }
+
+    size_t iBytesUploaded = 0;
+    TEXTUREDECODEJOB *pJob;
+    while( iBytesUploaded < iTextureUploadBytesPerFrame && ( pJob = TextureDecoder.GetDecoded() ) != NULL )
+    {
+        map < string, TEXTUREINFO >::iterator texture = textureinfocache.Textures.find( pJob->sChecksum );
+        if( texture != textureinfocache.Textures.end() )
+        {
+            // a failed larger level leaves the smaller one in place
+            if( ( !pJob->bResult || !UploadDecodedTexture( texture->second, *pJob ) ) && texture->second.iUploadedSize == 0 )
+            {
+                WARNING( "Couldn't decode texture " << pJob->sFilePath << ", loading it directly" );
+                if( !LoadTexture( texture->second ) )
+                {
+                    LoadMissingTexture( texture->second );
+                }
+            }
+            iBytesUploaded += pJob->GetSize();
+        }
+        delete pJob;
     }
 }
 
@@ -270,7 +655,7 @@ void RendererTexturingClass::ApplySkyboxTerrain( int iObjectReference, string sC
 
     if(iArrayNum != -1 )
     {
-        if( strcmp( World.GetObject( iArrayNum )->ObjectType, "PRIM" ) == 0 )
+        if( World.GetObject( iArrayNum )->TypeTag == OBJECTTYPE_PRIM )
         {
             dynamic_cast< Terrain *>( World.GetObject( iArrayNum ) )->SetSkybox( sCheckSum.c_str() );
 
@@ -312,7 +697,7 @@ void RendererTexturingClass::ApplyTexture( int iObjectReference, string sCheckSu
 
     if(iArrayNum != -1 )
     {
-        if( strcmp( World.GetObject( iArrayNum )->ObjectType, "PRIM" ) == 0 )
+        if( World.GetObject( iArrayNum )->TypeTag == OBJECTTYPE_PRIM )
         {
 
             dynamic_cast< Prim *>( World.GetObject( iArrayNum ) )->SetTexture( 0, sCheckSum.c_str() );
@@ -27,16 +27,33 @@
 #ifndef _RENDERERTEXTURING_H
 #define _RENDERERTEXTURING_H
 
+#include <map>
+#include <set>
 #include <string>
 using namespace std;
 
 #include "tinyxml.h"
 
 #include "TextureInfoCache.h"
+#include "TextureDecoder.h"
+#include "Math.h"
 
+//! Loads, uploads and downloads textures
+
+//! Loads, uploads and downloads textures
+//! Textures in the local cache are decoded on background threads, and uploaded into OpenGL a few
+//! per frame by UploadDecodedTextures, nearest and largest on screen first.  Until then they show
+//! the missing texture placeholder.
+//! Only the mip levels big enough for how large a texture is on screen are uploaded; as it
+//! gets bigger on screen, the larger levels are streamed in.
+//! Downloads are asked for with the same priority, so the file agent fetches what's near and in view
+//! first; their priorities are kept up to date, and downloads of textures no prim in view uses are
+//! cancelled, to be asked for again if one comes back into view.
 class RendererTexturingClass
 {
 public:
+   RendererTexturingClass();
+
    void UploadTexture( string TexturePath );                        //!< If texture unknown, asks ClientFileAgent to upload a texture to the server
    void DownloadTexture( TEXTUREINFO &rTextureInfo );              //!< Asks ClientFileAgent to download file from server
 
@@ -63,7 +80,35 @@ public:
 
    void UploadTextureFromXML( TiXmlElement *pElement );            //!< If texture unknown, asks ClientFileAgent to upload a texture to the server, uses UploadTexture
 
+   void UploadDecodedTextures();                                   //!< Uploads decoded textures into OpenGL, within a per-frame budget, and streams in larger mip levels as needed; call once a frame from the render thread
+   void SetViewFrustum( const VIEWFRUSTUM &Frustum );              //!< Frustum drawn this frame, so textures in view get priority; call from the render thread
+   void DownloadFinished( const char *sChecksum );                 //!< ClientFileAgent has finished, failed or cancelled downloading a texture
+
 protected:
+   TextureDecodePool TextureDecoder;                               //!< decodes cached textures off the render thread
+   int iLastPriorityUpdate;                                        //!< tickcount UpdateTexturePriorities last ran
+   VIEWFRUSTUM ViewFrustum;                                        //!< from SetViewFrustum
+   bool bHaveViewFrustum;
+
+   //! a download we've asked ClientFileAgent for
+   struct TEXTUREDOWNLOAD
+   {
+      int iPriority;            //!< priority last sent to ClientFileAgent
+      bool bForPrim;            //!< false if no prim used the texture when it was asked for, eg it's on the skybox; those are never cancelled
+      int iLastInViewTickCount; //!< when a prim in view last used the texture
+   };
+   map < string, TEXTUREDOWNLOAD > Downloads;                      //!< downloads in progress, by checksum
+   set < string > CancelledDownloads;                              //!< downloads cancelled because they went out of view, by checksum
+
+   string GetTextureCachePath( const string &sFilename );          //!< Path of a file in the local texture cache
+   void GetTexturePriorities( map < string, float > &Priorities, set < string > *pInView = NULL ); //!< How big and near each texture in the world is, by checksum, and which are in view
+   int GetDownloadPriority( float fPriority );                     //!< Asset channel priority for a texture of priority fPriority
+   void SendDownloadMessage( const char *sMessage, const string &sChecksum, int iPriority ); //!< sends a loadercancelfile or loaderfilepriority to ClientFileAgent
+   void UpdateDownloadPriorities( const map < string, float > &Priorities, const set < string > &InView );   //!< Reprioritizes downloads, cancelling the ones out of view and re-requesting cancelled ones back in view
+   int GetWantedTextureSize( float fPriority );                   //!< Biggest mip level worth having for a texture of priority fPriority
+   void QueueTextureDecode( TEXTUREINFO &rTextureInfo, float fPriority );
+   void UpdateTexturePriorities();                                 //!< Reprioritizes pending textures, and queues larger mip levels for textures that need them
+   bool UploadDecodedTexture( TEXTUREINFO &rTextureInfo, const TEXTUREDECODEJOB &rJob );
    bool LoadMissingTexture( TEXTUREINFO &rTextureInfo );
    bool LoadTexturePCX( TEXTUREINFO &rTextureInfo );
    bool LoadTextureTGA( TEXTUREINFO &rTextureInfo );
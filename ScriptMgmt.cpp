@@ -55,7 +55,7 @@ void ScriptMgmtClass::AssignScript( int iObjectReference, string sCheckSum )
 
     if(iArrayNum != -1 )
     {
-        if( strcmp( World.GetObject( iArrayNum )->sDeepObjectType, "AVATAR" ) != 0 || iObjectReference == iMyReference )
+        if( World.GetObject( iArrayNum )->DeepTypeTag != DEEPTYPE_AVATAR || iObjectReference == iMyReference )
         {
 
             ostringstream messagestream;
@@ -146,7 +146,7 @@ void MoveObjectsInCircle()
 	  for( int i = 0; i < World.iNumObjects; i++ )
 	  {
 //	  	  if( World.GetObject( i )->iParentReference == 0
-	  	  if( strcmp( World.GetObject( i )->sDeepObjectType, "AVATAR" ) != 0
+	  	  if( World.GetObject( i )->DeepTypeTag != DEEPTYPE_AVATAR
 	  	     && World.GetObject( i )->iReference != 0 )
 	  	  {
 	  	  	 iReference = World.GetObject( i )->iReference;
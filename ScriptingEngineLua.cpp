@@ -37,6 +37,12 @@
 //! lua can handle multithreading jsut fine.  Make sure that only one function is running at a time in each VM
 //! We do this by queuing events up until the VM is free then calling the function correspdongin to the event at that time
 //!
+//! All the VMs are threads of one Lua state, see LuaVMPool, and our Lua isnt built with lua_lock, so no two
+//! event threads may be inside Lua at once.  Each event thread holds EngineMutex for the whole of its lua_pcall,
+//! and a count hook hands the mutex on every iEventTimeSliceInstructions VM instructions, so a long-running
+//! event still cant block the others.  EngineMutex is recursive, so that the API functions the script
+//! calls can lock it as usual
+//!
 //! Note that for the moment the scriptingengine doesnt bind with odephysicsengine.dll, but it probably should do,
 //! and it will do in the future.
 
@@ -45,10 +51,13 @@
 #endif
 
 #include "pthread.h"
+#include <sched.h>
 
 #include <stdio.h>
 #include <math.h>
 #include <map>
+#include <set>
+#include <sstream>
 
 extern "C"
 {
@@ -67,6 +76,7 @@ extern "C"
 #include "Math.h"
 #include "TextureInfoCache.h"
 #include "Animation.h"
+#include "IPCMessages.h"
 #include "ScriptInfoCache.h"
 #include "TerrainInfoCache.h"
 #include "MeshInfoCache.h"
@@ -76,7 +86,12 @@ extern "C"
 #include "LuaScriptingAPI.h"
 #include "LuaScriptingAPIGod.h"
 #include "LuaScriptingAPIHelper.h"
+#include "LuaScriptingStandardRPC.h"
+#include "LuaMulticastGroups.h"
 #include "LuaEventClass.h"
+#include "LuaVMPool.h"
+#include "LuaVMState.h"
+#include "LuaUserDataCache.h"
 
 #include "ObjectGrouping.h"
 
@@ -101,6 +116,7 @@ char SendBuffer[ 2048 ];
 char ReadBuffer[ 4097 ];
 
 int iMyReference = 0;
+int iNumScriptingEngines = 0;   //!< scripting engines registered with the server, including us, as the server last told us; 0 until it does
 
 int StartTickCount = 0;
 const int iTicksPerFrame = 200;  //!< used to regulate resource utilisation by scripting engine
@@ -109,6 +125,12 @@ int LastTickCount = 0;
 
 int iLastScriptingFrameTickCount;
 
+const int iTicksPerVMPoolReport = 60000;  //!< how often the VM pool memory usage is written to the log
+const int iNumPrewarmedVMs = 16;   //!< VMs created at startup, ready for the first scripts
+int iLastVMPoolReportTickCount = 0;
+
+const int iMaxShardStateMessageLength = SOCKETS_READ_BUFFER_LENGTH - 16;   //!< scriptshardstate messages longer than this go without the script state, so the script restarts from Init; leaves room for the server renaming the message to scriptshardassign
+
 int totalTimers = 0;
 
 struct timerData
@@ -138,12 +160,16 @@ captureList[2048];
 float fAngle = 0;
 float fRadius = 5.0;
 
-pthread_mutex_t EngineMutex;    //!< The mutex to encourage this process to run as single-threaded as possible
+pthread_mutex_t EngineMutex;    //!< The mutex to encourage this process to run as single-threaded as possible; recursive
+
+const int iEventTimeSliceInstructions = 10000;   //!< Lua VM instructions an event runs before letting other threads have EngineMutex
 
 map < int, ObjectVMInfoClass > ObjectVMs;   //!< stores all the VMs
 
-map < int, EventInfo * > Events;   //!< This should probably be migrated to be a set, contains all queued events/function calls
-int iNextEventNum = 1;
+set < int > ShardObjects;   //!< objects whose scripts the server has assigned to this engine
+set < int > ShardReleases;   //!< objects the server is moving to another engine; released once their VM is idle
+map < int, string > MigratedScriptStates;   //!< saved state of scripts migrated to this engine, applied once the script is loaded
+
 
 //! sends a message to the Metaverse server.  Function name should be changed really
 void SendClientMessage( const char *message )
@@ -178,21 +204,166 @@ void SocketsBlockTillNextFrame()
     SocketsReadBlock(iTicksTillNextFrame, sockets);
 }
 
-//! Creates a new VM for file sScriptPath and object iObjectReference
-//! iObjectReference is used to send a Say from the object with the results of the compilation: success or the error message
-lua_State *CreateVMFromScript( string sScriptPath, int iObjectReference )
+//! Pushes the arguments of one type of event onto the stack of pluaVM, returns the number of arguments pushed
+//! The event is guaranteed to be of the class matching the event type tag of the handler table entry
+typedef int (*PushEventArgsFunction)( lua_State *pluaVM, const EventInfo *pEvent );
+
+static int PushNoEventArgs( lua_State *pluaVM, const EventInfo *pEvent )
+{
+    return 0;
+}
+
+static int PushClickEventArgs( lua_State *pluaVM, const EventInfo *pEvent )
+{
+    const EventClick *pClickEvent = static_cast< const EventClick *>( pEvent );
+    lua_pushnumber( pluaVM, pClickEvent->iClickerReference );
+    return 1;
+}
+
+static int PushKeyUpEventArgs( lua_State *pluaVM, const EventInfo *pEvent )
 {
-    lua_State *pluaVM = lua_open();
+    const EventKeyUp *pKeyUpEvent = static_cast< const EventKeyUp *>( pEvent );
+    lua_pushstring( pluaVM, pKeyUpEvent->sValue.c_str() );
+    lua_pushnumber( pluaVM, pKeyUpEvent->iReference );
+    return 2;
+}
+
+static int PushKeyDownEventArgs( lua_State *pluaVM, const EventInfo *pEvent )
+{
+    const EventKeyDown *pKeyDownEvent = static_cast< const EventKeyDown *>( pEvent );
+    lua_pushstring( pluaVM, pKeyDownEvent->sValue.c_str() );
+    lua_pushnumber( pluaVM, pKeyDownEvent->iReference );
+    return 2;
+}
 
-    if( NULL == pluaVM )
+static int PushCollisionStartEventArgs( lua_State *pluaVM, const EventInfo *pEvent )
+{
+    const EventCollisionStart *pCollisionStartEvent = static_cast< const EventCollisionStart *>( pEvent );
+    lua_pushnumber( pluaVM, pCollisionStartEvent->iReference );
+    return 1;
+}
+
+static int PushCollisionEndEventArgs( lua_State *pluaVM, const EventInfo *pEvent )
+{
+    const EventCollisionEnd *pCollisionEndEvent = static_cast< const EventCollisionEnd *>( pEvent );
+    lua_pushnumber( pluaVM, pCollisionEndEvent->iReference );
+    return 1;
+}
+
+static int PushUserDataEventArgs( lua_State *pluaVM, const EventInfo *pEvent )
+{
+    const EventInfoUserData *pUserDataEvent = static_cast< const EventInfoUserData * >( pEvent );
+    lua_pushstring( pluaVM, pUserDataEvent->sClientSideReference.c_str() );
+    lua_pushnumber( pluaVM, pUserDataEvent->iOwner );
+    lua_pushstring( pluaVM, pUserDataEvent->sStore.c_str() );
+    lua_pushstring( pluaVM, pUserDataEvent->sKey.c_str() );
+    lua_pushstring( pluaVM, pUserDataEvent->sData.c_str() );
+    return 5;
+}
+
+static int PushAsyncRPCEventArgs( lua_State *pluaVM, const EventInfo *pEvent )
+{
+    const EventInfoMulticastRPC *pRPCEvent = static_cast< const EventInfoMulticastRPC *>( pEvent );
+    lua_pushstring( pluaVM, pRPCEvent->pMessage->sMessage.c_str() );
+    lua_pushnumber( pluaVM, pRPCEvent->iSenderReference );
+    return 2;
+}
+
+//! One entry of the event handler table: the Lua function handling an event type, and how to push its arguments
+struct EventHandlerInfo
+{
+    EventType iEventType;   //!< event type handled; must equal the entry's index in EventHandlers
+    const char *sFunctionName;   //!< Lua function called, or NULL if the function name is carried by the event itself
+    PushEventArgsFunction pPushArgs;   //!< pushes the event's arguments
+};
+
+//! Event handler table, indexed by EventType
+static const EventHandlerInfo EventHandlers[] =
+{
+    { EVENTTYPE_INIT, "Init", PushNoEventArgs },
+    { EVENTTYPE_TIMER, "Timer", PushNoEventArgs },
+    { EVENTTYPE_CLICK, "Click", PushClickEventArgs },
+    { EVENTTYPE_KEYUP, "KeyUp", PushKeyUpEventArgs },
+    { EVENTTYPE_KEYDOWN, "KeyDown", PushKeyDownEventArgs },
+    { EVENTTYPE_COLLISIONSTART, "CollisionStart", PushCollisionStartEventArgs },
+    { EVENTTYPE_COLLISIONEND, "CollisionEnd", PushCollisionEndEventArgs },
+    { EVENTTYPE_USERDATA, "UserData", PushUserDataEventArgs },
+    { EVENTTYPE_ASYNCRPC, "AsyncRPC", PushAsyncRPCEventArgs },
+    { EVENTTYPE_NAMEDFUNCTION, NULL, PushNoEventArgs }
+};
+
+// fails to compile if an EventType is added without a matching EventHandlers entry
+typedef char EventHandlersSizeCheck[ sizeof( EventHandlers ) / sizeof( EventHandlers[0] ) == NUMEVENTTYPES ? 1 : -1 ];
+
+//! Tells LuaVMPool the names of the event handlers, so each VM keeps them where ChildThreadFunction can
+//! fetch them by event type.  A script that defines or replaces a handler at any time, not only while loading,
+//! has its new function called for the next event
+void RegisterEventHandlerNames()
+{
+    const char *HandlerNames[ NUMEVENTTYPES ];
+    for( int i = 0; i < NUMEVENTTYPES; i++ )
     {
-        printf("Error Initializing lua\n" );
-        exit(1);
+        HandlerNames[i] = EventHandlers[i].sFunctionName;
     }
-    luaopen_math( pluaVM );
-    luaopen_base( pluaVM);
+    LuaVMPool::SetHandlerNames( HandlerNames, NUMEVENTTYPES );
+}
+
+//! deletes all events still waiting in the queue of rObjectVMInfo, prior to removing the VM
+void DropPendingEvents( ObjectVMInfoClass &rObjectVMInfo )
+{
+    while( !rObjectVMInfo.PendingEvents.empty() )
+    {
+        DEBUG(  "dropping event for removed vm " << rObjectVMInfo.PendingEvents.front()->sEventName << " on vm " << rObjectVMInfo.iObjectReference ); // DEBUG
+        delete rObjectVMInfo.PendingEvents.front();
+        rObjectVMInfo.PendingEvents.pop_front();
+    }
+}
+
+//! returns true if object iReference has a VM on this engine, with its script loaded
+bool IsVMInitialized( int iReference )
+{
+    ObjectVMIterator iterator = ObjectVMs.find( iReference );
+    return iterator != ObjectVMs.end() && iterator->second.bVMInitialized;
+}
+
+//! Starts the script just loaded into rObjectVMInfo's VM by queuing its Init event
+//! If the script was migrated from another engine, the state it had there is restored instead of running Init
+void StartScript( ObjectVMInfoClass &rObjectVMInfo )
+{
+    map< int, string >::iterator stateiterator = MigratedScriptStates.find( rObjectVMInfo.iObjectReference );
+    if( stateiterator != MigratedScriptStates.end() )
+    {
+        DEBUG( "restoring migrated state for VM # " << rObjectVMInfo.iObjectReference );
+        if( !LuaVMState::RestoreState( rObjectVMInfo.pVM, stateiterator->second ) )
+        {
+            WARNING( "could not restore migrated state for object " << rObjectVMInfo.iObjectReference );
+        }
+        MigratedScriptStates.erase( stateiterator );
+        return;
+    }
+
+    DEBUG("Queue Init event for VM # " << rObjectVMInfo.iObjectReference);
+    EventInit *pEvent = new EventInit;
+
+    pEvent->iVMNum = rObjectVMInfo.iObjectReference;
 
-    RegisterLuaStandardFunctions( pluaVM );
+    QueueEvent( pEvent );
+}
+
+//! Loads file sScriptPath into a VM for object iObjectReference
+//! iObjectReference is used to send a Say from the object with the results of the compilation: success or the error message
+//! If pExistingVM is passed in, that VM is wiped and reused, otherwise a VM is taken from LuaVMPool
+lua_State *CreateVMFromScript( string sScriptPath, int iObjectReference, lua_State *pExistingVM = NULL )
+{
+    lua_State *pluaVM = pExistingVM;
+    if( pluaVM != NULL )
+    {
+        LuaVMPool::RecycleVM( pluaVM, iObjectReference );
+    }
+    else
+    {
+        pluaVM = LuaVMPool::AcquireVM( iObjectReference );
+    }
 
     // char sScriptPath[256];
     // sprintf( sScriptPath, "serverdata\\scripts\\%s", pElement->Attribute("serverfilename" ) );
@@ -219,15 +390,21 @@ lua_State *CreateVMFromScript( string sScriptPath, int iObjectReference )
 }
 
 //! Creates a new VM from the script referenced in ScriptInfo (a filename) for the object iObjectReference
-lua_State *CreateVMFromScriptInfo( SCRIPTINFO &rScriptInfo, int iObjectReference )
+lua_State *CreateVMFromScriptInfo( SCRIPTINFO &rScriptInfo, int iObjectReference, lua_State *pExistingVM = NULL )
 {
-    return CreateVMFromScript( "serverdata\\scripts\\" + rScriptInfo.sServerFilename, iObjectReference );
+    return CreateVMFromScript( "serverdata\\scripts\\" + rScriptInfo.sServerFilename, iObjectReference, pExistingVM );
 }
 
 //! Updates VM associated with object referenced by XML pElement if script has been added/changed/deleted
+//! Objects whose scripts the server hasnt assigned to this engine are ignored
 void UpdateScriptsForObject( TiXmlElement *pElement )
 {
     int iObjectReference = atoi( pElement->Attribute("ireference") );
+    if( ShardObjects.find( iObjectReference ) == ShardObjects.end() )
+    {
+        return;
+    }
+
     int iArrayNum = World.GetArrayNumForObjectReference( iObjectReference );
 
     if( iArrayNum != -1 )
@@ -280,10 +457,15 @@ void UpdateScriptsForObject( TiXmlElement *pElement )
                     DEBUG(  "updating vm for object " << iObjectReference ); // DEBUG
                     // ObjectVMs.erase( iObjectReference );
 
+                    // a VM still running an event is left to its thread to release, and the new script gets another
+                    lua_State *pOldVM = NULL;
                     if( pObjectVMInfo->bVMInitialized )
                     {
                         DEBUG(  "unloading old vm..." ); // DEBUG
-                        lua_close( pObjectVMInfo->pVM );
+                        if( !pObjectVMInfo->bVMIsRunning )
+                        {
+                            pOldVM = pObjectVMInfo->pVM;
+                        }
                         pObjectVMInfo->pVM = NULL;
                         pObjectVMInfo->bVMInitialized = false;
                     }
@@ -292,25 +474,28 @@ void UpdateScriptsForObject( TiXmlElement *pElement )
                     if( ScriptInfoCache.Scripts.find( sNewScriptReference ) != ScriptInfoCache.Scripts.end() )
                     {
                         DEBUG(  "loading script into new vm..." ); // DEBUG
-                        pObjectVMInfo->pVM = CreateVMFromScriptInfo( ScriptInfoCache.Scripts.find( sNewScriptReference )->second, iObjectReference );
-                        LuaScriptingAPIHelper::AddObjectReferenceToVMRegistry( iObjectReference, pObjectVMInfo->pVM );
-
-                        //pthread_mutex_unlock( &EngineMutex );
-                        DEBUG("Queue Init event for VM # " << iObjectReference);
-                        EventInit *pEvent = new EventInit;
+                        pObjectVMInfo->pVM = CreateVMFromScriptInfo( ScriptInfoCache.Scripts.find( sNewScriptReference )->second, iObjectReference, pOldVM );
 
-                        pEvent->sEventName = "Init";
-                        pEvent->sEventClass = "EventInit";
-                        pEvent->iVMNum = iObjectReference;
-
-                        QueueEvent( pEvent );
+                        StartScript( *pObjectVMInfo );
 
                         pObjectVMInfo->bVMInitialized = true;
                     }
+                    else
+                    {
+                        LuaVMPool::ReleaseVM( pOldVM );
+                    }
                 }
             }
             else
             {
+                if( ObjectVMs.find( iObjectReference ) != ObjectVMs.end() )
+                {
+                    DropPendingEvents( ObjectVMs.find( iObjectReference )->second );
+                    if( !ObjectVMs.find( iObjectReference )->second.bVMIsRunning )
+                    {
+                        LuaVMPool::ReleaseVM( ObjectVMs.find( iObjectReference )->second.pVM );
+                    }
+                }
                 ObjectVMs.erase( iObjectReference );
                 DEBUG(  "** did remove vm for object " << iObjectReference ); // DEBUG
             }
@@ -319,11 +504,23 @@ void UpdateScriptsForObject( TiXmlElement *pElement )
 }
 
 //! deletes any VM associated with a deleted object
+//! A VM still running an event is released by its thread when the event returns, see ChildThreadFunction
 void PurgeScriptForDeletedObject( TiXmlElement *pElement )
 {
     int iObjectReference = atoi( pElement->Attribute("ireference") );
     DEBUG(  "purging vm for deleted object ref " << iObjectReference ); // DEBUG
+    ObjectVMIterator iterator = ObjectVMs.find( iObjectReference );
+    if( iterator != ObjectVMs.end() )
+    {
+        DropPendingEvents( iterator->second );
+        if( !iterator->second.bVMIsRunning )
+        {
+            LuaVMPool::ReleaseVM( iterator->second.pVM );
+        }
+    }
     ObjectVMs.erase( iObjectReference );
+    ShardObjects.erase( iObjectReference );
+    MigratedScriptStates.erase( iObjectReference );
 }
 
 //! stores script file info received via XML in the script info cache
@@ -340,190 +537,101 @@ void CacheScriptInfoFromXML( TiXmlElement *pElement )
         {
             DEBUG(  "loading script into vm for object ..." << iterator->first ); // DEBUG
             iterator->second.pVM = CreateVMFromScriptInfo( ScriptInfo, iterator->first );
-            LuaScriptingAPIHelper::AddObjectReferenceToVMRegistry( iterator->first, iterator->second.pVM );
 
-            DEBUG("Queue Scriptinit 2 for VM # " << iterator->first);
-
-            EventInit *pEvent = new EventInit;
-
-            pEvent->sEventName = "Init";
-            pEvent->sEventClass = "EventInit";
-            pEvent->iVMNum = iterator->first;
-
-            QueueEvent( pEvent );
+            StartScript( iterator->second );
 
             iterator->second.bVMInitialized = true;
         }
     }
 }
 
-//! Runs as a separate thread each call.  Called by StartFunction.  Launches a single function/event on teh VM referenced
-//! by the passed in iVMNum (which is the iReference of the object containing the script)
-//! locks mutex as normal, then unlocks just prior to function call, to allow rest of program/scripts to run
-//! on return, locks the mutex again, then unlocks it at end of function.
-void *ChildThreadFunction( void *ptr )
+//! Count hook set on a VM while ChildThreadFunction runs an event in it: lets other threads have EngineMutex.
+//! Lua's state is consistent at hook points, so another thread may run a different VM meanwhile
+static void YieldEngineMutex( lua_State *pluaVM, lua_Debug *pDebug )
 {
+    pthread_mutex_unlock( &EngineMutex );
+    sched_yield();
     pthread_mutex_lock( &EngineMutex );
+}
 
-    int iVMNum = (int)ptr;
-    ObjectVMInfoClass &ObjectVMInfo = ObjectVMs.find( iVMNum )->second;
-
-    const EventInfo *pEvent = ObjectVMInfo.pEvent;
-
-    /*
-       if( ObjectVMInfo.CurrentEvent.sFunctionName == "AsyncRPC" ) // temp fudge for proof of concept
-       {
-         lua_pushstring( ObjectVMInfo.pVM, ObjectVMInfo.CurrentEvent.sData.c_str() );
-
-         pthread_mutex_unlock( &EngineMutex );
-         lua_pcall( ObjectVMInfo.pVM, 1, 0, 0 );
-         pthread_mutex_lock( &EngineMutex );
-       }
-       else
-       {
-
-         pthread_mutex_unlock( &EngineMutex );
-         lua_pcall( ObjectVMInfo.pVM, 0, 0, 0 );
-         pthread_mutex_lock( &EngineMutex );
-       }
-       */
+//! What ChildThreadFunction needs to run one event; passed to the thread by StartEvent, since the VM's entry in
+//! ObjectVMs may be gone by the time the thread gets EngineMutex
+struct EventThreadArgs
+{
+    int iVMNum;   //!< iReference of the object whose VM it is
+    lua_State *pVM;
+    const EventInfo *pEvent;
+};
+
+//! Runs as a separate thread each call.  Called by StartEvent.  Launches a single function/event on the VM passed in
+//! ptr, an EventThreadArgs, which it deletes
+//! The Lua function and its arguments are picked from EventHandlers using the event's type tag
+//! locks mutex as normal, and keeps it through the function call, since all VMs share one Lua state;
+//! YieldEngineMutex lets the rest of program/scripts run while the function does.
+//! If the object was deleted, or given a new script, before the thread got the mutex, the event is dropped.
+//! Either way, once the VM has stopped, it's released if its object no longer has it
+void *ChildThreadFunction( void *ptr )
+{
+    pthread_mutex_lock( &EngineMutex );
 
-    string sEventName = ObjectVMInfo.pEvent->sEventName;
+    EventThreadArgs *pArgs = static_cast< EventThreadArgs * >( ptr );
+    int iVMNum = pArgs->iVMNum;
+    lua_State *pluaVM = pArgs->pVM;
+    const EventInfo *pEvent = pArgs->pEvent;
+    delete pArgs;
+    pArgs = 0;
 
-    if( ObjectVMInfo.pEvent->sEventName == "AsyncRPC" )
+    ObjectVMIterator iterator = ObjectVMs.find( iVMNum );
+    if( pluaVM != NULL && iterator != ObjectVMs.end() && iterator->second.pVM == pluaVM )
     {
-        const EventInfoMulticastRPC *pRPCEvent = dynamic_cast< const EventInfoMulticastRPC *>( pEvent );
-
-        lua_getglobal( ObjectVMInfo.pVM, pRPCEvent->sEventName.c_str() );
-
-        if( LuaScriptingAPIHelper::GetTypename( ObjectVMInfo.pVM, -1 ) == "function" )
+        const EventHandlerInfo &rHandler = EventHandlers[ pEvent->iEventType ];
+        if( rHandler.sFunctionName != NULL )
         {
-            lua_pushstring( ObjectVMInfo.pVM, pRPCEvent->sMessage.c_str() );
-            lua_pushnumber( ObjectVMInfo.pVM, pRPCEvent->iSenderReference );
-
-            pthread_mutex_unlock( &EngineMutex );
-            LuaScriptingAPIHelper::DoPCall(ObjectVMInfo.pVM, 2, 0, 0);
-
-            pthread_mutex_lock( &EngineMutex );
+            LuaVMPool::PushHandler( pluaVM, pEvent->iEventType );
         }
-    }
-    else if( ObjectVMInfo.pEvent->sEventName == "Click" )
-    {
-        const EventClick *pClickEvent = dynamic_cast< const EventClick *>( pEvent );
-
-        lua_getglobal( ObjectVMInfo.pVM, pClickEvent->sEventName.c_str() );
-        DEBUG("Calling click event in script");
-        if( LuaScriptingAPIHelper::GetTypename( ObjectVMInfo.pVM, -1 ) == "function" )
+        else
         {
-            string errmsg;
-            lua_pushnumber( ObjectVMInfo.pVM, pClickEvent->iClickerReference );
-
-            pthread_mutex_unlock( &EngineMutex );
-            LuaScriptingAPIHelper::DoPCall(ObjectVMInfo.pVM, 1, 0, 0);
-            pthread_mutex_lock( &EngineMutex );
+            lua_getglobal( pluaVM, pEvent->sEventName.c_str() );
         }
-    }
-    else if( ObjectVMInfo.pEvent->sEventName == "KeyUp" )
-    {
-        const EventKeyUp *pKeyUpEvent = dynamic_cast< const EventKeyUp *>( pEvent );
-
-        lua_getglobal( ObjectVMInfo.pVM, pKeyUpEvent->sEventName.c_str() );
-        DEBUG("Calling KeyUp event in script");
-        if( LuaScriptingAPIHelper::GetTypename( ObjectVMInfo.pVM, -1 ) == "function" )
+        bool bHaveFunction = lua_type( pluaVM, -1 ) == LUA_TFUNCTION;
+        if( !bHaveFunction )
         {
-            string errmsg;
-            lua_pushstring( ObjectVMInfo.pVM, pKeyUpEvent->sValue.c_str() );
-            lua_pushnumber( ObjectVMInfo.pVM, pKeyUpEvent->iReference );
-
-            pthread_mutex_unlock( &EngineMutex );
-            LuaScriptingAPIHelper::DoPCall(ObjectVMInfo.pVM, 2, 0, 0);
-            pthread_mutex_lock( &EngineMutex );
+            lua_pop( pluaVM, 1 );
         }
-    }
-    else if( ObjectVMInfo.pEvent->sEventName == "KeyDown" )
-    {
-        const EventKeyDown *pKeyDownEvent = dynamic_cast< const EventKeyDown *>( pEvent );
 
-        lua_getglobal( ObjectVMInfo.pVM, pKeyDownEvent->sEventName.c_str() );
-        DEBUG("Calling KeyDown event in script");
-        if( LuaScriptingAPIHelper::GetTypename( ObjectVMInfo.pVM, -1 ) == "function" )
+        if( bHaveFunction )
         {
-            string errmsg;
-            lua_pushstring( ObjectVMInfo.pVM, pKeyDownEvent->sValue.c_str() );
-            lua_pushnumber( ObjectVMInfo.pVM, pKeyDownEvent->iReference );
+            int iNumArgs = rHandler.pPushArgs( pluaVM, pEvent );
 
-            pthread_mutex_unlock( &EngineMutex );
-            LuaScriptingAPIHelper::DoPCall(ObjectVMInfo.pVM, 2, 0, 0);
-            pthread_mutex_lock( &EngineMutex );
+            lua_sethook( pluaVM, YieldEngineMutex, LUA_MASKCOUNT, iEventTimeSliceInstructions );
+            LuaScriptingAPIHelper::DoPCall( pluaVM, iNumArgs, 0, 0);
+            lua_sethook( pluaVM, NULL, 0, 0 );
         }
-    }
-    else if( ObjectVMInfo.pEvent->sEventName == "CollisionEnd" )
-    {
-        const EventCollisionEnd *pCollisionEndEvent = dynamic_cast< const EventCollisionEnd *>( pEvent );
 
-        lua_getglobal( ObjectVMInfo.pVM, pCollisionEndEvent->sEventName.c_str() );
-        DEBUG("Calling CollisonEnd event in script");
-        if( LuaScriptingAPIHelper::GetTypename( ObjectVMInfo.pVM, -1 ) == "function" )
-        {
-            lua_pushnumber( ObjectVMInfo.pVM, pCollisionEndEvent->iReference );
-
-            pthread_mutex_unlock( &EngineMutex );
-            LuaScriptingAPIHelper::DoPCall(ObjectVMInfo.pVM, 1, 0, 0);
-            pthread_mutex_lock( &EngineMutex );
-        }
+        DEBUG(  "returned from lua function, VM " << pEvent->sEventName << " " << iVMNum ); // DEBUG
     }
-    else if( ObjectVMInfo.pEvent->sEventName == "CollisionStart" )
+    else
     {
-        const EventCollisionStart *pCollisionStartEvent = dynamic_cast< const EventCollisionStart *>( pEvent );
-
-        lua_getglobal( ObjectVMInfo.pVM, pCollisionStartEvent->sEventName.c_str() );
-        DEBUG("Calling CollisionStart event in script");
-        if( LuaScriptingAPIHelper::GetTypename( ObjectVMInfo.pVM, -1 ) == "function" )
-        {
-            lua_pushnumber( ObjectVMInfo.pVM, pCollisionStartEvent->iReference );
-
-            pthread_mutex_unlock( &EngineMutex );
-            LuaScriptingAPIHelper::DoPCall(ObjectVMInfo.pVM, 1, 0, 0);
-            pthread_mutex_lock( &EngineMutex );
-        }
+        DEBUG(  "dropping event " << pEvent->sEventName << " for VM " << iVMNum << ", which was removed before it started" ); // DEBUG
     }
-    else if( ObjectVMInfo.pEvent->sEventName == "UserData" )
-    {
-        const EventInfoUserData *pUserDataEvent = dynamic_cast< const EventInfoUserData * >( pEvent );
-
-        lua_getglobal( ObjectVMInfo.pVM, pUserDataEvent->sEventName.c_str() );
 
-        if( LuaScriptingAPIHelper::GetTypename( ObjectVMInfo.pVM, -1 ) == "function" )
-        {
-            lua_pushstring( ObjectVMInfo.pVM, pUserDataEvent->sClientSideReference.c_str() );
-            lua_pushnumber( ObjectVMInfo.pVM, pUserDataEvent->iOwner );
-            lua_pushstring( ObjectVMInfo.pVM, pUserDataEvent->sStore.c_str() );
-            lua_pushstring( ObjectVMInfo.pVM, pUserDataEvent->sKey.c_str() );
-            lua_pushstring( ObjectVMInfo.pVM, pUserDataEvent->sData.c_str() );
-
-            pthread_mutex_unlock( &EngineMutex );
-            LuaScriptingAPIHelper::DoPCall(ObjectVMInfo.pVM, 5, 0, 0);
-            pthread_mutex_lock( &EngineMutex );
-        }
+    // the object may have been deleted, or given a new script in another VM, before or while the event ran;
+    // either way nobody else will release our VM now it has stopped
+    iterator = ObjectVMs.find( iVMNum );
+    if( iterator == ObjectVMs.end() || iterator->second.pVM != pluaVM )
+    {
+        DEBUG(  "releasing VM of object " << iVMNum << ", which was removed while it ran" ); // DEBUG
+        LuaVMPool::ReleaseVM( pluaVM );
     }
-    else
+    // an entry made afresh for the object since isnt running our event, so isnt ours to mark stopped
+    if( iterator != ObjectVMs.end() && iterator->second.pEvent == pEvent )
     {
-        lua_getglobal( ObjectVMInfo.pVM, pEvent->sEventName.c_str() );
-
-        if( LuaScriptingAPIHelper::GetTypename( ObjectVMInfo.pVM, -1 ) == "function" )
-        {
-            pthread_mutex_unlock( &EngineMutex );
-            LuaScriptingAPIHelper::DoPCall(ObjectVMInfo.pVM, 0, 0, 0);
-            pthread_mutex_lock( &EngineMutex );
-        }
+        iterator->second.bVMIsRunning = false;
+        iterator->second.pEvent = 0;
     }
 
-    DEBUG(  "returned from lua function, VM " << sEventName << " " << iVMNum ); // DEBUG
-    ObjectVMInfo.bVMIsRunning = false;
-
     delete pEvent;
     pEvent = 0;
-    ObjectVMInfo.pEvent = 0;
 
     pthread_mutex_unlock( &EngineMutex );
 
@@ -582,85 +690,68 @@ void _QueueFunction( int iVMNum, string sFunctionName, string sData )
 
 //! Start running an event on its targeted VM
 //! assuming that VM is currently available (not running another event)
-void StartEvent( const EventInfo *pEvent )
+//! The caller holds EngineMutex; the new thread waits for it before running the event
+void StartEvent( ObjectVMInfoClass &rObjectVMInfo, const EventInfo *pEvent )
 {
+    rObjectVMInfo.bVMIsRunning = true;
+    rObjectVMInfo.pEvent = pEvent;
+    EventThreadArgs *pArgs = new EventThreadArgs;
+    pArgs->iVMNum = pEvent->iVMNum;
+    pArgs->pVM = rObjectVMInfo.pVM;
+    pArgs->pEvent = pEvent;
+    DEBUG(  "StartEvent() starting thread for event name " << pEvent->sEventName << " on vm " << pEvent->iVMNum ); // DEBUG
+    pthread_create(&(rObjectVMInfo.threadobject), 0, ChildThreadFunction, pArgs );
+    DEBUG(  "StartEvent() ...done" ); // DEBUG
+}
 
-    if( ObjectVMs.find( pEvent->iVMNum ) != ObjectVMs.end() )
+//! Adds an event to the queue of the VM rObjectVMInfo
+//! If the VM is currently available, start running event straight
+//! away
+void QueueEventForVM( ObjectVMInfoClass &rObjectVMInfo, EventInfo *pEvent )
+{
+    if( rObjectVMInfo.bVMIsRunning == false && rObjectVMInfo.PendingEvents.empty() )
     {
-        ObjectVMInfoClass &ObjectVMInfo = ObjectVMs.find( pEvent->iVMNum )->second;
-        ObjectVMInfo.bVMIsRunning = true;
-        ObjectVMInfo.pEvent = pEvent;
-        DEBUG(  "StartEvent() starting thread for event name " << pEvent->sEventName << " on vm " << pEvent->iVMNum ); // DEBUG
-        pthread_create(&(ObjectVMInfo.threadobject), 0, ChildThreadFunction, (void *)pEvent->iVMNum );
-        DEBUG(  "StartEvent() ...done" ); // DEBUG
-        pthread_mutex_unlock( &EngineMutex );
+        DEBUG(  "StartEvent() " << pEvent->iVMNum << " " << pEvent->sEventName ); // DEBUG
+        StartEvent( rObjectVMInfo, pEvent );
     }
     else
     {
-        DEBUG(  "could not find vm for StartEvent() " << pEvent->sEventName << " on vm " << pEvent->iVMNum ); // DEBUG
+        DEBUG(  "QueueEvent() " << pEvent->iVMNum << " " << pEvent->sEventName ); // DEBUG
+        rObjectVMInfo.PendingEvents.push_back( pEvent );
     }
 }
 
-//! Adds an event to the global event queue
+//! Adds an event to the queue of its targeted VM
 //! If the targeted VM is currently available, start running event straight
-//! away
+//! away.  Events for non-existant VMs are dropped
 void QueueEvent( EventInfo *pEvent )
 {
-    ObjectVMInfoClass &ObjectVMInfo = ObjectVMs.find( pEvent->iVMNum )->second;
-
-    if( ObjectVMInfo.bVMIsRunning == false )
-    {
-        DEBUG(  "StartEvent() " << pEvent->iVMNum << " " << pEvent->sEventName ); // DEBUG
-        StartEvent( pEvent );
-    }
-    else
+    ObjectVMIterator iterator = ObjectVMs.find( pEvent->iVMNum );
+    if( iterator == ObjectVMs.end() )
     {
-        //EventInfo *pEvent = new EventInfo;
-        //pEvent->iVMNum = iVMNum;
-        //pEvent->sFunctionName = sFunctionName;
-        //pEvent->sData = sData;
-        DEBUG(  "QueueEvent() " << pEvent->iVMNum << " " << pEvent->sEventName ); // DEBUG
-        Events.insert( pair< int, EventInfo * >( iNextEventNum, pEvent ) );
-        iNextEventNum++;
+        DEBUG(  "QueueEvent() dropping event for non-existant vm " << pEvent->sEventName << " on vm " << pEvent->iVMNum ); // DEBUG
+        delete pEvent;
+        return;
     }
+    QueueEventForVM( iterator->second, pEvent );
 }
 
-//! Starts queued events on each VM, as long as the VM isnt running currently
+//! Starts the oldest queued event on each VM, as long as the VM isnt running currently
 //! otherwise leaves the event in the queue for that VM
 //! (only one function should be running in a VM at a time)
 void StartQueuedFunctions()
 {
-    // DEBUG(  "StartQueuedFunctions() iterating over queued functions..." ); // DEBUG
-    for( map< int, EventInfo * >::iterator iterator = Events.begin(); iterator != Events.end(); iterator++ )
+    for( ObjectVMIterator iterator = ObjectVMs.begin(); iterator != ObjectVMs.end(); iterator++ )
     {
-        if( ObjectVMs.find( iterator->second->iVMNum ) != ObjectVMs.end() )
+        ObjectVMInfoClass &ObjectVMInfo = iterator->second;
+        if( !ObjectVMInfo.bVMIsRunning && !ObjectVMInfo.PendingEvents.empty() )
         {
-            ObjectVMInfoClass &ObjectVMInfo = ObjectVMs.find( iterator->second->iVMNum )->second;
-            if( !ObjectVMInfo.bVMIsRunning )
-            {
-                DEBUG(  "StartQueuedFunctions() starting function " << iterator->second->sEventName << " on vm " << iterator->second->iVMNum ); // DEBUG
-                StartEvent( iterator->second );
-                DEBUG(  "StartQueuedFunctions() ...function started, removing from queue..." ); // DEBUG
-                // delete iterator->second;
-                map< int, EventInfo * >::iterator nextiterator = iterator;
-                nextiterator++;
-                Events.erase( iterator );
-                iterator = nextiterator;
-                DEBUG(  "StartQueuedFunctions() ...removed from queue ok." ); // DEBUG
-            }
-        }
-        else
-        {
-            DEBUG(  "StartQueuedFunctions() dropping event for non-existant vm " <<  iterator->second->sEventName << " on vm " << iterator->second->iVMNum );
-            delete iterator->second;
-            map< int, EventInfo * >::iterator nextiterator = iterator;
-            nextiterator++;
-            Events.erase( iterator );
-            iterator = nextiterator;
-            DEBUG(  "dropped" ); // DEBUG
+            EventInfo *pEvent = ObjectVMInfo.PendingEvents.front();
+            ObjectVMInfo.PendingEvents.pop_front();
+            DEBUG(  "StartQueuedFunctions() starting function " << pEvent->sEventName << " on vm " << pEvent->iVMNum ); // DEBUG
+            StartEvent( ObjectVMInfo, pEvent );
         }
     }
-    // DEBUG(  "StartQueuedFunctions() done" ); // DEBUG
 }
 
 //! Calls the function "Timer" on each active VM
@@ -681,8 +772,6 @@ void RunTimerEvents()
 
                 EventTimer *pEvent = new EventTimer;
 
-                pEvent->sEventName = "Timer";
-                pEvent->sEventClass = "EventTimer";
                 pEvent->iVMNum = iterator->first;
 
                 QueueEvent( pEvent );
@@ -710,7 +799,7 @@ void RunCustomTimerEvents()
             {
                 timerList[i].tickcount = iCurrentTickCount;
                 //ObjectVMInfoClass *pObjectVMInfo = NULL;
-                if (ObjectVMs.find(  timerList[i].iRef )->second.bVMInitialized )
+                if( IsVMInitialized( timerList[i].iRef ) )
                 {
                     if (timerList[i].rcount > 0)
                     {
@@ -721,10 +810,8 @@ void RunCustomTimerEvents()
                         }
                     }
 
-                    EventTimer *pEvent = new EventTimer;
+                    EventTimer *pEvent = new EventTimer( timerList[i].function );
 
-                    pEvent->sEventName = timerList[i].function;
-                    pEvent->sEventClass = "EventTimer";
                     pEvent->iVMNum = timerList[i].iRef;
 
                     QueueEvent( pEvent );
@@ -748,12 +835,10 @@ void SendCollisionStart ( TiXmlElement *pElement )
     Debug("Inside CollisionStart event");
     int ireference = atoi(pElement->Attribute("ireference"));
     int itarget = atoi(pElement->Attribute("itarget"));
-    if (ObjectVMs.find(itarget)->second.bVMInitialized )
+    if( IsVMInitialized( itarget ) )
     {
         EventCollisionStart *pEvent = new EventCollisionStart;
 
-        pEvent->sEventName = "CollisionStart";
-        pEvent->sEventClass = "EventCollisionStart";
         pEvent->iReference = ireference;
         pEvent->iVMNum = itarget;
 
@@ -768,12 +853,10 @@ void SendCollisionEnd ( TiXmlElement *pElement )
     Debug("Inside CollisionEnd event");
     int ireference = atoi(pElement->Attribute("ireference"));
     int itarget = atoi(pElement->Attribute("itarget"));
-    if (ObjectVMs.find(itarget)->second.bVMInitialized )
+    if( IsVMInitialized( itarget ) )
     {
         EventCollisionEnd *pEvent = new EventCollisionEnd;
 
-        pEvent->sEventName = "CollisionEnd";
-        pEvent->sEventClass = "EventCollisionEnd";
         pEvent->iReference = ireference;
         pEvent->iVMNum = itarget;
 
@@ -792,12 +875,10 @@ void SendKeyDown ( TiXmlElement *pElement )
     {
         if ((captureList[i].iowner == iowner) && (captureList[i].active))
         {
-            if (ObjectVMs.find(captureList[i].iRef)->second.bVMInitialized )
+            if( IsVMInitialized( captureList[i].iRef ) )
             {
                 EventKeyDown *pEvent = new EventKeyDown;
 
-                pEvent->sEventName = "KeyDown";
-                pEvent->sEventClass = "EventKeyDown";
                 pEvent->sValue = sValue;
                 pEvent->iReference = iowner;
                 pEvent->iVMNum = captureList[i].iRef;
@@ -821,12 +902,10 @@ void SendKeyUp ( TiXmlElement *pElement )
     {
         if ((captureList[i].iowner == iowner) && (captureList[i].active))
         {
-            if (ObjectVMs.find(captureList[i].iRef)->second.bVMInitialized )
+            if( IsVMInitialized( captureList[i].iRef ) )
             {
                 EventKeyUp *pEvent = new EventKeyUp;
 
-                pEvent->sEventName = "KeyUp";
-                pEvent->sEventClass = "EventKeyUp";
                 pEvent->sValue = sValue;
                 pEvent->iReference = iowner;
                 pEvent->iVMNum = captureList[i].iRef;
@@ -855,8 +934,6 @@ void HandleEvent( TiXmlElement *pElement )
 
         EventClick *pEvent = new EventClick;
 
-        pEvent->sEventName = "Click";
-        pEvent->sEventClass = "EventClick";
         pEvent->iVMNum = iTargetReference;
         pEvent->iClickerReference = iClickerReference;
 
@@ -902,85 +979,359 @@ void HandleInfoResponse( TiXmlElement *pElement )
         string sKey = pElement->Attribute("valuename" );
         string sData = pElement->Attribute("value" );
 
+        LuaUserDataCache::StoreFetchResult( iOwner, sStore, sKey, sData );
+
         EventInfoUserData *pEvent = new EventInfoUserData;
 
-        pEvent->sEventName = "UserData";
-        pEvent->sEventClass = "EventInfoUserData";
         pEvent->iVMNum = iClientReferenceNum;
         pEvent->sClientSideReference = sClientSideReference;
         pEvent->iOwner = iOwner;
         pEvent->sStore = sStore;
+        pEvent->sKey = sKey;
         pEvent->sData = sData;
 
         QueueEvent( pEvent );
     }
 }
 
-//! handles XML input from server, such as object updates, news of new scripts and so on
-void HandleServerInput( char *ReadBuffer )
+//! Adds a custom timer migrated from another engine for object iReference, from the timer XML element pTimerElement
+void RestoreMigratedTimer( int iReference, TiXmlElement *pTimerElement )
 {
-    if( ReadBuffer[0] == '<' )
+    timerData thisTimer;
+    thisTimer.iRef = iReference;
+    thisTimer.function = pTimerElement->Attribute("function");
+    thisTimer.duration = atoi( pTimerElement->Attribute("duration") );
+    thisTimer.repeats = atoi( pTimerElement->Attribute("repeats") );
+    thisTimer.rcount = atoi( pTimerElement->Attribute("rcount") );
+    thisTimer.running = atoi( pTimerElement->Attribute("running") ) != 0;
+    thisTimer.tickcount = MVGetTickCount();
+    thisTimer.active = true;
+
+    if( totalTimers < 2048 )
     {
-        DEBUG( "XML IPC received from server " << ReadBuffer );
-
-        TiXmlDocument IPC;
-        IPC.Parse( ReadBuffer );
-        TiXmlElement *pElement = IPC.RootElement();
-        if( strcmp( pElement->Value(), "objectrefreshdata" ) == 0 )
-        {
-            World.StoreObjectXML( IPC.RootElement() );
-            UpdateScriptsForObject( IPC.RootElement() );
-        }
-        else if( strcmp( pElement->Value(), "objectcreate" ) == 0 )
-        {
-            World.StoreObjectXML( IPC.RootElement() );
-        }
-        else if( strcmp( pElement->Value(), "event" ) == 0 )
-        {
-            HandleEvent( IPC.RootElement() );
-        }
-        else if( strcmp( pElement->Value(), "inforesponse" ) == 0 )
-        {
-            HandleInfoResponse( IPC.RootElement() );
-        }
-        else if( strcmp( pElement->Value(), "objectupdate" ) == 0 )
+        timerList[totalTimers] = thisTimer;
+        totalTimers++;
+        return;
+    }
+    for( int i = 0; i < totalTimers; i++ )
+    {
+        if( timerList[i].active == false || timerList[i].running == false )
         {
-            UpdateScriptsForObject( IPC.RootElement() );
-            World.UpdateObjectXML( IPC.RootElement() );
+            timerList[i] = thisTimer;
+            return;
         }
-        else if( strcmp( pElement->Value(), "objectdelete" ) == 0 )
+    }
+    WARNING( "no timer slot left for migrated timer " << thisTimer.function << " of object " << iReference );
+}
+
+//! Adds a keyboard capture of avatar iOwner migrated from another engine for object iReference
+void RestoreMigratedKeyboardCapture( int iReference, int iOwner )
+{
+    captureData thisCapture;
+    thisCapture.iRef = iReference;
+    thisCapture.iowner = iOwner;
+    thisCapture.active = true;
+
+    if( totalCaptures < 2048 )
+    {
+        captureList[totalCaptures] = thisCapture;
+        totalCaptures++;
+        return;
+    }
+    for( int i = 0; i < totalCaptures; i++ )
+    {
+        if( captureList[i].active == false )
         {
-            World.DeleteObjectXML( IPC.RootElement() );
-            PurgeScriptForDeletedObject( IPC.RootElement() );
+            captureList[i] = thisCapture;
+            return;
         }
-        else if( strcmp( pElement->Value(), "objectmove" ) == 0 )
+    }
+    WARNING( "no capture slot left for migrated keyboard capture of object " << iReference );
+}
+
+//! Server assigns the script of an object to this engine, either a new one, or one migrated from another engine,
+//! in which case pElement carries its state, timers and keyboard captures
+void HandleScriptShardAssign( TiXmlElement *pElement )
+{
+    int iReference = atoi( pElement->Attribute("ireference") );
+    DEBUG( "assigned script of object " << iReference );
+    ShardObjects.insert( iReference );
+    ShardReleases.erase( iReference );
+
+    if( pElement->Attribute("state") != NULL )
+    {
+        MigratedScriptStates[ iReference ] = pElement->Attribute("state");
+    }
+    for( TiXmlElement *pTimerElement = pElement->FirstChildElement("timer"); pTimerElement != NULL; pTimerElement = pTimerElement->NextSiblingElement("timer") )
+    {
+        RestoreMigratedTimer( iReference, pTimerElement );
+    }
+    for( TiXmlElement *pCaptureElement = pElement->FirstChildElement("keyboardcapture"); pCaptureElement != NULL; pCaptureElement = pCaptureElement->NextSiblingElement("keyboardcapture") )
+    {
+        RestoreMigratedKeyboardCapture( iReference, atoi( pCaptureElement->Attribute("iowner") ) );
+    }
+    for( TiXmlElement *pGroupElement = pElement->FirstChildElement("multicastgroup"); pGroupElement != NULL; pGroupElement = pGroupElement->NextSiblingElement("multicastgroup") )
+    {
+        JoinMulticastGroup( iReference, pGroupElement->Attribute("name") );
+    }
+
+    Object *p_Object = World.GetObjectByReference( iReference );
+    if( p_Object != NULL && strcmp( p_Object->sScriptReference, "" ) != 0 )
+    {
+        TiXmlElement ScriptElement( "script" );
+        ScriptElement.SetAttribute( "sscriptreference", p_Object->sScriptReference );
+        TiXmlElement ScriptsElement( "scripts" );
+        ScriptsElement.InsertEndChild( ScriptElement );
+        TiXmlElement ObjectElement( "objectupdate" );
+        ObjectElement.SetAttribute( "ireference", iReference );
+        ObjectElement.InsertEndChild( ScriptsElement );
+
+        UpdateScriptsForObject( &ObjectElement );
+    }
+}
+
+//! Server is moving the script of an object to another engine; the VM is released by ProcessShardReleases once idle
+void HandleScriptShardRelease( TiXmlElement *pElement )
+{
+    int iReference = atoi( pElement->Attribute("ireference") );
+    DEBUG( "releasing script of object " << iReference );
+    ShardReleases.insert( iReference );
+}
+
+//! Saves the state of the script of object iReference, its timers and keyboard captures, removes its VM,
+//! and sends the state to the server, which passes it on to the new owner engine
+void ReleaseShardObject( int iReference )
+{
+    TiXmlElement StateElement( "scriptshardstate" );
+    StateElement.SetAttribute( "ireference", iReference );
+
+    ObjectVMIterator iterator = ObjectVMs.find( iReference );
+    if( iterator != ObjectVMs.end() && iterator->second.bVMInitialized )
+    {
+        string sState;
+        LuaVMState::SaveState( iterator->second.pVM, sState );
+        StateElement.SetAttribute( "state", sState.c_str() );
+    }
+
+    for( int i = 0; i < totalTimers; i++ )
+    {
+        if( timerList[i].iRef == iReference && timerList[i].active )
         {
-            animator.MoveObject( pElement );
-            //World.MoveObjectXML( IPC.RootElement() );
+            TiXmlElement TimerElement( "timer" );
+            TimerElement.SetAttribute( "function", timerList[i].function.c_str() );
+            TimerElement.SetAttribute( "duration", timerList[i].duration );
+            TimerElement.SetAttribute( "repeats", timerList[i].repeats );
+            TimerElement.SetAttribute( "rcount", timerList[i].rcount );
+            TimerElement.SetAttribute( "running", timerList[i].running ? 1 : 0 );
+            StateElement.InsertEndChild( TimerElement );
+            timerList[i].active = false;
         }
-        else if( strcmp( pElement->Value(), "script" ) == 0 )
+    }
+    for( int i = 0; i < totalCaptures; i++ )
+    {
+        if( captureList[i].iRef == iReference && captureList[i].active )
         {
-            CacheScriptInfoFromXML( pElement );
+            TiXmlElement CaptureElement( "keyboardcapture" );
+            CaptureElement.SetAttribute( "iowner", captureList[i].iowner );
+            StateElement.InsertEndChild( CaptureElement );
+            captureList[i].active = false;
         }
-        else if( strcmp( pElement->Value(), "loginaccept" ) == 0 )
+    }
+    vector< string > MulticastGroupNames;
+    TakeMulticastGroupsForObject( iReference, MulticastGroupNames );
+    for( int i = 0; i < (int)MulticastGroupNames.size(); i++ )
+    {
+        TiXmlElement GroupElement( "multicastgroup" );
+        GroupElement.SetAttribute( "name", MulticastGroupNames[i].c_str() );
+        StateElement.InsertEndChild( GroupElement );
+    }
+
+    if( iterator != ObjectVMs.end() )
+    {
+        DropPendingEvents( iterator->second );
+        LuaVMPool::ReleaseVM( iterator->second.pVM );
+        ObjectVMs.erase( iterator );
+    }
+    ShardObjects.erase( iReference );
+    MigratedScriptStates.erase( iReference );
+
+    // the limit is on the whole message, as escaped and sent, not just the state
+    ostringstream messagestream;
+    messagestream << StateElement << endl;
+    if( (int)messagestream.str().size() > iMaxShardStateMessageLength && StateElement.Attribute( "state" ) != NULL )
+    {
+        WARNING( "state of object " << iReference << " too large to migrate (" << messagestream.str().size() << " bytes), script will restart" );
+        StateElement.RemoveAttribute( "state" );
+        messagestream.str( "" );
+        messagestream << StateElement << endl;
+    }
+    string sMessage = messagestream.str();
+    SocketMetaverseServer.Send( sMessage.c_str(), sMessage.size() );
+}
+
+//! Releases the VMs the server asked us to give up, once they are not running an event
+void ProcessShardReleases()
+{
+    set< int >::iterator iterator = ShardReleases.begin();
+    while( iterator != ShardReleases.end() )
+    {
+        ObjectVMIterator vmiterator = ObjectVMs.find( *iterator );
+        if( vmiterator != ObjectVMs.end() && vmiterator->second.bVMIsRunning )
         {
-            iMyReference = atoi( pElement->Attribute("ireference" ) );
+            iterator++;
+            continue;
         }
-        else if( strcmp( pElement->Value(), "keyup" ) == 0 )
+        ReleaseShardObject( *iterator );
+        ShardReleases.erase( iterator++ );
+    }
+}
+
+//! Drops user data values changed by other engines or clients from the user data cache
+void HandleUserDataChanged( TiXmlElement *pElement )
+{
+    for( TiXmlElement *pValueElement = pElement->FirstChildElement("userdata"); pValueElement != NULL; pValueElement = pValueElement->NextSiblingElement("userdata") )
+    {
+        LuaUserDataCache::Invalidate( atoi( pValueElement->Attribute("iowner") ), pValueElement->Attribute("store"), pValueElement->Attribute("valuename") );
+    }
+}
+
+static void HandleObjectRefreshData( TiXmlElement *pElement )
+{
+    World.StoreObjectXML( pElement );
+    UpdateScriptsForObject( pElement );
+}
+
+static void HandleObjectCreate( TiXmlElement *pElement )
+{
+    World.StoreObjectXML( pElement );
+}
+
+static void HandleObjectUpdate( TiXmlElement *pElement )
+{
+    UpdateScriptsForObject( pElement );
+    World.UpdateObjectXML( pElement );
+}
+
+static void HandleObjectDelete( TiXmlElement *pElement )
+{
+    World.DeleteObjectXML( pElement );
+    PurgeScriptForDeletedObject( pElement );
+}
+
+static void HandleLoginAccept( TiXmlElement *pElement )
+{
+    iMyReference = atoi( pElement->Attribute("ireference" ) );
+}
+
+//! notes how many scripting engines the server has, so multicast RPCs only go to the server when there are others
+static void HandleScriptingEngines( TiXmlElement *pElement )
+{
+    if( pElement->Attribute( "count" ) != NULL )
+    {
+        iNumScriptingEngines = atoi( pElement->Attribute( "count" ) );
+    }
+}
+
+//! registers the scripts listed in a <filemanifest>; we dont need the other file types
+static void HandleFileManifest( TiXmlElement *pElement )
+{
+    for( TiXmlElement *pChild = pElement->FirstChildElement( "script" ); pChild != NULL; pChild = pChild->NextSiblingElement( "script" ) )
+    {
+        CacheScriptInfoFromXML( pChild );
+    }
+}
+
+//! Handles one type of XML IPC message from the server
+typedef void (*ServerMessageHandlerFunction)( TiXmlElement *pElement );
+
+//! returns handler for messages of type MessageType, or NULL if we dont handle that message
+//! The names are looked up once, by GetIPCMessageType, against the shared list in IPCMessages.cpp
+static ServerMessageHandlerFunction GetServerMessageHandler( IPCMessageType MessageType )
+{
+    switch( MessageType )
+    {
+    case IPC_COLLISIONEND:
+        return SendCollisionEnd;
+    case IPC_COLLISIONSTART:
+        return SendCollisionStart;
+    case IPC_EVENT:
+        return HandleEvent;
+    case IPC_FILEMANIFEST:
+        return HandleFileManifest;
+    case IPC_INFORESPONSE:
+        return HandleInfoResponse;
+    case IPC_KEYDOWN:
+        return SendKeyDown;
+    case IPC_KEYUP:
+        return SendKeyUp;
+    case IPC_LOGINACCEPT:
+        return HandleLoginAccept;
+    case IPC_MULTICASTRPC:
+        return DeliverMulticastRPC;
+    case IPC_OBJECTCREATE:
+        return HandleObjectCreate;
+    case IPC_OBJECTDELETE:
+        return HandleObjectDelete;
+    case IPC_OBJECTREFRESHDATA:
+        return HandleObjectRefreshData;
+    case IPC_OBJECTUPDATE:
+        return HandleObjectUpdate;
+    case IPC_SCRIPT:
+        return CacheScriptInfoFromXML;
+    case IPC_SCRIPTINGENGINES:
+        return HandleScriptingEngines;
+    case IPC_SCRIPTSHARDASSIGN:
+        return HandleScriptShardAssign;
+    case IPC_SCRIPTSHARDRELEASE:
+        return HandleScriptShardRelease;
+    case IPC_USERDATACHANGED:
+        return HandleUserDataChanged;
+    default:
+        return NULL;
+    }
+}
+
+//! handles XML input from server, such as object updates, news of new scripts and so on
+void HandleServerInput( char *ReadBuffer )
+{
+    if( ReadBuffer[0] == '<' )
+    {
+        DEBUG( "XML IPC received from server " << ReadBuffer );
+
+        // moves are most of what we get, and dont need the whole document built
+        IPCMessageType MessageType = GetIPCMessageType( ReadBuffer );
+        if( MessageType == IPC_OBJECTMOVE )
         {
-            SendKeyUp(IPC.RootElement() );
+            OBJECTMOVEMESSAGE Move;
+            if( ParseObjectMove( ReadBuffer, Move ) )
+            {
+                animator.MoveObject( Move );
+            }
+            return;
         }
-        else if( strcmp( pElement->Value(), "keydown" ) == 0 )
+        else if( MessageType == IPC_OBJECTTRACK )
         {
-            SendKeyDown(IPC.RootElement() );
+            OBJECTTRACKMESSAGE Track;
+            if( ParseObjectTrack( ReadBuffer, Track ) )
+            {
+                animator.SetTrack( Track );
+            }
+            return;
         }
-        else if( strcmp( pElement->Value(), "collisionstart" ) == 0 )
+
+        // only build the document for messages we handle
+        ServerMessageHandlerFunction pHandler = GetServerMessageHandler( MessageType );
+        if( pHandler == NULL )
         {
-            SendCollisionStart(IPC.RootElement() );
+            return;
         }
-        else if( strcmp( pElement->Value(), "collisionend" ) == 0 )
+
+        TiXmlDocument IPC;
+        IPC.Parse( ReadBuffer );
+        TiXmlElement *pElement = IPC.RootElement();
+        if( pElement != NULL )
         {
-            SendCollisionEnd(IPC.RootElement() );
+            pHandler( pElement );
         }
     }
     else
@@ -992,7 +1343,11 @@ void HandleServerInput( char *ReadBuffer )
 //! mainloop
 void MainLoop()
 {
-    pthread_mutex_init(&EngineMutex, 0);
+    pthread_mutexattr_t EngineMutexAttributes;
+    pthread_mutexattr_init( &EngineMutexAttributes );
+    pthread_mutexattr_settype( &EngineMutexAttributes, PTHREAD_MUTEX_RECURSIVE );
+    pthread_mutex_init( &EngineMutex, &EngineMutexAttributes );
+    pthread_mutexattr_destroy( &EngineMutexAttributes );
 
     while(1)
     {
@@ -1021,6 +1376,13 @@ void MainLoop()
             RunCustomTimerEvents();
             iLastScriptingFrameTickCount = MVGetTickCount();
         }
+        if( MVGetTickCount() - iLastVMPoolReportTickCount > iTicksPerVMPoolReport )
+        {
+            LuaVMPool::ReportMemoryUsage();
+            iLastVMPoolReportTickCount = MVGetTickCount();
+        }
+        ProcessShardReleases();
+        LuaUserDataCache::FlushWrites();
         StartQueuedFunctions();
         pthread_mutex_unlock( &EngineMutex );
 
@@ -1042,6 +1404,7 @@ int main(int argc, char *argv[])
 
     ScriptInfoCache.Scripts.clear();
     ObjectVMs.clear();
+    RegisterEventHandlerNames();
 
     sprintf( sMetaverseServerIP, "127.0.0.1" );
     sprintf( sAvatarName, "Guest" );
@@ -1064,9 +1427,14 @@ int main(int argc, char *argv[])
             sprintf( sAvatarPassword, argv[ argnum + 1] );
             argnum++;
         }
+        else if( strcmp( argv[ argnum ], "-vmreport" ) == 0 )
+        {
+            LuaVMPool::ReportCreationCost( atoi( argv[ argnum + 1 ] ) );
+            exit(0);
+        }
         else if( strcmp( argv[ argnum ], "-?" ) == 0 || strcmp( argv[ argnum ], "-h" ) == 0  || strcmp( argv[ argnum ], "/h" ) == 0  || strcmp( argv[ argnum ], "/?" ) == 0 )
         {
-            printf( "Usage: %s [ -s server IP ] -u user [ -p password ]\n", argv[0] );
+            printf( "Usage: %s [ -s server IP ] -u user [ -p password ] [ -vmreport number of VMs ]\n", argv[0] );
             exit(1);
         }
     }
@@ -1121,12 +1489,18 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    LuaVMPool::Prewarm( iNumPrewarmedVMs );
+
     printf( "Initialization complete\n" );
 
     printf( "Requesting world state...\n" );
 
     SocketMetaverseServer.Send( "<requestworldstate />\n" );
 
+    // server assigns us our share of the scripts once it has sent the world state
+    printf( "Registering as scripting engine...\n" );
+    SocketMetaverseServer.Send( "<registerscriptingengine />\n" );
+
     MainLoop();
 
     return 0;
@@ -25,11 +25,13 @@
 #define _SCRIPTINGENGINELUA_H
 
 #include <map>
+#include <deque>
 using namespace std;
 
 extern "C"
 {
 #include <lua.h>
+#include "lauxlib.h"
 }
 
 #include "pthread.h"
@@ -41,12 +43,18 @@ extern "C"
 //! Queues one event to the corresponding Lua VM
 void QueueEvent( EventInfo *pEvent );
 
+class ObjectVMInfoClass;
+
+//! Queues one event to the already looked-up VM rObjectVMInfo
+void QueueEventForVM( ObjectVMInfoClass &rObjectVMInfo, EventInfo *pEvent );
+
 //! Stores information about a single Lua virtual machine
 
 //! Stores information about a single Lua virtual machine, such as:
 //! - whether it is running
 //! - whether it is initialized
 //! - refrence of running script
+//! - events waiting for the VM to finish its current event
 class ObjectVMInfoClass
 {
 public:
@@ -57,6 +65,7 @@ public:
     bool bVMIsRunning;    //!< whether VM is running or not
     pthread_t threadobject;  //!< thread associated with running VM
     const EventInfo *pEvent;   //!< currently executing event
+    deque< EventInfo * > PendingEvents;   //!< events queued for this VM, oldest first
     ObjectVMInfoClass()
     {
         pVM = NULL;
@@ -0,0 +1,269 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Tracks which scripting engine process runs the script of each object
+//!
+//! The metaverseserver can have several Lua scripting engine processes connected at once, each
+//! running the scripts of a subset of the objects, so that script load spreads across cores and
+//! machines.  An engine announces itself with <registerscriptingengine/> after logging in.
+//!
+//! New scripted objects go to the engine with the fewest objects.  When an engine joins, objects are
+//! migrated from the busiest engines to it:
+//! - server sends <scriptshardrelease ireference="..."/> to the current owner
+//! - the owner serializes the VM's state, drops the VM, and replies with <scriptshardstate ireference="..." ...>
+//! - server records the new owner and forwards the state to it as <scriptshardassign ireference="..." ...>
+//! Until the state arrives, the object still belongs to the old owner, so collisions and clicks
+//! sent to it in the meantime are lost.
+//!
+//! When an engine disconnects, its objects are given to the remaining engines without state, so
+//! their scripts start again from Init.
+//!
+//! Whenever an engine joins or is lost, the server sends every engine <scriptingengines count="..."/>.
+//! An engine that is alone delivers multicast RPCs itself, without relaying them through the server.
+
+#include "ScriptingEngineShards.h"
+
+void ScriptingEngineShardsClass::AddEngine( int iConnectionRef )
+{
+    if( EngineObjects.find( iConnectionRef ) == EngineObjects.end() )
+    {
+        EngineObjects.insert( pair< int, set< int > >( iConnectionRef, set< int >() ) );
+    }
+}
+
+void ScriptingEngineShardsClass::RemoveEngine( int iConnectionRef, vector< int > &OrphanedObjects )
+{
+    map< int, set< int > >::iterator engineiterator = EngineObjects.find( iConnectionRef );
+    if( engineiterator == EngineObjects.end() )
+    {
+        return;
+    }
+
+    for( set< int >::iterator iterator = engineiterator->second.begin(); iterator != engineiterator->second.end(); iterator++ )
+    {
+        OrphanedObjects.push_back( *iterator );
+        ObjectOwners.erase( *iterator );
+        Migrations.erase( *iterator );
+    }
+    EngineObjects.erase( engineiterator );
+
+    // migrations towards this engine are redirected when their state arrives, see CompleteMigration
+}
+
+bool ScriptingEngineShardsClass::IsEngine( int iConnectionRef ) const
+{
+    return EngineObjects.find( iConnectionRef ) != EngineObjects.end();
+}
+
+int ScriptingEngineShardsClass::GetNumEngines() const
+{
+    return (int)EngineObjects.size();
+}
+
+void ScriptingEngineShardsClass::GetEngines( vector< int > &Engines ) const
+{
+    for( map< int, set< int > >::const_iterator iterator = EngineObjects.begin(); iterator != EngineObjects.end(); iterator++ )
+    {
+        Engines.push_back( iterator->first );
+    }
+}
+
+int ScriptingEngineShardsClass::GetOwner( int iReference ) const
+{
+    map< int, int >::const_iterator iterator = ObjectOwners.find( iReference );
+    if( iterator == ObjectOwners.end() )
+    {
+        return -1;
+    }
+    return iterator->second;
+}
+
+int ScriptingEngineShardsClass::GetLeastLoadedEngine() const
+{
+    int iBestEngine = -1;
+    int iBestLoad = 0;
+    for( map< int, set< int > >::const_iterator iterator = EngineObjects.begin(); iterator != EngineObjects.end(); iterator++ )
+    {
+        if( iBestEngine == -1 || (int)iterator->second.size() < iBestLoad )
+        {
+            iBestEngine = iterator->first;
+            iBestLoad = (int)iterator->second.size();
+        }
+    }
+    return iBestEngine;
+}
+
+void ScriptingEngineShardsClass::SetOwner( int iReference, int iConnectionRef )
+{
+    int iOldOwner = GetOwner( iReference );
+    if( iOldOwner != -1 )
+    {
+        EngineObjects.find( iOldOwner )->second.erase( iReference );
+    }
+    ObjectOwners[ iReference ] = iConnectionRef;
+    EngineObjects.find( iConnectionRef )->second.insert( iReference );
+}
+
+int ScriptingEngineShardsClass::AssignObject( int iReference )
+{
+    int iConnectionRef = GetLeastLoadedEngine();
+    if( iConnectionRef != -1 )
+    {
+        SetOwner( iReference, iConnectionRef );
+    }
+    return iConnectionRef;
+}
+
+void ScriptingEngineShardsClass::RemoveObject( int iReference )
+{
+    int iOwner = GetOwner( iReference );
+    if( iOwner != -1 )
+    {
+        EngineObjects.find( iOwner )->second.erase( iReference );
+        ObjectOwners.erase( iReference );
+    }
+    Migrations.erase( iReference );
+    RemoveKeyboardCaptures( iReference );
+}
+
+//! Loads are counted as they will be once all migrations in flight have completed
+//! Each planned object is recorded as in flight, so it wont be planned twice
+void ScriptingEngineShardsClass::PlanRebalance( vector< SCRIPTMIGRATION > &NewMigrations )
+{
+    map< int, int > Loads;
+    for( map< int, set< int > >::iterator iterator = EngineObjects.begin(); iterator != EngineObjects.end(); iterator++ )
+    {
+        Loads[ iterator->first ] = (int)iterator->second.size();
+    }
+    for( map< int, int >::iterator iterator = Migrations.begin(); iterator != Migrations.end(); iterator++ )
+    {
+        Loads[ GetOwner( iterator->first ) ]--;
+        if( Loads.find( iterator->second ) != Loads.end() )
+        {
+            Loads[ iterator->second ]++;
+        }
+    }
+
+    while( Loads.size() > 1 )
+    {
+        map< int, int >::iterator busiest = Loads.begin();
+        map< int, int >::iterator idlest = Loads.begin();
+        for( map< int, int >::iterator iterator = Loads.begin(); iterator != Loads.end(); iterator++ )
+        {
+            if( iterator->second > busiest->second )
+            {
+                busiest = iterator;
+            }
+            if( iterator->second < idlest->second )
+            {
+                idlest = iterator;
+            }
+        }
+        if( busiest->second - idlest->second <= 1 )
+        {
+            break;
+        }
+
+        set< int > &rCandidates = EngineObjects.find( busiest->first )->second;
+        set< int >::iterator candidate = rCandidates.begin();
+        while( candidate != rCandidates.end() && Migrations.find( *candidate ) != Migrations.end() )
+        {
+            candidate++;
+        }
+        if( candidate == rCandidates.end() )
+        {
+            break;
+        }
+
+        SCRIPTMIGRATION Migration;
+        Migration.iReference = *candidate;
+        Migration.iSourceConnectionRef = busiest->first;
+        Migration.iTargetConnectionRef = idlest->first;
+        NewMigrations.push_back( Migration );
+
+        Migrations.insert( pair< int, int >( Migration.iReference, Migration.iTargetConnectionRef ) );
+        busiest->second--;
+        idlest->second++;
+    }
+}
+
+//! If the planned target has gone away in the meantime, the least loaded engine gets the object instead
+int ScriptingEngineShardsClass::CompleteMigration( int iReference )
+{
+    if( GetOwner( iReference ) == -1 )
+    {
+        return -1;
+    }
+
+    int iTargetConnectionRef = -1;
+    map< int, int >::iterator iterator = Migrations.find( iReference );
+    if( iterator != Migrations.end() )
+    {
+        iTargetConnectionRef = iterator->second;
+        Migrations.erase( iterator );
+    }
+    if( !IsEngine( iTargetConnectionRef ) )
+    {
+        iTargetConnectionRef = GetLeastLoadedEngine();
+    }
+
+    SetOwner( iReference, iTargetConnectionRef );
+    return iTargetConnectionRef;
+}
+
+void ScriptingEngineShardsClass::AddKeyboardCapture( int iAvatarReference, int iReference )
+{
+    KeyboardCaptures[ iAvatarReference ].insert( iReference );
+}
+
+void ScriptingEngineShardsClass::RemoveKeyboardCaptures( int iReference )
+{
+    map< int, set< int > >::iterator iterator = KeyboardCaptures.begin();
+    while( iterator != KeyboardCaptures.end() )
+    {
+        iterator->second.erase( iReference );
+        if( iterator->second.empty() )
+        {
+            KeyboardCaptures.erase( iterator++ );
+        }
+        else
+        {
+            iterator++;
+        }
+    }
+}
+
+void ScriptingEngineShardsClass::GetEnginesCapturingKeyboard( int iAvatarReference, set< int > &Engines ) const
+{
+    map< int, set< int > >::const_iterator captureiterator = KeyboardCaptures.find( iAvatarReference );
+    if( captureiterator == KeyboardCaptures.end() )
+    {
+        return;
+    }
+    for( set< int >::const_iterator iterator = captureiterator->second.begin(); iterator != captureiterator->second.end(); iterator++ )
+    {
+        int iOwner = GetOwner( *iterator );
+        if( iOwner != -1 )
+        {
+            Engines.insert( iOwner );
+        }
+    }
+}
@@ -0,0 +1,78 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Tracks which scripting engine process runs the script of each object
+
+// see ScriptingEngineShards.cpp for documentation
+
+#ifndef _SCRIPTINGENGINESHARDS_H
+#define _SCRIPTINGENGINESHARDS_H
+
+#include <map>
+#include <set>
+#include <vector>
+using namespace std;
+
+//! One planned move of an object's script from one scripting engine to another, used by ScriptingEngineShardsClass
+class SCRIPTMIGRATION
+{
+public:
+   int iReference;   //!< object whose script is moving
+   int iSourceConnectionRef;   //!< engine currently running the script
+   int iTargetConnectionRef;   //!< engine that will run the script once its state has arrived
+};
+
+//! ScriptingEngineShardsClass tracks which scripting engine runs the script of each object
+
+//! ScriptingEngineShardsClass tracks which scripting engine runs the script of each object
+//! Engines are identified by their connection reference in the server's connection manager
+//! This class is only bookkeeping; sending the assign/release messages is left to the server
+class ScriptingEngineShardsClass
+{
+public:
+   void AddEngine( int iConnectionRef );   //!< registers a scripting engine, initially owning nothing
+   void RemoveEngine( int iConnectionRef, vector< int > &OrphanedObjects );   //!< forgets an engine; the objects it owned are appended to OrphanedObjects and are left unowned
+   bool IsEngine( int iConnectionRef ) const;   //!< returns true if iConnectionRef is a registered scripting engine
+   int GetNumEngines() const;
+   void GetEngines( vector< int > &Engines ) const;   //!< appends connection refs of all registered engines to Engines
+
+   int GetOwner( int iReference ) const;   //!< returns engine owning the script of object iReference, or -1 if none
+   int AssignObject( int iReference );   //!< gives object iReference to the least loaded engine, returning that engine, or -1 if there are no engines
+   void RemoveObject( int iReference );   //!< forgets object iReference, eg because it was deleted
+
+   void PlanRebalance( vector< SCRIPTMIGRATION > &NewMigrations );   //!< plans migrations so that engine loads differ by at most one
+   int CompleteMigration( int iReference );   //!< hands object iReference to its migration target, once its state has arrived; returns the new owner, or -1 if the object is gone
+
+   void AddKeyboardCapture( int iAvatarReference, int iReference );   //!< object iReference is capturing the keyboard of avatar iAvatarReference
+   void RemoveKeyboardCaptures( int iReference );   //!< object iReference no longer captures any keyboard
+   void GetEnginesCapturingKeyboard( int iAvatarReference, set< int > &Engines ) const;   //!< adds the engines owning objects that capture iAvatarReference's keyboard
+
+protected:
+   map< int, int > ObjectOwners;   //!< owning engine, by object reference
+   map< int, set< int > > EngineObjects;   //!< objects owned, by engine
+   map< int, int > Migrations;   //!< target engine of migrations in flight, by object reference
+   map< int, set< int > > KeyboardCaptures;   //!< objects capturing the keyboard, by avatar reference
+
+   int GetLeastLoadedEngine() const;   //!< returns engine with the fewest objects, or -1 if there are no engines
+   void SetOwner( int iReference, int iConnectionRef );
+};
+
+#endif // _SCRIPTINGENGINESHARDS_H
@@ -203,7 +203,7 @@ void mvSelection::ToggleObjectInSelection( int iReference, bool bSelectParentObj
         else
         {
             // check it's not an avatar, or, if it is, that its us :-O
-            if( strcmp( World.GetObject( iObjectArrayNum )->sDeepObjectType, "AVATAR" ) != 0 || World.GetObject( iObjectArrayNum )->iReference == MetaverseClient::iMyReference )
+            if( World.GetObject( iObjectArrayNum )->DeepTypeTag != DEEPTYPE_AVATAR || World.GetObject( iObjectArrayNum )->iReference == MetaverseClient::iMyReference )
             {
                 SelectedObjectIterator = SelectedObjects.find( iReference );
                 if( SelectedObjectIterator != SelectedObjects.end() )
@@ -30,11 +30,27 @@
 //! to facilitate error handling and reduce protocol management
 //! The client makes a single connection at a time to prevent bandwidth domination over
 //! the higher-priority main control socket that is used for avatar movement and so on.
+//!
+//! Alternatively a client can open one persistent "channel" connection, starting with
+//! <loaderchannel/>, and multiplex all its downloads over it:
+//! - client sends <channelget id="" type="" serverfilename="" checksum="" offset="" priority=""/>,
+//!   <channelpriority id="" priority=""/> and <channelcancel id=""/>, one per line
+//! - server sends <channelbegin id="" offset="" length="" filesize="" encoding=""/>, then any number of
+//!   <channeldata id="" length=""/> frames each followed by length bytes of data, or <channelerror id=""/>
+//! Frame headers end in CRLF.  Higher priority downloads are framed first; equal priorities take turns.
+//! channelget can list the encodings the client accepts, eg encodings="heightmap,lz", in order of
+//! preference; the server sends the first that applies and is worthwhile, from an encoded variant kept
+//! next to the original, and says which in channelbegin.  offsetencoding says which encoding a
+//! resume offset refers to; the offset is ignored if the server picks a different one.
 
 // Modified 20050330 Mark Wagner - Converted to use the mvsocket class as a class
 //                               - Converted CONNECTION into a class
 //                               - Replaced an array with a vector
 // Modified 20050416 Hugh Perkins - includes CRuntimeNameCompat, for Windows build
+// Downloads are sent with non-blocking SendFileChunk calls, driven by socket writability
+// Downloads requested by checksum are served through the content-addressed AssetStore
+// Downloads can ask for a byte range, so interrupted transfers can be resumed
+// Channel downloads can be sent encoded, see AssetCodec.h
 
 // TODO: Proper rate limiting
 
@@ -42,7 +58,12 @@
 #include <sstream>
 #include <string.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <iostream>
+#include <map>
+#include <string>
 using namespace std;
 
 #include "tinyxml.h"
@@ -53,6 +74,8 @@ using namespace std;
 //#include "filetrans.h"
 #include "Checksum.h"
 #include "System.h"
+#include "AssetStore.h"
+#include "AssetCodec.h"
 
 int iMetaverseServerPort = 22140;  //!< port used to connect to metaverseserver component
 int iClientFileAgentListenPort = 22174;   //!< port on which to listen for connections from clientfileagent
@@ -61,9 +84,247 @@ int iClientFileAgentListenPort = 22174;   //!< port on which to listen for conne
 char SendBuffer[BUFSIZE + 1];   //!< sockets SendBuffer
 char ReadBuffer[4097];   //! sockets read buffer
 
+const size_t iSendChunkSize = 65536;   //!< bytes offered to a download socket per SendFileChunk call, about one socket send buffer
+const size_t iMaxBytesPerPass = 4 * iSendChunkSize;   //!< most bytes sent to one download per pass, so one fast client cant starve the others
+
+const size_t iChannelFrameSize = 16384;   //!< most payload in one channel frame, so a higher priority download can cut in quickly
+
+AssetStore ServerAssetStore( 64 * 1024 * 1024, 256 );   //!< downloadable assets by checksum; 64MB memory cache, up to 256 files mapped
+int iDownloadsCompleted = 0;   //!< downloads finished, used to pace asset store statistics
+const int iAssetStatisticsInterval = 100;   //!< report asset store statistics every this many downloads
+
 mvsocket MetaverseServerSocket;   //!< socket used to connect with metaverseserver component
 mvsocket ClientFileAgentListener;   //!< socket to listen for new client connections
 
+bool ValidateFilename( const char *sFilename );
+void GenerateServerDataFilePath( char *targetbuffer, const char *subdirectoryname, const char *filename );
+
+//! Returns the ServerData subdirectory holding files of type sFiletype, or NULL for unknown types
+const char *ServerDataSubdirectory( const char *sFiletype )
+{
+    if( strcmp( sFiletype, "TEXTURE" ) == 0 )
+    {
+        return "textures";
+    }
+    else if( strcmp( sFiletype, "SCRIPT" ) == 0 )
+    {
+        return "scripts";
+    }
+    else if( strcmp( sFiletype, "TERRAIN" ) == 0 )
+    {
+        return "terrains";
+    }
+    else if( strcmp( sFiletype, "MESHFILE" ) == 0 )
+    {
+        return "meshes";
+    }
+    return NULL;
+}
+
+//! Creates the Encoding variant of sOriginalPath at sVariantPath; returns true if it worked
+bool CreateEncodedVariant( AssetEncoding Encoding, const char *sOriginalPath, const string &sVariantPath )
+{
+    // encode to a temporary file, so a variant is never seen half-written
+    string sTempPath = sVariantPath + ".tmp";
+    if( !AssetEncodeFile( Encoding, sOriginalPath, sTempPath.c_str() ) )
+    {
+        remove( sTempPath.c_str() );
+        return false;
+    }
+#ifdef _WIN32
+    remove( sVariantPath.c_str() );
+#endif
+    if( rename( sTempPath.c_str(), sVariantPath.c_str() ) != 0 )
+    {
+        remove( sTempPath.c_str() );
+        return false;
+    }
+    DEBUG( "Created " << AssetEncodingName( Encoding ) << " variant of " << sOriginalPath );
+    return true;
+}
+
+//! One download multiplexed over a channel connection
+
+//! One download multiplexed over a channel connection
+//! The client picks iRequestId, and every frame for the download carries it
+class CHANNELSTREAM
+{
+public:
+    int      iRequestId;   //!< client-chosen id, echoed in every frame for this download
+    int      iPriority;   //!< higher goes first, eg for nearby or visible objects
+    bool     bCancelled;   //!< to be dropped once any frame in progress is finished
+    bool     bBegun;   //!< channelbegin has been sent
+    unsigned long iLastServed;   //!< channel frame counter when last served, for round robin between equal priorities
+    string   sFiletype;
+    string   sFilename;
+    string   sChecksum;
+    size_t   iOffset;   //!< requested start offset
+    string   sEncodings;   //!< encodings the client accepts, comma-separated, most preferred first
+    AssetEncoding OffsetEncoding;   //!< encoding iOffset refers to
+    AssetEncoding Encoding;   //!< encoding being sent
+    size_t   iFileSize;
+    size_t   iBytesSent;   //!< offset of the next byte to send
+    FILE *   pFile;   //!< file being sent when not served from ServerAssetStore
+    const char *pAssetData;   //!< asset bytes from ServerAssetStore, or NULL
+    AssetSource Source;   //!< where pAssetData is being served from
+
+    CHANNELSTREAM()
+    {
+        iRequestId = 0;
+        iPriority = 0;
+        bCancelled = false;
+        bBegun = false;
+        iLastServed = 0;
+        iOffset = 0;
+        OffsetEncoding = ASSETENCODING_IDENTITY;
+        Encoding = ASSETENCODING_IDENTITY;
+        iFileSize = 0;
+        iBytesSent = 0;
+        pFile = NULL;
+        pAssetData = NULL;
+        Source = ASSETSOURCE_MAPPED;
+    }
+
+    bool IsComplete()
+    {
+        return iBytesSent >= iFileSize;
+    }
+
+    //! Opens the first encoded variant the client accepts that's worth sending, creating it if need be
+    bool OpenEncodedVariant()
+    {
+        const char *sSubdirectory = ServerDataSubdirectory( sFiletype.c_str() );
+        if( sSubdirectory == NULL || !ValidateFilename( sFilename.c_str() ) )
+        {
+            return false;
+        }
+        char FilePath[1025];
+        GenerateServerDataFilePath( FilePath, sSubdirectory, sFilename.c_str() );
+        struct stat OriginalInfo;
+        if( stat( FilePath, &OriginalInfo ) != 0 )
+        {
+            return false;
+        }
+
+        istringstream encodingsstream( sEncodings );
+        string sEncoding;
+        while( getline( encodingsstream, sEncoding, ',' ) )
+        {
+            AssetEncoding Candidate = AssetEncodingFromName( sEncoding.c_str() );
+            if( Candidate == ASSETENCODING_COUNT || Candidate == ASSETENCODING_IDENTITY
+                || !AssetEncodingApplies( Candidate, sFiletype.c_str(), OriginalInfo.st_size ) )
+            {
+                continue;
+            }
+            string sVariantPath = string( FilePath ) + "." + AssetEncodingName( Candidate );
+            struct stat VariantInfo;
+            if( stat( sVariantPath.c_str(), &VariantInfo ) != 0 || VariantInfo.st_mtime < OriginalInfo.st_mtime )
+            {
+                if( !CreateEncodedVariant( Candidate, FilePath, sVariantPath ) || stat( sVariantPath.c_str(), &VariantInfo ) != 0 )
+                {
+                    continue;
+                }
+            }
+            // not worth the client's time decoding unless it saves a tenth
+            if( VariantInfo.st_size * 10 >= OriginalInfo.st_size * 9 )
+            {
+                continue;
+            }
+            pFile = fopen( sVariantPath.c_str(), "rb" );
+            if( pFile == NULL || fstat( fileno( pFile ), &VariantInfo ) != 0 )
+            {
+                Close();
+                continue;
+            }
+            iFileSize = VariantInfo.st_size;
+            Encoding = Candidate;
+            return true;
+        }
+        return false;
+    }
+
+    //! Opens the asset, from ServerAssetStore where possible, else straight from disk
+    bool Open()
+    {
+        if( sEncodings != "" && OpenEncodedVariant() )
+        {
+            iBytesSent = OffsetEncoding == Encoding && iOffset < iFileSize ? iOffset : 0;
+            return true;
+        }
+        if( sChecksum != "" )
+        {
+            pAssetData = ServerAssetStore.Acquire( sChecksum, "", iFileSize, Source );
+        }
+        if( pAssetData == NULL )
+        {
+            const char *sSubdirectory = ServerDataSubdirectory( sFiletype.c_str() );
+            if( sSubdirectory == NULL || !ValidateFilename( sFilename.c_str() ) )
+            {
+                DEBUG( "Channel request " << iRequestId << " for invalid file " << sFiletype << " " << sFilename );
+                return false;
+            }
+            char FilePath[1025];
+            GenerateServerDataFilePath( FilePath, sSubdirectory, sFilename.c_str() );
+            if( sChecksum != "" )
+            {
+                pAssetData = ServerAssetStore.Acquire( sChecksum, FilePath, iFileSize, Source );
+            }
+            if( pAssetData == NULL )
+            {
+                struct stat FileInfo;
+                pFile = fopen( FilePath, "rb" );
+                if( pFile == NULL || fstat( fileno( pFile ), &FileInfo ) != 0 )
+                {
+                    ERRORMSG( "Unable to open file " << FilePath );
+                    Close();
+                    return false;
+                }
+                iFileSize = FileInfo.st_size;
+            }
+        }
+        size_t iStart = OffsetEncoding == ASSETENCODING_IDENTITY ? iOffset : 0;
+        iBytesSent = iStart < iFileSize ? iStart : iFileSize;
+        return true;
+    }
+
+    //! Sends up to bytes more of the asset; returns bytes sent, 0 if the socket is full, or SOCKET_ERROR
+    int SendChunk( mvsocket &socket, size_t bytes )
+    {
+        if( pAssetData != NULL )
+        {
+            ssize_t result = socket.SendChunk( pAssetData + iBytesSent, bytes );
+            if( result > 0 )
+            {
+                iBytesSent += result;
+                ServerAssetStore.AddBytesServed( Source, result );
+            }
+            return result;
+        }
+        if( pFile == NULL )
+        {
+            return SOCKET_ERROR;
+        }
+        off_t Offset = iBytesSent;
+        ssize_t result = socket.SendFileChunk( fileno( pFile ), Offset, bytes );
+        iBytesSent = Offset;
+        return result;
+    }
+
+    void Close()
+    {
+        if( pAssetData != NULL )
+        {
+            ServerAssetStore.Release( sChecksum );
+            pAssetData = NULL;
+        }
+        if( pFile != NULL )
+        {
+            fclose( pFile );
+            pFile = NULL;
+        }
+    }
+};
+
 //! Stores information about one connection from clientfileagent; used by serverfileagent
 class CONNECTION
 {
@@ -75,8 +336,90 @@ private:
     char     mFilePath[256]; //!< File name with path
     size_t   mFileSize;   //!< File size expected
     size_t   mBytesReceived;   //!< Byte received so far  (to compare with mFileSize)
+    size_t   mBytesSent;   //!< Offset of the next byte to send (to compare with mSendEnd)
+    size_t   mSendEnd;   //!< Offset to stop sending at: mFileSize, or the end of the requested range
+    bool     mbRangeRequested;   //!< client asked for a range, and expects a loaderfilerange header before the data
+    size_t   mRangeOffset;   //!< requested range start
+    size_t   mRangeLength;   //!< requested range length; 0 means to the end of the file
     string   mChecksum;   //!< checksum of file to be received (to allow check that it is ok)
     FILE *   mFileHandle;   //!< filehandle to operating sytem file object
+    const char *mAssetData;   //!< asset bytes from ServerAssetStore when sending from there, otherwise NULL
+    AssetSource mAssetSource;   //!< where mAssetData is being served from
+
+    map < int, CHANNELSTREAM > mStreams;   //!< downloads queued on a channel connection, by request id
+    string   mFrameHeader;   //!< header of the channel frame being sent
+    size_t   mFrameHeaderSent;   //!< bytes of mFrameHeader sent so far
+    int      mFrameRequestId;   //!< download whose data follows mFrameHeader, or -1 for header-only frames
+    size_t   mFramePayloadRemaining;   //!< data bytes of the current frame still to send
+    unsigned long mFrameCounter;   //!< channel frames started, the round robin clock
+
+    //! Picks the next channel frame to send
+
+    //! Picks the next channel frame to send
+    //! Drops finished and cancelled downloads, then frames the highest priority download,
+    //! taking turns among equal priorities.  Returns false if there's nothing to send
+    bool ChannelStartFrame()
+    {
+        map < int, CHANNELSTREAM >::iterator iterator = mStreams.begin();
+        map < int, CHANNELSTREAM >::iterator best = mStreams.end();
+        while( iterator != mStreams.end() )
+        {
+            if( iterator->second.bCancelled || ( iterator->second.bBegun && iterator->second.IsComplete() ) )
+            {
+                iterator->second.Close();
+                mStreams.erase( iterator++ );
+                continue;
+            }
+            if( best == mStreams.end() || iterator->second.iPriority > best->second.iPriority
+                || ( iterator->second.iPriority == best->second.iPriority && iterator->second.iLastServed < best->second.iLastServed ) )
+            {
+                best = iterator;
+            }
+            iterator++;
+        }
+
+        mFrameHeader = "";
+        mFrameHeaderSent = 0;
+        mFrameRequestId = -1;
+        mFramePayloadRemaining = 0;
+        if( best == mStreams.end() )
+        {
+            return false;
+        }
+
+        CHANNELSTREAM &rStream = best->second;
+        rStream.iLastServed = ++mFrameCounter;
+        ostringstream headerstream;
+        if( !rStream.bBegun )
+        {
+            if( rStream.Open() )
+            {
+                headerstream << "<channelbegin id=\"" << rStream.iRequestId << "\" offset=\"" << rStream.iBytesSent
+                << "\" length=\"" << ( rStream.iFileSize - rStream.iBytesSent ) << "\" filesize=\"" << rStream.iFileSize
+                << "\" encoding=\"" << AssetEncodingName( rStream.Encoding ) << "\"/>";
+                rStream.bBegun = true;
+            }
+            else
+            {
+                headerstream << "<channelerror id=\"" << rStream.iRequestId << "\"/>";
+                rStream.bCancelled = true;
+            }
+        }
+        else
+        {
+            mFrameRequestId = rStream.iRequestId;
+            mFramePayloadRemaining = rStream.iFileSize - rStream.iBytesSent;
+            if( mFramePayloadRemaining > iChannelFrameSize )
+            {
+                mFramePayloadRemaining = iChannelFrameSize;
+            }
+            headerstream << "<channeldata id=\"" << rStream.iRequestId << "\" length=\"" << mFramePayloadRemaining << "\"/>";
+        }
+        // CRLF, so a payload starting with a line-end byte can't be read as part of the header's line end
+        headerstream << "\r\n";
+        mFrameHeader = headerstream.str();
+        return true;
+    }
 
 public:
     //! possible connection states
@@ -87,6 +430,7 @@ public:
         StateSendingData,  //!< connection open, we are sending data
         StateReceivingData,   //!< connection open, we are receiving data
         StatePendingValidation,  //!< transfer done, pending verification (I think?)
+        StateChannel,  //!< persistent connection multiplexing many downloads
 
         StateLastState
     };
@@ -214,6 +558,204 @@ public:
             return false;
     }
 
+    //! Sets the requested range
+    void SetRange( size_t offset, size_t length )
+    {
+        mbRangeRequested = true;
+        mRangeOffset = offset;
+        mRangeLength = length;
+    }
+
+    //! Clamps the requested range to the open send source, sends the range header if one was asked for, and makes the socket non-blocking
+
+    //! Clamps the requested range to the open send source, sends the range header if one was asked for, and makes the socket non-blocking
+    //! The header goes out while the socket is still blocking; send errors show up on the first FileSendChunk
+    void StartSend()
+    {
+        mBytesSent = mRangeOffset < mFileSize ? mRangeOffset : mFileSize;
+        mSendEnd = mFileSize;
+        if( mRangeLength > 0 && mRangeLength < mSendEnd - mBytesSent )
+        {
+            mSendEnd = mBytesSent + mRangeLength;
+        }
+        if( mbRangeRequested )
+        {
+            // CRLF, so a payload starting with a line-end byte can't be read as part of the header's line end
+            ostringstream headerstream;
+            headerstream << "<loaderfilerange offset=\"" << mBytesSent << "\" length=\"" << ( mSendEnd - mBytesSent )
+            << "\" filesize=\"" << mFileSize << "\"/>\r\n";
+            Send( headerstream.str().c_str(), headerstream.str().length() );
+        }
+        mSocket.SetNonBlocking( true );
+    }
+
+    //! Opens mFilePath for download, takes mFileSize from it, and starts the send
+    bool FileOpenForSend()
+    {
+        if( !FileOpen( "rb" ) )
+        {
+            return false;
+        }
+        struct stat FileInfo;
+        if( fstat( fileno( mFileHandle ), &FileInfo ) != 0 )
+        {
+            ERRORMSG( "Unable to stat file " << mFilePath );
+            FileClose();
+            return false;
+        }
+        mFileSize = FileInfo.st_size;
+        StartSend();
+        return true;
+    }
+    //! Looks up mChecksum in ServerAssetStore, loading it from mFilePath if that's set; on success starts the send
+    bool AssetOpenForSend()
+    {
+        if( mChecksum == "" )
+        {
+            return false;
+        }
+        mAssetData = ServerAssetStore.Acquire( mChecksum, mFilePath, mFileSize, mAssetSource );
+        if( mAssetData == NULL )
+        {
+            return false;
+        }
+        StartSend();
+        return true;
+    }
+    bool IsSendSourceOpen()
+    {
+        return mAssetData != NULL || IsFilehandleValid();
+    }
+    //! Closes the file or releases the asset being sent
+    void CloseSendSource()
+    {
+        if( mAssetData != NULL )
+        {
+            ServerAssetStore.Release( mChecksum );
+            mAssetData = NULL;
+        }
+        FileClose();
+    }
+    //! Sends up to bytes more of the asset or file; returns bytes sent, 0 if the socket is full, or SOCKET_ERROR
+    int FileSendChunk( size_t bytes )
+    {
+        if( !IsSendSourceOpen() )
+        {
+            return SOCKET_ERROR;
+        }
+        if( bytes > mSendEnd - mBytesSent )
+        {
+            bytes = mSendEnd - mBytesSent;
+        }
+        if( mAssetData != NULL )
+        {
+            ssize_t result = mSocket.SendChunk( mAssetData + mBytesSent, bytes );
+            if( result > 0 )
+            {
+                mBytesSent += result;
+                ServerAssetStore.AddBytesServed( mAssetSource, result );
+            }
+            return result;
+        }
+        off_t Offset = mBytesSent;
+        ssize_t result = mSocket.SendFileChunk( fileno( mFileHandle ), Offset, bytes );
+        mBytesSent = Offset;
+        return result;
+    }
+    bool FileSendComplete()
+    {
+        return mBytesSent >= mSendEnd;
+    }
+
+    // Channel functions
+    //! Turns this connection into a channel multiplexing many downloads
+    void StartChannel()
+    {
+        SetState( StateChannel );
+        mSocket.SetNonBlocking( true );
+    }
+    //! Queues a download on the channel; a repeated request id just takes the new priority
+    void ChannelRequest( const CHANNELSTREAM &rStream )
+    {
+        map < int, CHANNELSTREAM >::iterator iterator = mStreams.find( rStream.iRequestId );
+        if( iterator != mStreams.end() )
+        {
+            iterator->second.iPriority = rStream.iPriority;
+            return;
+        }
+        mStreams.insert( make_pair( rStream.iRequestId, rStream ) );
+    }
+    void ChannelSetPriority( int iRequestId, int iPriority )
+    {
+        map < int, CHANNELSTREAM >::iterator iterator = mStreams.find( iRequestId );
+        if( iterator != mStreams.end() )
+        {
+            iterator->second.iPriority = iPriority;
+        }
+    }
+    //! Cancels a download; any frame of it already started is finished first, so the stream stays parseable
+    void ChannelCancel( int iRequestId )
+    {
+        map < int, CHANNELSTREAM >::iterator iterator = mStreams.find( iRequestId );
+        if( iterator != mStreams.end() )
+        {
+            iterator->second.bCancelled = true;
+        }
+    }
+    bool ChannelHasDataToSend()
+    {
+        return mFrameHeaderSent < mFrameHeader.length() || mFramePayloadRemaining > 0 || !mStreams.empty();
+    }
+    //! Sends channel frames until the socket is full or iMaxBytes have gone; returns bytes sent or SOCKET_ERROR
+    int ChannelSend( size_t iMaxBytes )
+    {
+        size_t iBytesThisPass = 0;
+        while( iBytesThisPass < iMaxBytes )
+        {
+            if( mFrameHeaderSent >= mFrameHeader.length() && mFramePayloadRemaining == 0 && !ChannelStartFrame() )
+            {
+                break;
+            }
+            int result;
+            if( mFrameHeaderSent < mFrameHeader.length() )
+            {
+                result = mSocket.SendChunk( mFrameHeader.c_str() + mFrameHeaderSent, mFrameHeader.length() - mFrameHeaderSent );
+                if( result > 0 )
+                {
+                    mFrameHeaderSent += result;
+                }
+            }
+            else
+            {
+                result = mStreams[ mFrameRequestId ].SendChunk( mSocket, mFramePayloadRemaining < iSendChunkSize ? mFramePayloadRemaining : iSendChunkSize );
+                if( result > 0 )
+                {
+                    mFramePayloadRemaining -= result;
+                }
+            }
+            if( result == SOCKET_ERROR )
+            {
+                return SOCKET_ERROR;
+            }
+            if( result == 0 )
+            {
+                break;
+            }
+            iBytesThisPass += result;
+        }
+        return iBytesThisPass;
+    }
+    //! Releases the files and assets held by the channel's downloads
+    void ChannelClose()
+    {
+        map < int, CHANNELSTREAM >::iterator iterator;
+        for( iterator = mStreams.begin(); iterator != mStreams.end(); iterator++ )
+        {
+            iterator->second.Close();
+        }
+        mStreams.clear();
+    }
+
     // Socket functions
     void Close()
     {
@@ -265,8 +807,19 @@ public:
         sprintf(mFilePath, "" );
         mFileSize = 0;
         mBytesReceived = 0;
+        mBytesSent = 0;
+        mSendEnd = 0;
+        mbRangeRequested = false;
+        mRangeOffset = 0;
+        mRangeLength = 0;
         mChecksum = "";
         mFileHandle = NULL;
+        mAssetData = NULL;
+        mAssetSource = ASSETSOURCE_MAPPED;
+        mFrameHeaderSent = 0;
+        mFrameRequestId = -1;
+        mFramePayloadRemaining = 0;
+        mFrameCounter = 0;
     }
 
     CONNECTION(mvsocket &socket)
@@ -278,8 +831,19 @@ public:
         sprintf(mFilePath, "" );
         mFileSize = 0;
         mBytesReceived = 0;
+        mBytesSent = 0;
+        mSendEnd = 0;
+        mbRangeRequested = false;
+        mRangeOffset = 0;
+        mRangeLength = 0;
         mChecksum = "";
         mFileHandle = NULL;
+        mAssetData = NULL;
+        mAssetSource = ASSETSOURCE_MAPPED;
+        mFrameHeaderSent = 0;
+        mFrameRequestId = -1;
+        mFramePayloadRemaining = 0;
+        mFrameCounter = 0;
         this->mSocket = socket;
     }
 
@@ -301,8 +865,21 @@ public:
     {
         this->mSocket = newconnection.mSocket;
         this->mFileHandle = newconnection.mFileHandle;
+        this->mAssetData = newconnection.mAssetData;
+        this->mAssetSource = newconnection.mAssetSource;
+        this->mStreams = newconnection.mStreams;
+        this->mFrameHeader = newconnection.mFrameHeader;
+        this->mFrameHeaderSent = newconnection.mFrameHeaderSent;
+        this->mFrameRequestId = newconnection.mFrameRequestId;
+        this->mFramePayloadRemaining = newconnection.mFramePayloadRemaining;
+        this->mFrameCounter = newconnection.mFrameCounter;
         this->mFileSize = newconnection.mFileSize;
         this->mBytesReceived = newconnection.mBytesReceived;
+        this->mBytesSent = newconnection.mBytesSent;
+        this->mSendEnd = newconnection.mSendEnd;
+        this->mbRangeRequested = newconnection.mbRangeRequested;
+        this->mRangeOffset = newconnection.mRangeOffset;
+        this->mRangeLength = newconnection.mRangeLength;
         this->mConnectionState = newconnection.mConnectionState;
         this->mChecksum = newconnection.mChecksum;
         strcpy( this->mFileType, newconnection.mFileType );
@@ -371,13 +948,15 @@ void GenerateServerDataFilePath( char *targetbuffer, const char *subdirectorynam
 //!
 //! Returns: None
 //!
-//! Description: Block until data is available on a read socket, or for one second
+//! Description: Block until data is available on a read socket, a download socket
+//!  can take more data, or for one second
 //
 // History: 20050330 Mark Wagner - Converted to use the mvsocket class as a class
 void SocketsBlockTillSomethingHappens()
 {
     vector<CONNECTION>::iterator i;
     vector<const mvsocket *> readsocks;
+    vector<const mvsocket *> writesocks;
 
     readsocks.clear();
 
@@ -402,17 +981,24 @@ void SocketsBlockTillSomethingHappens()
         {
             //       DEBUG( "select: adding connected client socket " << i->GetSocket().GetSocket() );
             readsocks.push_back( &( i->GetSocket() ) );
+            if( i->GetState() == CONNECTION::StateSendingData
+                || ( i->GetState() == CONNECTION::StateChannel && i->ChannelHasDataToSend() ) )
+            {
+                writesocks.push_back( &( i->GetSocket() ) );
+            }
         }
         else
         {
             INFO( "Removing connection from vector" );
+            i->CloseSendSource();
+            i->ChannelClose();
             i->Close();
             i = Connections.erase(i);
             i--;
         }
     }
 
-    SocketsReadBlock(10000, readsocks);
+    SocketsReadWriteBlock(1000, readsocks, writesocks);
     //Debug("wait finished\n" );
 }
 
@@ -492,14 +1078,15 @@ void CheckForNewClients()
 //!
 //! Returns: None
 //!
-//! Description: For each connection, if it's a "send" connection, send up to 1200 bytes of data
-//!  to the server.
+//! Description: For each connection, if it's a "send" connection, send as much of the file
+//!  as the socket will currently take, up to iMaxBytesPerPass.  The sockets are non-blocking,
+//!  so a slow client just gets skipped until select() reports it writable again.
 //
 // History: 20050330 Mark Wagner - converted to use Connections as a vector
 //                               - converted to use CONNECTION as a class
 void ProcessDataSendConnections()
 {
-    int BytesRead, i;
+    int i;
     char buffer[1025];
     vector<CONNECTION>::iterator Connection;
     for( Connection = Connections.begin(), i = 0; Connection != Connections.end(); Connection++, i++ )
@@ -507,7 +1094,8 @@ void ProcessDataSendConnections()
         if( Connection->GetState() == CONNECTION::StateSendingData )
         {
             DEBUG(  "Processing connection " << i ); // DEBUG
-            if( !Connection->IsFilehandleValid() )
+            // assets already in the store need no filename checks or file access
+            if( !Connection->IsSendSourceOpen() && !Connection->AssetOpenForSend() )
             {
                 if( ValidateFilename( Connection->GetFilename() ) )
                 {
@@ -540,9 +1128,12 @@ void ProcessDataSendConnections()
                         DEBUG( "socket closed, connection removed" ); // DEBUG
                         break;
                     }
-                    Connection->FileOpen("rb");
-                    DEBUG( "Setting up 'send' connection for file " << Connection->GetFilepath());
-                    if( !Connection->IsFilehandleValid() )
+                    if( !Connection->AssetOpenForSend() )
+                    {
+                        Connection->FileOpenForSend();
+                    }
+                    DEBUG( "Setting up 'send' connection for file " << Connection->GetFilepath() << " size " << Connection->GetFilesize() );
+                    if( !Connection->IsSendSourceOpen() )
                     {
                         Debug( "could not open file %s\n", Connection->GetFilepath() );
                         Connection->Close();
@@ -562,33 +1153,39 @@ void ProcessDataSendConnections()
                 }
             }
 
-            DEBUG(  "reading file if open..." ); // DEBUG
-            if( Connection->IsFilehandleValid() )
+            if( Connection->IsSendSourceOpen() )
             {
-                DEBUG(  "File open, reading..." ); // DEBUG
-                BytesRead = Connection->FileRead( ReadBuffer, 1200 );
-                if( Connection->FileEOF() )
+                size_t iBytesThisPass = 0;
+                int BytesSent = 0;
+                while( !Connection->FileSendComplete() && iBytesThisPass < iMaxBytesPerPass )
+                {
+                    BytesSent = Connection->FileSendChunk( iSendChunkSize );
+                    if( BytesSent <= 0 )
+                    {
+                        break;
+                    }
+                    iBytesThisPass += BytesSent;
+                }
+
+                if( BytesSent == SOCKET_ERROR )
                 {
-                    Debug( "File %s completely read, sending remainder of data, then closing socket...\n", Connection->GetFilename() );
-                    Connection->Send(ReadBuffer, BytesRead);
+                    Debug( "socket connection file %s closed by remote host\n", Connection->GetFilename() );
+                    Connection->CloseSendSource();
                     Connection->Close();
                     Connection = Connections.erase(Connection);
                     Connection--;
                 }
-                else if( Connection->FileError() )
+                else if( Connection->FileSendComplete() )
                 {
-                    Debug( "File %s read ERROR , closing socket...\n", Connection->GetFilename() );
+                    Debug( "File %s completely sent, closing socket...\n", Connection->GetFilename() );
+                    Connection->CloseSendSource();
                     Connection->Close();
                     Connection = Connections.erase(Connection);
                     Connection--;
-                }
-                else
-                {
-                    if( Connection->Send( ReadBuffer, BytesRead ) == SOCKET_ERROR )
+                    iDownloadsCompleted++;
+                    if( iDownloadsCompleted % iAssetStatisticsInterval == 0 )
                     {
-                        Debug( "socket connection file %s closed by remote host\n", Connection->GetFilename() );
-                        Connection = Connections.erase(Connection);
-                        Connection--;
+                        ServerAssetStore.ReportStatistics();
                     }
                 }
             }
@@ -596,6 +1193,89 @@ void ProcessDataSendConnections()
     }
 }
 
+//! Input: None
+//!
+//! Returns: None
+//!
+//! Description: For each channel connection, handles any requests the client has sent, then
+//!  sends frames for its queued downloads until the socket is full or iMaxBytesPerPass have gone
+void ProcessChannelConnections()
+{
+    vector<CONNECTION>::iterator Connection;
+    for( Connection = Connections.begin(); Connection != Connections.end(); Connection++ )
+    {
+        if( Connection->GetState() != CONNECTION::StateChannel )
+        {
+            continue;
+        }
+
+        int ReadResult;
+        while( ( ReadResult = Connection->ReceiveLineIfAvailable( ReadBuffer ) ) == SOCKETS_READ_OK )
+        {
+            TiXmlDocument IPC;
+            IPC.Parse( ReadBuffer );
+            TiXmlElement *pElement = IPC.RootElement();
+            if( pElement == NULL || pElement->Attribute("id") == NULL )
+            {
+                WARNING( "Unrecognised channel request [" << ReadBuffer << "]" );
+                continue;
+            }
+            int iRequestId = atoi( pElement->Attribute("id") );
+            if( strcmp( pElement->Value(), "channelget" ) == 0 )
+            {
+                CHANNELSTREAM NewStream;
+                NewStream.iRequestId = iRequestId;
+                if( pElement->Attribute("type") != NULL )
+                {
+                    NewStream.sFiletype = pElement->Attribute("type");
+                }
+                if( pElement->Attribute("serverfilename") != NULL )
+                {
+                    NewStream.sFilename = pElement->Attribute("serverfilename");
+                }
+                if( pElement->Attribute("checksum") != NULL )
+                {
+                    NewStream.sChecksum = pElement->Attribute("checksum");
+                }
+                if( pElement->Attribute("offset") != NULL )
+                {
+                    NewStream.iOffset = strtoul( pElement->Attribute("offset"), NULL, 10 );
+                }
+                if( pElement->Attribute("priority") != NULL )
+                {
+                    NewStream.iPriority = atoi( pElement->Attribute("priority") );
+                }
+                if( pElement->Attribute("encodings") != NULL )
+                {
+                    NewStream.sEncodings = pElement->Attribute("encodings");
+                }
+                if( pElement->Attribute("offsetencoding") != NULL )
+                {
+                    NewStream.OffsetEncoding = AssetEncodingFromName( pElement->Attribute("offsetencoding") );
+                }
+                Connection->ChannelRequest( NewStream );
+            }
+            else if( strcmp( pElement->Value(), "channelpriority" ) == 0 && pElement->Attribute("priority") != NULL )
+            {
+                Connection->ChannelSetPriority( iRequestId, atoi( pElement->Attribute("priority") ) );
+            }
+            else if( strcmp( pElement->Value(), "channelcancel" ) == 0 )
+            {
+                Connection->ChannelCancel( iRequestId );
+            }
+        }
+
+        if( ReadResult == SOCKETS_READ_SOCKETGONE || Connection->ChannelSend( iMaxBytesPerPass ) == SOCKET_ERROR )
+        {
+            DEBUG( "Channel connection closed" );
+            Connection->ChannelClose();
+            Connection->Close();
+            Connection = Connections.erase(Connection);
+            Connection--;
+        }
+    }
+}
+
 //! Input: None
 //!
 //! Returns: None
@@ -817,9 +1497,28 @@ void ProcessNewConnections()
                     Connection->SetFilename(buffer);
                     snprintf( buffer, 1024, "%.16s", IPC.RootElement()->Attribute("type") );
                     Connection->SetFiletype(buffer);
+                    if( IPC.RootElement()->Attribute("checksum") != NULL )
+                    {
+                        Connection->SetChecksum(IPC.RootElement()->Attribute("checksum"));
+                    }
+                    if( IPC.RootElement()->Attribute("offset") != NULL )
+                    {
+                        // ranged request, eg resuming an interrupted download
+                        size_t iLength = 0;
+                        if( IPC.RootElement()->Attribute("length") != NULL )
+                        {
+                            iLength = strtoul( IPC.RootElement()->Attribute("length"), NULL, 10 );
+                        }
+                        Connection->SetRange( strtoul( IPC.RootElement()->Attribute("offset"), NULL, 10 ), iLength );
+                    }
                     //     Connections[i].FileHandle = NULL;
                     Connection->SetState(CONNECTION::StateSendingData);
                 }
+                else if( strcmp( IPC.RootElement()->Value(), "loaderchannel" ) == 0 )
+                {
+                    DEBUG( "Connection " << i << " is an asset channel" );
+                    Connection->StartChannel();
+                }
                 else if( strcmp( IPC.RootElement()->Value(), "loadersendfile" ) == 0 )
                 {
                     snprintf( buffer, 1024, "%.33s", IPC.RootElement()->Attribute("sourcefilename") );
@@ -871,6 +1570,11 @@ int NumDataClients()
 int main( int argc, char *argv[] )
 {
     mvsocket::InitSocketSystem();
+#ifdef _WIN32
+    ChecksumCacheOpen( ".\\ServerData\\checksumcache.txt" );
+#else
+    ChecksumCacheOpen( "./ServerData/checksumcache.txt" );
+#endif
     //printf( "Connecting to Metaverse Server on port %i...\n", iMetaverseServerPort );
     //SocketMetaverseServer.ConnectToServer( inet_addr( "127.0.0.1" ), iMetaverseServerPort );
     //printf( "Connected to Metaverse Server.\n" );
@@ -901,16 +1605,14 @@ int main( int argc, char *argv[] )
         try
         {
             //  DEBUG("1");
-            if( NumDataClients() == 0 )
-            {
-                SocketsBlockTillSomethingHappens();
-            }
+            SocketsBlockTillSomethingHappens();
             //  DEBUG("2");
             CheckServerAlive();
             //    DEBUG("3");
             CheckForNewClients();
             /// DEBUG("4");
             ProcessDataSendConnections();
+            ProcessChannelConnections();
             // DEBUG("5");
             ProcessDataReceiveConnections();
             // DEBUG("6");
@@ -0,0 +1,341 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Buffers timestamped moves of remote objects, and plays them back smoothly, a little behind
+//!
+//! Remote avatars used to move by objectmove alone: each move started a fresh linear animation from
+//! wherever the avatar had got to, over the move's duration.  How smooth that looked depended on moves
+//! arriving exactly one duration apart; a late move left the avatar standing, and an early one made it jump.
+//!
+//! Moves with a <timestamp> carry the sender's tick count.  SnapshotInterpolation keeps the last few of
+//! these per object, and plays the object back a delay behind its sender: each frame it works out the
+//! sender time we're showing, and interpolates between the snapshots either side of it.  If that's past
+//! the newest snapshot, the object is dead reckoned on from it, at its velocity, for up to
+//! iMaxExtrapolationMilliseconds, then held.
+//!
+//! The delay adapts per object:
+//! - the sender's clock is related to ours by the quickest transit seen, ie our tick count minus the
+//!   sender's at arrival; this follows drift slowly upwards, a 256th of the difference per snapshot, and
+//!   quicker snapshots reset it at once.  The 256ths are kept in iClockOffsetRemainder, so drift of less
+//!   than 256 milliseconds still moves it
+//! - jitter is the smoothed difference between each snapshot's transit and the quickest, as in RTP
+//! - the delay is the smoothed interval between snapshots, plus twice the jitter, so the next snapshot
+//!   has usually arrived by the time we need it
+//! - when the delay or clock offset changes, playback runs up to an eighth fast or slow until it has
+//!   caught up, rather than jumping, unless it's more than iMaxCatchUpMilliseconds out
+//!
+//! Snapshots are put in order of sender time as they arrive, so moves that overtake each other still play
+//! in order; duplicates and snapshots older than the whole buffer are dropped.
+
+#include <stdio.h>
+
+#include "Diag.h"
+#include "SnapshotInterpolation.h"
+
+SnapshotInterpolation::SnapshotInterpolation()
+{
+    iNumObjects = 0;
+}
+
+int SnapshotInterpolation::ReferenceToBufferNum( const int iReference ) const
+{
+    for( int iBufferNum = 0; iBufferNum < iNumObjects; iBufferNum++ )
+    {
+        if( Buffers[ iBufferNum ].iReference == iReference )
+        {
+            return iBufferNum;
+        }
+    }
+    return -1;
+}
+
+void SnapshotInterpolation::RemoveObject( const int iReference )
+{
+    int iBufferNum = ReferenceToBufferNum( iReference );
+    if( iBufferNum != -1 )
+    {
+        Buffers[ iBufferNum ] = Buffers[ iNumObjects - 1 ];
+        iNumObjects--;
+    }
+}
+
+int SnapshotInterpolation::GetDelay( const SNAPSHOTBUFFER &Buffer ) const
+{
+    int iDelay = (int)( Buffer.fSendInterval + 2 * Buffer.fJitter );
+    if( iDelay < iMinDelayMilliseconds )
+    {
+        return iMinDelayMilliseconds;
+    }
+    if( iDelay > iMaxDelayMilliseconds )
+    {
+        return iMaxDelayMilliseconds;
+    }
+    return iDelay;
+}
+
+int SnapshotInterpolation::GetDelay( const int iReference ) const
+{
+    int iBufferNum = ReferenceToBufferNum( iReference );
+    if( iBufferNum == -1 )
+    {
+        return -1;
+    }
+    return GetDelay( Buffers[ iBufferNum ] );
+}
+
+bool SnapshotInterpolation::GetClockOffset( const int iReference, int &iClockOffset ) const
+{
+    int iBufferNum = ReferenceToBufferNum( iReference );
+    if( iBufferNum == -1 )
+    {
+        return false;
+    }
+    iClockOffset = Buffers[ iBufferNum ].iClockOffset;
+    return true;
+}
+
+// Input: Transforms: store holding the object's slot
+//        iReference, iSlot: the object, and its slot in Transforms
+//        iSenderTime: sender's tick count when it sent the snapshot
+//        Pos: where the object was
+//        pRotation, pVelocity: its rotation and velocity, or NULL if the snapshot didnt have them
+//        iTickCount: our tick count now
+//
+// Returns: false if the object had no buffer, and there's no room for another
+//
+// Description: Updates the sender's clock offset, jitter and send interval, then puts the snapshot in its
+//              place by sender time.  If the slot has changed hands since the object's first snapshot, the
+//              object has been deleted and recreated, so its buffer starts again.
+bool SnapshotInterpolation::AddSnapshot( ObjectTransformStore &Transforms, const int iReference, const int iSlot, const int iSenderTime,
+                                         const Vector3 &Pos, const Rot *pRotation, const Vector3 *pVelocity, const int iTickCount )
+{
+    int iBufferNum = ReferenceToBufferNum( iReference );
+    if( iBufferNum != -1 && ( Buffers[ iBufferNum ].iSlot != iSlot || Buffers[ iBufferNum ].SlotGeneration != Transforms.Generation( iSlot ) ) )
+    {
+        RemoveObject( iReference );
+        iBufferNum = -1;
+    }
+    if( iBufferNum == -1 )
+    {
+        if( iNumObjects == iMaxObjects )
+        {
+            DEBUG(  "no room to buffer snapshots for object " << iReference ); // DEBUG
+            return false;
+        }
+        iBufferNum = iNumObjects;
+        iNumObjects++;
+        SNAPSHOTBUFFER &NewBuffer = Buffers[ iBufferNum ];
+        NewBuffer.iReference = iReference;
+        NewBuffer.iSlot = iSlot;
+        NewBuffer.SlotGeneration = Transforms.Generation( iSlot );
+        NewBuffer.iNumSnapshots = 0;
+        NewBuffer.iClockOffset = iTickCount - iSenderTime;
+        NewBuffer.iClockOffsetRemainder = 0;
+        NewBuffer.fJitter = 0;
+        NewBuffer.fSendInterval = 0;
+        NewBuffer.iShowTime = 0;
+        NewBuffer.iLastTickCount = -1;
+    }
+    SNAPSHOTBUFFER &Buffer = Buffers[ iBufferNum ];
+
+    int iTransit = iTickCount - iSenderTime;
+    if( iTransit < Buffer.iClockOffset )
+    {
+        Buffer.iClockOffset = iTransit;
+        Buffer.iClockOffsetRemainder = 0;
+    }
+    else
+    {
+        Buffer.iClockOffsetRemainder += iTransit - Buffer.iClockOffset;
+        Buffer.iClockOffset += Buffer.iClockOffsetRemainder / 256;
+        Buffer.iClockOffsetRemainder %= 256;
+    }
+    Buffer.fJitter += ( (float)( iTransit - Buffer.iClockOffset ) - Buffer.fJitter ) / 16;
+
+    int iPosition = Buffer.iNumSnapshots;
+    while( iPosition > 0 && Buffer.Snapshots[ iPosition - 1 ].iSenderTime > iSenderTime )
+    {
+        iPosition--;
+    }
+    if( iPosition > 0 && Buffer.Snapshots[ iPosition - 1 ].iSenderTime == iSenderTime )
+    {
+        return true;   // duplicate
+    }
+    if( Buffer.iNumSnapshots == SNAPSHOTBUFFER::MAX_SNAPSHOTS )
+    {
+        if( iPosition == 0 )
+        {
+            return true;   // older than anything we still have
+        }
+        for( int i = 1; i < Buffer.iNumSnapshots; i++ )
+        {
+            Buffer.Snapshots[ i - 1 ] = Buffer.Snapshots[i];
+        }
+        Buffer.iNumSnapshots--;
+        iPosition--;
+    }
+    for( int i = Buffer.iNumSnapshots; i > iPosition; i-- )
+    {
+        Buffer.Snapshots[i] = Buffer.Snapshots[ i - 1 ];
+    }
+    Buffer.iNumSnapshots++;
+
+    OBJECTSNAPSHOT &Snapshot = Buffer.Snapshots[ iPosition ];
+    const OBJECTSNAPSHOT *pPrevious = iPosition > 0 ? &Buffer.Snapshots[ iPosition - 1 ] : NULL;
+    Snapshot.iSenderTime = iSenderTime;
+    Snapshot.Pos = Pos;
+    Snapshot.bRot = ( pRotation != NULL );
+    if( pRotation != NULL )
+    {
+        Snapshot.Rotation = *pRotation;
+    }
+    else if( pPrevious != NULL )
+    {
+        Snapshot.Rotation = pPrevious->Rotation;
+    }
+    else
+    {
+        Snapshot.Rotation = Transforms.Rotation( iSlot );
+    }
+    if( pVelocity != NULL )
+    {
+        Snapshot.Velocity = *pVelocity;
+    }
+    else if( pPrevious != NULL )
+    {
+        Snapshot.Velocity = ( Pos - pPrevious->Pos ) * ( 1000.0f / (float)( iSenderTime - pPrevious->iSenderTime ) );
+    }
+    else
+    {
+        Snapshot.Velocity = Vector3( 0, 0, 0 );
+    }
+
+    // the send interval only counts snapshots that came in order; long pauses count as the longest delay we use
+    if( pPrevious != NULL && iPosition == Buffer.iNumSnapshots - 1 )
+    {
+        float fInterval = (float)( iSenderTime - pPrevious->iSenderTime );
+        if( fInterval > iMaxDelayMilliseconds )
+        {
+            fInterval = iMaxDelayMilliseconds;
+        }
+        if( Buffer.fSendInterval == 0 )
+        {
+            Buffer.fSendInterval = fInterval;
+        }
+        else
+        {
+            Buffer.fSendInterval += ( fInterval - Buffer.fSendInterval ) / 8;
+        }
+    }
+    return true;
+}
+
+// Input: Transforms: store holding the object's slot
+//        Buffer: the object's snapshots
+//        iTickCount: our tick count now
+//
+// Returns: None
+//
+// Description: Moves the object to where it was one delay ago, by the sender's clock: interpolating between the
+//              snapshots either side, or dead reckoning on from the newest
+void SnapshotInterpolation::InterpolateBuffer( ObjectTransformStore &Transforms, SNAPSHOTBUFFER &Buffer, const int iTickCount ) const
+{
+    const int iTargetShowTime = iTickCount - Buffer.iClockOffset - GetDelay( Buffer );   // by the sender's clock
+    const int iElapsed = iTickCount - Buffer.iLastTickCount;
+    int iShowTime = Buffer.iShowTime + iElapsed;
+    if( Buffer.iLastTickCount == -1 || iShowTime < iTargetShowTime - iMaxCatchUpMilliseconds || iShowTime > iTargetShowTime + iMaxCatchUpMilliseconds )
+    {
+        iShowTime = iTargetShowTime;
+    }
+    else
+    {
+        int iCatchUp = iElapsed / 8 + 1;
+        if( iShowTime < iTargetShowTime - iCatchUp )
+        {
+            iShowTime += iCatchUp;
+        }
+        else if( iShowTime > iTargetShowTime + iCatchUp )
+        {
+            iShowTime -= iCatchUp;
+        }
+        else
+        {
+            iShowTime = iTargetShowTime;
+        }
+    }
+    Buffer.iShowTime = iShowTime;
+    Buffer.iLastTickCount = iTickCount;
+
+    const OBJECTSNAPSHOT *Snapshots = Buffer.Snapshots;
+    const OBJECTSNAPSHOT &Oldest = Snapshots[0];
+    const OBJECTSNAPSHOT &Newest = Snapshots[ Buffer.iNumSnapshots - 1 ];
+
+    Vector3 &rPos = Transforms.Pos( Buffer.iSlot );
+    Rot &rRot = Transforms.Rotation( Buffer.iSlot );
+    if( iShowTime <= Oldest.iSenderTime )
+    {
+        rPos = Oldest.Pos;
+        rRot = Oldest.Rotation;
+    }
+    else if( iShowTime >= Newest.iSenderTime )
+    {
+        int iAhead = iShowTime - Newest.iSenderTime;
+        if( iAhead > iMaxExtrapolationMilliseconds )
+        {
+            iAhead = iMaxExtrapolationMilliseconds;
+        }
+        rPos = Newest.Pos + Newest.Velocity * ( (float)iAhead / 1000.0f );
+        rRot = Newest.Rotation;
+    }
+    else
+    {
+        int i = 0;
+        while( Snapshots[ i + 1 ].iSenderTime <= iShowTime )
+        {
+            i++;
+        }
+        const OBJECTSNAPSHOT &From = Snapshots[i];
+        const OBJECTSNAPSHOT &To = Snapshots[ i + 1 ];
+        float fFraction = (float)( iShowTime - From.iSenderTime ) / (float)( To.iSenderTime - From.iSenderTime );
+        rPos = From.Pos + ( To.Pos - From.Pos ) * fFraction;
+        RotSlerp( rRot, From.Rotation, To.Rotation, fFraction );
+    }
+}
+
+void SnapshotInterpolation::Interpolate( ObjectTransformStore &Transforms, const int iTickCount )
+{
+    int iNumKept = 0;
+    for( int i = 0; i < iNumObjects; i++ )
+    {
+        SNAPSHOTBUFFER &Buffer = Buffers[i];
+        if( Transforms.Owner( Buffer.iSlot ) == NULL || Transforms.Generation( Buffer.iSlot ) != Buffer.SlotGeneration )
+        {
+            DEBUG(  "Dropping snapshots of deleted object " << Buffer.iReference ); // DEBUG
+            continue;
+        }
+        InterpolateBuffer( Transforms, Buffer, iTickCount );
+        if( iNumKept != i )
+        {
+            Buffers[ iNumKept ] = Buffers[i];
+        }
+        iNumKept++;
+    }
+    iNumObjects = iNumKept;
+}
@@ -0,0 +1,103 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Buffers timestamped moves of remote objects, and plays them back smoothly, a little behind
+
+// see SnapshotInterpolation.cpp for documentation
+
+#ifndef _SNAPSHOTINTERPOLATION_H
+#define _SNAPSHOTINTERPOLATION_H
+
+#include "Math.h"
+#include "ObjectTransformStore.h"
+
+//! Where a remote object's sender said it was, and when
+struct OBJECTSNAPSHOT
+{
+   int iSenderTime;    //!< sender's tick count when it sent the snapshot
+   Vector3 Pos;
+   Rot Rotation;
+   bool bRot;          //!< false if the snapshot had no rotation; Rotation then repeats the snapshot before
+   Vector3 Velocity;   //!< per second; from the snapshot, or worked out from the one before
+};
+
+//! Snapshots received for one remote object, and the timing estimates for its sender
+struct SNAPSHOTBUFFER
+{
+   enum { MAX_SNAPSHOTS = 8 };
+
+   int iReference;
+   int iSlot;                    //!< the object's slot in the world's ObjectTransformStore
+   unsigned int SlotGeneration;  //!< generation of that slot when the first snapshot came; if it has changed, the object has gone
+   int iNumSnapshots;
+   OBJECTSNAPSHOT Snapshots[ MAX_SNAPSHOTS ];   //!< oldest first, by sender time
+   int iClockOffset;             //!< our tick count minus sender time, for the quickest snapshot lately
+   int iClockOffsetRemainder;    //!< 256ths of a millisecond iClockOffset has drifted up by, on top of iClockOffset
+   float fJitter;                //!< smoothed difference between each snapshot's transit and the quickest, in milliseconds
+   float fSendInterval;          //!< smoothed interval between snapshots, in milliseconds
+   int iShowTime;                //!< sender time shown at the last Interpolate
+   int iLastTickCount;           //!< our tick count at the last Interpolate, or -1 before the first
+};
+
+//! SnapshotInterpolation plays back remote objects from timestamped snapshots
+
+//! SnapshotInterpolation plays back remote objects from timestamped snapshots
+//! Each frame, each object is put where it was a little while ago, by the sender's clock, interpolating
+//! between the two snapshots either side; the delay adapts to how often, and how regularly, its snapshots arrive.
+//! If the next snapshot is late, the object carries on at its last velocity for a while, then stops.
+//!
+//! How to use this class:
+//! - call AddSnapshot for each timestamped move of a remote object
+//! - call Interpolate once a frame
+//! - call RemoveObject when an object is deleted, or something else takes over moving it
+//!
+//! Both AddSnapshot and Interpolate take the current tick count, rather than reading it, so the
+//! same snapshots and times always give the same positions.
+class SnapshotInterpolation
+{
+public:
+   static const int iMaxObjects = 256;            //!< remote objects moved by snapshots at once; in practice, avatars
+   static const int iMinDelayMilliseconds = 50;   //!< shortest we'll play an object behind its sender
+   static const int iMaxDelayMilliseconds = 3000; //!< longest we'll play an object behind its sender
+   static const int iMaxExtrapolationMilliseconds = 500;   //!< how long to carry on past the last snapshot
+   static const int iMaxCatchUpMilliseconds = 500;   //!< if playback is further than this from where the delay says, it jumps rather than catching up
+
+   SnapshotInterpolation();
+
+   //! adds a snapshot for the object in slot iSlot of Transforms; returns false if there's no room for another object
+   bool AddSnapshot( ObjectTransformStore &Transforms, const int iReference, const int iSlot, const int iSenderTime,
+                     const Vector3 &Pos, const Rot *pRotation, const Vector3 *pVelocity, const int iTickCount );
+   void Interpolate( ObjectTransformStore &Transforms, const int iTickCount );   //!< moves every buffered object to where it was, one delay ago
+   void RemoveObject( const int iReference );   //!< forgets an object's snapshots; it stays where it is
+
+   int GetNumObjects() const { return iNumObjects; }
+   int GetDelay( const int iReference ) const;   //!< current playback delay for an object, in milliseconds, or -1 if it has no snapshots
+   bool GetClockOffset( const int iReference, int &iClockOffset ) const;   //!< our tick count minus the sender's, as estimated for an object; false if it has no snapshots
+
+protected:
+   int iNumObjects;
+   SNAPSHOTBUFFER Buffers[ iMaxObjects ];
+
+   int ReferenceToBufferNum( const int iReference ) const;
+   int GetDelay( const SNAPSHOTBUFFER &Buffer ) const;
+   void InterpolateBuffer( ObjectTransformStore &Transforms, SNAPSHOTBUFFER &Buffer, const int iTickCount ) const;
+};
+
+#endif // _SNAPSHOTINTERPOLATION_H
@@ -0,0 +1,278 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief snapshotinterpolationtest: replays packet traces with latency, jitter, loss and clock drift through SnapshotInterpolation
+//!
+//! Each test makes a trace of an object moving steadily along x, sending a timestamped snapshot every
+//! iSendInterval milliseconds by its own clock, and gives each snapshot an arrival time from the network
+//! conditions: a base latency, random jitter (enough, in some tests, that snapshots overtake each other),
+//! random loss, a step in latency part way through, and a sender clock running at a different rate from ours.
+//! The trace is replayed in order of arrival, with Interpolate called every frame, and the tests check that
+//! playback never goes backwards, rarely stalls, never jumps by more than catching up allows, stays within the
+//! longest delay of the sender, and that the clock offset follows slow drift.
+//! The random numbers are from a fixed seed, so every run replays the same traces.
+//! Prints each failed check, and exits non-zero if any failed.
+//!
+//! usage: snapshotinterpolationtest
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+using namespace std;
+
+#include "SnapshotInterpolation.h"
+#include "ObjectTransformStore.h"
+#include "TestCheck.h"
+
+const int iReference = 42;               //!< the remote object
+const int iStartTickCount = 1000000;     //!< our tick count when the trace starts
+const int iSenderClockStart = 123456789; //!< sender's tick count when the trace starts; nothing to do with ours
+const int iSendInterval = 100;           //!< milliseconds between snapshots, by the sender's clock
+const int iFrameInterval = 16;           //!< milliseconds between our frames
+const int iWarmUpMilliseconds = 5000;    //!< playback isnt checked until the delay has settled
+const float fSpeed = 2.0f;               //!< of the object, per second of the sender's clock
+
+//! What the network does to the snapshots
+struct NETWORKCONDITIONS
+{
+    int iLatency;          //!< quickest transit, in milliseconds
+    int iJitter;           //!< each snapshot takes up to this much longer, at random
+    int iLossPercent;      //!< chance of each snapshot being lost
+    int iLatencyStepTime;  //!< milliseconds into the trace when the latency changes, or -1
+    int iLatencyStep;      //!< change in latency then
+    double dSenderClockRate;   //!< sender's milliseconds per one of ours
+};
+
+//! One snapshot that got through
+struct TRACEPACKET
+{
+    int iSenderTime;
+    int iArrivalTime;   //!< by our clock
+    Vector3 Pos;
+};
+
+bool ArrivesEarlier( const TRACEPACKET &Packet1, const TRACEPACKET &Packet2 )
+{
+    return Packet1.iArrivalTime < Packet2.iArrivalTime;
+}
+
+//! What happened when a trace was replayed, from the end of the warm up
+struct REPLAYRESULT
+{
+    int iNumFrames;
+    int iNumBackwardSteps;   //!< frames where the object moved back along x
+    int iNumStalls;          //!< frames where it didnt move
+    float fMaxStep;          //!< furthest it moved in one frame
+    float fMaxLagMilliseconds;   //!< furthest it was behind where the sender was, in sender milliseconds
+    int iClockOffset;        //!< estimated at the end
+    int iTrueClockOffset;    //!< quickest transit at the end: our tick count minus the sender's, plus the latency
+};
+
+static unsigned int uRandomSeed = 1;
+
+//! returns a pseudo-random number from 0 to iRange - 1, the same sequence every run
+int Random( const int iRange )
+{
+    uRandomSeed = uRandomSeed * 1103515245 + 12345;
+    return iRange > 0 ? (int)( ( uRandomSeed >> 16 ) % (unsigned int)iRange ) : 0;
+}
+
+//! sender's tick count at our tick count iTickCount
+int SenderTime( const NETWORKCONDITIONS &Conditions, const int iTickCount )
+{
+    return iSenderClockStart + (int)floor( ( iTickCount - iStartTickCount ) * Conditions.dSenderClockRate );
+}
+
+//! makes a trace of iDurationMilliseconds of snapshots through Conditions, in order of arrival
+vector<TRACEPACKET> MakeTrace( const NETWORKCONDITIONS &Conditions, const int iDurationMilliseconds )
+{
+    uRandomSeed = 1;
+    vector<TRACEPACKET> Trace;
+    for( int iSenderOffset = 0; iSenderOffset < iDurationMilliseconds * Conditions.dSenderClockRate; iSenderOffset += iSendInterval )
+    {
+        int iSendTickCount = iStartTickCount + (int)ceil( iSenderOffset / Conditions.dSenderClockRate );
+        int iLatency = Conditions.iLatency;
+        if( Conditions.iLatencyStepTime >= 0 && iSendTickCount - iStartTickCount >= Conditions.iLatencyStepTime )
+        {
+            iLatency += Conditions.iLatencyStep;
+        }
+        int iJitter = Random( Conditions.iJitter + 1 );
+        if( Random( 100 ) < Conditions.iLossPercent )
+        {
+            continue;
+        }
+
+        TRACEPACKET Packet;
+        Packet.iSenderTime = SenderTime( Conditions, iSendTickCount );
+        Packet.iArrivalTime = iSendTickCount + iLatency + iJitter;
+        Packet.Pos = Vector3( fSpeed * ( Packet.iSenderTime - iSenderClockStart ) / 1000.0f, 0, 0 );
+        Trace.push_back( Packet );
+    }
+    stable_sort( Trace.begin(), Trace.end(), ArrivesEarlier );
+    return Trace;
+}
+
+//! plays Trace back through a SnapshotInterpolation, a frame at a time
+REPLAYRESULT ReplayTrace( const NETWORKCONDITIONS &Conditions, const vector<TRACEPACKET> &Trace )
+{
+    REPLAYRESULT Result;
+    Result.iNumFrames = 0;
+    Result.iNumBackwardSteps = 0;
+    Result.iNumStalls = 0;
+    Result.fMaxStep = 0;
+    Result.fMaxLagMilliseconds = 0;
+    Result.iClockOffset = 0;
+    Result.iTrueClockOffset = 0;
+
+    ObjectTransformStore Transforms;
+    char OwnerStandIn = 0;   // SnapshotInterpolation only checks the owner isnt NULL
+    int iSlot = Transforms.AllocateSlot( reinterpret_cast<Object *>( &OwnerStandIn ) );
+    SnapshotInterpolation RemoteObjects;
+
+    int iEndTickCount = Trace.back().iArrivalTime;
+    size_t iNextPacket = 0;
+    float fLastX = 0;
+    for( int iTickCount = iStartTickCount; iTickCount <= iEndTickCount; iTickCount += iFrameInterval )
+    {
+        while( iNextPacket < Trace.size() && Trace[ iNextPacket ].iArrivalTime <= iTickCount )
+        {
+            const TRACEPACKET &Packet = Trace[ iNextPacket ];
+            RemoteObjects.AddSnapshot( Transforms, iReference, iSlot, Packet.iSenderTime, Packet.Pos, NULL, NULL, Packet.iArrivalTime );
+            iNextPacket++;
+        }
+        if( iNextPacket == 0 )
+        {
+            continue;
+        }
+        RemoteObjects.Interpolate( Transforms, iTickCount );
+
+        float fX = Transforms.Pos( iSlot ).x;
+        if( iTickCount - iStartTickCount >= iWarmUpMilliseconds )
+        {
+            float fStep = fX - fLastX;
+            Result.iNumFrames++;
+            if( fStep < 0 )
+            {
+                Result.iNumBackwardSteps++;
+            }
+            else if( fStep == 0 )
+            {
+                Result.iNumStalls++;
+            }
+            Result.fMaxStep = max( Result.fMaxStep, fStep );
+
+            float fSenderX = fSpeed * ( SenderTime( Conditions, iTickCount ) - iSenderClockStart ) / 1000.0f;
+            Result.fMaxLagMilliseconds = max( Result.fMaxLagMilliseconds, ( fSenderX - fX ) * 1000.0f / fSpeed );
+        }
+        fLastX = fX;
+    }
+
+    RemoteObjects.GetClockOffset( iReference, Result.iClockOffset );
+    int iLatency = Conditions.iLatency + ( Conditions.iLatencyStepTime >= 0 ? Conditions.iLatencyStep : 0 );
+    Result.iTrueClockOffset = iEndTickCount - SenderTime( Conditions, iEndTickCount ) + iLatency;
+    return Result;
+}
+
+//! furthest the object can move in a frame, playing at most an eighth fast, plus a millisecond, to catch up
+float GetMaxStep()
+{
+    return fSpeed * ( iFrameInterval + iFrameInterval / 8 + 1 ) / 1000.0f * 1.01f;
+}
+
+//! the checks every replay should pass
+void CheckSmooth( const REPLAYRESULT &Result, const int iMaxStallsPercent )
+{
+    CHECK( Result.iNumFrames > 0 );
+    CHECK( Result.iNumBackwardSteps == 0 );
+    CHECK( Result.iNumStalls * 100 <= Result.iNumFrames * iMaxStallsPercent );
+    CHECK( Result.fMaxStep <= GetMaxStep() );
+    CHECK( Result.fMaxLagMilliseconds <= SnapshotInterpolation::iMaxDelayMilliseconds + iSendInterval );
+}
+
+NETWORKCONDITIONS GetGoodNetwork()
+{
+    NETWORKCONDITIONS Conditions;
+    Conditions.iLatency = 80;
+    Conditions.iJitter = 0;
+    Conditions.iLossPercent = 0;
+    Conditions.iLatencyStepTime = -1;
+    Conditions.iLatencyStep = 0;
+    Conditions.dSenderClockRate = 1.0;
+    return Conditions;
+}
+
+void TestSteadyNetwork()
+{
+    NETWORKCONDITIONS Conditions = GetGoodNetwork();
+    REPLAYRESULT Result = ReplayTrace( Conditions, MakeTrace( Conditions, 60000 ) );
+    CheckSmooth( Result, 0 );
+    CHECK( Result.fMaxLagMilliseconds <= Conditions.iLatency + SnapshotInterpolation::iMinDelayMilliseconds + iSendInterval );
+}
+
+void TestJitter()
+{
+    NETWORKCONDITIONS Conditions = GetGoodNetwork();
+    Conditions.iJitter = 60;
+    REPLAYRESULT Result = ReplayTrace( Conditions, MakeTrace( Conditions, 60000 ) );
+    CheckSmooth( Result, 1 );
+}
+
+void TestLossAndReordering()
+{
+    NETWORKCONDITIONS Conditions = GetGoodNetwork();
+    Conditions.iJitter = 250;   // more than the send interval, so snapshots overtake each other
+    Conditions.iLossPercent = 10;
+    REPLAYRESULT Result = ReplayTrace( Conditions, MakeTrace( Conditions, 60000 ) );
+    CheckSmooth( Result, 2 );
+}
+
+void TestLatencyStep()
+{
+    NETWORKCONDITIONS Conditions = GetGoodNetwork();
+    Conditions.iJitter = 30;
+    Conditions.iLatencyStepTime = 30000;
+    Conditions.iLatencyStep = 300;
+    REPLAYRESULT Result = ReplayTrace( Conditions, MakeTrace( Conditions, 60000 ) );
+    CheckSmooth( Result, 5 );
+}
+
+void TestClockDrift()
+{
+    // the sender's clock loses a millisecond a second against ours, so each snapshot's transit is a tenth of a
+    // millisecond longer than the one before; the quickest transit has to follow that up
+    NETWORKCONDITIONS Conditions = GetGoodNetwork();
+    Conditions.dSenderClockRate = 0.999;
+    REPLAYRESULT Result = ReplayTrace( Conditions, MakeTrace( Conditions, 600000 ) );
+    CheckSmooth( Result, 0 );
+    CHECK( Result.iClockOffset <= Result.iTrueClockOffset );
+    CHECK( Result.iTrueClockOffset - Result.iClockOffset < 64 );
+}
+
+int main( int argc, char *argv[] )
+{
+    TestSteadyNetwork();
+    TestJitter();
+    TestLossAndReordering();
+    TestLatencyStep();
+    TestClockDrift();
+
+    return ReportChecks();
+}
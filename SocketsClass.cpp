@@ -48,6 +48,15 @@ typedef int socklen_t;
 #include <unistd.h>
 #include <stdarg.h>
 #include <signal.h>
+#include <fcntl.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
 #endif
 
 #include <stdio.h>
@@ -124,7 +133,7 @@ mvsocket::mvsocket()
     ReadBuffer = NULL;
     SendBuffer = NULL;
     TempBuffer = NULL;
-    SetBufferSizes(4096, 2048, 2048);
+    SetBufferSizes(SOCKETS_READ_BUFFER_LENGTH, SOCKETS_SEND_BUFFER_LENGTH, 2048);
     ClearBuffers();
     socket = 0;
     mSocketOpen = false;
@@ -141,7 +150,7 @@ mvsocket::mvsocket( SOCKET newsocket )
     ReadBuffer = NULL;
     SendBuffer = NULL;
     TempBuffer = NULL;
-    SetBufferSizes(4096, 2048, 2048);
+    SetBufferSizes(SOCKETS_READ_BUFFER_LENGTH, SOCKETS_SEND_BUFFER_LENGTH, 2048);
     ClearBuffers();
     socket = newsocket;
     mSocketOpen = true;
@@ -242,6 +251,7 @@ mvsocket &mvsocket::operator =(const mvsocket &old)
 //
 // History: 20050409 Mark Wagner - Created
 //          20050410 Mark Wagner - Modified to handle short writes
+//          Short writes now resume from where the previous send() stopped
 ssize_t mvsocket::LowLevelSend(const char *buffer, size_t bytes)
 {
     ssize_t result = -1;
@@ -253,10 +263,10 @@ ssize_t mvsocket::LowLevelSend(const char *buffer, size_t bytes)
             //   DEBUG("Sending on socket " << socket << " " << strlen(SendBuffer) << " bytes: " << SendBuffer );
 
 #ifndef _WIN32 // linux
-            result = send(socket, buffer, bytes, MSG_NOSIGNAL);
+            result = send(socket, buffer + BytesSent, bytes - BytesSent, MSG_NOSIGNAL);
 #else
 
-            result = send(socket, buffer, bytes, 0);
+            result = send(socket, buffer + BytesSent, bytes - BytesSent, 0);
 #endif
 
             //   DEBUG("Socket " << socket << " send result " << result);
@@ -290,6 +300,10 @@ ssize_t mvsocket::LowLevelSend(const char *buffer, size_t bytes)
                 BytesSent += result;
             }
         }
+        if( result != -1 )
+        {
+            result = BytesSent;
+        }
     }
     else
     {
@@ -336,6 +350,185 @@ int mvsocket::Send( const char *buffer, size_t bytes )
     return LowLevelSend(buffer, bytes);
 }
 
+// Input: iFileDescriptor: an OS file descriptor opened for reading
+//        Offset: the file offset to start sending from; advanced past the bytes sent
+//        bytes: the maximum number of bytes to send
+//
+// Returns: The number of bytes sent, 0 if the socket is non-blocking and its
+//  send buffer is full, or -1 on error (including the file ending early)
+//
+// Side effects: Closes the socket on errors that indicate it isn't connected
+//  properly any more, as LowLevelSend does
+//
+// Description: Sends a section of a file over the socket in a single call, as much
+//  of it as the socket will take.  On Linux this uses sendfile(), so the data goes
+//  from the OS file cache to the socket without being copied through our buffers;
+//  elsewhere it reads the section into a local buffer and send()s it.  Unlike
+//  LowLevelSend this does not loop on short writes: the caller keeps the offset
+//  and calls again, typically once select() reports the socket writable.
+//
+// Thread safety: Thread-safe if the OS-level socket and file systems are
+ssize_t mvsocket::SendFileChunk( int iFileDescriptor, off_t &Offset, size_t bytes )
+{
+    if( !mSocketOpen )
+    {
+        WARNING("Socket " << socket << " not open");
+        return -1;
+    }
+
+    ssize_t result = -1;
+#ifdef __linux__
+
+    result = sendfile( socket, iFileDescriptor, &Offset, bytes );
+#else
+
+    char FileBuffer[ 16384 ];
+    if( bytes > sizeof( FileBuffer ) )
+    {
+        bytes = sizeof( FileBuffer );
+    }
+    if( lseek( iFileDescriptor, Offset, SEEK_SET ) == (off_t)-1 )
+    {
+        WARNING("Error " << strerror(errno) << " seeking in file for socket " << socket);
+        return -1;
+    }
+    ssize_t BytesRead = read( iFileDescriptor, FileBuffer, bytes );
+    if( BytesRead <= 0 )
+    {
+        result = BytesRead;
+    }
+    else
+    {
+#ifndef _WIN32
+        result = send( socket, FileBuffer, BytesRead, MSG_NOSIGNAL );
+#else
+
+        result = send( socket, FileBuffer, BytesRead, 0 );
+#endif
+
+        if( result > 0 )
+        {
+            Offset += result;
+        }
+    }
+#endif
+
+    if( 0 == result && bytes > 0 )
+    {
+        WARNING("File ended early sending on socket " << socket);
+        return -1;
+    }
+    return NonBlockingSendResult( result );
+}
+
+// Input: buffer: a pointer to the data to send
+//        bytes: the maximum number of bytes to send
+//
+// Returns: The number of bytes sent, 0 if the socket is non-blocking and its
+//  send buffer is full, or -1 on error
+//
+// Side effects: Closes the socket on errors that indicate it isn't connected
+//  properly any more, as LowLevelSend does
+//
+// Description: The in-memory counterpart of SendFileChunk: a single send() call,
+//  with no retry on short writes, for feeding non-blocking sockets
+//
+// Thread safety: Thread-safe if the OS-level socket system is
+ssize_t mvsocket::SendChunk( const char *buffer, size_t bytes )
+{
+    if( !mSocketOpen )
+    {
+        WARNING("Socket " << socket << " not open");
+        return -1;
+    }
+
+#ifndef _WIN32 // linux
+    ssize_t result = send( socket, buffer, bytes, MSG_NOSIGNAL );
+#else
+
+    ssize_t result = send( socket, buffer, bytes, 0 );
+#endif
+
+    return NonBlockingSendResult( result );
+}
+
+// Input: result: the return value of a send() or sendfile() call
+//
+// Returns: result if it succeeded, 0 if it failed because the non-blocking
+//  socket's send buffer is full, or -1 on any other error
+//
+// Side effects: Closes the socket on errors that indicate it isn't connected
+//  properly any more
+//
+// Description: Shared error handling for SendFileChunk and SendChunk
+ssize_t mvsocket::NonBlockingSendResult( ssize_t result )
+{
+    if( -1 == result )
+    {
+#ifndef _WIN32 // linux
+        switch(errno)
+        {
+            // Send buffer full; try again when the socket is writable
+            case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+            case EWOULDBLOCK:
+#endif
+            return 0;
+
+            // Errors that indicate a socket isn't connected properly anymore
+            case EACCES:
+            case EBADF:
+            case ECONNRESET:
+            case ENOTCONN:
+            case ENOTSOCK:
+            case EPIPE:
+            close(socket);
+            mSocketOpen = false;
+            break;
+        }
+        WARNING("Error " << strerror(errno) << " sending file on socket " << socket);
+#else // Windows
+        int iError = WSAGetLastError();
+        if( WSAEWOULDBLOCK == iError )
+        {
+            return 0;
+        }
+        DEBUG("Error code was " << iError );
+        Close();
+#endif
+
+    }
+    return result;
+}
+
+// Input: bNonBlocking: true to make the socket non-blocking, false to make it blocking
+//
+// Returns: None
+//
+// Description: Switches the socket between blocking and non-blocking mode.  In
+//  non-blocking mode, SendFileChunk returns 0 instead of waiting for the send
+//  buffer to drain, so one process can feed many sockets from a select() loop
+//
+// Thread safety: Thread-safe if the OS-level socket system is
+void mvsocket::SetNonBlocking( bool bNonBlocking )
+{
+#ifdef _WIN32
+    u_long iMode = bNonBlocking ? 1 : 0;
+    if( ioctlsocket( socket, FIONBIO, &iMode ) == SOCKET_ERROR )
+    {
+        WARNING("Error code " << WSAGetLastError() << " setting blocking mode on socket " << socket);
+    }
+#else
+
+    int flags = fcntl( socket, F_GETFL, 0 );
+    if( -1 == flags
+        || -1 == fcntl( socket, F_SETFL, bNonBlocking ? ( flags | O_NONBLOCK ) : ( flags & ~O_NONBLOCK ) ) )
+    {
+        WARNING("Error " << strerror(errno) << " setting blocking mode on socket " << socket);
+    }
+#endif
+}
+
 // Input: buffer: a pointer to where to store the data
 //        bytes: The number of bytes to fetch
 //
@@ -458,6 +651,7 @@ int mvsocket::ReceiveLineGeneric( char *Line, bool bBlocking )
     {
         // Return the line, including newline
         recvlen = ReadBufferRemove(Line, (pReadUntil - ReadBuffer + 1));
+        Line[recvlen] = '\0';
         //  DEBUG("Line found in buffer " << Line << " bytes " << recvlen);
         return SOCKETS_READ_OK;
     }
@@ -467,9 +661,11 @@ int mvsocket::ReceiveLineGeneric( char *Line, bool bBlocking )
         if(bBlocking || DataAvailable())
         {
             recvlen = LowLevelReceive(ReadBuffer + iBufferContentsLength, ReadBufferLen - iBufferContentsLength);
-            iBufferContentsLength += recvlen;
             if(recvlen != SOCKET_ERROR && recvlen > 0)
             {
+                // Keep the buffer terminated, so GetLineEnd can't run into stale data
+                iBufferContentsLength += recvlen;
+                ReadBuffer[iBufferContentsLength] = '\0';
                 pReadUntil = GetLineEnd( ReadBuffer );
                 if(pReadUntil != NULL)
                 {
@@ -1041,3 +1237,65 @@ void SocketsReadBlock(int timeout, vector<const mvsocket *> readsocks)
 
     }
 }
+
+// Input: timeout:    a timeout in milliseconds
+//        readsocks:  an STL vector of mvsocket pointers to check for reading
+//        writesocks: an STL vector of mvsocket pointers to check for writing
+//
+// Returns: None
+//
+// Description: Like SocketsReadBlock, but also returns as soon as any socket in
+//              writesocks can take more data.  Used to drive non-blocking sends,
+//              such as SendFileChunk, without polling.
+//              If timeout is 0, does not block.  If timeout is negative, blocks indefinitely
+void SocketsReadWriteBlock(int timeout, vector<const mvsocket *> readsocks, vector<const mvsocket *> writesocks)
+{
+    vector<const mvsocket *>::const_iterator i;
+    int  MaxFileDescriptor = 0;
+    timeval TimeOut;
+    TimeOut.tv_sec = timeout / 1000;
+    TimeOut.tv_usec = ( timeout % 1000 ) * 1000;
+    fd_set ReadTargetSet;
+    fd_set WriteTargetSet;
+
+    FD_ZERO( &ReadTargetSet );
+    FD_ZERO( &WriteTargetSet );
+
+    for(i = readsocks.begin(); i != readsocks.end(); i++)
+    {
+        SOCKET thissocket = (*i)->socket;
+        FD_SET( thissocket, &ReadTargetSet);
+        if( thissocket > MaxFileDescriptor)
+        {
+            MaxFileDescriptor = thissocket;
+        }
+    }
+    for(i = writesocks.begin(); i != writesocks.end(); i++)
+    {
+        SOCKET thissocket = (*i)->socket;
+        FD_SET( thissocket, &WriteTargetSet);
+        if( thissocket > MaxFileDescriptor)
+        {
+            MaxFileDescriptor = thissocket;
+        }
+    }
+
+    int result;
+    if(timeout >= 0)
+    {
+        result = select( MaxFileDescriptor + 1, &ReadTargetSet, &WriteTargetSet, NULL, &TimeOut );
+    }
+    else
+    {
+        result = select( MaxFileDescriptor + 1, &ReadTargetSet, &WriteTargetSet, NULL, NULL );
+    }
+    if( result == SOCKET_ERROR )
+    {
+#ifdef _WIN32
+        INFO("Sockets select error: " << WSAGetLastError() );
+#else
+        INFO("Sockets select error: " << strerror(errno) );
+#endif
+
+    }
+}
@@ -43,6 +43,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <sys/types.h>
 #include <vector>
 #include <ostream>
 
@@ -65,6 +66,9 @@ typedef int ssize_t;
 #endif
 #endif
 
+const int SOCKETS_READ_BUFFER_LENGTH = 4096;   //!< longest line, including its terminator, that a mvsocket can receive
+const int SOCKETS_SEND_BUFFER_LENGTH = 2048;   //!< longest message the printf-style Send can format; send longer ones with the blob Send
+
 enum SocketReadResult
 {
     SOCKETS_READ_NODATA,
@@ -101,6 +105,7 @@ private:
     // Low-level wrappers for reading and writing data to the network
     ssize_t LowLevelSend(const char *buffer, size_t bytes); //!< Low-level wrappers for writing data to the network
     ssize_t LowLevelReceive(char *buffer, size_t bytes);  //!< Low-level wrappers for reading data from the network
+    ssize_t NonBlockingSendResult( ssize_t result );  //!< Maps a failed non-blocking send to 0 (socket full) or -1 (error)
 
     //! Search a string for any form of line-ending
     char *GetLineEnd(char *buffer);
@@ -130,9 +135,16 @@ public:
     // Data-transmission functions
     ssize_t Send( const char *message, ... );                           //!< Sends data on our socket (client or server)
     int Send( const char *buffer, size_t bytes );     //!< Sends pre-formatted data on our socket
+    ssize_t SendFileChunk( int iFileDescriptor, off_t &Offset, size_t bytes ); //!< Sends part of a file, zero-copy where the OS allows
+    ssize_t SendChunk( const char *buffer, size_t bytes );          //!< Sends as much of a blob as the socket will take right now
+    void SetNonBlocking( bool bNonBlocking );                       //!< Switches the socket between blocking and non-blocking sends/receives
 
     // Data-reception functions
     bool DataAvailable();                                           //!< Is there any data waiting?  true/false
+    size_t BufferedBytes() const                                    //!< Bytes already read off the network but not yet returned
+    {
+        return iBufferContentsLength;
+    }
     int Receive( char *buffer, size_t bytes );      //!< Receives a blob of data
     int ReceiveLineIfAvailable( char *Line );                       //!< gets a line of data, returns immediately if no data
     //!< returns SOCKETS_READ_NODATA, SOCKETS_READ_SOCKETGONE, SOCKETS_READ_OK
@@ -174,6 +186,7 @@ public:
 
     // Friend functions
     void friend SocketsReadBlock(int timeout, vector<const mvsocket *> readsocks);
+    void friend SocketsReadWriteBlock(int timeout, vector<const mvsocket *> readsocks, vector<const mvsocket *> writesocks);
     friend ostream& operator <<( ostream& outs, const mvsocket data )
     {
         outs << "Socket: " << data.socket << " ReadBuffer " << data.iBufferContentsLength;
@@ -24,6 +24,7 @@
 
 #include <iostream>
 #include <map>
+#include <string.h>
 
 #include "SocketsConnectionManager.h"
 #include "SocketsClass.h"
@@ -78,7 +79,7 @@ void SocketsConnectionManagerClass::Broadcast( const string Message )
     int result;
     for ( ConnectionsIterator = Connections.begin( ) ; ConnectionsIterator != Connections.end( ); ConnectionsIterator++ )
     {
-        result = ConnectionsIterator->second.connectionsocket.Send( Message.c_str() );
+        result = ConnectionsIterator->second.connectionsocket.Send( Message.c_str(), Message.size() );
         if( result == SOCKET_ERROR )
         {
             DEBUG(  "Client connref " << ConnectionsIterator->first << " disconnected" ); // DEBUG
@@ -115,7 +116,8 @@ int SocketsConnectionManagerClass::SendOnCurrentIterator( const char *Message )
 int SocketsConnectionManagerClass::SendThruConnection( CONNECTION &rConnection, const char *Message )
 {
     int result;
-    result = rConnection.connectionsocket.Send( Message );
+    // sent as a blob: messages can be longer than the printf buffer, and carry '%' from user data
+    result = rConnection.connectionsocket.Send( Message, strlen( Message ) );
     if( result == SOCKETS_READ_SOCKETGONE )
     {
         rConnection.bConnected = false;
@@ -168,6 +168,11 @@ void Sphere::WriteToXMLDoc( TiXmlElement *pElement )
     pElement->FirstChildElement("faces")->FirstChildElement("face")->FirstChildElement("texture")->SetAttribute("stexturereference", sTextureReference );
     Prim::WriteToXMLDoc( pElement );
 }
+void Sphere::WriteXMLAttributes( XmlWriter &Writer )
+{
+    Writer.Attribute( "type", "SPHERE" );
+    Prim::WriteXMLAttributes( Writer );
+}
 //void Sphere::CopyTo( Sphere *ptargetsphere )
 //{
 //ptargetsphere->color0 = color0;
@@ -88,6 +88,8 @@ public:
    	   DEBUG( "Sphere::Sphere" );
    	   sprintf( ObjectType, "PRIM" );
    	   sprintf( sDeepObjectType, "SPHERE" );
+   	   TypeTag = OBJECTTYPE_PRIM;
+   	   DeepTypeTag = DEEPTYPE_SPHERE;
    	   sprintf( PrimType, "SPHERE" );
    	   color0.r = 0.2;
    	   color0.g = 0.2;
@@ -103,6 +105,7 @@ public:
    virtual void UpdateFromXML( TiXmlElement *pElement );
    void LoadFromXML( TiXmlElement *pElement );
    virtual void WriteToXMLDoc( TiXmlElement *pElement );
+   virtual void WriteXMLAttributes( XmlWriter &Writer );
    const Sphere &Sphere::operator=( const Sphere &IncomingPrim );
    //virtual void CopyTo( Sphere *ptargetcube );
    virtual void Draw();
@@ -0,0 +1,539 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Draws prims that havent moved for a while in batches, one draw per texture, prim type and area
+//!
+//! Drawing each prim by itself costs a push, translate, rotate, scale, material color, texture bind and
+//! display list call, so a world of ten thousand prims is ten thousand draws.  Most prims dont move though.
+//!
+//! Update looks at every top-level cube, sphere, cylinder and cone each frame, and remembers its position,
+//! rotation, scale, color and texture.  A prim that hasnt changed for iStaticDelayMilliseconds goes into a
+//! batch: one per prim type, texture and fCellSize cube of the world the prim's center is in.  A batch is its
+//! prims' triangles, already moved to where the prims are, with each prim's color on its vertices, handed to
+//! mvGraphicsInterface::CreateStaticBatch to keep.  A prim that changes, or goes, leaves its batch straight
+//! away, and is drawn by itself again until it's been still for iStaticDelayMilliseconds.
+//! Only batches whose prims came or went that frame are rebuilt.
+//!
+//! Draw draws the batches whose bounding boxes are in the view frustum; the rest of the world is drawn as
+//! before, skipping prims IsBatched says are in a batch.
+//!
+//! Batched prims use a coarser mesh than the display lists in Graphics.cpp, since each batch holds
+//! every triangle of every prim in it.
+//!
+//! All of this is bookkeeping on the CPU, and the drawing goes through mvGraphicsInterface, so a mock
+//! mvGraphicsInterface can check the batching and culling without OpenGL.
+
+#include "StaticBatches.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "WorldStorage.h"
+#include "Prim.h"
+#include "TextureInfoCache.h"
+
+const int iBatchSlices = 16;   //!< slices round spheres, cylinders and cones, in batches
+const int iBatchStacks = 8;   //!< stacks from pole to pole of spheres, in batches
+
+//! meshes of each prim type, centered on 0,0,0, unit size, built the first time they're needed
+static vector< BATCHVERTEX > UnitMeshes[ DEEPTYPE_COUNT ];
+
+static void AddVertex( vector< BATCHVERTEX > &Mesh, float x, float y, float z, float nx, float ny, float nz, float s, float t )
+{
+    BATCHVERTEX Vertex;
+    Vertex.Pos[0] = x;
+    Vertex.Pos[1] = y;
+    Vertex.Pos[2] = z;
+    Vertex.Normal[0] = nx;
+    Vertex.Normal[1] = ny;
+    Vertex.Normal[2] = nz;
+    Vertex.TexCoord[0] = s;
+    Vertex.TexCoord[1] = t;
+    Vertex.Color[0] = 1;
+    Vertex.Color[1] = 1;
+    Vertex.Color[2] = 1;
+    Mesh.push_back( Vertex );
+}
+
+// Description: same faces and texture coordinates as the cube display list in Graphics.cpp, each quad as two triangles
+static void BuildCubeMesh( vector< BATCHVERTEX > &Mesh )
+{
+    // normal, then texcoord and corner of each of the four corners, corners from 0 to 1 as in Graphics.cpp
+    static const float Faces[6][3 + 4 * 5] =
+        {
+            { 0, 0, 1,    0, 0, 1, 1, 1,   0, 1, 0, 1, 1,   1, 1, 0, 0, 1,   1, 0, 1, 0, 1 },
+            { 0, 0, -1,   1, 0, 1, 1, 0,   0, 0, 1, 0, 0,   0, 1, 0, 0, 0,   1, 1, 0, 1, 0 },
+            { 0, 1, 0,    0, 0, 1, 1, 1,   0, 1, 1, 1, 0,   1, 1, 0, 1, 0,   1, 0, 0, 1, 1 },
+            { 0, -1, 0,   0, 1, 0, 0, 0,   1, 1, 1, 0, 0,   1, 0, 1, 0, 1,   0, 0, 0, 0, 1 },
+            { 1, 0, 0,    1, 0, 1, 1, 1,   0, 0, 1, 0, 1,   0, 1, 1, 0, 0,   1, 1, 1, 1, 0 },
+            { -1, 0, 0,   1, 1, 0, 0, 0,   1, 0, 0, 0, 1,   0, 0, 0, 1, 1,   0, 1, 0, 1, 0 }
+        };
+    static const int Corners[6] = { 0, 1, 2, 0, 2, 3 };
+    for( int iFace = 0; iFace < 6; iFace++ )
+    {
+        const float *Face = Faces[iFace];
+        for( int i = 0; i < 6; i++ )
+        {
+            const float *Corner = Face + 3 + Corners[i] * 5;
+            AddVertex( Mesh, Corner[2] - 0.5f, Corner[3] - 0.5f, Corner[4] - 0.5f, Face[0], Face[1], Face[2], Corner[0], Corner[1] );
+        }
+    }
+}
+
+// Description: like gluSphere( 0.5, iBatchSlices, iBatchStacks ): poles on the z axis, texture wrapped round once
+static void BuildSphereMesh( vector< BATCHVERTEX > &Mesh )
+{
+    for( int iStack = 0; iStack < iBatchStacks; iStack++ )
+    {
+        for( int iSlice = 0; iSlice < iBatchSlices; iSlice++ )
+        {
+            // corners in the order that faces outwards
+            int Slices[4] = { iSlice, iSlice + 1, iSlice + 1, iSlice };
+            int Stacks[4] = { iStack, iStack, iStack + 1, iStack + 1 };
+            float Corners[4][5];
+            for( int iCorner = 0; iCorner < 4; iCorner++ )
+            {
+                float fTheta = TwoPI * (float)Slices[iCorner] / (float)iBatchSlices;
+                float fPhi = PI * (float)Stacks[iCorner] / (float)iBatchStacks;
+                Corners[iCorner][0] = (float)( sin( fTheta ) * sin( fPhi ) );
+                Corners[iCorner][1] = (float)( cos( fTheta ) * sin( fPhi ) );
+                Corners[iCorner][2] = (float)cos( fPhi );
+                Corners[iCorner][3] = 1.0f - (float)Slices[iCorner] / (float)iBatchSlices;
+                Corners[iCorner][4] = 1.0f - (float)Stacks[iCorner] / (float)iBatchStacks;
+            }
+            static const int Triangles[6] = { 0, 1, 2, 0, 2, 3 };
+            for( int i = 0; i < 6; i++ )
+            {
+                // at the poles, one triangle of each quad has two corners on the pole
+                if( ( iStack == 0 && i < 3 ) || ( iStack == iBatchStacks - 1 && i >= 3 ) )
+                {
+                    continue;
+                }
+                const float *Corner = Corners[ Triangles[i] ];
+                AddVertex( Mesh, Corner[0] * 0.5f, Corner[1] * 0.5f, Corner[2] * 0.5f, Corner[0], Corner[1], Corner[2], Corner[3], Corner[4] );
+            }
+        }
+    }
+}
+
+// Description: a disk of radius 0.5 at height fZ, facing up or down, like gluDisk, including its texture coordinates
+static void AddDisk( vector< BATCHVERTEX > &Mesh, float fZ, bool bFacingUp )
+{
+    for( int iSlice = 0; iSlice < iBatchSlices; iSlice++ )
+    {
+        float fTheta0 = TwoPI * (float)iSlice / (float)iBatchSlices;
+        float fTheta1 = TwoPI * (float)( iSlice + 1 ) / (float)iBatchSlices;
+        if( bFacingUp )
+        {
+            float fSwap = fTheta0;
+            fTheta0 = fTheta1;
+            fTheta1 = fSwap;
+        }
+        float fNormalZ = bFacingUp ? 1.0f : -1.0f;
+        // Graphics.cpp turns the downward disks over, which mirrors their texture in y
+        AddVertex( Mesh, 0, 0, fZ, 0, 0, fNormalZ, 0.5f, 0.5f );
+        AddVertex( Mesh, 0.5f * (float)sin( fTheta0 ), 0.5f * (float)cos( fTheta0 ), fZ, 0, 0, fNormalZ,
+                   0.5f + 0.5f * (float)sin( fTheta0 ), 0.5f + fNormalZ * 0.5f * (float)cos( fTheta0 ) );
+        AddVertex( Mesh, 0.5f * (float)sin( fTheta1 ), 0.5f * (float)cos( fTheta1 ), fZ, 0, 0, fNormalZ,
+                   0.5f + 0.5f * (float)sin( fTheta1 ), 0.5f + fNormalZ * 0.5f * (float)cos( fTheta1 ) );
+    }
+}
+
+// Description: like gluCylinder from z -0.5 to 0.5, with the disks Graphics.cpp puts on the ends; fTopRadius 0 makes a cone, which has no top
+static void BuildCylinderMesh( vector< BATCHVERTEX > &Mesh, float fTopRadius )
+{
+    const float fBaseRadius = 0.5f;
+    float fNormalZ = fBaseRadius - fTopRadius;
+    float fNormalScale = 1.0f / (float)sqrt( 1.0f + fNormalZ * fNormalZ );
+    for( int iSlice = 0; iSlice < iBatchSlices; iSlice++ )
+    {
+        // corners in the order that faces outwards: up one side, then down the next
+        int Slices[4] = { iSlice, iSlice, iSlice + 1, iSlice + 1 };
+        int Ends[4] = { 0, 1, 1, 0 };
+        float Corners[4][8];
+        for( int iCorner = 0; iCorner < 4; iCorner++ )
+        {
+            float fTheta = TwoPI * (float)Slices[iCorner] / (float)iBatchSlices;
+            float fRadius = Ends[iCorner] == 0 ? fBaseRadius : fTopRadius;
+            Corners[iCorner][0] = fRadius * (float)sin( fTheta );
+            Corners[iCorner][1] = fRadius * (float)cos( fTheta );
+            Corners[iCorner][2] = (float)Ends[iCorner] - 0.5f;
+            Corners[iCorner][3] = (float)sin( fTheta ) * fNormalScale;
+            Corners[iCorner][4] = (float)cos( fTheta ) * fNormalScale;
+            Corners[iCorner][5] = fNormalZ * fNormalScale;
+            Corners[iCorner][6] = (float)Slices[iCorner] / (float)iBatchSlices;
+            Corners[iCorner][7] = (float)Ends[iCorner];
+        }
+        static const int Triangles[6] = { 0, 1, 2, 0, 2, 3 };
+        for( int i = 0; i < 6; i++ )
+        {
+            if( fTopRadius == 0 && i < 3 )
+            {
+                continue;   // the first triangle has two corners at the tip
+            }
+            const float *Corner = Corners[ Triangles[i] ];
+            AddVertex( Mesh, Corner[0], Corner[1], Corner[2], Corner[3], Corner[4], Corner[5], Corner[6], Corner[7] );
+        }
+    }
+    AddDisk( Mesh, -0.5f, false );
+    if( fTopRadius > 0 )
+    {
+        AddDisk( Mesh, 0.5f, true );
+    }
+}
+
+static const vector< BATCHVERTEX > &GetUnitMesh( DeepObjectTypeTag DeepType )
+{
+    vector< BATCHVERTEX > &Mesh = UnitMeshes[ DeepType ];
+    if( Mesh.size() == 0 )
+    {
+        switch( DeepType )
+        {
+        case DEEPTYPE_CUBE:
+            BuildCubeMesh( Mesh );
+            break;
+        case DEEPTYPE_SPHERE:
+            BuildSphereMesh( Mesh );
+            break;
+        case DEEPTYPE_CYLINDER:
+            BuildCylinderMesh( Mesh, 0.5f );
+            break;
+        case DEEPTYPE_CONE:
+            BuildCylinderMesh( Mesh, 0.0f );
+            break;
+        default:
+            break;
+        }
+    }
+    return Mesh;
+}
+
+// Input: Rotation: a unit quaternion
+// Returns: Matrix, the same rotation as a 3x3 matrix, row-major, rotating the same way as mvGraphicsClass::RotateToRot
+static void RotToMatrix( float Matrix[3][3], const Rot &Rotation )
+{
+    float x = Rotation.x, y = Rotation.y, z = Rotation.z, s = Rotation.s;
+    Matrix[0][0] = 1 - 2 * ( y * y + z * z );
+    Matrix[0][1] = 2 * ( x * y - s * z );
+    Matrix[0][2] = 2 * ( x * z + s * y );
+    Matrix[1][0] = 2 * ( x * y + s * z );
+    Matrix[1][1] = 1 - 2 * ( x * x + z * z );
+    Matrix[1][2] = 2 * ( y * z - s * x );
+    Matrix[2][0] = 2 * ( x * z - s * y );
+    Matrix[2][1] = 2 * ( y * z + s * x );
+    Matrix[2][2] = 1 - 2 * ( x * x + y * y );
+}
+
+// Description: grows the box from Min to Max to take in Point
+static void ExpandBox( Vector3 &Min, Vector3 &Max, const float *Point )
+{
+    if( Point[0] < Min.x ) Min.x = Point[0];
+    if( Point[1] < Min.y ) Min.y = Point[1];
+    if( Point[2] < Min.z ) Min.z = Point[2];
+    if( Point[0] > Max.x ) Max.x = Point[0];
+    if( Point[1] > Max.y ) Max.y = Point[1];
+    if( Point[2] > Max.z ) Max.z = Point[2];
+}
+
+bool STATICBATCHKEY::operator<( const STATICBATCHKEY &Other ) const
+{
+    if( DeepType != Other.DeepType )
+    {
+        return DeepType < Other.DeepType;
+    }
+    if( iTextureID != Other.iTextureID )
+    {
+        return iTextureID < Other.iTextureID;
+    }
+    if( iCellX != Other.iCellX )
+    {
+        return iCellX < Other.iCellX;
+    }
+    if( iCellY != Other.iCellY )
+    {
+        return iCellY < Other.iCellY;
+    }
+    return iCellZ < Other.iCellZ;
+}
+
+StaticBatchesClass::StaticBatchesClass( mvGraphicsInterface &NewGraphics, int iNewStaticDelayMilliseconds, float fNewCellSize ) :
+        Graphics( NewGraphics )
+{
+    iStaticDelayMilliseconds = iNewStaticDelayMilliseconds;
+    fCellSize = fNewCellSize;
+    iScan = 0;
+    iNumBatchedPrims = 0;
+    iNumBatchesDrawn = 0;
+    iNumRebuilds = 0;
+}
+
+StaticBatchesClass::~StaticBatchesClass()
+{
+    Clear();
+}
+
+void StaticBatchesClass::Clear()
+{
+    map< STATICBATCHKEY, STATICBATCH >::iterator batchiterator;
+    for( batchiterator = Batches.begin(); batchiterator != Batches.end(); batchiterator++ )
+    {
+        if( batchiterator->second.iHandle != -1 )
+        {
+            Graphics.DeleteStaticBatch( batchiterator->second.iHandle );
+        }
+    }
+    Batches.clear();
+    Prims.clear();
+    iNumBatchedPrims = 0;
+}
+
+STATICBATCHKEY StaticBatchesClass::GetKey( const STATICPRIM &Prim ) const
+{
+    STATICBATCHKEY Key;
+    Key.DeepType = Prim.DeepType;
+    Key.iTextureID = Prim.iTextureID;
+    Key.iCellX = (int)floor( Prim.Pos.x / fCellSize );
+    Key.iCellY = (int)floor( Prim.Pos.y / fCellSize );
+    Key.iCellZ = (int)floor( Prim.Pos.z / fCellSize );
+    return Key;
+}
+
+void StaticBatchesClass::AddToBatch( int iReference, STATICPRIM &Prim )
+{
+    Prim.Key = GetKey( Prim );
+    map< STATICBATCHKEY, STATICBATCH >::iterator batchiterator = Batches.find( Prim.Key );
+    if( batchiterator == Batches.end() )
+    {
+        STATICBATCH NewBatch;
+        NewBatch.iHandle = -1;
+        NewBatch.iNumVertices = 0;
+        batchiterator = Batches.insert( pair< STATICBATCHKEY, STATICBATCH >( Prim.Key, NewBatch ) ).first;
+    }
+    batchiterator->second.Members.insert( iReference );
+    batchiterator->second.bDirty = true;
+    Prim.bBatched = true;
+    iNumBatchedPrims++;
+}
+
+void StaticBatchesClass::RemoveFromBatch( int iReference, STATICPRIM &Prim )
+{
+    map< STATICBATCHKEY, STATICBATCH >::iterator batchiterator = Batches.find( Prim.Key );
+    if( batchiterator != Batches.end() )
+    {
+        batchiterator->second.Members.erase( iReference );
+        batchiterator->second.bDirty = true;
+    }
+    Prim.bBatched = false;
+    iNumBatchedPrims--;
+}
+
+// Description: makes the batch's triangles from what its prims looked like when last checked, and hands them
+//              to Graphics in place of the ones it had
+void StaticBatchesClass::BuildBatch( STATICBATCH &Batch )
+{
+    Vertices.clear();
+    Batch.Min = Vector3( 0, 0, 0 );
+    Batch.Max = Vector3( 0, 0, 0 );
+    set< int >::const_iterator memberiterator;
+    for( memberiterator = Batch.Members.begin(); memberiterator != Batch.Members.end(); memberiterator++ )
+    {
+        const STATICPRIM &Prim = Prims[ *memberiterator ];
+        const vector< BATCHVERTEX > &Mesh = GetUnitMesh( Prim.DeepType );
+
+        float Rotation[3][3];
+        RotToMatrix( Rotation, Prim.Rotation );
+        // normals scale by the inverse of the scale, so they stay at right angles to squashed faces
+        float InverseScale[3];
+        InverseScale[0] = Prim.Scale.x != 0 ? 1.0f / Prim.Scale.x : 0;
+        InverseScale[1] = Prim.Scale.y != 0 ? 1.0f / Prim.Scale.y : 0;
+        InverseScale[2] = Prim.Scale.z != 0 ? 1.0f / Prim.Scale.z : 0;
+        float Scale[3] = { Prim.Scale.x, Prim.Scale.y, Prim.Scale.z };
+        float Pos[3] = { Prim.Pos.x, Prim.Pos.y, Prim.Pos.z };
+
+        for( int iVertex = 0; iVertex < (int)Mesh.size(); iVertex++ )
+        {
+            const BATCHVERTEX &UnitVertex = Mesh[iVertex];
+            BATCHVERTEX Vertex = UnitVertex;
+            float NormalMagnitudeSquared = 0;
+            for( int iAxis = 0; iAxis < 3; iAxis++ )
+            {
+                Vertex.Pos[iAxis] = Pos[iAxis];
+                Vertex.Normal[iAxis] = 0;
+                for( int k = 0; k < 3; k++ )
+                {
+                    Vertex.Pos[iAxis] += Rotation[iAxis][k] * UnitVertex.Pos[k] * Scale[k];
+                    Vertex.Normal[iAxis] += Rotation[iAxis][k] * UnitVertex.Normal[k] * InverseScale[k];
+                }
+                NormalMagnitudeSquared += Vertex.Normal[iAxis] * Vertex.Normal[iAxis];
+            }
+            if( NormalMagnitudeSquared > 0 )
+            {
+                float fNormalScale = 1.0f / (float)sqrt( NormalMagnitudeSquared );
+                Vertex.Normal[0] *= fNormalScale;
+                Vertex.Normal[1] *= fNormalScale;
+                Vertex.Normal[2] *= fNormalScale;
+            }
+            Vertex.Color[0] = Prim.FaceColor.r;
+            Vertex.Color[1] = Prim.FaceColor.g;
+            Vertex.Color[2] = Prim.FaceColor.b;
+
+            if( Vertices.size() == 0 )
+            {
+                Batch.Min = Vector3( Vertex.Pos[0], Vertex.Pos[1], Vertex.Pos[2] );
+                Batch.Max = Batch.Min;
+            }
+            ExpandBox( Batch.Min, Batch.Max, Vertex.Pos );
+            Vertices.push_back( Vertex );
+        }
+    }
+
+    if( Batch.iHandle != -1 )
+    {
+        Graphics.DeleteStaticBatch( Batch.iHandle );
+    }
+    Batch.iNumVertices = (int)Vertices.size();
+    Batch.iHandle = Graphics.CreateStaticBatch( &Vertices[0], Batch.iNumVertices );
+    Batch.bDirty = false;
+}
+
+void StaticBatchesClass::Update( mvWorldStorage &World, int iTickCount )
+{
+    iScan++;
+    for( int i = 0; i < World.iNumObjects; i++ )
+    {
+        Object *pObject = World.GetObject( i );
+        // sub-objects are drawn by their groupings
+        if( pObject->iParentReference != 0 || pObject->iReference == 0 )
+        {
+            continue;
+        }
+        if( pObject->DeepTypeTag != DEEPTYPE_CUBE && pObject->DeepTypeTag != DEEPTYPE_SPHERE &&
+            pObject->DeepTypeTag != DEEPTYPE_CYLINDER && pObject->DeepTypeTag != DEEPTYPE_CONE )
+        {
+            continue;
+        }
+        Prim *pPrim = dynamic_cast< Prim * >( pObject );
+
+        STATICPRIM Latest;
+        Latest.DeepType = pObject->DeepTypeTag;
+        Latest.Pos = pObject->pos;
+        Latest.Rotation = pObject->rot;
+        Latest.Scale = pPrim->scale;
+        Latest.FaceColor = pPrim->GetColor( 0 );
+        Latest.iTextureID = 0;
+        if( Object::ptextureinfocache != NULL )
+        {
+            char sTextureReference[33];
+            sprintf( sTextureReference, "%.32s", pPrim->GetTexture( 0 ) );
+            Latest.iTextureID = Object::ptextureinfocache->TextureReferenceToTextureId( sTextureReference );
+        }
+        Latest.iLastChangeTickCount = iTickCount;
+        Latest.iLastScan = iScan;
+        Latest.bBatched = false;
+
+        map< int, STATICPRIM >::iterator primiterator = Prims.find( pObject->iReference );
+        if( primiterator == Prims.end() )
+        {
+            Prims.insert( pair< int, STATICPRIM >( pObject->iReference, Latest ) );
+            continue;
+        }
+
+        STATICPRIM &Prim = primiterator->second;
+        Prim.iLastScan = iScan;
+        if( Latest.DeepType != Prim.DeepType || Latest.iTextureID != Prim.iTextureID
+            || Latest.Pos.x != Prim.Pos.x || Latest.Pos.y != Prim.Pos.y || Latest.Pos.z != Prim.Pos.z
+            || Latest.Rotation.x != Prim.Rotation.x || Latest.Rotation.y != Prim.Rotation.y
+            || Latest.Rotation.z != Prim.Rotation.z || Latest.Rotation.s != Prim.Rotation.s
+            || Latest.Scale.x != Prim.Scale.x || Latest.Scale.y != Prim.Scale.y || Latest.Scale.z != Prim.Scale.z
+            || Latest.FaceColor.r != Prim.FaceColor.r || Latest.FaceColor.g != Prim.FaceColor.g || Latest.FaceColor.b != Prim.FaceColor.b )
+        {
+            if( Prim.bBatched )
+            {
+                RemoveFromBatch( pObject->iReference, Prim );
+            }
+            Prim = Latest;
+        }
+        else if( !Prim.bBatched && iTickCount - Prim.iLastChangeTickCount >= iStaticDelayMilliseconds )
+        {
+            AddToBatch( pObject->iReference, Prim );
+        }
+    }
+
+    // prims not seen this scan have been deleted, or linked into a grouping
+    map< int, STATICPRIM >::iterator primiterator = Prims.begin();
+    while( primiterator != Prims.end() )
+    {
+        if( primiterator->second.iLastScan != iScan )
+        {
+            if( primiterator->second.bBatched )
+            {
+                RemoveFromBatch( primiterator->first, primiterator->second );
+            }
+            Prims.erase( primiterator++ );
+        }
+        else
+        {
+            primiterator++;
+        }
+    }
+
+    iNumRebuilds = 0;
+    map< STATICBATCHKEY, STATICBATCH >::iterator batchiterator = Batches.begin();
+    while( batchiterator != Batches.end() )
+    {
+        STATICBATCH &Batch = batchiterator->second;
+        if( Batch.bDirty && Batch.Members.size() == 0 )
+        {
+            if( Batch.iHandle != -1 )
+            {
+                Graphics.DeleteStaticBatch( Batch.iHandle );
+            }
+            Batches.erase( batchiterator++ );
+            continue;
+        }
+        if( Batch.bDirty )
+        {
+            BuildBatch( Batch );
+            iNumRebuilds++;
+        }
+        batchiterator++;
+    }
+}
+
+void StaticBatchesClass::Draw( const VIEWFRUSTUM &Frustum )
+{
+    iNumBatchesDrawn = 0;
+    map< STATICBATCHKEY, STATICBATCH >::const_iterator batchiterator;
+    for( batchiterator = Batches.begin(); batchiterator != Batches.end(); batchiterator++ )
+    {
+        const STATICBATCH &Batch = batchiterator->second;
+        if( Batch.iHandle != -1 && BoxInFrustum( Frustum, Batch.Min, Batch.Max ) )
+        {
+            Graphics.DrawStaticBatch( Batch.iHandle, batchiterator->first.iTextureID );
+            iNumBatchesDrawn++;
+        }
+    }
+}
+
+bool StaticBatchesClass::IsBatched( int iReference ) const
+{
+    map< int, STATICPRIM >::const_iterator primiterator = Prims.find( iReference );
+    return primiterator != Prims.end() && primiterator->second.bBatched;
+}
@@ -0,0 +1,119 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Draws prims that havent moved for a while in batches, one draw per texture, prim type and area
+
+// see StaticBatches.cpp for documentation
+
+#ifndef _STATICBATCHES_H
+#define _STATICBATCHES_H
+
+#include <map>
+#include <set>
+#include <vector>
+using namespace std;
+
+#include "Math.h"
+#include "BasicTypes.h"
+#include "GraphicsInterface.h"
+#include "Object.h"
+
+class mvWorldStorage;
+
+//! What puts a prim in one batch rather than another
+struct STATICBATCHKEY
+{
+   DeepObjectTypeTag DeepType;
+   int iTextureID;
+   int iCellX;   //!< cell of the world the prim's center is in, so each batch covers one area and can be culled
+   int iCellY;
+   int iCellZ;
+
+   bool operator<( const STATICBATCHKEY &Other ) const;
+};
+
+//! What a prim looked like last time we checked: everything that goes into its batch's vertices
+struct STATICPRIM
+{
+   DeepObjectTypeTag DeepType;
+   Vector3 Pos;
+   Rot Rotation;
+   Vector3 Scale;
+   Color FaceColor;
+   int iTextureID;
+   int iLastChangeTickCount;   //!< when any of the above last changed
+   int iLastScan;   //!< Update scan it was last seen in, to spot deleted prims
+   bool bBatched;   //!< true if it's in the batch for Key
+   STATICBATCHKEY Key;
+};
+
+//! A batch: prims drawn with one call
+struct STATICBATCH
+{
+   set< int > Members;   //!< prim references
+   int iHandle;   //!< from mvGraphicsInterface::CreateStaticBatch, or -1 if not built
+   bool bDirty;   //!< Members changed since it was built
+   int iNumVertices;
+   Vector3 Min;   //!< bounding box
+   Vector3 Max;
+};
+
+//! StaticBatchesClass draws prims that havent moved for a while in batches, one draw per texture, prim type and area
+
+//! StaticBatchesClass draws prims that havent moved for a while in batches, one draw per texture, prim type and area
+//! Call Update then Draw once a frame, and skip drawing prims IsBatched says are in a batch.
+//! Only this class's own bookkeeping is done here; drawing goes through mvGraphicsInterface, so it runs without OpenGL
+class StaticBatchesClass
+{
+public:
+   StaticBatchesClass( mvGraphicsInterface &Graphics, int iStaticDelayMilliseconds = 2000, float fCellSize = 32.0f );
+   ~StaticBatchesClass();
+
+   void Update( mvWorldStorage &World, int iTickCount );   //!< moves prims into and out of batches as they stop and start changing, and rebuilds batches whose prims changed
+   void Draw( const VIEWFRUSTUM &Frustum );   //!< draws the batches in Frustum
+   bool IsBatched( int iReference ) const;   //!< true if the prim is drawn by Draw, so shouldnt be drawn by itself
+   void Clear();   //!< drops all batches; prims go back into them as they're seen to be still again
+
+   int GetNumBatches() const { return (int)Batches.size(); }
+   int GetNumBatchedPrims() const { return iNumBatchedPrims; }
+   int GetNumBatchesDrawn() const { return iNumBatchesDrawn; }   //!< by the last Draw, after culling
+   int GetNumRebuilds() const { return iNumRebuilds; }   //!< batches rebuilt by the last Update
+
+protected:
+   mvGraphicsInterface &Graphics;
+   int iStaticDelayMilliseconds;   //!< how long a prim has to stay the same before it's batched
+   float fCellSize;   //!< size of the cube of world each batch covers
+
+   map< int, STATICPRIM > Prims;   //!< by prim reference
+   map< STATICBATCHKEY, STATICBATCH > Batches;
+   vector< BATCHVERTEX > Vertices;   //!< used while building a batch; kept to save reallocating
+
+   int iScan;
+   int iNumBatchedPrims;
+   int iNumBatchesDrawn;
+   int iNumRebuilds;
+
+   STATICBATCHKEY GetKey( const STATICPRIM &Prim ) const;
+   void AddToBatch( int iReference, STATICPRIM &Prim );
+   void RemoveFromBatch( int iReference, STATICPRIM &Prim );
+   void BuildBatch( STATICBATCH &Batch );
+};
+
+#endif // _STATICBATCHES_H
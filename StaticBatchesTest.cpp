@@ -0,0 +1,365 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief staticbatchestest: headless tests of StaticBatches against a mock mvGraphicsInterface
+//!
+//! Puts cubes and a sphere with two textures into a world, in two cells, and checks that once they've
+//! been still for the static delay they go into one batch per prim type, texture and cell, with the
+//! right triangles in the right places; that Draw culls batches outside the frustum; that a prim that
+//! moves leaves its batch, which alone is rebuilt, and rejoins it once still again; that a deleted
+//! prim's batch goes; and that every batch handed to the mock is given back.
+//! Prints each failed check, and exits non-zero if any failed.
+//!
+//! usage: staticbatchestest
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+using namespace std;
+
+#include "StaticBatches.h"
+#include "WorldStorage.h"
+#include "TextureInfoCache.h"
+#include "Cube.h"
+#include "Sphere.h"
+#include "Diag.h"
+#include "TestCheck.h"
+
+//! mvGraphicsInterface that keeps the static batches it's given, and records which are drawn, instead of drawing
+class MockGraphics : public mvGraphicsInterface
+{
+public:
+   map< int, vector< BATCHVERTEX > > Batches;   //!< live batches, by handle
+   vector< int > DrawnHandles;   //!< batches drawn since last cleared, in order
+   vector< int > DrawnTextureIDs;   //!< texture each was drawn with
+   int iNumCreates;
+   int iNumDeletes;
+   int iNumBadHandles;   //!< draws and deletes of handles that werent live
+   int iNextHandle;
+
+   MockGraphics()
+   {
+      iNumCreates = 0;
+      iNumDeletes = 0;
+      iNumBadHandles = 0;
+      iNextHandle = 1;
+   }
+
+   void printtext( char * string) {}
+   void screenprinttext(int x, int y, char * string) {}
+   float GetScalingFrom3DToScreen( float fDepth ) { return 1.0f; }
+   void RotateToRot( Rot &rot ) {}
+   void SetColor( float r, float g, float b ) {}
+   void DrawWireframeBox( int iNumSlices ) {}
+   void DoCone() {}
+   void DoCube() {}
+   void DoSphere() {}
+   void DoCylinder() {}
+   void DoWireSphere() {}
+   void DrawSquareXYPlane() {}
+   void DrawParallelSquares( int iNumSlices ) {}
+   void Translatef( float x, float y, float z ) {}
+   void Rotatef( float fAngleDegrees, float fX, float fY, float fZ) {}
+   void Scalef( float x, float y, float z ) {}
+   void Bind2DTexture( int iTextureID ) {}
+   void PopMatrix() {}
+   void PushMatrix() {}
+   void SetMaterialColor(float *mcolor) {}
+   void RasterPos3f(float x, float y, float z ) {}
+   void GetViewFrustum( VIEWFRUSTUM &Frustum ) {}
+   void GetEyePosition( Vector3 &EyePos ) { EyePos = Vector3( 0, 0, 0 ); }
+   void DrawIndexedTriangles( const BATCHVERTEX *pVertices, const unsigned short *pIndices, int iNumIndices ) {}
+
+   int CreateStaticBatch( const BATCHVERTEX *pVertices, int iNumVertices )
+   {
+      iNumCreates++;
+      Batches[ iNextHandle ] = vector< BATCHVERTEX >( pVertices, pVertices + iNumVertices );
+      return iNextHandle++;
+   }
+   void DrawStaticBatch( int iBatchHandle, int iTextureID )
+   {
+      if( Batches.find( iBatchHandle ) == Batches.end() )
+      {
+         iNumBadHandles++;
+      }
+      DrawnHandles.push_back( iBatchHandle );
+      DrawnTextureIDs.push_back( iTextureID );
+   }
+   void DeleteStaticBatch( int iBatchHandle )
+   {
+      iNumDeletes++;
+      if( Batches.erase( iBatchHandle ) != 1 )
+      {
+         iNumBadHandles++;
+      }
+   }
+};
+
+const int iStaticDelay = 2000;
+const float fCellSize = 32.0f;
+const int iVerticesPerCube = 36;   //!< six faces of two triangles
+
+const char *sTextureA = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+const char *sTextureB = "bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb";
+const int iTextureIDA = 11;
+const int iTextureIDB = 12;
+
+//! sets up pPrim as a unit prim at Pos, with a texture and color, and adds it to World
+void AddPrim( mvWorldStorage &World, Prim *pPrim, const int iReference, const Vector3 &Pos, const char *sTexture, const Color &FaceColor )
+{
+    pPrim->iReference = iReference;
+    pPrim->pos = Pos;
+    SetZeroRot( pPrim->rot );
+    pPrim->scale = Vector3( 1, 1, 1 );
+    pPrim->SetTexture( 0, sTexture );
+    pPrim->SetColor( 0, FaceColor );
+    World.AddObject( pPrim );
+}
+
+//! returns the handle of the only live batch whose vertices are all within fRadius of Center, or -1 if none or more than one
+int FindBatch( const MockGraphics &Graphics, const Vector3 &Center, const float fRadius )
+{
+    int iFound = -1;
+    int iNumFound = 0;
+    map< int, vector< BATCHVERTEX > >::const_iterator batchiterator;
+    for( batchiterator = Graphics.Batches.begin(); batchiterator != Graphics.Batches.end(); batchiterator++ )
+    {
+        bool bAllNear = batchiterator->second.size() > 0;
+        for( int i = 0; i < (int)batchiterator->second.size(); i++ )
+        {
+            const float *Pos = batchiterator->second[i].Pos;
+            if( VectorMag( Vector3( Pos[0], Pos[1], Pos[2] ) - Center ) > fRadius )
+            {
+                bAllNear = false;
+            }
+        }
+        if( bAllNear )
+        {
+            iFound = batchiterator->first;
+            iNumFound++;
+        }
+    }
+    return iNumFound == 1 ? iFound : -1;
+}
+
+//! returns the vertices of batch iHandle, or none if it's not live
+const vector< BATCHVERTEX > &GetBatch( const MockGraphics &Graphics, const int iHandle )
+{
+    static const vector< BATCHVERTEX > NoVertices;
+    map< int, vector< BATCHVERTEX > >::const_iterator batchiterator = Graphics.Batches.find( iHandle );
+    return batchiterator != Graphics.Batches.end() ? batchiterator->second : NoVertices;
+}
+
+//! returns true if the batch has a vertex at Pos, to within a millimetre
+bool BatchHasVertexAt( const MockGraphics &Graphics, const int iHandle, const Vector3 &Pos )
+{
+    map< int, vector< BATCHVERTEX > >::const_iterator batchiterator = Graphics.Batches.find( iHandle );
+    if( batchiterator == Graphics.Batches.end() )
+    {
+        return false;
+    }
+    for( int i = 0; i < (int)batchiterator->second.size(); i++ )
+    {
+        const float *VertexPos = batchiterator->second[i].Pos;
+        if( VectorMag( Vector3( VertexPos[0], VertexPos[1], VertexPos[2] ) - Pos ) < 0.001f )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//! returns a frustum that's the box from Min to Max
+VIEWFRUSTUM MakeBoxFrustum( const Vector3 &Min, const Vector3 &Max )
+{
+    VIEWFRUSTUM Frustum;
+    Frustum.Normals[0] = Vector3( 1, 0, 0 );
+    Frustum.Distances[0] = -Min.x;
+    Frustum.Normals[1] = Vector3( -1, 0, 0 );
+    Frustum.Distances[1] = Max.x;
+    Frustum.Normals[2] = Vector3( 0, 1, 0 );
+    Frustum.Distances[2] = -Min.y;
+    Frustum.Normals[3] = Vector3( 0, -1, 0 );
+    Frustum.Distances[3] = Max.y;
+    Frustum.Normals[4] = Vector3( 0, 0, 1 );
+    Frustum.Distances[4] = -Min.z;
+    Frustum.Normals[5] = Vector3( 0, 0, -1 );
+    Frustum.Distances[5] = Max.z;
+    return Frustum;
+}
+
+void TestBatching()
+{
+    TextureInfoCache Textures;
+    Textures.Textures[ sTextureA ].iTextureID = iTextureIDA;
+    Textures.Textures[ sTextureB ].iTextureID = iTextureIDB;
+    Object::ptextureinfocache = &Textures;
+
+    mvWorldStorage *pWorld = new mvWorldStorage;
+    MockGraphics Graphics;
+    StaticBatchesClass *pStaticBatches = new StaticBatchesClass( Graphics, iStaticDelay, fCellSize );
+
+    const Color Red( 1, 0, 0 );
+    const Color Green( 0, 1, 0 );
+    AddPrim( *pWorld, new Cube, 1, Vector3( 2, 2, 2 ), sTextureA, Red );
+    AddPrim( *pWorld, new Cube, 2, Vector3( 6, 2, 2 ), sTextureA, Green );
+    AddPrim( *pWorld, new Cube, 3, Vector3( 2, 10, 2 ), sTextureB, Red );   // another texture
+    AddPrim( *pWorld, new Sphere, 4, Vector3( 2, 2, 20 ), sTextureA, Red );   // another prim type
+    AddPrim( *pWorld, new Cube, 5, Vector3( 100, 2, 2 ), sTextureA, Red );   // another cell
+    Cube *pChild = new Cube;
+    AddPrim( *pWorld, pChild, 6, Vector3( 2, 2, 2 ), sTextureA, Red );
+    pChild->iParentReference = 1;   // drawn by its grouping, so never batched
+
+    // nothing is batched until it's been still for the delay
+    pStaticBatches->Update( *pWorld, 0 );
+    pStaticBatches->Update( *pWorld, iStaticDelay - 1 );
+    CHECK( pStaticBatches->GetNumBatches() == 0 );
+    CHECK( Graphics.iNumCreates == 0 );
+    CHECK( !pStaticBatches->IsBatched( 1 ) );
+
+    pStaticBatches->Update( *pWorld, iStaticDelay );
+    CHECK( pStaticBatches->GetNumBatches() == 4 );
+    CHECK( pStaticBatches->GetNumBatchedPrims() == 5 );
+    CHECK( pStaticBatches->GetNumRebuilds() == 4 );
+    CHECK( Graphics.Batches.size() == 4 );
+    for( int iReference = 1; iReference <= 5; iReference++ )
+    {
+        CHECK( pStaticBatches->IsBatched( iReference ) );
+    }
+    CHECK( !pStaticBatches->IsBatched( 6 ) );
+
+    // cubes 1 and 2 share a batch, with each corner where the cube is, and each cube's color
+    int iBatch12 = FindBatch( Graphics, Vector3( 4, 2, 2 ), 3.0f );
+    CHECK( iBatch12 != -1 );
+    CHECK( GetBatch( Graphics, iBatch12 ).size() == 2 * iVerticesPerCube );
+    CHECK( BatchHasVertexAt( Graphics, iBatch12, Vector3( 1.5f, 1.5f, 1.5f ) ) );
+    CHECK( BatchHasVertexAt( Graphics, iBatch12, Vector3( 6.5f, 2.5f, 2.5f ) ) );
+    int iNumRed = 0;
+    int iNumGreen = 0;
+    for( int i = 0; i < (int)GetBatch( Graphics, iBatch12 ).size(); i++ )
+    {
+        const BATCHVERTEX &Vertex = GetBatch( Graphics, iBatch12 )[i];
+        if( Vertex.Color[0] == 1 && Vertex.Color[1] == 0 && Vertex.Pos[0] < 4 )
+        {
+            iNumRed++;
+        }
+        if( Vertex.Color[1] == 1 && Vertex.Color[0] == 0 && Vertex.Pos[0] > 4 )
+        {
+            iNumGreen++;
+        }
+    }
+    CHECK( iNumRed == iVerticesPerCube && iNumGreen == iVerticesPerCube );
+
+    int iBatch3 = FindBatch( Graphics, Vector3( 2, 10, 2 ), 1.0f );
+    int iBatch4 = FindBatch( Graphics, Vector3( 2, 2, 20 ), 1.0f );
+    int iBatch5 = FindBatch( Graphics, Vector3( 100, 2, 2 ), 1.0f );
+    CHECK( iBatch3 != -1 && GetBatch( Graphics, iBatch3 ).size() == iVerticesPerCube );
+    CHECK( iBatch4 != -1 && GetBatch( Graphics, iBatch4 ).size() > iVerticesPerCube );
+    CHECK( iBatch5 != -1 && GetBatch( Graphics, iBatch5 ).size() == iVerticesPerCube );
+
+    // each batch is drawn with its texture; the one in the far cell is culled when it's out of view
+    pStaticBatches->Draw( MakeBoxFrustum( Vector3( -200, -200, -200 ), Vector3( 200, 200, 200 ) ) );
+    CHECK( pStaticBatches->GetNumBatchesDrawn() == 4 );
+    CHECK( Graphics.DrawnHandles.size() == 4 );
+    for( int i = 0; i < (int)Graphics.DrawnHandles.size(); i++ )
+    {
+        int iExpectedTextureID = Graphics.DrawnHandles[i] == iBatch3 ? iTextureIDB : iTextureIDA;
+        CHECK( Graphics.DrawnTextureIDs[i] == iExpectedTextureID );
+    }
+    Graphics.DrawnHandles.clear();
+    Graphics.DrawnTextureIDs.clear();
+    pStaticBatches->Draw( MakeBoxFrustum( Vector3( -10, -10, -10 ), Vector3( 40, 40, 40 ) ) );
+    CHECK( pStaticBatches->GetNumBatchesDrawn() == 3 );
+    CHECK( find( Graphics.DrawnHandles.begin(), Graphics.DrawnHandles.end(), iBatch5 ) == Graphics.DrawnHandles.end() );
+
+    // nothing changed, nothing rebuilt
+    pStaticBatches->Update( *pWorld, iStaticDelay + 100 );
+    CHECK( pStaticBatches->GetNumRebuilds() == 0 );
+    CHECK( Graphics.iNumCreates == 4 && Graphics.iNumDeletes == 0 );
+
+    // cube 2 moves: it leaves its batch, which is the only one rebuilt, with just cube 1
+    int iMoveTickCount = iStaticDelay + 200;
+    pWorld->GetObjectByReference( 2 )->pos = Vector3( 6, 6, 2 );
+    pStaticBatches->Update( *pWorld, iMoveTickCount );
+    CHECK( !pStaticBatches->IsBatched( 2 ) );
+    CHECK( pStaticBatches->IsBatched( 1 ) );
+    CHECK( pStaticBatches->GetNumBatchedPrims() == 4 );
+    CHECK( pStaticBatches->GetNumRebuilds() == 1 );
+    CHECK( Graphics.iNumCreates == 5 && Graphics.iNumDeletes == 1 );
+    CHECK( Graphics.Batches.find( iBatch12 ) == Graphics.Batches.end() );
+    int iBatch1 = FindBatch( Graphics, Vector3( 2, 2, 2 ), 1.0f );
+    CHECK( iBatch1 != -1 && GetBatch( Graphics, iBatch1 ).size() == iVerticesPerCube );
+    CHECK( Graphics.Batches.find( iBatch3 ) != Graphics.Batches.end() );
+    CHECK( Graphics.Batches.find( iBatch5 ) != Graphics.Batches.end() );
+
+    // still again for the delay, it rejoins the batch where it is now
+    pStaticBatches->Update( *pWorld, iMoveTickCount + iStaticDelay - 1 );
+    CHECK( !pStaticBatches->IsBatched( 2 ) );
+    CHECK( pStaticBatches->GetNumRebuilds() == 0 );
+    pStaticBatches->Update( *pWorld, iMoveTickCount + iStaticDelay );
+    CHECK( pStaticBatches->IsBatched( 2 ) );
+    CHECK( pStaticBatches->GetNumRebuilds() == 1 );
+    iBatch12 = FindBatch( Graphics, Vector3( 4, 4, 2 ), 4.0f );
+    CHECK( iBatch12 != -1 && GetBatch( Graphics, iBatch12 ).size() == 2 * iVerticesPerCube );
+    CHECK( BatchHasVertexAt( Graphics, iBatch12, Vector3( 6.5f, 6.5f, 2.5f ) ) );
+    CHECK( !BatchHasVertexAt( Graphics, iBatch12, Vector3( 6.5f, 2.5f, 2.5f ) ) );
+
+    // cube 5 moves into the first cell: its own batch goes, and it joins cubes 1 and 2 once still
+    int iCellMoveTickCount = iMoveTickCount + 2 * iStaticDelay;
+    pWorld->GetObjectByReference( 5 )->pos = Vector3( 10, 2, 2 );
+    pStaticBatches->Update( *pWorld, iCellMoveTickCount );
+    CHECK( pStaticBatches->GetNumBatches() == 3 );
+    CHECK( Graphics.Batches.find( iBatch5 ) == Graphics.Batches.end() );
+    pStaticBatches->Update( *pWorld, iCellMoveTickCount + iStaticDelay );
+    CHECK( pStaticBatches->IsBatched( 5 ) );
+    CHECK( pStaticBatches->GetNumBatches() == 3 );
+    iBatch12 = FindBatch( Graphics, Vector3( 6, 4, 2 ), 6.0f );
+    CHECK( iBatch12 != -1 && GetBatch( Graphics, iBatch12 ).size() == 3 * iVerticesPerCube );
+
+    // a deleted prim's batch goes with it
+    pWorld->DeleteObject( pWorld->GetArrayNumForObjectReference( 3 ) );
+    pStaticBatches->Update( *pWorld, iCellMoveTickCount + iStaticDelay + 100 );
+    CHECK( !pStaticBatches->IsBatched( 3 ) );
+    CHECK( pStaticBatches->GetNumBatches() == 2 );
+    CHECK( Graphics.Batches.find( iBatch3 ) == Graphics.Batches.end() );
+
+    // every batch created is given back
+    pStaticBatches->Clear();
+    CHECK( Graphics.Batches.size() == 0 );
+    CHECK( Graphics.iNumCreates == Graphics.iNumDeletes );
+    CHECK( Graphics.iNumBadHandles == 0 );
+
+    delete pStaticBatches;
+    pWorld->Clear();
+    delete pWorld;
+    Object::ptextureinfocache = NULL;
+}
+
+int main( int argc, char *argv[] )
+{
+#ifndef _NOLOGGINGLIB
+    CMessageGroup::disableAllMsgGroups();   // a debug line per prim would drown the results
+#endif
+
+    TestBatching();
+
+    return ReportChecks();
+}
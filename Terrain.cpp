@@ -19,7 +19,7 @@
 //
 
 //! \file
-//! \brief A terrain is a height-mapped prim based on a 128x128 .raw file
+//! \brief A terrain is a height-mapped prim based on a square .raw file
 // For documentation see header file mvobjectstorage.h
 
 #ifndef TIXML_USE_STL
@@ -50,51 +50,28 @@ using namespace std;
 #include "TextureInfoCache.h"
 #include "TerrainInfoCache.h"
 
+// Description: slopes are measured over iNormalSpan cells either side, or up to the edge of the map, which
+//              smooths out the steps between byte heights; each normal is in the terrain's coordinates,
+//              where the map is 1 across and 256 heights high, before Scalef
 void Terrain::CalculateNormals()
 {
-    for ( int X = 2; X < (iMapSize - 3); X += 1 )
+    const int iNormalSpan = 5;
+    VectorNormals.resize( iMapSize * iMapSize );
+    for ( int X = 0; X < iMapSize; X += 1 )
     {
-        // DEBUG(  "X " << X ); // DEBUG
-        for ( int Y = 2; Y < (iMapSize - 3); Y += 1 )
+        int XMinus = X - iNormalSpan < 0 ? 0 : X - iNormalSpan;
+        int XPlus = X + iNormalSpan > iMapSize - 1 ? iMapSize - 1 : X + iNormalSpan;
+        for ( int Y = 0; Y < iMapSize; Y += 1 )
         {
-            Vector3 Normal;
-            //   DEBUG(  X << " " << Y ); // DEBUG
+            int YMinus = Y - iNormalSpan < 0 ? 0 : Y - iNormalSpan;
+            int YPlus = Y + iNormalSpan > iMapSize - 1 ? iMapSize - 1 : Y + iNormalSpan;
 
-            if( X > 5 && X < iMapSize - 5 )
-            {
-                Normal.x = ( Height( X + 5, Y ) - Height( X - 5, Y ) ) / 10.0f / 2.0f;
-            }
-            else if( X < iMapSize - 5 )
-            {
-                Normal.x = ( Height( X + 5, Y ) - Height( X, Y ) ) / 5.0f / 2.0f;
-            }
-            else
-            {
-                Normal.x = ( Height( X, Y ) - Height( X - 5, Y ) ) / 5.0f / 2.0f;
-            }
-            //   DEBUG(  "done x " << Normal.x ); // DEBUG
-
-            if( Y > 5 && Y < iMapSize - 5 )
-            {
-                Normal.y = ( Height( X, Y + 5 ) - Height( X, Y - 5 ) ) / 10.0f / 2.0f;
-            }
-            else if( Y < iMapSize - 5 )
-            {
-                Normal.y = ( Height( X, Y + 5 ) - Height( X, Y ) ) / 5.0f / 2.0f;
-            }
-            else
-            {
-                Normal.y = ( Height( X, Y ) - Height( X, Y - 5 ) ) / 5.0f / 2.0f;
-            }
+            float fSlopeX = (float)( Height( XPlus, Y ) - Height( XMinus, Y ) ) / (float)( XPlus - XMinus ) * (float)iMapSize / 256.0f;
+            float fSlopeY = (float)( Height( X, YPlus ) - Height( X, YMinus ) ) / (float)( YPlus - YMinus ) * (float)iMapSize / 256.0f;
 
-            //  DEBUG(  "done y " << Normal.y ); // DEBUG
-            Normal.z = 1;
-
-            //  DEBUG(  "assigning to VectorNormals..." ); // DEBUG
-            VectorNormals[ X + Y * iMapSize ].x = Normal.x;
-            VectorNormals[ X + Y * iMapSize ].y = Normal.y;
-            VectorNormals[ X + Y * iMapSize ].z = Normal.z;
-            //   DEBUG(  "...done" ); // DEBUG
+            Vector3 Normal( - fSlopeX, - fSlopeY, 1 );
+            float fScale = 1.0f / (float)sqrt( Normal.x * Normal.x + Normal.y * Normal.y + 1.0f );
+            VectorNormals[ X + Y * iMapSize ] = Vector3( Normal.x * fScale, Normal.y * fScale, fScale );
         }
     }
 }
@@ -112,7 +89,21 @@ bool Terrain::LoadTerrainFile( const char *sFilePath )
         return false;
     }
 
-    fread( g_HeightMap, 1, iMapSize * iMapSize, pFile );
+    // the map is square, so its size is the square root of the file's
+    fseek( pFile, 0, SEEK_END );
+    long iFileSize = ftell( pFile );
+    fseek( pFile, 0, SEEK_SET );
+    int iNewMapSize = (int)( sqrt( (double)iFileSize ) + 0.5 );
+    if( iNewMapSize < 2 || (long)iNewMapSize * (long)iNewMapSize != iFileSize )
+    {
+        DEBUG(  "Height map file " << sFilePath << " isnt square: " << iFileSize << " bytes" ); // DEBUG
+        fclose(pFile);
+        return false;
+    }
+    iMapSize = iNewMapSize;
+    g_HeightMap.resize( iMapSize * iMapSize );
+
+    fread( &g_HeightMap[0], 1, iMapSize * iMapSize, pFile );
 
     // Check If We Received An Error
     int result = ferror( pFile );
@@ -129,6 +120,7 @@ bool Terrain::LoadTerrainFile( const char *sFilePath )
     DEBUG(  "LoadRawFile() done" ); // DEBUG
 
     CalculateNormals();
+    Mesh.Build( &g_HeightMap[0], &VectorNormals[0], iMapSize );
 
     bTerrainLoaded = true;
     return true;
@@ -140,7 +132,7 @@ int Terrain::Height( const int X, const int Y) const    // This Returns The Heig
     int x = X % iMapSize;        // Error Check Our x Value
     int y = Y % iMapSize;        // Error Check Our y Value
 
-    if(!g_HeightMap)
+    if( g_HeightMap.size() == 0 )
         return 0;       // Make Sure Our Data Is Valid
 
     return g_HeightMap[x + (y * iMapSize)];    // Index Into Our Height Array And Return The Height
@@ -324,6 +316,25 @@ void Terrain::WriteToXMLDoc( TiXmlElement *pElement )
     pElement->FirstChildElement("faces")->FirstChildElement("face")->FirstChildElement("skybox")->SetAttribute("stexturereference", sSkyboxReference );
     Prim::WriteToXMLDoc( pElement );
 }
+void Terrain::WriteXMLAttributes( XmlWriter &Writer )
+{
+    Writer.Attribute( "type", "TERRAIN" );
+    Prim::WriteXMLAttributes( Writer );
+}
+void Terrain::WriteXMLGeometry( XmlWriter &Writer )
+{
+    Prim::WriteXMLGeometry( Writer );
+    Writer.StartElement( "terrain" );
+    Writer.Attribute( "sterrainreference", sTerrainReference );
+    Writer.EndElement();
+}
+void Terrain::WriteXMLFace( XmlWriter &Writer )
+{
+    Prim::WriteXMLFace( Writer );
+    Writer.StartElement( "skybox" );
+    Writer.Attribute( "stexturereference", sSkyboxReference );
+    Writer.EndElement();
+}
 const Terrain &Terrain::operator=( const Terrain &IncomingPrim )
 {
     this->color0 = IncomingPrim.color0;
@@ -398,7 +409,7 @@ void Terrain::Draw()
 
     pmvGraphics->Bind2DTexture( iTextureID );
     //DEBUG(  "Drawing terrain..." ); // DEBUG
-    pmvGraphics->RenderTerrain( g_HeightMap, iMapSize );
+    Mesh.Draw( *pmvGraphics, scale );
     // DEBUG(  "Terrain drawn" ); // DEBUG
     pmvGraphics->Bind2DTexture( 0 );
 
@@ -19,18 +19,19 @@
 //
 
 //! \file
-//! \brief A terrain is a height-mapped prim based on a 128x128 .raw file
+//! \brief A terrain is a height-mapped prim based on a square .raw file
 
 #ifndef _MVTerrain_H
 #define _MVTerrain_H
 
 #include "Object.h"
 #include "Prim.h"
+#include "TerrainMesh.h"
 
-//! A terrain is a height-mapped prim based on a 128x128 .raw file
+//! A terrain is a height-mapped prim based on a square .raw file
 
 //! A terrain is a special type of prim.
-//! It is a height-mapped prim based on a 128x128 .raw file
+//! It is a height-mapped prim based on a square .raw file, one byte per height, 128x128 by default
 
 // For documentaiton on member functions, see doucmentaiton of Object class
 class Terrain : public Prim
@@ -49,15 +50,18 @@ public:
    
   // bool bTerrainListInitialized;
    
-   static const int iMapSize = 128;  //!< size of terrain map; always 128
-   unsigned char g_HeightMap[ iMapSize * iMapSize ];  //!< Heightmap data
-   Vector3 VectorNormals[ iMapSize * iMapSize ];  //!< normals data
+   int iMapSize;  //!< size of terrain map along each side; set from the size of the file loaded
+   vector< unsigned char > g_HeightMap;  //!< Heightmap data
+   vector< Vector3 > VectorNormals;  //!< normals data, unit length, in the terrain's coordinates before scaling
+   TerrainMeshClass Mesh;  //!< chunks drawn from g_HeightMap, built when it's loaded
 
    Terrain()
    {  
    	   DEBUG( "mvTerrain Terrain::Terrain()" );
    	   sprintf( ObjectType, "PRIM" );
    	   sprintf( sDeepObjectType, "TERRAIN" );
+   	   TypeTag = OBJECTTYPE_PRIM;
+   	   DeepTypeTag = DEEPTYPE_TERRAIN;
    	   sprintf( PrimType, "TERRAIN" );
    	   color0.r = 0.8;
    	   color0.g = 0.2;
@@ -68,6 +72,7 @@ public:
    	   //iOurTerrainListNumber = 0;
    	   bTerrainEnabled = true;
    	   bTerrainLoaded = false;
+   	   iMapSize = 128;
    	   //bTerrainListInitialized = false;
   }
    static void GetCreateSQLFromXMLEx( TiXmlElement *pElement, char *SQL );
@@ -77,6 +82,9 @@ public:
    virtual void UpdateFromXML( TiXmlElement *pElement );
    void LoadFromXML( TiXmlElement *pElement );
    virtual void WriteToXMLDoc( TiXmlElement *pElement );
+   virtual void WriteXMLAttributes( XmlWriter &Writer );
+   virtual void WriteXMLGeometry( XmlWriter &Writer );
+   virtual void WriteXMLFace( XmlWriter &Writer );
    //virtual void CopyTo( Terrain *ptargetterrain );
    const Terrain &Terrain::operator=( const Terrain &IncomingPrim );
    virtual void Draw();
@@ -89,12 +97,10 @@ public:
    virtual const char *GetTexture( int face );
    virtual const char *GetSkybox( );
 
-   bool LoadTerrainFile( const char *sFilePath );   //!< loads a 128x128 8-bit raw file as the terrain data
+   bool LoadTerrainFile( const char *sFilePath );   //!< loads a square 8-bit raw file as the terrain data
    void CalculateNormals();  //!< calculates normals to terrain
       
-   void RenderTerrain();          //!< renders terrain to opengl
    virtual int Height( const int X, const int Y) const;    //!< gets the height of a piece of terrain at position X,Y
-   void RenderHeightMap();         //!< called by RenderTerrain
 protected:
 };
 
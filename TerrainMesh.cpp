@@ -0,0 +1,306 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Terrain heightmap as chunks of triangles, drawn at less detail further away
+//!
+//! The heightmap used to be sent to OpenGL a quad at a time, every frame.  Build now turns it into
+//! CHUNK_CELLS x CHUNK_CELLS cell chunks once, when the heightmap is loaded: each chunk keeps its vertices,
+//! in the terrain's own coordinates (-0.5 to 0.5 across, heights 0 to 255 from -0.5 up), with the
+//! normals Terrain::CalculateNormals worked out, and its bounding box.
+//!
+//! Each chunk can be drawn at NUM_LEVELS levels of detail: level 0 uses every vertex, level 1 every
+//! second one along each side, and so on.  Draw picks a level for each chunk from how far its center is
+//! from the eye, then raises the detail of chunks next to much more detailed ones, so neighbours are
+//! never more than one level apart.  Where a chunk meets a coarser neighbour, the vertices along that edge
+//! which the neighbour doesnt have are folded onto the ones it does, so the two edges match and there
+//! are no cracks.  Chunks outside the view frustum arent drawn at all.
+//!
+//! The triangle indices for each level and each combination of stitched edges are the same for every
+//! chunk of every terrain, so they're made once, the first time they're needed.
+//!
+//! Drawing goes through mvGraphicsInterface::DrawIndexedTriangles, so a mock mvGraphicsInterface can
+//! check the levels, stitching and culling without OpenGL.
+
+#include "TerrainMesh.h"
+
+#include <math.h>
+
+//! triangle indices for each level of detail and each combination of stitched edges, built the first time they're needed
+static vector< unsigned short > ChunkIndices[ TerrainMeshClass::NUM_LEVELS ][ 16 ];
+
+// edges of a chunk, as bits of the stitch mask
+const int STITCH_MINUSX = 1;
+const int STITCH_PLUSX = 2;
+const int STITCH_MINUSY = 4;
+const int STITCH_PLUSY = 8;
+
+const int iChunkVerticesAcross = TerrainMeshClass::CHUNK_CELLS + 1;
+
+// Input: i, j: vertex within the chunk; iStep: spacing of vertices at this level; iStitchEdges: edges to stitch
+// Returns: index of the vertex to use in its place
+// Description: a vertex on a stitched edge that the next level down doesnt have is moved back to the one before it
+static unsigned short StitchedIndex( int i, int j, int iStep, int iStitchEdges )
+{
+    if( ( ( iStitchEdges & STITCH_MINUSX ) && i == 0 ) || ( ( iStitchEdges & STITCH_PLUSX ) && i == TerrainMeshClass::CHUNK_CELLS ) )
+    {
+        if( ( j / iStep ) % 2 == 1 )
+        {
+            j -= iStep;
+        }
+    }
+    if( ( ( iStitchEdges & STITCH_MINUSY ) && j == 0 ) || ( ( iStitchEdges & STITCH_PLUSY ) && j == TerrainMeshClass::CHUNK_CELLS ) )
+    {
+        if( ( i / iStep ) % 2 == 1 )
+        {
+            i -= iStep;
+        }
+    }
+    return (unsigned short)( j * iChunkVerticesAcross + i );
+}
+
+// Description: adds triangle a, b, c, unless stitching has folded two of its corners together
+static void AddTriangle( vector< unsigned short > &Indices, unsigned short a, unsigned short b, unsigned short c )
+{
+    if( a == b || b == c || c == a )
+    {
+        return;
+    }
+    Indices.push_back( a );
+    Indices.push_back( b );
+    Indices.push_back( c );
+}
+
+static const vector< unsigned short > &GetIndices( int iLevel, int iStitchEdges )
+{
+    vector< unsigned short > &Indices = ChunkIndices[ iLevel ][ iStitchEdges ];
+    if( Indices.size() == 0 )
+    {
+        int iStep = 1 << iLevel;
+        for( int j = 0; j < TerrainMeshClass::CHUNK_CELLS; j += iStep )
+        {
+            for( int i = 0; i < TerrainMeshClass::CHUNK_CELLS; i += iStep )
+            {
+                // anticlockwise seen from above, like the quads Graphics.cpp used to draw
+                unsigned short a = StitchedIndex( i, j, iStep, iStitchEdges );
+                unsigned short b = StitchedIndex( i + iStep, j, iStep, iStitchEdges );
+                unsigned short c = StitchedIndex( i + iStep, j + iStep, iStep, iStitchEdges );
+                unsigned short d = StitchedIndex( i, j + iStep, iStep, iStitchEdges );
+                AddTriangle( Indices, a, b, c );
+                AddTriangle( Indices, a, c, d );
+            }
+        }
+    }
+    return Indices;
+}
+
+TerrainMeshClass::TerrainMeshClass( float fNewDetailChunks )
+{
+    fDetailChunks = fNewDetailChunks;
+    iMapSize = 0;
+    iChunksAcross = 0;
+    iNumChunksDrawn = 0;
+    iNumTrianglesDrawn = 0;
+}
+
+void TerrainMeshClass::Clear()
+{
+    Chunks.clear();
+    iMapSize = 0;
+    iChunksAcross = 0;
+}
+
+// Input: pHeightMap: iMapSize x iMapSize heights, a row of x at a time; pNormals: normal at each height, in terrain coordinates
+// Description: the last chunk along each side is padded out with copies of the edge of the map, if the map isnt
+//              a whole number of chunks across
+void TerrainMeshClass::Build( const unsigned char *pHeightMap, const Vector3 *pNormals, int iNewMapSize )
+{
+    Clear();
+    if( iNewMapSize < 2 )
+    {
+        return;
+    }
+    iMapSize = iNewMapSize;
+    iChunksAcross = ( iMapSize - 1 + CHUNK_CELLS - 1 ) / CHUNK_CELLS;
+    Chunks.resize( iChunksAcross * iChunksAcross );
+
+    for( int iChunkY = 0; iChunkY < iChunksAcross; iChunkY++ )
+    {
+        for( int iChunkX = 0; iChunkX < iChunksAcross; iChunkX++ )
+        {
+            TERRAINCHUNK &Chunk = Chunks[ iChunkY * iChunksAcross + iChunkX ];
+            Chunk.iLevel = 0;
+            Chunk.Vertices.resize( iChunkVerticesAcross * iChunkVerticesAcross );
+            for( int j = 0; j < iChunkVerticesAcross; j++ )
+            {
+                int Y = iChunkY * CHUNK_CELLS + j;
+                if( Y > iMapSize - 1 )
+                {
+                    Y = iMapSize - 1;
+                }
+                for( int i = 0; i < iChunkVerticesAcross; i++ )
+                {
+                    int X = iChunkX * CHUNK_CELLS + i;
+                    if( X > iMapSize - 1 )
+                    {
+                        X = iMapSize - 1;
+                    }
+                    BATCHVERTEX &Vertex = Chunk.Vertices[ j * iChunkVerticesAcross + i ];
+                    Vertex.Pos[0] = (float)X / (float)iMapSize - 0.5f;
+                    Vertex.Pos[1] = (float)Y / (float)iMapSize - 0.5f;
+                    Vertex.Pos[2] = (float)pHeightMap[ X + Y * iMapSize ] / 256.0f - 0.5f;
+                    const Vector3 &Normal = pNormals[ X + Y * iMapSize ];
+                    Vertex.Normal[0] = Normal.x;
+                    Vertex.Normal[1] = Normal.y;
+                    Vertex.Normal[2] = Normal.z;
+                    Vertex.TexCoord[0] = (float)X / (float)iMapSize;
+                    Vertex.TexCoord[1] = (float)Y / (float)iMapSize;
+                    Vertex.Color[0] = 1;
+                    Vertex.Color[1] = 1;
+                    Vertex.Color[2] = 1;
+
+                    Vector3 Pos( Vertex.Pos[0], Vertex.Pos[1], Vertex.Pos[2] );
+                    if( i == 0 && j == 0 )
+                    {
+                        Chunk.Min = Pos;
+                        Chunk.Max = Pos;
+                    }
+                    if( Pos.x < Chunk.Min.x ) Chunk.Min.x = Pos.x;
+                    if( Pos.y < Chunk.Min.y ) Chunk.Min.y = Pos.y;
+                    if( Pos.z < Chunk.Min.z ) Chunk.Min.z = Pos.z;
+                    if( Pos.x > Chunk.Max.x ) Chunk.Max.x = Pos.x;
+                    if( Pos.y > Chunk.Max.y ) Chunk.Max.y = Pos.y;
+                    if( Pos.z > Chunk.Max.z ) Chunk.Max.z = Pos.z;
+                }
+            }
+        }
+    }
+}
+
+// Input: EyePos: the eye, in terrain coordinates; Scale: size of the terrain in the world
+// Description: each chunk gets the level its distance from the eye, in the world, calls for; then chunks more
+//              than one level coarser than a neighbour are made more detailed until none are
+void TerrainMeshClass::ChooseLevels( const Vector3 &EyePos, const Vector3 &Scale )
+{
+    float fChunkWidth = (float)CHUNK_CELLS / (float)iMapSize * ( fabs( Scale.x ) > fabs( Scale.y ) ? (float)fabs( Scale.x ) : (float)fabs( Scale.y ) );
+    float fDetailDistance = fDetailChunks * fChunkWidth;
+    for( int iChunk = 0; iChunk < (int)Chunks.size(); iChunk++ )
+    {
+        TERRAINCHUNK &Chunk = Chunks[ iChunk ];
+        float dx = ( ( Chunk.Min.x + Chunk.Max.x ) * 0.5f - EyePos.x ) * Scale.x;
+        float dy = ( ( Chunk.Min.y + Chunk.Max.y ) * 0.5f - EyePos.y ) * Scale.y;
+        float dz = ( ( Chunk.Min.z + Chunk.Max.z ) * 0.5f - EyePos.z ) * Scale.z;
+        float fDistance = (float)sqrt( dx * dx + dy * dy + dz * dz );
+
+        Chunk.iLevel = 0;
+        float fLevelDistance = fDetailDistance;
+        while( fDistance > fLevelDistance && Chunk.iLevel < NUM_LEVELS - 1 )
+        {
+            Chunk.iLevel++;
+            fLevelDistance *= 2;
+        }
+    }
+
+    bool bChanged = true;
+    while( bChanged )
+    {
+        bChanged = false;
+        for( int iChunkY = 0; iChunkY < iChunksAcross; iChunkY++ )
+        {
+            for( int iChunkX = 0; iChunkX < iChunksAcross; iChunkX++ )
+            {
+                int &iLevel = Chunks[ iChunkY * iChunksAcross + iChunkX ].iLevel;
+                int Neighbours[4][2] = { { iChunkX - 1, iChunkY }, { iChunkX + 1, iChunkY }, { iChunkX, iChunkY - 1 }, { iChunkX, iChunkY + 1 } };
+                for( int iNeighbour = 0; iNeighbour < 4; iNeighbour++ )
+                {
+                    int iNeighbourX = Neighbours[ iNeighbour ][0];
+                    int iNeighbourY = Neighbours[ iNeighbour ][1];
+                    if( iNeighbourX < 0 || iNeighbourX >= iChunksAcross || iNeighbourY < 0 || iNeighbourY >= iChunksAcross )
+                    {
+                        continue;
+                    }
+                    int iNeighbourLevel = Chunks[ iNeighbourY * iChunksAcross + iNeighbourX ].iLevel;
+                    if( iLevel > iNeighbourLevel + 1 )
+                    {
+                        iLevel = iNeighbourLevel + 1;
+                        bChanged = true;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Returns: the edges of the chunk whose neighbours are drawn at less detail than it
+int TerrainMeshClass::GetStitchEdges( int iChunkX, int iChunkY ) const
+{
+    int iLevel = Chunks[ iChunkY * iChunksAcross + iChunkX ].iLevel;
+    int iStitchEdges = 0;
+    if( iChunkX > 0 && Chunks[ iChunkY * iChunksAcross + iChunkX - 1 ].iLevel > iLevel )
+    {
+        iStitchEdges |= STITCH_MINUSX;
+    }
+    if( iChunkX < iChunksAcross - 1 && Chunks[ iChunkY * iChunksAcross + iChunkX + 1 ].iLevel > iLevel )
+    {
+        iStitchEdges |= STITCH_PLUSX;
+    }
+    if( iChunkY > 0 && Chunks[ ( iChunkY - 1 ) * iChunksAcross + iChunkX ].iLevel > iLevel )
+    {
+        iStitchEdges |= STITCH_MINUSY;
+    }
+    if( iChunkY < iChunksAcross - 1 && Chunks[ ( iChunkY + 1 ) * iChunksAcross + iChunkX ].iLevel > iLevel )
+    {
+        iStitchEdges |= STITCH_PLUSY;
+    }
+    return iStitchEdges;
+}
+
+void TerrainMeshClass::Draw( mvGraphicsInterface &Graphics, const Vector3 &Scale )
+{
+    iNumChunksDrawn = 0;
+    iNumTrianglesDrawn = 0;
+    if( Chunks.size() == 0 )
+    {
+        return;
+    }
+
+    // both in terrain coordinates, since the terrain's transform is already applied
+    Vector3 EyePos;
+    Graphics.GetEyePosition( EyePos );
+    VIEWFRUSTUM Frustum;
+    Graphics.GetViewFrustum( Frustum );
+
+    ChooseLevels( EyePos, Scale );
+
+    for( int iChunkY = 0; iChunkY < iChunksAcross; iChunkY++ )
+    {
+        for( int iChunkX = 0; iChunkX < iChunksAcross; iChunkX++ )
+        {
+            const TERRAINCHUNK &Chunk = Chunks[ iChunkY * iChunksAcross + iChunkX ];
+            if( !BoxInFrustum( Frustum, Chunk.Min, Chunk.Max ) )
+            {
+                continue;
+            }
+            const vector< unsigned short > &Indices = GetIndices( Chunk.iLevel, GetStitchEdges( iChunkX, iChunkY ) );
+            Graphics.DrawIndexedTriangles( &Chunk.Vertices[0], &Indices[0], (int)Indices.size() );
+            iNumChunksDrawn++;
+            iNumTrianglesDrawn += (int)Indices.size() / 3;
+        }
+    }
+}
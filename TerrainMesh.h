@@ -0,0 +1,77 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief Terrain heightmap as chunks of triangles, drawn at less detail further away
+
+// see TerrainMesh.cpp for documentation
+
+#ifndef _TERRAINMESH_H
+#define _TERRAINMESH_H
+
+#include <vector>
+using namespace std;
+
+#include "Math.h"
+#include "GraphicsInterface.h"
+
+//! One square chunk of a terrain
+struct TERRAINCHUNK
+{
+   vector< BATCHVERTEX > Vertices;   //!< every vertex of the chunk at full detail, ( CHUNK_CELLS + 1 ) squared, a row of x at a time
+   Vector3 Min;   //!< bounding box, in terrain coordinates
+   Vector3 Max;
+   int iLevel;   //!< level of detail the last Draw chose: 0 is full detail, each level up is half as many vertices along each side
+};
+
+//! TerrainMeshClass holds a terrain heightmap as chunks of triangles, drawn at less detail further away
+
+//! TerrainMeshClass holds a terrain heightmap as chunks of triangles, drawn at less detail further away
+//! Build it once each time the heightmap is loaded, then call Draw each frame with the terrain's transform applied.
+//! Only this class's own bookkeeping is done here; drawing goes through mvGraphicsInterface, so it runs without OpenGL
+class TerrainMeshClass
+{
+public:
+   enum { CHUNK_CELLS = 32, NUM_LEVELS = 4 };
+
+   TerrainMeshClass( float fDetailChunks = 3.0f );
+
+   void Build( const unsigned char *pHeightMap, const Vector3 *pNormals, int iMapSize );   //!< makes the chunks from an iMapSize x iMapSize heightmap, and its normals
+   void Clear();   //!< drops the chunks
+   bool IsBuilt() const { return Chunks.size() > 0; }
+   void Draw( mvGraphicsInterface &Graphics, const Vector3 &Scale );   //!< draws the chunks in the view, with the terrain's transform already applied; Scale is the scale in that transform
+
+   int GetNumChunks() const { return (int)Chunks.size(); }
+   int GetNumChunksDrawn() const { return iNumChunksDrawn; }   //!< by the last Draw, after culling
+   int GetNumTrianglesDrawn() const { return iNumTrianglesDrawn; }   //!< by the last Draw
+
+protected:
+   float fDetailChunks;   //!< chunks nearer the eye than this many chunk widths are drawn at full detail; each doubling of distance after that halves the detail
+   int iMapSize;
+   int iChunksAcross;
+   vector< TERRAINCHUNK > Chunks;   //!< a row of x at a time
+
+   int iNumChunksDrawn;
+   int iNumTrianglesDrawn;
+
+   void ChooseLevels( const Vector3 &EyePos, const Vector3 &Scale );
+   int GetStitchEdges( int iChunkX, int iChunkY ) const;
+};
+
+#endif // _TERRAINMESH_H
@@ -0,0 +1,54 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief CHECK macro and pass/fail counts shared by the headless test programs
+//!
+//! Each test program includes this once, CHECKs its conditions, and returns ReportChecks() from main.
+//! A failed CHECK prints its file, line and condition, and the test carries on.
+
+#ifndef _TESTCHECK_H
+#define _TESTCHECK_H
+
+#include <stdio.h>
+
+static int iNumChecks = 0;   //!< CHECKs made so far
+static int iNumFailures = 0;   //!< CHECKs failed so far
+
+#define CHECK( condition ) Check( ( condition ), #condition, __FILE__, __LINE__ )
+
+static void Check( bool bCondition, const char *sCondition, const char *sFile, int iLine )
+{
+    iNumChecks++;
+    if( !bCondition )
+    {
+        printf( "%s(%i): check failed: %s\n", sFile, iLine, sCondition );
+        iNumFailures++;
+    }
+}
+
+//! prints the number of checks made and failed; returns the test program's exit code, non-zero if any failed
+static int ReportChecks()
+{
+    printf( "%i checks, %i failed\n", iNumChecks, iNumFailures );
+    return iNumFailures == 0 ? 0 : 1;
+}
+
+#endif // _TESTCHECK_H
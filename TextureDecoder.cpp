@@ -0,0 +1,854 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Decodes texture files into pixel buffers, on a pool of background threads
+//!
+//! Decodes texture files into pixel buffers, on a pool of background threads
+//! see headerfile for documentation
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "Diag.h"
+#include "TextureDecoder.h"
+
+static const size_t iTGAHeaderSize = 18;
+static const size_t iPCXHeaderSize = 128;
+static const size_t iPCXPaletteSize = 769;   //!< 0x0C marker then 256 RGB entries, at the end of 8-bit PCX files
+
+static int ReadLittleEndianShort( const unsigned char *pData )
+{
+    return pData[0] | ( pData[1] << 8 );
+}
+
+//! Reverses the order of rTexture's rows, so top-first become bottom-first and vice versa
+static void FlipRows( DECODEDTEXTURE &rTexture )
+{
+    size_t iRowSize = rTexture.iWidth * rTexture.iChannels;
+    vector<unsigned char> Row( iRowSize );
+    for( int iTop = 0, iBottom = rTexture.iHeight - 1; iTop < iBottom; iTop++, iBottom-- )
+    {
+        unsigned char *pTop = &rTexture.Pixels[ iTop * iRowSize ];
+        unsigned char *pBottom = &rTexture.Pixels[ iBottom * iRowSize ];
+        memcpy( &Row[0], pTop, iRowSize );
+        memcpy( pTop, pBottom, iRowSize );
+        memcpy( pBottom, &Row[0], iRowSize );
+    }
+}
+
+// Input: pData, iLength: the TGA file
+//        rTexture: receives the pixels
+//
+// Returns: True if the file was a TGA we can decode
+//
+// Description: Decodes uncompressed and RLE truecolor (24 and 32 bit) and greyscale (8 bit)
+//  TGAs.  Colour-mapped TGAs aren't supported.  BGR(A) is swapped to RGB(A).
+//
+// Thread safety: Thread-safe
+bool DecodeTGA( const unsigned char *pData, size_t iLength, DECODEDTEXTURE &rTexture )
+{
+    if( iLength < iTGAHeaderSize )
+    {
+        return false;
+    }
+
+    int iImageType = pData[2];
+    bool bRLE = ( iImageType == 10 || iImageType == 11 );
+    bool bGreyscale = ( iImageType == 3 || iImageType == 11 );
+    if( iImageType != 2 && iImageType != 3 && iImageType != 10 && iImageType != 11 )
+    {
+        DEBUG( "Unsupported TGA image type " << iImageType );
+        return false;
+    }
+
+    int iWidth = ReadLittleEndianShort( pData + 12 );
+    int iHeight = ReadLittleEndianShort( pData + 14 );
+    int iBitsPerPixel = pData[16];
+    bool bTopOrigin = ( pData[17] & 0x20 ) != 0;
+    int iChannels = iBitsPerPixel / 8;
+    if( iWidth <= 0 || iHeight <= 0 ||
+            ( bGreyscale && iBitsPerPixel != 8 ) ||
+            ( !bGreyscale && iBitsPerPixel != 24 && iBitsPerPixel != 32 ) )
+    {
+        DEBUG( "Unsupported TGA " << iWidth << "x" << iHeight << " at " << iBitsPerPixel << " bits per pixel" );
+        return false;
+    }
+
+    // skip the image id and any colour map
+    size_t iOffset = iTGAHeaderSize + pData[0];
+    if( pData[1] != 0 )
+    {
+        iOffset += ReadLittleEndianShort( pData + 5 ) * ( ( pData[7] + 7 ) / 8 );
+    }
+
+    size_t iImageSize = (size_t)iWidth * iHeight * iChannels;
+    rTexture.Pixels.resize( iImageSize );
+    unsigned char *pPixel = iImageSize > 0 ? &rTexture.Pixels[0] : NULL;
+    unsigned char *pEnd = pPixel + iImageSize;
+
+    if( !bRLE )
+    {
+        if( iLength < iOffset || iLength - iOffset < iImageSize )
+        {
+            return false;
+        }
+        memcpy( pPixel, pData + iOffset, iImageSize );
+    }
+    else
+    {
+        // packets are a header byte, then either one pixel repeated ( header & 0x7F ) + 1 times,
+        // or ( header & 0x7F ) + 1 raw pixels
+        while( pPixel < pEnd )
+        {
+            if( iOffset >= iLength )
+            {
+                return false;
+            }
+            int iHeader = pData[ iOffset++ ];
+            size_t iCount = ( iHeader & 0x7F ) + 1;
+            if( iCount * iChannels > (size_t)( pEnd - pPixel ) )
+            {
+                return false;
+            }
+            if( iHeader & 0x80 )
+            {
+                if( iLength - iOffset < (size_t)iChannels )
+                {
+                    return false;
+                }
+                for( size_t i = 0; i < iCount; i++ )
+                {
+                    memcpy( pPixel, pData + iOffset, iChannels );
+                    pPixel += iChannels;
+                }
+                iOffset += iChannels;
+            }
+            else
+            {
+                if( iLength - iOffset < iCount * iChannels )
+                {
+                    return false;
+                }
+                memcpy( pPixel, pData + iOffset, iCount * iChannels );
+                pPixel += iCount * iChannels;
+                iOffset += iCount * iChannels;
+            }
+        }
+    }
+
+    if( iChannels >= 3 )
+    {
+        for( size_t i = 0; i < iImageSize; i += iChannels )
+        {
+            unsigned char Blue = rTexture.Pixels[i];
+            rTexture.Pixels[i] = rTexture.Pixels[ i + 2 ];
+            rTexture.Pixels[ i + 2 ] = Blue;
+        }
+    }
+
+    rTexture.iWidth = iWidth;
+    rTexture.iHeight = iHeight;
+    rTexture.iChannels = iChannels;
+    if( bTopOrigin )
+    {
+        FlipRows( rTexture );
+    }
+    return true;
+}
+
+// Input: pData, iLength: the PCX file
+//        rTexture: receives the pixels, as RGB
+//
+// Returns: True if the file was a PCX we can decode
+//
+// Description: Decodes RLE PCXs that are either 8-bit with a 256 colour palette,
+//  or 24-bit as three 8-bit planes
+//
+// Thread safety: Thread-safe
+bool DecodePCX( const unsigned char *pData, size_t iLength, DECODEDTEXTURE &rTexture )
+{
+    if( iLength < iPCXHeaderSize || pData[0] != 0x0A || pData[2] != 1 )
+    {
+        return false;
+    }
+
+    int iBitsPerPlane = pData[3];
+    int iWidth = ReadLittleEndianShort( pData + 8 ) - ReadLittleEndianShort( pData + 4 ) + 1;
+    int iHeight = ReadLittleEndianShort( pData + 10 ) - ReadLittleEndianShort( pData + 6 ) + 1;
+    int iPlanes = pData[65];
+    int iBytesPerLine = ReadLittleEndianShort( pData + 66 );
+    bool bPaletted = ( iPlanes == 1 );
+    if( iBitsPerPlane != 8 || ( iPlanes != 1 && iPlanes != 3 ) || iWidth <= 0 || iHeight <= 0 || iBytesPerLine < iWidth )
+    {
+        DEBUG( "Unsupported PCX " << iWidth << "x" << iHeight << " with " << iPlanes << " planes of " << iBitsPerPlane << " bits" );
+        return false;
+    }
+
+    size_t iDataEnd = iLength;
+    if( bPaletted )
+    {
+        if( iLength < iPCXHeaderSize + iPCXPaletteSize || pData[ iLength - iPCXPaletteSize ] != 0x0C )
+        {
+            return false;
+        }
+        iDataEnd = iLength - iPCXPaletteSize;
+    }
+
+    // scanlines are RLE compressed as one stream: a byte with its top two bits set repeats
+    // the next byte ( byte & 0x3F ) times, any other byte is itself
+    size_t iScanlineSize = (size_t)iPlanes * iBytesPerLine;
+    vector<unsigned char> Scanlines( iScanlineSize * iHeight );
+    size_t iOffset = iPCXHeaderSize;
+    for( size_t iOut = 0; iOut < Scanlines.size(); )
+    {
+        if( iOffset >= iDataEnd )
+        {
+            return false;
+        }
+        unsigned char Byte = pData[ iOffset++ ];
+        size_t iCount = 1;
+        if( ( Byte & 0xC0 ) == 0xC0 )
+        {
+            if( iOffset >= iDataEnd )
+            {
+                return false;
+            }
+            iCount = Byte & 0x3F;
+            Byte = pData[ iOffset++ ];
+        }
+        for( size_t i = 0; i < iCount && iOut < Scanlines.size(); i++ )
+        {
+            Scanlines[ iOut++ ] = Byte;
+        }
+    }
+
+    rTexture.iWidth = iWidth;
+    rTexture.iHeight = iHeight;
+    rTexture.iChannels = 3;
+    rTexture.Pixels.resize( (size_t)iWidth * iHeight * 3 );
+    const unsigned char *pPalette = pData + iDataEnd + 1;
+    unsigned char *pPixel = &rTexture.Pixels[0];
+    for( int y = 0; y < iHeight; y++ )
+    {
+        const unsigned char *pScanline = &Scanlines[ y * iScanlineSize ];
+        for( int x = 0; x < iWidth; x++ )
+        {
+            if( bPaletted )
+            {
+                memcpy( pPixel, pPalette + pScanline[x] * 3, 3 );
+            }
+            else
+            {
+                pPixel[0] = pScanline[x];
+                pPixel[1] = pScanline[ iBytesPerLine + x ];
+                pPixel[2] = pScanline[ 2 * iBytesPerLine + x ];
+            }
+            pPixel += 3;
+        }
+    }
+
+    // PCX rows are top first
+    FlipRows( rTexture );
+    return true;
+}
+
+// Input: sFilePath: path of a .tga or .pcx file
+//        rTexture: receives the pixels
+//
+// Returns: True if the file was read and decoded
+//
+// Description: Reads the file, and decodes it as a TGA if it ends in .tga, otherwise as a PCX,
+//  as RendererTexturingClass::LoadTexture does
+//
+// Thread safety: Thread-safe
+bool DecodeTextureFile( const string &sFilePath, DECODEDTEXTURE &rTexture )
+{
+    FILE *pFile = fopen( sFilePath.c_str(), "rb" );
+    if( pFile == NULL )
+    {
+        DEBUG( "Couldn't open texture file " << sFilePath );
+        return false;
+    }
+    vector<unsigned char> Data;
+    unsigned char buffer[ 65536 ];
+    size_t iBytesRead;
+    while( ( iBytesRead = fread( buffer, 1, sizeof( buffer ), pFile ) ) > 0 )
+    {
+        Data.insert( Data.end(), buffer, buffer + iBytesRead );
+    }
+    fclose( pFile );
+    if( Data.empty() )
+    {
+        return false;
+    }
+
+    bool bTGA = sFilePath.length() >= 4 && sFilePath[ sFilePath.length() - 4 ] == '.' &&
+                toupper( sFilePath[ sFilePath.length() - 3 ] ) == 'T' &&
+                toupper( sFilePath[ sFilePath.length() - 2 ] ) == 'G' &&
+                toupper( sFilePath[ sFilePath.length() - 1 ] ) == 'A';
+    if( bTGA )
+    {
+        return DecodeTGA( &Data[0], Data.size(), rTexture );
+    }
+    return DecodePCX( &Data[0], Data.size(), rTexture );
+}
+
+static const char sMipFileMagic[] = "OSMPMIPS";   //!< first 8 bytes of a .mips file
+static const int iMipFileVersion = 1;
+
+//! Nearest power of two to iSize
+static int NearestPowerOfTwo( int iSize )
+{
+    int iPower = 1;
+    while( iPower * 2 <= iSize )
+    {
+        iPower *= 2;
+    }
+    if( iSize - iPower > iPower * 2 - iSize )
+    {
+        iPower *= 2;
+    }
+    return iPower;
+}
+
+// Input: rSource: texture to scale
+//        iWidth, iHeight: size wanted
+//        rResult: receives the scaled texture
+//
+// Returns: None
+//
+// Description: Each result pixel is the average of the source pixels it covers.  Scaling up,
+//  each result pixel covers at least one source pixel, so this is nearest neighbour.
+//
+// Thread safety: Thread-safe
+void ScaleTexture( const DECODEDTEXTURE &rSource, int iWidth, int iHeight, DECODEDTEXTURE &rResult )
+{
+    int iChannels = rSource.iChannels;
+    rResult.iWidth = iWidth;
+    rResult.iHeight = iHeight;
+    rResult.iChannels = iChannels;
+    rResult.Pixels.resize( (size_t)iWidth * iHeight * iChannels );
+
+    unsigned char *pOut = &rResult.Pixels[0];
+    for( int y = 0; y < iHeight; y++ )
+    {
+        int iSourceY0 = (int)( (double)y * rSource.iHeight / iHeight );
+        int iSourceY1 = (int)( (double)( y + 1 ) * rSource.iHeight / iHeight );
+        if( iSourceY1 <= iSourceY0 )
+        {
+            iSourceY1 = iSourceY0 + 1;
+        }
+        for( int x = 0; x < iWidth; x++ )
+        {
+            int iSourceX0 = (int)( (double)x * rSource.iWidth / iWidth );
+            int iSourceX1 = (int)( (double)( x + 1 ) * rSource.iWidth / iWidth );
+            if( iSourceX1 <= iSourceX0 )
+            {
+                iSourceX1 = iSourceX0 + 1;
+            }
+            unsigned int iCount = ( iSourceY1 - iSourceY0 ) * ( iSourceX1 - iSourceX0 );
+            for( int c = 0; c < iChannels; c++ )
+            {
+                unsigned int iSum = 0;
+                for( int sy = iSourceY0; sy < iSourceY1; sy++ )
+                {
+                    const unsigned char *pRow = &rSource.Pixels[ ( (size_t)sy * rSource.iWidth ) * iChannels ];
+                    for( int sx = iSourceX0; sx < iSourceX1; sx++ )
+                    {
+                        iSum += pRow[ sx * iChannels + c ];
+                    }
+                }
+                *pOut++ = (unsigned char)( ( iSum + iCount / 2 ) / iCount );
+            }
+        }
+    }
+}
+
+// Input: rSource: texture with even width and height
+//        rResult: receives rSource at half the width and height
+//
+// Returns: None
+//
+// Description: 2x2 box filter.  The common case when building mip chains, so it's done a row
+//  at a time in flat loops over bytes that the compiler can vectorise: add each pair of rows,
+//  then each pair of pixels in the sum.
+//
+// Thread safety: Thread-safe
+static void HalveTexture( const DECODEDTEXTURE &rSource, DECODEDTEXTURE &rResult )
+{
+    int iChannels = rSource.iChannels;
+    int iWidth = rSource.iWidth / 2;
+    int iHeight = rSource.iHeight / 2;
+    size_t iSourceRowSize = (size_t)rSource.iWidth * iChannels;
+    size_t iRowSize = (size_t)iWidth * iChannels;
+    rResult.iWidth = iWidth;
+    rResult.iHeight = iHeight;
+    rResult.iChannels = iChannels;
+    rResult.Pixels.resize( iRowSize * iHeight );
+
+    vector<unsigned short> RowSums( iSourceRowSize );
+    unsigned short *pSums = &RowSums[0];
+    for( int y = 0; y < iHeight; y++ )
+    {
+        const unsigned char *pTop = &rSource.Pixels[ 2 * y * iSourceRowSize ];
+        const unsigned char *pBottom = pTop + iSourceRowSize;
+        for( size_t i = 0; i < iSourceRowSize; i++ )
+        {
+            pSums[i] = (unsigned short)( pTop[i] + pBottom[i] );
+        }
+
+        unsigned char *pOut = &rResult.Pixels[ y * iRowSize ];
+        for( int x = 0; x < iWidth; x++ )
+        {
+            const unsigned short *pLeft = pSums + 2 * x * iChannels;
+            const unsigned short *pRight = pLeft + iChannels;
+            for( int c = 0; c < iChannels; c++ )
+            {
+                pOut[ x * iChannels + c ] = (unsigned char)( ( pLeft[c] + pRight[c] + 2 ) >> 2 );
+            }
+        }
+    }
+}
+
+// Input: rTexture: decoded texture
+//        MipLevels: receives the mip chain
+//
+// Returns: None
+//
+// Description: The first level is rTexture scaled to the nearest power of two each way,
+//  since older OpenGLs need power-of-two textures.  Each level after is half the size,
+//  down to 1x1.
+//
+// Thread safety: Thread-safe
+void GenerateMipmaps( const DECODEDTEXTURE &rTexture, vector<DECODEDTEXTURE> &MipLevels )
+{
+    MipLevels.clear();
+    int iWidth = NearestPowerOfTwo( rTexture.iWidth );
+    int iHeight = NearestPowerOfTwo( rTexture.iHeight );
+    MipLevels.push_back( DECODEDTEXTURE() );
+    if( iWidth == rTexture.iWidth && iHeight == rTexture.iHeight )
+    {
+        MipLevels.back() = rTexture;
+    }
+    else
+    {
+        ScaleTexture( rTexture, iWidth, iHeight, MipLevels.back() );
+    }
+
+    while( iWidth > 1 || iHeight > 1 )
+    {
+        MipLevels.push_back( DECODEDTEXTURE() );
+        const DECODEDTEXTURE &rLarger = MipLevels[ MipLevels.size() - 2 ];
+        if( iWidth > 1 && iHeight > 1 )
+        {
+            HalveTexture( rLarger, MipLevels.back() );
+        }
+        else
+        {
+            ScaleTexture( rLarger, iWidth > 1 ? iWidth / 2 : 1, iHeight > 1 ? iHeight / 2 : 1, MipLevels.back() );
+        }
+        iWidth = MipLevels.back().iWidth;
+        iHeight = MipLevels.back().iHeight;
+    }
+}
+
+static void WriteMipFileInt( FILE *pFile, int iValue )
+{
+    unsigned char bytes[4];
+    for( int i = 0; i < 4; i++ )
+    {
+        bytes[i] = (unsigned char)( iValue >> ( 8 * i ) );
+    }
+    fwrite( bytes, 1, 4, pFile );
+}
+
+static bool ReadMipFileInt( FILE *pFile, int &iValue )
+{
+    unsigned char bytes[4];
+    if( fread( bytes, 1, 4, pFile ) != 4 )
+    {
+        return false;
+    }
+    iValue = bytes[0] | ( bytes[1] << 8 ) | ( bytes[2] << 16 ) | ( bytes[3] << 24 );
+    return true;
+}
+
+// Input: sMipFilePath: file to write
+//        MipLevels: mip chain from GenerateMipmaps
+//
+// Returns: True if the file was written
+//
+// Description: A .mips file is sMipFileMagic, then as 4-byte little-endian integers the
+//  format version, the number of channels and the number of levels.  Each level follows,
+//  largest first, as its width and height then its pixels, rows bottom first.
+//  The file is written to a temporary file then renamed, so it's never seen half-written.
+//
+// Thread safety: Thread-safe, for different files
+bool SaveTextureMips( const string &sMipFilePath, const vector<DECODEDTEXTURE> &MipLevels )
+{
+    if( MipLevels.empty() )
+    {
+        return false;
+    }
+    string sTempPath = sMipFilePath + ".tmp";
+    FILE *pFile = fopen( sTempPath.c_str(), "wb" );
+    if( pFile == NULL )
+    {
+        return false;
+    }
+    fwrite( sMipFileMagic, 1, 8, pFile );
+    WriteMipFileInt( pFile, iMipFileVersion );
+    WriteMipFileInt( pFile, MipLevels[0].iChannels );
+    WriteMipFileInt( pFile, (int)MipLevels.size() );
+    for( size_t i = 0; i < MipLevels.size(); i++ )
+    {
+        WriteMipFileInt( pFile, MipLevels[i].iWidth );
+        WriteMipFileInt( pFile, MipLevels[i].iHeight );
+        fwrite( &MipLevels[i].Pixels[0], 1, MipLevels[i].Pixels.size(), pFile );
+    }
+    bool bWritten = ( ferror( pFile ) == 0 );
+    if( fclose( pFile ) != 0 )
+    {
+        bWritten = false;
+    }
+    if( !bWritten )
+    {
+        remove( sTempPath.c_str() );
+        return false;
+    }
+#ifdef _WIN32
+    remove( sMipFilePath.c_str() );
+#endif
+    if( rename( sTempPath.c_str(), sMipFilePath.c_str() ) != 0 )
+    {
+        remove( sTempPath.c_str() );
+        return false;
+    }
+    return true;
+}
+
+// Input: sMipFilePath: .mips file written by SaveTextureMips
+//        iMaxSize: levels wider or taller than this are skipped, though the smallest level
+//          is always read
+//        MipLevels: receives the levels read, largest first
+//        iFullSize: receives the width or height, whichever is larger, of the first level in the file
+//
+// Returns: True if the file was there and whole
+//
+// Thread safety: Thread-safe
+bool LoadTextureMips( const string &sMipFilePath, int iMaxSize, vector<DECODEDTEXTURE> &MipLevels, int &iFullSize )
+{
+    MipLevels.clear();
+    FILE *pFile = fopen( sMipFilePath.c_str(), "rb" );
+    if( pFile == NULL )
+    {
+        return false;
+    }
+
+    char magic[8];
+    int iVersion, iChannels, iNumLevels;
+    bool bOK = fread( magic, 1, 8, pFile ) == 8 && memcmp( magic, sMipFileMagic, 8 ) == 0 &&
+               ReadMipFileInt( pFile, iVersion ) && iVersion == iMipFileVersion &&
+               ReadMipFileInt( pFile, iChannels ) && iChannels >= 1 && iChannels <= 4 &&
+               ReadMipFileInt( pFile, iNumLevels ) && iNumLevels >= 1 && iNumLevels <= 32;
+    for( int i = 0; bOK && i < iNumLevels; i++ )
+    {
+        int iWidth, iHeight;
+        bOK = ReadMipFileInt( pFile, iWidth ) && ReadMipFileInt( pFile, iHeight ) &&
+              iWidth >= 1 && iHeight >= 1 && iWidth <= 65536 && iHeight <= 65536;
+        if( !bOK )
+        {
+            break;
+        }
+        if( i == 0 )
+        {
+            iFullSize = iWidth > iHeight ? iWidth : iHeight;
+        }
+        size_t iLevelSize = (size_t)iWidth * iHeight * iChannels;
+        if( ( iWidth > iMaxSize || iHeight > iMaxSize ) && i < iNumLevels - 1 )
+        {
+            bOK = fseek( pFile, (long)iLevelSize, SEEK_CUR ) == 0;
+            continue;
+        }
+        MipLevels.push_back( DECODEDTEXTURE() );
+        DECODEDTEXTURE &rLevel = MipLevels.back();
+        rLevel.iWidth = iWidth;
+        rLevel.iHeight = iHeight;
+        rLevel.iChannels = iChannels;
+        rLevel.Pixels.resize( iLevelSize );
+        bOK = fread( &rLevel.Pixels[0], 1, iLevelSize, pFile ) == iLevelSize;
+    }
+    fclose( pFile );
+
+    if( !bOK )
+    {
+        MipLevels.clear();
+    }
+    return bOK;
+}
+
+size_t TEXTUREDECODEJOB::GetSize() const
+{
+    size_t iSize = 0;
+    for( size_t i = 0; i < MipLevels.size(); i++ )
+    {
+        iSize += MipLevels[i].GetSize();
+    }
+    return iSize;
+}
+
+TextureDecodePool::TextureDecodePool( int iNewNumThreads )
+{
+    iNumThreads = iNewNumThreads;
+    bThreadsStarted = false;
+    pthread_mutex_init( &Mutex, NULL );
+    pthread_cond_init( &JobQueued, NULL );
+}
+
+// Input: sChecksum: identifies the texture
+//        sFilePath: file to decode
+//        sMipFilePath: where its mip chain is, or is to be, cached
+//        fPriority: higher is decoded first
+//        iMaxSize: largest width or height wanted
+//
+// Returns: None
+//
+// Description: Queues the texture for decoding, starting the threads if they aren't yet.
+//  A texture already queued, decoding or decoded just has its priority updated,
+//  and, if it's still queued, its iMaxSize raised to iMaxSize.
+//  If no thread can be started, decodes in place.
+//
+// Thread safety: Thread-safe
+void TextureDecodePool::Queue( const string &sChecksum, const string &sFilePath, const string &sMipFilePath, float fPriority, int iMaxSize )
+{
+    pthread_mutex_lock( &Mutex );
+    map < string, TEXTUREDECODEJOB * >::iterator queued = QueuedJobs.find( sChecksum );
+    if( queued != QueuedJobs.end() && queued->second->iMaxSize < iMaxSize )
+    {
+        queued->second->iMaxSize = iMaxSize;
+    }
+    if( queued != QueuedJobs.end() ||
+            DecodingJobs.find( sChecksum ) != DecodingJobs.end() ||
+            DecodedJobs.find( sChecksum ) != DecodedJobs.end() )
+    {
+        pthread_mutex_unlock( &Mutex );
+        SetPriority( sChecksum, fPriority );
+        return;
+    }
+
+    TEXTUREDECODEJOB *pJob = new TEXTUREDECODEJOB;
+    pJob->sChecksum = sChecksum;
+    pJob->sFilePath = sFilePath;
+    pJob->sMipFilePath = sMipFilePath;
+    pJob->fPriority = fPriority;
+    pJob->iMaxSize = iMaxSize;
+    pJob->bResult = false;
+    pJob->iFullSize = 0;
+    QueuedJobs.insert( pair < string, TEXTUREDECODEJOB * >( sChecksum, pJob ) );
+
+    if( !bThreadsStarted )
+    {
+        int iThreadsStarted = 0;
+        for( int i = 0; i < iNumThreads; i++ )
+        {
+            pthread_t Thread;
+            if( pthread_create( &Thread, NULL, ThreadFunction, this ) == 0 )
+            {
+                pthread_detach( Thread );
+                iThreadsStarted++;
+            }
+        }
+        bThreadsStarted = ( iThreadsStarted > 0 );
+        DEBUG( "Started " << iThreadsStarted << " texture decode threads" );
+    }
+    bool bThreadsRunning = bThreadsStarted;
+    pthread_cond_signal( &JobQueued );
+    pthread_mutex_unlock( &Mutex );
+
+    if( !bThreadsRunning )
+    {
+        WARNING( "Couldn't start texture decode threads; decoding " << sFilePath << " in place" );
+        DecodeLoop();
+    }
+}
+
+// Input: sChecksum: identifies the texture
+//        fPriority: new priority
+//
+// Returns: None
+//
+// Description: Changes the priority of a texture that's queued, decoding or decoded.
+//  Does nothing for textures not in the pool.
+//
+// Thread safety: Thread-safe
+void TextureDecodePool::SetPriority( const string &sChecksum, float fPriority )
+{
+    pthread_mutex_lock( &Mutex );
+    map < string, TEXTUREDECODEJOB * > *JobMaps[] = { &QueuedJobs, &DecodingJobs, &DecodedJobs };
+    for( int i = 0; i < 3; i++ )
+    {
+        map < string, TEXTUREDECODEJOB * >::iterator it = JobMaps[i]->find( sChecksum );
+        if( it != JobMaps[i]->end() )
+        {
+            it->second->fPriority = fPriority;
+        }
+    }
+    pthread_mutex_unlock( &Mutex );
+}
+
+void TextureDecodePool::GetPendingChecksums( vector<string> &Checksums )
+{
+    Checksums.clear();
+    pthread_mutex_lock( &Mutex );
+    map < string, TEXTUREDECODEJOB * > *JobMaps[] = { &QueuedJobs, &DecodingJobs, &DecodedJobs };
+    for( int i = 0; i < 3; i++ )
+    {
+        for( map < string, TEXTUREDECODEJOB * >::iterator it = JobMaps[i]->begin(); it != JobMaps[i]->end(); it++ )
+        {
+            Checksums.push_back( it->first );
+        }
+    }
+    pthread_mutex_unlock( &Mutex );
+}
+
+// Input: None
+//
+// Returns: The highest priority decoded job, or NULL if none are decoded yet.
+//  The caller owns the job and must delete it.
+//
+// Thread safety: Thread-safe
+TEXTUREDECODEJOB *TextureDecodePool::GetDecoded()
+{
+    pthread_mutex_lock( &Mutex );
+    TEXTUREDECODEJOB *pJob = TakeHighestPriority( DecodedJobs );
+    pthread_mutex_unlock( &Mutex );
+    return pJob;
+}
+
+bool TextureDecodePool::IsIdle()
+{
+    pthread_mutex_lock( &Mutex );
+    bool bIdle = QueuedJobs.empty() && DecodingJobs.empty() && DecodedJobs.empty();
+    pthread_mutex_unlock( &Mutex );
+    return bIdle;
+}
+
+// Input: pJob: the job to do
+//
+// Returns: None
+//
+// Description: Reads the mip levels pJob wants from its .mips file, or, if there isn't one yet,
+//  decodes the texture file, builds the mip chain and caches it.
+//
+// Thread safety: Thread-safe, for different jobs
+void TextureDecodePool::DecodeJob( TEXTUREDECODEJOB *pJob )
+{
+    if( LoadTextureMips( pJob->sMipFilePath, pJob->iMaxSize, pJob->MipLevels, pJob->iFullSize ) )
+    {
+        pJob->bResult = true;
+        return;
+    }
+
+    DECODEDTEXTURE Texture;
+    if( !DecodeTextureFile( pJob->sFilePath, Texture ) )
+    {
+        pJob->bResult = false;
+        return;
+    }
+    GenerateMipmaps( Texture, pJob->MipLevels );
+    if( !SaveTextureMips( pJob->sMipFilePath, pJob->MipLevels ) )
+    {
+        WARNING( "Couldn't write mip cache " << pJob->sMipFilePath );
+    }
+
+    pJob->iFullSize = pJob->MipLevels[0].iWidth > pJob->MipLevels[0].iHeight ? pJob->MipLevels[0].iWidth : pJob->MipLevels[0].iHeight;
+    size_t iFirstLevel = 0;
+    while( iFirstLevel + 1 < pJob->MipLevels.size() &&
+            ( pJob->MipLevels[ iFirstLevel ].iWidth > pJob->iMaxSize || pJob->MipLevels[ iFirstLevel ].iHeight > pJob->iMaxSize ) )
+    {
+        iFirstLevel++;
+    }
+    pJob->MipLevels.erase( pJob->MipLevels.begin(), pJob->MipLevels.begin() + iFirstLevel );
+    pJob->bResult = true;
+}
+
+//! Removes and returns the job in Jobs with the highest priority, or NULL if Jobs is empty; call with Mutex held
+TEXTUREDECODEJOB *TextureDecodePool::TakeHighestPriority( map < string, TEXTUREDECODEJOB * > &Jobs )
+{
+    map < string, TEXTUREDECODEJOB * >::iterator best = Jobs.end();
+    for( map < string, TEXTUREDECODEJOB * >::iterator it = Jobs.begin(); it != Jobs.end(); it++ )
+    {
+        if( best == Jobs.end() || it->second->fPriority > best->second->fPriority )
+        {
+            best = it;
+        }
+    }
+    if( best == Jobs.end() )
+    {
+        return NULL;
+    }
+    TEXTUREDECODEJOB *pJob = best->second;
+    Jobs.erase( best );
+    return pJob;
+}
+
+void *TextureDecodePool::ThreadFunction( void *pPool )
+{
+    ( (TextureDecodePool *)pPool )->DecodeLoop();
+    return NULL;
+}
+
+// Input: None
+//
+// Returns: Never on a decode thread; when QueuedJobs is empty if the threads couldn't be started
+//
+// Description: Decodes queued textures, highest priority first, into mip chains
+void TextureDecodePool::DecodeLoop()
+{
+    pthread_mutex_lock( &Mutex );
+    while( true )
+    {
+        while( QueuedJobs.empty() )
+        {
+            if( !bThreadsStarted )
+            {
+                pthread_mutex_unlock( &Mutex );
+                return;
+            }
+            pthread_cond_wait( &JobQueued, &Mutex );
+        }
+        TEXTUREDECODEJOB *pJob = TakeHighestPriority( QueuedJobs );
+        DecodingJobs.insert( pair < string, TEXTUREDECODEJOB * >( pJob->sChecksum, pJob ) );
+        pthread_mutex_unlock( &Mutex );
+
+        // pJob's levels and result are only touched here until it moves to DecodedJobs
+        DecodeJob( pJob );
+
+        pthread_mutex_lock( &Mutex );
+        DecodingJobs.erase( pJob->sChecksum );
+        DecodedJobs.insert( pair < string, TEXTUREDECODEJOB * >( pJob->sChecksum, pJob ) );
+    }
+}
@@ -0,0 +1,119 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Decodes texture files into pixel buffers, on a pool of background threads
+//!
+//! Decodes texture files into pixel buffers, on a pool of background threads
+//! Nothing here touches OpenGL, so it can run off the render thread, and be tested headless.
+//! RendererTexturingClass uploads the decoded pixels on the render thread, a few per frame.
+//!
+//! Decoded textures are box-filtered into a power-of-two mip chain, which is cached on disk
+//! in a .mips file keyed by the texture's checksum.  Later loads read just the levels
+//! they need from the .mips file, so distant textures never decode their full resolution.
+
+#ifndef _TEXTUREDECODER_H
+#define _TEXTUREDECODER_H
+
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "pthread.h"
+
+//! Pixels of a decoded texture, ready to upload
+class DECODEDTEXTURE
+{
+public:
+    int iWidth;
+    int iHeight;
+    int iChannels;   //!< 1 for luminance, 3 for RGB, 4 for RGBA
+    vector<unsigned char> Pixels;   //!< rows bottom first, as OpenGL expects them
+
+    DECODEDTEXTURE()
+    {
+        iWidth = 0;
+        iHeight = 0;
+        iChannels = 0;
+    }
+    size_t GetSize() const
+    {
+        return Pixels.size();
+    }
+};
+
+bool DecodeTGA( const unsigned char *pData, size_t iLength, DECODEDTEXTURE &rTexture );   //!< Decodes a truecolor or greyscale TGA, raw or RLE
+bool DecodePCX( const unsigned char *pData, size_t iLength, DECODEDTEXTURE &rTexture );   //!< Decodes an 8-bit paletted or 24-bit PCX
+bool DecodeTextureFile( const string &sFilePath, DECODEDTEXTURE &rTexture );   //!< Decodes a .tga or .pcx file, by extension
+
+void ScaleTexture( const DECODEDTEXTURE &rSource, int iWidth, int iHeight, DECODEDTEXTURE &rResult );   //!< Box filters rSource to iWidth x iHeight
+void GenerateMipmaps( const DECODEDTEXTURE &rTexture, vector<DECODEDTEXTURE> &MipLevels );   //!< Builds the mip chain, largest first, power-of-two sized, down to 1x1
+bool SaveTextureMips( const string &sMipFilePath, const vector<DECODEDTEXTURE> &MipLevels );   //!< Writes a mip chain to a .mips file
+bool LoadTextureMips( const string &sMipFilePath, int iMaxSize, vector<DECODEDTEXTURE> &MipLevels, int &iFullSize );   //!< Reads the levels no bigger than iMaxSize from a .mips file
+
+//! A texture to decode, and then the result
+class TEXTUREDECODEJOB
+{
+public:
+    string sChecksum;   //!< texture checksum, identifying the job
+    string sFilePath;
+    string sMipFilePath;   //!< where the texture's mip chain is cached
+    float fPriority;   //!< higher is decoded, and uploaded, first
+    int iMaxSize;   //!< mip levels wider or taller than this aren't wanted
+    bool bResult;   //!< true if decoding worked
+    int iFullSize;   //!< width or height, whichever is larger, of the full size mip level
+    vector<DECODEDTEXTURE> MipLevels;   //!< largest first, down to 1x1
+
+    size_t GetSize() const;   //!< bytes in MipLevels
+};
+
+//! TextureDecodePool decodes texture files on a pool of background threads
+
+//! TextureDecodePool decodes texture files on a pool of background threads
+//! Jobs are decoded highest priority first, and priorities can be changed while jobs wait.
+//! Threads are started when the first job is queued.
+class TextureDecodePool
+{
+public:
+    TextureDecodePool( int iNumThreads );
+
+    void Queue( const string &sChecksum, const string &sFilePath, const string &sMipFilePath, float fPriority, int iMaxSize );   //!< Queues a texture for decoding, unless it's already queued
+    void SetPriority( const string &sChecksum, float fPriority );   //!< Changes the priority of a queued or decoded texture
+    void GetPendingChecksums( vector<string> &Checksums );   //!< Gets the checksums of textures queued or decoded but not yet collected
+    TEXTUREDECODEJOB *GetDecoded();   //!< Returns the highest priority decoded texture, or NULL; caller deletes it
+    bool IsIdle();   //!< True if there are no jobs queued, decoding or waiting to be collected
+
+protected:
+    int iNumThreads;
+    bool bThreadsStarted;
+    pthread_mutex_t Mutex;   //!< guards everything below
+    pthread_cond_t JobQueued;
+    map < string, TEXTUREDECODEJOB * > QueuedJobs;   //!< waiting for a thread, by checksum
+    map < string, TEXTUREDECODEJOB * > DecodingJobs;   //!< being decoded, by checksum
+    map < string, TEXTUREDECODEJOB * > DecodedJobs;   //!< waiting for GetDecoded, by checksum
+
+    static void *ThreadFunction( void *pPool );
+    void DecodeLoop();
+    static TEXTUREDECODEJOB *TakeHighestPriority( map < string, TEXTUREDECODEJOB * > &Jobs );
+    static void DecodeJob( TEXTUREDECODEJOB *pJob );
+};
+
+#endif // _TEXTUREDECODER_H
@@ -0,0 +1,298 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief texturedecodertest: headless tests of the texture decoder
+//!
+//! Decodes small TGA and PCX images built in memory, checks the mip chain and its .mips cache,
+//! and runs jobs through a TextureDecodePool, checking they come back highest priority first.
+//! Nothing here needs OpenGL.  Prints each failed check, and exits non-zero if any failed.
+//!
+//! usage: texturedecodertest
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "TextureDecoder.h"
+#include "ThreadWrapper.h"
+#include "TestCheck.h"
+
+//! true if rTexture's pixel at x, y (from the bottom) is Expected
+bool PixelIs( const DECODEDTEXTURE &rTexture, int x, int y, const unsigned char *Expected )
+{
+    return memcmp( &rTexture.Pixels[ ( y * rTexture.iWidth + x ) * rTexture.iChannels ], Expected, rTexture.iChannels ) == 0;
+}
+
+//! an 18 byte TGA header
+void AppendTGAHeader( vector<unsigned char> &Data, int iImageType, int iWidth, int iHeight, int iBitsPerPixel, bool bTopOrigin )
+{
+    unsigned char Header[18];
+    memset( Header, 0, sizeof( Header ) );
+    Header[2] = (unsigned char)iImageType;
+    Header[12] = (unsigned char)( iWidth & 0xFF );
+    Header[13] = (unsigned char)( iWidth >> 8 );
+    Header[14] = (unsigned char)( iHeight & 0xFF );
+    Header[15] = (unsigned char)( iHeight >> 8 );
+    Header[16] = (unsigned char)iBitsPerPixel;
+    Header[17] = bTopOrigin ? 0x20 : 0;
+    Data.insert( Data.end(), Header, Header + sizeof( Header ) );
+}
+
+void TestRawTGA()
+{
+    // 2x2, 24 bit BGR, rows top first
+    vector<unsigned char> Data;
+    AppendTGAHeader( Data, 2, 2, 2, 24, true );
+    unsigned char Pixels[] = { 3, 2, 1,  6, 5, 4,     // top row
+                               9, 8, 7,  12, 11, 10 }; // bottom row
+    Data.insert( Data.end(), Pixels, Pixels + sizeof( Pixels ) );
+
+    DECODEDTEXTURE Texture;
+    CHECK( DecodeTGA( &Data[0], Data.size(), Texture ) );
+    CHECK( Texture.iWidth == 2 && Texture.iHeight == 2 && Texture.iChannels == 3 );
+    unsigned char BottomLeft[] = { 7, 8, 9 };
+    unsigned char TopRight[] = { 4, 5, 6 };
+    CHECK( PixelIs( Texture, 0, 0, BottomLeft ) );
+    CHECK( PixelIs( Texture, 1, 1, TopRight ) );
+
+    // truncated
+    CHECK( !DecodeTGA( &Data[0], Data.size() - 1, Texture ) );
+}
+
+void TestRLETGA()
+{
+    // 3x1, 32 bit BGRA, bottom origin: a run of two pixels then one raw pixel
+    vector<unsigned char> Data;
+    AppendTGAHeader( Data, 10, 3, 1, 32, false );
+    unsigned char Packets[] = { 0x81, 10, 20, 30, 40,
+                                0x00, 50, 60, 70, 80 };
+    Data.insert( Data.end(), Packets, Packets + sizeof( Packets ) );
+
+    DECODEDTEXTURE Texture;
+    CHECK( DecodeTGA( &Data[0], Data.size(), Texture ) );
+    CHECK( Texture.iWidth == 3 && Texture.iHeight == 1 && Texture.iChannels == 4 );
+    unsigned char Run[] = { 30, 20, 10, 40 };
+    unsigned char Raw[] = { 70, 60, 50, 80 };
+    CHECK( PixelIs( Texture, 0, 0, Run ) );
+    CHECK( PixelIs( Texture, 1, 0, Run ) );
+    CHECK( PixelIs( Texture, 2, 0, Raw ) );
+
+    // a run longer than the image
+    Data[ 18 ] = 0x83;
+    CHECK( !DecodeTGA( &Data[0], Data.size(), Texture ) );
+}
+
+void TestPalettedPCX()
+{
+    // 2x2, 8 bit paletted; the top row is colour 1 twice, as a run, the bottom row colours 2 and 0xC5,
+    // the latter needing a run of one as it has its top two bits set
+    vector<unsigned char> Data( 128, 0 );
+    Data[0] = 0x0A;
+    Data[2] = 1;
+    Data[3] = 8;
+    Data[8] = 1;    // xmax
+    Data[10] = 1;   // ymax
+    Data[65] = 1;   // planes
+    Data[66] = 2;   // bytes per line
+    unsigned char Scanlines[] = { 0xC2, 1,  2, 0xC1, 0xC5 };
+    Data.insert( Data.end(), Scanlines, Scanlines + sizeof( Scanlines ) );
+    Data.push_back( 0x0C );
+    for( int i = 0; i < 256; i++ )
+    {
+        Data.push_back( (unsigned char)i );
+        Data.push_back( (unsigned char)( 255 - i ) );
+        Data.push_back( (unsigned char)( i / 2 ) );
+    }
+
+    DECODEDTEXTURE Texture;
+    CHECK( DecodePCX( &Data[0], Data.size(), Texture ) );
+    CHECK( Texture.iWidth == 2 && Texture.iHeight == 2 && Texture.iChannels == 3 );
+    unsigned char Colour1[] = { 1, 254, 0 };
+    unsigned char Colour2[] = { 2, 253, 1 };
+    unsigned char ColourC5[] = { 0xC5, 0x3A, 0x62 };
+    CHECK( PixelIs( Texture, 0, 1, Colour1 ) );
+    CHECK( PixelIs( Texture, 1, 1, Colour1 ) );
+    CHECK( PixelIs( Texture, 0, 0, Colour2 ) );
+    CHECK( PixelIs( Texture, 1, 0, ColourC5 ) );
+
+    // no palette marker
+    Data[ Data.size() - 769 ] = 0;
+    CHECK( !DecodePCX( &Data[0], Data.size(), Texture ) );
+}
+
+//! a greyscale texture whose pixels are their index times iStep
+void MakeGreyTexture( DECODEDTEXTURE &rTexture, int iWidth, int iHeight, int iStep )
+{
+    rTexture.iWidth = iWidth;
+    rTexture.iHeight = iHeight;
+    rTexture.iChannels = 1;
+    rTexture.Pixels.resize( iWidth * iHeight );
+    for( int i = 0; i < iWidth * iHeight; i++ )
+    {
+        rTexture.Pixels[i] = (unsigned char)( i * iStep );
+    }
+}
+
+void TestMipmaps()
+{
+    DECODEDTEXTURE Texture;
+    MakeGreyTexture( Texture, 4, 2, 10 );
+
+    vector<DECODEDTEXTURE> MipLevels;
+    GenerateMipmaps( Texture, MipLevels );
+    CHECK( MipLevels.size() == 3 );
+    CHECK( MipLevels[0].iWidth == 4 && MipLevels[0].iHeight == 2 );
+    CHECK( MipLevels[1].iWidth == 2 && MipLevels[1].iHeight == 1 );
+    CHECK( MipLevels[2].iWidth == 1 && MipLevels[2].iHeight == 1 );
+    // 0 10 20 30 over 40 50 60 70: the 2x2 boxes average to 25 and 45, and those to 35
+    CHECK( MipLevels[1].Pixels[0] == 25 && MipLevels[1].Pixels[1] == 45 );
+    CHECK( MipLevels[2].Pixels[0] == 35 );
+
+    // not a power of two: scaled to the nearest first, ties going down
+    MakeGreyTexture( Texture, 5, 3, 1 );
+    GenerateMipmaps( Texture, MipLevels );
+    CHECK( MipLevels[0].iWidth == 4 && MipLevels[0].iHeight == 2 );
+    CHECK( MipLevels.back().iWidth == 1 && MipLevels.back().iHeight == 1 );
+}
+
+void TestMipFile()
+{
+    DECODEDTEXTURE Texture;
+    MakeGreyTexture( Texture, 8, 8, 3 );
+    vector<DECODEDTEXTURE> MipLevels;
+    GenerateMipmaps( Texture, MipLevels );
+
+    const char *sMipFilePath = "texturedecodertest.mips";
+    CHECK( SaveTextureMips( sMipFilePath, MipLevels ) );
+
+    vector<DECODEDTEXTURE> Loaded;
+    int iFullSize = 0;
+    CHECK( LoadTextureMips( sMipFilePath, 2, Loaded, iFullSize ) );
+    CHECK( iFullSize == 8 );
+    CHECK( Loaded.size() == 2 );
+    CHECK( Loaded.size() == 2 && Loaded[0].iWidth == 2 && Loaded[0].Pixels == MipLevels[2].Pixels );
+
+    // asking for less than the smallest level still gets that level
+    CHECK( LoadTextureMips( sMipFilePath, 0, Loaded, iFullSize ) );
+    CHECK( Loaded.size() == 1 && Loaded[0].iWidth == 1 );
+
+    remove( sMipFilePath );
+    CHECK( !LoadTextureMips( sMipFilePath, 8, Loaded, iFullSize ) );
+}
+
+//! writes a greyscale TGA of iSize x iSize
+void WriteGreyTGA( const string &sFilePath, int iSize )
+{
+    vector<unsigned char> Data;
+    AppendTGAHeader( Data, 3, iSize, iSize, 8, false );
+    Data.resize( Data.size() + iSize * iSize, 128 );
+    FILE *pFile = fopen( sFilePath.c_str(), "wb" );
+    fwrite( &Data[0], 1, Data.size(), pFile );
+    fclose( pFile );
+}
+
+//! queues the test jobs on Pool, and collects them as they're decoded
+void RunPoolJobs( TextureDecodePool &Pool, vector<TEXTUREDECODEJOB *> &Jobs )
+{
+    const char *Checksums[] = { "low", "high", "missing" };
+    float Priorities[] = { 1, 3, 2 };
+    for( int i = 0; i < 3; i++ )
+    {
+        string sBase = string( "texturedecodertest_" ) + Checksums[i];
+        Pool.Queue( Checksums[i], sBase + ".tga", sBase + ".mips", Priorities[i], 4 );
+    }
+    CHECK( !Pool.IsIdle() );
+
+    TEXTUREDECODEJOB *pJob;
+    for( int iWaited = 0; Jobs.size() < 3 && iWaited < 500; iWaited++ )
+    {
+        while( ( pJob = Pool.GetDecoded() ) != NULL )
+        {
+            Jobs.push_back( pJob );
+        }
+        if( Jobs.size() < 3 )
+        {
+            PauseThreadMilliseconds( 10 );
+        }
+    }
+    CHECK( Jobs.size() == 3 );
+    CHECK( Pool.IsIdle() );
+}
+
+void DeleteJobs( vector<TEXTUREDECODEJOB *> &Jobs )
+{
+    for( size_t i = 0; i < Jobs.size(); i++ )
+    {
+        delete Jobs[i];
+    }
+    Jobs.clear();
+}
+
+void TestPool()
+{
+    WriteGreyTGA( "texturedecodertest_low.tga", 16 );
+    WriteGreyTGA( "texturedecodertest_high.tga", 16 );
+
+    // with no threads each job is decoded as it's queued, so all three are waiting when we
+    // collect them, and must come back highest priority first
+    vector<TEXTUREDECODEJOB *> Jobs;
+    TextureDecodePool InPlacePool( 0 );
+    CHECK( InPlacePool.IsIdle() );
+    RunPoolJobs( InPlacePool, Jobs );
+    if( Jobs.size() == 3 )
+    {
+        CHECK( Jobs[0]->sChecksum == "high" && Jobs[1]->sChecksum == "missing" && Jobs[2]->sChecksum == "low" );
+        CHECK( Jobs[0]->bResult && Jobs[0]->iFullSize == 16 && Jobs[0]->MipLevels[0].iWidth == 4 );
+        CHECK( !Jobs[1]->bResult );
+    }
+    DeleteJobs( Jobs );
+
+    // on threads; the .mips files written above are used this time
+    TextureDecodePool ThreadedPool( 2 );
+    RunPoolJobs( ThreadedPool, Jobs );
+    for( size_t i = 0; i < Jobs.size(); i++ )
+    {
+        CHECK( Jobs[i]->bResult == ( Jobs[i]->sChecksum != "missing" ) );
+        CHECK( !Jobs[i]->bResult || ( Jobs[i]->iFullSize == 16 && Jobs[i]->MipLevels[0].iWidth == 4 ) );
+    }
+    DeleteJobs( Jobs );
+
+    const char *Files[] = { "texturedecodertest_low.tga", "texturedecodertest_low.mips",
+                            "texturedecodertest_high.tga", "texturedecodertest_high.mips" };
+    for( int i = 0; i < 4; i++ )
+    {
+        remove( Files[i] );
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    TestRawTGA();
+    TestRLETGA();
+    TestPalettedPCX();
+    TestMipmaps();
+    TestMipFile();
+    TestPool();
+
+    return ReportChecks();
+}
@@ -97,6 +97,8 @@ TEXTUREINFO &TextureInfoCache::AddTextureInfoFromXML( TiXmlElement *pElement )
         TEXTUREINFO NewTextureInfo;
         NewTextureInfo.sChecksum = sChecksumStream.str();
         NewTextureInfo.iTextureID = 0;
+        NewTextureInfo.iUploadedSize = 0;
+        NewTextureInfo.iFullSize = 0;
         NewTextureInfo.iOwner = 0;
         NewTextureInfo.sSourceFilename = pElement->Attribute("sourcefilename" );
         if( pElement->Attribute("serverfilename" ) != NULL )
@@ -41,6 +41,8 @@ class TEXTUREINFO : public FILEINFO
 {
 public:
    int iTextureID;
+   int iUploadedSize;   //!< width or height, whichever is larger, of the biggest mip level in iTextureID; 0 if it's a placeholder
+   int iFullSize;   //!< width or height, whichever is larger, of the texture at full resolution; 0 if not known yet
 };
 
 typedef map <string, TEXTUREINFO, less<string> >::iterator TextureIteratorTypedef;
@@ -0,0 +1,111 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Versions each object in the world, so reconnecting clients can be sent just what changed
+//!
+//! Every create, update, move and delete of an object moves the world version on one, and the object
+//! takes that version.  The log keeps only the last change of each object, and at most iMaxChanges of them,
+//! dropping the oldest when full.
+//!
+//! Clients learn the world version from <worldversion session="..." version="..."/>, sent before the world
+//! state and every few seconds afterwards whenever it has changed.  Each client is told the version it has
+//! been sent every object move up to, which lags while MoveSendScheduler holds moves back from it.
+//! A client that has kept its copy of the world can send these back in
+//! <requestworldstate worldsession="..." worldversion="..."/>, and is sent only
+//! the objects changed since, as objectrefreshdata, or objectdelete if they've gone.
+//! If the server has restarted, or the log has dropped changes the client hasn't seen, it gets the whole
+//! world, and a worldversion with full="true" first, telling it to drop the objects it has.
+
+#include <time.h>
+
+#include "WorldChangeLog.h"
+
+WorldChangeLogClass::WorldChangeLogClass( int iNewMaxChanges )
+{
+    iSession = (int)time( NULL );
+    iVersion = 0;
+    iMaxChanges = iNewMaxChanges;
+    iTruncatedVersion = 0;
+}
+
+int WorldChangeLogClass::ObjectChanged( int iReference )
+{
+    iVersion++;
+
+    map< int, int >::iterator objectiterator = ObjectVersions.find( iReference );
+    if( objectiterator != ObjectVersions.end() )
+    {
+        Changes.erase( objectiterator->second );
+        objectiterator->second = iVersion;
+    }
+    else
+    {
+        ObjectVersions.insert( pair< int, int >( iReference, iVersion ) );
+    }
+    Changes.insert( pair< int, int >( iVersion, iReference ) );
+
+    while( (int)Changes.size() > iMaxChanges )
+    {
+        map< int, int >::iterator oldest = Changes.begin();
+        iTruncatedVersion = oldest->first;
+        ObjectVersions.erase( oldest->second );
+        Changes.erase( oldest );
+    }
+    return iVersion;
+}
+
+int WorldChangeLogClass::GetSession() const
+{
+    return iSession;
+}
+
+int WorldChangeLogClass::GetVersion() const
+{
+    return iVersion;
+}
+
+int WorldChangeLogClass::GetObjectVersion( int iReference ) const
+{
+    map< int, int >::const_iterator objectiterator = ObjectVersions.find( iReference );
+    if( objectiterator == ObjectVersions.end() )
+    {
+        return 0;
+    }
+    return objectiterator->second;
+}
+
+// Input: iClientSession, iSinceVersion: session and world version the client last heard of
+//        ChangedObjects: objects changed since are added to this, including deleted ones
+//
+// Returns: false if the client needs the whole world: iClientSession isn't ours, or changes
+//  after iSinceVersion have been dropped from the log
+bool WorldChangeLogClass::GetChangesSince( int iClientSession, int iSinceVersion, set< int > &ChangedObjects ) const
+{
+    if( iClientSession != iSession || iSinceVersion < iTruncatedVersion || iSinceVersion > iVersion )
+    {
+        return false;
+    }
+    for( map< int, int >::const_iterator iterator = Changes.upper_bound( iSinceVersion ); iterator != Changes.end(); iterator++ )
+    {
+        ChangedObjects.insert( iterator->second );
+    }
+    return true;
+}
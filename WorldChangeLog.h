@@ -0,0 +1,58 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief Versions each object in the world, so reconnecting clients can be sent just what changed
+
+// see WorldChangeLog.cpp for documentation
+
+#ifndef _WORLDCHANGELOG_H
+#define _WORLDCHANGELOG_H
+
+#include <map>
+#include <set>
+using namespace std;
+
+//! WorldChangeLogClass versions each object in the world, so reconnecting clients can be sent just what changed
+
+//! WorldChangeLogClass versions each object in the world, so reconnecting clients can be sent just what changed
+//! The world version goes up by one for each change; an object's version is the world version of its last change.
+//! This class is only bookkeeping; sending the objects is left to the server
+class WorldChangeLogClass
+{
+public:
+   WorldChangeLogClass( int iMaxChanges );
+
+   int ObjectChanged( int iReference );   //!< records that object iReference was created, updated, moved or deleted; returns the new world version
+   int GetSession() const;   //!< identifies this run of the server; versions from other runs mean nothing
+   int GetVersion() const;   //!< world version, ie number of changes so far
+   int GetObjectVersion( int iReference ) const;   //!< world version of object iReference's last change still in the log, or 0
+   bool GetChangesSince( int iClientSession, int iSinceVersion, set< int > &ChangedObjects ) const;   //!< adds objects changed after iSinceVersion to ChangedObjects; returns false if the log doesn't go back that far
+
+protected:
+   int iSession;
+   int iVersion;
+   int iMaxChanges;
+   int iTruncatedVersion;   //!< changes up to this version may have been dropped from the log
+   map< int, int > ObjectVersions;   //!< version of each object's last change, by object reference
+   map< int, int > Changes;   //!< object changed, by version; only each object's last change is kept
+};
+
+#endif // _WORLDCHANGELOG_H
@@ -59,14 +59,29 @@ using namespace std;
 mvWorldStorage::mvWorldStorage()
 {
     iNumObjects = 0;
+    Object::SetTransformStore( &Transforms );
+}
+mvWorldStorage::~mvWorldStorage()
+{
+    if( Object::pTransformStore == &Transforms )
+    {
+        Object::SetTransformStore( NULL );
+    }
 }
 int mvWorldStorage::GetArrayNumForObjectReference( int iReference )
 {
+    map<int,int>::const_iterator it = ArrayNumsByReference.find( iReference );
+    if( it != ArrayNumsByReference.end() && it->second < iNumObjects && p_Objects[ it->second ]->iReference == iReference )
+    {
+        return it->second;
+    }
+
     int iArrayNum = 0;
     for( iArrayNum = 0; iArrayNum < iNumObjects; iArrayNum++ )
     {
         if( p_Objects[ iArrayNum ]->iReference == iReference )
         {
+            ArrayNumsByReference[ iReference ] = iArrayNum;
             return iArrayNum;
         }
     }
@@ -113,14 +128,17 @@ void mvWorldStorage::DeleteObject( int iArrayNum )
     DEBUG(  "DeleteObject " << iArrayNum ); // DEBUG
     if(iArrayNum < ( iNumObjects - 1 ) )
     {
+        ArrayNumsByReference.erase( p_Objects[ iArrayNum ]->iReference );
         delete( p_Objects[ iArrayNum ] );
         p_Objects[ iArrayNum ] = NULL;
         p_Objects[ iArrayNum ] = p_Objects[ iNumObjects - 1 ];
         p_Objects[ iNumObjects - 1 ] = NULL;
         iNumObjects--;
+        ArrayNumsByReference[ p_Objects[ iArrayNum ]->iReference ] = iArrayNum;
     }
     else
     {
+        ArrayNumsByReference.erase( p_Objects[ iNumObjects - 1 ]->iReference );
         delete( p_Objects[ iNumObjects - 1 ] );
         p_Objects[ iNumObjects - 1 ] = NULL;
         iNumObjects--;
@@ -164,7 +182,7 @@ void mvWorldStorage::DereferenceParent( Object *p_Object )
         return;
     }
 
-    if( strcmp( p_ParentObject->ObjectType, "OBJECTGROUPING" ) != 0 )
+    if( p_ParentObject->TypeTag != OBJECTTYPE_OBJECTGROUPING )
     {
         DEBUG(  "mvWorldStorage::DereferenceParent() WARNING: function called for non-objectgroup" ); // DEBUG
         return;
@@ -222,7 +240,7 @@ bool mvWorldStorage::IsLastPrimInGroup( int iGroupReference )
         return false;
     }
 
-    if( strcmp( p_Object->ObjectType, "OBJECTGROUPING" ) != 0 )
+    if( p_Object->TypeTag != OBJECTTYPE_OBJECTGROUPING )
     {
         DEBUG(  "mvWorldStorage::IsLastPrimInGroup() WARNING: function called for non-objectgroup" ); // DEBUG
         return false;
@@ -267,7 +285,7 @@ void mvWorldStorage::DeleteObjectByObjectReference( int iReference, bool bRecurs
             //   return;
             // }
         }
-        if( strcmp( p_TargetObject->ObjectType, "OBJECTGROUPING" ) == 0 )
+        if( p_TargetObject->TypeTag == OBJECTTYPE_OBJECTGROUPING )
         {
             DEBUG(  "objectgrouping, handling child objects before deleting objectgrouping object..." );
             for( int i = 0; i < iNumObjects; i++ )
@@ -297,7 +315,15 @@ void mvWorldStorage::DeleteObjectByObjectReference( int iReference, bool bRecurs
 }
 int mvWorldStorage::AddObject( Object *p_Object )
 {
-    p_Objects[ iNumObjects ] = p_Object;
+    if( iNumObjects == (int)p_Objects.size() )
+    {
+        p_Objects.push_back( p_Object );
+    }
+    else
+    {
+        p_Objects[ iNumObjects ] = p_Object;
+    }
+    ArrayNumsByReference[ p_Object->iReference ] = iNumObjects;
     iNumObjects++;
     return( iNumObjects - 1 );
 }
@@ -482,7 +508,7 @@ Object *mvWorldStorage::UpdateObjectXML( TiXmlElement *pElement )
     {
         p_Object->UpdateFromXML( pElement );
 
-        if( strcmp( p_Object->ObjectType, "OBJECTGROUPING" ) == 0  )
+        if( p_Object->TypeTag == OBJECTTYPE_OBJECTGROUPING  )
         {
             ObjectGrouping *pGroup = dynamic_cast<ObjectGrouping *>( p_Object );
             DEBUG(  "UpdateObjectXML() updating objectgrouping... numchildren before update = " << pGroup->iNumSubObjects ); // DEBUG
@@ -547,60 +573,23 @@ Object *mvWorldStorage::StoreObjectXML( TiXmlElement *pElement )
         {
             DEBUG( "storing " << pElement->Attribute( "type") << " ..." );
 
-            if( strcmp( pElement->Attribute( "type"), "CUBE" ) == 0 )
-            {
-                iObjectArrayNum = AddObject( new Cube );
-                p_Object = GetObject( iObjectArrayNum );
-                p_Object->LoadFromXML( pElement );
-            }
-            else if( strcmp( pElement->Attribute( "type"), "SPHERE" ) == 0 )
-            {
-                iObjectArrayNum = AddObject( new Sphere );
-                p_Object = GetObject( iObjectArrayNum );
-                p_Object->LoadFromXML( pElement );
-            }
-            else if( strcmp( pElement->Attribute( "type"), "CYLINDER" ) == 0 )
+            const OBJECTTYPEINFO *pTypeInfo = Object::GetTypeInfo( pElement->Attribute( "type") );
+            if( pTypeInfo != NULL )
             {
-                iObjectArrayNum = AddObject( new Cylinder );
+                iObjectArrayNum = AddObject( pTypeInfo->pfCreate() );
                 p_Object = GetObject( iObjectArrayNum );
                 p_Object->LoadFromXML( pElement );
-            }
-            else if( strcmp( pElement->Attribute( "type"), "CONE" ) == 0 )
-            {
-                iObjectArrayNum = AddObject( new Cone );
-                p_Object = GetObject( iObjectArrayNum );
-                p_Object->LoadFromXML( pElement );
-            }
-            else if( strcmp( pElement->Attribute( "type"), "TERRAIN" ) == 0 )
-            {
-                iObjectArrayNum = AddObject( new Terrain );
-                p_Object = GetObject( iObjectArrayNum );
-                p_Object->LoadFromXML( pElement );
-            }
-            else if( strcmp( pElement->Attribute( "type"), "MD2MESH" ) == 0 )
-            {
-                iObjectArrayNum = AddObject( new mvMd2Mesh );
-                p_Object = GetObject( iObjectArrayNum );
-                p_Object->LoadFromXML( pElement );
-            }
-            else if( strcmp( pElement->Attribute( "type"), "AVATAR" ) == 0 )
-            {
-                iObjectArrayNum = AddObject( new Avatar );
-                p_Objects[ iObjectArrayNum ]->LoadFromXML( pElement );
-                ObjectGrouping *pGroup = dynamic_cast<ObjectGrouping *>(p_Objects[ iObjectArrayNum ]);
-                CrossReferenceChildrenIfNecessary( pGroup );
-            }
-            else if( strcmp( pElement->Attribute( "type"), "OBJECTGROUPING" ) == 0 )
-            {
-                iObjectArrayNum = AddObject( new ObjectGrouping );
-                ObjectGrouping *pGroup = dynamic_cast<ObjectGrouping *>(p_Objects[ iObjectArrayNum ]);
-                pGroup->LoadFromXML( pElement );
 
-                TiXmlHandle docHandle( pElement );
-                CrossReferenceChildrenIfNecessary( pGroup );
-                if( docHandle.FirstChild("members").Element() )
+                if( pTypeInfo->Type == OBJECTTYPE_OBJECTGROUPING )
                 {
-                    LinkFromXML( pGroup, pElement );
+                    ObjectGrouping *pGroup = dynamic_cast<ObjectGrouping *>( p_Object );
+                    CrossReferenceChildrenIfNecessary( pGroup );
+
+                    TiXmlHandle docHandle( pElement );
+                    if( pTypeInfo->DeepType == DEEPTYPE_OBJECTGROUPING && docHandle.FirstChild("members").Element() )
+                    {
+                        LinkFromXML( pGroup, pElement );
+                    }
                 }
             }
             else
@@ -634,4 +623,5 @@ void mvWorldStorage::Clear()
         delete GetObject( i );
     }
     iNumObjects = 0;
+    ArrayNumsByReference.clear();
 }
@@ -65,10 +65,13 @@
 #include <string.h>
 #include <math.h>
 #include <stdio.h>
+#include <map>
+#include <vector>
 using namespace std;
 
 #include "Object.h"
 #include "ObjectGrouping.h"
+#include "ObjectTransformStore.h"
 
 //! mvworldstorage is the class used to store the world associated with one server
 
@@ -102,6 +105,7 @@ public:
    char skyboxChecksum[33];  //!< reference id (md5 checksum) of skybox
 
    mvWorldStorage();
+   ~mvWorldStorage();
 
    int GetArrayNumForObjectReference( int iReference );             //!< iReference is the unique reference number assigned by the db
                                                                     //!< iArrayNum is the sequence number within the p_Objects array
@@ -113,6 +117,8 @@ public:
    {
       return iMaxObjects;
    }
+   //! positions, rotations and velocities of all objects, in arrays, for per-frame passes over the whole world
+   inline ObjectTransformStore &GetTransforms(){ return Transforms; }
 
    //! Deletes the object specified by iReference
 
@@ -147,8 +153,10 @@ public:
    void DeleteObject( int iArrayNum );   //!< Deletes object specified by iArrayNum (reference number within p_Objects)
 
 protected:
-   static const int iMaxObjects = 1000;  //<! maximum number of objects we can hold in world
-   Object *p_Objects[iMaxObjects];  //!< All the objects in the world
+   static const int iMaxObjects = 65536;  //<! maximum number of objects we can hold in world
+   vector<Object *> p_Objects;  //!< All the objects in the world; grows as objects are added
+   map<int,int> ArrayNumsByReference;  //!< last known iArrayNum of each iReference; checked against the object before use, since iReference can be set after AddObject
+   ObjectTransformStore Transforms;  //!< hot transform and dynamics state of the objects, registered with Object as the store objects take slots from
 
    void UnlinkChildren( ObjectGrouping *p_Group );  //!< Unlinks children of p_Group
    void LinkFromXML( ObjectGrouping *p_Group, TiXmlElement *pElement );
@@ -22,6 +22,10 @@
 //! \brief contains functions to make using XML easier
 // see header file for documentation
 
+#include <stdio.h>
+#include <string.h>
+
+#include "CRuntimeNameCompat.h"
 #include "XmlHelper.h"
 
 void AddXmlChildIfNecessary( TiXmlElement *pElement, string sNodeName )
@@ -34,3 +38,102 @@ void AddXmlChildIfNecessary( TiXmlElement *pElement, string sNodeName )
     }
 }
 
+XmlWriter::XmlWriter( string &Buffer ) :
+        Buffer( Buffer )
+{
+    iDepth = 0;
+    bStartTagOpen = false;
+}
+
+void XmlWriter::StartElement( const char *sName )
+{
+    if( bStartTagOpen )
+    {
+        Buffer += '>';
+    }
+    Buffer += '<';
+    Buffer += sName;
+    if( iDepth < MAX_DEPTH )
+    {
+        OpenElements[ iDepth ] = sName;
+    }
+    iDepth++;
+    bStartTagOpen = true;
+}
+
+// Input: sName is the attribute name, sValue its value, unescaped
+// Description: Appends ` sName="sValue"`, escaping &, <, >, quotes and control characters in sValue as TinyXML does.
+// Like TinyXML, quotes the value with ' instead if it has a " in it
+void XmlWriter::Attribute( const char *sName, const char *sValue )
+{
+    char cQuote = strchr( sValue, '"' ) == NULL ? '"' : '\'';
+    Buffer += ' ';
+    Buffer += sName;
+    Buffer += '=';
+    Buffer += cQuote;
+    for( const char *p = sValue; *p != '\0'; p++ )
+    {
+        switch( *p )
+        {
+        case '&':
+            Buffer += "&amp;";
+            break;
+        case '<':
+            Buffer += "&lt;";
+            break;
+        case '>':
+            Buffer += "&gt;";
+            break;
+        case '"':
+            Buffer += "&quot;";
+            break;
+        case '\'':
+            Buffer += "&apos;";
+            break;
+        default:
+            if( (unsigned char)*p < 32 )
+            {
+                char Entity[8];
+                sprintf( Entity, "&#x%02X;", (unsigned char)*p );
+                Buffer += Entity;
+            }
+            else
+            {
+                Buffer += *p;
+            }
+            break;
+        }
+    }
+    Buffer += cQuote;
+}
+
+void XmlWriter::Attribute( const char *sName, int iValue )
+{
+    char Value[16];
+    sprintf( Value, "%d", iValue );
+    Attribute( sName, Value );
+}
+
+void XmlWriter::Attribute( const char *sName, double dValue )
+{
+    char Value[512];   // %f of the biggest doubles is over 300 characters
+    snprintf( Value, sizeof( Value ), "%f", dValue );
+    Value[ sizeof( Value ) - 1 ] = '\0';   // _snprintf doesnt terminate if it runs out of room
+    Attribute( sName, Value );
+}
+
+void XmlWriter::EndElement()
+{
+    iDepth--;
+    if( bStartTagOpen )
+    {
+        Buffer += " />";   // as TinyXML prints empty elements
+        bStartTagOpen = false;
+    }
+    else if( iDepth < MAX_DEPTH )
+    {
+        Buffer += "</";
+        Buffer += OpenElements[ iDepth ];
+        Buffer += '>';
+    }
+}
@@ -21,6 +21,9 @@
 //! \file
 //! \brief contains functions to make using XML easier
 
+#ifndef _XMLHELPER_H
+#define _XMLHELPER_H
+
 #include <string>
 using namespace std;
 
@@ -28,3 +31,37 @@ using namespace std;
 
 void AddXmlChildIfNecessary( TiXmlElement *pElement, string sNodeName );   //!< adds an xml child element with name snodename
                                                                            //!< but only if it doesnt already exist
+
+//! XmlWriter writes XML straight into a string, without building a TiXmlDocument first
+
+//! XmlWriter writes XML straight into a string, without building a TiXmlDocument first
+//! Elements are written in order: open one with StartElement, add its attributes, then
+//! its children, then close it with EndElement.  Attributes must come before any children.
+//! Output matches what TinyXML prints for the same elements and attributes, byte for byte: doubles
+//! are written with %f, attribute values are escaped and quoted the same way, and empty elements
+//! are closed with " />".
+//!
+//! The writer appends to the string it's given and doesnt clear it, so one string can be reused
+//! for many messages, keeping its memory.  Element names must stay valid until they're closed;
+//! in practice they're always literals.
+class XmlWriter
+{
+public:
+   XmlWriter( string &Buffer );
+
+   void StartElement( const char *sName );   //!< opens a child element of the current element
+   void Attribute( const char *sName, const char *sValue );   //!< adds an attribute to the element just opened
+   void Attribute( const char *sName, int iValue );
+   void Attribute( const char *sName, double dValue );
+   void EndElement();   //!< closes the current element
+
+protected:
+   enum { MAX_DEPTH = 16 };
+
+   string &Buffer;
+   const char *OpenElements[ MAX_DEPTH ];   //!< names of the elements we're inside, to close them
+   int iDepth;
+   bool bStartTagOpen;   //!< true if the last element opened still has no children, so we can still add attributes
+};
+
+#endif // _XMLHELPER_H
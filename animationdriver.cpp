@@ -0,0 +1,172 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief animationdriver: benchmark of Animation with tens of thousands of objects moving at once
+//!
+//! Fills a world with cubes, starts an objectmove on every one of them, position and rotation, plus scale and
+//! color on every fourth, then runs animation frames with all of them moving, printing the time to start the
+//! moves and the time per frame.  Then moves them all to the end, and checks every animation has finished
+//! and every cube is where its move ended.
+//!
+//! usage: animationdriver [--objects <number of objects>] [--frames <number of frames>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "WorldStorage.h"
+#include "Animation.h"
+#include "Cube.h"
+#include "TickCount.h"
+#include "Diag.h"
+
+const int iLongDuration = 10000000;  //!< milliseconds; long enough that no move finishes during the frames
+
+//! move for the cube with iReference, to end after iDurationMilliseconds
+static OBJECTMOVEMESSAGE MakeMove( const int iReference, const int iDurationMilliseconds )
+{
+    OBJECTMOVEMESSAGE Move;
+    Move.iReference = iReference;
+    Move.bPos = true;
+    Move.Pos = Vector3( (float)( iReference % 100 ), (float)( iReference / 100 ), 10.0f );
+    Move.bRot = true;
+    AxisAngle2Rot( Move.Rotation, Vector3( 0, 0, 1 ), (float)( iReference % 360 ) * 3.14159f / 180.0f );
+    Move.bScale = ( iReference % 4 == 0 );
+    Move.Scale = Vector3( 2.0f, 2.0f, 2.0f );
+    Move.bColor = ( iReference % 4 == 0 );
+    Move.iFaceNumber = 0;
+    Move.FaceColor.r = 1.0f;
+    Move.FaceColor.g = 0.5f;
+    Move.FaceColor.b = 0.0f;
+    Move.iDurationMilliseconds = iDurationMilliseconds;
+    Move.iTimestampMilliseconds = -1;
+    Move.bVelocity = false;
+    return Move;
+}
+
+//! milliseconds since iStartTickCount, at least 1
+static int MillisecondsSince( const int iStartTickCount )
+{
+    int iMilliseconds = MVGetTickCount() - iStartTickCount;
+    return iMilliseconds < 1 ? 1 : iMilliseconds;
+}
+
+int main( int argc, char *argv[] )
+{
+    int iNumObjects = 50000;
+    int iNumFrames = 100;
+    for( int i = 1; i + 1 < argc; i += 2 )
+    {
+        if( strcmp( argv[i], "--objects" ) == 0 )
+        {
+            iNumObjects = atoi( argv[i + 1] );
+        }
+        else if( strcmp( argv[i], "--frames" ) == 0 )
+        {
+            iNumFrames = atoi( argv[i + 1] );
+        }
+        else
+        {
+            printf( "usage: %s [--objects <number of objects>] [--frames <number of frames>]\n", argv[0] );
+            return 1;
+        }
+    }
+    if( iNumObjects > mvWorldStorage::GetMaxObjects() )
+    {
+        printf( "the world holds at most %i objects\n", mvWorldStorage::GetMaxObjects() );
+        return 1;
+    }
+
+#ifndef _NOLOGGINGLIB
+    CMessageGroup::disableAllMsgGroups();   // a debug line per cube would drown the results
+#endif
+
+    mvWorldStorage *pWorld = new mvWorldStorage;
+    Animation *pAnimation = new Animation( *pWorld );
+    for( int i = 0; i < iNumObjects; i++ )
+    {
+        Cube *pCube = new Cube;
+        pCube->iReference = i + 1;
+        pWorld->AddObject( pCube );
+    }
+
+    int iStartTickCount = MVGetTickCount();
+    for( int i = 0; i < iNumObjects; i++ )
+    {
+        pAnimation->MoveObject( MakeMove( i + 1, iLongDuration ) );
+    }
+    int iMilliseconds = MillisecondsSince( iStartTickCount );
+    printf( "started %i moves in %i ms: %.0f moves/s\n", iNumObjects, iMilliseconds, (double)iNumObjects * 1000.0 / iMilliseconds );
+
+    bool bOk = true;
+    if( pAnimation->GetNumMovingObjects() != iNumObjects )
+    {
+        printf( "%i objects moving, expected %i\n", pAnimation->GetNumMovingObjects(), iNumObjects );
+        bOk = false;
+    }
+
+    iStartTickCount = MVGetTickCount();
+    for( int iFrame = 0; iFrame < iNumFrames; iFrame++ )
+    {
+        pAnimation->AnimateWorld();
+    }
+    iMilliseconds = MillisecondsSince( iStartTickCount );
+    printf( "%i frames of %i animations in %i ms: %.2f ms/frame, %.0f animations/s\n", iNumFrames, pAnimation->GetNumMovingObjects(),
+            iMilliseconds, (double)iMilliseconds / iNumFrames, (double)pAnimation->GetNumMovingObjects() * iNumFrames * 1000.0 / iMilliseconds );
+
+    // replacing each move with one of no duration takes every object straight to the end next frame
+    for( int i = 0; i < iNumObjects; i++ )
+    {
+        pAnimation->MoveObject( MakeMove( i + 1, 0 ) );
+    }
+    const int iMovedTickCount = MVGetTickCount();
+    while( MVGetTickCount() <= iMovedTickCount )
+    {
+    }
+    pAnimation->AnimateWorld();
+    if( pAnimation->GetNumMovingObjects() != 0 )
+    {
+        printf( "%i objects still moving after their moves ended\n", pAnimation->GetNumMovingObjects() );
+        bOk = false;
+    }
+    int iNumMisplaced = 0;
+    for( int i = 0; i < iNumObjects; i++ )
+    {
+        Object *pObject = pWorld->GetObjectByReference( i + 1 );
+        OBJECTMOVEMESSAGE Move = MakeMove( i + 1, 0 );
+        if( pObject->pos.x != Move.Pos.x || pObject->pos.y != Move.Pos.y || pObject->pos.z != Move.Pos.z
+                || fabs( pObject->rot.z - Move.Rotation.z ) > 0.0001 || fabs( pObject->rot.s - Move.Rotation.s ) > 0.0001
+                || ( Move.bScale && static_cast<Prim *>( pObject )->scale.x != Move.Scale.x ) )
+        {
+            iNumMisplaced++;
+        }
+    }
+    if( iNumMisplaced > 0 )
+    {
+        printf( "%i objects not where their moves ended\n", iNumMisplaced );
+        bOk = false;
+    }
+
+    delete pAnimation;
+    pWorld->Clear();
+    delete pWorld;
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,219 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief ipcparsedriver: benchmark of XML IPC parsing, IPCPullParser against TinyXML
+//!
+//! Parses the same objectmove, objecttrack and login lines over and over, once the way the
+//! mainloops used to, building a TiXmlDocument and reading the fields out of the tree, and once with
+//! GetIPCMessageType and the Parse functions in IPCMessages.cpp.  For each prints messages parsed
+//! per second, and checks both ways read the same values.
+//!
+//! usage: ipcparsedriver [--messages <number of messages per run>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+using namespace std;
+
+#include "tinyxml.h"
+
+#include "IPCMessages.h"
+#include "TickCount.h"
+
+//! Lines as the processes send them; the fields read from each are summed into a checksum
+const char *TestMessages[] =
+{
+    "<objectmove ireference=\"1234\"><geometry><pos x=\"12.5\" y=\"-3.25\" z=\"40\"/><rot x=\"0\" y=\"0\" z=\"0.7071\" s=\"0.7071\"/></geometry>"
+    "<faces><face num=\"2\"><color r=\"0.5\" g=\"0.25\" b=\"1\"/></face></faces>"
+    "<dynamics><duration milliseconds=\"200\"/><timestamp milliseconds=\"123456\"/></dynamics></objectmove>",
+
+    "<objecttrack ireference=\"4321\" loop=\"true\" period=\"3000\">"
+    "<key t=\"0\" ease=\"easeinout\"><pos x=\"0\" y=\"0\" z=\"0\"/></key>"
+    "<key t=\"1000\"><pos x=\"10\" y=\"0\" z=\"0\"/></key>"
+    "<key t=\"2000\"><pos x=\"10\" y=\"10\" z=\"0\"/></key></objecttrack>",
+
+    "<login name=\"Someone Somewhere\" password=\"p&amp;ssword\"/>"
+};
+
+const int iNumTestMessages = sizeof( TestMessages ) / sizeof( TestMessages[0] );
+
+//! returns attribute sName of pElement as a float, or 0 if pElement is NULL or doesnt have it
+static float FloatAttribute( TiXmlElement *pElement, const char *sName )
+{
+    if( pElement == NULL || pElement->Attribute( sName ) == NULL )
+    {
+        return 0;
+    }
+    return (float)atof( pElement->Attribute( sName ) );
+}
+
+//! parses sMessage into a TiXmlDocument and reads the same fields the typed parsers do, returning their checksum
+double ParseWithTinyXML( const char *sMessage )
+{
+    TiXmlDocument IPC;
+    IPC.Parse( sMessage );
+    TiXmlElement *pElement = IPC.RootElement();
+    if( pElement == NULL )
+    {
+        return 0;
+    }
+
+    double dChecksum = 0;
+    if( strcmp( pElement->Value(), "objectmove" ) == 0 )
+    {
+        TiXmlHandle docHandle( pElement );
+        dChecksum += atoi( pElement->Attribute( "ireference" ) );
+        TiXmlElement *pPos = docHandle.FirstChild( "geometry" ).FirstChild( "pos" ).Element();
+        dChecksum += FloatAttribute( pPos, "x" ) + FloatAttribute( pPos, "y" ) + FloatAttribute( pPos, "z" );
+        TiXmlElement *pRot = docHandle.FirstChild( "geometry" ).FirstChild( "rot" ).Element();
+        dChecksum += FloatAttribute( pRot, "x" ) + FloatAttribute( pRot, "y" ) + FloatAttribute( pRot, "z" ) + FloatAttribute( pRot, "s" );
+        TiXmlElement *pFace = docHandle.FirstChild( "faces" ).FirstChild( "face" ).Element();
+        dChecksum += FloatAttribute( pFace, "num" );
+        TiXmlElement *pColor = docHandle.FirstChild( "faces" ).FirstChild( "face" ).FirstChild( "color" ).Element();
+        dChecksum += FloatAttribute( pColor, "r" ) + FloatAttribute( pColor, "g" ) + FloatAttribute( pColor, "b" );
+        dChecksum += FloatAttribute( docHandle.FirstChild( "dynamics" ).FirstChild( "duration" ).Element(), "milliseconds" );
+        dChecksum += FloatAttribute( docHandle.FirstChild( "dynamics" ).FirstChild( "timestamp" ).Element(), "milliseconds" );
+    }
+    else if( strcmp( pElement->Value(), "objecttrack" ) == 0 )
+    {
+        dChecksum += atoi( pElement->Attribute( "ireference" ) );
+        dChecksum += FloatAttribute( pElement, "period" );
+        for( TiXmlElement *pKey = pElement->FirstChildElement( "key" ); pKey != NULL; pKey = pKey->NextSiblingElement( "key" ) )
+        {
+            dChecksum += FloatAttribute( pKey, "t" );
+            TiXmlElement *pPos = pKey->FirstChildElement( "pos" );
+            dChecksum += FloatAttribute( pPos, "x" ) + FloatAttribute( pPos, "y" ) + FloatAttribute( pPos, "z" );
+        }
+    }
+    else if( strcmp( pElement->Value(), "login" ) == 0 )
+    {
+        dChecksum += strlen( pElement->Attribute( "name" ) ) + strlen( pElement->Attribute( "password" ) );
+    }
+    return dChecksum;
+}
+
+//! reads sMessage with the typed parsers, returning the checksum of the same fields as ParseWithTinyXML
+double ParseWithPullParser( const char *sMessage )
+{
+    double dChecksum = 0;
+    switch( GetIPCMessageType( sMessage ) )
+    {
+    case IPC_OBJECTMOVE:
+        {
+            OBJECTMOVEMESSAGE Move;
+            if( ParseObjectMove( sMessage, Move ) )
+            {
+                dChecksum += Move.iReference;
+                dChecksum += Move.Pos.x + Move.Pos.y + Move.Pos.z;
+                dChecksum += Move.Rotation.x + Move.Rotation.y + Move.Rotation.z + Move.Rotation.s;
+                dChecksum += Move.iFaceNumber;
+                dChecksum += Move.FaceColor.r + Move.FaceColor.g + Move.FaceColor.b;
+                dChecksum += Move.iDurationMilliseconds + Move.iTimestampMilliseconds;
+            }
+        }
+        break;
+    case IPC_OBJECTTRACK:
+        {
+            OBJECTTRACKMESSAGE Track;
+            if( ParseObjectTrack( sMessage, Track ) )
+            {
+                dChecksum += Track.iReference;
+                dChecksum += Track.iPeriodMilliseconds;
+                for( int i = 0; i < Track.iNumKeys; i++ )
+                {
+                    dChecksum += Track.Keys[i].iTimeMilliseconds;
+                    dChecksum += Track.Keys[i].Pos.x + Track.Keys[i].Pos.y + Track.Keys[i].Pos.z;
+                }
+            }
+        }
+        break;
+    case IPC_LOGIN:
+        {
+            LOGINMESSAGE Login;
+            if( ParseLogin( sMessage, Login ) )
+            {
+                dChecksum += strlen( Login.sName ) + strlen( Login.sPassword );
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return dChecksum;
+}
+
+//! parses sMessage iNumMessages times with ParseFunction, printing messages per second; returns the checksum of one parse
+double RunBenchmark( const char *sParserName, double (*ParseFunction)( const char * ), const char *sMessage, int iNumMessages )
+{
+    double dChecksum = ParseFunction( sMessage );
+    int iNumDifferent = 0;
+    int iStartTickCount = MVGetTickCount();
+    for( int i = 0; i < iNumMessages; i++ )
+    {
+        if( ParseFunction( sMessage ) != dChecksum )
+        {
+            iNumDifferent++;
+        }
+    }
+    int iMilliseconds = MVGetTickCount() - iStartTickCount;
+    if( iMilliseconds < 1 )
+    {
+        iMilliseconds = 1;
+    }
+    printf( "  %-10s %8i messages in %6i ms: %10.0f messages/s\n", sParserName, iNumMessages, iMilliseconds,
+            (double)iNumMessages * 1000.0 / iMilliseconds );
+    if( iNumDifferent > 0 )
+    {
+        printf( "  %s gave different results on different runs\n", sParserName );
+    }
+    return dChecksum;
+}
+
+int main( int argc, char *argv[] )
+{
+    int iNumMessages = 200000;
+    for( int i = 1; i + 1 < argc; i += 2 )
+    {
+        if( strcmp( argv[i], "--messages" ) == 0 )
+        {
+            iNumMessages = atoi( argv[i + 1] );
+        }
+        else
+        {
+            printf( "usage: %s [--messages <number of messages per run>]\n", argv[0] );
+            return 1;
+        }
+    }
+
+    bool bOk = true;
+    for( int i = 0; i < iNumTestMessages; i++ )
+    {
+        printf( "%s\n", GetIPCMessageName( GetIPCMessageType( TestMessages[i] ) ) );
+        double dTinyXMLChecksum = RunBenchmark( "TinyXML", ParseWithTinyXML, TestMessages[i], iNumMessages );
+        double dPullParserChecksum = RunBenchmark( "IPCMessages", ParseWithPullParser, TestMessages[i], iNumMessages );
+        if( dTinyXMLChecksum != dPullParserChecksum )
+        {
+            printf( "  parsers disagree: TinyXML read %f, IPCMessages read %f\n", dTinyXMLChecksum, dPullParserChecksum );
+            bOk = false;
+        }
+    }
+    return bOk ? 0 : 1;
+}
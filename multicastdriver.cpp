@@ -0,0 +1,192 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief multicastdriver: benchmark of multicast RPC fan-out, shared message against a copy per member
+//!
+//! Puts --members objects in one multicast group and sends --messages RPCs of --bytes bytes to it:
+//! once through DeliverMulticastRPC, which queues an event pointing at one shared copy of the message
+//! for each member, and once the way SendMulticastRPC used to, walking a set of members and queueing an
+//! event holding its own copy of the message for each.  After each RPC the VM queues are drained, reading
+//! each event's message, as StartQueuedFunctions does when it starts them; pushing the message into Lua
+//! isnt included.  For each prints deliveries per second and message bytes copied, and checks both ways
+//! delivered the same.
+//!
+//! The VMs are all marked running, so events wait on their VM's queue instead of starting a thread; the
+//! QueueEventForVM here is what the engine's does for a running VM.
+//!
+//! usage: multicastdriver [--members <group size>] [--messages <RPCs per run>] [--bytes <message length>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <set>
+#include <string>
+using namespace std;
+
+#include "scriptingenginelua.h"
+#include "LuaEventClass.h"
+#include "LuaMulticastGroups.h"
+#include "TickCount.h"
+
+map < int, ObjectVMInfoClass > ObjectVMs;   //!< one VM per group member; their pVM is never used
+
+//! the engine's QueueEventForVM, for a VM that is running an event: the event waits on its queue
+void QueueEventForVM( ObjectVMInfoClass &rObjectVMInfo, EventInfo *pEvent )
+{
+    rObjectVMInfo.PendingEvents.push_back( pEvent );
+}
+
+//! multicast RPC event as it was before SharedRPCMessage: each member's event holds its own copy of the message
+class EventInfoMulticastRPCCopy : public EventInfoRPC
+{
+public:
+    int iSenderReference;  //!< iReference of sending object
+    string sMessage;   //!< message
+    EventInfoMulticastRPCCopy() : EventInfoRPC( EVENTTYPE_ASYNCRPC, "AsyncRPC", "EventInfoMulticastRPC" ) {}
+};
+
+//! queues sMessage for each member of Members, as SendMulticastRPC did before SharedRPCMessage:
+//! GetVMForReference, then a copy of the message in a new event, then QueueEvent, which looks the VM up again
+void DeliverWithCopies( const set < int > &Members, int iSenderReference, const string &sMessage )
+{
+    for( set < int >::const_iterator iterator = Members.begin(); iterator != Members.end(); iterator++ )
+    {
+        ObjectVMIterator vmiterator = ObjectVMs.find( *iterator );
+        if( vmiterator != ObjectVMs.end() && vmiterator->second.pVM != NULL )
+        {
+            EventInfoMulticastRPCCopy *pEvent = new EventInfoMulticastRPCCopy;
+
+            pEvent->iVMNum = *iterator;
+            pEvent->iSenderReference = iSenderReference;
+            pEvent->sMessage = sMessage;
+
+            QueueEventForVM( ObjectVMs.find( pEvent->iVMNum )->second, pEvent );
+        }
+    }
+}
+
+static const string &GetMessage( const EventInfoMulticastRPC *pEvent )
+{
+    return pEvent->pMessage->sMessage;
+}
+
+static const string &GetMessage( const EventInfoMulticastRPCCopy *pEvent )
+{
+    return pEvent->sMessage;
+}
+
+//! empties the queue of every VM, whose events are all EventClass, returning the sum of their message lengths
+template< class EventClass > long DrainQueues()
+{
+    long lNumBytes = 0;
+    for( ObjectVMIterator iterator = ObjectVMs.begin(); iterator != ObjectVMs.end(); iterator++ )
+    {
+        deque< EventInfo * > &rPendingEvents = iterator->second.PendingEvents;
+        while( !rPendingEvents.empty() )
+        {
+            EventClass *pEvent = static_cast< EventClass * >( rPendingEvents.front() );
+            rPendingEvents.pop_front();
+            lNumBytes += (long)GetMessage( pEvent ).size();
+            delete pEvent;
+        }
+    }
+    return lNumBytes;
+}
+
+//! prints the rate of one run; iNumBytesCopied is message bytes copied per RPC
+void PrintResult( const char *sName, int iNumMessages, int iNumMembers, int iMilliseconds, long lNumBytesCopied )
+{
+    if( iMilliseconds < 1 )
+    {
+        iMilliseconds = 1;
+    }
+    printf( "  %-16s %6i RPCs in %6i ms: %10.0f deliveries/s, %8li message bytes copied per RPC\n", sName, iNumMessages,
+            iMilliseconds, (double)iNumMessages * iNumMembers * 1000.0 / iMilliseconds, lNumBytesCopied );
+}
+
+int main( int argc, char *argv[] )
+{
+    int iNumMembers = 1000;
+    int iNumMessages = 1000;
+    int iMessageLength = 256;
+    for( int i = 1; i + 1 < argc; i += 2 )
+    {
+        if( strcmp( argv[i], "--members" ) == 0 )
+        {
+            iNumMembers = atoi( argv[i + 1] );
+        }
+        else if( strcmp( argv[i], "--messages" ) == 0 )
+        {
+            iNumMessages = atoi( argv[i + 1] );
+        }
+        else if( strcmp( argv[i], "--bytes" ) == 0 )
+        {
+            iMessageLength = atoi( argv[i + 1] );
+        }
+        else
+        {
+            printf( "usage: %s [--members <group size>] [--messages <RPCs per run>] [--bytes <message length>]\n", argv[0] );
+            return 1;
+        }
+    }
+
+    // the sender, reference 0, isnt a member
+    static char DummyVM;
+    set < int > OldStyleMembers;
+    for( int iReference = 1; iReference <= iNumMembers; iReference++ )
+    {
+        ObjectVMInfoClass &rObjectVMInfo = ObjectVMs[ iReference ];
+        rObjectVMInfo.pVM = reinterpret_cast< lua_State * >( &DummyVM );
+        rObjectVMInfo.iObjectReference = iReference;
+        rObjectVMInfo.bVMIsRunning = true;
+        JoinMulticastGroup( iReference, "benchmark" );
+        OldStyleMembers.insert( iReference );
+    }
+    string sMessage( iMessageLength, 'x' );
+
+    printf( "1 sender, %i members, %i byte messages\n", iNumMembers, iMessageLength );
+
+    long lSharedBytes = 0;
+    int iStartTickCount = MVGetTickCount();
+    for( int i = 0; i < iNumMessages; i++ )
+    {
+        DeliverMulticastRPC( "benchmark", 0, sMessage.c_str() );
+        lSharedBytes += DrainQueues< EventInfoMulticastRPC >();
+    }
+    PrintResult( "shared message", iNumMessages, iNumMembers, MVGetTickCount() - iStartTickCount, iMessageLength );
+
+    long lCopiedBytes = 0;
+    iStartTickCount = MVGetTickCount();
+    for( int i = 0; i < iNumMessages; i++ )
+    {
+        DeliverWithCopies( OldStyleMembers, 0, sMessage );
+        lCopiedBytes += DrainQueues< EventInfoMulticastRPCCopy >();
+    }
+    PrintResult( "copy per member", iNumMessages, iNumMembers, MVGetTickCount() - iStartTickCount, (long)iMessageLength * iNumMembers );
+
+    if( lSharedBytes != lCopiedBytes )
+    {
+        printf( "  deliveries differ: shared message delivered %li bytes, copy per member %li\n", lSharedBytes, lCopiedBytes );
+        return 1;
+    }
+    return 0;
+}
@@ -218,6 +218,18 @@ void mvMd2Mesh::WriteToXMLDoc( TiXmlElement *pElement )
 
     MESH::WriteToXMLDoc( pElement );
 }
+void mvMd2Mesh::WriteXMLAttributes( XmlWriter &Writer )
+{
+    Writer.Attribute( "type", "mvMd2Mesh" );
+    MESH::WriteXMLAttributes( Writer );
+}
+void mvMd2Mesh::WriteXMLGeometry( XmlWriter &Writer )
+{
+    MESH::WriteXMLGeometry( Writer );
+    Writer.StartElement( "mesh" );
+    Writer.Attribute( "smeshreference", sMeshReference );
+    Writer.EndElement();
+}
 const mvMd2Mesh &mvMd2Mesh::operator=( const mvMd2Mesh &IncomingPrim )
 {
     strcpy( this->sMeshReference, IncomingPrim.sMeshReference );
@@ -356,6 +368,7 @@ mvMd2Mesh::mvMd2Mesh()
 {
     DEBUG( "mvMd2Mesh::mvMd2Mesh" );
     sprintf( sDeepObjectType, "mvMd2Mesh" );
+    DeepTypeTag = DEEPTYPE_MD2MESH;
 
     sprintf( sMeshReference, "" );
     bMeshLoaded = false;
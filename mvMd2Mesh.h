@@ -59,6 +59,8 @@ public:
    virtual void UpdateFromXML( TiXmlElement *pElement );
    virtual void LoadFromXML( TiXmlElement *pElement );
    virtual void WriteToXMLDoc( TiXmlElement *pElement );
+   virtual void WriteXMLAttributes( XmlWriter &Writer );
+   virtual void WriteXMLGeometry( XmlWriter &Writer );
    const mvMd2Mesh &mvMd2Mesh::operator=( const mvMd2Mesh &IncomingPrim );
    //virtual void CopyTo( mvMd2Mesh *ptargetmd2mesh );
    virtual void Draw();
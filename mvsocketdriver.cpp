@@ -0,0 +1,268 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+
+//! \file
+//! \brief mvsocketdriver: loopback throughput benchmark for mvsocket file downloads
+//!
+//! Serves a test file to a number of concurrent loopback connections, twice: once the way the
+//! server file agent used to, reading and sending 1200 bytes per connection per select wakeup,
+//! and once the way it does now, with non-blocking SendFileChunk calls of up to one socket buffer,
+//! several per wakeup.  For each it prints the throughput and the number of select wakeups.
+//!
+//! usage: mvsocketdriver [--sizemb <megabytes>] [--downloads <connections>] [--port <port>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <vector>
+using namespace std;
+
+#include "SocketsClass.h"
+#include "TickCount.h"
+
+const char *sTestFilename = "mvsocketdriver.tmp";
+const size_t iOldChunkSize = 1200;   //!< bytes per connection per wakeup, as ServerFileAgent used to send
+const size_t iSendChunkSize = 65536;   //!< as ServerFileAgent's iSendChunkSize
+const size_t iMaxBytesPerPass = 4 * iSendChunkSize;   //!< as ServerFileAgent's iMaxBytesPerPass
+
+//! One download in flight: the sending end, the receiving end, and how far each has got
+class DOWNLOAD
+{
+public:
+    mvsocket Sender;
+    mvsocket Receiver;
+    FILE *FileHandle;
+    off_t Offset;
+    size_t iBytesReceived;
+};
+
+//! writes a file of iSize bytes of test data
+bool CreateTestFile( size_t iSize )
+{
+    FILE *TestFile = fopen( sTestFilename, "wb" );
+    if( TestFile == NULL )
+    {
+        printf( "couldnt create %s\n", sTestFilename );
+        return false;
+    }
+    char Block[ 4096 ];
+    for( int i = 0; i < (int)sizeof( Block ); i++ )
+    {
+        Block[i] = (char)( i * 7 );
+    }
+    for( size_t iWritten = 0; iWritten < iSize; iWritten += sizeof( Block ) )
+    {
+        size_t iBytes = iSize - iWritten < sizeof( Block ) ? iSize - iWritten : sizeof( Block );
+        fwrite( Block, 1, iBytes, TestFile );
+    }
+    fclose( TestFile );
+    return true;
+}
+
+//! connects iNumDownloads loopback connections through Listener, with the file open for each
+bool OpenDownloads( mvsocket &Listener, int iPort, int iNumDownloads, vector< DOWNLOAD > &Downloads )
+{
+    Downloads.resize( iNumDownloads );
+    for( int i = 0; i < iNumDownloads; i++ )
+    {
+        Downloads[i].Receiver.Init();
+        if( !Downloads[i].Receiver.ConnectToServer( inet_addr( "127.0.0.1" ), iPort ) )
+        {
+            printf( "couldnt connect to port %i\n", iPort );
+            return false;
+        }
+        Downloads[i].Sender = Listener.AcceptNewConnection();
+        Downloads[i].Sender.SetNonBlocking( true );
+        Downloads[i].FileHandle = fopen( sTestFilename, "rb" );
+        Downloads[i].Offset = 0;
+        Downloads[i].iBytesReceived = 0;
+    }
+    return true;
+}
+
+void CloseDownloads( vector< DOWNLOAD > &Downloads )
+{
+    for( int i = 0; i < (int)Downloads.size(); i++ )
+    {
+        fclose( Downloads[i].FileHandle );
+        Downloads[i].Sender.Close();
+        Downloads[i].Receiver.Close();
+    }
+    Downloads.clear();
+}
+
+//! sends the next part of the file on rDownload; returns false on error
+bool SendSome( DOWNLOAD &rDownload, size_t iFileSize, bool bSendFile )
+{
+    if( bSendFile )
+    {
+        size_t iBytesThisPass = 0;
+        while( (size_t)rDownload.Offset < iFileSize && iBytesThisPass < iMaxBytesPerPass )
+        {
+            size_t iBytes = iFileSize - rDownload.Offset < iSendChunkSize ? iFileSize - rDownload.Offset : iSendChunkSize;
+            ssize_t result = rDownload.Sender.SendFileChunk( fileno( rDownload.FileHandle ), rDownload.Offset, iBytes );
+            if( result < 0 )
+            {
+                return false;
+            }
+            if( result == 0 )
+            {
+                break;
+            }
+            iBytesThisPass += result;
+        }
+    }
+    else
+    {
+        char Buffer[ iOldChunkSize ];
+        fseek( rDownload.FileHandle, rDownload.Offset, SEEK_SET );
+        size_t iBytes = fread( Buffer, 1, iOldChunkSize, rDownload.FileHandle );
+        ssize_t result = rDownload.Sender.SendChunk( Buffer, iBytes );
+        if( result < 0 )
+        {
+            return false;
+        }
+        rDownload.Offset += result;
+    }
+    return true;
+}
+
+//! serves the test file to iNumDownloads connections; returns false on error
+bool RunBenchmark( const char *sName, bool bSendFile, mvsocket &Listener, int iPort, int iNumDownloads, size_t iFileSize )
+{
+    vector< DOWNLOAD > Downloads;
+    if( !OpenDownloads( Listener, iPort, iNumDownloads, Downloads ) )
+    {
+        return false;
+    }
+
+    char ReceiveBuffer[ 65536 ];
+    int iNumWakeups = 0;
+    int iStartTickCount = MVGetTickCount();
+    int iNumComplete = 0;
+    while( iNumComplete < iNumDownloads )
+    {
+        vector< const mvsocket * > ReadSockets;
+        vector< const mvsocket * > WriteSockets;
+        for( int i = 0; i < iNumDownloads; i++ )
+        {
+            if( Downloads[i].iBytesReceived < iFileSize )
+            {
+                ReadSockets.push_back( &Downloads[i].Receiver );
+            }
+            if( (size_t)Downloads[i].Offset < iFileSize )
+            {
+                WriteSockets.push_back( &Downloads[i].Sender );
+            }
+        }
+        SocketsReadWriteBlock( 1000, ReadSockets, WriteSockets );
+        iNumWakeups++;
+
+        for( int i = 0; i < iNumDownloads; i++ )
+        {
+            if( (size_t)Downloads[i].Offset < iFileSize && !SendSome( Downloads[i], iFileSize, bSendFile ) )
+            {
+                printf( "send failed\n" );
+                CloseDownloads( Downloads );
+                return false;
+            }
+            while( Downloads[i].iBytesReceived < iFileSize && Downloads[i].Receiver.DataAvailable() )
+            {
+                int iBytes = Downloads[i].Receiver.Receive( ReceiveBuffer, sizeof( ReceiveBuffer ) );
+                if( iBytes <= 0 )
+                {
+                    printf( "receive failed\n" );
+                    CloseDownloads( Downloads );
+                    return false;
+                }
+                Downloads[i].iBytesReceived += iBytes;
+                if( Downloads[i].iBytesReceived >= iFileSize )
+                {
+                    iNumComplete++;
+                }
+            }
+        }
+    }
+
+    int iMilliseconds = MVGetTickCount() - iStartTickCount;
+    if( iMilliseconds < 1 )
+    {
+        iMilliseconds = 1;
+    }
+    double dMegabytes = (double)iFileSize * iNumDownloads / ( 1024 * 1024 );
+    printf( "%-10s %8.1f MB in %6i ms: %8.1f MB/s, %8i select wakeups\n",
+            sName, dMegabytes, iMilliseconds, dMegabytes * 1000 / iMilliseconds, iNumWakeups );
+
+    CloseDownloads( Downloads );
+    return true;
+}
+
+int main( int argc, char *argv[] )
+{
+    int iSizeMB = 16;
+    int iNumDownloads = 8;
+    int iPort = 22190;
+    for( int i = 1; i + 1 < argc; i += 2 )
+    {
+        if( strcmp( argv[i], "--sizemb" ) == 0 )
+        {
+            iSizeMB = atoi( argv[i + 1] );
+        }
+        else if( strcmp( argv[i], "--downloads" ) == 0 )
+        {
+            iNumDownloads = atoi( argv[i + 1] );
+        }
+        else if( strcmp( argv[i], "--port" ) == 0 )
+        {
+            iPort = atoi( argv[i + 1] );
+        }
+        else
+        {
+            printf( "usage: %s [--sizemb <megabytes>] [--downloads <connections>] [--port <port>]\n", argv[0] );
+            return 1;
+        }
+    }
+
+    mvsocket::InitSocketSystem();
+
+    size_t iFileSize = (size_t)iSizeMB * 1024 * 1024;
+    if( !CreateTestFile( iFileSize ) )
+    {
+        return 1;
+    }
+
+    mvsocket Listener;
+    Listener.Init();
+    if( !Listener.Listen( inet_addr( "127.0.0.1" ), iPort ) )
+    {
+        printf( "couldnt listen on port %i\n", iPort );
+        return 1;
+    }
+
+    printf( "serving %i MB to %i loopback connections\n", iSizeMB, iNumDownloads );
+    bool bOk = RunBenchmark( "1200 bytes", false, Listener, iPort, iNumDownloads, iFileSize )
+               && RunBenchmark( "sendfile", true, Listener, iPort, iNumDownloads, iFileSize );
+
+    Listener.Close();
+    remove( sTestFilename );
+    mvsocket::EndSocketSystem();
+    return bOk ? 0 : 1;
+}
@@ -57,6 +57,10 @@ class CallbacksFromCPPClass( osmpclient.CallbackToPythonClass ):
       self.SimSocket = None
       self.bSpawnNewWindows = False
       self.WorldInitiated = False
+      self.ManifestSession = None
+      self.ManifestEpoch = None
+      self.WorldSession = None
+      self.WorldVersion = None
       self.MessageFragment = ""
       self.GUIApp = None
       self.pyDevices = pyDevices.pyDevices()
@@ -186,7 +190,33 @@ class CallbacksFromCPPClass( osmpclient.CallbackToPythonClass ):
       self.EditorMgr.Clear()
       self.Selector.Clear()
 
-      self.SendToServer( "<requestworldstate />\n" )
+      # world and file caches were cleared, so we need everything again
+      self.ManifestSession = None
+      self.ManifestEpoch = None
+      self.WorldSession = None
+      self.WorldVersion = None
+      self.RequestWorldState()
+
+   def RequestWorldState( self ):
+      # if we still have the world or the files from before, only ask for changes since
+      message = '<requestworldstate'
+      if self.ManifestSession != None:
+         message = message + ' manifestsession="' + self.ManifestSession + '" manifestepoch="' + self.ManifestEpoch + '"'
+      if self.WorldSession != None:
+         message = message + ' worldsession="' + self.WorldSession + '" worldversion="' + self.WorldVersion + '"'
+      self.SendToServer( message + ' />\n' )
+
+   def RegisterFileFromXMLString( self, Command, message ):
+      if( Command == "texture" ):
+         print " ** CALL RegTextFromXML val: texture in ProcessXML"
+         self.RendererTexturing.RegisterTextureFromXMLString( message )
+
+      elif( Command == "terrain" ):
+         print " ** Call RegisterTerrainFromXML()"
+         self.ClientTerrainFunctions.RegisterTerrainFromXMLString( message )
+
+      elif( Command == "meshfile" ):
+         self.MeshFileMgmt.RegisterFileFromXMLString( message );
 
    def CreateNewObject( self, sType, sFilename, x, y, z ):
       print  "creating object at coords " + str( x ) + " " + str( y ) + " " + str( z )
@@ -259,23 +289,33 @@ class CallbacksFromCPPClass( osmpclient.CallbackToPythonClass ):
              self.World.SetSkyboxChecksum( newskyboxchecksum.encode('utf-8') )
              print " ** NEW  CLIENT SKYBOX " + str( self.World.GetSkyboxChecksum() )
 
-          elif( Command == "texture" ):
-             print " ** CALL RegTextFromXML val: texture in ProcessXML"
-             self.RendererTexturing.RegisterTextureFromXMLString( message )
-      
-          elif( Command == "terrain" ):
-             print " ** Call RegisterTerrainFromXML()"
-             self.ClientTerrainFunctions.RegisterTerrainFromXMLString( message )
-               
-          elif( Command == "meshfile" ):
-             self.MeshFileMgmt.RegisterFileFromXMLString( message );
+          elif( Command == "texture" or Command == "terrain" or Command == "meshfile" ):
+             self.RegisterFileFromXMLString( Command, message )
+
+          elif( Command == "filemanifest" ):
+             for FileNode in dom.documentElement.childNodes:
+                if FileNode.nodeType == FileNode.ELEMENT_NODE:
+                   self.RegisterFileFromXMLString( FileNode.tagName, FileNode.toxml().encode('utf-8') )
+             self.ManifestSession = dom.documentElement.getAttribute("session").encode('utf-8')
+             self.ManifestEpoch = dom.documentElement.getAttribute("epoch").encode('utf-8')
              
+          elif( Command == "worldversion" ):
+             # full means the server couldn't send just the changes since our version, so is sending everything
+             if dom.documentElement.getAttribute("full") == "true" and self.WorldSession != None:
+                self.World.Clear()
+                self.Selector.Clear()
+             self.WorldSession = dom.documentElement.getAttribute("session").encode('utf-8')
+             self.WorldVersion = dom.documentElement.getAttribute("version").encode('utf-8')
+
           elif( Command == "objectmove" ):
              iReference = int( dom.documentElement.getAttribute("ireference") )
              if iReference != 0:
                 if not self.Selector.IsSelected( iReference ) and iReference != self.iMyReference:
                    self.Animator.MoveObjectFromXMLString( message );
                 self.World.UpdateObjectXMLString( message )
+
+          elif( Command == "objecttrack" ):
+             self.Animator.SetTrackFromXMLString( message )
           
           elif( Command == "inforesponse" ):
              if dom.documentElement.getAttribute("clienteditreference") != None:
@@ -511,7 +551,7 @@ class CallbacksFromCPPClass( osmpclient.CallbackToPythonClass ):
    def DoEvents( self ):
       try:
          if not self.WorldInitiated:
-            self.SendToServer("<requestworldstate />\015\012")
+            self.RequestWorldState()
             self.WorldInitiated = True
       
          # print ">>>Doevents"
@@ -0,0 +1,245 @@
+// Copyright Hugh Perkins 2004
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURVector3E. See the GNU General Public License for
+//  more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program in the file licence.txt; if not, write to the
+// Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-
+// 1307 USA
+// You can find the licence also on the web at:
+// http://www.opensource.org/licenses/gpl-license.php
+//
+//! \file
+//! \brief transformsweepdriver: benchmark of a full-world transform sweep, before and after ObjectTransformStore
+//!
+//! Runs the same per-frame integration, pos += vVelocity * dt and rot += vAngularVelocity * dt, over every
+//! object in a world, twice:
+//! - before: the way the transforms used to be stored, inside each object, which is allocated on its own
+//!   between the other allocations the world makes per object (names, scripts, xml).  OldLayoutCube has the
+//!   fields of Object, Prim and Cube as they were laid out before ObjectTransformStore, and the sweep
+//!   goes through an array of pointers, like mvWorldStorage::p_Objects
+//! - after: the ObjectTransformStore arrays, block by block, skipping free slots
+//!
+//! One object in every 16 is deleted before the sweeps, so the store has holes in it, as it would in a running world.
+//! Prints milliseconds and objects per second for each, and checks both end up with the same positions.
+//!
+//! usage: transformsweepdriver [--objects <number of objects>] [--sweeps <number of sweeps>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+using namespace std;
+
+#include "BasicTypes.h"
+#include "Math.h"
+#include "ObjectTransformStore.h"
+#include "TickCount.h"
+
+//! Fields of a Cube as they were laid out before ObjectTransformStore; only the transforms are used by the sweep
+class OldLayoutCube
+{
+public:
+    virtual ~OldLayoutCube(){}
+
+    // Object
+    int iReference;
+    int iParentReference;
+    char ObjectType[17];
+    char sDeepObjectType[17];
+    int iownerreference;
+    Vector3 pos;
+    Rot rot;
+    char sScriptReference[33];
+    char sObjectName[65];
+    bool bPhysicsEnabled;
+    bool bGravityEnabled;
+    bool bPhantom;
+    bool bTerrain;
+    Vector3 vVelocity;
+    Vector3 vAngularVelocity;
+    Vector3 vLocalForce;
+    Vector3 vLocalTorque;
+
+    // Prim
+    char PrimType[17];
+    Vector3 scale;
+
+    // Cube
+    Color color0;
+    char sTextureReference[33];
+};
+
+const int iDeleteEvery = 16;           //!< one object in this many is deleted before the sweeps
+const int iOtherAllocationSize = 200;  //!< bytes allocated between objects, standing in for the rest of what the world allocates per object
+const float fTimeStep = 0.01f;         //!< dt for each sweep
+
+//! velocities of object i, the same in both layouts
+static void GetVelocities( int i, Vector3 &Velocity, Vector3 &AngularVelocity )
+{
+    Velocity = Vector3( (float)( i % 7 ), (float)( i % 5 ) - 2.0f, 1.0f );
+    AngularVelocity = Vector3( 0.0f, 0.0f, (float)( i % 3 ) * 0.1f );
+}
+
+//! prints the time taken by a sweep run
+static void PrintResult( const char *sLayoutName, int iNumObjects, int iNumSweeps, int iMilliseconds )
+{
+    if( iMilliseconds < 1 )
+    {
+        iMilliseconds = 1;
+    }
+    printf( "  %-24s %8i objects x %6i sweeps in %6i ms: %12.0f objects/s\n", sLayoutName, iNumObjects, iNumSweeps, iMilliseconds,
+            (double)iNumObjects * iNumSweeps * 1000.0 / iMilliseconds );
+}
+
+//! sweeps OldLayoutCubes through a pointer array, returning the sum of their positions afterwards
+double SweepOldLayout( int iNumObjects, int iNumSweeps )
+{
+    vector<OldLayoutCube *> Objects;
+    vector<char *> OtherAllocations;
+    for( int i = 0; i < iNumObjects; i++ )
+    {
+        OldLayoutCube *pCube = new OldLayoutCube;
+        pCube->iReference = i;
+        GetVelocities( i, pCube->vVelocity, pCube->vAngularVelocity );
+        Objects.push_back( pCube );
+        OtherAllocations.push_back( new char[ iOtherAllocationSize ] );
+    }
+    // mvWorldStorage::DeleteObject moves the last object into the deleted one's place
+    for( int i = (int)Objects.size() - 1; i >= 0; i-- )
+    {
+        if( i % iDeleteEvery == 0 )
+        {
+            delete Objects[i];
+            Objects[i] = Objects.back();
+            Objects.pop_back();
+        }
+    }
+
+    int iNumLiveObjects = (int)Objects.size();
+    int iStartTickCount = MVGetTickCount();
+    for( int iSweep = 0; iSweep < iNumSweeps; iSweep++ )
+    {
+        for( int i = 0; i < iNumLiveObjects; i++ )
+        {
+            OldLayoutCube *pCube = Objects[i];
+            pCube->pos = pCube->pos + pCube->vVelocity * fTimeStep;
+            pCube->rot.x += pCube->vAngularVelocity.x * fTimeStep;
+            pCube->rot.y += pCube->vAngularVelocity.y * fTimeStep;
+            pCube->rot.z += pCube->vAngularVelocity.z * fTimeStep;
+        }
+    }
+    PrintResult( "objects (before)", iNumLiveObjects, iNumSweeps, MVGetTickCount() - iStartTickCount );
+
+    double dChecksum = 0;
+    for( int i = 0; i < iNumLiveObjects; i++ )
+    {
+        dChecksum += Objects[i]->pos.x + Objects[i]->pos.y + Objects[i]->pos.z + Objects[i]->rot.z;
+        delete Objects[i];
+    }
+    for( int i = 0; i < (int)OtherAllocations.size(); i++ )
+    {
+        delete[] OtherAllocations[i];
+    }
+    return dChecksum;
+}
+
+//! sweeps the arrays of an ObjectTransformStore, returning the sum of the positions afterwards
+double SweepTransformStore( int iNumObjects, int iNumSweeps )
+{
+    ObjectTransformStore *pStore = new ObjectTransformStore;
+    char OwnerStandIn = 0;  // the sweep only tests owners for NULL
+    for( int i = 0; i < iNumObjects; i++ )
+    {
+        int iSlot = pStore->AllocateSlot( reinterpret_cast<Object *>( &OwnerStandIn ) );
+        if( iSlot == -1 )
+        {
+            printf( "  store full after %i objects\n", i );
+            delete pStore;
+            return 0;
+        }
+        GetVelocities( i, pStore->Velocity( iSlot ), pStore->AngularVelocity( iSlot ) );
+    }
+    int iNumLiveObjects = iNumObjects;
+    for( int i = 0; i < iNumObjects; i++ )
+    {
+        if( i % iDeleteEvery == 0 )
+        {
+            pStore->FreeSlot( i );
+            iNumLiveObjects--;
+        }
+    }
+
+    int iStartTickCount = MVGetTickCount();
+    for( int iSweep = 0; iSweep < iNumSweeps; iSweep++ )
+    {
+        for( int iBlockNum = 0; iBlockNum < pStore->GetNumBlocks(); iBlockNum++ )
+        {
+            OBJECTTRANSFORMBLOCK &Block = pStore->GetBlock( iBlockNum );
+            const int iNumSlots = pStore->GetNumSlotsUsedInBlock( iBlockNum );
+            for( int i = 0; i < iNumSlots; i++ )
+            {
+                if( Block.Owners[i] != NULL )
+                {
+                    Block.Pos[i] = Block.Pos[i] + Block.Velocity[i] * fTimeStep;
+                    Block.Rotation[i].x += Block.AngularVelocity[i].x * fTimeStep;
+                    Block.Rotation[i].y += Block.AngularVelocity[i].y * fTimeStep;
+                    Block.Rotation[i].z += Block.AngularVelocity[i].z * fTimeStep;
+                }
+            }
+        }
+    }
+    PrintResult( "ObjectTransformStore (after)", iNumLiveObjects, iNumSweeps, MVGetTickCount() - iStartTickCount );
+
+    double dChecksum = 0;
+    for( int i = 0; i < pStore->GetNumSlotsUsed(); i++ )
+    {
+        if( pStore->Owner( i ) != NULL )
+        {
+            dChecksum += pStore->Pos( i ).x + pStore->Pos( i ).y + pStore->Pos( i ).z + pStore->Rotation( i ).z;
+        }
+    }
+    delete pStore;
+    return dChecksum;
+}
+
+int main( int argc, char *argv[] )
+{
+    int iNumObjects = 50000;
+    int iNumSweeps = 200;
+    for( int i = 1; i + 1 < argc; i += 2 )
+    {
+        if( strcmp( argv[i], "--objects" ) == 0 )
+        {
+            iNumObjects = atoi( argv[i + 1] );
+        }
+        else if( strcmp( argv[i], "--sweeps" ) == 0 )
+        {
+            iNumSweeps = atoi( argv[i + 1] );
+        }
+        else
+        {
+            printf( "usage: %s [--objects <number of objects>] [--sweeps <number of sweeps>]\n", argv[0] );
+            return 1;
+        }
+    }
+
+    double dOldLayoutChecksum = SweepOldLayout( iNumObjects, iNumSweeps );
+    double dStoreChecksum = SweepTransformStore( iNumObjects, iNumSweeps );
+    // the sums are in a different order, so allow for rounding
+    if( fabs( dOldLayoutChecksum - dStoreChecksum ) > fabs( dOldLayoutChecksum ) * 1e-9 )
+    {
+        printf( "  layouts disagree: objects summed to %f, ObjectTransformStore to %f\n", dOldLayoutChecksum, dStoreChecksum );
+        return 1;
+    }
+    return 0;
+}